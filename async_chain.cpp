@@ -0,0 +1,116 @@
+#include "async_chain.h"
+#include "pool_allocator.h"
+
+#include <new>
+
+struct AsyncStep {
+    std::function<void()> fn;
+    ThreadHop* thread;      // Where it runs, null = a worker
+    AsyncStep* next;
+    JobSystem* jobs;
+    JobCounter* done;       // The chain's, if any
+};
+
+// Steps live from append() until they have run, so they are recycled
+// rather than allocated per chain
+static BlockPool& stepPool()
+{
+    static BlockPool* pool = new BlockPool(sizeof(AsyncStep), 256, MEMORY_JOBS);
+    return *pool;
+}
+
+static void deleteStep(AsyncStep* step)
+{
+    step->~AsyncStep();
+    stepPool().release(step);
+}
+
+static void dispatch(AsyncStep* step);
+
+// Run 'step', then start the one after it or, at the end, finish the chain
+static void runStep(AsyncStep* step)
+{
+    step->fn();
+    AsyncStep* next = step->next;
+    JobSystem* jobs = step->jobs;
+    JobCounter* done = step->done;
+    deleteStep(step);
+    if (next)
+        dispatch(next);
+    else if (done)
+        jobs->endWork(*done);
+}
+
+static void dispatch(AsyncStep* step)
+{
+    if (step->thread)
+        step->thread->post(step);
+    else
+        step->jobs->schedule([step] { runStep(step); });
+}
+
+void ThreadHop::post(AsyncStep* step)
+{
+    posted.push(step);
+    if (wake)
+        wake();
+}
+
+int ThreadHop::runPending(int maxSteps)
+{
+    if (ready.empty())
+        posted.drain(ready);
+    int run = 0;
+    while (run < maxSteps && !ready.empty()) {
+        AsyncStep* step = ready.front();
+        ready.pop_front();
+        runStep(step);
+        run++;
+    }
+    return run;
+}
+
+AsyncChain::~AsyncChain()
+{
+    while (first) {
+        AsyncStep* next = first->next;
+        deleteStep(first);
+        first = next;
+    }
+}
+
+AsyncChain& AsyncChain::then(std::function<void()> step)
+{
+    append(std::move(step), nullptr);
+    return *this;
+}
+
+AsyncChain& AsyncChain::on(ThreadHop& thread, std::function<void()> step)
+{
+    append(std::move(step), &thread);
+    return *this;
+}
+
+void AsyncChain::append(std::function<void()> fn, ThreadHop* thread)
+{
+    AsyncStep* step = new (stepPool().allocate()) AsyncStep{ std::move(fn), thread, nullptr, jobs, nullptr };
+    if (last)
+        last->next = step;
+    else
+        first = step;
+    last = step;
+}
+
+void AsyncChain::run(JobCounter* done)
+{
+    if (!first)
+        return;
+    for (AsyncStep* step = first; step; step = step->next)
+        step->done = done;
+    if (done)
+        jobs->beginWork(*done);
+    AsyncStep* start = first;
+    first = nullptr;
+    last = nullptr;
+    dispatch(start);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "job_system.h"
+#include "mpsc_queue.h"
+
+#include <climits>
+#include <deque>
+#include <functional>
+
+struct AsyncStep;
+
+// Steps of AsyncChains hopped onto a thread that isn't a worker: the
+// render thread for GL calls, or an I/O thread for disk access. That thread
+// runs them from its own loop with runPending(). Drain it before it goes
+// away; a chain whose step is dropped never finishes.
+struct ThreadHop {
+    ThreadHop() = default;
+    ThreadHop(const ThreadHop&) = delete;
+    ThreadHop& operator=(const ThreadHop&) = delete;
+
+    // Owner thread: run the steps queued so far, oldest first and at most
+    // 'maxSteps'. Returns the steps run.
+    int runPending(int maxSteps = INT_MAX);
+    // Any thread: queue a chain's step (see AsyncChain)
+    void post(AsyncStep* step);
+
+    // Called (on the posting thread) after a step is queued, to wake an
+    // owner that sleeps between batches; optional
+    std::function<void()> wake;
+
+private:
+    MPSCQueue<AsyncStep*> posted;   // Pushed by any thread
+    std::deque<AsyncStep*> ready;   // Owner side, in post order
+};
+
+// A pipeline written as a linear list of steps, each started once the one
+// before has returned: on a worker of the job system by default, or hopped
+// onto another thread through its ThreadHop. It stands in for a coroutine
+// (read -> decompress -> light -> mesh -> upload on the GL thread) without
+// C++20: state shared between steps lives in what they capture, typically
+// one object held by pointer, and the steps themselves come from a block
+// pool, so a capture that fits std::function's small buffer allocates
+// nothing.
+//
+//     AsyncChain(jobs)
+//         .then([load] { decompress(*load); })
+//         .on(glThread, [load] { upload(*load); })
+//         .run(&pending);
+struct AsyncChain {
+    explicit AsyncChain(JobSystem& jobs) : jobs(&jobs) {}
+    AsyncChain(const AsyncChain&) = delete;
+    AsyncChain& operator=(const AsyncChain&) = delete;
+    // Frees the steps of a chain that was never run
+    ~AsyncChain();
+
+    // Append a step run on a worker
+    AsyncChain& then(std::function<void()> step);
+    // Append a step run by 'thread' in its runPending()
+    AsyncChain& on(ThreadHop& thread, std::function<void()> step);
+
+    // Start the first step. 'done' (optional) counts the whole chain, until
+    // its last step returns, so jobs can depend on it or JobSystem::wait()
+    // for it. The chain object can go away right after.
+    void run(JobCounter* done = nullptr);
+
+private:
+    void append(std::function<void()> step, ThreadHop* thread);
+
+    JobSystem* jobs;
+    AsyncStep* first = nullptr;
+    AsyncStep* last = nullptr;
+};
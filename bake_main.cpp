@@ -0,0 +1,303 @@
+#include "chunk_generator.h"
+#include "chunk_mesher.h"
+#include "generation_cache.h"
+#include "job_system.h"
+#include "light_engine.h"
+#include "mesh_cache.h"
+#include "profiler.h"
+#include "region_file.h"
+#include "world.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// World baker: generates and lights a circle of chunk columns offline and
+// saves it, light included, into a world directory's region files, so a
+// client or server started on it loads those columns lit instead of
+// generating and lighting them live.
+//
+// Works a region at a time: the world streams a circle of columns around
+// the region's columns (generation on every core, lighting jobs on all of
+// them too) until each column of the region and its neighbours is lit, then
+// saves the region's columns with baked light. With --mesh their meshes
+// are built too and written to the region's MeshCache sidecar, so loading
+// them is I/O rather than meshing. Regions already saved with baked light
+// (and meshes) are skipped, so an interrupted bake resumes where it stopped.
+
+const char* DEFAULT_WORLD_DIR = "world";
+const int DEFAULT_RADIUS = 64;          // Columns
+// Streamed beyond the farthest column baked: its neighbours' neighbours,
+// which light reaches it from
+const int STREAM_MARGIN = 2;
+const int LOADS_PER_UPDATE = 4096;
+// The client's default builder, whose meshes the sidecars hold
+const MeshMode BAKED_MESH_MODE = MESH_GREEDY;
+// Snapshots and meshes in flight while a region is meshed
+const size_t MESH_BUDGET_BYTES = 256 * 1024 * 1024;
+
+// Set by Ctrl+C: the region being baked is finished and saved, then the bake stops
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+// Every chunk of the column is loaded and lit
+static bool columnLit(const World& world, const glm::ivec2& column)
+{
+    for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+        const Chunk* chunk = world.getChunk(glm::ivec3(column.x, y, column.y));
+        if (!chunk || chunk->state != CHUNK_LIT)
+            return false;
+    }
+    return true;
+}
+
+static bool columnBaked(RegionStore& storage, const glm::ivec2& column)
+{
+    for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++)
+        if (!storage.hasBakedLight(glm::ivec3(column.x, y, column.y)))
+            return false;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* worldDir = DEFAULT_WORLD_DIR;
+    uint32_t seed = 0;
+    glm::ivec2 center(0);
+    int radius = DEFAULT_RADIUS;
+    int threadCount = 0;
+    size_t generationCacheMB = 256;
+    bool bakeMeshes = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--world") == 0 && i + 1 < argc) {
+            worldDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--center") == 0 && i + 2 < argc) {
+            center.x = atoi(argv[++i]);
+            center.y = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--radius") == 0 && i + 1 < argc) {
+            radius = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--gen-cache-mb") == 0 && i + 1 < argc) {
+            generationCacheMB = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--mesh") == 0) {
+            bakeMeshes = true;
+        }
+        else {
+            std::cout << "Usage: " << argv[0] << " [--world <directory>] [--seed <n>] [--center <column x> <column z>] [--radius <columns>] [--threads <n>] [--gen-cache-mb <n>] [--mesh]" << std::endl;
+            return 1;
+        }
+    }
+
+    RegionStore storage;
+    if (!storage.open(worldDir, seed)) {
+        std::cout << "Bake: can't use " << worldDir << std::endl;
+        return 1;
+    }
+
+    // The columns to bake, grouped by region; regions in serpentine order so
+    // each one streams in next to the last
+    std::vector<std::vector<glm::ivec2>> regions;
+    int firstX = floorDivRegion(center.x - radius), lastX = floorDivRegion(center.x + radius);
+    int firstZ = floorDivRegion(center.y - radius), lastZ = floorDivRegion(center.y + radius);
+    int totalColumns = 0;
+    for (int rx = firstX; rx <= lastX; rx++) {
+        bool reversed = (rx - firstX) & 1;
+        for (int step = 0; step <= lastZ - firstZ; step++) {
+            int rz = reversed ? lastZ - step : firstZ + step;
+            std::vector<glm::ivec2> columns;
+            for (int x = rx * REGION_SIZE; x < (rx + 1) * REGION_SIZE; x++) {
+                for (int z = rz * REGION_SIZE; z < (rz + 1) * REGION_SIZE; z++) {
+                    glm::ivec2 d = glm::ivec2(x, z) - center;
+                    if (d.x * d.x + d.y * d.y <= radius * radius)
+                        columns.push_back(glm::ivec2(x, z));
+                }
+            }
+            if (!columns.empty()) {
+                totalColumns += (int)columns.size();
+                regions.push_back(std::move(columns));
+            }
+        }
+    }
+
+    profilerSetThreadName("Main");
+    JobSystem jobSystem;
+    jobSystem.start(threadCount);
+    GenerationCache generationCache;
+    generationCache.budgetBytes = generationCacheMB * 1024 * 1024;
+    ChunkGenerator generator;
+    generator.seed = seed;
+    generator.storage = &storage;
+    // Regions overlap their neighbours' streaming circles: those chunks come back from here
+    if (generationCacheMB > 0)
+        generator.cache = &generationCache;
+    generator.start(jobSystem);
+    LightEngine lighting;
+    lighting.maxJobs = jobSystem.workerCount();
+    lighting.start(jobSystem);
+    World world;
+    world.seed = seed;
+    world.generator = &generator;
+    world.storage = &storage;
+    world.lighting = &lighting;
+    ChunkMesher mesher;
+    mesher.budgetBytes = MESH_BUDGET_BYTES;
+    mesher.start(jobSystem);
+    MeshCacheWriter meshWriter;
+
+    std::cout << "Bake: " << totalColumns << " columns in " << regions.size() << " regions around ("
+        << center.x << ", " << center.y << "), radius " << radius << ", " << jobSystem.workerCount() << " threads" << std::endl;
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    int doneColumns = 0;
+    int bakedColumns = 0;   // This run, for the rate
+    int savedChunks = 0;
+    int meshedChunks = 0;
+    std::vector<Chunk*> loaded;
+    std::vector<glm::ivec3> unloaded;
+    for (size_t r = 0; r < regions.size() && !stopRequested; r++) {
+        const std::vector<glm::ivec2>& columns = regions[r];
+        glm::ivec2 regionCoord(floorDivRegion(columns[0].x), floorDivRegion(columns[0].y));
+        glm::ivec3 firstChunk(columns[0].x, 0, columns[0].y);
+        bool done = std::all_of(columns.begin(), columns.end(), [&](const glm::ivec2& column) {
+            return columnBaked(storage, column);
+        }) && (!bakeMeshes || meshCacheCurrent(worldDir, firstChunk, BAKED_MESH_MODE));
+        if (done) {
+            doneColumns += (int)columns.size();
+            std::cout << "Bake: region (" << regionCoord.x << ", " << regionCoord.y << ") already baked" << std::endl;
+            continue;
+        }
+
+        // Stream the smallest circle around the columns (regions on the edge
+        // of the bake hold few) until they and their neighbours are lit
+        glm::ivec2 low = columns[0], high = columns[0];
+        for (const glm::ivec2& column : columns) {
+            low = glm::min(low, column);
+            high = glm::max(high, column);
+        }
+        glm::ivec2 streamCenter = (low + high) / 2;
+        int streamRadius = 0;
+        for (const glm::ivec2& column : columns) {
+            glm::ivec2 d = column - streamCenter;
+            while (d.x * d.x + d.y * d.y > streamRadius * streamRadius)
+                streamRadius++;
+        }
+        streamRadius += STREAM_MARGIN;
+        glm::ivec3 centerChunk(streamCenter.x, WORLD_HEIGHT_CHUNKS / 2, streamCenter.y);
+        Clock::time_point regionStart = Clock::now();
+        for (;;) {
+            world.updateStreaming(streamCenter, streamRadius, LOADS_PER_UPDATE, loaded, unloaded);
+            lighting.update(world, centerChunk);
+            world.releaseUnloaded();
+            loaded.clear();
+            unloaded.clear();
+
+            bool lit = true;
+            for (size_t c = 0; c < columns.size() && lit; c++)
+                for (int dx = -1; dx <= 1 && lit; dx++)
+                    for (int dz = -1; dz <= 1 && lit; dz++)
+                        lit = columnLit(world, columns[c] + glm::ivec2(dx, dz));
+            if (lit)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // Chunks read back with their baked light are already saved
+        for (const glm::ivec2& column : columns) {
+            for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+                Chunk* chunk = world.getChunk(glm::ivec3(column.x, y, column.y));
+                if (!chunk->bakedLight) {
+                    chunk->bakedLight = true;
+                    chunk->unsaved = true;
+                }
+            }
+        }
+        savedChunks += world.saveAll();
+
+        // Meshed from the same snapshots the client takes once it has the
+        // neighbours, versions indexing the snapshots' hashes
+        if (bakeMeshes) {
+            std::vector<Chunk*> chunks;
+            for (const glm::ivec2& column : columns) {
+                for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+                    Chunk* chunk = world.getChunk(glm::ivec3(column.x, y, column.y));
+                    if (!chunk->isUniform() || chunk->uniformBlock() != BLOCK_AIR)
+                        chunks.push_back(chunk);
+                }
+            }
+            std::vector<uint64_t> hashes;
+            size_t pending = 0;
+            MeshResult mesh;
+            while (hashes.size() < chunks.size() || pending > 0) {
+                while (hashes.size() < chunks.size() && !mesher.overBudget()) {
+                    std::unique_ptr<ChunkVoxels> snapshot(new ChunkVoxels());
+                    world.snapshotChunk(*chunks[hashes.size()], *snapshot);
+                    uint32_t version = (uint32_t)hashes.size();
+                    hashes.push_back(meshSnapshotHash(*snapshot));
+                    mesher.submit(chunks[version]->coord, version, BAKED_MESH_MODE, std::move(snapshot), glm::ivec3(CHUNK_SIZE / 2));
+                    pending++;
+                }
+                if (mesher.poll(mesh)) {
+                    meshWriter.add(hashes[mesh.version], mesh);
+                    pending--;
+                }
+                else {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            meshedChunks += meshWriter.count();
+            if (!meshWriter.write(worldDir, firstChunk, BAKED_MESH_MODE))
+                std::cout << "Bake: can't write " << meshCachePath(worldDir, firstChunk) << std::endl;
+        }
+        doneColumns += (int)columns.size();
+        bakedColumns += (int)columns.size();
+
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        double regionSeconds = std::chrono::duration<double>(Clock::now() - regionStart).count();
+        double perColumn = elapsed / bakedColumns;
+        std::cout << "Bake: region (" << regionCoord.x << ", " << regionCoord.y << ") in " << regionSeconds << " s, "
+            << doneColumns << "/" << totalColumns << " columns (" << 100 * doneColumns / std::max(totalColumns, 1) << "%), "
+            << (int)(bakedColumns * WORLD_HEIGHT_CHUNKS / elapsed) << " chunks/s, "
+            << (int)(perColumn * (totalColumns - doneColumns)) << " s left" << std::endl;
+    }
+
+    // Writes the saves still queued
+    generator.stop();
+    mesher.stop();
+    lighting.stop();
+    jobSystem.stop();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    if (stopRequested && doneColumns < totalColumns)
+        std::cout << "Bake: stopped, run again to resume; ";
+    else
+        std::cout << "Bake: done; ";
+    std::cout << savedChunks << " chunks saved";
+    if (bakeMeshes)
+        std::cout << ", " << meshedChunks << " meshes";
+    std::cout << " in " << elapsed << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+bool BenchmarkScript::load(const char* path, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file) {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+
+    keys.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.resize(comment);
+        std::istringstream in(line);
+        std::string keyword;
+        if (!(in >> keyword))
+            continue;
+
+        bool valid;
+        if (keyword == "seed") {
+            valid = (bool)(in >> seed);
+        }
+        else if (keyword == "distance") {
+            valid = (bool)(in >> renderDistance) && renderDistance >= 1;
+        }
+        else if (keyword == "lod") {
+            valid = (bool)(in >> lodDistance) && lodDistance >= 0;
+        }
+        else if (keyword == "far") {
+            std::string mode;
+            valid = false;
+            if (in >> mode) {
+                for (int m = 0; m < FAR_FIELD_MODE_COUNT; m++) {
+                    if (mode == FAR_FIELD_NAMES[m]) {
+                        farField = (FarFieldMode)m;
+                        valid = true;
+                    }
+                }
+            }
+        }
+        else if (keyword == "rate") {
+            valid = (bool)(in >> rate) && rate > 0.0;
+        }
+        else if (keyword == "key") {
+            CameraKeyframe key;
+            valid = (bool)(in >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch) &&
+                (keys.empty() || key.time > keys.back().time);
+            if (valid)
+                keys.push_back(key);
+        }
+        else {
+            valid = false;
+        }
+        if (!valid) {
+            error = std::string(path) + ":" + std::to_string(lineNumber) + ": bad line '" + line + "'";
+            return false;
+        }
+    }
+    if (keys.size() < 2) {
+        error = std::string(path) + ": a path needs at least two keyframes";
+        return false;
+    }
+    return true;
+}
+
+// Uniform Catmull-Rom between p1 and p2 at 's' in [0, 1]
+template <typename T>
+static T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, double s)
+{
+    double s2 = s * s;
+    double s3 = s2 * s;
+    return ((p1 * 2.0) + (p2 - p0) * s + (p0 * 2.0 - p1 * 5.0 + p2 * 4.0 - p3) * s2 + (p1 * 3.0 - p0 - p2 * 3.0 + p3) * s3) * 0.5;
+}
+
+CameraKeyframe BenchmarkScript::sample(double t) const
+{
+    if (t <= keys.front().time)
+        return keys.front();
+    if (t >= keys.back().time)
+        return keys.back();
+
+    size_t segment = 1;
+    while (keys[segment].time < t)
+        segment++;
+    // Ends repeat so the curve passes through the first and last keys
+    const CameraKeyframe& k0 = keys[segment >= 2 ? segment - 2 : 0];
+    const CameraKeyframe& k1 = keys[segment - 1];
+    const CameraKeyframe& k2 = keys[segment];
+    const CameraKeyframe& k3 = keys[segment + 1 < keys.size() ? segment + 1 : segment];
+    double s = (t - k1.time) / (k2.time - k1.time);
+
+    CameraKeyframe pose;
+    pose.time = t;
+    pose.position = catmullRom(k0.position, k1.position, k2.position, k3.position, s);
+    pose.yaw = (float)catmullRom((double)k0.yaw, (double)k1.yaw, (double)k2.yaw, (double)k3.yaw, s);
+    pose.pitch = (float)catmullRom((double)k0.pitch, (double)k1.pitch, (double)k2.pitch, (double)k3.pitch, s);
+    return pose;
+}
+
+BenchmarkRecorder::RunSummary BenchmarkRecorder::summarizeRun(int run) const
+{
+    size_t end = run + 1 < runCount() ? runStarts[run + 1] : frames.size();
+    return summarize(runStarts[run], end);
+}
+
+BenchmarkRecorder::RunSummary BenchmarkRecorder::summarize(size_t begin, size_t end) const
+{
+    RunSummary run;
+    std::vector<float> ms(end - begin);
+    double seconds = 0.0;
+    long long meshes = 0;
+    size_t uploaded = 0;
+    for (size_t i = begin; i < end; i++) {
+        const Frame& frame = frames[i];
+        ms[i - begin] = frame.ms;
+        seconds += frame.ms / 1000.0;
+        meshes += frame.counters.meshesUploaded;
+        uploaded += frame.counters.uploadedBytes;
+        run.peak.voxelMB = std::max(run.peak.voxelMB, frame.memory.voxelMB);
+        run.peak.stagingMB = std::max(run.peak.stagingMB, frame.memory.stagingMB);
+        run.peak.heapMB = std::max(run.peak.heapMB, frame.memory.heapMB);
+    }
+    run.times = summarizeFrameTimes(ms.data(), (int)ms.size());
+    if (seconds > 0.0) {
+        run.meshesPerSecond = meshes / seconds;
+        run.uploadMBPerSecond = uploaded / (1024.0 * 1024.0) / seconds;
+    }
+    return run;
+}
+
+bool BenchmarkRecorder::writeCsv(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "frame,run,ms,draw_calls,triangles,loaded_chunks,visible_chunks,uploaded_bytes,meshes_uploaded,voxel_mb,staging_mb,heap_mb\n");
+    int run = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        while (run + 1 < runCount() && runStarts[run + 1] <= i)
+            run++;
+        const FrameCounters& c = frames[i].counters;
+        const MemorySample& m = frames[i].memory;
+        fprintf(file, "%zu,%d,%.4f,%d,%d,%d,%d,%zu,%d,%.2f,%.2f,%.2f\n", i, run, frames[i].ms, c.drawCalls, c.triangles,
+            c.loadedChunks, c.visibleChunks, c.uploadedBytes, c.meshesUploaded, m.voxelMB, m.stagingMB, m.heapMB);
+    }
+    return fclose(file) == 0;
+}
+
+// The figures of 'run' as JSON members, each line starting with 'indent'
+static void writeRunJson(FILE* file, const BenchmarkRecorder::RunSummary& run, const char* indent)
+{
+    const FrameTimeSummary& s = run.times;
+    fprintf(file, "%s\"frames\": %d,\n%s\"fps\": %.3f,\n%s\"mean_ms\": %.4f,\n", indent, s.frames, indent, s.fps, indent, s.meanMs);
+    fprintf(file, "%s\"p50_ms\": %.4f,\n%s\"p95_ms\": %.4f,\n%s\"p99_ms\": %.4f,\n%s\"max_ms\": %.4f,\n",
+        indent, s.p50Ms, indent, s.p95Ms, indent, s.p99Ms, indent, s.maxMs);
+    fprintf(file, "%s\"meshes_per_second\": %.3f,\n%s\"upload_mb_per_second\": %.3f,\n",
+        indent, run.meshesPerSecond, indent, run.uploadMBPerSecond);
+    fprintf(file, "%s\"peak_voxel_mb\": %.3f,\n%s\"peak_staging_mb\": %.3f,\n%s\"peak_heap_mb\": %.3f",
+        indent, run.peak.voxelMB, indent, run.peak.stagingMB, indent, run.peak.heapMB);
+}
+
+bool BenchmarkRecorder::writeJson(const char* path, const BenchmarkScript& script, const std::string& renderer,
+    const StartupTimeline& startup) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    // The renderer string is the only free text; drop anything needing escapes
+    std::string safeRenderer;
+    for (char c : renderer)
+        if (c != '"' && c != '\\' && (unsigned char)c >= 0x20)
+            safeRenderer += c;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"renderer\": \"%s\",\n", safeRenderer.c_str());
+    fprintf(file, "  \"seed\": %u,\n  \"render_distance\": %d,\n  \"lod_distance\": %d,\n  \"far_field\": \"%s\",\n  \"rate\": %.3f,\n  \"duration\": %.3f,\n",
+        script.seed, script.renderDistance, script.lodDistance, FAR_FIELD_NAMES[script.farField], script.rate, script.duration());
+    writeRunJson(file, summarize(0, frames.size()), "  ");
+    fprintf(file, ",\n  \"runs\": [\n");
+    for (int run = 0; run < runCount(); run++) {
+        fprintf(file, "    {\n");
+        writeRunJson(file, summarizeRun(run), "      ");
+        fprintf(file, "\n    }%s\n", run + 1 < runCount() ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+    fprintf(file, "  \"startup\": {\n");
+    startup.writeJson(file, "    ");
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "frame_stats.h"
+#include "lod_terrain.h"
+#include "startup_timeline.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Camera pose at a point of a benchmark path
+struct CameraKeyframe {
+    double time;            // Simulated seconds from the start of the path
+    glm::dvec3 position;    // Eye position
+    float yaw;              // Degrees, as the mouse look uses them
+    float pitch;
+};
+
+// A recorded camera path plus the world settings it was recorded with.
+// Text file, one setting per line, '#' starts a comment:
+//   seed <uint>                  world seed
+//   distance <chunks>            render distance
+//   lod <chunks>                 LOD horizon beyond it (default 0, off)
+//   far lod|raymarch|impostor    how the horizon is drawn (default lod tiles)
+//   rate <hz>                    simulated frames per second (default 60)
+//   key <t> <x> <y> <z> <yaw> <pitch>
+// Keyframes must be in increasing time order; at least two are needed.
+struct BenchmarkScript {
+    uint32_t seed = 0;
+    int renderDistance = 6;
+    int lodDistance = 0;
+    FarFieldMode farField = FAR_FIELD_LOD;
+    double rate = 60.0;
+    std::vector<CameraKeyframe> keys;
+
+    // False with a message in 'error' if the file is missing or malformed
+    bool load(const char* path, std::string& error);
+
+    double duration() const { return keys.empty() ? 0.0 : keys.back().time; }
+    // Pose at simulated time 't' on a Catmull-Rom spline through the keys
+    CameraKeyframe sample(double t) const;
+};
+
+// Pooled memory in use when a frame was recorded, in megabytes
+struct MemorySample {
+    float voxelMB = 0.0f;       // Chunk voxel storage
+    float stagingMB = 0.0f;     // CPU-side meshes awaiting upload
+    float heapMB = 0.0f;        // Chunk meshes in the GPU vertex heap
+};
+
+// Frame log of a benchmark, over one or more runs along the path
+struct BenchmarkRecorder {
+    struct Frame {
+        float ms;
+        FrameCounters counters;
+        MemorySample memory;
+    };
+
+    // Figures of a run (or of all of them)
+    struct RunSummary {
+        FrameTimeSummary times;
+        double meshesPerSecond = 0.0;   // Chunk meshes uploaded per recorded second
+        double uploadMBPerSecond = 0.0; // Mesh vertex data uploaded
+        MemorySample peak;              // Highest of each pool
+    };
+
+    std::vector<Frame> frames;
+    std::vector<size_t> runStarts;      // First frame of each run
+
+    // Frames added from here on belong to a new run
+    void beginRun() { runStarts.push_back(frames.size()); }
+    void addFrame(double seconds, const FrameCounters& counters, const MemorySample& memory)
+    {
+        frames.push_back(Frame{ (float)(seconds * 1000.0), counters, memory });
+    }
+    int runCount() const { return (int)runStarts.size(); }
+
+    // Over every frame recorded
+    FrameTimeSummary summary() const { return summarize(0, frames.size()).times; }
+    RunSummary summarizeRun(int run) const;
+
+    // One row per frame
+    bool writeCsv(const char* path) const;
+    // The summary plus the settings needed to reproduce it, how long
+    // start-up took and the summary of each run (which compareBenchmarkReports
+    // takes the spread from)
+    bool writeJson(const char* path, const BenchmarkScript& script, const std::string& renderer,
+        const StartupTimeline& startup) const;
+
+private:
+    RunSummary summarize(size_t begin, size_t end) const;
+};
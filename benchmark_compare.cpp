@@ -0,0 +1,306 @@
+#include "benchmark_compare.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <sstream>
+
+// Just enough JSON for the reports: objects, arrays, strings, numbers and
+// literals, read in place
+struct JsonReader {
+    const char* p;
+
+    void skipSpace()
+    {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            p++;
+    }
+
+    bool expect(char c)
+    {
+        skipSpace();
+        if (*p != c)
+            return false;
+        p++;
+        return true;
+    }
+
+    // Escapes are kept as the character after the backslash, which is all
+    // the reports' keys and names need
+    bool string(std::string& out)
+    {
+        if (!expect('"'))
+            return false;
+        out.clear();
+        while (*p && *p != '"') {
+            if (*p == '\\' && p[1])
+                p++;
+            out += *p++;
+        }
+        return expect('"');
+    }
+
+    bool number(double& out)
+    {
+        skipSpace();
+        char* end;
+        out = strtod(p, &end);
+        if (end == p)
+            return false;
+        p = end;
+        return true;
+    }
+
+    bool skipValue()
+    {
+        skipSpace();
+        if (*p == '"') {
+            std::string ignored;
+            return string(ignored);
+        }
+        if (*p == '{' || *p == '[') {
+            char close = *p == '{' ? '}' : ']';
+            p++;
+            if (expect(close))
+                return true;
+            do {
+                if (close == '}') {
+                    std::string key;
+                    if (!string(key) || !expect(':'))
+                        return false;
+                }
+                if (!skipValue())
+                    return false;
+            } while (expect(','));
+            return expect(close);
+        }
+        for (const char* literal : { "true", "false", "null" }) {
+            size_t length = strlen(literal);
+            if (strncmp(p, literal, length) == 0) {
+                p += length;
+                return true;
+            }
+        }
+        double ignored;
+        return number(ignored);
+    }
+
+    // An object's members: numbers into 'numbers', strings into 'strings'
+    // (when given), anything else handed to 'other' by key or skipped
+    template <typename Other>
+    bool object(std::map<std::string, double>& numbers, std::map<std::string, std::string>* strings, Other other)
+    {
+        if (!expect('{'))
+            return false;
+        if (expect('}'))
+            return true;
+        do {
+            std::string key;
+            if (!string(key) || !expect(':'))
+                return false;
+            skipSpace();
+            bool read;
+            if (*p == '"' && strings)
+                read = string((*strings)[key]);
+            else if (*p == '-' || (*p >= '0' && *p <= '9'))
+                read = number(numbers[key]);
+            else
+                read = other(key);
+            if (!read)
+                return false;
+        } while (expect(','));
+        return expect('}');
+    }
+};
+
+bool BenchmarkReport::load(const char* path, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string text = contents.str();
+
+    summary.clear();
+    runs.clear();
+    std::map<std::string, std::string> strings;
+    JsonReader reader{ text.c_str() };
+    bool parsed = reader.object(summary, &strings, [&](const std::string& key) {
+        if (key != "runs")
+            return reader.skipValue();
+        if (!reader.expect('['))
+            return false;
+        if (reader.expect(']'))
+            return true;
+        do {
+            runs.emplace_back();
+            if (!reader.object(runs.back(), nullptr, [&](const std::string&) { return reader.skipValue(); }))
+                return false;
+        } while (reader.expect(','));
+        return reader.expect(']');
+    });
+    if (!parsed) {
+        error = std::string(path) + " isn't valid JSON";
+        return false;
+    }
+    if (summary.find("p50_ms") == summary.end()) {
+        error = std::string(path) + " isn't a benchmark report";
+        return false;
+    }
+    renderer = strings["renderer"];
+    return true;
+}
+
+namespace {
+
+struct Metric {
+    const char* key;
+    const char* label;
+    bool higherIsBetter;
+    bool gated;         // Fails the comparison when it regresses
+};
+
+// Upload volume follows the mesh format as much as speed, so it is shown
+// but not gated
+const Metric METRICS[] = {
+    { "fps", "FPS", true, true },
+    { "mean_ms", "Mean frame ms", false, true },
+    { "p50_ms", "p50 frame ms", false, true },
+    { "p95_ms", "p95 frame ms", false, true },
+    { "p99_ms", "p99 frame ms", false, true },
+    { "max_ms", "Max frame ms", false, true },
+    { "meshes_per_second", "Meshes/s", true, true },
+    { "upload_mb_per_second", "Upload MB/s", true, false },
+    { "peak_voxel_mb", "Peak voxel MB", false, true },
+    { "peak_staging_mb", "Peak staging MB", false, true },
+    { "peak_heap_mb", "Peak heap MB", false, true },
+};
+
+// Settings that must match for the comparison to mean anything
+const char* SETTINGS[] = { "seed", "render_distance", "lod_distance", "rate", "duration" };
+
+// Mean and sample variance of a metric over a report's runs; a report
+// without runs gives its summary as a single sample
+struct Sample {
+    int count = 0;
+    double mean = 0.0;
+    double variance = 0.0;
+};
+
+Sample sampleOf(const BenchmarkReport& report, const char* key)
+{
+    Sample sample;
+    std::vector<double> values;
+    for (const std::map<std::string, double>& run : report.runs) {
+        auto found = run.find(key);
+        if (found != run.end())
+            values.push_back(found->second);
+    }
+    if (values.empty()) {
+        auto found = report.summary.find(key);
+        if (found != report.summary.end())
+            values.push_back(found->second);
+    }
+    sample.count = (int)values.size();
+    for (double value : values)
+        sample.mean += value;
+    if (sample.count > 0)
+        sample.mean /= sample.count;
+    for (double value : values)
+        sample.variance += (value - sample.mean) * (value - sample.mean);
+    if (sample.count > 1)
+        sample.variance /= sample.count - 1;
+    return sample;
+}
+
+// Two-sided 95% quantile of Student's t with 'df' degrees of freedom
+// (rounded down, so intervals err on the wide side)
+double tQuantile95(double df)
+{
+    static const double TABLE[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    int whole = std::max(1, (int)df);
+    if (whole <= 30)
+        return TABLE[whole - 1];
+    // Approaches the normal quantile
+    return 1.960 + (TABLE[29] - 1.960) * 30.0 / whole;
+}
+
+} // namespace
+
+int compareBenchmarkReports(const char* baselinePath, const char* candidatePath, double thresholdPercent)
+{
+    BenchmarkReport baseline, candidate;
+    std::string error;
+    if (!baseline.load(baselinePath, error) || !candidate.load(candidatePath, error)) {
+        printf("Compare: %s\n", error.c_str());
+        return 2;
+    }
+
+    printf("Compare: baseline %s (%zu runs), candidate %s (%zu runs), threshold %.1f%%\n",
+        baselinePath, baseline.runs.size(), candidatePath, candidate.runs.size(), thresholdPercent);
+    for (const char* key : SETTINGS) {
+        if (baseline.summary[key] != candidate.summary[key])
+            printf("Compare: warning, the reports differ in %s (%g and %g)\n", key, baseline.summary[key], candidate.summary[key]);
+    }
+    if (baseline.renderer != candidate.renderer)
+        printf("Compare: warning, the reports come from different GPUs (%s and %s)\n", baseline.renderer.c_str(), candidate.renderer.c_str());
+
+    printf("%-16s %12s %12s %9s   %-20s\n", "metric", "baseline", "candidate", "change", "95% interval");
+    int regressions = 0;
+    for (const Metric& metric : METRICS) {
+        Sample base = sampleOf(baseline, metric.key);
+        Sample next = sampleOf(candidate, metric.key);
+        if (base.count == 0 || next.count == 0) {
+            printf("%-16s %12s\n", metric.label, "missing");
+            continue;
+        }
+
+        // Changes relative to the baseline mean, positive = worse
+        double scale = base.mean != 0.0 ? 100.0 / std::fabs(base.mean) : 0.0;
+        double change = (next.mean - base.mean) * scale;
+        double worse = metric.higherIsBetter ? -change : change;
+
+        // Welch's interval for the difference of the means
+        char interval[32] = "-";
+        bool known = base.count > 1 && next.count > 1;
+        double low = change, high = change;
+        if (known) {
+            double baseError = base.variance / base.count;
+            double nextError = next.variance / next.count;
+            double standardError = std::sqrt(baseError + nextError);
+            double df = baseError + nextError > 0.0 ?
+                (baseError + nextError) * (baseError + nextError) /
+                (baseError * baseError / (base.count - 1) + nextError * nextError / (next.count - 1)) :
+                base.count + next.count - 2;
+            double halfWidth = tQuantile95(df) * standardError * scale;
+            low = change - halfWidth;
+            high = change + halfWidth;
+            snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", low, high);
+        }
+        double leastWorse = metric.higherIsBetter ? -high : low;
+
+        bool regressed = metric.gated && scale > 0.0 && worse > thresholdPercent && (!known || leastWorse > 0.0);
+        if (regressed)
+            regressions++;
+        printf("%-16s %12.3f %12.3f %+8.1f%%   %-20s%s\n", metric.label, base.mean, next.mean, change, interval,
+            regressed ? " REGRESSED" : "");
+    }
+
+    if (regressions > 0) {
+        printf("Compare: %d metric%s regressed by more than %.1f%%\n", regressions, regressions == 1 ? "" : "s", thresholdPercent);
+        return 1;
+    }
+    printf("Compare: no regressions\n");
+    return 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+// The numbers of a benchmark report (the .json BenchmarkRecorder writes):
+// the settings and summary at the top level, and the summary of each run
+struct BenchmarkReport {
+    std::string renderer;
+    std::map<std::string, double> summary;
+    std::vector<std::map<std::string, double>> runs;
+
+    // False with a message in 'error' if the file is missing or isn't a report
+    bool load(const char* path, std::string& error);
+};
+
+// Regression gate between a baseline and a candidate report. Prints each
+// metric (frame time percentiles, mesh throughput, memory peaks) with the
+// candidate's change and, when both reports hold two or more runs, the 95%
+// confidence interval of that change from the spread between runs (Welch's
+// t-interval). A metric regresses when it got worse by more than
+// 'thresholdPercent' and, where an interval is known, the whole interval
+// is on the worse side, so run-to-run noise alone never fails the gate.
+// Returns 0 if nothing regressed, 1 if something did, 2 if a report can't
+// be read.
+int compareBenchmarkReports(const char* baselinePath, const char* candidatePath, double thresholdPercent);
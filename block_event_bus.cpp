@@ -0,0 +1,123 @@
+#include "block_event_bus.h"
+#include "world.h"
+
+#include <algorithm>
+
+// Buses a thread published to lately and its buffer in each, so publish()
+// finds its buffer without the lock
+struct ProducerCacheEntry {
+    uint32_t busId;
+    void* producer;
+};
+const int PRODUCER_CACHE_ENTRIES = 4;
+static thread_local ProducerCacheEntry producerCache[PRODUCER_CACHE_ENTRIES];
+static thread_local int producerCacheNext = 0;
+
+static std::atomic<uint32_t> nextBusId{ 1 };
+
+BlockEventBus::BlockEventBus()
+    : busId(nextBusId.fetch_add(1, std::memory_order_relaxed))
+{
+}
+
+BlockEventBus::~BlockEventBus()
+{
+    for (Producer* producer : producers) {
+        for (EventBlock* block = producer->head; block;) {
+            EventBlock* next = block->next.load(std::memory_order_relaxed);
+            delete block;
+            block = next;
+        }
+        delete producer;
+    }
+}
+
+BlockEventBus::Producer* BlockEventBus::producerForThisThread()
+{
+    for (const ProducerCacheEntry& entry : producerCache) {
+        if (entry.busId == busId)
+            return (Producer*)entry.producer;
+    }
+
+    Producer* found = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(producersMutex);
+        std::thread::id self = std::this_thread::get_id();
+        for (Producer* producer : producers) {
+            if (producer->owner == self)
+                found = producer;
+        }
+        if (!found) {
+            found = new Producer();
+            found->owner = self;
+            found->tail = found->head = new EventBlock();
+            producers.push_back(found);
+        }
+    }
+    producerCache[producerCacheNext] = { busId, found };
+    producerCacheNext = (producerCacheNext + 1) % PRODUCER_CACHE_ENTRIES;
+    return found;
+}
+
+void BlockEventBus::publish(const glm::ivec3& block, BlockId previous, BlockId id)
+{
+    Producer* producer = producerForThisThread();
+    EventBlock* tail = producer->tail;
+    int count = tail->count.load(std::memory_order_relaxed);
+    if (count == EVENTS_PER_BLOCK) {
+        // drain() may free the full block as soon as it sees the link
+        EventBlock* fresh = new EventBlock();
+        tail->next.store(fresh, std::memory_order_release);
+        producer->tail = tail = fresh;
+        count = 0;
+    }
+    tail->events[count] = { block, previous, id, sequence.fetch_add(1, std::memory_order_relaxed) };
+    tail->count.store(count + 1, std::memory_order_release);
+}
+
+void BlockEventBus::drain(std::vector<BlockEvent>& out)
+{
+    sorting.clear();
+    {
+        std::lock_guard<std::mutex> lock(producersMutex);
+        for (Producer* producer : producers) {
+            for (;;) {
+                EventBlock* head = producer->head;
+                int count = head->count.load(std::memory_order_acquire);
+                for (; producer->read < count; producer->read++) {
+                    const BlockEvent& event = head->events[producer->read];
+                    glm::ivec3 local = localBlockOf(event.block);
+                    sorting.push_back({ packChunkCoord(chunkCoordOf(event.block)), chunkIndex(local.x, local.y, local.z), event });
+                }
+                EventBlock* next = head->next.load(std::memory_order_acquire);
+                if (producer->read < EVENTS_PER_BLOCK || !next)
+                    break;
+                delete head;
+                producer->head = next;
+                producer->read = 0;
+            }
+        }
+    }
+
+    std::sort(sorting.begin(), sorting.end(), [](const SortEntry& a, const SortEntry& b) {
+        if (a.chunk != b.chunk)
+            return a.chunk < b.chunk;
+        if (a.index != b.index)
+            return a.index < b.index;
+        // Sequences may wrap around between a drain's events
+        return (int32_t)(a.event.sequence - b.event.sequence) < 0;
+    });
+
+    // A run of one block's changes becomes one, from its first previous
+    // block to its last
+    out.clear();
+    for (size_t begin = 0, end; begin < sorting.size(); begin = end) {
+        BlockEvent event = sorting[begin].event;
+        for (end = begin + 1; end < sorting.size() && sorting[end].event.block == event.block; end++)
+            event.id = sorting[end].event.id;
+        if (event.id != event.previous)
+            out.push_back(event);
+    }
+    lastPublished = sorting.size();
+    lastDrained = out.size();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One block change as the bus carries it
+struct BlockEvent {
+    glm::ivec3 block;       // World block position
+    BlockId previous;       // Before the first change since the last drain
+    BlockId id;             // After the last one
+    uint32_t sequence;      // Order of publishing, across threads
+};
+
+// Block changes from any thread, handed to whoever reacts to them as one
+// batch a tick. publish() appends to a buffer of the calling thread's own
+// with no lock: a chain of fixed blocks of events that only that thread
+// writes, each with a count it publishes after the event. drain() walks
+// every thread's chain from where it stopped last time and frees the
+// blocks behind it, which the writer has left for good once it linked the
+// next one. A thread remembers its buffers of the last few buses it
+// published to; only finding one otherwise takes the bus's lock.
+//
+// A drained batch has one event per block, so a block set and reset within
+// a tick reaches nobody, and is sorted by chunk (packChunkCoord()), then
+// by the block's index in it: consumers work a chunk at a time.
+struct BlockEventBus {
+    BlockEventBus();
+    BlockEventBus(const BlockEventBus&) = delete;
+    BlockEventBus& operator=(const BlockEventBus&) = delete;
+    ~BlockEventBus();
+
+    // Any thread
+    void publish(const glm::ivec3& block, BlockId previous, BlockId id);
+
+    // Replace 'out' with everything published since the last drain,
+    // coalesced and sorted. One thread at a time.
+    void drain(std::vector<BlockEvent>& out);
+
+    // Events drained by the last drain() before coalescing, and after
+    size_t lastPublished = 0;
+    size_t lastDrained = 0;
+
+private:
+    static const int EVENTS_PER_BLOCK = 256;
+    struct EventBlock {
+        BlockEvent events[EVENTS_PER_BLOCK];
+        std::atomic<int> count{ 0 };                // Events written, published by the writer
+        std::atomic<EventBlock*> next{ nullptr };   // Set once 'events' is full
+    };
+    struct Producer {
+        std::thread::id owner;
+        EventBlock* tail = nullptr;     // Writer only
+        EventBlock* head = nullptr;     // drain() only
+        int read = 0;                   // Events of 'head' drained
+    };
+
+    Producer* producerForThisThread();
+
+    uint32_t busId;                     // Tells buses apart in the per-thread cache
+    std::atomic<uint32_t> sequence{ 0 };
+    std::mutex producersMutex;          // Adding buffers, and drain() walking them
+    std::vector<Producer*> producers;
+    struct SortEntry {
+        uint64_t chunk;             // packChunkCoord()
+        int index;                  // chunkIndex() of the block in it
+        BlockEvent event;
+    };
+    std::vector<SortEntry> sorting; // drain() scratch
+};
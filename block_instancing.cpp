@@ -0,0 +1,120 @@
+#include "block_instancing.h"
+#include "chunk_mesh.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// Shared unit cube: 4 corners per face so hidden faces can be collapsed per
+// instance. The faces are six quads, so the first 36 indices of the chunk
+// meshes' quad index buffer draw it.
+static unsigned int cubeVBO = 0;
+
+void initBlockInstancing()
+{
+    // Unit-cube corners; the face is the vertex index / 4
+    float cubeVertices[6 * 4 * 3];
+
+    for (int face = 0; face < 6; face++) {
+        for (int corner = 0; corner < 4; corner++) {
+            float* v = &cubeVertices[(face * 4 + corner) * 3];
+            v[0] = FACE_CORNERS[face][corner][0];
+            v[1] = FACE_CORNERS[face][corner][1];
+            v[2] = FACE_CORNERS[face][corner][2];
+        }
+    }
+
+    glGenBuffers(1, &cubeVBO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void shutdownBlockInstancing()
+{
+    glState().deleteBuffers(1, &cubeVBO);
+    cubeVBO = 0;
+}
+
+void ChunkInstances::build(const ChunkVoxels& voxels)
+{
+    std::vector<BlockInstance> instances;
+    faceCount = 0;
+
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                int block = voxels.get(x, y, z);
+                if (block == BLOCK_AIR) continue; // Skip air blocks
+
+                unsigned char mask = 0;
+                for (int face = 0; face < 6; face++) {
+                    const int* n = FACE_NORMALS[face];
+                    if (faceVisible((BlockId)block, voxels.blockAt(x + n[0], y + n[1], z + n[2]))) {
+                        mask |= 1 << face;
+                        faceCount++;
+                    }
+                }
+                if (mask == 0) continue; // Fully enclosed
+
+                BlockInstance instance;
+                instance.position[0] = (float)x;
+                instance.position[1] = (float)y;
+                instance.position[2] = (float)z;
+                instance.material = (unsigned char)block;
+                instance.faceMask = mask;
+                instance.padding[0] = instance.padding[1] = 0;
+                instances.push_back(instance);
+            }
+        }
+    }
+    instanceCount = (int)instances.size();
+
+    if (VAO == 0) {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+
+        glState().bindVertexArray(VAO);
+
+        // Per-vertex: unit-cube corner
+        glState().bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkQuadIndexBuffer());
+
+        // Per-instance: block position, material and face mask
+        glState().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(BlockInstance), (void*)0);
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+        glVertexAttribIPointer(3, 2, GL_UNSIGNED_BYTE, sizeof(BlockInstance), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
+    }
+    else {
+        glState().bindVertexArray(VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(BlockInstance), instances.data(), GL_STATIC_DRAW);
+    glState().bindVertexArray(0);
+}
+
+void ChunkInstances::draw() const
+{
+    if (instanceCount == 0) return;
+    glState().bindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, (void*)0, instanceCount);
+}
+
+void ChunkInstances::destroy()
+{
+    if (VAO != 0) {
+        glState().deleteVertexArrays(1, &VAO);
+        glState().deleteBuffers(1, &instanceVBO);
+    }
+    VAO = instanceVBO = 0;
+    instanceCount = 0;
+    faceCount = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "chunk.h"
+
+// Per-instance data for the instanced block path (16 bytes)
+struct BlockInstance {
+    float position[3];          // Chunk-local block position
+    unsigned char material;     // BlockType
+    unsigned char faceMask;     // Bit f set when face f (-X, +X, -Y, +Y, -Z, +Z) is visible
+    unsigned char padding[2];
+};
+
+// One instance per visible block of a chunk, drawn as instanced unit cubes.
+// This is the fallback used when chunk meshing is disabled.
+struct ChunkInstances {
+    unsigned int VAO = 0;
+    unsigned int instanceVBO = 0;
+    int instanceCount = 0;
+    int faceCount = 0;
+
+    // Collect visible blocks and their face masks from a chunk snapshot, then upload the instance list
+    void build(const ChunkVoxels& voxels);
+    // Draw every instance with one glDrawElementsInstanced call
+    void draw() const;
+    // Release the GL objects
+    void destroy();
+};
+
+// Create / release the shared unit-cube vertices (indexed through
+// chunkQuadIndexBuffer(), so instances are built after initChunkMeshes())
+void initBlockInstancing();
+void shutdownBlockInstancing();
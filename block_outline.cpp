@@ -0,0 +1,98 @@
+#include "block_outline.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+
+static const char* outlineVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;          // Unit-cube corner
+layout (location = 1) in vec3 iBlockOrigin;  // Per instance, relative to the camera
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+};
+
+void main()
+{
+    // Grow the box slightly so the lines aren't hidden by the block's own faces
+    gl_Position = viewProj * vec4(iBlockOrigin + (aPos - 0.5) * 1.004 + 0.5, 1.0);
+}
+)";
+
+static const char* outlineFragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+}
+)";
+
+void BlockOutline::init(unsigned int cameraBinding)
+{
+    program.create(outlineVertexShaderSource, outlineFragmentShaderSource);
+    program.bindBlock("Camera", cameraBinding);
+
+    const float corners[8 * 3] = {
+        0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0,
+        0, 0, 1,  1, 0, 1,  0, 1, 1,  1, 1, 1
+    };
+    // The 12 edges of the cube
+    const unsigned char indices[24] = {
+        0, 1,  2, 3,  4, 5,  6, 7,  // along X
+        0, 2,  1, 3,  4, 6,  5, 7,  // along Y
+        0, 4,  1, 5,  2, 6,  3, 7   // along Z
+    };
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    // Block origin per instance, sourced from the stream buffer at draw time
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glState().bindVertexArray(0);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void BlockOutline::destroy()
+{
+    if (VAO == 0)
+        return;
+    glState().deleteVertexArrays(1, &VAO);
+    glState().deleteBuffers(1, &VBO);
+    glState().deleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+    program.destroy();
+}
+
+int BlockOutline::draw(const glm::ivec3* blocks, int count, const glm::dvec3& eye, StreamBuffer& stream) const
+{
+    if (count == 0)
+        return 0;
+    size_t offset;
+    glm::vec3* origins = (glm::vec3*)stream.map(count * sizeof(glm::vec3), sizeof(glm::vec3), offset);
+    if (!origins)
+        return 0;
+    for (int i = 0; i < count; i++)
+        origins[i] = glm::vec3(glm::dvec3(blocks[i]) - eye);
+    stream.unmap();
+
+    program.use();
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+    glDrawElementsInstanced(GL_LINES, 24, GL_UNSIGNED_BYTE, (void*)0, count);
+    glState().bindVertexArray(0);
+    return 1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "shader.h"
+#include "stream_buffer.h"
+
+#include <glm/glm.hpp>
+
+// Line boxes drawn around blocks: the one under the crosshair and any
+// other per-block overlay. Every box is an instance of the same cube edges,
+// one glDrawElementsInstanced for all of them, with the camera-relative
+// block origins written to the frame's stream buffer.
+struct BlockOutline {
+    // 'cameraBinding' is the uniform buffer binding of the Camera block
+    void init(unsigned int cameraBinding);
+    void destroy();
+
+    // Outline the 'count' blocks at world positions 'blocks', drawn
+    // relative to 'eye'. Returns the number of draw calls (0 when the
+    // stream region is full).
+    int draw(const glm::ivec3* blocks, int count, const glm::dvec3& eye, StreamBuffer& stream) const;
+
+private:
+    ShaderProgram program;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+};
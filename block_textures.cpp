@@ -0,0 +1,180 @@
+#include "block_textures.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "ktx2_file.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <vector>
+
+// Deterministic value in [0, 1) per block, texel and pattern layer
+static float texelNoise(int block, int x, int y, int layer)
+{
+    uint32_t h = (uint32_t)block * 0x9E3779B1u ^ (uint32_t)x * 0x85EBCA77u ^ (uint32_t)y * 0xC2B2AE3Du ^ (uint32_t)layer * 0x27D4EB2Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// Brightness of a texel relative to the block colour (about 1 on average).
+// Patterns wrap at the texture edge, since quads repeat the texture.
+static float texelShade(BlockId block, int x, int y)
+{
+    const int last = BLOCK_TEXTURE_SIZE - 1;
+    float fine = texelNoise(block, x, y, 0);
+    switch (block) {
+    case BLOCK_STONE: {
+        // Mottled 2x2 patches with a little grain
+        float coarse = texelNoise(block, x / 2, y / 2, 1);
+        return 0.8f + 0.25f * coarse + 0.1f * fine;
+    }
+    case BLOCK_DIRT:
+        // Grainy, with scattered dark pebbles
+        return texelNoise(block, x, y, 1) > 0.92f ? 0.65f : 0.85f + 0.3f * fine;
+    case BLOCK_GRASS: {
+        // Blades: columns of similar shade
+        float blade = texelNoise(block, x, 0, 1);
+        return 0.75f + 0.3f * blade + 0.15f * fine;
+    }
+    case BLOCK_LAMP:
+        // Bright panel in a darker frame
+        if (x == 0 || y == 0 || x == last || y == last)
+            return 0.7f;
+        return 1.0f + 0.08f * fine;
+    case BLOCK_WATER:
+    case BLOCK_FLOWING_WATER:
+        // Soft ripples running across the surface
+        return 0.9f + 0.15f * texelNoise(block, (x + y) / 3, 0, 1) + 0.05f * fine;
+    case BLOCK_GLASS:
+        // Frame a little darker than the pane
+        if (x == 0 || y == 0 || x == last || y == last)
+            return 0.85f;
+        return 1.0f;
+    case BLOCK_WOOD: {
+        // Bark: vertical ridges broken up along their length
+        float ridge = texelNoise(block, x / 2, 0, 1);
+        return 0.75f + 0.35f * ridge + 0.1f * texelNoise(block, x, y / 4, 2);
+    }
+    case BLOCK_LEAVES:
+        // Clumps with dark gaps between them
+        return texelNoise(block, x / 2, y / 2, 1) > 0.8f ? 0.55f : 0.9f + 0.25f * fine;
+    default:
+        return 1.0f;
+    }
+}
+
+// Opacity of a texel: translucent blocks are blended with what is behind them
+static float texelAlpha(BlockId block, int x, int y)
+{
+    const int last = BLOCK_TEXTURE_SIZE - 1;
+    switch (block) {
+    case BLOCK_WATER:
+    case BLOCK_FLOWING_WATER:
+        return 0.65f;
+    case BLOCK_GLASS:
+        // Nearly clear pane with a couple of glints in a solid frame
+        if (x == 0 || y == 0 || x == last || y == last)
+            return 0.95f;
+        return x + y == 5 || x + y == 7 ? 0.45f : 0.15f;
+    default:
+        return 1.0f;
+    }
+}
+
+void generateBlockTexture(BlockId block, uint8_t* rgba)
+{
+    glm::vec3 color = block < BLOCK_TYPE_COUNT ? BLOCK_COLORS[block] : glm::vec3(1.0f, 0.0f, 1.0f);
+    for (int y = 0; y < BLOCK_TEXTURE_SIZE; y++) {
+        for (int x = 0; x < BLOCK_TEXTURE_SIZE; x++) {
+            glm::vec3 texel = glm::clamp(color * texelShade(block, x, y), glm::vec3(0.0f), glm::vec3(1.0f));
+            uint8_t* out = rgba + (y * BLOCK_TEXTURE_SIZE + x) * 4;
+            out[0] = (uint8_t)(texel.r * 255.0f + 0.5f);
+            out[1] = (uint8_t)(texel.g * 255.0f + 0.5f);
+            out[2] = (uint8_t)(texel.b * 255.0f + 0.5f);
+            out[3] = (uint8_t)(texelAlpha(block, x, y) * 255.0f + 0.5f);
+        }
+    }
+}
+
+bool BlockTextures::load(const char* path)
+{
+    MappedFile file;
+    Ktx2Texture ktx;
+    if (!file.map(path) || !parseKtx2(file.data, file.size, ktx))
+        return false;
+    bool bptc = ktx.glFormat == GL_COMPRESSED_RGBA_BPTC_UNORM;
+    if (ktx.layers < BLOCK_TYPE_COUNT || ktx.width != ktx.height || !(bptc ? glFeatures.textureBPTC : glFeatures.textureS3TC))
+        return false;
+
+    // The driver copies each level out of the mapping before returning
+    glGenTextures(1, &texture);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    bytes = 0;
+    for (int level = 0; level < ktx.levelCount; level++) {
+        const Ktx2Level& l = ktx.levels[level];
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, ktx.glFormat, l.width, l.height, ktx.layers, 0,
+            (GLsizei)l.size, l.data);
+        bytes += l.size;
+    }
+    // A short chain stays complete: sampling stops at the last level given
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, ktx.levelCount - 1);
+    format = ktx.formatName;
+    size = ktx.width;
+    levels = ktx.levelCount;
+    return true;
+}
+
+void BlockTextures::generate()
+{
+    const int layerBytes = BLOCK_TEXTURE_SIZE * BLOCK_TEXTURE_SIZE * 4;
+    std::vector<uint8_t> texels(layerBytes * BLOCK_TYPE_COUNT);
+    for (int block = 0; block < BLOCK_TYPE_COUNT; block++)
+        generateBlockTexture((BlockId)block, texels.data() + block * layerBytes);
+
+    glGenTextures(1, &texture);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, BLOCK_TEXTURE_SIZE, BLOCK_TEXTURE_SIZE, BLOCK_TYPE_COUNT, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    format = "RGBA8";
+    size = BLOCK_TEXTURE_SIZE;
+    levels = 1;
+    while (BLOCK_TEXTURE_SIZE >> levels)
+        levels++;
+    // A full chain adds a third
+    bytes = texels.size() * 4 / 3;
+}
+
+void BlockTextures::init(float maxAnisotropy, const char* path)
+{
+    if (!path || !load(path))
+        generate();
+
+    // Crisp texels up close, trilinear (and anisotropic, at grazing angles) further away
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    anisotropy = std::min(maxAnisotropy, glFeatures.maxAnisotropy);
+    if (anisotropy > 1.0f)
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY, anisotropy);
+    else
+        anisotropy = 0.0f;
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void BlockTextures::destroy()
+{
+    glState().deleteTextures(1, &texture);
+    texture = 0;
+}
+
+void BlockTextures::bind(int unit) const
+{
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glState().activeTexture(GL_TEXTURE0);
+}
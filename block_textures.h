@@ -0,0 +1,47 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Texels along each side of a block texture
+const int BLOCK_TEXTURE_SIZE = 16;
+
+// Fill 'rgba' (BLOCK_TEXTURE_SIZE^2 texels, 4 bytes each) with the surface
+// of 'block': a procedural pattern around its BLOCK_COLORS entry, averaging
+// close to it so distant mip levels (and LOD tiles, which use the plain
+// colour) match the near surface. Alpha is 1 except on translucent blocks.
+void generateBlockTexture(BlockId block, uint8_t* rgba);
+
+// Surface textures of every block type, one layer per BlockType of a
+// GL_TEXTURE_2D_ARRAY indexed by the material of the packed vertex. A single
+// texture stays bound for every chunk draw, and since each block has a
+// whole layer, greedy quads repeat it across their size without bleeding
+// into neighbours as an atlas would.
+//
+// The layers either come pre-compressed from a KTX2 file (BC1, BC3 or BC7,
+// with its own mip chain), uploaded straight from a mapping of the file
+// with no decoding on the CPU, or else are generated as RGBA8.
+struct BlockTextures {
+    unsigned int texture = 0;
+    float anisotropy = 0.0f;    // In use; 0 = plain trilinear filtering
+    const char* format = "";    // "RGBA8" when generated, else the file's BCn format
+    int size = 0;               // Texels along a side of the base level
+    int levels = 0;
+    size_t bytes = 0;           // Video memory of every level and layer
+
+    // Upload the layers of the KTX2 file at 'path' when it exists, holds a
+    // layer per block type and the driver samples its format; otherwise
+    // generate them with a full mip chain. Anisotropic filtering is set up to
+    // 'maxAnisotropy' where the driver supports it.
+    void init(float maxAnisotropy, const char* path = nullptr);
+    void destroy();
+
+    // Bind to texture unit 'unit' (texture unit 0 is left active)
+    void bind(int unit) const;
+
+private:
+    bool load(const char* path);
+    void generate();
+};
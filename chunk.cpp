@@ -0,0 +1,269 @@
+#include "chunk.h"
+#include "lz4.h"
+#include "palette_kernels.h"
+
+// Smallest supported index width that can address 'count' palette entries
+static int bitsForPaletteSize(size_t count)
+{
+    if (count <= 1) return 0;
+    if (count <= 2) return 1;
+    if (count <= 4) return 2;
+    if (count <= 16) return 4;
+    return 8;
+}
+
+int PalettedBlocks::findOrAdd(BlockId id)
+{
+    for (size_t i = 0; i < palette.size(); i++) {
+        if (palette[i] == id)
+            return (int)i;
+    }
+    palette.push_back(id);
+    return (int)palette.size() - 1;
+}
+
+void PalettedBlocks::repack(int newBits)
+{
+    alignas(16) uint8_t indices[CHUNK_VOLUME];
+    if (bitsPerIndex != 0)
+        unpackPaletteIndices(words.data(), bitsPerIndex, indices);
+    else
+        memset(indices, 0, CHUNK_VOLUME);
+    words.resize((size_t)(CHUNK_VOLUME * newBits + 63) / 64);
+    packPaletteIndices(indices, newBits, words.data());
+    bitsPerIndex = newBits;
+}
+
+void PalettedBlocks::set(int index, BlockId id)
+{
+    if (bitsPerIndex == 0 && palette[0] == id)
+        return; // Uniform chunk already holds this value
+
+    int paletteIndex = findOrAdd(id);
+    int neededBits = bitsForPaletteSize(palette.size());
+    if (neededBits > bitsPerIndex)
+        repack(neededBits);
+
+    int bit = index * bitsPerIndex;
+    uint64_t mask = (1ull << bitsPerIndex) - 1;
+    uint64_t& word = words[bit >> 6];
+    word = (word & ~(mask << (bit & 63))) | ((uint64_t)paletteIndex << (bit & 63));
+}
+
+void PalettedBlocks::fill(BlockId id)
+{
+    palette.assign(1, id);
+    words.clear();
+    words.shrink_to_fit();
+    bitsPerIndex = 0;
+}
+
+void PalettedBlocks::encode(const BlockId* flat)
+{
+    BlockId found[256];
+    palette.assign(found, found + collectPalette(flat, CHUNK_VOLUME, found));
+
+    bitsPerIndex = bitsForPaletteSize(palette.size());
+    if (bitsPerIndex == 0) {
+        words.clear();
+        words.shrink_to_fit();
+        return;
+    }
+    alignas(16) uint8_t indices[CHUNK_VOLUME];
+    findPaletteIndices(flat, CHUNK_VOLUME, palette.data(), (int)palette.size(), indices);
+    words.resize((size_t)(CHUNK_VOLUME * bitsPerIndex + 63) / 64);
+    packPaletteIndices(indices, bitsPerIndex, words.data());
+}
+
+void PalettedBlocks::decode(BlockId* flat) const
+{
+    if (bitsPerIndex == 0) {
+        memset(flat, palette[0], CHUNK_VOLUME);
+        return;
+    }
+    // Indices first, then looked up in place
+    unpackPaletteIndices(words.data(), bitsPerIndex, flat);
+    lookupBytes(flat, CHUNK_VOLUME, palette.data(), (int)palette.size(), flat);
+}
+
+void PalettedBlocks::compact()
+{
+    if (bitsPerIndex == 0)
+        return;
+    alignas(16) uint8_t indices[CHUNK_VOLUME];
+    unpackPaletteIndices(words.data(), bitsPerIndex, indices);
+    bool used[256] = {};
+    for (int i = 0; i < CHUNK_VOLUME; i++)
+        used[indices[i]] = true;
+
+    // Used entries keep their order; the rest are dropped
+    uint8_t remap[256];
+    std::vector<BlockId> kept;
+    for (size_t j = 0; j < palette.size(); j++) {
+        if (used[j]) {
+            remap[j] = (uint8_t)kept.size();
+            kept.push_back(palette[j]);
+        }
+        else {
+            remap[j] = 0;
+        }
+    }
+    if (kept.size() == palette.size())
+        return;
+    if (kept.size() == 1) {
+        fill(kept[0]);
+        return;
+    }
+    lookupBytes(indices, CHUNK_VOLUME, remap, (int)palette.size(), indices);
+    palette.swap(kept);
+    bitsPerIndex = bitsForPaletteSize(palette.size());
+    words.resize((size_t)(CHUNK_VOLUME * bitsPerIndex + 63) / 64);
+    words.shrink_to_fit();
+    packPaletteIndices(indices, bitsPerIndex, words.data());
+}
+
+void ChunkLight::encode(const uint8_t* flat)
+{
+    for (int i = 1; i < CHUNK_VOLUME; i++) {
+        if (flat[i] != flat[0]) {
+            levels.assign(flat, flat + CHUNK_VOLUME);
+            return;
+        }
+    }
+    uniform = flat[0];
+    levels.clear();
+    levels.shrink_to_fit();
+}
+
+void ChunkLight::decode(uint8_t* flat) const
+{
+    if (levels.empty())
+        memset(flat, uniform, CHUNK_VOLUME);
+    else
+        memcpy(flat, levels.data(), CHUNK_VOLUME);
+}
+
+bool ChunkLight::operator==(const ChunkLight& other) const
+{
+    if (levels.empty() || other.levels.empty())
+        return levels.empty() && other.levels.empty() && uniform == other.uniform;
+    return memcmp(levels.data(), other.levels.data(), CHUNK_VOLUME) == 0;
+}
+
+// Pools are leaked on purpose so chunks freed during static destruction still find theirs
+BlockPool& chunkPool()
+{
+    static BlockPool* pool = new BlockPool(sizeof(Chunk), 256, MEMORY_VOXELS);
+    return *pool;
+}
+
+BlockPool& voxelSnapshotPool()
+{
+    static BlockPool* pool = new BlockPool(sizeof(ChunkVoxels), 32, MEMORY_VOXELS);
+    return *pool;
+}
+
+bool Chunk::faceHasSolid(int face) const
+{
+    if (isUniform())
+        return uniformBlock() != BLOCK_AIR;
+    if (isCold())
+        return (coldFaceSolid >> face) & 1;
+
+    int d = face / 2;
+    int a = d == 0 ? 1 : 0;
+    int b = d == 2 ? 1 : 2;
+    int pos[3];
+    pos[d] = (face & 1) ? CHUNK_SIZE - 1 : 0;
+    for (pos[a] = 0; pos[a] < CHUNK_SIZE; pos[a]++)
+        for (pos[b] = 0; pos[b] < CHUNK_SIZE; pos[b]++)
+            if (get(pos[0], pos[1], pos[2]) != BLOCK_AIR)
+                return true;
+    return false;
+}
+
+bool Chunk::freeze()
+{
+    blocks.compact();
+    size_t blockBytes = blocks.words.size() * sizeof(uint64_t);
+    size_t lightBytes = light.levels.size();
+    std::vector<uint8_t> packed(lz4CompressBound(blockBytes) + lz4CompressBound(lightBytes));
+    size_t blockPacked = blockBytes ? lz4Compress((const uint8_t*)blocks.words.data(), blockBytes, packed.data()) : 0;
+    size_t lightPacked = lightBytes ? lz4Compress(light.levels.data(), lightBytes, packed.data() + blockPacked) : 0;
+    if (blockPacked + lightPacked >= blockBytes + lightBytes)
+        return false;
+
+    uint8_t faces = 0;
+    for (int face = 0; face < 6; face++)
+        faces |= faceHasSolid(face) << face;
+    coldFaceSolid = faces;
+    packed.resize(blockPacked + lightPacked);
+    packed.shrink_to_fit();
+    coldVoxels = std::move(packed);
+    coldBlockBytes = (uint32_t)blockPacked;
+    coldLightLevels = lightBytes != 0;
+    // Back to the pools; thaw() takes the same sizes again
+    decltype(blocks.words)().swap(blocks.words);
+    decltype(light.levels)().swap(light.levels);
+    cold.store(true, std::memory_order_release);
+    return true;
+}
+
+void Chunk::thaw()
+{
+    if (blocks.bitsPerIndex) {
+        blocks.words.resize((size_t)(CHUNK_VOLUME * blocks.bitsPerIndex + 63) / 64);
+        lz4Decompress(coldVoxels.data(), coldBlockBytes, (uint8_t*)blocks.words.data(),
+            blocks.words.size() * sizeof(uint64_t));
+    }
+    if (coldLightLevels) {
+        light.levels.resize(CHUNK_VOLUME);
+        lz4Decompress(coldVoxels.data() + coldBlockBytes, coldVoxels.size() - coldBlockBytes, light.levels.data(),
+            CHUNK_VOLUME);
+    }
+    std::vector<uint8_t>().swap(coldVoxels);
+    cold.store(false, std::memory_order_release);
+}
+
+void linearToMorton(const uint8_t* linear, uint8_t* morton)
+{
+    for (int x = 0; x < CHUNK_SIZE; x++)
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            // The y and x bits are fixed along a row
+            int rowMorton = (spreadMortonBits(x) << 2) | (spreadMortonBits(y) << 1);
+            const uint8_t* row = linear + chunkIndex(x, y, 0);
+            for (int z = 0; z < CHUNK_SIZE; z++)
+                morton[rowMorton | spreadMortonBits(z)] = row[z];
+        }
+}
+
+void mortonToLinear(const uint8_t* morton, uint8_t* linear)
+{
+    for (int x = 0; x < CHUNK_SIZE; x++)
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            int rowMorton = (spreadMortonBits(x) << 2) | (spreadMortonBits(y) << 1);
+            uint8_t* row = linear + chunkIndex(x, y, 0);
+            for (int z = 0; z < CHUNK_SIZE; z++)
+                row[z] = morton[rowMorton | spreadMortonBits(z)];
+        }
+}
+
+void* Chunk::operator new(size_t size)
+{
+    return chunkPool().allocate();
+}
+
+void Chunk::operator delete(void* block)
+{
+    chunkPool().release(block);
+}
+
+void* ChunkVoxels::operator new(size_t size)
+{
+    return voxelSnapshotPool().allocate();
+}
+
+void ChunkVoxels::operator delete(void* block)
+{
+    voxelSnapshotPool().release(block);
+}
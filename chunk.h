@@ -0,0 +1,361 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "pool_allocator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Edge length of a cubic chunk in blocks: a power of two, so voxel indices
+// and block-to-chunk coordinates are shifts and masks. The vertex and face
+// row formats fix it at 16 or less (see chunk_geometry.h); anything large
+// enough to matter is sized from these.
+const int CHUNK_SHIFT = 4;
+const int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+const int CHUNK_MASK = CHUNK_SIZE - 1;
+const int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+// One byte per block type
+typedef uint8_t BlockId;
+
+// Block types stored in chunk voxels (0 is always air)
+enum BlockType {
+    BLOCK_AIR = 0,
+    BLOCK_STONE,
+    BLOCK_DIRT,
+    BLOCK_GRASS,
+    BLOCK_LAMP,
+    BLOCK_WATER,
+    BLOCK_GLASS,
+    BLOCK_FLOWING_WATER,    // Spread from a water source by FluidSimulation
+    BLOCK_WOOD,             // Tree trunks
+    BLOCK_LEAVES,
+    BLOCK_TYPE_COUNT
+};
+
+// Block colours indexed by BlockType
+const glm::vec3 BLOCK_COLORS[BLOCK_TYPE_COUNT] = {
+    glm::vec3(0.0f, 0.0f, 0.0f), // air (never drawn)
+    glm::vec3(0.5f, 0.5f, 0.5f), // stone (gray)
+    glm::vec3(0.6f, 0.3f, 0.0f), // dirt (brown)
+    glm::vec3(0.0f, 1.0f, 0.0f), // grass (green)
+    glm::vec3(1.0f, 0.9f, 0.6f), // lamp (warm white)
+    glm::vec3(0.2f, 0.4f, 0.9f), // water (blue)
+    glm::vec3(0.8f, 0.9f, 0.95f), // glass (pale)
+    glm::vec3(0.25f, 0.45f, 0.9f), // flowing water (lighter blue)
+    glm::vec3(0.45f, 0.3f, 0.15f), // wood (bark brown)
+    glm::vec3(0.1f, 0.5f, 0.1f) // leaves (dark green)
+};
+
+// Behaviour of each block type, as flags the mesher, lighting and physics
+// test per voxel with one table lookup. Texture array layers and palette
+// colours are indexed by the BlockType itself.
+enum BlockFlags : uint8_t {
+    BLOCK_OPAQUE = 1 << 0,      // Hides the faces against it; stops light and sight
+    BLOCK_TRANSLUCENT = 1 << 1, // Light and sight pass; drawn blended in its own mesh after everything opaque
+    BLOCK_SOLID = 1 << 2,       // Stops moving boxes (water is waded through)
+    BLOCK_FLUID = 1 << 3,       // Water, still or flowing
+};
+struct BlockProperties {
+    uint8_t flags;      // BlockFlags
+    uint8_t emission;   // Block light given off (0..MAX_LIGHT); emitters light their neighbours
+};
+constexpr BlockProperties BLOCK_PROPERTIES[BLOCK_TYPE_COUNT] = {
+    { 0, 0 },                                       // air
+    { BLOCK_OPAQUE | BLOCK_SOLID, 0 },              // stone
+    { BLOCK_OPAQUE | BLOCK_SOLID, 0 },              // dirt
+    { BLOCK_OPAQUE | BLOCK_SOLID, 0 },              // grass
+    { BLOCK_OPAQUE | BLOCK_SOLID, 15 },             // lamp
+    { BLOCK_TRANSLUCENT | BLOCK_FLUID, 0 },         // water
+    { BLOCK_TRANSLUCENT | BLOCK_SOLID, 0 },         // glass
+    { BLOCK_TRANSLUCENT | BLOCK_FLUID, 0 },         // flowing water
+    { BLOCK_OPAQUE | BLOCK_SOLID, 0 },              // wood
+    { BLOCK_OPAQUE | BLOCK_SOLID, 0 },              // leaves
+};
+
+constexpr bool blockPropertiesConsistent()
+{
+    for (int id = 0; id < BLOCK_TYPE_COUNT; id++) {
+        int flags = BLOCK_PROPERTIES[id].flags;
+        // Every non-air block is drawn in exactly one mesh
+        if (((flags & BLOCK_OPAQUE) != 0) == ((flags & BLOCK_TRANSLUCENT) != 0) && id != BLOCK_AIR)
+            return false;
+    }
+    return BLOCK_PROPERTIES[BLOCK_AIR].flags == 0;
+}
+static_assert(blockPropertiesConsistent(), "blocks must be opaque or translucent, air neither");
+
+inline bool isTranslucent(BlockId id) { return (BLOCK_PROPERTIES[id].flags & BLOCK_TRANSLUCENT) != 0; }
+inline bool isOpaque(BlockId id) { return (BLOCK_PROPERTIES[id].flags & BLOCK_OPAQUE) != 0; }
+inline bool isWater(BlockId id) { return (BLOCK_PROPERTIES[id].flags & BLOCK_FLUID) != 0; }
+inline int blockEmission(BlockId id) { return BLOCK_PROPERTIES[id].emission; }
+
+// True if the face of 'block' towards 'neighbour' is drawn: opaque blocks
+// show against anything see-through, translucent ones only against air or
+// a different translucent type (no walls inside a body of water, still or
+// flowing)
+inline bool faceVisible(BlockId block, BlockId neighbour)
+{
+    if (block == BLOCK_AIR || isOpaque(neighbour))
+        return false;
+    return isOpaque(block) || (neighbour != block && !(isWater(neighbour) && isWater(block)));
+}
+
+// Neighbour offset for each face direction: -X, +X, -Y, +Y, -Z, +Z
+const int FACE_NORMALS[6][3] = {
+    { -1, 0, 0 }, { 1, 0, 0 },
+    { 0, -1, 0 }, { 0, 1, 0 },
+    { 0, 0, -1 }, { 0, 0, 1 }
+};
+
+// Linear voxel index, laid out [x][y][z]
+inline int chunkIndex(int x, int y, int z)
+{
+    return (x << (2 * CHUNK_SHIFT)) | (y << CHUNK_SHIFT) | z;
+}
+// Voxel position of a linear index
+inline glm::ivec3 chunkIndexPosition(int index)
+{
+    return glm::ivec3(index >> (2 * CHUNK_SHIFT), (index >> CHUNK_SHIFT) & CHUNK_MASK, index & CHUNK_MASK);
+}
+
+// Morton (Z-order) voxel index: the bits of x, y and z interleaved (z
+// lowest), so each 2x2x2, 4x4x4, ... block of voxels is contiguous. An
+// alternative layout to chunkIndex() for copies of voxel data that are
+// queried by neighbourhood; chunk storage itself stays linear (the kernel
+// benchmarks compare the two).
+static_assert(CHUNK_SHIFT <= 4, "the bit spreading below handles 4-bit coordinates");
+inline int spreadMortonBits(int v)
+{
+    v &= CHUNK_MASK;
+    v = (v | (v << 4)) & 0x0C3;
+    return (v | (v << 2)) & 0x249;
+}
+inline int gatherMortonBits(int v)
+{
+    v &= 0x249;
+    v = (v | (v >> 2)) & 0x0C3;
+    return (v | (v >> 4)) & 0x0F;
+}
+inline int chunkMortonIndex(int x, int y, int z)
+{
+    return (spreadMortonBits(x) << 2) | (spreadMortonBits(y) << 1) | spreadMortonBits(z);
+}
+inline glm::ivec3 chunkMortonPosition(int index)
+{
+    return glm::ivec3(gatherMortonBits(index >> 2), gatherMortonBits(index >> 1), gatherMortonBits(index));
+}
+// Reorder CHUNK_VOLUME voxels between the linear and Morton layouts
+void linearToMorton(const uint8_t* linear, uint8_t* morton);
+void mortonToLinear(const uint8_t* morton, uint8_t* linear);
+
+// Light levels are 0..MAX_LIGHT, two per voxel in one byte: sunlight in the
+// high nibble, block light in the low one
+const int MAX_LIGHT = 15;
+inline uint8_t packLight(int sun, int block) { return (uint8_t)((sun << 4) | block); }
+inline int sunLight(uint8_t light) { return light >> 4; }
+inline int blockLight(uint8_t light) { return light & 15; }
+// Open sky and no block light: chunks that haven't been lit yet (and every
+// chunk when nothing computes light)
+const uint8_t FULL_SUNLIGHT = 0xF0;
+
+// Per-voxel light of a chunk. Chunks in the open sky or deep underground are
+// one level throughout and store only that.
+struct ChunkLight {
+    std::vector<uint8_t, PoolAllocator<uint8_t, voxelStoragePool>> levels; // CHUNK_VOLUME, empty when uniform
+    uint8_t uniform = FULL_SUNLIGHT;  // The level when 'levels' is empty
+
+    uint8_t get(int index) const { return levels.empty() ? uniform : levels[index]; }
+    // Replace the contents from / expand to a flat CHUNK_VOLUME array
+    void encode(const uint8_t* flat);
+    void decode(uint8_t* flat) const;
+
+    bool isUniform() const { return levels.empty(); }
+    bool operator==(const ChunkLight& other) const;
+    bool operator!=(const ChunkLight& other) const { return !(*this == other); }
+    size_t memoryUsage() const { return levels.capacity(); }
+};
+
+// Palette-compressed block storage: bit-packed indices into a per-chunk
+// palette of block IDs. A chunk of a single block type stores only that
+// value. Index widths are 1, 2, 4 or 8 bits so they never straddle words.
+struct PalettedBlocks {
+    std::vector<BlockId> palette;   // palette[0] is the value of a uniform chunk
+    std::vector<uint64_t, PoolAllocator<uint64_t, voxelStoragePool>> words; // Packed indices, empty when uniform
+    int bitsPerIndex = 0;           // 0 when uniform
+
+    PalettedBlocks() : palette(1, 0) {}
+
+    BlockId get(int index) const
+    {
+        if (bitsPerIndex == 0)
+            return palette[0];
+        int bit = index * bitsPerIndex;
+        uint64_t mask = (1ull << bitsPerIndex) - 1;
+        return palette[(words[bit >> 6] >> (bit & 63)) & mask];
+    }
+
+    void set(int index, BlockId id);
+    // Make every voxel 'id' (collapses to uniform storage)
+    void fill(BlockId id);
+    // Replace the contents from / expand to a flat CHUNK_VOLUME array
+    void encode(const BlockId* flat);
+    void decode(BlockId* flat) const;
+    // Drop palette entries no voxel uses any more (set() only adds them),
+    // narrowing the indices when that allows
+    void compact();
+
+    bool isUniform() const { return bitsPerIndex == 0; }
+    // Resident bytes used by palette and packed indices
+    size_t memoryUsage() const { return palette.capacity() * sizeof(BlockId) + words.capacity() * sizeof(uint64_t); }
+
+private:
+    int findOrAdd(BlockId id);
+    void repack(int newBits);
+};
+
+// Flat, uncompressed copy of a chunk's blocks and light for hot loops such
+// as meshing, plus the touching layer of each neighbour chunk (air in full
+// sunlight where none is loaded). border[face] and borderLight[face] are
+// indexed by the two remaining axes in x, y, z order.
+struct ChunkVoxels {
+    BlockId blocks[CHUNK_VOLUME];
+    BlockId border[6][CHUNK_SIZE][CHUNK_SIZE];
+    uint8_t light[CHUNK_VOLUME];
+    uint8_t borderLight[6][CHUNK_SIZE][CHUNK_SIZE];
+
+    // Heap snapshots are recycled through voxelSnapshotPool()
+    static void* operator new(size_t size);
+    static void operator delete(void* block);
+
+    BlockId get(int x, int y, int z) const { return blocks[chunkIndex(x, y, z)]; }
+
+    // Block at (x, y, z). Coordinates may step one voxel outside the chunk
+    // along a single axis, which reads the neighbour border.
+    BlockId blockAt(int x, int y, int z) const
+    {
+        if (x < 0) return border[0][y][z];
+        if (x >= CHUNK_SIZE) return border[1][y][z];
+        if (y < 0) return border[2][x][z];
+        if (y >= CHUNK_SIZE) return border[3][x][z];
+        if (z < 0) return border[4][x][y];
+        if (z >= CHUNK_SIZE) return border[5][x][y];
+        return blocks[chunkIndex(x, y, z)];
+    }
+
+    // Light of the voxel at (x, y, z), with the same one-voxel reach as blockAt()
+    uint8_t lightAt(int x, int y, int z) const
+    {
+        if (x < 0) return borderLight[0][y][z];
+        if (x >= CHUNK_SIZE) return borderLight[1][y][z];
+        if (y < 0) return borderLight[2][x][z];
+        if (y >= CHUNK_SIZE) return borderLight[3][x][z];
+        if (z < 0) return borderLight[4][x][y];
+        if (z >= CHUNK_SIZE) return borderLight[5][x][y];
+        return light[chunkIndex(x, y, z)];
+    }
+};
+
+// Where a loaded chunk is in its life. Before it exists a chunk is either
+// unloaded or loading (queued in World::pendingChunks). World moves it to
+// READY once its neighbours are settled, and LightEngine to LIT once its
+// column is lit; the renderer takes it from there.
+// Each step is budgeted per frame or tick, nearest chunks first: adoption
+// (CHUNK_LOADS_PER_TICK), mesh submissions, mesh uploads (bytes) and
+// eviction (the memory budgets).
+enum ChunkState {
+    CHUNK_GENERATED,    // Voxels loaded or generated; a neighbour is still on its way
+    CHUNK_READY,        // Every neighbour is loaded or will not be: may be lit
+    CHUNK_LIT,          // Light computed: may be meshed
+    CHUNK_MESHING,      // Snapshot with the mesher
+    CHUNK_MESHED,       // Mesh built, waiting for the upload budget
+    CHUNK_UPLOADED,     // Mesh on the GPU (or none needed); dirty again on changes
+    CHUNK_EVICTED,      // Mesh dropped for the GPU budget, rebuilt when back in view
+    CHUNK_UNLOADING     // Out of the world; freed by World::releaseUnloaded()
+};
+
+// A CHUNK_SIZE^3 block of voxels
+struct Chunk {
+    glm::ivec3 coord;       // Chunk coordinate (world position / CHUNK_SIZE)
+    PalettedBlocks blocks;
+    ChunkLight light;       // Written by LightEngine results on the main thread
+    ChunkState state = CHUNK_GENERATED;
+    bool dirty;             // Voxels changed since the mesh was last built
+    bool edited = false;    // Dirty from a block edit: re-mesh this frame, not in the background
+    bool unsaved = false;   // Edited since it was last saved to a RegionStore (generated chunks never are)
+    bool bakedLight = false; // 'light' is final for these blocks: read with them from a RegionStore
+                             // (or lit offline to be saved with them); cleared by edits
+
+    // Cold tier (World::compressColdChunks()): the packed indices and light
+    // levels of a chunk nothing has read for a while, LZ4-compressed one
+    // after the other. The palette, index width and uniform light stay as
+    // they are, so uniform and palette checks need no thaw; a cold chunk's
+    // 'words' and 'levels' are empty until World thaws it.
+    std::vector<uint8_t> coldVoxels;
+    uint32_t coldBlockBytes = 0;    // Compressed indices; the light levels follow
+    bool coldLightLevels = false;   // 'light' had per-voxel levels
+    uint8_t coldFaceSolid = 0;      // faceHasSolid() bits of the six faces, for reads while cold
+    std::atomic<bool> cold{ false };
+    mutable std::atomic<uint32_t> lastRead{ 0 }; // World's cold clock when last handed out
+
+    bool isCold() const { return cold.load(std::memory_order_acquire); }
+    // Compact the palette and compress into the cold tier. False (and
+    // nothing compressed) if that would not save memory.
+    bool freeze();
+    // Back from the cold tier; World serialises thaws of a chunk
+    void thaw();
+
+    BlockId get(int x, int y, int z) const { return blocks.get(chunkIndex(x, y, z)); }
+    void set(int x, int y, int z, BlockId id)
+    {
+        blocks.set(chunkIndex(x, y, z), id);
+        dirty = true;
+    }
+
+    // True if the voxel at (x, y, z) is air or outside the chunk
+    bool isExposed(int x, int y, int z) const
+    {
+        if (x < 0 || x >= CHUNK_SIZE || y < 0 || y >= CHUNK_SIZE || z < 0 || z >= CHUNK_SIZE)
+            return true;
+        return get(x, y, z) == BLOCK_AIR;
+    }
+
+    // A chunk of one block type (all air, all stone, ...) stores no voxel
+    // array. Every stage checks this first and handles the chunk in O(1).
+    bool isUniform() const { return blocks.isUniform(); }
+    BlockId uniformBlock() const { return blocks.palette[0]; }
+
+    // True if any voxel of the boundary layer on 'face' (-X, +X, -Y, +Y, -Z, +Z) is solid
+    bool faceHasSolid(int face) const;
+
+    // Expand into a flat array for bulk processing (borders are left as air
+    // in full sunlight)
+    void decode(ChunkVoxels& out) const
+    {
+        blocks.decode(out.blocks);
+        light.decode(out.light);
+        memset(out.border, BLOCK_AIR, sizeof(out.border));
+        memset(out.borderLight, FULL_SUNLIGHT, sizeof(out.borderLight));
+    }
+
+    // World-space position of the chunk's minimum corner
+    glm::vec3 origin() const { return glm::vec3(coord) * (float)CHUNK_SIZE; }
+    // Minimum corner relative to 'eye', subtracted in double so the small
+    // result stays precise however far both are from the world origin
+    glm::vec3 relativeOrigin(const glm::dvec3& eye) const
+    {
+        return glm::vec3(glm::dvec3(coord) * (double)CHUNK_SIZE - eye);
+    }
+
+    // Chunks are recycled through chunkPool()
+    static void* operator new(size_t size);
+    static void operator delete(void* block);
+};
+
+// Fixed-size pools behind Chunk and ChunkVoxels allocations
+BlockPool& chunkPool();
+BlockPool& voxelSnapshotPool();
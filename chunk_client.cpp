@@ -0,0 +1,217 @@
+#include "chunk_client.h"
+#include "net_protocol.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+bool ChunkClient::connect(const char* host, int port, double timeoutSeconds)
+{
+    disconnect();
+    if (!connection.connect(host, port))
+        return false;
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point deadline = Clock::now() +
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeoutSeconds));
+    uint8_t type;
+    const uint8_t* body;
+    size_t size;
+    while (Clock::now() < deadline) {
+        bool open = connection.update();
+        if (connection.receive(type, body, size)) {
+            uint32_t version;
+            if (type == NET_HELLO && decodeHello(body, size, version, seed) && version == NET_PROTOCOL_VERSION)
+                return true;
+            std::cout << "Client: the server speaks another protocol" << std::endl;
+            break;
+        }
+        if (!open)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    connection.close();
+    return false;
+}
+
+void ChunkClient::disconnect()
+{
+    connection.close();
+    for (Chunk* chunk : arrived)
+        delete chunk;
+    arrived.clear();
+    inFlight.clear();
+    requestBatch.clear();
+    releaseBatch.clear();
+    editBatch.clear();
+    inputBatch.clear();
+    requested = 0;
+    spawned = false;
+    spawnPending = false;
+    prediction.reset();
+    snapshots.clear();
+}
+
+Chunk* ChunkClient::findArrived(const glm::ivec3& coord) const
+{
+    for (Chunk* chunk : arrived) {
+        if (chunk->coord == coord)
+            return chunk;
+    }
+    return nullptr;
+}
+
+void ChunkClient::request(const glm::ivec3& coord)
+{
+    inFlight.push_back({ coord, requested++ });
+    requestBatch.push_back(coord);
+}
+
+void ChunkClient::release(const glm::ivec3& coord)
+{
+    for (size_t i = 0; i < inFlight.size(); i++) {
+        if (inFlight[i].coord == coord) {
+            // A reply already on its way no longer matches and is dropped
+            inFlight[i] = inFlight.back();
+            inFlight.pop_back();
+            break;
+        }
+    }
+    for (size_t i = 0; i < arrived.size(); i++) {
+        if (arrived[i]->coord == coord) {
+            delete arrived[i];
+            arrived.erase(arrived.begin() + i);
+            break;
+        }
+    }
+    releaseBatch.push_back(coord);
+}
+
+void ChunkClient::cancelOutside(const glm::ivec2& centerColumn, int radius, std::vector<glm::ivec3>& cancelled)
+{
+    auto outside = [&](const glm::ivec3& coord) {
+        int dx = coord.x - centerColumn.x;
+        int dz = coord.z - centerColumn.y;
+        return dx * dx + dz * dz > radius * radius;
+    };
+    std::vector<glm::ivec3> dropped;
+    for (const InFlight& request : inFlight) {
+        if (outside(request.coord))
+            dropped.push_back(request.coord);
+    }
+    for (const Chunk* chunk : arrived) {
+        if (outside(chunk->coord))
+            dropped.push_back(chunk->coord);
+    }
+    for (const glm::ivec3& coord : dropped) {
+        release(coord);
+        cancelled.push_back(coord);
+    }
+}
+
+int ChunkClient::collect(std::vector<Chunk*>& out, int maxResults)
+{
+    int count = std::min(maxResults, (int)arrived.size());
+    out.insert(out.end(), arrived.begin(), arrived.begin() + count);
+    arrived.erase(arrived.begin(), arrived.begin() + count);
+    return count;
+}
+
+void ChunkClient::sendEdit(const glm::ivec3& block, BlockId id)
+{
+    editBatch.push_back({ block, id });
+}
+
+void ChunkClient::stepPlayer(const World& world, const PlayerInput& input, float dt)
+{
+    if (!player)
+        return;
+    if (!spawned) {
+        spawned = true;
+        spawnPending = true;
+        spawnPosition = player->position;
+    }
+    NetPlayerInput recorded = prediction.record(input, player->mode, dt);
+    stepNetPlayer(*player, world, recorded);
+    inputBatch.push_back(recorded);
+    prediction.decay(dt);
+}
+
+bool ChunkClient::update(World& world)
+{
+    PROFILE_ZONE("Chunk client");
+    if (spawnPending) {
+        encodePlayerSpawn(spawnPosition, connection.beginMessage(NET_PLAYER_SPAWN, 24));
+        connection.endMessage();
+        spawnPending = false;
+    }
+    if (!inputBatch.empty()) {
+        encodePlayerInputs(inputBatch, connection.beginMessage(NET_PLAYER_INPUT, inputBatch.size() * 20 + 10));
+        connection.endMessage();
+        inputBatch.clear();
+    }
+    if (!requestBatch.empty()) {
+        encodeChunkCoords(requestBatch, connection.beginMessage(NET_CHUNK_REQUEST));
+        connection.endMessage();
+        requestBatch.clear();
+    }
+    if (!releaseBatch.empty()) {
+        encodeChunkCoords(releaseBatch, connection.beginMessage(NET_CHUNK_RELEASE));
+        connection.endMessage();
+        releaseBatch.clear();
+    }
+    if (!editBatch.empty()) {
+        encodeBlockChanges(editBatch, connection.beginMessage(NET_BLOCK_EDITS));
+        connection.endMessage();
+        editBatch.clear();
+    }
+    bool open = connection.update();
+
+    uint8_t type;
+    const uint8_t* body;
+    size_t size;
+    std::vector<BlockChange> deltas;
+    while (connection.receive(type, body, size)) {
+        if (type == NET_CHUNK_DATA) {
+            Chunk* chunk = new Chunk();
+            uint32_t sequence;
+            bool wanted = false;
+            if (decodeChunkData(body, size, *chunk, sequence, payload)) {
+                for (size_t i = 0; i < inFlight.size(); i++) {
+                    if (inFlight[i].coord == chunk->coord && inFlight[i].sequence == sequence) {
+                        inFlight[i] = inFlight.back();
+                        inFlight.pop_back();
+                        wanted = true;
+                        break;
+                    }
+                }
+            }
+            if (wanted)
+                arrived.push_back(chunk);
+            else
+                delete chunk; // Released while on its way (or malformed)
+        }
+        else if (type == NET_BLOCK_DELTAS) {
+            deltas.clear();
+            decodeBlockChanges(body, size, deltas);
+            for (const BlockChange& delta : deltas) {
+                if (world.setBlock(delta.block, delta.id, false))
+                    continue;
+                if (Chunk* chunk = findArrived(chunkCoordOf(delta.block))) {
+                    glm::ivec3 local = localBlockOf(delta.block);
+                    chunk->set(local.x, local.y, local.z, delta.id);
+                }
+            }
+        }
+        else if (type == NET_SNAPSHOT && decodeSnapshot(body, size, snapshot)) {
+            snapshots.push(snapshot, netClockSeconds());
+            if (player && snapshot.hasPlayer)
+                prediction.reconcile(*player, world, snapshot.player, snapshot.inputAck);
+        }
+    }
+    if (!open)
+        std::cout << "Client: lost the connection to the server" << std::endl;
+    return open;
+}
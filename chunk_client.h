@@ -0,0 +1,96 @@
+#pragma once
+
+#include "chunk.h"
+#include "net_connection.h"
+#include "net_protocol.h"
+#include "player_prediction.h"
+#include "snapshot_buffer.h"
+#include "world.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Client side of chunk streaming (see ChunkServer), used as the remote
+// chunk source of a ChunkGenerator: the generator keeps ordering requests
+// by distance and view direction as it does for generation, and hands the
+// best ones here while fewer than maxInFlight are outstanding. Arrived
+// chunks are collected by the world like generated ones, so they go
+// through lighting and the background mesher unchanged.
+//
+// The local player is predicted (see PlayerPrediction) and its inputs sent
+// to the server, which moves it for real; the entities around it come in
+// snapshots, buffered and interpolated by 'snapshots'.
+//
+// Main thread only.
+struct ChunkClient {
+    // Connect to 'host' on 'port' and wait up to 'timeoutSeconds' for the
+    // server's hello
+    bool connect(const char* host, int port, double timeoutSeconds = 5.0);
+    void disconnect();
+    bool connected() const { return connection.isOpen(); }
+
+    // Once per tick, before the world streams and the player steps: send
+    // what was queued, take arrived chunks, apply the server's deltas (to
+    // 'world', or to arrived chunks it hasn't collected yet) and correct
+    // 'player' by its snapshots. False once the connection is lost.
+    bool update(World& world);
+
+    // Step 'player' by one tick of 'input' as the server will, and queue the
+    // input for it. The first call also tells the server where the player
+    // starts.
+    void stepPlayer(const World& world, const PlayerInput& input, float dt);
+
+    // The player's edit, already applied locally; the server sends it back
+    // (or corrects it) with its deltas
+    void sendEdit(const glm::ivec3& block, BlockId id);
+
+    // ChunkGenerator side
+    bool canRequest() const { return (int)inFlight.size() < maxInFlight; }
+    void request(const glm::ivec3& coord);
+    // Stop wanting a chunk: cancels it if requested, or stops its deltas if
+    // the world took it
+    void release(const glm::ivec3& coord);
+    // Release the requested and uncollected chunks whose column is further
+    // than 'radius' from 'centerColumn', appending their coordinates to
+    // 'cancelled'
+    void cancelOutside(const glm::ivec2& centerColumn, int radius, std::vector<glm::ivec3>& cancelled);
+    // Take at most 'maxResults' arrived chunks; ownership passes to the caller
+    int collect(std::vector<Chunk*>& out, int maxResults);
+    // Requested or arrived, not collected
+    int pendingCount() const { return (int)(inFlight.size() + arrived.size()); }
+
+    uint32_t seed = 0;      // The server's terrain seed, from its hello
+    int maxInFlight = 64;   // Requests outstanding at once
+
+    // The local player, moved by stepPlayer() and snapshots (not owned)
+    PlayerController* player = nullptr;
+    PlayerPrediction prediction;
+    SnapshotBuffer snapshots;
+
+    ~ChunkClient() { disconnect(); }
+
+private:
+    struct InFlight {
+        glm::ivec3 coord;
+        uint32_t sequence;  // See encodeChunkData()
+    };
+
+    // Arrived, uncollected chunk at 'coord', or nullptr
+    Chunk* findArrived(const glm::ivec3& coord) const;
+
+    NetConnection connection;
+    uint32_t requested = 0;                 // Coordinates requested so far
+    std::vector<InFlight> inFlight;         // At most maxInFlight: linear searches
+    std::vector<Chunk*> arrived;            // Owned, in arrival order
+    std::vector<glm::ivec3> requestBatch;   // Queued for the next update()
+    std::vector<glm::ivec3> releaseBatch;
+    std::vector<BlockChange> editBatch;
+    std::vector<NetPlayerInput> inputBatch;
+    std::vector<uint8_t> payload;           // A chunk's payload, decompressed
+    NetSnapshot snapshot;                   // Decoded into, keeping its memory
+    glm::dvec3 spawnPosition = glm::dvec3(0.0);
+    bool spawned = false;                   // The spawn was queued
+    bool spawnPending = false;              // ... and not sent yet
+};
@@ -0,0 +1,280 @@
+#include "chunk_generator.h"
+#include "chunk_client.h"
+#include "generation_cache.h"
+#include "memory_tracking.h"
+#include "profiler.h"
+#include "region_file.h"
+#include "thread_priority.h"
+#include "world.h"
+
+#include <algorithm>
+
+void ChunkGenerator::start(JobSystem& jobs)
+{
+    jobSystem = &jobs;
+    stopping = false;
+    if (storage)
+        ioThread = std::thread(&ChunkGenerator::ioLoop, this);
+}
+
+void ChunkGenerator::stop()
+{
+    if (!jobSystem)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        requests.clear();
+        loads.clear();
+        stopping = true;
+    }
+    ioCondition.notify_one();
+    if (ioThread.joinable())
+        ioThread.join(); // Returns once the queued saves are written
+    jobSystem->wait(activeJobs);
+    jobSystem = nullptr;
+
+    // Free results that were never collected
+    results.drain(collected);
+    for (Chunk* chunk : collected)
+        delete chunk;
+    collected.clear();
+}
+
+float ChunkGenerator::score(const glm::ivec3& coord) const
+{
+    bool first = preferred.contains(packChunkCoord(coord));
+    if (!hasFocus)
+        return first ? -1.0f : 0.0f;
+
+    glm::vec3 boxMin = glm::vec3(coord) * (float)CHUNK_SIZE;
+    glm::vec3 boxMax = boxMin + glm::vec3((float)CHUNK_SIZE);
+    glm::vec3 delta = (boxMin + boxMax) * 0.5f - focusPos;
+    float distance2 = glm::dot(delta, delta);
+
+    // Preferred chunks score below zero, still nearest first
+    if (first)
+        return -1.0f / (1.0f + distance2);
+
+    // Chunks outside the view wait as if they were twice as far away
+    return focusFrustum.intersectsAABB(boxMin, boxMax) ? distance2 : distance2 * 4.0f;
+}
+
+void ChunkGenerator::request(const glm::ivec3& coord)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (remote) {
+        // Sent from collect() as the server has room
+        requests.push_back({ coord, score(coord) });
+        std::push_heap(requests.begin(), requests.end(), servedAfter);
+        return;
+    }
+    if (!storage) {
+        queueGeneration(coord);
+        return;
+    }
+    loads.push_back({ coord, score(coord) });
+    std::push_heap(loads.begin(), loads.end(), servedAfter);
+    ioCondition.notify_one();
+}
+
+void ChunkGenerator::queueGeneration(const glm::ivec3& coord)
+{
+    requests.push_back({ coord, score(coord) });
+    std::push_heap(requests.begin(), requests.end(), servedAfter);
+
+    // One job per request; each takes whatever is most urgent when it runs
+    jobSystem->schedule([this] { generateNext(); }, &activeJobs);
+}
+
+void ChunkGenerator::save(const Chunk& chunk)
+{
+    if (!storage)
+        return;
+    if (!ioThread.joinable()) {
+        storage->save(chunk);
+        return;
+    }
+    Chunk* copy = new Chunk();
+    copy->coord = chunk.coord;
+    copy->blocks = chunk.blocks;
+    if (chunk.bakedLight) {
+        copy->light = chunk.light;
+        copy->bakedLight = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        saves.push_back(copy);
+    }
+    ioCondition.notify_one();
+}
+
+void ChunkGenerator::release(const glm::ivec3& coord)
+{
+    if (remote)
+        remote->release(coord);
+}
+
+void ChunkGenerator::cancelRequests(std::vector<Request>& queue, const glm::ivec2& centerColumn, int radius,
+    std::vector<glm::ivec3>& cancelled)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < queue.size(); i++) {
+        int dx = queue[i].coord.x - centerColumn.x;
+        int dz = queue[i].coord.z - centerColumn.y;
+        if (dx * dx + dz * dz > radius * radius)
+            cancelled.push_back(queue[i].coord);
+        else
+            queue[kept++] = queue[i];
+    }
+    queue.resize(kept);
+}
+
+void ChunkGenerator::cancelOutside(const glm::ivec2& centerColumn, int radius, std::vector<glm::ivec3>& cancelled)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    cancelRequests(requests, centerColumn, radius, cancelled);
+    cancelRequests(loads, centerColumn, radius, cancelled);
+    if (remote)
+        remote->cancelOutside(centerColumn, radius, cancelled);
+    std::make_heap(requests.begin(), requests.end(), servedAfter);
+    std::make_heap(loads.begin(), loads.end(), servedAfter);
+}
+
+void ChunkGenerator::setFocus(const glm::vec3& cameraPos, const Frustum& frustum)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    focusPos = cameraPos;
+    focusFrustum = frustum;
+    hasFocus = true;
+
+    for (Request& r : requests)
+        r.score = score(r.coord);
+    for (Request& r : loads)
+        r.score = score(r.coord);
+    std::make_heap(requests.begin(), requests.end(), servedAfter);
+    std::make_heap(loads.begin(), loads.end(), servedAfter);
+}
+
+void ChunkGenerator::prefer(const std::vector<glm::ivec3>& coords)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    preferred.clear();
+    for (const glm::ivec3& coord : coords) {
+        for (int dx = -1; dx <= 1; dx++)
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dz = -1; dz <= 1; dz++)
+                    preferred[packChunkCoord(coord + glm::ivec3(dx, dy, dz))] = true;
+    }
+
+    for (Request& r : requests)
+        r.score = score(r.coord);
+    for (Request& r : loads)
+        r.score = score(r.coord);
+    std::make_heap(requests.begin(), requests.end(), servedAfter);
+    std::make_heap(loads.begin(), loads.end(), servedAfter);
+}
+
+int ChunkGenerator::collect(std::vector<Chunk*>& out, int maxResults)
+{
+    if (remote) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        while (!requests.empty() && remote->canRequest()) {
+            std::pop_heap(requests.begin(), requests.end(), servedAfter);
+            remote->request(requests.back().coord);
+            requests.pop_back();
+        }
+        return remote->collect(out, maxResults);
+    }
+    results.drain(collected);
+
+    int count = 0;
+    while (count < maxResults && !collected.empty()) {
+        out.push_back(collected.front());
+        collected.pop_front();
+        count++;
+    }
+    return count;
+}
+
+int ChunkGenerator::pendingCount()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return (int)(requests.size() + loads.size()) + reading + (remote ? remote->pendingCount() : 0);
+}
+
+void ChunkGenerator::generateNext()
+{
+    PROFILE_ZONE("Generate chunk");
+    MemoryTagScope memoryTag(MEMORY_VOXELS);
+    glm::ivec3 coord;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (requests.empty())
+            return; // Cancelled
+
+        std::pop_heap(requests.begin(), requests.end(), servedAfter);
+        coord = requests.back().coord;
+        requests.pop_back();
+    }
+
+    Chunk* chunk = new Chunk();
+    if (cache && cache->fetch(seed, coord, chunk->blocks)) {
+        chunk->coord = coord;
+        chunk->dirty = true;
+        results.push(chunk);
+        return;
+    }
+    TerrainNeighbourhood terrain;
+    columns.getNeighbourhood(glm::ivec2(coord.x, coord.z), seed, terrain);
+    generateChunk(*chunk, coord, terrain, seed);
+    // Uniform chunks come out of the generator in O(1); only cache the rest
+    if (cache && !chunk->isUniform())
+        cache->store(seed, coord, chunk->blocks);
+    results.push(chunk);
+}
+
+void ChunkGenerator::ioLoop()
+{
+    profilerSetThreadName("Chunk I/O");
+    setThreadMemoryTag(MEMORY_IO);
+    // Saves and loads wait on the disk anyway; they shouldn't take a core
+    // from the frame
+    setCurrentThreadPriority(THREAD_LOW_PRIORITY);
+    std::unique_lock<std::mutex> lock(queueMutex);
+    for (;;) {
+        ioCondition.wait(lock, [this] { return stopping || !saves.empty() || !loads.empty(); });
+
+        // Saves first: a chunk unloaded and requested again must read its last copy
+        if (!saves.empty()) {
+            Chunk* chunk = saves.front();
+            saves.pop_front();
+            lock.unlock();
+            storage->save(*chunk);
+            delete chunk;
+            lock.lock();
+            continue;
+        }
+        if (stopping)
+            return;
+
+        std::pop_heap(loads.begin(), loads.end(), servedAfter);
+        glm::ivec3 coord = loads.back().coord;
+        loads.pop_back();
+        reading++;
+        lock.unlock();
+
+        Chunk* chunk = new Chunk();
+        bool loaded = storage->load(coord, *chunk);
+        if (loaded)
+            results.push(chunk);
+        else
+            delete chunk;
+
+        lock.lock();
+        reading--;
+        // Never saved: generate it instead
+        if (!loaded && !stopping)
+            queueGeneration(coord);
+    }
+}
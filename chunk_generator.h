@@ -0,0 +1,119 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_hash_map.h"
+#include "frustum.h"
+#include "job_system.h"
+#include "mpsc_queue.h"
+#include "terrain_column.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ChunkClient;
+struct GenerationCache;
+struct RegionStore;
+
+// Provides chunk voxel data off the main thread. With a RegionStore, an
+// I/O thread of its own reads requested chunks from disk and hands the ones
+// never saved to generation; without one, every request is generated.
+// Generation tries the GenerationCache first, if any: chunks that were
+// never edited are never saved, so coming back to them is a cache hit. Both
+// stages serve requests by priority (distance to the camera, in-frustum
+// first); finished chunks come back through a lock-free queue.
+//
+// The I/O thread also writes the chunks passed to save(), always before the
+// next load, so a chunk saved on unload and requested again reads back its
+// latest copy. Loads are mapped-file reads (RegionStore): page faults on the
+// I/O thread are the only waits, and nothing on the main thread touches disk.
+//
+// With a remote source the chunks come from a server instead: requests are
+// ordered the same way and handed to it as it has room, on collect().
+struct ChunkGenerator {
+    // Run generation jobs on 'jobs', and the I/O thread when 'storage' is set
+    void start(JobSystem& jobs);
+    // Drop unfinished requests, write the queued saves and wait for running jobs
+    void stop();
+
+    // Queue a chunk for loading or generation (main thread)
+    void request(const glm::ivec3& coord);
+    // Queue a snapshot of the chunk's blocks (and baked light) to be
+    // compressed and saved on the I/O thread; the chunk itself can be edited
+    // or freed right after. The paletted blocks are a few KB at most, so the
+    // copy is the whole cost on the calling thread. Written at once when the I/O thread isn't running;
+    // ignored without storage.
+    void save(const Chunk& chunk);
+    // The world dropped a chunk it collected; a remote source stops sending
+    // its changes
+    void release(const glm::ivec3& coord);
+    // Drop queued requests whose column is further than 'radius' from 'centerColumn'.
+    // Their coordinates are appended to 'cancelled'.
+    void cancelOutside(const glm::ivec2& centerColumn, int radius, std::vector<glm::ivec3>& cancelled);
+    // Update the camera used to prioritise queued requests
+    void setFocus(const glm::vec3& cameraPos, const Frustum& frustum);
+    // Serve requests for 'coords', and the chunks around them that lighting
+    // and meshing wait for, before every other one (nearest first among
+    // them); an empty list ends the preference
+    void prefer(const std::vector<glm::ivec3>& coords);
+
+    // Take at most 'maxResults' finished chunks (main thread). Ownership passes to the caller.
+    int collect(std::vector<Chunk*>& out, int maxResults);
+
+    // Requests waiting to be loaded or generated
+    int pendingCount();
+
+    ~ChunkGenerator() { stop(); }
+
+    // Terrain seed; set before the first request
+    uint32_t seed = 0;
+    // Heightmaps and biomes shared by the chunks of a column
+    TerrainColumnCache columns;
+    // Saved chunks, read instead of generating when present (not owned);
+    // set before start()
+    RegionStore* storage = nullptr;
+    // Generated chunks to reuse (not owned); set before start()
+    GenerationCache* cache = nullptr;
+    // Server the chunks are requested from instead of loading or generating
+    // them (not owned); set before the first request
+    ChunkClient* remote = nullptr;
+
+private:
+    struct Request {
+        glm::ivec3 coord;
+        float score;    // Lower is served first
+    };
+    // Heap order: the request with the lowest score on top
+    static bool servedAfter(const Request& a, const Request& b) { return a.score > b.score; }
+
+    float score(const glm::ivec3& coord) const;
+    // Drop the requests of 'queue' whose column is further than 'radius' from 'centerColumn'
+    static void cancelRequests(std::vector<Request>& queue, const glm::ivec2& centerColumn, int radius,
+        std::vector<glm::ivec3>& cancelled);
+    // Queue 'coord' for generation and schedule its job (queueMutex held)
+    void queueGeneration(const glm::ivec3& coord);
+    // Job body: generate the best request queued at the time it runs
+    void generateNext();
+    // I/O thread body: saves, then the best load, until stopped
+    void ioLoop();
+
+    JobSystem* jobSystem = nullptr;
+    JobCounter activeJobs;
+    std::mutex queueMutex;              // Guards requests, loads, saves, focus and stopping
+    std::vector<Request> requests;      // Generation, min-heap on score
+    std::vector<Request> loads;         // Waiting for the I/O thread, min-heap on score
+    std::deque<Chunk*> saves;           // Owned copies, written in order
+    int reading = 0;                    // Loads taken by the I/O thread and not yet resolved
+    std::condition_variable ioCondition;
+    std::thread ioThread;
+    bool stopping = false;
+    glm::vec3 focusPos = glm::vec3(0.0f);
+    Frustum focusFrustum;
+    bool hasFocus = false;
+    ChunkHashMap<bool> preferred;   // Packed coords served first
+
+    MPSCQueue<Chunk*> results;      // Pushed by workers, drained by the main thread
+    std::deque<Chunk*> collected;   // Main-thread side, in completion order
+};
@@ -0,0 +1,480 @@
+#include "chunk_geometry.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+// Unit-cube corners of each face, counter-clockwise seen from outside
+const float FACE_CORNERS[6][4][3] = {
+    { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 } }, // left   (-X)
+    { { 1, 0, 1 }, { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 } }, // right  (+X)
+    { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 } }, // bottom (-Y)
+    { { 0, 1, 1 }, { 1, 1, 1 }, { 1, 1, 0 }, { 0, 1, 0 } }, // top    (+Y)
+    { { 1, 0, 0 }, { 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 } }, // back   (-Z)
+    { { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } }  // front  (+Z)
+};
+
+// Append the four corners of one quad covering 'size' blocks from 'origin' on the given face.
+// The shared index buffer splits quads along the diagonal from their first
+// vertex; when corners 0 and 2 are less occluded than 1 and 3, emission
+// starts at corner 1 instead so the split runs along the darker pair and
+// the occlusion gradient stays symmetric.
+static void emitQuad(ChunkVertexBuffer& out, int face, const glm::ivec3& origin, const glm::ivec3& size, int material,
+    const uint8_t light[4], const uint8_t ao[4])
+{
+    int first = ao[0] + ao[2] > ao[1] + ao[3] ? 1 : 0;
+    for (int k = 0; k < 4; k++) {
+        int i = (first + k) & 3;
+        const float* corner = FACE_CORNERS[face][i];
+        out.push_back(packChunkVertex(
+            origin.x + (int)corner[0] * size.x,
+            origin.y + (int)corner[1] * size.y,
+            origin.z + (int)corner[2] * size.z,
+            face, ao[i], material, light[i]));
+    }
+}
+
+void packFaceRecords(const ChunkVertex* vertices, int quads, ChunkVertexBuffer& out)
+{
+    for (int q = 0; q < quads; q++) {
+        const ChunkVertex* quad = vertices + q * 4;
+        int face = (quad[0] >> 15) & 7;
+        int d = face / 2;
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+        glm::ivec3 pos[4];
+        glm::ivec3 low(CHUNK_SIZE + 1);
+        glm::ivec3 high(0);
+        for (int k = 0; k < 4; k++) {
+            pos[k] = glm::ivec3(quad[k] & 31, (quad[k] >> 5) & 31, (quad[k] >> 10) & 31);
+            low = glm::min(low, pos[k]);
+            high = glm::max(high, pos[k]);
+        }
+
+        // Emission may start at any corner: shading goes back in corner order
+        uint8_t light[4], ao[4];
+        for (int k = 0; k < 4; k++) {
+            bool highU = pos[k][u] > low[u];
+            bool highV = pos[k][v] > low[v];
+            for (int i = 0; i < 4; i++) {
+                if ((FACE_CORNERS[face][i][u] > 0.0f) == highU && (FACE_CORNERS[face][i][v] > 0.0f) == highV) {
+                    light[i] = (uint8_t)(quad[k] >> 24);
+                    ao[i] = (uint8_t)((quad[k] >> 18) & 3);
+                }
+            }
+        }
+        glm::ivec3 origin = low;
+        origin[d] = pos[0][d] - (int)FACE_CORNERS[face][0][d];
+        bool even = light[0] == light[1] && light[0] == light[2] && light[0] == light[3] &&
+            ao[0] == ao[1] && ao[0] == ao[2] && ao[0] == ao[3];
+
+        uint32_t word0 = (uint32_t)origin.x | (uint32_t)origin.y << 4 | (uint32_t)origin.z << 8 |
+            (uint32_t)face << 12 | ((quad[0] >> 20) & 15) << 15;
+        uint32_t word1;
+        if (even) {
+            word0 |= 1u << 19 | (uint32_t)(high[u] - low[u] - 1) << 20 | (uint32_t)(high[v] - low[v] - 1) << 24;
+            word1 = light[0] | (uint32_t)ao[0] << 8;
+        }
+        else {
+            // Uneven quads are single faces
+            word0 |= (uint32_t)(ao[0] | ao[1] << 2 | ao[2] << 4 | ao[3] << 6) << 20;
+            word1 = light[0] | (uint32_t)light[1] << 8 | (uint32_t)light[2] << 16 | (uint32_t)light[3] << 24;
+        }
+        out.push_back(word0);
+        out.push_back(word1);
+    }
+}
+
+// Light and occupancy samples of a snapshot, padded by a voxel on every
+// side (the neighbour borders), so corner light and ambient occlusion are
+// read without bounds checks. An open voxel's (air or translucent) sample is
+// its block light in bits 0-5, sunlight in bits 6-11 and a count of one in
+// bits 12-14; an opaque voxel's is a count of one in bits 15-17. Samples add up without carries,
+// so a corner sums four and divides once. Edges and corners the snapshot
+// doesn't reach are 0: neither lit nor occluding. Built on the first face,
+// so chunks without any cost nothing.
+struct CornerLight {
+    static const int PADDED = CHUNK_SIZE + 2;
+    static const uint32_t SOLID = 1u << 15;
+    static const uint32_t OPEN_MASK = SOLID - 1;
+
+    explicit CornerLight(const ChunkVoxels& chunk) : chunk(chunk) {}
+
+    // Smooth light and ambient occlusion at the four corners of the face of
+    // voxel 'pos', from the voxels touching each corner in the layer the
+    // face looks into (two sides and the diagonal). Light averages the open
+    // ones, leaving out the diagonal when both sides block it; AO is 3 minus
+    // the solid ones, or 0 when both sides are solid.
+    void face(int face, const glm::ivec3& pos, uint8_t light[4], uint8_t ao[4]);
+
+private:
+    static int index(int x, int y, int z) { return ((x + 1) * PADDED + (y + 1)) * PADDED + (z + 1); }
+    static uint16_t sample(BlockId block, uint8_t level)
+    {
+        return !isOpaque(block) ? (uint16_t)(1 << 12 | sunLight(level) << 6 | blockLight(level)) : (uint16_t)SOLID;
+    }
+    void build();
+
+    const ChunkVoxels& chunk;
+    bool built = false;
+    uint16_t samples[PADDED * PADDED * PADDED];
+};
+
+void CornerLight::build()
+{
+    memset(samples, 0, sizeof(samples));
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            int from = chunkIndex(x, y, 0);
+            int to = index(x, y, 0);
+            for (int z = 0; z < CHUNK_SIZE; z++)
+                samples[to + z] = sample(chunk.blocks[from + z], chunk.light[from + z]);
+        }
+    }
+    for (int face = 0; face < 6; face++) {
+        int d = face / 2;
+        int a = d == 0 ? 1 : 0;
+        int b = d == 2 ? 1 : 2;
+        int pos[3];
+        pos[d] = (face & 1) ? CHUNK_SIZE : -1;
+        for (pos[a] = 0; pos[a] < CHUNK_SIZE; pos[a]++)
+            for (pos[b] = 0; pos[b] < CHUNK_SIZE; pos[b]++)
+                samples[index(pos[0], pos[1], pos[2])] = sample(chunk.border[face][pos[a]][pos[b]], chunk.borderLight[face][pos[a]][pos[b]]);
+    }
+    built = true;
+}
+
+// Rounded sum / count of up to four light levels, [count - 1][sum]
+struct LightAverages {
+    uint8_t table[4][4 * MAX_LIGHT + 1];
+    LightAverages()
+    {
+        for (int count = 1; count <= 4; count++)
+            for (int sum = 0; sum <= 4 * MAX_LIGHT; sum++)
+                table[count - 1][sum] = (uint8_t)std::min((sum + count / 2) / count, MAX_LIGHT);
+    }
+};
+static const LightAverages lightAverages;
+
+void CornerLight::face(int face, const glm::ivec3& pos, uint8_t light[4], uint8_t ao[4])
+{
+    static const int AXIS_STRIDE[3] = { PADDED * PADDED, PADDED, 1 };
+    if (!built)
+        build();
+
+    int d = face / 2;
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+    int facing = index(pos.x, pos.y, pos.z) + FACE_NORMALS[face][d] * AXIS_STRIDE[d];
+    for (int i = 0; i < 4; i++) {
+        const float* corner = FACE_CORNERS[face][i];
+        int stepU = corner[u] > 0.0f ? AXIS_STRIDE[u] : -AXIS_STRIDE[u];
+        int stepV = corner[v] > 0.0f ? AXIS_STRIDE[v] : -AXIS_STRIDE[v];
+        uint32_t sides = samples[facing + stepU] + samples[facing + stepV];
+        uint32_t diagonal = samples[facing + stepU + stepV];
+        // The facing voxel is open, so the count is at least one
+        uint32_t sum = samples[facing] + (sides & OPEN_MASK) + ((sides & OPEN_MASK) ? diagonal & OPEN_MASK : 0);
+        const uint8_t* average = lightAverages.table[(sum >> 12) - 1];
+        light[i] = packLight(average[(sum >> 6) & 63], average[sum & 63]);
+
+        uint32_t solidSides = sides >> 15;
+        ao[i] = (uint8_t)(solidSides == 2 ? 0 : 3 - solidSides - (diagonal >> 15));
+    }
+}
+
+// Visible-face bitmasks of a chunk, one 16-bit row per face and column.
+// faces[face][a][b] runs along the face's axis; a and b are the two other
+// axes in x, y, z order (the ChunkVoxels border layout).
+typedef uint16_t FaceRows[6][CHUNK_SIZE][CHUNK_SIZE];
+static_assert(CHUNK_SIZE <= 16, "face rows hold a chunk row per 16-bit mask");
+
+static void buildFaceRows(const ChunkVoxels& chunk, FaceRows& faces)
+{
+    static_assert(CHUNK_SIZE + 2 <= 32, "padded occupancy rows must fit 32 bits");
+
+    // Opaque occupancy rows per axis, padded with the neighbour border at bit 0
+    // and bit CHUNK_SIZE + 1; voxel c sits at bit c + 1
+    uint32_t solid[3][CHUNK_SIZE][CHUNK_SIZE];
+    const uint32_t high = 1u << (CHUNK_SIZE + 1);
+    for (int a = 0; a < CHUNK_SIZE; a++) {
+        for (int b = 0; b < CHUNK_SIZE; b++) {
+            solid[0][a][b] = (isOpaque(chunk.border[0][a][b]) ? 1u : 0u) | (isOpaque(chunk.border[1][a][b]) ? high : 0u);
+            solid[1][a][b] = (isOpaque(chunk.border[2][a][b]) ? 1u : 0u) | (isOpaque(chunk.border[3][a][b]) ? high : 0u);
+            solid[2][a][b] = (isOpaque(chunk.border[4][a][b]) ? 1u : 0u) | (isOpaque(chunk.border[5][a][b]) ? high : 0u);
+        }
+    }
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            const BlockId* row = &chunk.blocks[chunkIndex(x, y, 0)];
+            uint32_t zBits = 0;
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                uint32_t s = isOpaque(row[z]) ? 1u : 0u;
+                zBits |= s << (z + 1);
+                solid[0][y][z] |= s << (x + 1);
+                solid[1][x][z] |= s << (y + 1);
+            }
+            solid[2][x][y] |= zBits;
+        }
+    }
+
+    // A face is visible where an opaque voxel's neighbour along the axis isn't
+    for (int d = 0; d < 3; d++) {
+        for (int a = 0; a < CHUNK_SIZE; a++) {
+            for (int b = 0; b < CHUNK_SIZE; b++) {
+                uint32_t s = solid[d][a][b];
+                faces[d * 2][a][b] = (uint16_t)((s & ~(s << 1)) >> 1);     // -axis neighbour empty
+                faces[d * 2 + 1][a][b] = (uint16_t)((s & ~(s >> 1)) >> 1); // +axis neighbour empty
+            }
+        }
+    }
+}
+
+// Index of the lowest set bit (bits is non-zero)
+static inline int lowestBit(uint32_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+int meshChunkCulled(const ChunkVoxels& chunk, ChunkVertexBuffer& out)
+{
+    CornerLight corners(chunk);
+    int quads = 0;
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            for (int y = 0; y < CHUNK_SIZE; y++) {
+                for (int z = 0; z < CHUNK_SIZE; z++) {
+                    int block = chunk.get(x, y, z);
+                    if (!isOpaque(block)) continue; // Air, or in the translucent mesh
+
+                    if (!faceVisible(block, chunk.blockAt(x + n[0], y + n[1], z + n[2])))
+                        continue; // Hidden by an opaque neighbour
+
+                    uint8_t light[4], ao[4];
+                    corners.face(face, glm::ivec3(x, y, z), light, ao);
+                    emitQuad(out, face, glm::ivec3(x, y, z), glm::ivec3(1), block, light, ao);
+                    quads++;
+                }
+            }
+        }
+    }
+    return quads;
+}
+
+int meshChunkBinary(const ChunkVoxels& chunk, ChunkVertexBuffer& out)
+{
+    FaceRows faces;
+    buildFaceRows(chunk, faces);
+
+    CornerLight corners(chunk);
+    int quads = 0;
+    for (int face = 0; face < 6; face++) {
+        int d = face / 2;
+        int a = d == 0 ? 1 : 0; // Row index axes in x, y, z order
+        int b = d == 2 ? 1 : 2;
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            for (int j = 0; j < CHUNK_SIZE; j++) {
+                // Walk only the set bits: one per visible face in the row
+                uint32_t bits = faces[face][i][j];
+                while (bits) {
+                    glm::ivec3 pos;
+                    pos[d] = lowestBit(bits);
+                    pos[a] = i;
+                    pos[b] = j;
+                    bits &= bits - 1;
+
+                    uint8_t light[4], ao[4];
+                    corners.face(face, pos, light, ao);
+                    emitQuad(out, face, pos, glm::ivec3(1), chunk.get(pos.x, pos.y, pos.z), light, ao);
+                    quads++;
+                }
+            }
+        }
+    }
+    return quads;
+}
+
+// Greedy mask entries: 0 for no face, else the material (4 bits) and, for
+// faces shaded the same at all four corners, their light (bits 4-11) and
+// AO (bits 13-14). Unevenly shaded faces are never merged, so a merged
+// quad is always evenly shaded.
+const uint16_t UNEVEN_SHADE = 1u << 12;
+
+static inline uint16_t faceKey(int material, const uint8_t light[4], const uint8_t ao[4])
+{
+    bool even = light[0] == light[1] && light[0] == light[2] && light[0] == light[3] &&
+        ao[0] == ao[1] && ao[0] == ao[2] && ao[0] == ao[3];
+    return (uint16_t)(material | (even ? light[0] << 4 | ao[0] << 13 : UNEVEN_SHADE));
+}
+
+int meshChunkGreedy(const ChunkVoxels& chunk, ChunkVertexBuffer& out)
+{
+    FaceRows faces;
+    buildFaceRows(chunk, faces);
+
+    CornerLight corners(chunk);
+    int quads = 0;
+    uint16_t masks[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
+
+    for (int face = 0; face < 6; face++) {
+        // Slices run along axis d; the mask spans the two other axes u and v
+        int d = face / 2;
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+
+        // Scatter the visible faces into per-slice masks of their material
+        // and shading, visiting set bits only
+        memset(masks, 0, sizeof(masks));
+        int a = d == 0 ? 1 : 0;
+        int b = d == 2 ? 1 : 2;
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            for (int j = 0; j < CHUNK_SIZE; j++) {
+                uint32_t bits = faces[face][i][j];
+                while (bits) {
+                    glm::ivec3 pos;
+                    pos[d] = lowestBit(bits);
+                    pos[a] = i;
+                    pos[b] = j;
+                    bits &= bits - 1;
+                    uint8_t light[4], ao[4];
+                    corners.face(face, pos, light, ao);
+                    masks[pos[d]][pos[u]][pos[v]] = faceKey(chunk.get(pos.x, pos.y, pos.z), light, ao);
+                }
+            }
+        }
+
+        for (int slice = 0; slice < CHUNK_SIZE; slice++) {
+            uint16_t (&mask)[CHUNK_SIZE][CHUNK_SIZE] = masks[slice];
+
+            // Merge runs of equal material and shading into rectangles, widest first
+            for (int j = 0; j < CHUNK_SIZE; j++) {
+                for (int i = 0; i < CHUNK_SIZE; ) {
+                    uint16_t key = mask[i][j];
+                    if (key == 0) {
+                        i++;
+                        continue;
+                    }
+
+                    int w = 1;
+                    int h = 1;
+                    if (!(key & UNEVEN_SHADE)) {
+                        while (i + w < CHUNK_SIZE && mask[i + w][j] == key)
+                            w++;
+
+                        bool canGrow = true;
+                        while (j + h < CHUNK_SIZE && canGrow) {
+                            for (int k = 0; k < w; k++) {
+                                if (mask[i + k][j + h] != key) {
+                                    canGrow = false;
+                                    break;
+                                }
+                            }
+                            if (canGrow)
+                                h++;
+                        }
+                    }
+
+                    glm::ivec3 origin, size;
+                    origin[d] = slice;
+                    origin[u] = i;
+                    origin[v] = j;
+                    size[d] = 1;
+                    size[u] = w;
+                    size[v] = h;
+                    uint8_t light[4], ao[4];
+                    if (key & UNEVEN_SHADE) {
+                        corners.face(face, origin, light, ao);
+                    }
+                    else {
+                        memset(light, (key >> 4) & 0xFF, sizeof(light));
+                        memset(ao, (key >> 13) & 3, sizeof(ao));
+                    }
+                    emitQuad(out, face, origin, size, key & 15, light, ao);
+                    quads++;
+
+                    // Clear the merged area so it isn't emitted again
+                    for (int l = 0; l < h; l++)
+                        for (int k = 0; k < w; k++)
+                            mask[i + k][j + l] = 0;
+
+                    i += w;
+                }
+            }
+        }
+    }
+    return quads;
+}
+
+int meshChunkTranslucent(const ChunkVoxels& chunk, ChunkVertexBuffer& out)
+{
+    CornerLight corners(chunk);
+    int quads = 0;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                BlockId block = chunk.get(x, y, z);
+                if (!isTranslucent(block)) continue;
+
+                for (int face = 0; face < 6; face++) {
+                    const int* n = FACE_NORMALS[face];
+                    if (!faceVisible(block, chunk.blockAt(x + n[0], y + n[1], z + n[2])))
+                        continue;
+
+                    uint8_t light[4], ao[4];
+                    corners.face(face, glm::ivec3(x, y, z), light, ao);
+                    emitQuad(out, face, glm::ivec3(x, y, z), glm::ivec3(1), block, light, ao);
+                    quads++;
+                }
+            }
+        }
+    }
+    return quads;
+}
+
+void sortTranslucentQuads(ChunkVertexBuffer& vertices, const glm::ivec3& cell)
+{
+    // Distances are compared in quarter blocks: a quad's four corners add
+    // up to four times its centre, and the cell centre is 4 * cell + 2
+    int quads = (int)vertices.size() / 4;
+    glm::ivec3 eye = cell * 4 + glm::ivec3(2);
+    std::vector<uint32_t> order(quads);
+    std::vector<uint32_t> keys(quads);
+    for (int q = 0; q < quads; q++) {
+        glm::ivec3 sum(0);
+        for (int k = 0; k < 4; k++) {
+            ChunkVertex v = vertices[q * 4 + k];
+            sum += glm::ivec3(v & 31, (v >> 5) & 31, (v >> 10) & 31);
+        }
+        glm::ivec3 offset = sum - eye;
+        keys[q] = (uint32_t)(offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+        order[q] = (uint32_t)q;
+    }
+    // Farthest first, ties in emission order so repeated sorts agree
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return keys[a] != keys[b] ? keys[a] > keys[b] : a < b;
+    });
+
+    ChunkVertexBuffer sorted;
+    sorted.reserve(vertices.size());
+    for (uint32_t q : order)
+        sorted.insert(sorted.end(), vertices.begin() + q * 4, vertices.begin() + q * 4 + 4);
+    vertices.swap(sorted);
+}
+
+int meshChunk(const ChunkVoxels& chunk, MeshMode mode, ChunkVertexBuffer& out)
+{
+    if (mode == MESH_GREEDY)
+        return meshChunkGreedy(chunk, out);
+    if (mode == MESH_BINARY)
+        return meshChunkBinary(chunk, out);
+    return meshChunkCulled(chunk, out);
+}
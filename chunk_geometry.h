@@ -0,0 +1,95 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// CPU side of chunk meshing: the vertex format and the builders. No GL
+// here, so tools without a display (the world baker) mesh too; ChunkMesh
+// uploads the results.
+
+// Unit-cube corners of each face, counter-clockwise seen from outside
+extern const float FACE_CORNERS[6][4][3];
+
+// Packed chunk mesh vertex, unpacked in the vertex shader (4 bytes):
+//   bits  0-4   x      (chunk-local corner, 0..CHUNK_SIZE)
+//   bits  5-9   y
+//   bits 10-14  z
+//   bits 15-17  face   (-X, +X, -Y, +Y, -Z, +Z)
+//   bits 18-19  ao     (0 = fully occluded .. 3 = unoccluded)
+//   bits 20-23  material (BlockType, resolved by the shader palette)
+//   bits 24-31  light  (packLight(): block light, then sunlight, at the corner)
+typedef uint32_t ChunkVertex;
+
+inline ChunkVertex packChunkVertex(int x, int y, int z, int face, int ao, int material, uint8_t light)
+{
+    return (uint32_t)x | ((uint32_t)y << 5) | ((uint32_t)z << 10) |
+        ((uint32_t)face << 15) | ((uint32_t)ao << 18) | ((uint32_t)material << 20) | ((uint32_t)light << 24);
+}
+static_assert(BLOCK_TYPE_COUNT <= 16, "materials must fit the vertex's 4 bits");
+static_assert(CHUNK_SIZE < 32, "corners 0..CHUNK_SIZE must fit the vertex's 5 bits");
+
+// Upper bound on quads in one chunk mesh (a 3D checkerboard needs 12288),
+// sized to the shared 16-bit quad index buffer
+const int MAX_CHUNK_QUADS = 16384;
+
+// CPU-side vertex list, pooled since meshes are rebuilt constantly while streaming
+typedef std::vector<ChunkVertex, PoolAllocator<ChunkVertex, meshStagingPool>> ChunkVertexBuffer;
+
+// Available chunk mesh builders
+enum MeshMode {
+    MESH_CULLED,    // One quad per visible block face, per-voxel neighbour tests
+    MESH_BINARY,    // Same faces as MESH_CULLED, found with bitmask row operations
+    MESH_GREEDY,    // Coplanar same-material faces merged into larger quads
+    MESH_MODE_COUNT
+};
+
+// Version of the builders' output. Bump it with any change to the vertices
+// any builder emits for a snapshot: meshes saved to disk (MeshCache) are
+// only used while it matches.
+const uint32_t MESHER_VERSION = 2;
+
+// Append the visible-face vertices of a chunk to 'out', each corner lit by
+// the open voxels around it and occluded by the solid ones (quads are split
+// along their darker diagonal). Every builder returns the number of quads
+// emitted; the greedy one only merges faces shaded evenly at every corner.
+// Quads come grouped by face, in face order, so each direction is one range
+// that can be skipped when it faces away from the camera (see ChunkMesh).
+int meshChunkCulled(const ChunkVoxels& chunk, ChunkVertexBuffer& out);
+int meshChunkBinary(const ChunkVoxels& chunk, ChunkVertexBuffer& out);
+int meshChunkGreedy(const ChunkVoxels& chunk, ChunkVertexBuffer& out);
+// Run the builder selected by 'mode'
+int meshChunk(const ChunkVoxels& chunk, MeshMode mode, ChunkVertexBuffer& out);
+
+// Append the visible faces of the chunk's translucent blocks, one quad per
+// face (the opaque builders leave them out, and there are rarely enough to
+// merge). They are drawn blended, so their order matters: see below.
+int meshChunkTranslucent(const ChunkVoxels& chunk, ChunkVertexBuffer& out);
+// Reorder the quads of a translucent mesh back to front as seen from the
+// centre of block 'cell' (chunk-local; may lie outside the chunk). The order
+// is close enough for a camera anywhere in that cell, so it is redone only
+// when the camera moves into another.
+void sortTranslucentQuads(ChunkVertexBuffer& vertices, const glm::ivec3& cell);
+
+// Compact mesh format: one record of FACE_RECORD_WORDS words per quad
+// instead of four vertices, expanded back into the same vertices by the
+// vertex shader (see chunkVertexInputSource()). Half the memory, for the
+// cost of decoding each vertex. Records hold what the builders' quads
+// need, relying on merged quads being evenly shaded:
+//   word 0  bits  0-11  block origin x, y, z (4 bits each)
+//           bits 12-14  face
+//           bits 15-18  material
+//           bit  19     even: the same light and AO at every corner
+//           bits 20-27  even: quad size - 1 along the face's u and v axes
+//                       (4 bits each); else AO per corner (2 bits each,
+//                       FACE_CORNERS order)
+//   word 1  even: light in bits 0-7 and AO in bits 8-9; else light per
+//           corner (8 bits each)
+const int FACE_RECORD_WORDS = 2;
+static_assert(CHUNK_SIZE <= 16, "block origins and quad sizes must fit the record's 4 bits");
+// Append the records of 'quads' quads of 'vertices', four each as the
+// builders emit them, to 'out'
+void packFaceRecords(const ChunkVertex* vertices, int quads, ChunkVertexBuffer& out);
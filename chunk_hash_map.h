@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash map keyed by packed chunk coordinates
+// (packChunkCoord). Keys and values sit inline in one power-of-two slot
+// array probed linearly, so a lookup is a multiply, a shift and usually a
+// single cache line, and entries cost no allocation of their own. Erasing
+// shifts the rest of the probe run back instead of leaving tombstones, so
+// lookups don't slow down as chunks stream in and out. At most 3/4 full.
+template <typename T>
+struct ChunkHashMap {
+    // Packed coordinates use 63 bits, so an all-ones key marks an empty slot
+    static const uint64_t EMPTY_KEY = ~0ull;
+
+    T* find(uint64_t key)
+    {
+        return const_cast<T*>(static_cast<const ChunkHashMap*>(this)->find(key));
+    }
+    const T* find(uint64_t key) const
+    {
+        if (slots.empty())
+            return nullptr;
+        for (size_t i = slotOf(key); ; i = (i + 1) & mask()) {
+            if (slots[i].key == key)
+                return &slots[i].value;
+            if (slots[i].key == EMPTY_KEY)
+                return nullptr;
+        }
+    }
+    bool contains(uint64_t key) const { return find(key) != nullptr; }
+
+    // Value for 'key', inserted default-constructed when missing
+    T& operator[](uint64_t key)
+    {
+        if ((count + 1) * 4 > slots.size() * 3)
+            grow();
+        size_t i = slotOf(key);
+        while (slots[i].key != key && slots[i].key != EMPTY_KEY)
+            i = (i + 1) & mask();
+        if (slots[i].key == EMPTY_KEY) {
+            slots[i].key = key;
+            count++;
+        }
+        return slots[i].value;
+    }
+    // Add 'value' under 'key' unless the key is present. Returns true if added.
+    bool insert(uint64_t key, T value)
+    {
+        if (contains(key))
+            return false;
+        (*this)[key] = std::move(value);
+        return true;
+    }
+    // Returns false if 'key' wasn't present
+    bool erase(uint64_t key)
+    {
+        if (slots.empty())
+            return false;
+        size_t hole = slotOf(key);
+        while (slots[hole].key != key) {
+            if (slots[hole].key == EMPTY_KEY)
+                return false;
+            hole = (hole + 1) & mask();
+        }
+
+        // Pull later entries of the run back into the hole when their home
+        // slot is at or before it, so every entry stays reachable from home
+        for (size_t i = (hole + 1) & mask(); slots[i].key != EMPTY_KEY; i = (i + 1) & mask()) {
+            size_t home = slotOf(slots[i].key);
+            if (((i - home) & mask()) >= ((i - hole) & mask())) {
+                slots[hole] = std::move(slots[i]);
+                hole = i;
+            }
+        }
+        slots[hole].key = EMPTY_KEY;
+        slots[hole].value = T();
+        count--;
+        return true;
+    }
+
+    void clear()
+    {
+        slots.clear();
+        count = 0;
+        shift = 64;
+    }
+    size_t size() const { return count; }
+
+private:
+    struct Slot {
+        uint64_t key = EMPTY_KEY;
+        T value = T();
+    };
+
+    static const size_t MIN_SLOTS = 64;
+
+    size_t mask() const { return slots.size() - 1; }
+    // Fibonacci hashing: the top bits of key * 2^64 / phi. Neighbouring
+    // coordinates land far apart, so runs stay short.
+    size_t slotOf(uint64_t key) const { return (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift); }
+
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots);
+        size_t size = old.empty() ? MIN_SLOTS : old.size() * 2;
+        slots.resize(size);
+        shift = 64;
+        for (size_t s = size; s > 1; s >>= 1)
+            shift--;
+        for (Slot& slot : old) {
+            if (slot.key == EMPTY_KEY)
+                continue;
+            size_t i = slotOf(slot.key);
+            while (slots[i].key != EMPTY_KEY)
+                i = (i + 1) & mask();
+            slots[i] = std::move(slot);
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+    int shift = 64;
+};
@@ -0,0 +1,360 @@
+#include "chunk_mesh.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Two triangles per face quad, indexing its four corners
+static const int quadOrder[6] = { 0, 1, 2, 2, 3, 0 };
+
+static bool useFaceRecords = false;
+
+// Split quads [begin, end) of 'face' into meshlets, bounded by their
+// vertices, or by the whole chunk without them
+static void appendMeshlets(std::vector<ChunkMesh::Meshlet>& out, int begin, int end, int face, const ChunkVertex* vertices)
+{
+    for (int first = begin; first < end; first += CHUNK_MESHLET_QUADS) {
+        int quads = std::min(end - first, CHUNK_MESHLET_QUADS);
+        glm::ivec3 lo(0), hi(CHUNK_SIZE);
+        if (vertices) {
+            lo = glm::ivec3(CHUNK_SIZE);
+            hi = glm::ivec3(0);
+            for (int v = first * 4; v < (first + quads) * 4; v++) {
+                glm::ivec3 p(vertices[v] & 31, (vertices[v] >> 5) & 31, (vertices[v] >> 10) & 31);
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+            }
+        }
+        uint32_t bounds = (uint32_t)(lo.x | lo.y << 5 | lo.z << 10 | hi.x << 15 | hi.y << 20 | hi.z << 25);
+        out.push_back({ (uint16_t)first, (uint8_t)quads, (uint8_t)face, bounds });
+    }
+}
+
+void ChunkMesh::build(const ChunkVoxels& voxels, MeshMode mode)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    ChunkVertexBuffer vertices;
+    int quads = meshChunk(voxels, mode, vertices);
+
+    buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    upload(vertices, quads);
+}
+
+void ChunkMesh::upload(const ChunkVertexBuffer& vertices, int quads)
+{
+    quadCount = quads;
+    vertexCount = (int)vertices.size();
+    if (vertexCount == 0) {
+        destroy();
+        return;
+    }
+
+    // Face ranges, if the quads are in face order
+    grouped = true;
+    int face = 0;
+    for (int q = 0; q < quads && grouped; q++) {
+        int quadFace = (vertices[q * 4] >> 15) & 7;
+        grouped = quadFace >= face;
+        for (; face < quadFace; face++)
+            faceEnd[face] = q;
+    }
+    for (; face < 6; face++)
+        faceEnd[face] = quads;
+
+    meshlets.clear();
+    if (grouped) {
+        for (face = 0; face < 6; face++)
+            appendMeshlets(meshlets, face > 0 ? faceEnd[face - 1] : 0, faceEnd[face], face, vertices.data());
+    }
+    else {
+        appendMeshlets(meshlets, 0, quads, 6, vertices.data());
+    }
+
+    if (useFaceRecords) {
+        ChunkVertexBuffer records;
+        records.reserve(quads * FACE_RECORD_WORDS);
+        packFaceRecords(vertices.data(), quads, records);
+        vertexCount = (int)records.size();
+        allocation = chunkMeshHeap().upload(allocation, records.data(), (uint32_t)records.size());
+        return;
+    }
+    allocation = chunkMeshHeap().upload(allocation, vertices.data(), (uint32_t)vertices.size());
+}
+
+void ChunkMesh::copyFaces(unsigned int source, const size_t faceOffsets[6], const int faceQuads[6])
+{
+    quadCount = 0;
+    for (int face = 0; face < 6; face++) {
+        quadCount += faceQuads[face];
+        faceEnd[face] = quadCount;
+    }
+    vertexCount = quadCount * 4;
+    if (vertexCount == 0) {
+        destroy();
+        return;
+    }
+    grouped = true;
+
+    // The vertices never reach the CPU, so the meshlets get the chunk's bounds
+    meshlets.clear();
+    for (int face = 0; face < 6; face++)
+        appendMeshlets(meshlets, faceEnd[face] - faceQuads[face], faceEnd[face], face, nullptr);
+
+    GpuHeap& heap = chunkMeshHeap();
+    allocation = heap.reserve(allocation, (uint32_t)vertexCount);
+    for (int face = 0; face < 6; face++) {
+        uint32_t first = (uint32_t)(faceEnd[face] - faceQuads[face]) * 4;
+        heap.copyFrom(allocation, first, source, faceOffsets[face], (uint32_t)faceQuads[face] * 4);
+    }
+}
+
+void ChunkMesh::share(const ChunkMesh& other)
+{
+    if (&other == this)
+        return;
+    destroy();
+    *this = other;
+    chunkMeshHeap().retain(allocation);
+}
+
+int ChunkMesh::draw(int faceMask) const
+{
+    if (vertexCount == 0) return 0;
+    ChunkMeshRanges ranges;
+    facingRanges(faceMask, ranges);
+    int quads = 0;
+    for (int r = 0; r < ranges.count; r++) {
+        // Four vertex IDs per quad in either format
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, ranges.quads[r] * 6, GL_UNSIGNED_SHORT, (void*)0,
+            chunkViewCount(), (GLint)(baseVertex() + ranges.first[r] * 4));
+        quads += ranges.quads[r];
+    }
+    return quads;
+}
+
+int ChunkMesh::record(CommandList& list, int faceMask) const
+{
+    if (vertexCount == 0) return 0;
+    ChunkMeshRanges ranges;
+    facingRanges(faceMask, ranges);
+    int quads = 0;
+    for (int r = 0; r < ranges.count; r++) {
+        list.drawIndexed(ranges.quads[r] * 6, baseVertex() + ranges.first[r] * 4, chunkViewCount());
+        quads += ranges.quads[r];
+    }
+    return quads;
+}
+
+void ChunkMesh::facingRanges(int faceMask, ChunkMeshRanges& out) const
+{
+    out.count = 0;
+    if (quadCount == 0)
+        return;
+    if (!grouped) {
+        out.first[0] = 0;
+        out.quads[0] = quadCount;
+        out.count = 1;
+        return;
+    }
+    int start = -1;
+    int begin = 0;
+    for (int face = 0; face < 6; face++) {
+        if ((faceMask >> face & 1) || faceEnd[face] == begin) {
+            if (start < 0)
+                start = begin;
+        }
+        else if (start >= 0) {
+            if (begin > start) {
+                out.first[out.count] = start;
+                out.quads[out.count++] = begin - start;
+            }
+            start = -1;
+        }
+        begin = faceEnd[face];
+    }
+    if (start >= 0 && quadCount > start) {
+        out.first[out.count] = start;
+        out.quads[out.count++] = quadCount - start;
+    }
+}
+
+int ChunkMesh::page() const
+{
+    return allocation >= 0 ? chunkMeshHeap().page(allocation) : -1;
+}
+
+int ChunkMesh::baseVertex() const
+{
+    // Four vertex IDs per record: the heap's granularity keeps ranges
+    // starting on a whole record
+    uint32_t first = chunkMeshHeap().first(allocation);
+    return (int)(useFaceRecords ? first / FACE_RECORD_WORDS * 4 : first);
+}
+
+void ChunkMesh::destroy()
+{
+    chunkMeshHeap().release(allocation);
+    allocation = -1;
+    vertexCount = 0;
+    quadCount = 0;
+    grouped = false;
+    meshlets.clear();
+}
+
+// Vertices per heap page (4 bytes each, so 32 MB pages)
+const uint32_t CHUNK_HEAP_PAGE_VERTICES = 8 * 1024 * 1024;
+// Staged per frame: the chunk and LOD upload budgets with room for the mesh
+// overshooting them and for in-place rebuilds after edits
+const size_t CHUNK_MESH_STAGING_BYTES = 4 * 1024 * 1024;
+
+static GpuHeap meshHeap;
+static StreamBuffer meshStaging;
+static unsigned int quadEBO = 0;
+static bool usePerDrawOffsets = false;
+static bool useVertexPulling = false;
+static int offsetDivisor = 1;   // Views per chunk draw at most
+static int viewCount = 1;
+
+// Vertex pulling needs GLSL 4.30 for storage blocks with a binding
+static const char* ATTRIBUTE_INPUT_SOURCE = R"(#version 330 core
+    layout (location = 0) in uint aVertex;
+    uint chunkVertex() { return aVertex; }
+)";
+static const char* PULLING_INPUT_SOURCE = R"(#version 430 core
+    layout (std430, binding = 4) readonly buffer ChunkVertices { uint chunkVertices[]; };
+    uint chunkVertex() { return chunkVertices[gl_VertexID]; }  // Includes the draw's base vertex
+)";
+// Corner i of FACE_CORNERS[face] in bits 3i (x), 3i + 1 (y) and 3i + 2 (z)
+// of FACE_CORNER_BITS[face]; emission order and layout as packFaceRecords()
+static const char* FACE_RECORD_INPUT_SOURCE = R"(#version 430 core
+    layout (std430, binding = 4) readonly buffer ChunkFaces { uvec2 chunkFaces[]; };
+    const uint FACE_CORNER_BITS[6] = uint[6](0x5A0u, 0xECDu, 0x948u, 0x4FEu, 0x681u, 0xDECu);
+    uint chunkVertex()
+    {
+        uvec2 record = chunkFaces[gl_VertexID >> 2];
+        uint face = (record.x >> 12) & 7u;
+        uvec3 size = uvec3(1u);
+        uvec4 ao;
+        uvec4 light;
+        if ((record.x & (1u << 19)) != 0u) {
+            uint d = face >> 1;
+            size[(d + 1u) % 3u] = ((record.x >> 20) & 15u) + 1u;
+            size[(d + 2u) % 3u] = ((record.x >> 24) & 15u) + 1u;
+            ao = uvec4((record.y >> 8) & 3u);
+            light = uvec4(record.y & 255u);
+        }
+        else {
+            ao = (uvec4(record.x >> 20) >> uvec4(0u, 2u, 4u, 6u)) & 3u;
+            light = (uvec4(record.y) >> uvec4(0u, 8u, 16u, 24u)) & 255u;
+        }
+        uint first = ao.x + ao.z > ao.y + ao.w ? 1u : 0u;
+        uint i = (first + uint(gl_VertexID)) & 3u;
+        uvec3 corner = (uvec3(FACE_CORNER_BITS[face] >> (3u * i)) >> uvec3(0u, 1u, 2u)) & 1u;
+        uvec3 pos = ((uvec3(record.x) >> uvec3(0u, 4u, 8u)) & 15u) + corner * size;
+        return pos.x | (pos.y << 5) | (pos.z << 10) | (face << 15) | (ao[i] << 18) |
+            (((record.x >> 15) & 15u) << 20) | (light[i] << 24);
+    }
+)";
+static_assert(CHUNK_VERTEX_STORAGE_BINDING == 4, "the pulling sources name the binding");
+static_assert(FACE_RECORD_WORDS == 2, "FACE_RECORD_INPUT_SOURCE reads records as uvec2");
+
+GpuHeap& chunkMeshHeap()
+{
+    return meshHeap;
+}
+
+unsigned int chunkQuadIndexBuffer()
+{
+    return quadEBO;
+}
+
+StreamBuffer& chunkMeshStaging()
+{
+    return meshStaging;
+}
+
+void bindChunkDrawOffsets(unsigned int buffer, size_t offset, int components)
+{
+    glState().bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(1, components, GL_FLOAT, GL_FALSE, components * sizeof(float), (void*)offset);
+}
+
+// Called with a new heap page's VAO and vertex buffer bound, or once for
+// the shared VAO when pulling
+static void setupChunkVertexAttributes()
+{
+    // Packed position/face/AO/material attribute
+    if (!useVertexPulling) {
+        glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(ChunkVertex), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
+
+    // Chunk origin: per draw (selected by base instance, source bound at draw
+    // time) or a constant attribute
+    if (usePerDrawOffsets) {
+        glVertexAttribDivisor(1, offsetDivisor);
+        glEnableVertexAttribArray(1);
+    }
+
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+}
+
+void initChunkMeshes(bool perDrawOffsets, bool vertexPulling, bool faceRecords, int maxViews)
+{
+    usePerDrawOffsets = perDrawOffsets;
+    offsetDivisor = std::max(maxViews, 1);
+    useVertexPulling = vertexPulling;
+    useFaceRecords = vertexPulling && faceRecords;
+
+    // Shared index pattern for every quad of every mesh
+    std::vector<unsigned short> indices(MAX_CHUNK_QUADS * 6);
+    for (int q = 0; q < MAX_CHUNK_QUADS; q++)
+        for (int i = 0; i < 6; i++)
+            indices[q * 6 + i] = (unsigned short)(q * 4 + quadOrder[i]);
+
+    glGenBuffers(1, &quadEBO);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    meshHeap.init(sizeof(ChunkVertex), CHUNK_HEAP_PAGE_VERTICES, setupChunkVertexAttributes,
+        vertexPulling ? (int)CHUNK_VERTEX_STORAGE_BINDING : -1);
+    meshStaging.init(CHUNK_MESH_STAGING_BYTES);
+    meshHeap.staging = &meshStaging;
+}
+
+void setChunkViewCount(int views)
+{
+    viewCount = std::min(std::max(views, 1), offsetDivisor);
+}
+
+int chunkViewCount()
+{
+    return viewCount;
+}
+
+bool chunkMeshesUseFaceRecords()
+{
+    return useFaceRecords;
+}
+
+const char* chunkVertexInputSource(bool vertexPulling, bool faceRecords)
+{
+    if (!vertexPulling)
+        return ATTRIBUTE_INPUT_SOURCE;
+    return faceRecords ? FACE_RECORD_INPUT_SOURCE : PULLING_INPUT_SOURCE;
+}
+
+void shutdownChunkMeshes()
+{
+    meshHeap.staging = nullptr;
+    meshStaging.destroy();
+    meshHeap.destroy();
+    glState().deleteBuffers(1, &quadEBO);
+    quadEBO = 0;
+}
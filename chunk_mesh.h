@@ -0,0 +1,140 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_geometry.h"
+#include "gpu_heap.h"
+#include "stream_buffer.h"
+
+#include <cstdint>
+#include <vector>
+
+// Face masks have bit 'face' per direction (-X, +X, -Y, +Y, -Z, +Z)
+const int ALL_CHUNK_FACES = 63;
+
+// Face directions of a box, given relative to the eye, that can face the
+// eye: bit 'face' unless every face of that direction in the box points
+// away (-X when the eye is past the box's high x, and so on)
+inline int chunkFacingMask(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    int mask = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (boxMax[axis] > 0.0f)
+            mask |= 1 << (axis * 2);
+        if (boxMin[axis] < 0.0f)
+            mask |= 2 << (axis * 2);
+    }
+    return mask;
+}
+
+// Quad ranges of a mesh to draw: adjacent directions (and empty ones between
+// them) are merged, which leaves at most three out of six
+struct ChunkMeshRanges {
+    int count;
+    int first[3];
+    int quads[3];
+};
+
+// Quads per meshlet: the unit GpuCuller tests on its own, finer than a chunk
+const int CHUNK_MESHLET_QUADS = 64;
+
+// GPU geometry for one chunk: the visible faces of its opaque (or, for the
+// second mesh of a chunk, translucent) blocks,
+// built once and rebuilt only when the chunk's voxels change. Each quad is
+// four vertices in a range of the shared chunkMeshHeap(), drawn through the
+// shared quad index buffer. With face records (see initChunkMeshes()) each
+// quad is one record instead, expanded by the vertex shader.
+//
+// Opaque meshes come grouped by face (see meshChunk()), so the directions
+// facing away from the camera can be left out of a draw: for a chunk off to
+// one side of the camera on every axis that is half its quads.
+struct ChunkMesh {
+    int allocation = -1;        // chunkMeshHeap() handle
+    int vertexCount = 0;        // Heap elements: vertices, or face record words
+    int quadCount = 0;
+    bool grouped = false;       // Quads in face order; not translucent meshes
+    int faceEnd[6] = {};        // When grouped: end of each face's quads
+
+    // Runs of up to CHUNK_MESHLET_QUADS quads of one face direction (of
+    // the whole mesh unless grouped), in quad order, with chunk-local
+    // bounds: min x, y, z then max x, y, z, 5 bits each
+    struct Meshlet {
+        uint16_t first;
+        uint8_t quads;
+        uint8_t face;           // 6 when not grouped: any direction
+        uint32_t bounds;
+    };
+    std::vector<Meshlet> meshlets;
+    double buildTimeMs = 0.0; // CPU time of the last build (meshing only)
+
+    // Extract visible faces from a chunk snapshot and upload them (chunk-local positions)
+    void build(const ChunkVoxels& voxels, MeshMode mode);
+    // Replace the GPU vertices with an already built mesh (four vertices a
+    // quad, converted to face records if those are in use)
+    void upload(const ChunkVertexBuffer& vertices, int quads);
+    // Replace the GPU vertices with quads already in video memory, grouped
+    // by face: faceQuads[face] of them at byte faceOffsets[face] of the GL
+    // buffer 'source', copied into the heap on the GPU (vertices only, not
+    // face records; see GpuMesher)
+    void copyFaces(unsigned int source, const size_t faceOffsets[6], const int faceQuads[6]);
+    // Draw the same vertices as 'other' (an identical chunk elsewhere:
+    // positions are chunk-local), sharing its heap range. Rebuilding either
+    // mesh gives it a range of its own.
+    void share(const ChunkMesh& other);
+    // Draw the directions in 'faceMask' (bit per face, see chunkFacingMask()),
+    // one call per range of them. Its heap page must be bound and, without
+    // per-draw offsets, attribute 1 set to the chunk origin. Returns the quads
+    // drawn.
+    int draw(int faceMask = ALL_CHUNK_FACES) const;
+    // Same, recorded into 'list' for a later submit
+    int record(CommandList& list, int faceMask = ALL_CHUNK_FACES) const;
+    // Quad ranges covering the directions in 'faceMask' (the whole mesh
+    // unless grouped), written to 'out'
+    void facingRanges(int faceMask, ChunkMeshRanges& out) const;
+    // Heap page holding the vertices (-1 while empty)
+    int page() const;
+    // Base vertex of the mesh's draws, indirect ones included
+    int baseVertex() const;
+    // Return the vertex range to the heap (once no other mesh shares it)
+    void destroy();
+};
+
+// Shader storage binding of the heap page being drawn, with vertex pulling
+const unsigned int CHUNK_VERTEX_STORAGE_BINDING = 4;
+
+// Shared vertex heap for every chunk mesh
+GpuHeap& chunkMeshHeap();
+// Shared 16-bit index buffer of MAX_CHUNK_QUADS quads, (0, 1, 2, 2, 3, 0) + 4k:
+// bound by every heap page's VAO, and by anything else drawn as quads of
+// four consecutive vertices
+unsigned int chunkQuadIndexBuffer();
+// Staging ring its uploads are copied from (see GpuHeap::staging); the
+// render loop calls beginFrame() and endFrame() on it around each frame
+StreamBuffer& chunkMeshStaging();
+// Point attribute 1 of the bound heap page at per-draw chunk origins (3 floats
+// each, selected by base instance) starting at 'offset' in 'buffer'. Chunks
+// pass 4 components, the fourth how far they have faded in; LOD tiles too,
+// the fourth scaling the vertex positions.
+void bindChunkDrawOffsets(unsigned int buffer, size_t offset, int components = 3);
+// Create / release the heap, its staging ring and the quad index buffer. With 'perDrawOffsets'
+// attribute 1 is a per-instance array for multi-draw indirect (see
+// bindChunkDrawOffsets); otherwise it is a constant attribute set per draw.
+// With 'vertexPulling' (GL 4.3) there is no vertex attribute: chunk vertex
+// shaders read the bound page at CHUNK_VERTEX_STORAGE_BINDING, see
+// chunkVertexInputSource(). 'faceRecords' (vertex pulling only) stores
+// meshes as packFaceRecords() records, half the size. With 'maxViews' 2,
+// per-draw offsets advance every second instance, so each chunk draw can
+// be instanced once per view (see setChunkViewCount()).
+void initChunkMeshes(bool perDrawOffsets, bool vertexPulling, bool faceRecords, int maxViews = 1);
+// Instances of every chunk draw from now on, one per view, up to the
+// 'maxViews' given to initChunkMeshes(); 1 outside multi-view passes
+void setChunkViewCount(int views);
+int chunkViewCount();
+// True when meshes are stored as face records (as set up by initChunkMeshes())
+bool chunkMeshesUseFaceRecords();
+void shutdownChunkMeshes();
+// Start of a vertex shader drawing chunk meshes: the #version line and
+// 'uint chunkVertex()', the packed vertex (see packChunkVertex()) read from
+// attribute 0 or, with 'vertexPulling' as given to initChunkMeshes(), from
+// the page by gl_VertexID; with 'faceRecords' it is rebuilt from the quad's
+// record. Attribute 1 (the chunk origin) is left to the shader.
+const char* chunkVertexInputSource(bool vertexPulling, bool faceRecords);
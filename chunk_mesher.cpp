@@ -0,0 +1,132 @@
+#include "chunk_mesher.h"
+#include "memory_tracking.h"
+#include "mesh_cache.h"
+#include "profiler.h"
+
+#include <chrono>
+
+void ChunkMesher::start(JobSystem& jobs)
+{
+    jobSystem = &jobs;
+}
+
+void ChunkMesher::stop()
+{
+    if (!jobSystem)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.clear();
+    }
+    jobSystem->wait(activeJobs);
+    jobSystem = nullptr;
+
+    results.drain(finished);
+    for (MeshResult* result : finished)
+        delete result;
+    finished.clear();
+    sortResults.drain(sorted);
+    for (SortResult* result : sorted)
+        delete result;
+    sorted.clear();
+    held = 0;
+}
+
+static size_t resultBytes(const MeshResult& result)
+{
+    return sizeof(MeshResult) + (result.vertices.capacity() + result.translucentVertices.capacity()) * sizeof(ChunkVertex);
+}
+
+void ChunkMesher::submit(const glm::ivec3& coord, uint32_t version, MeshMode mode, std::unique_ptr<ChunkVoxels> snapshot,
+    const glm::ivec3& sortCell)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.push_back({ coord, version, mode, sortCell, std::move(snapshot) });
+    }
+    held.fetch_add(sizeof(ChunkVoxels), std::memory_order_relaxed);
+    jobSystem->schedule([this] { meshNext(); }, &activeJobs);
+}
+
+bool ChunkMesher::poll(MeshResult& out)
+{
+    if (finished.empty())
+        results.drain(finished);
+    if (finished.empty())
+        return false;
+
+    MeshResult* result = finished.front();
+    finished.pop_front();
+    held.fetch_sub(resultBytes(*result), std::memory_order_relaxed);
+    out = std::move(*result);
+    delete result;
+    return true;
+}
+
+void ChunkMesher::sort(const glm::ivec3& coord, uint32_t version, const glm::ivec3& cell,
+    std::shared_ptr<const ChunkVertexBuffer> quads)
+{
+    // Small and short-lived, so not counted in heldBytes()
+    jobSystem->schedule([this, coord, version, cell, quads] {
+        PROFILE_ZONE("Sort translucent");
+        SortResult* result = new SortResult{ coord, version, cell, *quads };
+        sortTranslucentQuads(result->vertices, cell);
+        sortResults.push(result);
+    }, &activeJobs);
+}
+
+bool ChunkMesher::pollSorted(SortResult& out)
+{
+    if (sorted.empty())
+        sortResults.drain(sorted);
+    if (sorted.empty())
+        return false;
+
+    SortResult* result = sorted.front();
+    sorted.pop_front();
+    out = std::move(*result);
+    delete result;
+    return true;
+}
+
+void ChunkMesher::meshNext()
+{
+    PROFILE_ZONE("Mesh chunk");
+    MemoryTagScope memoryTag(MEMORY_MESHES);
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        if (jobs.empty())
+            return; // Dropped by stop()
+
+        job = std::move(jobs.front());
+        jobs.pop_front();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    MeshResult* result = new MeshResult();
+    result->coord = job.coord;
+    result->version = job.version;
+    CachedMesh cached;
+    if (cache && cache->mode == job.mode && cache->find(job.coord, meshSnapshotHash(*job.snapshot), cached)) {
+        result->vertices.assign(cached.vertices, cached.vertices + cached.quadCount * 4);
+        result->quadCount = cached.quadCount;
+        result->translucentVertices.assign(cached.translucentVertices, cached.translucentVertices + cached.translucentQuads * 4);
+        result->translucentQuads = cached.translucentQuads;
+        result->faceVisibility = cached.faceVisibility;
+    }
+    else {
+        result->quadCount = meshChunk(*job.snapshot, job.mode, result->vertices);
+        result->translucentQuads = meshChunkTranslucent(*job.snapshot, result->translucentVertices);
+        result->faceVisibility = computeFaceVisibility(*job.snapshot);
+    }
+    sortTranslucentQuads(result->translucentVertices, job.sortCell);
+    result->sortCell = job.sortCell;
+    result->buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // The snapshot is freed with the job; the mesh is held until polled
+    held.fetch_add(resultBytes(*result) - sizeof(ChunkVoxels), std::memory_order_relaxed);
+    results.push(result);
+}
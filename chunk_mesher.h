@@ -0,0 +1,98 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_geometry.h"
+#include "chunk_visibility.h"
+#include "job_system.h"
+#include "mpsc_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct MeshCache;
+
+// CPU-side mesh built by a worker, waiting for upload on the GL thread
+struct MeshResult {
+    glm::ivec3 coord;
+    uint32_t version;       // Version passed to submit()
+    ChunkVertexBuffer vertices;
+    int quadCount;
+    ChunkVertexBuffer translucentVertices;  // Sorted for sortCell
+    int translucentQuads;
+    glm::ivec3 sortCell;
+    FaceVisibility faceVisibility;  // Face-to-face connectivity of the snapshot
+    double buildTimeMs;
+};
+
+// Translucent quads of a mesh re-sorted for a new camera cell
+struct SortResult {
+    glm::ivec3 coord;
+    uint32_t version;       // Mesh version passed to sort()
+    glm::ivec3 cell;
+    ChunkVertexBuffer vertices;
+};
+
+// Meshes chunk snapshots on job system workers. Jobs only ever see their
+// own snapshot, so edits to the live chunk can't race them.
+struct ChunkMesher {
+    // Run meshing jobs on 'jobs'
+    void start(JobSystem& jobs);
+    // Drop queued snapshots and unclaimed results after running jobs finish
+    void stop();
+
+    // Queue a snapshot for meshing (main thread). Its translucent quads are
+    // sorted for the camera in chunk-local block 'sortCell'.
+    void submit(const glm::ivec3& coord, uint32_t version, MeshMode mode, std::unique_ptr<ChunkVoxels> snapshot,
+        const glm::ivec3& sortCell);
+    // Take the oldest finished mesh (main thread). Returns false when none is ready.
+    bool poll(MeshResult& out);
+
+    // Re-sort a copy of uploaded translucent quads for 'cell' on a worker
+    // (see sortTranslucentQuads); the shared list is only read
+    void sort(const glm::ivec3& coord, uint32_t version, const glm::ivec3& cell,
+        std::shared_ptr<const ChunkVertexBuffer> quads);
+    // Take the oldest finished sort. Returns false when none is ready.
+    bool pollSorted(SortResult& out);
+
+    // Memory held in queued snapshots and meshes not yet polled
+    size_t heldBytes() const { return held.load(std::memory_order_relaxed); }
+    // True while heldBytes() plus the caller's own 'extraBytes' of polled but
+    // unuploaded meshes is at least budgetBytes: callers hold back new
+    // submissions until uploads catch up
+    bool overBudget(size_t extraBytes = 0) const { return budgetBytes != 0 && heldBytes() + extraBytes >= budgetBytes; }
+
+    // Most CPU memory for snapshots and meshes in flight; 0 = no limit
+    size_t budgetBytes = 0;
+    // Meshes saved by the world baker (not owned), copied instead of meshing
+    // snapshots they were built from
+    MeshCache* cache = nullptr;
+
+    ~ChunkMesher() { stop(); }
+
+private:
+    struct Job {
+        glm::ivec3 coord;
+        uint32_t version;
+        MeshMode mode;
+        glm::ivec3 sortCell;
+        std::unique_ptr<ChunkVoxels> snapshot;
+    };
+
+    // Job body: mesh the oldest queued snapshot
+    void meshNext();
+
+    JobSystem* jobSystem = nullptr;
+    JobCounter activeJobs;
+    std::mutex jobMutex;                // Guards jobs
+    std::deque<Job> jobs;
+
+    MPSCQueue<MeshResult*> results;     // Pushed by workers, drained by the main thread
+    std::deque<MeshResult*> finished;   // Main-thread side, in completion order
+    MPSCQueue<SortResult*> sortResults; // Same for sorts
+    std::deque<SortResult*> sorted;
+    std::atomic<size_t> held{ 0 };
+};
@@ -0,0 +1,242 @@
+#include "chunk_overlay.h"
+#include "chunk_renderer.h"
+#include "frame_arena.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+const char* CHUNK_OVERLAY_MODE_NAMES[CHUNK_OVERLAY_MODE_COUNT] = { "off", "build time", "vertices", "culling" };
+
+static const char* overlayVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;          // Box corner, chunk-local
+layout (location = 1) in vec3 iChunkOrigin;  // Per instance, relative to the camera
+layout (location = 2) in vec4 iColor;
+
+out vec4 color;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+};
+
+void main()
+{
+    gl_Position = viewProj * vec4(iChunkOrigin + aPos, 1.0);
+    color = iColor;
+}
+)";
+
+static const char* overlayFragmentShaderSource = R"(
+#version 330 core
+in vec4 color;
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = color;
+}
+)";
+
+// Opacity of a tint; back faces are culled, so each box adds one layer
+static const float TINT_ALPHA = 0.3f;
+
+// Upper limits of the first three categories of the build time and vertex
+// modes; the fourth takes the rest
+static const double BUILD_MS_LIMITS[3] = { 0.5, 2.0, 8.0 };
+static const double VERTEX_LIMITS[3] = { 2048, 8192, 32768 };
+
+static const glm::vec3 COOL(0.2f, 0.8f, 0.3f);
+static const glm::vec3 WARM(0.95f, 0.85f, 0.2f);
+static const glm::vec3 HOT(1.0f, 0.5f, 0.1f);
+static const glm::vec3 HOTTEST(1.0f, 0.15f, 0.15f);
+
+void ChunkOverlay::init(unsigned int cameraBinding)
+{
+    program.create(overlayVertexShaderSource, overlayFragmentShaderSource);
+    program.bindBlock("Camera", cameraBinding);
+
+    // Inset a little so neighbouring boxes don't fight over the same plane
+    const float INSET = 0.05f;
+    const float lo = INSET, hi = CHUNK_SIZE - INSET;
+    const float corners[8 * 3] = {
+        lo, lo, lo,  hi, lo, lo,  lo, hi, lo,  hi, hi, lo,
+        lo, lo, hi,  hi, lo, hi,  lo, hi, hi,  hi, hi, hi
+    };
+    // Two counter-clockwise triangles per face, seen from outside
+    const unsigned char indices[36] = {
+        0, 4, 6,  0, 6, 2,  // -X
+        1, 3, 7,  1, 7, 5,  // +X
+        0, 1, 5,  0, 5, 4,  // -Y
+        2, 6, 7,  2, 7, 3,  // +Y
+        0, 2, 3,  0, 3, 1,  // -Z
+        4, 5, 7,  4, 7, 6   // +Z
+    };
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    // Origin and colour per instance, sourced from the stream buffer at draw time
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+    glState().bindVertexArray(0);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ChunkOverlay::destroy()
+{
+    if (VAO == 0)
+        return;
+    glState().deleteVertexArrays(1, &VAO);
+    glState().deleteBuffers(1, &VBO);
+    glState().deleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+    program.destroy();
+}
+
+// Index of the first limit 'value' is below, or 3 above them all
+static int bucket(double value, const double limits[3])
+{
+    int i = 0;
+    while (i < 3 && value >= limits[i])
+        i++;
+    return i;
+}
+
+void ChunkOverlay::update(ChunkOverlayMode overlayMode, const ChunkRenderer& chunkRenderer, const Frustum& frustum,
+    const int* visible, int visibleCount)
+{
+    mode = overlayMode;
+    renderer = &chunkRenderer;
+    chunkCategory = nullptr;
+    categoryCount = 0;
+    if (mode == CHUNK_OVERLAY_OFF)
+        return;
+
+    if (mode == CHUNK_OVERLAY_BUILD_TIME) {
+        categories[0] = { "< 0.5 ms", COOL, 0, 0.0 };
+        categories[1] = { "0.5 - 2 ms", WARM, 0, 0.0 };
+        categories[2] = { "2 - 8 ms", HOT, 0, 0.0 };
+        categories[3] = { ">= 8 ms", HOTTEST, 0, 0.0 };
+        categoryCount = 4;
+        unit = "ms";
+    }
+    else if (mode == CHUNK_OVERLAY_VERTICES) {
+        categories[0] = { "< 2k", COOL, 0, 0.0 };
+        categories[1] = { "2k - 8k", WARM, 0, 0.0 };
+        categories[2] = { "8k - 32k", HOT, 0, 0.0 };
+        categories[3] = { ">= 32k", HOTTEST, 0, 0.0 };
+        categoryCount = 4;
+        unit = "vertices";
+    }
+    else {
+        categories[0] = { "Frustum-culled", glm::vec3(0.3f, 0.4f, 1.0f), 0, 0.0 };
+        categories[1] = { "Occlusion-culled", HOTTEST, 0, 0.0 };
+        categories[2] = { visible ? "Drawn" : "In view (GPU-tested)", COOL, 0, 0.0 };
+        categoryCount = 3;
+        unit = "quads";
+    }
+
+    // Chunks listed as visible, for the cull outcome
+    const std::vector<ChunkRenderData>& chunks = chunkRenderer.chunks;
+    bool* drawn = nullptr;
+    if (mode == CHUNK_OVERLAY_CULLING && visible) {
+        drawn = frameArena().allocArray<bool>(chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++)
+            drawn[i] = false;
+        for (int v = 0; v < visibleCount; v++)
+            drawn[visible[v]] = true;
+    }
+
+    chunkCategory = frameArena().allocArray<int>(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        const ChunkRenderData& data = chunks[i];
+        int quads = data.mesh.quadCount + data.translucent.quadCount;
+        chunkCategory[i] = -1;
+        if (quads == 0)
+            continue;   // Nothing to draw, nothing to tint
+
+        int category;
+        double value;
+        if (mode == CHUNK_OVERLAY_BUILD_TIME) {
+            value = data.mesh.buildTimeMs;
+            category = bucket(value, BUILD_MS_LIMITS);
+        }
+        else if (mode == CHUNK_OVERLAY_VERTICES) {
+            value = data.mesh.vertexCount + data.translucent.vertexCount;
+            category = bucket(value, VERTEX_LIMITS);
+        }
+        else {
+            value = quads;
+            glm::vec3 boxMin = data.chunk->origin();
+            if (!frustum.intersectsAABB(boxMin, boxMin + glm::vec3((float)CHUNK_SIZE)))
+                category = 0;
+            else
+                category = !drawn || drawn[i] ? 2 : 1;
+        }
+        chunkCategory[i] = category;
+        categories[category].chunks++;
+        categories[category].total += value;
+    }
+}
+
+int ChunkOverlay::draw(const glm::dvec3& eye, StreamBuffer& stream) const
+{
+    if (!chunkCategory)
+        return 0;
+    const std::vector<ChunkRenderData>& chunks = renderer->chunks;
+    int count = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+        count += chunkCategory[i] >= 0;
+    if (count == 0)
+        return 0;
+
+    size_t offset;
+    Instance* instances = (Instance*)stream.map(count * sizeof(Instance), sizeof(Instance), offset);
+    if (!instances)
+        return 0;
+    int written = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunkCategory[i] < 0)
+            continue;
+        instances[written].origin = glm::vec4(chunks[i].chunk->relativeOrigin(eye), 0.0f);
+        instances[written].color = glm::vec4(categories[chunkCategory[i]].color, TINT_ALPHA);
+        written++;
+    }
+    stream.unmap();
+
+    // Blended over the scene without writing depth; cull outcomes through it
+    program.use();
+    glState().enable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState().depthMask(GL_FALSE);
+    if (mode == CHUNK_OVERLAY_CULLING)
+        glState().disable(GL_DEPTH_TEST);
+    glState().enable(GL_CULL_FACE);
+
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offset);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, color)));
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0, count);
+    glState().bindVertexArray(0);
+
+    glState().disable(GL_CULL_FACE);
+    glState().enable(GL_DEPTH_TEST);
+    glState().depthMask(GL_TRUE);
+    glState().disable(GL_BLEND);
+    return 1;
+}
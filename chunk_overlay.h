@@ -0,0 +1,69 @@
+#pragma once
+
+#include "frustum.h"
+#include "shader.h"
+#include "stream_buffer.h"
+
+#include <glm/glm.hpp>
+
+struct ChunkRenderer;
+
+// What the chunk overlay tints chunks by
+enum ChunkOverlayMode {
+    CHUNK_OVERLAY_OFF,
+    CHUNK_OVERLAY_BUILD_TIME,   // CPU time of the last mesh build
+    CHUNK_OVERLAY_VERTICES,     // Heap elements of the opaque and translucent meshes
+    CHUNK_OVERLAY_CULLING,      // Outcome of this frame's culling
+    CHUNK_OVERLAY_MODE_COUNT
+};
+extern const char* CHUNK_OVERLAY_MODE_NAMES[CHUNK_OVERLAY_MODE_COUNT];
+
+// Debug view that tints every meshed chunk with the colour of the category
+// it falls in for the chosen mode and totals each category, so a chunk that
+// is slow to mesh, heavy or never culled stands out where it is. Chunks are
+// drawn as translucent boxes, instanced like BlockOutline's. Cull outcomes
+// are shown through the terrain, since occluded chunks are hidden by
+// definition; the other modes are depth tested.
+struct ChunkOverlay {
+    static const int MAX_CATEGORIES = 4;
+
+    struct Category {
+        const char* name;
+        glm::vec3 color;
+        int chunks;
+        double total;       // Milliseconds, vertices or quads, per 'unit'
+    };
+
+    // 'cameraBinding' is the uniform buffer binding of the Camera block
+    void init(unsigned int cameraBinding);
+    void destroy();
+
+    // Sort the meshed chunks of 'renderer' into the categories of 'mode'.
+    // For CHUNK_OVERLAY_CULLING, chunks in 'frustum' are drawn if listed in
+    // 'visible' and occlusion-culled otherwise; pass nullptr when the
+    // occlusion test runs on the GPU, and they all count as in view.
+    void update(ChunkOverlayMode mode, const ChunkRenderer& renderer, const Frustum& frustum,
+        const int* visible, int visibleCount);
+    // Tint the chunks sorted by the last update(), relative to 'eye'.
+    // Returns the number of draw calls.
+    int draw(const glm::dvec3& eye, StreamBuffer& stream) const;
+
+    ChunkOverlayMode mode = CHUNK_OVERLAY_OFF;  // As of the last update()
+    Category categories[MAX_CATEGORIES] = {};
+    int categoryCount = 0;  // 0 while off
+    const char* unit = "";  // Of Category::total
+
+private:
+    struct Instance {
+        glm::vec4 origin;   // Chunk corner relative to the eye (xyz)
+        glm::vec4 color;
+    };
+
+    const ChunkRenderer* renderer = nullptr;
+    int* chunkCategory = nullptr;   // Per renderer chunk, -1 = not tinted (frame arena)
+
+    ShaderProgram program;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+};
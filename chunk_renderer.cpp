@@ -0,0 +1,932 @@
+#include "chunk_renderer.h"
+#include "foliage_renderer.h"
+#include "frame_arena.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "mesh_cache.h"
+#include "profiler.h"
+#include "world.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+void ChunkRenderer::addChunk(Chunk* chunk)
+{
+    ChunkRenderData data;
+    data.chunk = chunk;
+    data.meshVersion = 0;
+    data.faceVisibility = FACE_VISIBILITY_ALL;
+    chunk->dirty = true;
+    markNeighboursDirty(chunk->coord, chunk);
+    drawDataVersion++;
+
+    indexOf[packChunkCoord(chunk->coord)] = (int)chunks.size();
+    chunks.push_back(data);
+    bounds.add(chunk->origin(), chunk->origin() + glm::vec3((float)CHUNK_SIZE));
+}
+
+void ChunkRenderer::removeChunk(const glm::ivec3& coord)
+{
+    uint64_t key = packChunkCoord(coord);
+    const int* found = indexOf.find(key);
+    if (!found)
+        return;
+
+    int index = *found;
+    indexOf.erase(key);
+    if (chunks[index].mesh.vertexCount > 0)
+        changedMeshes.push_back(coord);
+    dropMesh(chunks[index]);
+    chunks[index].translucent.destroy();
+    chunks[index].instances.destroy();
+
+    // Swap-remove, keeping the bounds list in the same order
+    int last = (int)chunks.size() - 1;
+    if (index != last) {
+        chunks[index] = chunks[last];
+        indexOf[packChunkCoord(chunks[index].chunk->coord)] = index;
+    }
+    chunks.pop_back();
+    bounds.removeSwap(index);
+
+    markNeighboursDirty(coord, nullptr);
+    drawDataVersion++;
+}
+
+void ChunkRenderer::markNeighboursDirty(const glm::ivec3& coord, const Chunk* added)
+{
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        const int* index = indexOf.find(packChunkCoord(coord + glm::ivec3(n[0], n[1], n[2])));
+        if (!index)
+            continue;
+
+        // Only the neighbour's solid boundary voxels have faces on the shared
+        // plane, and an added chunk that is air there looks like no chunk at all
+        Chunk* neighbour = chunks[*index].chunk;
+        if (!neighbour->faceHasSolid(face ^ 1))
+            continue;
+        if (added && !added->faceHasSolid(face))
+            continue;
+        neighbour->dirty = true;
+    }
+}
+
+// True if a uniform chunk has no visible faces: it is air, or every side
+// is a uniform chunk hiding its faces (opaque, or the same translucent
+// block). Decided without any voxels.
+static bool uniformChunkIsHidden(const World& world, const Chunk& chunk)
+{
+    BlockId block = chunk.uniformBlock();
+    if (block == BLOCK_AIR)
+        return true;
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        const Chunk* neighbour = world.getChunk(chunk.coord + glm::ivec3(n[0], n[1], n[2]));
+        if (!neighbour || !neighbour->isUniform() || faceVisible(block, neighbour->uniformBlock()))
+            return false;
+    }
+    return true;
+}
+
+// Chunk-local block holding 'eye', the cell translucent quads are sorted
+// for. Beyond a chunk's width outside it the order barely changes, so the
+// cells there are clamped to save re-sorts.
+static glm::ivec3 sortCellOf(const Chunk& chunk, const glm::dvec3& eye)
+{
+    glm::ivec3 cell = glm::ivec3(glm::floor(eye - glm::dvec3(chunk.coord) * (double)CHUNK_SIZE));
+    return glm::clamp(cell, glm::ivec3(-CHUNK_SIZE), glm::ivec3(2 * CHUNK_SIZE - 1));
+}
+
+// Voxels of the snapshot that give off block light, the point lights of
+// the chunk: voxel index in the low 12 bits, emission above. Most chunks
+// hold no emitter in their palette and skip the scan.
+static_assert(CHUNK_VOLUME <= 4096 && MAX_LIGHT < 16, "emitters pack index and level into 16 bits");
+static void findEmitters(const Chunk& chunk, const ChunkVoxels& voxels, std::vector<uint16_t>& emitters)
+{
+    emitters.clear();
+    bool any = false;
+    for (BlockId id : chunk.blocks.palette)
+        any = any || blockEmission(id) > 0;
+    if (!any)
+        return;
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        int emission = blockEmission(voxels.blocks[i]);
+        if (emission > 0)
+            emitters.push_back((uint16_t)(emission << 12 | i));
+    }
+}
+
+// Squared chunk distance, for nearest-first stages
+static int chunkDistance2(const glm::ivec3& coord, const glm::ivec3& cameraChunk)
+{
+    glm::ivec3 d = coord - cameraChunk;
+    return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+void ChunkRenderer::updateDirty(const World& world, MeshMode mode, bool instancing, ChunkMesher* mesher,
+    const glm::ivec3& cameraChunk, const glm::dvec3& eye)
+{
+    PROFILE_ZONE("Update dirty chunks");
+    // Shared meshes only stand in for meshes of the builder that made them
+    if (mode != sharedMode) {
+        for (auto& entry : sharedMeshes)
+            entry.second.mesh.destroy();
+        sharedMeshes.clear();
+        sharedMode = mode;
+    }
+
+    int* rebuild = frameArena().allocArray<int>(chunks.size());
+    int rebuildCount = 0;
+    int* submit = frameArena().allocArray<int>(chunks.size());
+    int submitCount = 0;
+    for (int i = 0; i < (int)chunks.size(); i++) {
+        ChunkRenderData& data = chunks[i];
+        if (!data.chunk->dirty || data.chunk->state < CHUNK_LIT)
+            continue; // Not meshed before its neighbours and light are in
+        if (data.state == CHUNK_EVICTED && !data.chunk->edited)
+            continue; // Stays dirty until it is back in view
+
+        bool hiddenUniform = data.chunk->isUniform() && uniformChunkIsHidden(world, *data.chunk);
+        if (!hiddenUniform && mesher && !instancing && !data.chunk->edited) {
+            submit[submitCount++] = i; // Nearest first, below
+            continue;
+        }
+
+        data.meshVersion = ++nextMeshVersion;
+        if (hiddenUniform) {
+            // No snapshot and no meshing; the new version drops pending async results
+            if (data.mesh.vertexCount > 0)
+                changedMeshes.push_back(data.chunk->coord);
+            dropMesh(data);
+            data.translucent.destroy();
+            data.translucentQuads.reset();
+            data.instances.destroy();
+            data.emitters.clear();
+            data.foliage.clear();
+            data.faceVisibility = uniformFaceVisibility(data.chunk->uniformBlock());
+            drawDataVersion++;
+        }
+        else if (instancing) {
+            ChunkVoxels voxels;
+            world.snapshotChunk(*data.chunk, voxels);
+            data.instances.build(voxels);
+            data.faceVisibility = computeFaceVisibility(voxels);
+            findEmitters(*data.chunk, voxels, data.emitters);
+            findFoliage(*data.chunk, voxels, data.foliage);
+        }
+        else {
+            rebuild[rebuildCount++] = i;
+        }
+        data.state = CHUNK_UPLOADED;
+        data.chunk->dirty = false;
+        data.chunk->edited = false;
+    }
+
+    // Async meshes: the nearest within this frame's submission budget and
+    // the mesher's memory budget; the rest stay dirty for later frames
+    if (submitCount > 0) {
+        int budget = meshSubmitsPerFrame > 0 ? std::min(submitCount, meshSubmitsPerFrame) : submitCount;
+        auto nearer = [&](int a, int b) {
+            return chunkDistance2(chunks[a].chunk->coord, cameraChunk) < chunkDistance2(chunks[b].chunk->coord, cameraChunk);
+        };
+        if (budget < submitCount)
+            std::nth_element(submit, submit + budget, submit + submitCount, nearer);
+        std::sort(submit, submit + budget, nearer);
+        for (int k = 0; k < budget && !mesher->overBudget(meshedBytes); k++) {
+            ChunkRenderData& data = chunks[submit[k]];
+            // The snapshot is taken now, so later edits only affect the next rebuild
+            data.meshVersion = ++nextMeshVersion;
+            std::unique_ptr<ChunkVoxels> snapshot(new ChunkVoxels());
+            world.snapshotChunk(*data.chunk, *snapshot);
+            findEmitters(*data.chunk, *snapshot, data.emitters);
+            findFoliage(*data.chunk, *snapshot, data.foliage);
+
+            // An identical chunk is drawn already: its mesh is drawn here too
+            uint64_t hash = meshSnapshotHash(*snapshot);
+            auto shared = sharedMeshes.find(hash);
+            if (shared != sharedMeshes.end()) {
+                dropMesh(data);
+                data.mesh.share(shared->second.mesh);
+                data.mesh.buildTimeMs = 0.0;
+                data.sharedHash = hash;
+                data.reusedMesh = true;
+                reusedMeshes++;
+                data.snapshotHash = 0;
+                data.translucent.destroy();
+                data.translucentQuads.reset();
+                data.faceVisibility = shared->second.faceVisibility;
+                data.state = CHUNK_UPLOADED;
+                startFade(data);
+                changedMeshes.push_back(data.chunk->coord);
+                drawDataVersion++;
+                data.chunk->dirty = false;
+                continue;
+            }
+
+            data.snapshotHash = 0;
+            if (gpuMesher && gpuMesher->hasFreeSlot() && GpuMesher::accepts(*data.chunk)) {
+                gpuMesher->submit(data.chunk->coord, data.meshVersion, *snapshot);
+            }
+            else {
+                data.snapshotHash = hash;
+                mesher->submit(data.chunk->coord, data.meshVersion, mode, std::move(snapshot), sortCellOf(*data.chunk, eye));
+            }
+            data.state = CHUNK_MESHING;
+            data.chunk->dirty = false;
+        }
+    }
+
+    if (rebuildCount == 0)
+        return;
+
+    // Synchronous meshes: build on the job system if there is one, upload here
+    std::vector<ChunkVertexBuffer> vertices(rebuildCount);
+    std::vector<ChunkVertexBuffer> translucentVertices(rebuildCount);
+    int* quads = frameArena().allocArray<int>(rebuildCount);
+    int* translucentQuads = frameArena().allocArray<int>(rebuildCount);
+    glm::ivec3* sortCells = frameArena().allocArray<glm::ivec3>(rebuildCount);
+    FaceVisibility* faceVisibility = frameArena().allocArray<FaceVisibility>(rebuildCount);
+    double* buildMs = frameArena().allocArray<double>(rebuildCount);
+
+    auto buildRange = [&](int begin, int end) {
+        ArenaScope scratch(threadArena());
+        ChunkVoxels* voxels = threadArena().allocArray<ChunkVoxels>(1);
+        for (int r = begin; r < end; r++) {
+            auto start = std::chrono::steady_clock::now();
+            const Chunk& chunk = *chunks[rebuild[r]].chunk;
+            world.snapshotChunk(chunk, *voxels);
+            quads[r] = meshChunk(*voxels, mode, vertices[r]);
+            translucentQuads[r] = meshChunkTranslucent(*voxels, translucentVertices[r]);
+            sortCells[r] = sortCellOf(chunk, eye);
+            sortTranslucentQuads(translucentVertices[r], sortCells[r]);
+            faceVisibility[r] = computeFaceVisibility(*voxels);
+            findEmitters(chunk, *voxels, chunks[rebuild[r]].emitters);  // Each range writes its own chunks
+            findFoliage(chunk, *voxels, chunks[rebuild[r]].foliage);
+            buildMs[r] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(rebuildCount, 8, buildRange);
+    else
+        buildRange(0, rebuildCount);
+
+    for (int r = 0; r < rebuildCount; r++) {
+        ChunkRenderData& data = chunks[rebuild[r]];
+        dropMesh(data);
+        data.snapshotHash = 0;
+        data.mesh.upload(vertices[r], quads[r]);
+        data.mesh.buildTimeMs = buildMs[r];
+        setTranslucent(data, std::move(translucentVertices[r]), translucentQuads[r], sortCells[r]);
+        data.faceVisibility = faceVisibility[r];
+        startFade(data);
+        changedMeshes.push_back(data.chunk->coord);
+    }
+    drawDataVersion++;
+}
+
+void ChunkRenderer::startFade(ChunkRenderData& data) const
+{
+    if (data.fadeStart < 0.0f)
+        data.fadeStart = (float)clock;
+}
+
+float ChunkRenderer::fadeOf(const ChunkRenderData& data) const
+{
+    if (fadeSeconds <= 0.0f || data.fadeStart < 0.0f)
+        return 1.0f;
+    return std::min(((float)clock - data.fadeStart) / fadeSeconds, 1.0f);
+}
+
+// CPU memory of a finished mesh waiting for upload
+static size_t meshBytes(const MeshResult& result)
+{
+    return (result.vertices.capacity() + result.translucentVertices.capacity()) * sizeof(ChunkVertex);
+}
+
+void ChunkRenderer::dropMesh(ChunkRenderData& data)
+{
+    data.mesh.destroy();
+    if (data.reusedMesh) {
+        reusedMeshes--;
+        data.reusedMesh = false;
+    }
+    if (data.sharedHash != 0) {
+        auto found = sharedMeshes.find(data.sharedHash);
+        if (found != sharedMeshes.end() && chunkMeshHeap().owners(found->second.mesh.allocation) <= 1) {
+            found->second.mesh.destroy();
+            sharedMeshes.erase(found);
+        }
+        data.sharedHash = 0;
+    }
+}
+
+void ChunkRenderer::shareMesh(ChunkRenderData& data)
+{
+    uint64_t hash = data.snapshotHash;
+    data.snapshotHash = 0;
+    if (hash == 0 || data.mesh.vertexCount == 0 || data.translucent.vertexCount > 0)
+        return;
+    auto found = sharedMeshes.find(hash);
+    if (found == sharedMeshes.end()) {
+        SharedMesh& entry = sharedMeshes[hash];
+        entry.mesh.share(data.mesh);
+        entry.faceVisibility = data.faceVisibility;
+    }
+    else {
+        // Meshed at the same time as its twin; keep one copy
+        double buildTimeMs = data.mesh.buildTimeMs;
+        data.mesh.share(found->second.mesh);
+        data.mesh.buildTimeMs = buildTimeMs;
+        data.reusedMesh = true;
+        reusedMeshes++;
+    }
+    data.sharedHash = hash;
+}
+
+void ChunkRenderer::setTranslucent(ChunkRenderData& data, ChunkVertexBuffer vertices, int quads, const glm::ivec3& cell)
+{
+    data.translucent.upload(vertices, quads);
+    data.sortedCell = cell;
+    data.sortPending = false;
+    if (quads > 0)
+        data.translucentQuads = std::make_shared<const ChunkVertexBuffer>(std::move(vertices));
+    else
+        data.translucentQuads.reset();
+}
+
+int ChunkRenderer::enforceMeshBudget(const Frustum& frustum, const glm::ivec3& cameraChunk)
+{
+    if (meshBudgetBytes == 0 || chunks.empty())
+        return 0;
+    PROFILE_ZONE("Mesh budget");
+    budgetFrame++;
+
+    int* inView = frameArena().allocArray<int>(chunks.size());
+    int inViewCount = cullAABBs(frustum, bounds, inView);
+    for (int v = 0; v < inViewCount; v++) {
+        ChunkRenderData& data = chunks[inView[v]];
+        data.lastSeenFrame = budgetFrame;
+        if (data.state == CHUNK_EVICTED) {
+            data.state = CHUNK_READY;
+            data.chunk->dirty = true;
+        }
+    }
+
+    GpuHeap& heap = chunkMeshHeap();
+    if (heap.bytesInUse() <= meshBudgetBytes)
+        return 0;
+
+    int* candidates = frameArena().allocArray<int>(chunks.size());
+    int candidateCount = 0;
+    for (int i = 0; i < (int)chunks.size(); i++) {
+        bool resident = chunks[i].mesh.allocation >= 0 || chunks[i].translucent.allocation >= 0;
+        if (resident && chunks[i].lastSeenFrame != budgetFrame)
+            candidates[candidateCount++] = i;
+    }
+    std::sort(candidates, candidates + candidateCount, [&](int a, int b) {
+        if (chunks[a].lastSeenFrame != chunks[b].lastSeenFrame)
+            return chunks[a].lastSeenFrame < chunks[b].lastSeenFrame;
+        return chunkDistance2(chunks[a].chunk->coord, cameraChunk) > chunkDistance2(chunks[b].chunk->coord, cameraChunk);
+    });
+
+    size_t target = meshBudgetBytes - meshBudgetBytes / 8;
+    int evicted = 0;
+    for (int c = 0; c < candidateCount && heap.bytesInUse() > target; c++) {
+        ChunkRenderData& data = chunks[candidates[c]];
+        dropMesh(data);
+        data.translucent.destroy();
+        data.translucentQuads.reset();
+        data.state = CHUNK_EVICTED;
+        changedMeshes.push_back(data.chunk->coord);
+        data.meshVersion = ++nextMeshVersion; // Drops an async rebuild still in flight
+        evicted++;
+    }
+    if (evicted > 0)
+        drawDataVersion++;
+    return evicted;
+}
+
+int ChunkRenderer::uploadMeshes(ChunkMesher& mesher, size_t budgetBytes, const glm::ivec3& cameraChunk)
+{
+    PROFILE_ZONE("Upload meshes");
+
+    // Meshes of unloaded chunks or ones superseded by a newer rebuild are dropped
+    auto current = [&](const MeshResult& result) -> ChunkRenderData* {
+        const int* index = indexOf.find(packChunkCoord(result.coord));
+        if (!index || chunks[*index].meshVersion != result.version)
+            return nullptr;
+        return &chunks[*index];
+    };
+
+    int uploaded = 0;
+    if (gpuMesher) {
+        GpuMeshResult done;
+        while (gpuMesher->poll(done)) {
+            const int* index = indexOf.find(packChunkCoord(done.coord));
+            ChunkRenderData* data = index && chunks[*index].meshVersion == done.version ? &chunks[*index] : nullptr;
+            if (data)
+                dropMesh(*data);
+            gpuMesher->take(done, data ? &data->mesh : nullptr);
+            if (!data)
+                continue;
+            data->mesh.buildTimeMs = 0.0;
+            data->translucent.destroy();
+            data->translucentQuads.reset();
+            data->faceVisibility = done.faceVisibility;
+            data->state = CHUNK_UPLOADED;
+            startFade(*data);
+            changedMeshes.push_back(done.coord);
+            uploaded++;
+        }
+    }
+
+    // Take every finished mesh, then upload the nearest within the budget
+    MeshResult result;
+    while (mesher.poll(result)) {
+        ChunkRenderData* data = current(result);
+        if (!data)
+            continue;
+        data->state = CHUNK_MESHED;
+        meshedBytes += meshBytes(result);
+        meshed.push_back(std::move(result));
+    }
+    meshed.erase(std::remove_if(meshed.begin(), meshed.end(), [&](const MeshResult& r) {
+        if (current(r))
+            return false;
+        meshedBytes -= meshBytes(r);
+        return true;
+    }), meshed.end());
+    std::sort(meshed.begin(), meshed.end(), [&](const MeshResult& a, const MeshResult& b) {
+        return chunkDistance2(a.coord, cameraChunk) > chunkDistance2(b.coord, cameraChunk);
+    });
+
+    size_t bytes = 0;
+    while (bytes < budgetBytes && !meshed.empty()) {
+        MeshResult& next = meshed.back();
+        meshedBytes -= meshBytes(next);
+        if (ChunkRenderData* data = current(next)) {
+            bytes += (next.vertices.size() + next.translucentVertices.size()) * sizeof(ChunkVertex);
+            dropMesh(*data);
+            data->mesh.upload(next.vertices, next.quadCount);
+            data->mesh.buildTimeMs = next.buildTimeMs;
+            setTranslucent(*data, std::move(next.translucentVertices), next.translucentQuads, next.sortCell);
+            data->faceVisibility = next.faceVisibility;
+            shareMesh(*data);
+            data->state = CHUNK_UPLOADED;
+            startFade(*data);
+            changedMeshes.push_back(next.coord);
+            uploaded++;
+        }
+        meshed.pop_back();
+    }
+    if (uploaded > 0)
+        drawDataVersion++;
+    uploadedBytes = bytes;
+    return uploaded;
+}
+
+int ChunkRenderer::pendingCount() const
+{
+    int count = 0;
+    for (const ChunkRenderData& data : chunks) {
+        if (data.state == CHUNK_MESHING || data.state == CHUNK_MESHED)
+            count++;
+        else if (data.state != CHUNK_EVICTED && data.chunk->dirty && data.chunk->state >= CHUNK_LIT)
+            count++;
+    }
+    return count;
+}
+
+void ChunkRenderer::residentInView(const Frustum& frustum, std::vector<glm::ivec3>& out) const
+{
+    for (const ChunkRenderData& data : chunks) {
+        glm::vec3 origin = data.chunk->origin();
+        if (data.state == CHUNK_UPLOADED && frustum.intersectsAABB(origin, origin + glm::vec3((float)CHUNK_SIZE)))
+            out.push_back(data.chunk->coord);
+    }
+}
+
+int ChunkRenderer::residentCount(const std::vector<glm::ivec3>& coords) const
+{
+    int count = 0;
+    for (const glm::ivec3& coord : coords) {
+        const int* index = indexOf.find(packChunkCoord(coord));
+        if (index && chunks[*index].state == CHUNK_UPLOADED)
+            count++;
+    }
+    return count;
+}
+
+int ChunkRenderer::cull(const Frustum& frustum)
+{
+    const int CULL_GRAIN = 4096;
+    int count = (int)chunks.size();
+    visible = frameArena().allocArray<int>(count);
+
+    if (!jobs || count <= CULL_GRAIN) {
+        visibleCount = cullAABBs(frustum, bounds, visible);
+        return visibleCount;
+    }
+
+    // Each range writes into its own slice of 'visible', compacted afterwards
+    int ranges = (count + CULL_GRAIN - 1) / CULL_GRAIN;
+    int* cullCounts = frameArena().allocArray<int>(ranges);
+    jobs->parallelFor(count, CULL_GRAIN, [&](int begin, int end) {
+        cullCounts[begin / CULL_GRAIN] = cullAABBRange(frustum, bounds, begin, end, visible + begin);
+    });
+
+    visibleCount = 0;
+    for (int r = 0; r < ranges; r++) {
+        const int* slice = visible + r * CULL_GRAIN;
+        for (int k = 0; k < cullCounts[r]; k++)
+            visible[visibleCount++] = slice[k];
+    }
+    return visibleCount;
+}
+
+int ChunkRenderer::cullVisibility(const Frustum& frustum, const glm::ivec3& cameraChunk)
+{
+    visible = frameArena().allocArray<int>(chunks.size());
+    visibleCount = 0;
+    if (chunks.empty())
+        return 0;
+
+    // Walk a grid over the loaded chunks plus one layer of open air around
+    // them, so the camera can start outside the loaded set
+    glm::ivec3 lo = chunks[0].chunk->coord;
+    glm::ivec3 hi = lo;
+    for (const ChunkRenderData& data : chunks) {
+        lo = glm::min(lo, data.chunk->coord);
+        hi = glm::max(hi, data.chunk->coord);
+    }
+    lo -= glm::ivec3(1);
+    hi += glm::ivec3(1);
+    glm::ivec3 dims = hi - lo + glm::ivec3(1);
+    int cells = dims.x * dims.y * dims.z;
+
+    struct Step {
+        glm::ivec3 coord;
+        int entryFace;      // Face of this chunk the walk came through, -1 at the start
+        int directions;     // Directions stepped so far
+    };
+    Step* queue = frameArena().allocArray<Step>(cells);
+    uint8_t* seen = frameArena().allocArray<uint8_t>(cells);
+    memset(seen, 0, cells);
+    auto cellOf = [&](const glm::ivec3& c) {
+        glm::ivec3 p = c - lo;
+        return (p.x * dims.y + p.y) * dims.z + p.z;
+    };
+
+    int head = 0, tail = 0;
+    glm::ivec3 start = glm::clamp(cameraChunk, lo, hi);
+    queue[tail++] = { start, -1, 0 };
+    seen[cellOf(start)] = 1;
+
+    while (head < tail) {
+        Step step = queue[head++];
+
+        FaceVisibility connectivity = FACE_VISIBILITY_ALL;
+        if (const int* index = indexOf.find(packChunkCoord(step.coord))) {
+            visible[visibleCount++] = *index;
+            connectivity = chunks[*index].faceVisibility;
+        }
+
+        for (int face = 0; face < 6; face++) {
+            if (step.directions & (1 << (face ^ 1)))
+                continue; // Would head back towards the camera
+            if (step.entryFace >= 0 && (step.entryFace == face || !facesConnected(connectivity, step.entryFace, face)))
+                continue;
+
+            const int* n = FACE_NORMALS[face];
+            glm::ivec3 next = step.coord + glm::ivec3(n[0], n[1], n[2]);
+            if (glm::any(glm::lessThan(next, lo)) || glm::any(glm::greaterThan(next, hi)))
+                continue;
+            int cell = cellOf(next);
+            if (seen[cell])
+                continue;
+
+            glm::vec3 boxMin = glm::vec3(next) * (float)CHUNK_SIZE;
+            if (!frustum.intersectsAABB(boxMin, boxMin + glm::vec3((float)CHUNK_SIZE)))
+                continue;
+
+            seen[cell] = 1;
+            queue[tail++] = { next, face ^ 1, step.directions | (1 << face) };
+        }
+    }
+    return visibleCount;
+}
+
+void ChunkRenderer::sortFrontToBack(const glm::ivec3& cameraChunk)
+{
+    if (visibleCount < 2)
+        return;
+
+    int* keys = frameArena().allocArray<int>(visibleCount);
+    int maxKey = 0;
+    for (int v = 0; v < visibleCount; v++) {
+        glm::ivec3 d = chunks[visible[v]].chunk->coord - cameraChunk;
+        keys[v] = d.x * d.x + d.y * d.y + d.z * d.z;
+        maxKey = std::max(maxKey, keys[v]);
+    }
+
+    int* start = frameArena().allocArray<int>(maxKey + 2);
+    memset(start, 0, (maxKey + 2) * sizeof(int));
+    for (int v = 0; v < visibleCount; v++)
+        start[keys[v] + 1]++;
+    for (int k = 0; k <= maxKey; k++)
+        start[k + 1] += start[k];
+
+    int* sorted = frameArena().allocArray<int>(visibleCount);
+    for (int v = 0; v < visibleCount; v++)
+        sorted[start[keys[v]]++] = visible[v];
+    visible = sorted;
+}
+
+int ChunkRenderer::drawIndirect(StreamBuffer& stream, const glm::dvec3& eye, int& quads)
+{
+    return drawIndirect(visible, visibleCount, stream, eye, quads);
+}
+
+// Directions of a chunk's mesh that can face 'eye', given its origin relative to it
+static int facingMask(const glm::vec3& origin, bool facing)
+{
+    // With several views each has its own eye, so nothing is left out
+    if (!facing || chunkViewCount() > 1)
+        return ALL_CHUNK_FACES;
+    return chunkFacingMask(origin, origin + glm::vec3((float)CHUNK_SIZE));
+}
+
+int ChunkRenderer::drawIndirect(const int* list, int count, StreamBuffer& stream, const glm::dvec3& eye, int& quads, bool facing)
+{
+    GpuHeap& heap = chunkMeshHeap();
+    int pages = heap.pageCount();
+    if (count == 0 || pages == 0)
+        return 0;
+
+    // Each mesh's ranges of the directions facing the eye
+    ChunkMeshRanges* ranges = frameArena().allocArray<ChunkMeshRanges>(count);
+
+    // Bucket the commands by heap page (stable counting sort, so each page
+    // keeps the order of the list: front to back for the visible one)
+    int* pageStart = frameArena().allocArray<int>(pages + 1);
+    int* cursor = frameArena().allocArray<int>(pages);
+    memset(pageStart, 0, (pages + 1) * sizeof(int));
+    for (int v = 0; v < count; v++) {
+        const ChunkRenderData& data = chunks[list[v]];
+        ranges[v].count = 0;
+        if (data.mesh.vertexCount == 0)
+            continue;
+        data.mesh.facingRanges(facingMask(data.chunk->relativeOrigin(eye), facing), ranges[v]);
+        pageStart[data.mesh.page() + 1] += ranges[v].count;
+    }
+    for (int p = 0; p < pages; p++) {
+        pageStart[p + 1] += pageStart[p];
+        cursor[p] = pageStart[p];
+    }
+
+    int total = pageStart[pages];
+    if (total == 0)
+        return 0;
+
+    // One command per range; its base instance selects the chunk origin
+    DrawElementsIndirectCommand* commands = frameArena().allocArray<DrawElementsIndirectCommand>(total);
+    glm::vec4* offsets = frameArena().allocArray<glm::vec4>(total);
+    for (int v = 0; v < count; v++) {
+        const ChunkRenderData& data = chunks[list[v]];
+        for (int r = 0; r < ranges[v].count; r++) {
+            int slot = cursor[data.mesh.page()]++;
+            commands[slot].count = ranges[v].quads[r] * 6;
+            commands[slot].instanceCount = (GLuint)chunkViewCount();
+            commands[slot].firstIndex = 0;
+            commands[slot].baseVertex = (GLint)(data.mesh.baseVertex() + ranges[v].first[r] * 4);
+            commands[slot].baseInstance = slot;
+            offsets[slot] = glm::vec4(data.chunk->relativeOrigin(eye), fadeOf(data));
+            quads += ranges[v].quads[r];
+        }
+    }
+
+    size_t commandOffset = stream.write(commands, total * sizeof(DrawElementsIndirectCommand), 4);
+    size_t originOffset = stream.write(offsets, total * sizeof(glm::vec4), 4);
+    if (commandOffset == StreamBuffer::STREAM_FULL || originOffset == StreamBuffer::STREAM_FULL)
+        return 0; // Frame region too small for this many chunks
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer);
+
+    int draws = 0;
+    for (int p = 0; p < pages; p++) {
+        int count = pageStart[p + 1] - pageStart[p];
+        if (count == 0)
+            continue;
+        heap.bind(p);
+        bindChunkDrawOffsets(stream.buffer, originOffset, 4);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+            (void*)(commandOffset + pageStart[p] * sizeof(DrawElementsIndirectCommand)), count, 0);
+        draws++;
+    }
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return draws;
+}
+
+int ChunkRenderer::recordEach(const int* list, int count, const glm::dvec3& eye, int& quads, CommandList& out, bool facing) const
+{
+    int draws = 0;
+    int boundPage = -1;
+    for (int v = 0; v < count; v++) {
+        const ChunkRenderData& data = chunks[list[v]];
+        if (data.mesh.vertexCount == 0)
+            continue;
+        int page = data.mesh.page();
+        if (page != boundPage) {
+            chunkMeshHeap().record(out, page);
+            boundPage = page;
+        }
+        glm::vec3 origin = data.chunk->relativeOrigin(eye);
+        out.vertexAttribute(1, glm::vec4(origin, fadeOf(data)));
+        quads += data.mesh.record(out, facingMask(origin, facing));
+        draws++;
+    }
+    return draws;
+}
+
+int ChunkRenderer::drawEach(const int* list, int count, const glm::dvec3& eye, int& quads, bool facing)
+{
+    const int RECORD_GRAIN = 256;
+    if (!jobs || count <= RECORD_GRAIN) {
+        if (commands.empty())
+            commands.resize(1);
+        commands[0].clear();
+        int draws = recordEach(list, count, eye, quads, commands[0], facing);
+        renderDevice().submit(commands[0]);
+        return draws;
+    }
+
+    // Each slice of the list is recorded into its own command list on the
+    // workers, then all are submitted here in list order. A slice binds its
+    // first page itself, so the lists don't depend on each other.
+    int slices = (count + RECORD_GRAIN - 1) / RECORD_GRAIN;
+    if ((int)commands.size() < slices)
+        commands.resize(slices);
+    int* sliceDraws = frameArena().allocArray<int>(slices);
+    int* sliceQuads = frameArena().allocArray<int>(slices);
+    for (int s = 0; s < slices; s++) {
+        commands[s].clear();
+        sliceDraws[s] = sliceQuads[s] = 0;
+    }
+    jobs->parallelFor(count, RECORD_GRAIN, [&](int begin, int end) {
+        int slice = begin / RECORD_GRAIN;
+        sliceDraws[slice] = recordEach(list + begin, end - begin, eye, sliceQuads[slice], commands[slice], facing);
+    });
+
+    int draws = 0;
+    for (int s = 0; s < slices; s++) {
+        renderDevice().submit(commands[s]);
+        draws += sliceDraws[s];
+        quads += sliceQuads[s];
+    }
+    return draws;
+}
+
+int ChunkRenderer::updateTranslucent(ChunkMesher* mesher, const Frustum& frustum, const glm::dvec3& eye, bool sorted)
+{
+    PROFILE_ZONE("Sort translucent");
+
+    // Re-sorts of meshes that were rebuilt or dropped meanwhile are stale
+    SortResult result;
+    while (mesher && mesher->pollSorted(result)) {
+        const int* index = indexOf.find(packChunkCoord(result.coord));
+        if (!index || chunks[*index].meshVersion != result.version)
+            continue;
+        ChunkRenderData& data = chunks[*index];
+        setTranslucent(data, std::move(result.vertices), data.translucent.quadCount, result.cell);
+    }
+
+    translucent = frameArena().allocArray<int>(chunks.size());
+    int inView = cullAABBs(frustum, bounds, translucent);
+    translucentCount = 0;
+    for (int v = 0; v < inView; v++) {
+        ChunkRenderData& data = chunks[translucent[v]];
+        if (data.translucent.vertexCount == 0)
+            continue;
+        translucent[translucentCount++] = translucent[v];
+
+        glm::ivec3 cell = sortCellOf(*data.chunk, eye);
+        if (!sorted || cell == data.sortedCell || data.sortPending)
+            continue;
+        // Later sorts start from the last order, which is nearly right
+        if (mesher) {
+            mesher->sort(data.chunk->coord, data.meshVersion, cell, data.translucentQuads);
+            data.sortPending = true;
+        }
+        else {
+            ChunkVertexBuffer vertices(*data.translucentQuads);
+            sortTranslucentQuads(vertices, cell);
+            setTranslucent(data, std::move(vertices), data.translucent.quadCount, cell);
+        }
+    }
+
+    // Any order blends the same: one indirect call per page
+    if (!sorted) {
+        std::sort(translucent, translucent + translucentCount, [&](int a, int b) {
+            return chunks[a].translucent.page() < chunks[b].translucent.page();
+        });
+        return translucentCount;
+    }
+
+    float* distance = frameArena().allocArray<float>(chunks.size());
+    for (int v = 0; v < translucentCount; v++) {
+        glm::vec3 center = chunks[translucent[v]].chunk->relativeOrigin(eye) + glm::vec3(CHUNK_SIZE * 0.5f);
+        distance[translucent[v]] = glm::dot(center, center);
+    }
+    std::sort(translucent, translucent + translucentCount, [&](int a, int b) {
+        return distance[a] > distance[b];
+    });
+    return translucentCount;
+}
+
+int ChunkRenderer::drawTranslucent(StreamBuffer& stream, const glm::dvec3& eye, bool indirect, int& quads)
+{
+    if (translucentCount == 0)
+        return 0;
+    GpuHeap& heap = chunkMeshHeap();
+
+    if (!indirect) {
+        int draws = 0;
+        int boundPage = -1;
+        for (int v = 0; v < translucentCount; v++) {
+            const ChunkRenderData& data = chunks[translucent[v]];
+            int page = data.translucent.page();
+            if (page != boundPage) {
+                heap.bind(page);
+                boundPage = page;
+            }
+            glVertexAttrib4fv(1, glm::value_ptr(glm::vec4(data.chunk->relativeOrigin(eye), fadeOf(data))));
+            data.translucent.draw();
+            quads += data.translucent.quadCount;
+            draws++;
+        }
+        return draws;
+    }
+
+    // Commands stay in list order, so only runs on the same page share a call
+    DrawElementsIndirectCommand* commands = frameArena().allocArray<DrawElementsIndirectCommand>(translucentCount);
+    glm::vec4* offsets = frameArena().allocArray<glm::vec4>(translucentCount);
+    for (int v = 0; v < translucentCount; v++) {
+        const ChunkRenderData& data = chunks[translucent[v]];
+        commands[v].count = data.translucent.quadCount * 6;
+        commands[v].instanceCount = (GLuint)chunkViewCount();
+        commands[v].firstIndex = 0;
+        commands[v].baseVertex = (GLint)data.translucent.baseVertex();
+        commands[v].baseInstance = v;
+        offsets[v] = glm::vec4(data.chunk->relativeOrigin(eye), fadeOf(data));
+        quads += data.translucent.quadCount;
+    }
+
+    size_t commandOffset = stream.write(commands, translucentCount * sizeof(DrawElementsIndirectCommand), 4);
+    size_t originOffset = stream.write(offsets, translucentCount * sizeof(glm::vec4), 4);
+    if (commandOffset == StreamBuffer::STREAM_FULL || originOffset == StreamBuffer::STREAM_FULL)
+        return 0;
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer);
+
+    int draws = 0;
+    for (int begin = 0; begin < translucentCount; ) {
+        int page = chunks[translucent[begin]].translucent.page();
+        int end = begin + 1;
+        while (end < translucentCount && chunks[translucent[end]].translucent.page() == page)
+            end++;
+        heap.bind(page);
+        bindChunkDrawOffsets(stream.buffer, originOffset, 4);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+            (void*)(commandOffset + begin * sizeof(DrawElementsIndirectCommand)), end - begin, 0);
+        draws++;
+        begin = end;
+    }
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return draws;
+}
+
+void ChunkRenderer::destroy()
+{
+
+    for (ChunkRenderData& data : chunks) {
+        data.mesh.destroy();
+        data.translucent.destroy();
+        data.instances.destroy();
+    }
+    for (auto& entry : sharedMeshes)
+        entry.second.mesh.destroy();
+    sharedMeshes.clear();
+    reusedMeshes = 0;
+    chunks.clear();
+    changedMeshes.clear();
+    meshed.clear();
+    meshedBytes = 0;
+    bounds.clear();
+    visible = nullptr;
+    visibleCount = 0;
+    translucent = nullptr;
+    translucentCount = 0;
+    indexOf.clear();
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "block_instancing.h"
+#include "chunk.h"
+#include "chunk_hash_map.h"
+#include "chunk_mesh.h"
+#include "chunk_mesher.h"
+#include "chunk_visibility.h"
+#include "frustum.h"
+#include "gpu_mesher.h"
+#include "job_system.h"
+#include "render_device.h"
+#include "stream_buffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Render data kept alongside each loaded chunk
+struct ChunkRenderData {
+    Chunk* chunk;
+    ChunkMesh mesh;
+    ChunkMesh translucent;  // Faces of translucent blocks, quads ordered back to front for sortedCell
+    std::shared_ptr<const ChunkVertexBuffer> translucentQuads; // CPU copy of 'translucent', read by re-sorts
+    glm::ivec3 sortedCell;  // Chunk-local camera block the translucent quads are ordered for
+    bool sortPending = false;   // A re-sort for a newer cell is on a worker
+    ChunkInstances instances;
+    uint32_t meshVersion;   // Set on each rebuild; older async results are discarded
+    FaceVisibility faceVisibility;  // Updated with the mesh; all open until first meshed
+    uint32_t lastSeenFrame = 0;     // enforceMeshBudget() frame the chunk was last in view
+    float fadeStart = -1.0f;        // ChunkRenderer::clock at the first mesh upload, -1 before
+    std::vector<uint16_t> emitters; // Light-emitting voxels, emission << 12 | index; refreshed with the mesh (ClusteredLights)
+    std::vector<uint32_t> foliage;  // Plants over its grass, see findFoliage(); refreshed with the mesh (FoliageRenderer)
+    uint64_t snapshotHash = 0;      // meshSnapshotHash() of the snapshot being meshed, 0 = none
+    uint64_t sharedHash = 0;        // ... of the one 'mesh' is registered under for sharing, 0 = not registered
+    bool reusedMesh = false;        // 'mesh' came from another chunk's snapshot, no meshing of its own
+    // Render-side stage (CHUNK_READY until first meshed, then MESHING to
+    // UPLOADED or EVICTED); the world-side stages stay in Chunk::state, which
+    // only the main thread writes
+    ChunkState state = CHUNK_READY;
+};
+
+struct World;
+
+// GPU-side mirror of the loaded chunk set: meshes plus culling bounds
+struct ChunkRenderer {
+    std::vector<ChunkRenderData> chunks;
+    AABBList bounds;            // bounds entry i belongs to chunks[i]
+    int* visible = nullptr;     // Indices into chunks after cull() (frame arena)
+    int visibleCount = 0;
+    int* translucent = nullptr; // Chunks with translucent faces in view after updateTranslucent(), farthest first
+    int translucentCount = 0;
+    JobSystem* jobs = nullptr;  // Optional; splits culling and synchronous meshing across workers
+    uint32_t drawDataVersion = 0;   // Bumped when chunks or their mesh sizes change
+    size_t uploadedBytes = 0;       // Vertex data sent by the last uploadMeshes()
+    size_t meshBudgetBytes = 0;     // Most chunk mesh memory in the vertex heap; 0 = no limit
+    int meshSubmitsPerFrame = 0;    // Async mesh submissions per updateDirty(), nearest first; 0 = no limit
+    GpuMesher* gpuMesher = nullptr; // Optional; takes the async meshes it accepts while it has free slots
+    double clock = 0.0;             // Seconds, advanced by the caller every frame
+    float fadeSeconds = 0.0f;       // Chunks dither in over this long after their first upload; 0 = they pop in
+    // Chunks whose mesh was replaced or dropped since the caller last cleared
+    // the list (cached shadow maps drawn from them are stale)
+    std::vector<glm::ivec3> changedMeshes;
+    int reusedMeshes = 0;           // Chunks drawing a mesh shared with an identical chunk
+    size_t sharedMeshCount() const { return sharedMeshes.size(); }
+
+    // Start tracking a newly loaded chunk (meshed on the next update).
+    // Loaded neighbours are re-meshed so their shared faces are culled.
+    void addChunk(Chunk* chunk);
+    // Release the GPU data of a chunk that is being unloaded
+    void removeChunk(const glm::ivec3& coord);
+
+    // Rebuild meshes (or instance lists) for chunks whose voxels or light
+    // changed, skipping chunks not CHUNK_LIT yet (neighbours or light not in
+    // yet). With a
+    // mesher, chunk meshes are snapshotted and built on its workers instead,
+    // nearest to 'cameraChunk' first, at most meshSubmitsPerFrame and while
+    // the mesher is within its budget. Without one, or for chunks changed by
+    // block edits, meshes are built in place (in parallel when 'jobs' is set)
+    // so the change shows this frame. Translucent quads are sorted for 'eye'.
+    // With a gpuMesher, async chunks it accepts are meshed there instead.
+    void updateDirty(const World& world, MeshMode mode, bool instancing, ChunkMesher* mesher,
+        const glm::ivec3& cameraChunk, const glm::dvec3& eye);
+    // Take the finished async meshes and upload the nearest to 'cameraChunk'
+    // until 'budgetBytes' of vertex data has been sent (the last mesh may
+    // overshoot); the rest wait, CHUNK_MESHED. Finished GPU meshes are
+    // copied into the heap as they come, outside the budget (nothing crosses
+    // the bus). Returns the number uploaded.
+    int uploadMeshes(ChunkMesher& mesher, size_t budgetBytes, const glm::ivec3& cameraChunk);
+    // Draw every visible chunk mesh with one glMultiDrawElementsIndirect per
+    // heap page (needs initChunkMeshes(true)), writing the commands and chunk
+    // origins relative to 'eye' into 'stream'. Face directions pointing away
+    // from 'eye' are left out (a command per range of the rest). Adds the
+    // quads drawn to 'quads' and returns the number of draw calls.
+    int drawIndirect(StreamBuffer& stream, const glm::dvec3& eye, int& quads);
+    // Same for the chunks in 'list' instead of the visible ones. Without
+    // 'facing' every direction is drawn, for shadow maps ('eye' is the
+    // cascade's anchor, not a viewer).
+    int drawIndirect(const int* list, int count, StreamBuffer& stream, const glm::dvec3& eye, int& quads, bool facing = true);
+
+    // Collect the chunks with translucent faces inside 'frustum' into
+    // 'translucent', farthest from 'eye' first, and upload finished re-sorts.
+    // A chunk whose quads were ordered for another camera block than the one
+    // 'eye' is in now is re-sorted on the mesher's workers (in place without
+    // one); until the result is in, the old order is drawn. Unless 'sorted'
+    // (order-independent blending), nothing is re-sorted and the list is
+    // grouped by heap page instead. Returns the count.
+    int updateTranslucent(ChunkMesher* mesher, const Frustum& frustum, const glm::dvec3& eye, bool sorted = true);
+    // Draw the translucent meshes in 'translucent' in list order, with
+    // indirect commands written into 'stream' when 'indirect' (one call per
+    // run of meshes on the same heap page) or else one call each.
+    // Returns the number of draw calls.
+    int drawTranslucent(StreamBuffer& stream, const glm::dvec3& eye, bool indirect, int& quads);
+    // Draw the meshes of the chunks in 'list' one call each, binding heap
+    // pages as they change and setting attribute 1 per draw (needs
+    // initChunkMeshes(false)), 'facing' as for drawIndirect(). With 'jobs',
+    // long lists are recorded in slices across the workers and submitted
+    // in order. Returns the number of chunks drawn.
+    int drawEach(const int* list, int count, const glm::dvec3& eye, int& quads, bool facing = true);
+    // Record what drawEach() would draw into 'out' instead, touching no GL
+    // state, so it can run on any thread while the chunks are unchanged
+    int recordEach(const int* list, int count, const glm::dvec3& eye, int& quads, CommandList& out, bool facing = true) const;
+
+    // Keep the vertex heap within meshBudgetBytes: once over, drop the meshes
+    // of chunks outside 'frustum', least recently in view first and the
+    // farthest from 'cameraChunk' among those, down to 7/8 of the budget.
+    // Dropped meshes are rebuilt (marked dirty) when their chunk comes back
+    // into view. Call before updateDirty(). Returns the meshes dropped.
+    int enforceMeshBudget(const Frustum& frustum, const glm::ivec3& cameraChunk);
+
+    // Chunks that will get a mesh but have none on the GPU yet: lit and
+    // dirty, with the mesher or waiting for upload. Evicted ones don't count.
+    // Reads chunk flags, so call before the frame's release().
+    int pendingCount() const;
+
+    // Coordinates of the chunks inside 'frustum' whose mesh is on the GPU
+    // (or needs none), appended to 'out': the view a later session restores
+    void residentInView(const Frustum& frustum, std::vector<glm::ivec3>& out) const;
+    // How many of 'coords' are tracked with their mesh on the GPU (or none needed)
+    int residentCount(const std::vector<glm::ivec3>& coords) const;
+
+    // Frustum-cull every chunk, filling 'visible' from the frame arena (valid
+    // until the next frame). Returns the visible count.
+    int cull(const Frustum& frustum);
+    // Cave culling: breadth-first walk from 'cameraChunk' through chunk faces
+    // that are connected by air, never stepping back towards the camera and
+    // only into chunks inside the frustum. Positions without a loaded chunk
+    // count as open air. Fills 'visible' like cull(), nearest chunks first.
+    int cullVisibility(const Frustum& frustum, const glm::ivec3& cameraChunk);
+    // Reorder 'visible' nearest first by squared chunk distance from
+    // 'cameraChunk' (counting sort), so early depth testing rejects the
+    // fragments of farther chunks
+    void sortFrontToBack(const glm::ivec3& cameraChunk);
+
+    // How far 'data' has faded in, 0..1: the fourth component of the chunk
+    // offsets every draw passes in attribute 1
+    float fadeOf(const ChunkRenderData& data) const;
+
+    // Release every chunk's GPU data
+    void destroy();
+
+private:
+    // Re-mesh the loaded neighbours of 'coord' whose shared faces can change
+    // when the chunk there appears ('added') or disappears (nullptr)
+    void markNeighboursDirty(const glm::ivec3& coord, const Chunk* added);
+    // Upload a chunk's translucent quads, ordered for 'cell', keeping a copy for re-sorts
+    void setTranslucent(ChunkRenderData& data, ChunkVertexBuffer vertices, int quads, const glm::ivec3& cell);
+    // Begin the fade-in at the first upload; re-meshes show at once
+    void startFade(ChunkRenderData& data) const;
+    // Release a chunk's opaque mesh, and its shared entry once no chunk uses it
+    void dropMesh(ChunkRenderData& data);
+    // Register a just-uploaded opaque-only mesh under its snapshot hash, or
+    // if an identical one was registered meanwhile, draw that one instead
+    void shareMesh(ChunkRenderData& data);
+
+    ChunkHashMap<int> indexOf;  // Packed chunk coord -> index in chunks
+    uint32_t nextMeshVersion = 0;   // Unique across chunks, so a reloaded chunk can't match an old result
+    uint32_t budgetFrame = 0;       // Counts enforceMeshBudget() calls
+    std::vector<MeshResult> meshed; // Finished meshes waiting for the upload budget
+    size_t meshedBytes = 0;         // ... and their vertex memory
+    std::vector<CommandList> commands;  // Reused by drawEach(), one per recorded slice
+
+    // Opaque meshes by the hash of the snapshot they were built from
+    // (blocks, light and neighbour borders), each holding a reference to
+    // its heap range. A chunk whose snapshot hashes the same is given the
+    // mesh instead of being meshed: positions are chunk-local, so the one
+    // range draws at every such chunk's origin. Chunks with translucent
+    // quads (sorted per chunk) or no quads aren't shared.
+    struct SharedMesh {
+        ChunkMesh mesh;
+        FaceVisibility faceVisibility;
+    };
+    std::unordered_map<uint64_t, SharedMesh> sharedMeshes;
+    MeshMode sharedMode = MESH_MODE_COUNT;  // Builder of the shared meshes
+};
@@ -0,0 +1,357 @@
+#include "chunk_server.h"
+#include "entity_systems.h"
+#include "net_protocol.h"
+#include "player_prediction.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Inputs a client may send ahead of the server, at most: a second of
+// ticks at 60 Hz, so a stalled server catches up but a client can't run
+// faster than real time for long
+const uint32_t MAX_INPUTS_PER_TICK = 60;
+// Player boxes, one colour per spawn in turn
+const uint32_t PLAYER_COLORS[] = { 0xFF3050E0u, 0xFF30B0E0u, 0xFF40C040u, 0xFFE06030u, 0xFFC040C0u, 0xFF30E0E0u };
+const int PLAYER_COLOR_COUNT = 6;
+
+bool ChunkServer::start(World& serverWorld, int port)
+{
+    if (!listener.listen(port))
+        return false;
+    world = &serverWorld;
+    world->changeLog = &changes;
+    startTime = netClockSeconds();
+    return true;
+}
+
+void ChunkServer::stop()
+{
+    for (std::unique_ptr<Client>& client : clients)
+        disconnect(*client);
+    clients.clear();
+    slots.clear();
+    freeSlots.clear();
+    listener.close();
+    if (world)
+        world->changeLog = nullptr;
+    world = nullptr;
+}
+
+void ChunkServer::hold(Client& client, const glm::ivec3& coord)
+{
+    uint64_t key = packChunkCoord(coord);
+    if (!client.held.insert(key, (uint32_t)client.heldCoords.size())) {
+        unreference(coord); // Requested twice: the client holds it once
+        return;
+    }
+    client.heldCoords.push_back(coord);
+    interest.subscribe(client.slot, interestCellOfChunk(coord));
+}
+
+void ChunkServer::release(Client& client, const glm::ivec3& coord)
+{
+    // Still waiting: just drop the request
+    for (auto it = client.wanted.begin(); it != client.wanted.end(); ++it) {
+        if (it->coord == coord) {
+            client.wanted.erase(it);
+            unreference(coord);
+            return;
+        }
+    }
+
+    uint64_t key = packChunkCoord(coord);
+    const uint32_t* index = client.held.find(key);
+    if (!index)
+        return;
+    // Swap-remove from the coordinate list, fixing the moved entry's index
+    uint32_t slot = *index;
+    glm::ivec3 moved = client.heldCoords.back();
+    client.heldCoords[slot] = moved;
+    client.heldCoords.pop_back();
+    client.held.erase(key);
+    if (moved != coord)
+        client.held[packChunkCoord(moved)] = slot;
+    interest.unsubscribe(client.slot, interestCellOfChunk(coord));
+    unreference(coord);
+}
+
+void ChunkServer::unreference(const glm::ivec3& coord)
+{
+    uint64_t key = packChunkCoord(coord);
+    int* count = references.find(key);
+    if (!count || --*count > 0)
+        return;
+    references.erase(key);
+    world->unloadChunk(coord);
+}
+
+void ChunkServer::disconnect(Client& client)
+{
+    while (!client.wanted.empty()) {
+        glm::ivec3 coord = client.wanted.front().coord;
+        client.wanted.pop_front();
+        unreference(coord);
+    }
+    for (const glm::ivec3& coord : client.heldCoords) {
+        interest.unsubscribe(client.slot, interestCellOfChunk(coord));
+        unreference(coord);
+    }
+    client.heldCoords.clear();
+    client.held.clear();
+    client.connection.close();
+    if (entities)
+        entities->destroy(client.entity);
+    client.entity = NO_ENTITY;
+    if (slots[client.slot] == &client) {
+        slots[client.slot] = nullptr;
+        freeSlots.push_back(client.slot);
+    }
+}
+
+void ChunkServer::receive(Client& client)
+{
+    uint8_t type;
+    const uint8_t* body;
+    size_t size;
+    std::vector<glm::ivec3> coords;
+    std::vector<BlockChange> edits;
+    std::vector<NetPlayerInput> inputs;
+    uint32_t applied = 0;
+    while (client.connection.receive(type, body, size)) {
+        coords.clear();
+        edits.clear();
+        inputs.clear();
+        bool valid = true;
+        switch (type) {
+        case NET_CHUNK_REQUEST:
+            valid = decodeChunkCoords(body, size, coords);
+            for (const glm::ivec3& coord : coords) {
+                uint32_t sequence = client.requested++;
+                if (coord.y < 0 || coord.y >= WORLD_HEIGHT_CHUNKS)
+                    continue; // Never answered; the client only asks for chunks in the world
+                client.wanted.push_back({ coord, sequence });
+                references[packChunkCoord(coord)]++;
+            }
+            break;
+        case NET_CHUNK_RELEASE:
+            valid = decodeChunkCoords(body, size, coords);
+            for (const glm::ivec3& coord : coords)
+                release(client, coord);
+            break;
+        case NET_BLOCK_EDITS:
+            // Only in chunks the client holds; the world sends them back as deltas
+            valid = decodeBlockChanges(body, size, edits);
+            for (const BlockChange& edit : edits) {
+                if (!client.held.contains(packChunkCoord(chunkCoordOf(edit.block))))
+                    continue;
+                BlockId broken = world->getBlock(edit.block);
+                if (world->setBlock(edit.block, edit.id, false) && entities && edit.id == BLOCK_AIR && broken != BLOCK_AIR)
+                    spawnDroppedItem(*entities, edit.block, broken, drops++);
+            }
+            break;
+        case NET_PLAYER_SPAWN:
+            valid = !client.spawned && decodePlayerSpawn(body, size, client.player.position);
+            client.spawned = true;
+            if (valid && entities) {
+                client.entity = entities->create(COMPONENT_POSITION | COMPONENT_BOUNDS | COMPONENT_APPEARANCE);
+                if (client.entity != NO_ENTITY) {
+                    size_t row;
+                    Archetype& a = entities->archetypeOf(client.entity, row);
+                    a.hx[row] = a.hz[row] = PlayerController::HALF_WIDTH;
+                    a.hy[row] = PlayerController::HEIGHT * 0.5f;
+                    a.color[row] = PLAYER_COLORS[spawns++ % PLAYER_COLOR_COUNT];
+                }
+            }
+            break;
+        case NET_PLAYER_INPUT:
+            // In sequence after the spawn, repeats skipped. Past the limit
+            // of a tick they only count as acknowledged: the next snapshot
+            // puts the client's player back where it is here.
+            valid = client.spawned && decodePlayerInputs(body, size, inputs);
+            for (const NetPlayerInput& input : inputs) {
+                if (input.sequence < client.nextInput)
+                    continue;
+                client.nextInput = input.sequence + 1;
+                if (applied++ < MAX_INPUTS_PER_TICK)
+                    stepNetPlayer(client.player, *world, input);
+            }
+            break;
+        default:
+            valid = false;
+            break;
+        }
+        if (!valid) {
+            std::cout << "Server: malformed message from a client, disconnecting it" << std::endl;
+            client.connection.close();
+            return;
+        }
+    }
+}
+
+void ChunkServer::tick()
+{
+    PROFILE_ZONE("Chunk server");
+    // New clients get the seed first (for anything they derive from it
+    // locally, such as distant terrain)
+    for (;;) {
+        std::unique_ptr<Client> client(new Client());
+        if (!listener.accept(client->connection))
+            break;
+        encodeHello(world->seed, client->connection.beginMessage(NET_HELLO, 8));
+        client->connection.endMessage();
+        if (freeSlots.empty()) {
+            client->slot = (uint32_t)slots.size();
+            slots.push_back(client.get());
+        }
+        else {
+            client->slot = freeSlots.back();
+            freeSlots.pop_back();
+            slots[client->slot] = client.get();
+        }
+        clients.push_back(std::move(client));
+        std::cout << "Server: client connected (" << clients.size() << " connected)" << std::endl;
+    }
+
+    for (std::unique_ptr<Client>& client : clients) {
+        client->connection.update();
+        receive(*client);
+    }
+    // Player boxes where the inputs took them
+    if (entities) {
+        for (std::unique_ptr<Client>& client : clients) {
+            if (client->entity == NO_ENTITY)
+                continue;
+            size_t row;
+            Archetype& a = entities->archetypeOf(client->entity, row);
+            a.px[row] = client->player.position.x;
+            a.py[row] = client->player.position.y + PlayerController::HEIGHT * 0.5;
+            a.pz[row] = client->player.position.z;
+        }
+    }
+
+    // This tick's changes (client edits above, anything else since the
+    // last tick) go to the clients holding their chunks: per cell, to the
+    // cell's subscribers. Chunks sent below already include them.
+    world->flushBlockEvents();
+    changeCells.clear();
+    for (const BlockChange& change : changes)
+        changeCells.add(interestCellOf(change.block), change);
+    changes.clear();
+    changeCells.sort();
+    changeCells.forEachCell([&](const glm::ivec2& cell, const CellBuckets<BlockChange>::Entry* entries, size_t count) {
+        const std::vector<InterestGrid::Subscription>* subscribers = interest.subscribers(cell);
+        if (!subscribers)
+            return;
+        for (const InterestGrid::Subscription& subscription : *subscribers) {
+            Client& client = *slots[subscription.subscriber];
+            for (size_t i = 0; i < count; i++) {
+                if (client.held.contains(packChunkCoord(chunkCoordOf(entries[i].item.block))))
+                    client.deltas.push_back(entries[i].item);
+            }
+        }
+    });
+
+    // Entities for the snapshots, bucketed once for every client
+    entityCells.clear();
+    if (entities) {
+        entities->forEach(COMPONENT_POSITION | COMPONENT_BOUNDS | COMPONENT_APPEARANCE, [&](const Archetype& a) {
+            for (size_t i = 0; i < a.size(); i++) {
+                glm::dvec3 position(a.px[i], a.py[i], a.pz[i]);
+                entityCells.add(interestCellOf(position), NetEntity{ a.entities[i], position, glm::vec3(a.hx[i], a.hy[i], a.hz[i]), a.color[i] });
+            }
+        });
+        entityCells.sort();
+    }
+
+    int loads = 0;
+    for (std::unique_ptr<Client>& client : clients) {
+        if (!client->deltas.empty()) {
+            encodeBlockChanges(client->deltas, client->connection.beginMessage(NET_BLOCK_DELTAS));
+            client->connection.endMessage();
+            client->deltas.clear();
+        }
+        // Requested chunks while the window has room; loading (or
+        // generating) the ones not loaded yet is the budgeted part
+        while (!client->wanted.empty() && client->connection.unsentBytes() < sendWindowBytes) {
+            Wanted next = client->wanted.front();
+            Chunk* chunk = world->getChunk(next.coord);
+            if (!chunk) {
+                if (loads == loadsPerTick)
+                    break;
+                chunk = world->loadChunk(next.coord);
+                loads++;
+            }
+            client->wanted.pop_front();
+            encodeChunkData(*chunk, next.sequence, payload, client->connection.beginMessage(NET_CHUNK_DATA));
+            client->connection.endMessage();
+            hold(*client, next.coord);
+        }
+        if (client->spawned)
+            sendSnapshot(*client, netClockSeconds());
+        uint64_t before = client->connection.bytesSent;
+        client->connection.update();
+        sentBytes += client->connection.bytesSent - before;
+    }
+
+    // Drop the clients that went away
+    for (size_t i = 0; i < clients.size(); ) {
+        if (clients[i]->connection.isOpen()) {
+            i++;
+            continue;
+        }
+        disconnect(*clients[i]);
+        clients[i] = std::move(clients.back());
+        clients.pop_back();
+        std::cout << "Server: client disconnected (" << clients.size() << " connected)" << std::endl;
+    }
+    world->releaseUnloaded();
+}
+
+void ChunkServer::sendSnapshot(Client& client, double now)
+{
+    snapshot.serverTime = now - startTime;
+    snapshot.inputAck = client.nextInput;
+    snapshot.hasPlayer = true;
+    snapshot.player.position = client.player.position;
+    snapshot.player.velocity = client.player.velocity;
+    snapshot.player.onGround = client.player.onGround;
+    snapshot.player.mode = client.player.mode;
+    snapshot.entities.clear();
+
+    if (entities) {
+        // The nearest ones within the radius, then in id order
+        typedef std::pair<double, NetEntity> Near;
+        nearEntities.clear();
+        glm::dvec3 center = client.player.position;
+        double radius2 = snapshotRadius * snapshotRadius;
+        glm::ivec2 cellMin = interestCellOf(center - snapshotRadius);
+        glm::ivec2 cellMax = interestCellOf(center + snapshotRadius);
+        for (int x = cellMin.x; x <= cellMax.x; x++) {
+            for (int z = cellMin.y; z <= cellMax.y; z++) {
+                size_t count = 0;
+                const CellBuckets<NetEntity>::Entry* entries = entityCells.find(glm::ivec2(x, z), count);
+                for (size_t i = 0; entries && i < count; i++) {
+                    const NetEntity& entity = entries[i].item;
+                    glm::dvec3 d = entity.position - center;
+                    double distance2 = glm::dot(d, d);
+                    if (distance2 > radius2 || entity.id == client.entity)
+                        continue;
+                    nearEntities.push_back(Near(distance2, entity));
+                }
+            }
+        }
+        if ((int)nearEntities.size() > maxSnapshotEntities) {
+            std::nth_element(nearEntities.begin(), nearEntities.begin() + maxSnapshotEntities, nearEntities.end(),
+                [](const Near& a, const Near& b) { return a.first < b.first; });
+            nearEntities.resize(maxSnapshotEntities);
+        }
+        std::sort(nearEntities.begin(), nearEntities.end(), [](const Near& a, const Near& b) { return a.second.id < b.second.id; });
+        for (const Near& n : nearEntities)
+            snapshot.entities.push_back(n.second);
+    }
+
+    size_t bytes = NET_SNAPSHOT_HEADER_BYTES + snapshot.entities.size() * NET_SNAPSHOT_ENTITY_BYTES;
+    encodeSnapshot(snapshot, client.connection.beginMessage(NET_SNAPSHOT, bytes));
+    client.connection.endMessage();
+}
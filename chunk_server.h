@@ -0,0 +1,116 @@
+#pragma once
+
+#include "chunk_hash_map.h"
+#include "entity_store.h"
+#include "interest_grid.h"
+#include "net_connection.h"
+#include "net_protocol.h"
+#include "player_controller.h"
+#include "world.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Server side of chunk streaming: owns the world and streams it to any
+// number of clients. A client asks for the chunks it wants, in its own
+// priority order, and receives each one palette-encoded and LZ4-compressed,
+// never more than a send window ahead of what its socket has taken. From
+// then on only changes go out: every block change in a chunk the client
+// holds is batched into one delta message per client per tick, grouped by
+// chunk and delta-coded. Once a client is streamed in, its bandwidth
+// follows the edit rate, not the size of the world.
+//
+// Chunks stay loaded while any client holds them (or is waiting for them)
+// and are unloaded, saved if they changed, when the last one lets go.
+// Clients' edits are applied to the world and come back to every holder,
+// the sender included, with the next deltas.
+//
+// Each client's player is moved here by the inputs it sends, with the
+// physics the client predicts with. Every tick each spawned client gets a
+// snapshot: where its player is after the inputs applied so far, and the
+// entities within snapshotRadius of it, the other players among them.
+//
+// Neither kind of update looks at every client or every entity per
+// client: a tick's block changes and entities are each bucketed once by
+// interest cell. A client is subscribed to the cells of the chunks it
+// holds, so a cell's changes go only to its subscribers, and a snapshot
+// reads just the cells within its radius. Cost follows what each client
+// can see rather than players times entities.
+struct ChunkServer {
+    // Listen on 'port' for clients of 'world'; the server sets the world's
+    // change log
+    bool start(World& world, int port);
+    void stop();
+
+    // Accept new clients, apply what they sent, then send each client its
+    // deltas, as many requested chunks as its window allows and a snapshot
+    void tick();
+
+    int clientCount() const { return (int)clients.size(); }
+    // Bytes sent to every client since start()
+    uint64_t bytesSent() const { return sentBytes; }
+
+    // Requested chunks are only queued on a connection while fewer bytes
+    // than this are waiting to be sent on it
+    size_t sendWindowBytes = 256 * 1024;
+    // Chunks loaded or generated per tick, over every client
+    int loadsPerTick = 64;
+    // Optional entities (not owned): players are boxes in it, blocks the
+    // clients break drop items into it and snapshots carry the ones near
+    // each player
+    EntityStore* entities = nullptr;
+    double snapshotRadius = 96.0;       // Blocks
+    int maxSnapshotEntities = 256;      // The nearest ones
+
+private:
+    struct Wanted {
+        glm::ivec3 coord;
+        uint32_t sequence;          // Position among all the coordinates the client requested
+    };
+    struct Client {
+        NetConnection connection;
+        std::deque<Wanted> wanted;  // Requested, not sent yet, in the client's order
+        uint32_t requested = 0;     // Coordinates requested so far
+        // Chunks sent and not released: index into 'heldCoords' by packed coordinate
+        ChunkHashMap<uint32_t> held;
+        std::vector<glm::ivec3> heldCoords;
+        std::vector<BlockChange> deltas;    // Waiting for this tick's batch
+        PlayerController player;
+        bool spawned = false;
+        uint32_t nextInput = 0;     // Sequence of the next input to apply
+        EntityId entity = NO_ENTITY;        // Its box in 'entities'
+        uint32_t slot = 0;          // Index into 'slots', its interest subscriber
+    };
+
+    void receive(Client& client);
+    void hold(Client& client, const glm::ivec3& coord);
+    void release(Client& client, const glm::ivec3& coord);
+    // One fewer holder (or waiting client) of a chunk; unloaded at none
+    void unreference(const glm::ivec3& coord);
+    void disconnect(Client& client);
+    void sendSnapshot(Client& client, double now);
+
+    World* world = nullptr;
+    NetListener listener;
+    std::vector<std::unique_ptr<Client>> clients;
+    ChunkHashMap<int> references;       // Clients holding or waiting for each chunk
+    std::vector<Client*> slots;         // By Client::slot; nullptr when free
+    std::vector<uint32_t> freeSlots;
+    InterestGrid interest;              // Cells of the chunks each client holds
+    CellBuckets<BlockChange> changeCells;   // This tick's changes
+    CellBuckets<NetEntity> entityCells;     // This tick's entities with a box
+    std::vector<BlockChange> changes;   // World change log, drained every tick
+    // Reused every tick, so sending allocates nothing once warmed up
+    std::vector<uint8_t> payload;       // A chunk's uncompressed payload
+    NetSnapshot snapshot;
+    std::vector<std::pair<double, NetEntity>> nearEntities;    // By squared distance
+    uint64_t sentBytes = 0;
+    double startTime = 0.0;             // netClockSeconds() at start(); snapshot times count from it
+    uint32_t drops = 0;                 // Dropped items so far, varying their toss
+    uint32_t spawns = 0;                // Players spawned so far, picking their colour
+};
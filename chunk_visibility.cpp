@@ -0,0 +1,50 @@
+#include "chunk_visibility.h"
+
+FaceVisibility computeFaceVisibility(const ChunkVoxels& voxels)
+{
+    uint64_t visited[CHUNK_VOLUME / 64] = {};
+    uint16_t stack[CHUNK_VOLUME];
+    FaceVisibility visibility = 0;
+
+    for (int start = 0; start < CHUNK_VOLUME; start++) {
+        if (isOpaque(voxels.blocks[start]) || (visited[start >> 6] & (1ull << (start & 63))))
+            continue;
+
+        // Collect the faces touched by this air region
+        int faces = 0;
+        int top = 0;
+        stack[top++] = (uint16_t)start;
+        visited[start >> 6] |= 1ull << (start & 63);
+        while (top > 0) {
+            int index = stack[--top];
+            glm::ivec3 pos = chunkIndexPosition(index);
+            int x = pos.x, y = pos.y, z = pos.z;
+            if (x == 0) faces |= 1 << 0;
+            if (x == CHUNK_SIZE - 1) faces |= 1 << 1;
+            if (y == 0) faces |= 1 << 2;
+            if (y == CHUNK_SIZE - 1) faces |= 1 << 3;
+            if (z == 0) faces |= 1 << 4;
+            if (z == CHUNK_SIZE - 1) faces |= 1 << 5;
+
+            for (int face = 0; face < 6; face++) {
+                const int* n = FACE_NORMALS[face];
+                int nx = x + n[0], ny = y + n[1], nz = z + n[2];
+                if (nx < 0 || nx >= CHUNK_SIZE || ny < 0 || ny >= CHUNK_SIZE || nz < 0 || nz >= CHUNK_SIZE)
+                    continue;
+                int next = chunkIndex(nx, ny, nz);
+                if (isOpaque(voxels.blocks[next]) || (visited[next >> 6] & (1ull << (next & 63))))
+                    continue;
+                visited[next >> 6] |= 1ull << (next & 63);
+                stack[top++] = (uint16_t)next;
+            }
+        }
+
+        for (int a = 0; a < 6; a++)
+            for (int b = a + 1; b < 6; b++)
+                if ((faces & (1 << a)) && (faces & (1 << b)))
+                    visibility |= facePairBit(a, b);
+        if (visibility == FACE_VISIBILITY_ALL)
+            break;
+    }
+    return visibility;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <cstdint>
+
+// Which pairs of a chunk's six faces are connected through air (or
+// translucent blocks) inside the chunk: one bit per unordered face pair, 15
+// in total. Rendering walks this graph from the camera's chunk, so chunks
+// only reachable through solid rock (the inside of the terrain) are never
+// drawn.
+typedef uint16_t FaceVisibility;
+
+// Every face sees every other, e.g. an all-air chunk
+const FaceVisibility FACE_VISIBILITY_ALL = 0x7FFF;
+
+// Connectivity of a chunk of one block type: closed if opaque, else open
+inline FaceVisibility uniformFaceVisibility(BlockId id)
+{
+    return isOpaque(id) ? 0 : FACE_VISIBILITY_ALL;
+}
+
+// Bit of the face pair (a, b), a != b
+inline FaceVisibility facePairBit(int a, int b)
+{
+    if (a > b) {
+        int t = a;
+        a = b;
+        b = t;
+    }
+    return (FaceVisibility)(1u << (a * (11 - a) / 2 + b - a - 1));
+}
+
+inline bool facesConnected(FaceVisibility visibility, int a, int b)
+{
+    return (visibility & facePairBit(a, b)) != 0;
+}
+
+// Flood fill the see-through voxels of a chunk snapshot and record which
+// faces each connected region touches (neighbour borders are not consulted)
+FaceVisibility computeFaceVisibility(const ChunkVoxels& voxels);
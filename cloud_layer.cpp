@@ -0,0 +1,250 @@
+#include "cloud_layer.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Blocks across a cell of the coarsest octave, and cells before the noise
+// repeats; the wind's drift is kept within that period
+const double CLOUD_CELL = 96.0;
+const int CLOUD_PERIOD_CELLS = 256;
+const double CLOUD_PERIOD = CLOUD_CELL * CLOUD_PERIOD_CELLS;
+// Beyond this distance along the layer it has faded out into the horizon
+const float CLOUD_FADE_DISTANCE = 3000.0f;
+
+static const char* cloudVertexSource = R"(
+#version 330 core
+out vec2 ndc;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    ndc = corner * 2.0 - 1.0;
+    gl_Position = vec4(ndc, 0.0, 1.0);
+}
+)";
+
+static const char* cloudFragmentSource = R"(
+#version 330 core
+in vec2 ndc;
+out vec4 FragColor;
+
+uniform mat4 inverseViewProj;   // Camera-relative, this frame
+uniform mat4 lastViewProj;      // Camera-relative, the history's
+uniform vec3 historyOffset;     // Added to a point relative to this eye: relative to the history's, in the drifted layer
+uniform bool historyValid;
+uniform sampler2D history;
+uniform vec2 noiseOrigin;       // Layer coordinate under the eye, in cells
+uniform float layerHeight;      // Above the eye; negative below it
+uniform int phase;              // Texel of each 2x2 block evaluated this frame
+uniform vec2 jitter;            // Of the evaluated point within its texel, in NDC
+uniform vec3 litColor;
+uniform vec3 shadeColor;
+uniform float fadeDistance;
+
+const float CELL = CELL_BLOCKS;
+const int PERIOD = PERIOD_CELLS;
+
+float hash(ivec2 cell, int period)
+{
+    // GLSL leaves % of negative numbers undefined
+    cell -= period * ivec2(floor(vec2(cell) / float(period)));
+    uint h = uint(cell.x) * 0x8DA6B343u ^ uint(cell.y) * 0xD8163841u;
+    h = (h ^ (h >> 15)) * 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return float(h & 0xFFFFu) / 65535.0;
+}
+
+float valueNoise(vec2 x, int period)
+{
+    ivec2 cell = ivec2(floor(x));
+    vec2 f = fract(x);
+    f = f * f * (3.0 - 2.0 * f);
+    return mix(mix(hash(cell, period), hash(cell + ivec2(1, 0), period), f.x),
+               mix(hash(cell + ivec2(0, 1), period), hash(cell + ivec2(1, 1), period), f.x), f.y);
+}
+
+// Where 'ndc' meets the layer, relative to the eye; false if it never does
+bool hitLayer(vec2 at, out vec3 point)
+{
+    vec4 farPoint = inverseViewProj * vec4(at, 1.0, 1.0);
+    vec3 rd = normalize(farPoint.xyz / farPoint.w);
+    if (rd.y * layerHeight <= 0.0)
+        return false;
+    point = rd * (layerHeight / rd.y);
+    return true;
+}
+
+vec4 shade(vec3 point)
+{
+    // Octaves at twice the frequency tile at twice the cells
+    vec2 x = noiseOrigin + point.xz / CELL;
+    float density = 0.0;
+    float amplitude = 0.5;
+    int period = PERIOD;
+    for (int octave = 0; octave < 4; octave++) {
+        density += valueNoise(x, period) * amplitude;
+        x *= 2.0;
+        period *= 2;
+        amplitude *= 0.5;
+    }
+    float coverage = smoothstep(0.48, 0.68, density);
+    coverage *= 1.0 - smoothstep(fadeDistance * 0.3, fadeDistance, length(point.xz));
+    // Thicker cloud is darker underneath
+    vec3 color = mix(litColor, shadeColor, smoothstep(0.55, 0.85, density));
+    return vec4(color * coverage, coverage);
+}
+
+void main()
+{
+    vec3 point;
+    if (!hitLayer(ndc, point)) {
+        FragColor = vec4(0.0);
+        return;
+    }
+
+    // The same spot of the layer in the last frame's texture
+    vec4 last = vec4(0.0);
+    bool reprojected = false;
+    if (historyValid) {
+        vec4 clip = lastViewProj * vec4(point + historyOffset, 1.0);
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+        reprojected = clip.w > 0.0 && all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)));
+        if (reprojected)
+            last = texture(history, uv);
+    }
+
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    bool evaluate = (texel.x & 1) + 2 * (texel.y & 1) == phase;
+    if (!evaluate && reprojected) {
+        FragColor = last;
+        return;
+    }
+    vec3 jittered;
+    if (!hitLayer(ndc + jitter, jittered))
+        jittered = point;
+    vec4 fresh = shade(jittered);
+    FragColor = reprojected ? mix(last, fresh, 0.5) : fresh;
+}
+)";
+
+void CloudLayer::init()
+{
+    std::string source = cloudFragmentSource;
+    std::string defines = "#version 330 core\n#define CELL_BLOCKS " + std::to_string(CLOUD_CELL) +
+        "\n#define PERIOD_CELLS " + std::to_string(CLOUD_PERIOD_CELLS) + "\n";
+    source.replace(source.find("#version 330 core\n"), 18, defines);
+    program.create(cloudVertexSource, source.c_str());
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+void CloudLayer::destroy()
+{
+    if (emptyVAO == 0)
+        return;
+    destroyTargets();
+    program.destroy();
+    glState().deleteVertexArrays(1, &emptyVAO);
+    emptyVAO = 0;
+}
+
+void CloudLayer::createTargets(int w, int h)
+{
+    width = w;
+    height = h;
+    glGenTextures(2, textures);
+    glGenFramebuffers(2, framebuffers);
+    for (int i = 0; i < 2; i++) {
+        glState().bindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+    }
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    historyValid = false;
+}
+
+void CloudLayer::destroyTargets()
+{
+    glState().deleteFramebuffers(2, framebuffers);
+    glState().deleteTextures(2, textures);
+    framebuffers[0] = framebuffers[1] = 0;
+    textures[0] = textures[1] = 0;
+    width = height = 0;
+}
+
+int CloudLayer::update(const glm::mat4& viewProj, const glm::dvec3& eye, const SkyColors& colors, float seconds,
+    int sceneWidth, int sceneHeight, int unit)
+{
+    int w = std::max((sceneWidth + DOWNSCALE - 1) / DOWNSCALE, 1);
+    int h = std::max((sceneHeight + DOWNSCALE - 1) / DOWNSCALE, 1);
+    if (w != width || h != height) {
+        destroyTargets();
+        createTargets(w, h);
+    }
+
+    drift += glm::dvec2(wind) * (double)seconds;
+    drift -= glm::floor(drift / CLOUD_PERIOD) * CLOUD_PERIOD;
+    // How far the layer moved under the eye since the history, the wrap taken out
+    glm::dvec2 moved = glm::dvec2(eye.x - lastEye.x, eye.z - lastEye.z) + drift - lastDrift;
+    moved -= glm::round(moved / CLOUD_PERIOD) * CLOUD_PERIOD;
+    glm::dvec2 origin = glm::dvec2(eye.x, eye.z) + drift;
+    origin = (origin - glm::floor(origin / CLOUD_PERIOD) * CLOUD_PERIOD) / CLOUD_CELL;
+
+    // A different point of each texel every time it comes round
+    int phase = (int)(frameIndex & 3);
+    float visit = (float)((frameIndex >> 2) & 1023);
+    glm::vec2 jitter = (glm::vec2(std::fmod(visit * 0.618034f, 1.0f), std::fmod(visit * 0.381966f, 1.0f)) - 0.5f) *
+        glm::vec2(2.0f / w, 2.0f / h);
+
+    int target = 1 - current;
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffers[target]);
+    glViewport(0, 0, w, h);
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().disable(GL_DEPTH_TEST);
+
+    program.use();
+    glm::mat4 inverse = glm::inverse(viewProj);
+    glUniformMatrix4fv(program.uniform("inverseViewProj"), 1, GL_FALSE, &inverse[0][0]);
+    glUniformMatrix4fv(program.uniform("lastViewProj"), 1, GL_FALSE, &lastViewProj[0][0]);
+    glUniform3f(program.uniform("historyOffset"), (float)moved.x, (float)(eye.y - lastEye.y), (float)moved.y);
+    glUniform1i(program.uniform("historyValid"), historyValid ? 1 : 0);
+    glUniform1i(program.uniform("history"), unit);
+    glUniform2f(program.uniform("noiseOrigin"), (float)origin.x, (float)origin.y);
+    glUniform1f(program.uniform("layerHeight"), (float)(CLOUD_HEIGHT - eye.y));
+    glUniform1i(program.uniform("phase"), phase);
+    glUniform2f(program.uniform("jitter"), jitter.x, jitter.y);
+    // Sunlit above the horizon colour; the undersides of thick cloud in shade
+    glm::vec3 lit = colors.sun * 0.75f + colors.horizon * 0.45f;
+    glUniform3f(program.uniform("litColor"), lit.r, lit.g, lit.b);
+    glm::vec3 shade = glm::mix(lit, colors.zenith, 0.5f) * 0.75f;
+    glUniform3f(program.uniform("shadeColor"), shade.r, shade.g, shade.b);
+    glUniform1f(program.uniform("fadeDistance"), CLOUD_FADE_DISTANCE);
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    glState().bindTexture(GL_TEXTURE_2D, textures[current]);
+    glState().bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+    glState().activeTexture(GL_TEXTURE0);
+
+    glState().enable(GL_DEPTH_TEST);
+    glState().polygonMode(polygonMode);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    current = target;
+    historyValid = true;
+    frameIndex++;
+    lastViewProj = viewProj;
+    lastEye = eye;
+    lastDrift = drift;
+    return 1;
+}
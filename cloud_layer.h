@@ -0,0 +1,57 @@
+#pragma once
+
+#include "procedural_sky.h"
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+// Height of the layer, above the highest block
+const float CLOUD_HEIGHT = 288.0f;
+
+// A flat layer of clouds drifting on the wind, for ProceduralSky to blend
+// over the sky. The layer is a few octaves of tiling value noise on a plane
+// above the world, drawn into a texture of a quarter of the scene's width
+// and height that follows the view. Each frame evaluates the noise for one
+// texel of every 2x2 block, at a jittered point within it, and blends it
+// into what that texel showed before; the other three reproject the last
+// frame's texture (the plane is known, so the point it saw is found through
+// the camera and the wind that moved since). Noise is evaluated for 1 in 64
+// scene pixels a frame, and anything uncovered by the view turning is filled
+// at once.
+struct CloudLayer {
+    static const int DOWNSCALE = 4;             // Scene pixels across a texel
+    glm::vec2 wind = glm::vec2(4.0f, 1.5f);     // Blocks per second along x and z
+
+    void init();
+    void destroy();
+
+    // Draw this frame's layer for a 'sceneWidth' x 'sceneHeight' scene seen
+    // through 'viewProj' (camera-relative, unjittered) from 'eye',
+    // 'seconds' after the last, sampling the last through texture 'unit'.
+    // Leaves the window's framebuffer bound. Returns the draw calls (one).
+    int update(const glm::mat4& viewProj, const glm::dvec3& eye, const SkyColors& colors, float seconds,
+        int sceneWidth, int sceneHeight, int unit);
+    // Start over without history, after frames the layer wasn't drawn
+    void invalidate() { historyValid = false; }
+
+    // The texture update() drew last, premultiplied by coverage
+    unsigned int texture() const { return textures[current]; }
+
+private:
+    void createTargets(int width, int height);
+    void destroyTargets();
+
+    ShaderProgram program;
+    unsigned int emptyVAO = 0;      // Fullscreen triangle from gl_VertexID
+    unsigned int framebuffers[2] = { 0, 0 };
+    unsigned int textures[2] = { 0, 0 };    // RGBA8, drawn into in turn
+    int current = 0;
+    int width = 0;
+    int height = 0;
+    bool historyValid = false;
+    unsigned int frameIndex = 0;
+    glm::dvec2 drift = glm::dvec2(0.0);     // Wind travelled, wrapped to the noise's period
+    glm::mat4 lastViewProj = glm::mat4(1.0f);
+    glm::dvec3 lastEye = glm::dvec3(0.0);
+    glm::dvec2 lastDrift = glm::dvec2(0.0);
+};
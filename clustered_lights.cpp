@@ -0,0 +1,246 @@
+#include "clustered_lights.h"
+#include "chunk_renderer.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "shader.h"
+#include "simd_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Block light is warmer than daylight (as in the chunk vertex shader)
+const glm::vec3 LAMP_TINT(1.0f, 0.85f, 0.6f);
+// Brightness of a full-emission light at its centre, before falloff
+const float LAMP_INTENSITY = 1.5f;
+
+// Grid constants below must match CLUSTER_TILES_X, CLUSTER_TILES_Y and CLUSTER_SLICES
+static_assert(CLUSTER_TILES_X == 16 && CLUSTER_TILES_Y == 9 && CLUSTER_SLICES == 24, "update clusteredLightsSource");
+static const char* CLUSTERED_LIGHTS_SOURCE = R"(
+    uniform samplerBuffer pointLights;      // Two texels per light: position relative to the eye and radius, colour
+    uniform usamplerBuffer lightClusters;   // First index and count per cluster
+    uniform usamplerBuffer lightIndices;
+    uniform vec4 clusterGrid;               // Tiles per pixel in x and y, depth slice scale and bias; 0 without lights
+
+    // Diffuse light of the lamps whose clusters hold the fragment at
+    // 'position' (relative to the eye, 'depth' along the view direction)
+    vec3 pointLighting(vec3 position, vec3 normal, float depth)
+    {
+        if (clusterGrid.x == 0.0)
+            return vec3(0.0);
+        ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterGrid.xy), ivec2(15, 8));
+        int slice = clamp(int(log(depth) * clusterGrid.z + clusterGrid.w), 0, 23);
+        uvec2 range = texelFetch(lightClusters, (slice * 9 + tile.y) * 16 + tile.x).rg;
+
+        vec3 sum = vec3(0.0);
+        for (uint i = 0u; i < range.y; i++) {
+            int light = int(texelFetch(lightIndices, int(range.x + i)).r) * 2;
+            vec4 sphere = texelFetch(pointLights, light);
+            vec3 toLight = sphere.xyz - position;
+            float d2 = dot(toLight, toLight);
+            // Smooth window to zero at the radius, so clusters need not overlap exactly
+            float falloff = max(1.0 - d2 / (sphere.w * sphere.w), 0.0);
+            float facing = max(dot(normal, toLight * inversesqrt(max(d2, 1e-4))), 0.0);
+            sum += texelFetch(pointLights, light + 1).rgb * (falloff * falloff * facing);
+        }
+        return sum;
+    }
+)";
+
+const char* clusteredLightsSource()
+{
+    return CLUSTERED_LIGHTS_SOURCE;
+}
+
+void ClusteredLights::init(int firstUnit)
+{
+    static const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+    for (int i = 0; i < 3; i++) {
+        glState().bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        glState().activeTexture(GL_TEXTURE0 + firstUnit + i);
+        glState().bindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+    glState().activeTexture(GL_TEXTURE0);
+    this->firstUnit = firstUnit;
+
+    lights.reserve(MAX_LIGHTS);
+    ranges.assign(CLUSTER_COUNT * 2, 0);
+    clear();
+}
+
+void ClusteredLights::destroy()
+{
+    if (buffers[0] == 0)
+        return;
+    glState().deleteTextures(3, textures);
+    glState().deleteBuffers(3, buffers);
+    for (int i = 0; i < 3; i++)
+        textures[i] = buffers[i] = 0;
+}
+
+void ClusteredLights::bindProgram(const ShaderProgram& program) const
+{
+    program.use();
+    glUniform1i(program.uniform("pointLights"), firstUnit);
+    glUniform1i(program.uniform("lightClusters"), firstUnit + 1);
+    glUniform1i(program.uniform("lightIndices"), firstUnit + 2);
+}
+
+void ClusteredLights::setUniforms(const ShaderProgram& program, int width, int height, bool enabled) const
+{
+    program.use();
+    if (!enabled || lightCount == 0 || width <= 0 || height <= 0)
+        glUniform4f(program.uniform("clusterGrid"), 0.0f, 0.0f, 0.0f, 0.0f);
+    else
+        glUniform4f(program.uniform("clusterGrid"), (float)CLUSTER_TILES_X / width, (float)CLUSTER_TILES_Y / height, sliceScale, sliceBias);
+}
+
+void ClusteredLights::clear()
+{
+    lights.clear();
+    indices.clear();
+    std::fill(ranges.begin(), ranges.end(), 0u);
+    lightCount = indexCount = 0;
+    upload();
+}
+
+int ClusteredLights::update(const ChunkRenderer& renderer, const glm::dvec3& eye, const glm::mat4& view, const glm::mat4& projection)
+{
+    PROFILE_ZONE("Cluster lights");
+
+    // Emitters within reach of the eye; whole chunks out of reach are skipped
+    struct Candidate {
+        glm::vec3 position;     // Relative to the eye
+        float distance2;
+        float strength;
+    };
+    std::vector<Candidate> candidates;
+    float reach = lightDistance + radius;
+    for (const ChunkRenderData& data : renderer.chunks) {
+        if (data.emitters.empty())
+            continue;
+        glm::vec3 origin = data.chunk->relativeOrigin(eye);
+        glm::vec3 nearest = glm::clamp(glm::vec3(0.0f), origin, origin + glm::vec3((float)CHUNK_SIZE));
+        if (glm::dot(nearest, nearest) > reach * reach)
+            continue;
+        for (uint16_t emitter : data.emitters) {
+            glm::vec3 position = origin + glm::vec3(chunkIndexPosition(emitter & (CHUNK_VOLUME - 1))) + glm::vec3(0.5f);
+            float distance2 = glm::dot(position, position);
+            if (distance2 <= reach * reach)
+                candidates.push_back({ position, distance2, (emitter >> 12) / (float)MAX_LIGHT });
+        }
+    }
+    if ((int)candidates.size() > MAX_LIGHTS) {
+        std::nth_element(candidates.begin(), candidates.begin() + MAX_LIGHTS, candidates.end(),
+            [](const Candidate& a, const Candidate& b) { return a.distance2 < b.distance2; });
+        candidates.resize(MAX_LIGHTS);
+    }
+
+    // Depth slices from the near to the far plane, each a constant ratio
+    // deeper than the last (the planes come back out of the projection)
+    float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    sliceScale = CLUSTER_SLICES / std::log(farPlane / nearPlane);
+    sliceBias = -std::log(nearPlane) * sliceScale;
+    auto sliceOf = [&](float depth) {
+        return glm::clamp((int)std::floor(std::log(std::max(depth, nearPlane)) * sliceScale + sliceBias), 0, CLUSTER_SLICES - 1);
+    };
+    auto tileOf = [](float ndc, int tiles) {
+        return glm::clamp((int)std::floor((ndc * 0.5f + 0.5f) * tiles), 0, tiles - 1);
+    };
+
+    // View-space centres of every candidate, as one batch
+    size_t count = candidates.size();
+    std::vector<float> centers(count * 3);
+    float* centerX = centers.data();
+    float* centerY = centerX + count;
+    float* centerZ = centerY + count;
+    for (size_t l = 0; l < count; l++) {
+        centerX[l] = candidates[l].position.x;
+        centerY[l] = candidates[l].position.y;
+        centerZ[l] = candidates[l].position.z;
+    }
+    transformPoints(view, centerX, centerY, centerZ, count, centerX, centerY, centerZ, nullptr);
+
+    // Clusters each light's sphere may touch: the tiles its view-space box
+    // projects to (every corner in front of the near plane) and the slices
+    // its depth spans. Lights wholly outside the view are dropped here.
+    lights.clear();
+    boxes.clear();
+    std::fill(ranges.begin(), ranges.end(), 0u);
+    for (size_t l = 0; l < count; l++) {
+        const Candidate& candidate = candidates[l];
+        glm::vec3 center(centerX[l], centerY[l], centerZ[l]);
+        float depth = -center.z;
+        if (depth + radius < nearPlane || depth - radius > farPlane)
+            continue;
+        float depths[2] = { std::max(depth - radius, nearPlane), depth + radius };
+        glm::vec2 ndcMin(INFINITY), ndcMax(-INFINITY);
+        for (float d : depths) {
+            for (int corner = 0; corner < 4; corner++) {
+                glm::vec2 xy(center.x + ((corner & 1) ? radius : -radius), center.y + ((corner & 2) ? radius : -radius));
+                glm::vec2 ndc(projection[0][0] * xy.x / d, projection[1][1] * xy.y / d);
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+        }
+        if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+            continue;
+
+        ClusterBox box;
+        box.x0 = (uint8_t)tileOf(ndcMin.x, CLUSTER_TILES_X);
+        box.x1 = (uint8_t)tileOf(ndcMax.x, CLUSTER_TILES_X);
+        box.y0 = (uint8_t)tileOf(ndcMin.y, CLUSTER_TILES_Y);
+        box.y1 = (uint8_t)tileOf(ndcMax.y, CLUSTER_TILES_Y);
+        box.z0 = (uint8_t)sliceOf(depths[0]);
+        box.z1 = (uint8_t)sliceOf(depths[1]);
+        for (int z = box.z0; z <= box.z1; z++)
+            for (int y = box.y0; y <= box.y1; y++)
+                for (int x = box.x0; x <= box.x1; x++)
+                    ranges[((z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x) * 2 + 1]++;
+        boxes.push_back(box);
+        lights.push_back({ glm::vec4(candidate.position, radius), glm::vec4(LAMP_TINT * (LAMP_INTENSITY * candidate.strength), 0.0f) });
+    }
+
+    // Counts to first indices (a counting sort by cluster), cut off at
+    // MAX_INDICES; then each light is written into its clusters' ranges
+    uint32_t total = 0;
+    for (int c = 0; c < CLUSTER_COUNT; c++) {
+        uint32_t count = std::min(ranges[c * 2 + 1], (uint32_t)MAX_INDICES - total);
+        ranges[c * 2] = total;
+        ranges[c * 2 + 1] = count;
+        total += count;
+    }
+    indices.resize(total);
+    filled.assign(CLUSTER_COUNT, 0);
+    for (size_t l = 0; l < boxes.size(); l++) {
+        const ClusterBox& box = boxes[l];
+        for (int z = box.z0; z <= box.z1; z++)
+            for (int y = box.y0; y <= box.y1; y++)
+                for (int x = box.x0; x <= box.x1; x++) {
+                    int c = (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+                    if (filled[c] < ranges[c * 2 + 1])
+                        indices[ranges[c * 2] + filled[c]++] = (uint16_t)l;
+                }
+    }
+
+    lightCount = (int)lights.size();
+    indexCount = (int)total;
+    upload();
+    return lightCount;
+}
+
+void ClusteredLights::upload()
+{
+    // Orphaned every frame, so the driver never waits on last frame's reads
+    const void* data[3] = { lights.data(), ranges.data(), indices.data() };
+    size_t bytes[3] = { lights.size() * sizeof(PointLight), ranges.size() * sizeof(uint32_t), indices.size() * sizeof(uint16_t) };
+    for (int i = 0; i < 3; i++) {
+        glState().bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        if (bytes[i] > 0)
+            glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)bytes[i], data[i], GL_STREAM_DRAW);
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ChunkRenderer;
+struct ShaderProgram;
+
+// Light-emitting blocks (lamps) as point lights for forward shading,
+// binned per frame into a clustered grid: screen tiles split into depth
+// slices that grow exponentially with distance ("froxels"). Each cluster
+// lists the lights whose sphere reaches it, so a chunk fragment only loops
+// over the handful around it rather than every light in range. Built on
+// the CPU from the emitters ChunkRenderer keeps with each mesh; the shader
+// reads three texture buffers (lights, per-cluster ranges, light indices),
+// which GL 3.3 has, so no compute pass is needed.
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+struct ClusteredLights {
+    static const int MAX_LIGHTS = 1024;         // Nearest kept when more are in range
+    static const int MAX_INDICES = 65535;       // Light references over all clusters
+    float radius = 10.0f;                       // Reach of each light in blocks
+    float lightDistance = 96.0f;                // Lights farther from the eye are left out
+
+    // Lights and clusters after the last update()
+    int lightCount = 0;
+    int indexCount = 0;
+
+    // Create the texture buffers, bound to 'firstUnit' and the two after it
+    // for good
+    void init(int firstUnit);
+    void destroy();
+
+    // Point the programs' samplers at the units from init()
+    void bindProgram(const ShaderProgram& program) const;
+    // Set the per-frame grid uniform of a program: 'width' x 'height' target
+    // pixels and the depth slicing of update()'s projection; lights off
+    // (nothing read) when 'enabled' is false
+    void setUniforms(const ShaderProgram& program, int width, int height, bool enabled) const;
+
+    // Gather the emitters of every chunk near 'eye', keep those whose
+    // sphere touches the view and bin them into the clusters of
+    // 'projection' (perspective, camera-relative 'view'). Uploads the lights
+    // relative to the eye. Returns the lights kept.
+    int update(const ChunkRenderer& renderer, const glm::dvec3& eye, const glm::mat4& view, const glm::mat4& projection);
+    // Empty every cluster, for frames drawn without point lights
+    void clear();
+
+private:
+    // Clusters one light covers, inclusive
+    struct ClusterBox {
+        uint8_t x0, x1, y0, y1, z0, z1;
+    };
+    // Lights as two RGBA32F texels: position relative to the eye and
+    // radius, colour and intensity
+    struct PointLight {
+        glm::vec4 position;
+        glm::vec4 color;
+    };
+
+    void upload();
+
+    unsigned int buffers[3] = {};   // Lights, cluster ranges, light indices
+    unsigned int textures[3] = {};
+    int firstUnit = 0;
+    float sliceScale = 0.0f;        // slice = log(depth) * sliceScale + sliceBias
+    float sliceBias = 0.0f;
+
+    std::vector<PointLight> lights;
+    std::vector<ClusterBox> boxes;  // Per light
+    std::vector<uint32_t> ranges;   // First index and count per cluster
+    std::vector<uint16_t> indices;
+    std::vector<uint32_t> filled;   // Indices written per cluster so far
+};
+
+// GLSL for fragment shaders that read the clusters: the samplers and the
+// grid uniform, and 'vec3 pointLighting(vec3 position, vec3 normal, float
+// depth)' summing the lamps around a fragment. No #version line.
+const char* clusteredLightsSource();
@@ -0,0 +1,128 @@
+#include "console.h"
+
+#include <GLFW/glfw3.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+static_assert(Console::TOGGLE_KEY == GLFW_KEY_GRAVE_ACCENT, "the console opens with the grave accent key");
+
+bool Console::onKey(int key, int action)
+{
+    if (key == TOGGLE_KEY && action == GLFW_PRESS) {
+        text.open = !text.open;
+        return true;
+    }
+    if (!text.open || action == GLFW_RELEASE)
+        return false;
+
+    size_t length = strlen(text.input);
+    if (key == GLFW_KEY_ENTER || key == GLFW_KEY_KP_ENTER)
+        execute();
+    else if (key == GLFW_KEY_BACKSPACE && length > 0)
+        text.input[length - 1] = '\0';
+    else if (key == GLFW_KEY_ESCAPE)
+        text.open = false;
+    else if (key == GLFW_KEY_UP)
+        memcpy(text.input, previous, sizeof(previous));
+    return true;
+}
+
+void Console::onChar(unsigned int codepoint)
+{
+    // The HUD font covers ASCII; the toggle key's own character is dropped
+    if (!text.open || codepoint < 32 || codepoint > 126 || codepoint == '`')
+        return;
+    size_t length = strlen(text.input);
+    if (length + 1 < sizeof(text.input)) {
+        text.input[length] = (char)codepoint;
+        text.input[length + 1] = '\0';
+    }
+}
+
+void Console::print(const char* format, ...)
+{
+    if (text.lineCount == ConsoleText::LINES) {
+        memmove(text.lines[0], text.lines[1], sizeof(text.lines[0]) * (ConsoleText::LINES - 1));
+        text.lineCount--;
+    }
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text.lines[text.lineCount++], ConsoleText::LINE_CHARS, format, args);
+    va_end(args);
+}
+
+const Console::Command* Console::findCommand(const std::string& name) const
+{
+    for (const Command& command : commands) {
+        if (name == command.name)
+            return &command;
+    }
+    return nullptr;
+}
+
+void Console::execute()
+{
+    std::istringstream words(text.input);
+    std::string command, value;
+    words >> command >> value;
+    std::vector<std::string> args;
+    if (!value.empty())
+        args.push_back(value);
+    for (std::string word; words >> word;)
+        args.push_back(word);
+    if (!command.empty()) {
+        memcpy(previous, text.input, sizeof(previous));
+        print("> %s", text.input);
+    }
+    text.input[0] = '\0';
+    if (command.empty())
+        return;
+
+    if (command == "clear") {
+        text.lineCount = 0;
+    }
+    else if (command == "list") {
+        // One line each would scroll most of them away; several to a line
+        std::string line;
+        for (const CVar& var : cvars->vars) {
+            if (strncmp(var.name, value.c_str(), value.size()) != 0)
+                continue;
+            std::string entry = std::string(var.name) + " " + cvars->format(var) + "  ";
+            if (line.size() + entry.size() >= ConsoleText::LINE_CHARS) {
+                print("%s", line.c_str());
+                line.clear();
+            }
+            line += entry;
+        }
+        if (!line.empty())
+            print("%s", line.c_str());
+    }
+    else if (command == "save") {
+        if (configPath && cvars->saveFile(configPath))
+            print("Saved to %s", configPath);
+        else
+            print("Can't write %s", configPath ? configPath : "a config file");
+    }
+    else if (const Command* added = findCommand(command)) {
+        if (!added->run(args))
+            print("Usage: %s", added->usage);
+    }
+    else if (CVar* var = cvars->find(command.c_str())) {
+        std::string error;
+        if (value.empty())
+            print("%s %s: %s%s", var->name, cvars->format(*var).c_str(), var->help, var->live ? "" : " [start-up]");
+        else if (cvars->set(var->name, value.c_str(), error))
+            print("%s %s", var->name, cvars->format(*var).c_str());
+        else
+            print("%s", error.c_str());
+    }
+    else {
+        std::string names = "list, save, clear";
+        for (const Command& added : commands)
+            names += std::string(", ") + added.name;
+        print("Unknown cvar or command '%s' (%s)", command.c_str(), names.c_str());
+    }
+}
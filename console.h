@@ -0,0 +1,56 @@
+#pragma once
+
+#include "cvars.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// What the console shows, copied into each frame packet while it is open
+struct ConsoleText {
+    static const int LINES = 8;         // Output kept, newest last
+    static const int LINE_CHARS = 112;
+
+    bool open = false;
+    char input[LINE_CHARS] = {};
+    char lines[LINES][LINE_CHARS] = {};
+    int lineCount = 0;
+};
+
+// In-game console over the cvar registry, opened and closed with the key
+// left of 1 (grave accent). While it is open it takes key presses and typed
+// characters from the GLFW callbacks; releases still reach the action map,
+// so nothing stays held. Commands:
+//   <name>            show a cvar's value and help
+//   <name> <value>    set it (live cvars only)
+//   list [prefix]     every cvar and its value
+//   save              write every cvar to the config file
+//   clear             empty the output
+// and those added to 'commands'.
+struct Console {
+    static const int TOGGLE_KEY = 96;   // GLFW_KEY_GRAVE_ACCENT
+
+    // A command beyond the built-in ones, run with the words after its name
+    struct Command {
+        const char* name;
+        const char* usage;      // Printed when 'run' returns false (arguments it can't use)
+        std::function<bool(const std::vector<std::string>& args)> run;
+    };
+    std::vector<Command> commands;
+
+    CVarRegistry* cvars = nullptr;
+    const char* configPath = nullptr;   // Written by "save"
+    ConsoleText text;
+
+    // From the GLFW callbacks. onKey() returns true if it took the key.
+    bool onKey(int key, int action);
+    void onChar(unsigned int codepoint);
+
+    void print(const char* format, ...);
+
+private:
+    void execute();
+    const Command* findCommand(const std::string& name) const;
+
+    char previous[ConsoleText::LINE_CHARS] = {};    // Last command, recalled with Up
+};
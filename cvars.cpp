@@ -0,0 +1,187 @@
+#include "cvars.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+CVar& CVarRegistry::add(const char* name, const char* help, CVarType type, void* value, double minValue, double maxValue, bool live)
+{
+    CVar var;
+    var.name = name;
+    var.help = help;
+    var.type = type;
+    var.value = value;
+    var.minValue = minValue;
+    var.maxValue = maxValue;
+    var.live = live;
+    var.defaultValue = number(var);
+    vars.push_back(var);
+    return vars.back();
+}
+
+CVar& CVarRegistry::addBool(const char* name, bool* value, const char* help, bool live)
+{
+    return add(name, help, CVAR_BOOL, value, 0.0, 1.0, live);
+}
+
+CVar& CVarRegistry::addInt(const char* name, int* value, int minValue, int maxValue, const char* help, bool live)
+{
+    return add(name, help, CVAR_INT, value, minValue, maxValue, live);
+}
+
+CVar& CVarRegistry::addSize(const char* name, size_t* value, size_t minValue, size_t maxValue, const char* help, bool live)
+{
+    return add(name, help, CVAR_SIZE, value, (double)minValue, (double)maxValue, live);
+}
+
+CVar& CVarRegistry::addFloat(const char* name, float* value, float minValue, float maxValue, const char* help, bool live)
+{
+    return add(name, help, CVAR_FLOAT, value, minValue, maxValue, live);
+}
+
+CVar& CVarRegistry::addDouble(const char* name, double* value, double minValue, double maxValue, const char* help, bool live)
+{
+    return add(name, help, CVAR_DOUBLE, value, minValue, maxValue, live);
+}
+
+CVar* CVarRegistry::find(const char* name)
+{
+    for (CVar& var : vars) {
+        if (strcmp(var.name, name) == 0)
+            return &var;
+    }
+    return nullptr;
+}
+
+bool CVarRegistry::set(const char* name, const char* text, std::string& error)
+{
+    CVar* var = find(name);
+    if (!var) {
+        error = std::string("no cvar '") + name + "'";
+        return false;
+    }
+    if (locked && !var->live) {
+        error = std::string(name) + " is read at start-up; set it in the config file or with --set";
+        return false;
+    }
+
+    // Booleans as on/off, enums by name, or anything by number
+    int index = 0;
+    while (var->type == CVAR_ENUM && index < var->nameCount && strcmp(text, var->names[index]) != 0)
+        index++;
+    double number;
+    if (var->type == CVAR_BOOL && (strcmp(text, "on") == 0 || strcmp(text, "true") == 0))
+        number = 1.0;
+    else if (var->type == CVAR_BOOL && (strcmp(text, "off") == 0 || strcmp(text, "false") == 0))
+        number = 0.0;
+    else if (var->type == CVAR_ENUM && index < var->nameCount)
+        number = index;
+    else {
+        char* end;
+        number = strtod(text, &end);
+        if (end == text || *end != '\0') {
+            error = std::string("'") + text + "' isn't a value of " + name;
+            return false;
+        }
+    }
+    number = std::min(std::max(number, var->minValue), var->maxValue);
+
+    switch (var->type) {
+    case CVAR_BOOL: *(bool*)var->value = number != 0.0; break;
+    case CVAR_INT: *(int*)var->value = (int)number; break;
+    case CVAR_SIZE: *(size_t*)var->value = (size_t)number; break;
+    case CVAR_FLOAT: *(float*)var->value = (float)number; break;
+    case CVAR_DOUBLE: *(double*)var->value = number; break;
+    case CVAR_ENUM: *(int*)var->value = (int)number; break;
+    }
+    if (locked && var->changed)
+        var->changed();
+    return true;
+}
+
+bool CVarRegistry::setDefault(const char* name, const char* text)
+{
+    CVar* var = find(name);
+    std::string error;
+    if (!var || number(*var) != var->defaultValue || !set(name, text, error))
+        return false;
+    var->defaultValue = number(*var);
+    return true;
+}
+
+double CVarRegistry::number(const CVar& var) const
+{
+    switch (var.type) {
+    case CVAR_BOOL: return *(const bool*)var.value ? 1.0 : 0.0;
+    case CVAR_INT: return *(const int*)var.value;
+    case CVAR_SIZE: return (double)*(const size_t*)var.value;
+    case CVAR_FLOAT: return *(const float*)var.value;
+    case CVAR_DOUBLE: return *(const double*)var.value;
+    case CVAR_ENUM: return *(const int*)var.value;
+    }
+    return 0.0;
+}
+
+std::string CVarRegistry::format(const CVar& var) const
+{
+    char text[64];
+    switch (var.type) {
+    case CVAR_BOOL: return *(const bool*)var.value ? "on" : "off";
+    case CVAR_INT: snprintf(text, sizeof(text), "%d", *(const int*)var.value); break;
+    case CVAR_SIZE: snprintf(text, sizeof(text), "%zu", *(const size_t*)var.value); break;
+    case CVAR_FLOAT: snprintf(text, sizeof(text), "%g", *(const float*)var.value); break;
+    case CVAR_DOUBLE: snprintf(text, sizeof(text), "%g", *(const double*)var.value); break;
+    case CVAR_ENUM: {
+        int index = *(const int*)var.value;
+        return index >= 0 && index < var.nameCount ? var.names[index] : std::to_string(index);
+    }
+    }
+    return text;
+}
+
+bool CVarRegistry::loadFile(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.resize(comment);
+        std::istringstream fields(line);
+        std::string name, value;
+        if (!(fields >> name))
+            continue;
+        std::string error = "missing value";
+        if (!(fields >> value) || !set(name.c_str(), value.c_str(), error))
+            std::cout << "Config: " << path << ":" << lineNumber << ": " << error << std::endl;
+    }
+    return true;
+}
+
+bool CVarRegistry::saveFile(const char* path) const
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    for (const CVar& var : vars) {
+        file << var.name << " " << format(var) << "    # " << var.help;
+        if (var.type == CVAR_ENUM) {
+            file << " (";
+            for (int i = 0; i < var.nameCount; i++)
+                file << (i > 0 ? ", " : "") << var.names[i];
+            file << ")";
+        }
+        if (!var.live)
+            file << " [start-up]";
+        file << "\n";
+    }
+    return (bool)file;
+}
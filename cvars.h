@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum CVarType {
+    CVAR_BOOL,
+    CVAR_INT,
+    CVAR_SIZE,      // size_t
+    CVAR_FLOAT,
+    CVAR_DOUBLE,
+    CVAR_ENUM,      // An int-sized enum, spelt by name
+};
+
+// A tunable: one of the program's own variables, registered under a name.
+// Live variables are read where they are used, every frame or tick, so a
+// change takes effect at once; the others are read while starting up only.
+struct CVar {
+    const char* name;
+    const char* help;
+    CVarType type;
+    void* value;
+    double minValue = 0.0;          // Numbers are clamped to the range
+    double maxValue = 0.0;
+    const char* const* names = nullptr; // CVAR_ENUM: a name per value
+    int nameCount = 0;
+    bool live = true;
+    std::function<void()> changed;  // After a change once started (optional)
+    double defaultValue = 0.0;      // As registered, or as setDefault() last left it
+};
+
+// Every cvar, settable by name from a config file (one "name value" a
+// line, '#' starts a comment), the command line (--set <name> <value>) and
+// the console. The config file is read first so the command line
+// overrides it. Once lock() is called, variables that aren't live refuse
+// changes instead of silently doing nothing.
+struct CVarRegistry {
+    CVar& addBool(const char* name, bool* value, const char* help, bool live = true);
+    CVar& addInt(const char* name, int* value, int minValue, int maxValue, const char* help, bool live = true);
+    CVar& addSize(const char* name, size_t* value, size_t minValue, size_t maxValue, const char* help, bool live = true);
+    CVar& addFloat(const char* name, float* value, float minValue, float maxValue, const char* help, bool live = true);
+    CVar& addDouble(const char* name, double* value, double minValue, double maxValue, const char* help, bool live = true);
+    template <typename Enum>
+    CVar& addEnum(const char* name, Enum* value, const char* const* names, int nameCount, const char* help, bool live = true)
+    {
+        static_assert(sizeof(Enum) == sizeof(int), "enum cvars are stored as int");
+        CVar& var = add(name, help, CVAR_ENUM, value, 0.0, nameCount - 1.0, live);
+        var.names = names;
+        var.nameCount = nameCount;
+        return var;
+    }
+
+    CVar* find(const char* name);
+    // Parse 'text' into the named cvar. False with the reason in 'error'.
+    bool set(const char* name, const char* text, std::string& error);
+    // The value as set() reads it
+    std::string format(const CVar& var) const;
+    // set() only while the cvar still has its default value, which 'text'
+    // then becomes, so defaults chosen after the config file and the flags
+    // are read (quality tiers) don't override them. True if it was set.
+    bool setDefault(const char* name, const char* text);
+
+    // False if the file can't be opened; bad lines are reported and skipped
+    bool loadFile(const char* path);
+    // Every cvar with its value and help, in a form loadFile() reads back
+    bool saveFile(const char* path) const;
+
+    // Start-up is over: from now on only live cvars change
+    void lock() { locked = true; }
+
+    std::vector<CVar> vars;     // In registration order
+
+private:
+    CVar& add(const char* name, const char* help, CVarType type, void* value, double minValue, double maxValue, bool live);
+    double number(const CVar& var) const;
+
+    bool locked = false;
+};
@@ -0,0 +1,47 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Weight of each new reading in the smoothed frame time
+const double SMOOTHING = 0.25;
+
+bool DynamicResolution::update(double gpuMs)
+{
+    if (gpuMs <= 0.0)
+        return false;
+    if (skip > 0) {
+        skip--;
+        return false;
+    }
+    smoothedMs = smoothedMs == 0.0 ? gpuMs : smoothedMs + (gpuMs - smoothedMs) * SMOOTHING;
+
+    float target = scale;
+    if (smoothedMs > budgetMs)
+        target = scale * (float)std::sqrt(budgetMs / smoothedMs);
+    else if (smoothedMs < budgetMs * HEADROOM)
+        target = std::min(scale * (float)std::sqrt(budgetMs * HEADROOM / smoothedMs), scale + MAX_STEP_UP);
+
+    // Whole steps, rounded towards the cheaper side
+    float next = std::floor(target / SCALE_STEP + 0.001f) * SCALE_STEP;
+    next = std::max(minScale, std::min(maxScale, next));
+    if (std::fabs(next - scale) < SCALE_STEP * 0.5f)
+        return false;
+    scale = next;
+    smoothedMs = 0.0;
+    skip = settleFrames;
+    return true;
+}
+
+void DynamicResolution::reset()
+{
+    scale = maxScale;
+    smoothedMs = 0.0;
+    skip = settleFrames;
+}
+
+int DynamicResolution::scaled(int size) const
+{
+    // A minimised window stays at zero
+    return size > 0 ? std::max(1, (int)(size * scale + 0.5f)) : 0;
+}
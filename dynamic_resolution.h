@@ -0,0 +1,36 @@
+#pragma once
+
+// Scale of the scene's resolution, adjusted to hold the GPU frame time near
+// a budget. Frame time is taken as proportional to the pixels shaded, so
+// the scale moves by the square root of budget / measured time, in steps of
+// SCALE_STEP: down as soon as the smoothed time is over the budget, up only
+// once it is comfortably under (below HEADROOM of the budget), so it settles
+// instead of toggling between two steps.
+//
+// GPU times come from timer queries read back a few frames late, so after
+// every change the controller ignores 'settleFrames' readings, the frames
+// still rendered at the old scale.
+struct DynamicResolution {
+    static constexpr float SCALE_STEP = 0.05f;
+    static constexpr float HEADROOM = 0.8f;
+    static constexpr float MAX_STEP_UP = 0.1f;  // Per change; too far up costs a slow frame or more
+
+    float budgetMs = 15.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float scale = 1.0f;         // Of each framebuffer side
+    int settleFrames = 6;
+
+    // Feed the GPU time of the newest frame read back (0 when none yet).
+    // Returns true when the scale changed.
+    bool update(double gpuMs);
+    // Back to full resolution (scaling was turned off)
+    void reset();
+
+    // Scene pixels along a framebuffer side of 'size'
+    int scaled(int size) const;
+
+private:
+    double smoothedMs = 0.0;    // 0 = no readings since the last change
+    int skip = 0;               // Readings still from before the last change
+};
@@ -0,0 +1,170 @@
+#include "edit_history.h"
+#include "world.h"
+
+#include <cstring>
+
+// Run-length encoding of voxel bytes. A header byte below 128 starts a
+// literal of header + 1 bytes; from 128 up it repeats the following byte
+// header - 126 times (2 to 129).
+const int MAX_LITERAL = 128;
+const int MAX_REPEAT = 129;
+
+static void encodeRuns(const uint8_t* data, int size, std::vector<uint8_t>& out)
+{
+    out.clear();
+    int i = 0;
+    while (i < size) {
+        int repeat = 1;
+        while (i + repeat < size && repeat < MAX_REPEAT && data[i + repeat] == data[i])
+            repeat++;
+        if (repeat >= 2) {
+            out.push_back((uint8_t)(repeat + 126));
+            out.push_back(data[i]);
+            i += repeat;
+            continue;
+        }
+        // Literal up to where the next repeat starts
+        int start = i;
+        while (i < size && i - start < MAX_LITERAL && !(i + 1 < size && data[i + 1] == data[i]))
+            i++;
+        out.push_back((uint8_t)(i - start - 1));
+        out.insert(out.end(), data + start, data + i);
+    }
+}
+
+// XOR the decoded runs into 'data'. False if they don't cover exactly 'size' bytes.
+static bool xorRuns(const std::vector<uint8_t>& runs, uint8_t* data, int size)
+{
+    int i = 0;
+    size_t r = 0;
+    while (r < runs.size()) {
+        int header = runs[r++];
+        if (header >= MAX_LITERAL) {
+            int repeat = header - 126;
+            if (r >= runs.size() || i + repeat > size)
+                return false;
+            uint8_t value = runs[r++];
+            if (value != 0)
+                for (int k = 0; k < repeat; k++)
+                    data[i + k] ^= value;
+            i += repeat;
+        }
+        else {
+            int literal = header + 1;
+            if (r + literal > runs.size() || i + literal > size)
+                return false;
+            for (int k = 0; k < literal; k++)
+                data[i + k] ^= runs[r + k];
+            r += literal;
+            i += literal;
+        }
+    }
+    return i == size;
+}
+
+void EditHistory::begin(const World& world, const glm::ivec3& boxMin, const glm::ivec3& boxMax)
+{
+    recording.clear();
+    if (glm::any(glm::lessThanEqual(boxMax, boxMin)))
+        return;
+    glm::ivec3 first = chunkCoordOf(boxMin);
+    glm::ivec3 last = chunkCoordOf(boxMax - 1);
+    for (int x = first.x; x <= last.x; x++)
+        for (int y = first.y; y <= last.y; y++)
+            for (int z = first.z; z <= last.z; z++)
+                if (const Chunk* chunk = world.getChunk(glm::ivec3(x, y, z)))
+                    recording.push_back({ chunk->coord, chunk->blocks });
+}
+
+bool EditHistory::end(const World& world)
+{
+    Step step;
+    BlockId before[CHUNK_VOLUME];
+    BlockId after[CHUNK_VOLUME];
+    for (const Recorded& recorded : recording) {
+        const Chunk* chunk = world.getChunk(recorded.coord);
+        if (!chunk)
+            continue; // Unloaded during the edit: saved as it was left
+        recorded.blocks.decode(before);
+        chunk->blocks.decode(after);
+        bool changed = false;
+        for (int i = 0; i < CHUNK_VOLUME; i++) {
+            before[i] ^= after[i];
+            changed = changed || before[i] != 0;
+        }
+        if (!changed)
+            continue;
+        ChunkDelta delta;
+        delta.coord = recorded.coord;
+        encodeRuns(before, CHUNK_VOLUME, delta.runs);
+        delta.runs.shrink_to_fit();
+        step.bytes += sizeof(ChunkDelta) + delta.runs.size();
+        step.chunks.push_back(std::move(delta));
+    }
+    recording.clear();
+    if (step.chunks.empty())
+        return false;
+
+    // A new edit ends the redo branch
+    while (steps.size() > applied) {
+        used -= steps.back().bytes;
+        steps.pop_back();
+    }
+    used += step.bytes;
+    steps.push_back(std::move(step));
+    applied++;
+    while (used > budgetBytes && !steps.empty()) {
+        used -= steps.front().bytes;
+        steps.pop_front();
+        applied--;
+    }
+    return !steps.empty();
+}
+
+bool EditHistory::undo(World& world)
+{
+    if (!canUndo() || !apply(world, steps[applied - 1]))
+        return false;
+    applied--;
+    return true;
+}
+
+bool EditHistory::redo(World& world)
+{
+    if (!canRedo() || !apply(world, steps[applied]))
+        return false;
+    applied++;
+    return true;
+}
+
+void EditHistory::clear()
+{
+    steps.clear();
+    applied = 0;
+    used = 0;
+    recording.clear();
+}
+
+bool EditHistory::apply(World& world, const Step& step)
+{
+    // All or nothing: a half-applied step would leave the rest out of step
+    for (const ChunkDelta& delta : step.chunks)
+        if (!world.getChunk(delta.coord))
+            return false;
+
+    BlockRegion region;
+    region.size = glm::ivec3(CHUNK_SIZE); // Indexed as chunkIndex() is
+    region.blocks.resize(CHUNK_VOLUME);
+    BlockId current[CHUNK_VOLUME];
+    for (const ChunkDelta& delta : step.chunks) {
+        world.getChunk(delta.coord)->blocks.decode(current);
+        memcpy(region.blocks.data(), current, sizeof(current));
+        if (!xorRuns(delta.runs, region.blocks.data(), CHUNK_VOLUME))
+            continue;
+        for (int i = 0; i < CHUNK_VOLUME; i++)
+            if (region.blocks[i] >= BLOCK_TYPE_COUNT)
+                region.blocks[i] = current[i];
+        world.pasteRegion(region, delta.coord * CHUNK_SIZE);
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct World;
+
+// Undo and redo of world edits for tools. An edit is recorded between
+// begin() and end(): begin() keeps the paletted blocks of the loaded chunks
+// the edit's box overlaps (cheap: a uniform chunk is one byte), end() XORs
+// each against its chunk afterwards and keeps the run-length encoded
+// result for the chunks that changed. Unchanged voxels XOR to long runs of
+// zeros and a filled area to runs of one value, so a step costs a few
+// bytes per chunk rather than a copy of it. XOR works both ways: undo and
+// redo apply the same delta, through World::pasteRegion().
+//
+// The steps live in a ring bounded by budgetBytes, the oldest dropped
+// first; recording a new edit drops the steps that were undone. Deltas
+// assume the chunks are as the step left them: a voxel changed since
+// (water flowing, another player) comes back wrong, and one that would
+// come back as no valid block is left as it is.
+struct EditHistory {
+    // Start recording an edit of the box [boxMin, boxMax), before making it
+    void begin(const World& world, const glm::ivec3& boxMin, const glm::ivec3& boxMax);
+    // Finish the edit as one step. False if it changed nothing, or the step
+    // alone is over the budget (the history is then empty).
+    bool end(const World& world);
+
+    // Undo the latest applied step / redo the last undone one. False when
+    // there is none, or a chunk it changed isn't loaded (nothing is applied).
+    bool undo(World& world);
+    bool redo(World& world);
+    bool canUndo() const { return applied > 0; }
+    bool canRedo() const { return applied < steps.size(); }
+    void clear();
+
+    // Encoded bytes held by the steps
+    size_t bytes() const { return used; }
+    size_t budgetBytes = 16 * 1024 * 1024;
+
+private:
+    struct ChunkDelta {
+        glm::ivec3 coord;
+        std::vector<uint8_t> runs;  // RLE of the before ^ after voxels
+    };
+    struct Step {
+        std::vector<ChunkDelta> chunks;
+        size_t bytes = 0;
+    };
+    struct Recorded {
+        glm::ivec3 coord;
+        PalettedBlocks blocks;      // As they were at begin()
+    };
+
+    bool apply(World& world, const Step& step);
+
+    std::deque<Step> steps;         // Oldest first
+    size_t applied = 0;             // Steps in effect; the rest were undone
+    size_t used = 0;
+    std::vector<Recorded> recording;
+};
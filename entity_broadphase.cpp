@@ -0,0 +1,158 @@
+#include "entity_broadphase.h"
+#include "job_system.h"
+#include "profiler.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Occupied cells per job system range
+const int PAIR_GRAIN = 32;
+
+// The cell itself and the 13 neighbours after it in x, y, z order; the
+// other 13 see this cell as one of theirs
+const int FORWARD_CELLS = 14;
+const glm::ivec3 FORWARD_OFFSETS[FORWARD_CELLS] = {
+    glm::ivec3(0, 0, 0), glm::ivec3(0, 0, 1),
+    glm::ivec3(0, 1, -1), glm::ivec3(0, 1, 0), glm::ivec3(0, 1, 1),
+    glm::ivec3(1, -1, -1), glm::ivec3(1, -1, 0), glm::ivec3(1, -1, 1),
+    glm::ivec3(1, 0, -1), glm::ivec3(1, 0, 0), glm::ivec3(1, 0, 1),
+    glm::ivec3(1, 1, -1), glm::ivec3(1, 1, 0), glm::ivec3(1, 1, 1)
+};
+
+static glm::ivec3 cellOf(double x, double y, double z)
+{
+    return glm::ivec3((int)std::floor(x / ENTITY_CELL_SIZE), (int)std::floor(y / ENTITY_CELL_SIZE),
+        (int)std::floor(z / ENTITY_CELL_SIZE));
+}
+
+static void boxOf(const EntityStore& entities, EntityId entity, glm::dvec3& boxMin, glm::dvec3& boxMax)
+{
+    size_t row;
+    const Archetype& a = entities.archetypeOf(entity, row);
+    glm::dvec3 center(a.px[row], a.py[row], a.pz[row]);
+    glm::dvec3 half(a.hx[row], a.hy[row], a.hz[row]);
+    boxMin = center - half;
+    boxMax = center + half;
+}
+
+void EntityBroadphase::add(const glm::ivec3& coord, EntityId entity)
+{
+    uint64_t key = packChunkCoord(coord);
+    Cell* cell = cells.find(key);
+    if (!cell) {
+        cell = &cells[key];
+        cell->index = (uint32_t)occupied.size();
+        occupied.push_back(coord);
+    }
+    cell->entities.push_back(entity);
+}
+
+void EntityBroadphase::remove(const glm::ivec3& coord, EntityId entity)
+{
+    uint64_t key = packChunkCoord(coord);
+    Cell* cell = cells.find(key);
+    if (!cell)
+        return;
+    std::vector<EntityId>& list = cell->entities;
+    for (size_t i = 0; i < list.size(); i++) {
+        if (list[i] == entity) {
+            list[i] = list.back();
+            list.pop_back();
+            break;
+        }
+    }
+    if (!list.empty())
+        return;
+
+    // Empty cells leave the map, the last occupied one taking their place
+    uint32_t index = cell->index;
+    occupied[index] = occupied.back();
+    occupied.pop_back();
+    if (index < occupied.size())
+        cells.find(packChunkCoord(occupied[index]))->index = index;
+    cells.erase(key);
+}
+
+void EntityBroadphase::update(const EntityStore& entities)
+{
+    PROFILE_ZONE("Broadphase update");
+    const ComponentMask needed = COMPONENT_POSITION | COMPONENT_BOUNDS;
+
+    // Forget entities that were destroyed or lost their box
+    for (size_t i = 0; i < tracked.size();) {
+        EntityId entity = tracked[i];
+        size_t row;
+        if (entities.alive(entity) && entities.archetypeOf(entity, row).has(needed)) {
+            i++;
+            continue;
+        }
+        remove(*entityCells.find(entity), entity);
+        entityCells.erase(entity);
+        tracked[i] = tracked.back();
+        tracked.pop_back();
+    }
+
+    // File new entities, and move the ones whose centre changed cell
+    entities.forEach(needed, [&](const Archetype& a) {
+        for (size_t i = 0; i < a.size(); i++) {
+            EntityId entity = a.entities[i];
+            glm::ivec3 coord = cellOf(a.px[i], a.py[i], a.pz[i]);
+            glm::ivec3* filed = entityCells.find(entity);
+            if (!filed) {
+                entityCells[entity] = coord;
+                tracked.push_back(entity);
+                add(coord, entity);
+            }
+            else if (*filed != coord) {
+                remove(*filed, entity);
+                *filed = coord;
+                add(coord, entity);
+            }
+        }
+    });
+}
+
+void EntityBroadphase::findPairs(const EntityStore& entities, JobSystem* jobs, std::vector<EntityPair>& pairs)
+{
+    PROFILE_ZONE("Broadphase pairs");
+    int count = (int)occupied.size();
+    int ranges = (count + PAIR_GRAIN - 1) / PAIR_GRAIN;
+    if ((int)rangePairs.size() < ranges)
+        rangePairs.resize(ranges);
+
+    auto pairRange = [&](int begin, int end) {
+        std::vector<EntityPair>& out = rangePairs[begin / PAIR_GRAIN];
+        out.clear();
+        for (int c = begin; c < end; c++) {
+            const Cell& home = *cells.find(packChunkCoord(occupied[c]));
+            for (int o = 0; o < FORWARD_CELLS; o++) {
+                const Cell* other = o == 0 ? &home : cells.find(packChunkCoord(occupied[c] + FORWARD_OFFSETS[o]));
+                if (!other)
+                    continue;
+                for (size_t i = 0; i < home.entities.size(); i++) {
+                    glm::dvec3 aMin, aMax;
+                    boxOf(entities, home.entities[i], aMin, aMax);
+                    // Within the cell itself, each pair once
+                    for (size_t j = other == &home ? i + 1 : 0; j < other->entities.size(); j++) {
+                        glm::dvec3 bMin, bMax;
+                        boxOf(entities, other->entities[j], bMin, bMax);
+                        if (glm::all(glm::lessThan(aMin, bMax)) && glm::all(glm::lessThan(bMin, aMax)))
+                            out.push_back({ home.entities[i], other->entities[j] });
+                    }
+                }
+            }
+        }
+    };
+    if (jobs) {
+        jobs->parallelFor(count, PAIR_GRAIN, pairRange);
+    }
+    else {
+        for (int begin = 0; begin < count; begin += PAIR_GRAIN)
+            pairRange(begin, std::min(begin + PAIR_GRAIN, count));
+    }
+
+    pairs.clear();
+    for (int r = 0; r < ranges; r++)
+        pairs.insert(pairs.end(), rangePairs[r].begin(), rangePairs[r].end());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "chunk_hash_map.h"
+#include "entity_store.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct JobSystem;
+
+// Edge of a broadphase cell in blocks. Boxes up to a cell across are all
+// found by looking at the neighbouring cells.
+const int ENTITY_CELL_SIZE = 2;
+
+// Two entities whose boxes overlap
+struct EntityPair {
+    EntityId a;
+    EntityId b;
+};
+
+// Uniform-grid spatial hash over the entities with position and bounds,
+// each filed under the cell holding its centre. The grid is kept from
+// tick to tick: update() only moves the entities that crossed into another
+// cell and drops the destroyed ones, so a settled pile costs a lookup per
+// entity. findPairs() then tests each occupied cell against itself and the
+// half of its 26 neighbours ahead of it (so every pair comes up once), one
+// job system range of cells at a time. Past a few hundred entities this
+// beats testing every pair by orders of magnitude.
+struct EntityBroadphase {
+    // Bring the grid up to date with the store. Simulation thread.
+    void update(const EntityStore& entities);
+    // Every overlapping pair, in 'pairs' (replaced). The cells are split
+    // across 'jobs' when given; the store must not change until this returns.
+    void findPairs(const EntityStore& entities, JobSystem* jobs, std::vector<EntityPair>& pairs);
+
+    size_t occupiedCells() const { return occupied.size(); }
+
+private:
+    struct Cell {
+        std::vector<EntityId> entities;
+        uint32_t index = 0;     // In 'occupied'
+    };
+
+    void add(const glm::ivec3& coord, EntityId entity);
+    void remove(const glm::ivec3& coord, EntityId entity);
+
+    ChunkHashMap<Cell> cells;               // By packed cell coordinate
+    std::vector<glm::ivec3> occupied;       // Coordinates of every non-empty cell
+    ChunkHashMap<glm::ivec3> entityCells;   // Cell each tracked entity is filed under, by EntityId
+    std::vector<EntityId> tracked;
+    std::vector<std::vector<EntityPair>> rangePairs;    // Per job range
+};
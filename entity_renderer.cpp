@@ -0,0 +1,146 @@
+#include "entity_renderer.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+static const char* entityVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;         // Unit-cube corner, -1..1
+layout (location = 2) in vec3 iCenter;      // Per instance, relative to the camera
+layout (location = 3) in vec3 iHalfExtents;
+layout (location = 4) in vec4 iColor;
+
+uniform vec3 sunDirection;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+};
+
+out vec3 color;
+
+const vec3 FACE_NORMALS[6] = vec3[6](vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0));
+
+void main()
+{
+    gl_Position = viewProj * vec4(iCenter + aPos * iHalfExtents, 1.0);
+    // Vertices come four per face, in face order
+    vec3 aNormal = FACE_NORMALS[gl_VertexID >> 2];
+    // Ambient plus a little sun, and darker sides as on the terrain
+    float shade = 0.55 + 0.45 * max(dot(aNormal, sunDirection), 0.0);
+    color = iColor.rgb * shade * (abs(aNormal.y) > 0.5 ? 1.0 : 0.85);
+}
+)";
+
+static const char* entityFragmentShaderSource = R"(
+#version 330 core
+in vec3 color;
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(color, 1.0);
+}
+)";
+
+void EntityRenderer::init(unsigned int cameraBinding)
+{
+    program.create(entityVertexShaderSource, entityFragmentShaderSource);
+    program.bindBlock("Camera", cameraBinding);
+
+    // Four corners per face so each face has its own normal, found by the
+    // shader from the vertex index
+    float vertices[6 * 4 * 3];
+    unsigned char indices[6 * 6];
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        int axis = n[0] ? 0 : (n[1] ? 1 : 2);
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        for (int corner = 0; corner < 4; corner++) {
+            float* out = vertices + (face * 4 + corner) * 3;
+            glm::vec3 p(0.0f);
+            p[axis] = (float)(n[0] + n[1] + n[2]);
+            p[u] = corner & 1 ? 1.0f : -1.0f;
+            p[v] = corner & 2 ? 1.0f : -1.0f;
+            out[0] = p.x;
+            out[1] = p.y;
+            out[2] = p.z;
+        }
+        // Counter-clockwise seen from outside: flip the winding on negative faces
+        bool positive = n[0] + n[1] + n[2] > 0;
+        static const unsigned char front[6] = { 0, 1, 3, 0, 3, 2 };
+        static const unsigned char back[6] = { 0, 3, 1, 0, 2, 3 };
+        for (int k = 0; k < 6; k++)
+            indices[face * 6 + k] = (unsigned char)(face * 4 + (positive ? front[k] : back[k]));
+    }
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &cubeVBO);
+    glGenBuffers(1, &cubeEBO);
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    // Instance attributes: sourced from the stream buffer at draw time
+    for (int attribute = 2; attribute <= 4; attribute++) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+    glState().bindVertexArray(0);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void EntityRenderer::destroy()
+{
+    if (VAO == 0)
+        return;
+    glState().deleteVertexArrays(1, &VAO);
+    glState().deleteBuffers(1, &cubeVBO);
+    glState().deleteBuffers(1, &cubeEBO);
+    VAO = cubeVBO = cubeEBO = 0;
+    program.destroy();
+}
+
+int EntityRenderer::draw(const std::vector<EntityInstance>& instances, const glm::dvec3& eye, const glm::vec3& sunDirection,
+    StreamBuffer& stream)
+{
+    if (instances.empty())
+        return 0;
+
+    // Straight into this frame's region, aligned to the stride so the
+    // attributes can point at it
+    size_t offset;
+    GpuInstance* out = (GpuInstance*)stream.map(instances.size() * sizeof(GpuInstance), sizeof(GpuInstance), offset);
+    if (!out)
+        return 0;
+    for (size_t i = 0; i < instances.size(); i++) {
+        // Relative to the eye in double, so far-off positions don't jitter
+        GpuInstance instance;
+        instance.center = glm::vec3(instances[i].position - eye);
+        instance.halfExtents = instances[i].halfExtents;
+        instance.color = instances[i].color;
+        out[i] = instance;
+    }
+    stream.unmap();
+
+    program.use();
+    glUniform3fv(program.uniform("sunDirection"), 1, glm::value_ptr(sunDirection));
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    const GLsizei stride = sizeof(GpuInstance);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(GpuInstance, center)));
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(GpuInstance, halfExtents)));
+    glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(offset + offsetof(GpuInstance, color)));
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0, (GLsizei)instances.size());
+    glState().bindVertexArray(0);
+    return 1;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "entity_systems.h"
+#include "shader.h"
+#include "stream_buffer.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Draws entity boxes as instances of one unit cube: a single
+// glDrawElementsInstanced per frame, with each box's camera-relative
+// centre, half extents and colour written straight into the frame's
+// stream buffer and read from there as per-instance attributes.
+struct EntityRenderer {
+    // 'cameraBinding' is the uniform buffer binding of the Camera block
+    void init(unsigned int cameraBinding);
+    void destroy();
+
+    // Draw 'instances' relative to 'eye', lit from 'sunDirection' (towards
+    // the sun), their attributes taken from 'stream'. Returns the number of
+    // draw calls (0 when the stream region is full).
+    int draw(const std::vector<EntityInstance>& instances, const glm::dvec3& eye, const glm::vec3& sunDirection,
+        StreamBuffer& stream);
+
+private:
+    // Per-instance attributes as uploaded
+    struct GpuInstance {
+        glm::vec3 center;       // Relative to the eye
+        glm::vec3 halfExtents;
+        uint32_t color;
+    };
+
+    ShaderProgram program;
+    unsigned int VAO = 0;
+    unsigned int cubeVBO = 0;
+    unsigned int cubeEBO = 0;
+};
@@ -0,0 +1,175 @@
+#include "entity_store.h"
+
+#include <utility>
+
+const uint32_t SLOT_BITS = 24;
+const uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+
+static inline uint32_t slotOf(EntityId entity) { return entity & SLOT_MASK; }
+static inline uint32_t generationOf(EntityId entity) { return entity >> SLOT_BITS; }
+
+// Apply 'fn' to every column of each component in 'mask', one call per
+// column type
+template <typename Fn>
+static void forEachColumn(Archetype& a, ComponentMask mask, Fn fn)
+{
+    if (mask & COMPONENT_POSITION) {
+        fn(a.px);
+        fn(a.py);
+        fn(a.pz);
+    }
+    if (mask & COMPONENT_VELOCITY) {
+        fn(a.vx);
+        fn(a.vy);
+        fn(a.vz);
+    }
+    if (mask & COMPONENT_BOUNDS) {
+        fn(a.hx);
+        fn(a.hy);
+        fn(a.hz);
+    }
+    if (mask & COMPONENT_APPEARANCE)
+        fn(a.color);
+    if (mask & COMPONENT_LIFETIME)
+        fn(a.lifetime);
+}
+
+struct AppendZero {
+    template <typename Column>
+    void operator()(Column& column) const { column.push_back(0); }
+};
+
+// Swap-remove one row of a column
+struct RemoveRow {
+    uint32_t row;
+    template <typename Column>
+    void operator()(Column& column) const
+    {
+        column[row] = column.back();
+        column.pop_back();
+    }
+};
+
+int EntityStore::findOrAddArchetype(ComponentMask mask)
+{
+    for (size_t i = 0; i < archetypes.size(); i++) {
+        if (archetypes[i].mask == mask)
+            return (int)i;
+    }
+    archetypes.emplace_back();
+    archetypes.back().mask = mask;
+    return (int)archetypes.size() - 1;
+}
+
+uint32_t EntityStore::appendRow(int index, EntityId entity)
+{
+    Archetype& archetype = archetypes[index];
+    archetype.entities.push_back(entity);
+    forEachColumn(archetype, archetype.mask, AppendZero());
+    return (uint32_t)archetype.size() - 1;
+}
+
+void EntityStore::removeRow(int index, uint32_t row)
+{
+    Archetype& archetype = archetypes[index];
+    EntityId moved = archetype.entities.back();
+    archetype.entities[row] = moved;
+    archetype.entities.pop_back();
+    forEachColumn(archetype, archetype.mask, RemoveRow{ row });
+    if (row < archetype.size())
+        slots[slotOf(moved)].row = row;
+}
+
+EntityId EntityStore::create(ComponentMask mask)
+{
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else {
+        slot = (uint32_t)slots.size();
+        if (slot > SLOT_MASK)
+            return NO_ENTITY;
+        slots.emplace_back();
+    }
+    EntityId entity = (slots[slot].generation << SLOT_BITS) | slot;
+    int index = findOrAddArchetype(mask);
+    slots[slot].archetype = index;
+    slots[slot].row = appendRow(index, entity);
+    liveCount++;
+    return entity;
+}
+
+bool EntityStore::alive(EntityId entity) const
+{
+    uint32_t slot = slotOf(entity);
+    return entity != NO_ENTITY && slot < slots.size() && slots[slot].archetype >= 0 &&
+        slots[slot].generation == generationOf(entity);
+}
+
+void EntityStore::destroy(EntityId entity)
+{
+    if (!alive(entity))
+        return;
+    Slot& slot = slots[slotOf(entity)];
+    removeRow(slot.archetype, slot.row);
+    slot.archetype = -1;
+    // The generation wraps within its 8 bits
+    slot.generation = (slot.generation + 1) & (0xFFu);
+    freeSlots.push_back(slotOf(entity));
+    liveCount--;
+}
+
+Archetype& EntityStore::archetypeOf(EntityId entity, size_t& row)
+{
+    return const_cast<Archetype&>(static_cast<const EntityStore*>(this)->archetypeOf(entity, row));
+}
+
+const Archetype& EntityStore::archetypeOf(EntityId entity, size_t& row) const
+{
+    const Slot& slot = slots[slotOf(entity)];
+    row = slot.row;
+    return archetypes[slot.archetype];
+}
+
+void EntityStore::setComponents(EntityId entity, ComponentMask mask)
+{
+    if (!alive(entity))
+        return;
+    Slot& slot = slots[slotOf(entity)];
+    int from = slot.archetype;
+    if (archetypes[from].mask == mask)
+        return;
+    int to = findOrAddArchetype(mask);
+    uint32_t oldRow = slot.row;
+    uint32_t newRow = appendRow(to, entity);
+
+    // Copy the components both archetypes have
+    Archetype& src = archetypes[from];
+    Archetype& dst = archetypes[to];
+    ComponentMask shared = src.mask & mask;
+    if (shared & COMPONENT_POSITION) {
+        dst.px[newRow] = src.px[oldRow];
+        dst.py[newRow] = src.py[oldRow];
+        dst.pz[newRow] = src.pz[oldRow];
+    }
+    if (shared & COMPONENT_VELOCITY) {
+        dst.vx[newRow] = src.vx[oldRow];
+        dst.vy[newRow] = src.vy[oldRow];
+        dst.vz[newRow] = src.vz[oldRow];
+    }
+    if (shared & COMPONENT_BOUNDS) {
+        dst.hx[newRow] = src.hx[oldRow];
+        dst.hy[newRow] = src.hy[oldRow];
+        dst.hz[newRow] = src.hz[oldRow];
+    }
+    if (shared & COMPONENT_APPEARANCE)
+        dst.color[newRow] = src.color[oldRow];
+    if (shared & COMPONENT_LIFETIME)
+        dst.lifetime[newRow] = src.lifetime[oldRow];
+
+    removeRow(from, oldRow);
+    slot.archetype = to;
+    slot.row = newRow;
+}
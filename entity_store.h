@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Components an entity can have, one bit each
+enum ComponentBits : uint32_t {
+    COMPONENT_POSITION = 1 << 0,    // World position of the centre (double)
+    COMPONENT_VELOCITY = 1 << 1,    // Blocks per second
+    COMPONENT_BOUNDS = 1 << 2,      // Half extents of a box around the position
+    COMPONENT_APPEARANCE = 1 << 3,  // Colour, drawn as an instanced box
+    COMPONENT_LIFETIME = 1 << 4,    // Seconds left before it is destroyed
+};
+typedef uint32_t ComponentMask;
+
+// Handle to an entity: slot index in the low 24 bits, the slot's
+// generation above, so handles of destroyed entities stay invalid when the
+// slot is reused
+typedef uint32_t EntityId;
+const EntityId NO_ENTITY = ~0u;
+
+// Every entity with exactly one set of components, stored as parallel
+// arrays: one column per scalar of each component in the mask, indexed like
+// 'entities'. Columns of components outside the mask stay empty. Systems
+// walk whole columns, which the compiler can vectorise, and never touch the
+// components they don't use.
+struct Archetype {
+    ComponentMask mask = 0;
+    std::vector<EntityId> entities;
+
+    std::vector<double> px, py, pz;     // COMPONENT_POSITION
+    std::vector<float> vx, vy, vz;      // COMPONENT_VELOCITY
+    std::vector<float> hx, hy, hz;      // COMPONENT_BOUNDS
+    std::vector<uint32_t> color;        // COMPONENT_APPEARANCE, RGBA8
+    std::vector<float> lifetime;        // COMPONENT_LIFETIME
+
+    size_t size() const { return entities.size(); }
+    bool has(ComponentMask components) const { return (mask & components) == components; }
+};
+
+// Entities grouped into archetypes by their component set. Creating and
+// destroying an entity appends or swap-removes one row of its archetype, so
+// the columns stay dense; handles map to (archetype, row) through a slot
+// table. Components start zeroed and are written through the columns.
+//
+// Not thread-safe: the simulation thread owns the store.
+struct EntityStore {
+    EntityId create(ComponentMask mask);
+    // Does nothing for a handle that is no longer alive
+    void destroy(EntityId entity);
+    bool alive(EntityId entity) const;
+
+    // Archetype and row holding a live entity
+    Archetype& archetypeOf(EntityId entity, size_t& row);
+    const Archetype& archetypeOf(EntityId entity, size_t& row) const;
+    // Move an entity to the archetype of 'mask', keeping the components
+    // both have (added ones start zeroed)
+    void setComponents(EntityId entity, ComponentMask mask);
+
+    // Call fn(archetype) for every non-empty archetype with all of 'mask'
+    template <typename Fn>
+    void forEach(ComponentMask mask, Fn fn)
+    {
+        for (Archetype& archetype : archetypes) {
+            if (archetype.has(mask) && archetype.size() > 0)
+                fn(archetype);
+        }
+    }
+    template <typename Fn>
+    void forEach(ComponentMask mask, Fn fn) const
+    {
+        for (const Archetype& archetype : archetypes) {
+            if (archetype.has(mask) && archetype.size() > 0)
+                fn(archetype);
+        }
+    }
+
+    size_t count() const { return liveCount; }
+
+private:
+    struct Slot {
+        uint32_t generation = 0;
+        int archetype = -1;     // -1 while free
+        uint32_t row = 0;
+    };
+
+    int findOrAddArchetype(ComponentMask mask);
+    // Append a zeroed row for 'entity' to archetype 'index'
+    uint32_t appendRow(int index, EntityId entity);
+    // Swap-remove row 'row' of archetype 'index', fixing the moved entity's slot
+    void removeRow(int index, uint32_t row);
+
+    std::vector<Archetype> archetypes;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    size_t liveCount = 0;
+};
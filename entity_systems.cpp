@@ -0,0 +1,184 @@
+#include "entity_systems.h"
+#include "profiler.h"
+#include "simd_math.h"
+#include "voxel_collision.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float ENTITY_GRAVITY = 28.0f;     // Blocks per second squared, as for the player
+const float ENTITY_MAX_FALL_SPEED = 60.0f;
+// Fraction of horizontal speed kept per second while resting on the ground
+const float GROUND_FRICTION = 0.02f;
+// Dropped items
+const float ITEM_HALF_SIZE = 0.125f;
+const float ITEM_LIFETIME = 60.0f;      // Seconds
+const float ITEM_TOSS_SPEED = 3.0f;
+
+static uint32_t packColor(const glm::vec3& c)
+{
+    glm::vec3 v = glm::clamp(c, glm::vec3(0.0f), glm::vec3(1.0f)) * 255.0f + 0.5f;
+    return (uint32_t)v.r | ((uint32_t)v.g << 8) | ((uint32_t)v.b << 16) | (255u << 24);
+}
+
+// Well-mixed value in [0, 1) from a seed and a counter
+static float hashUnit(uint32_t seed, uint32_t n)
+{
+    uint32_t h = seed * 0x9E3779B1u ^ n * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// A plain loop over the column, which the compiler vectorises
+static void applyGravity(Archetype& a, float dt)
+{
+    float* vy = a.vy.data();
+    for (size_t i = 0; i < a.size(); i++)
+        vy[i] = std::max(vy[i] - ENTITY_GRAVITY * dt, -ENTITY_MAX_FALL_SPEED);
+}
+
+// Float velocities widened into double positions, a batch at a time
+static void integrate(Archetype& a, float dt)
+{
+    integratePositions(a.px.data(), a.py.data(), a.pz.data(), a.vx.data(), a.vy.data(), a.vz.data(), a.size(), dt);
+}
+
+// Boxes move as the player does: swept an axis at a time through the block
+// grid, vertical first, stopping at solid blocks. Landing takes the
+// horizontal speed down with friction.
+static void moveThroughVoxels(Archetype& a, WorldCursor& cursor, float dt)
+{
+    float friction = std::pow(GROUND_FRICTION, dt);
+    for (size_t i = 0; i < a.size(); i++) {
+        glm::dvec3 position(a.px[i], a.py[i], a.pz[i]);
+        glm::dvec3 half(a.hx[i], a.hy[i], a.hz[i]);
+        float* velocity[3] = { &a.vx[i], &a.vy[i], &a.vz[i] };
+        static const int AXES[3] = { 1, 0, 2 };
+        bool grounded = false;
+        for (int axis : AXES) {
+            double delta = *velocity[axis] * (double)dt;
+            double moved = sweepBoxAxis(cursor, position - half, position + half, axis, delta);
+            position[axis] += moved;
+            if (moved != delta) {
+                grounded = grounded || (axis == 1 && delta < 0.0);
+                *velocity[axis] = 0.0f;
+            }
+        }
+        if (grounded) {
+            a.vx[i] *= friction;
+            a.vz[i] *= friction;
+        }
+        a.px[i] = position.x;
+        a.py[i] = position.y;
+        a.pz[i] = position.z;
+    }
+}
+
+void updateEntities(EntityStore& entities, const World& world, float dt)
+{
+    PROFILE_ZONE("Entities");
+    WorldCursor cursor(world);
+    entities.forEach(COMPONENT_POSITION | COMPONENT_VELOCITY, [&](Archetype& a) {
+        applyGravity(a, dt);
+        if (a.has(COMPONENT_BOUNDS))
+            moveThroughVoxels(a, cursor, dt);
+        else
+            integrate(a, dt);
+    });
+
+    // Expired entities are collected first: destroying reorders the rows
+    std::vector<EntityId> expired;
+    entities.forEach(COMPONENT_LIFETIME, [&](Archetype& a) {
+        float* lifetime = a.lifetime.data();
+        for (size_t i = 0; i < a.size(); i++)
+            lifetime[i] -= dt;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (lifetime[i] <= 0.0f)
+                expired.push_back(a.entities[i]);
+        }
+    });
+    for (EntityId entity : expired)
+        entities.destroy(entity);
+}
+
+void separateEntities(EntityStore& entities, const World& world, const std::vector<EntityPair>& pairs)
+{
+    WorldCursor cursor(world);
+    for (const EntityPair& pair : pairs) {
+        size_t rowA, rowB;
+        Archetype& a = entities.archetypeOf(pair.a, rowA);
+        Archetype& b = entities.archetypeOf(pair.b, rowB);
+        glm::dvec3 centerA(a.px[rowA], a.py[rowA], a.pz[rowA]);
+        glm::dvec3 centerB(b.px[rowB], b.py[rowB], b.pz[rowB]);
+        glm::dvec3 halfA(a.hx[rowA], a.hy[rowA], a.hz[rowA]);
+        glm::dvec3 halfB(b.hx[rowB], b.hy[rowB], b.hz[rowB]);
+
+        // Earlier pairs may have moved them apart already
+        glm::dvec3 overlap = halfA + halfB - glm::abs(centerB - centerA);
+        if (overlap.x <= 0.0 || overlap.y <= 0.0 || overlap.z <= 0.0)
+            continue;
+        int axis = overlap.x < overlap.y ? (overlap.x < overlap.z ? 0 : 2) : (overlap.y < overlap.z ? 1 : 2);
+        double side = centerB[axis] >= centerA[axis] ? 1.0 : -1.0;
+        double push = overlap[axis] * 0.5;
+        centerA[axis] += sweepBoxAxis(cursor, centerA - halfA, centerA + halfA, axis, -side * push);
+        centerB[axis] += sweepBoxAxis(cursor, centerB - halfB, centerB + halfB, axis, side * push);
+        a.px[rowA] = centerA.x;
+        a.py[rowA] = centerA.y;
+        a.pz[rowA] = centerA.z;
+        b.px[rowB] = centerB.x;
+        b.py[rowB] = centerB.y;
+        b.pz[rowB] = centerB.z;
+
+        // Moving boxes no longer close in: both take their mean speed along the axis
+        if (a.has(COMPONENT_VELOCITY) && b.has(COMPONENT_VELOCITY)) {
+            float* va[3] = { &a.vx[rowA], &a.vy[rowA], &a.vz[rowA] };
+            float* vb[3] = { &b.vx[rowB], &b.vy[rowB], &b.vz[rowB] };
+            if ((*vb[axis] - *va[axis]) * side < 0.0f) {
+                float mean = (*va[axis] + *vb[axis]) * 0.5f;
+                *va[axis] = mean;
+                *vb[axis] = mean;
+            }
+        }
+    }
+}
+
+void gatherEntityInstances(const EntityStore& entities, float ahead, std::vector<EntityInstance>& out)
+{
+    entities.forEach(COMPONENT_POSITION | COMPONENT_BOUNDS | COMPONENT_APPEARANCE, [&](const Archetype& a) {
+        bool moving = a.has(COMPONENT_VELOCITY);
+        for (size_t i = 0; i < a.size(); i++) {
+            EntityInstance instance;
+            instance.position = glm::dvec3(a.px[i], a.py[i], a.pz[i]);
+            if (moving)
+                instance.position += glm::dvec3(a.vx[i], a.vy[i], a.vz[i]) * (double)ahead;
+            instance.halfExtents = glm::vec3(a.hx[i], a.hy[i], a.hz[i]);
+            instance.color = a.color[i];
+            out.push_back(instance);
+        }
+    });
+}
+
+EntityId spawnDroppedItem(EntityStore& entities, const glm::ivec3& block, BlockId id, uint32_t seed)
+{
+    EntityId entity = entities.create(COMPONENT_POSITION | COMPONENT_VELOCITY | COMPONENT_BOUNDS |
+        COMPONENT_APPEARANCE | COMPONENT_LIFETIME);
+    if (entity == NO_ENTITY)
+        return entity;
+    size_t row;
+    Archetype& a = entities.archetypeOf(entity, row);
+    a.px[row] = block.x + 0.5;
+    a.py[row] = block.y + 0.5;
+    a.pz[row] = block.z + 0.5;
+    // A little hop in a random direction
+    float angle = hashUnit(seed, 0) * 6.2831853f;
+    a.vx[row] = std::cos(angle) * ITEM_TOSS_SPEED * 0.5f;
+    a.vy[row] = ITEM_TOSS_SPEED * (1.0f + hashUnit(seed, 1));
+    a.vz[row] = std::sin(angle) * ITEM_TOSS_SPEED * 0.5f;
+    a.hx[row] = a.hy[row] = a.hz[row] = ITEM_HALF_SIZE;
+    a.color[row] = packColor(BLOCK_COLORS[id]);
+    a.lifetime[row] = ITEM_LIFETIME;
+    return entity;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "chunk.h"
+#include "entity_broadphase.h"
+#include "entity_store.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct World;
+
+// One entity box for the renderer
+struct EntityInstance {
+    glm::dvec3 position;        // Centre, world space
+    glm::vec3 halfExtents;
+    uint32_t color;             // RGBA8
+};
+
+// Advance every entity by 'dt' seconds: velocity under gravity, position
+// along it (swept through the block grid for entities with bounds), and
+// the lifetimes that ran out destroyed.
+void updateEntities(EntityStore& entities, const World& world, float dt);
+
+// Push the boxes of each overlapping pair apart along the axis they
+// overlap least, half each, swept so neither is pushed into a block, and
+// stop them closing in along it
+void separateEntities(EntityStore& entities, const World& world, const std::vector<EntityPair>& pairs);
+
+// Append a box per entity with position, bounds and appearance to 'out',
+// moved 'ahead' seconds along its velocity so motion between ticks stays
+// smooth
+void gatherEntityInstances(const EntityStore& entities, float ahead, std::vector<EntityInstance>& out);
+
+// Small box of the colour of 'id' popping out of the broken 'block'.
+// 'seed' varies its toss.
+EntityId spawnDroppedItem(EntityStore& entities, const glm::ivec3& block, BlockId id, uint32_t seed);
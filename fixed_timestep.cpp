@@ -0,0 +1,21 @@
+#include "fixed_timestep.h"
+
+#include <algorithm>
+
+void FixedTimestep::setRate(double hz)
+{
+    tickSeconds = 1.0 / hz;
+    accumulator = std::min(accumulator, tickSeconds);
+}
+
+int FixedTimestep::advance(double frameSeconds)
+{
+    accumulator += std::min(std::max(frameSeconds, 0.0), maxFrameSeconds);
+    int ticks = 0;
+    while (accumulator >= tickSeconds) {
+        accumulator -= tickSeconds;
+        ticks++;
+    }
+    tickCount += (uint64_t)ticks;
+    return ticks;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Fixed-rate simulation clock. Frame time is accumulated and handed out as
+// whole ticks, so simulation cost follows elapsed time instead of the frame
+// rate; rendering interpolates between the last two tick states with alpha().
+struct FixedTimestep {
+    double tickSeconds = 1.0 / 60.0;
+    double maxFrameSeconds = 0.25;  // Longer frames are cut short, so a stall can't start a catch-up spiral
+    double accumulator = 0.0;       // Time not yet simulated, below one tick after advance()
+    uint64_t tickCount = 0;         // Ticks simulated since start
+
+    // Ticks per second
+    void setRate(double hz);
+    // Add a frame's elapsed time; returns the number of ticks to run now
+    int advance(double frameSeconds);
+    // Progress from the last tick towards the next one, in [0, 1)
+    double alpha() const { return accumulator / tickSeconds; }
+};
@@ -0,0 +1,183 @@
+#include "fluid_simulation.h"
+#include "job_system.h"
+#include "profiler.h"
+#include "world.h"
+
+#include <algorithm>
+
+// Block positions pack like chunk coordinates: 21 bits per axis reach a
+// million blocks each way
+static inline uint64_t cellKey(const glm::ivec3& cell)
+{
+    return packChunkCoord(cell);
+}
+
+// Sideways neighbours water spreads to
+const glm::ivec3 SIDEWAYS[4] = { glm::ivec3(-1, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 1) };
+
+// Calls 'fn' with the world position of every flowing water voxel of 'chunk'
+template <typename Fn>
+static void forEachFlowing(const Chunk& chunk, Fn fn)
+{
+    const std::vector<BlockId>& palette = chunk.blocks.palette;
+    if (std::find(palette.begin(), palette.end(), (BlockId)BLOCK_FLOWING_WATER) == palette.end())
+        return;
+    glm::ivec3 origin = chunk.coord * CHUNK_SIZE;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                if (chunk.get(x, y, z) == BLOCK_FLOWING_WATER)
+                    fn(origin + glm::ivec3(x, y, z));
+            }
+        }
+    }
+}
+
+void FluidSimulation::chunkReady(const Chunk& chunk)
+{
+    forEachFlowing(chunk, [&](const glm::ivec3& cell) { activate(cell); });
+}
+
+void FluidSimulation::chunkUnloaded(const Chunk& chunk)
+{
+    // Queued cells of the chunk are dropped when their turn comes
+    forEachFlowing(chunk, [&](const glm::ivec3& cell) { levels.erase(cellKey(cell)); });
+}
+
+void FluidSimulation::blockChanged(const glm::ivec3& block)
+{
+    activateAround(block);
+}
+
+void FluidSimulation::activate(const glm::ivec3& cell)
+{
+    if (active.insert(cellKey(cell), true))
+        next.push_back(cell);
+}
+
+void FluidSimulation::activateAround(const glm::ivec3& cell)
+{
+    activate(cell);
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        activate(cell + glm::ivec3(n[0], n[1], n[2]));
+    }
+}
+
+int FluidSimulation::levelOf(const glm::ivec3& cell, BlockId id) const
+{
+    if (id == BLOCK_WATER)
+        return MAX_FLUID_LEVEL + 1;
+    if (id != BLOCK_FLOWING_WATER)
+        return 0;
+    const uint8_t* level = levels.find(cellKey(cell));
+    return level ? *level : MAX_FLUID_LEVEL;
+}
+
+int FluidSimulation::inflow(WorldCursor& cursor, const glm::ivec3& cell) const
+{
+    int best = 0;
+    if (isWater(cursor.getBlock(cell + glm::ivec3(0, 1, 0))))
+        best = MAX_FLUID_LEVEL;
+    for (const glm::ivec3& side : SIDEWAYS) {
+        glm::ivec3 from = cell + side;
+        BlockId id = cursor.getBlock(from);
+        if (!isWater(id))
+            continue;
+        // Water with air or a falling stream below pours down instead
+        BlockId below = cursor.getBlock(from - glm::ivec3(0, 1, 0));
+        if (below == BLOCK_AIR || below == BLOCK_FLOWING_WATER)
+            continue;
+        best = std::max(best, levelOf(from, id) - 1);
+    }
+    return best;
+}
+
+bool FluidSimulation::evaluate(WorldCursor& cursor, const glm::ivec3& cell, BlockId& id, int& level) const
+{
+    id = cursor.getBlock(cell);
+    if (id != BLOCK_AIR && id != BLOCK_FLOWING_WATER)
+        return false;
+    glm::ivec3 coord = chunkCoordOf(cell);
+    if (!cursor.chunk(coord))
+        return false;
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        glm::ivec3 neighbour = chunkCoordOf(cell + glm::ivec3(n[0], n[1], n[2]));
+        if (neighbour != coord && neighbour.y >= 0 && neighbour.y < WORLD_HEIGHT_CHUNKS && !cursor.chunk(neighbour))
+            return false;
+    }
+    level = inflow(cursor, cell);
+    return level != levelOf(cell, id);
+}
+
+int FluidSimulation::tick(World& world)
+{
+    world.flushBlockEvents();
+    if (++ticks < FLUID_TICKS_PER_STEP)
+        return 0;
+    ticks = 0;
+    PROFILE_ZONE("Fluids");
+
+    // Cells left over by the last step go first
+    current.insert(current.end(), next.begin(), next.end());
+    next.clear();
+
+    // This step's cells, grouped by tile in the order they came
+    stepCells.clear();
+    for (int budget = cellsPerStep; budget > 0 && !current.empty(); budget--) {
+        glm::ivec3 cell = current.front();
+        current.pop_front();
+        active.erase(cellKey(cell));
+        uint64_t tile = packChunkCoord(glm::ivec3(cell.x >> FLUID_TILE_SHIFT, 0, cell.z >> FLUID_TILE_SHIFT));
+        stepCells.push_back(std::make_pair(tile, cell));
+    }
+    std::stable_sort(stepCells.begin(), stepCells.end(),
+        [](const std::pair<uint64_t, glm::ivec3>& a, const std::pair<uint64_t, glm::ivec3>& b) { return a.first < b.first; });
+    tileStarts.clear();
+    for (size_t i = 0; i < stepCells.size(); i++) {
+        if (i == 0 || stepCells[i].first != stepCells[i - 1].first)
+            tileStarts.push_back((int)i);
+    }
+    tileStarts.push_back((int)stepCells.size());
+    lastTiles = (int)tileStarts.size() - 1;
+
+    // Phase one: every tile's outcomes from the world as it stands
+    updates.resize(stepCells.size());
+    auto evaluateTiles = [&](int begin, int end) {
+        WorldCursor cursor(world);
+        for (int i = tileStarts[begin]; i < tileStarts[end]; i++) {
+            FlowUpdate& update = updates[i];
+            update.cell = stepCells[i].second;
+            int level = 0;
+            update.changed = evaluate(cursor, update.cell, update.id, level);
+            update.level = (uint8_t)level;
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(lastTiles, 1, evaluateTiles);
+    else
+        evaluateTiles(0, lastTiles);
+
+    // Phase two: apply them, activating the neighbours of each change
+    // whichever tile they are in
+    int changed = 0;
+    for (const FlowUpdate& update : updates) {
+        if (!update.changed)
+            continue;
+        uint64_t key = cellKey(update.cell);
+        if (update.level == 0) {
+            levels.erase(key);
+            world.setBlock(update.cell, BLOCK_AIR, false);
+        }
+        else {
+            levels[key] = update.level;
+            if (update.id == BLOCK_AIR)
+                world.setBlock(update.cell, BLOCK_FLOWING_WATER, false);
+            else
+                activateAround(update.cell); // Same block, so World has no edit to report
+        }
+        changed++;
+    }
+    return changed;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_hash_map.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+struct JobSystem;
+struct World;
+struct WorldCursor;
+
+// Simulation ticks per flow step: water advances a block per step
+const int FLUID_TICKS_PER_STEP = 6;
+// Level of flowing water next to a source, and of water falling down;
+// each block sideways loses one
+const int MAX_FLUID_LEVEL = 7;
+// A step's cells are split into tiles of this many blocks (as a shift) in
+// x and z, the full height of the world
+const int FLUID_TILE_SHIFT = 6;
+
+// Water flow over the loaded chunks, stepped on the fixed simulation tick.
+// BLOCK_WATER is a source and never drains. BLOCK_FLOWING_WATER spreads
+// from it with a level: it falls into air below at MAX_FLUID_LEVEL and,
+// where it can't fall, runs sideways one level weaker, so a stream reaches
+// MAX_FLUID_LEVEL blocks across flat ground. Flowing water that no
+// neighbour feeds any more dries up, a block per step.
+//
+// Only active cells are looked at: a changed block activates itself and
+// its six neighbours, and each step processes the cells activated before
+// it, at most cellsPerStep of them (the rest wait for the next step), so a
+// still lake costs nothing. Changes go through World::setBlock as
+// background edits: the chunks a step touches are re-meshed once, together
+// with the other dirty chunks, on the mesher.
+//
+// A step runs in two phases. The cells are grouped into tiles, and every
+// tile works out its cells' new levels on the job system, all reading the
+// world as it was when the step began, so tiles never wait on each other.
+// Then the calling thread applies the changes tile by tile, and effects
+// across tile borders (the neighbours a change activates, the chunks it
+// marks for re-meshing) are resolved there. Results don't depend on how
+// the cells were split or scheduled.
+//
+// Levels are kept here rather than in the voxels. Flowing water read from
+// storage counts as MAX_FLUID_LEVEL until its chunk is ready and its cells
+// have been looked at again: levels only settle down from there to what
+// the sources give them, so a stream never dries up while it reloads.
+struct FluidSimulation {
+    // World hooks (main thread): a chunk became CHUNK_READY, a chunk was
+    // unloaded, a block changed (World::flushBlockEvents())
+    void chunkReady(const Chunk& chunk);
+    void chunkUnloaded(const Chunk& chunk);
+    void blockChanged(const glm::ivec3& block);
+
+    // Advance one simulation tick, running a flow step every
+    // FLUID_TICKS_PER_STEP ticks. Returns the blocks changed.
+    int tick(World& world);
+
+    // Cells waiting for a step
+    size_t activeCount() const { return current.size() + next.size(); }
+
+    // Most cells one step processes
+    int cellsPerStep = 8192;
+    // Optional workers for a step's tiles (not owned); without them the
+    // work runs on the calling thread
+    JobSystem* jobs = nullptr;
+
+    // Tiles the last step had cells in
+    int lastTiles = 0;
+
+private:
+    // A cell's outcome in a step's first phase
+    struct FlowUpdate {
+        glm::ivec3 cell;
+        BlockId id;         // Before the step
+        uint8_t level;      // After it
+        bool changed;
+    };
+
+    // New level of 'cell', false if it can't change (a source or solid
+    // block, or water whose neighbourhood isn't all loaded, since missing
+    // chunks read as air) or keeps its level. Only reads, so any number of
+    // threads can evaluate at once.
+    bool evaluate(WorldCursor& cursor, const glm::ivec3& cell, BlockId& id, int& level) const;
+    // Level of water at 'cell': sources above every flowing level
+    int levelOf(const glm::ivec3& cell, BlockId id) const;
+    // Level water flowing into 'cell' from its neighbours would give it (0 = none)
+    int inflow(WorldCursor& cursor, const glm::ivec3& cell) const;
+    void activate(const glm::ivec3& cell);
+    void activateAround(const glm::ivec3& cell);
+
+    std::deque<glm::ivec3> current;     // Being processed by the step in progress
+    std::deque<glm::ivec3> next;        // Activated since it started
+    ChunkHashMap<bool> active;          // Every cell in 'current' or 'next'
+    ChunkHashMap<uint8_t> levels;       // Flowing water's level by block position
+    int ticks = 0;
+
+    // This step's cells by tile, and each tile's first one
+    std::vector<std::pair<uint64_t, glm::ivec3>> stepCells;
+    std::vector<int> tileStarts;
+    std::vector<FlowUpdate> updates;    // Per entry of stepCells
+};
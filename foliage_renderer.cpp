@@ -0,0 +1,252 @@
+#include "foliage_renderer.h"
+#include "chunk_renderer.h"
+#include "gl_state.h"
+#include "profiler.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
+// Of the grass blocks open to the air, about one in three has a tuft and
+// one in forty a flower (out of 256)
+const uint32_t FOLIAGE_GRASS_ODDS = 85;
+const uint32_t FOLIAGE_FLOWER_ODDS = 6;
+
+static_assert(CHUNK_VOLUME <= 4096 && FOLIAGE_KIND_COUNT <= 16, "foliage entries pack index and kind into 16 bits");
+
+static uint32_t foliageHash(const glm::ivec3& block)
+{
+    uint32_t h = (uint32_t)block.x * 0x8DA6B343u ^ (uint32_t)block.y * 0xD8163841u ^ (uint32_t)block.z * 0xCB1AB31Fu;
+    h ^= h >> 13;
+    h *= 0x5BD1E995u;
+    h ^= h >> 15;
+    return h;
+}
+
+void findFoliage(const Chunk& chunk, const ChunkVoxels& voxels, std::vector<uint32_t>& foliage)
+{
+    foliage.clear();
+    bool air = false;
+    bool grass = false;
+    for (BlockId id : chunk.blocks.palette) {
+        air = air || id == BLOCK_AIR;
+        grass = grass || id == BLOCK_GRASS;
+    }
+    if (!air)
+        return;
+    // Without grass of its own only the bottom layer can stand on some, below
+    int top = grass ? CHUNK_SIZE : 1;
+    glm::ivec3 origin = chunk.coord * CHUNK_SIZE;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < top; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                int i = chunkIndex(x, y, z);
+                if (voxels.blocks[i] != BLOCK_AIR || voxels.blockAt(x, y - 1, z) != BLOCK_GRASS)
+                    continue;
+                uint32_t h = foliageHash(origin + glm::ivec3(x, y, z)) & 0xFF;
+                int kind;
+                if (h < FOLIAGE_GRASS_ODDS)
+                    kind = FOLIAGE_GRASS;
+                else if (h < FOLIAGE_GRASS_ODDS + FOLIAGE_FLOWER_ODDS)
+                    kind = FOLIAGE_RED_FLOWER + (int)(h % 3);
+                else
+                    continue;
+                foliage.push_back((uint32_t)voxels.light[i] << 16 | (uint32_t)kind << 12 | (uint32_t)i);
+            }
+        }
+    }
+}
+
+static const char* foliageVertexShaderSource = R"(
+#version 330 core
+layout (location = 2) in vec3 iBase;        // Per instance, relative to the camera
+layout (location = 3) in uvec4 iData;       // Kind, light, turn, height
+
+uniform vec3 sunDirection;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+};
+
+out vec2 uv;
+flat out uint kind;
+out vec3 lighting;
+
+// Two triangles a quad, two quads crossed at right angles
+const vec2 CORNERS[6] = vec2[6](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));
+
+float lightLevel(uint level)
+{
+    return pow(0.8, 15.0 - float(level));
+}
+
+void main()
+{
+    int quad = gl_VertexID / 6;
+    uv = CORNERS[gl_VertexID % 6];
+    kind = iData.x;
+
+    float angle = 0.785398 + float(quad) * 1.570796 + float(iData.z) / 256.0 * 3.141593;
+    vec2 across = vec2(cos(angle), sin(angle)) * (uv.x * 2.0 - 1.0) * 0.45;
+    float height = (kind == 0u ? 0.8 : 0.7) * float(iData.w) / 255.0;
+    gl_Position = viewProj * vec4(iBase + vec3(across.x, uv.y * height, across.y), 1.0);
+
+    // The air voxel's light, as the terrain's faces take it, a little
+    // darker at the foot
+    float sun = lightLevel(iData.y >> 4u) * (0.6 + 0.4 * max(sunDirection.y, 0.0));
+    vec3 lamps = lightLevel(iData.y & 15u) * vec3(1.0, 0.85, 0.6);
+    lighting = max(max(vec3(sun), lamps), vec3(0.04)) * mix(0.7, 1.0, uv.y);
+}
+)";
+
+static const char* foliageFragmentShaderSource = R"(
+#version 330 core
+in vec2 uv;
+flat in uint kind;
+in vec3 lighting;
+out vec4 FragColor;
+
+uniform float alphaTest;    // Coverage below which fragments are dropped
+
+const vec3 PETAL_COLORS[3] = vec3[3](vec3(0.85, 0.15, 0.12), vec3(0.95, 0.8, 0.15), vec3(0.3, 0.4, 0.95));
+
+void main()
+{
+    // Signed distance-like edge value, positive inside the shape
+    float edge;
+    vec3 color;
+    if (kind == 0u) {
+        // Three blades narrowing to points
+        float blade = abs(fract(uv.x * 3.0) - 0.5) * 2.0;
+        edge = (1.0 - uv.y) * 0.9 - blade;
+        color = mix(vec3(0.2, 0.42, 0.12), vec3(0.45, 0.7, 0.25), uv.y);
+    }
+    else {
+        // A stem and a round blossom with a yellow heart
+        float stem = min(0.05 - abs(uv.x - 0.5), 0.8 - uv.y);
+        float radius = length((uv - vec2(0.5, 0.82)) * vec2(1.0, 1.4));
+        float blossom = 0.16 - radius;
+        edge = max(stem, blossom);
+        color = blossom > stem ? (radius < 0.05 ? vec3(0.95, 0.85, 0.3) : PETAL_COLORS[int(min(kind - 1u, 2u))])
+                               : vec3(0.25, 0.5, 0.15);
+    }
+    // Sharpened to about a pixel wide, so alpha to coverage gives an
+    // antialiased edge rather than a soft one
+    float coverage = clamp(edge / max(fwidth(edge), 1e-4) + 0.5, 0.0, 1.0);
+    if (coverage <= alphaTest)
+        discard;
+    FragColor = vec4(color * lighting, coverage);
+}
+)";
+
+void FoliageRenderer::init(unsigned int cameraBinding)
+{
+    program.create(foliageVertexShaderSource, foliageFragmentShaderSource);
+    program.bindBlock("Camera", cameraBinding);
+
+    // No vertex data: corners come from gl_VertexID, instances from the stream
+    glGenVertexArrays(1, &VAO);
+    glState().bindVertexArray(VAO);
+    for (int attribute = 2; attribute <= 3; attribute++) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+    glState().bindVertexArray(0);
+}
+
+void FoliageRenderer::destroy()
+{
+    if (VAO == 0)
+        return;
+    glState().deleteVertexArrays(1, &VAO);
+    VAO = 0;
+    program.destroy();
+}
+
+int FoliageRenderer::draw(const ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye,
+    const glm::vec3& sunDirection, StreamBuffer& stream, int samples)
+{
+    PROFILE_ZONE("Draw foliage");
+    lastInstances = 0;
+
+    // Chunks with plants that reach within the radius and into the view
+    near.clear();
+    size_t bound = 0;
+    for (int c = 0; c < (int)renderer.chunks.size(); c++) {
+        const ChunkRenderData& data = renderer.chunks[c];
+        if (data.foliage.empty() || data.state != CHUNK_UPLOADED)
+            continue;
+        glm::dvec3 boxMin = glm::dvec3(data.chunk->coord) * (double)CHUNK_SIZE;
+        glm::dvec3 boxMax = boxMin + (double)CHUNK_SIZE;
+        glm::dvec3 closest = glm::clamp(eye, boxMin, boxMax);
+        if (glm::length(closest - eye) > (double)radius)
+            continue;
+        if (!frustum.intersectsAABB(glm::vec3(boxMin), glm::vec3(boxMax)))
+            continue;
+        near.push_back(c);
+        bound += data.foliage.size();
+    }
+    if (bound == 0)
+        return 0;
+
+    size_t offset;
+    GpuInstance* out = (GpuInstance*)stream.map(bound * sizeof(GpuInstance), sizeof(GpuInstance), offset);
+    if (!out)
+        return 0;
+    float thinning = radius * (1.0f - fullDensity);
+    int count = 0;
+    for (int c : near) {
+        const ChunkRenderData& data = renderer.chunks[c];
+        glm::ivec3 origin = data.chunk->coord * CHUNK_SIZE;
+        // Relative to the eye in double, then small enough for float
+        glm::vec3 chunkBase = glm::vec3(glm::dvec3(origin) - eye);
+        for (uint32_t entry : data.foliage) {
+            glm::ivec3 local = chunkIndexPosition((int)(entry & 0xFFF));
+            uint32_t h = foliageHash(origin + local) * 0x2C1B3C6Du;
+            // Off the block's centre by up to a quarter block either way
+            glm::vec3 base = chunkBase + glm::vec3(local) +
+                glm::vec3(0.25f + 0.5f * (float)(h >> 24) / 255.0f, 0.0f, 0.25f + 0.5f * (float)((h >> 16) & 0xFF) / 255.0f);
+            float distance = glm::length(base);
+            float density = distance <= radius - thinning ? 1.0f : 1.0f - (distance - (radius - thinning)) / thinning;
+            float rank = (float)((h >> 4) & 0xFFF) / 4096.0f;
+            if (rank >= density)
+                continue;
+            // Thinned-out plants shrink to nothing over the last stretch
+            float height = std::min((density - rank) * 8.0f, 1.0f);
+            GpuInstance& instance = out[count++];
+            instance.base = base;
+            instance.data[0] = (uint8_t)(entry >> 12 & 0xF);
+            instance.data[1] = (uint8_t)(entry >> 16);
+            instance.data[2] = (uint8_t)h;
+            instance.data[3] = (uint8_t)(height * 255.0f);
+        }
+    }
+    stream.unmap();
+    lastInstances = count;
+    if (count == 0)
+        return 0;
+
+    program.use();
+    glUniform3fv(program.uniform("sunDirection"), 1, glm::value_ptr(sunDirection));
+    // Alpha to coverage only acts on multisampled targets; elsewhere the
+    // half-covered edge is the cut
+    bool multisampled = samples > 1;
+    glUniform1f(program.uniform("alphaTest"), multisampled ? 0.0f : 0.5f);
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    const GLsizei stride = sizeof(GpuInstance);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(GpuInstance, base)));
+    glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, stride, (void*)(offset + offsetof(GpuInstance, data)));
+    if (multisampled)
+        glState().enable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 12, count);
+    if (multisampled)
+        glState().disable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+    glState().bindVertexArray(0);
+    return 1;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "chunk.h"
+#include "frustum.h"
+#include "shader.h"
+#include "stream_buffer.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct ChunkRenderer;
+
+// Ground cover: grass tufts and flowers standing in the air voxel over
+// grass blocks, chosen by a hash of the block so the same spots are covered
+// every time. They aren't blocks (nothing collides with them or can pick
+// them) and aren't meshed: findFoliage() lists a chunk's plants when its
+// mesh is built (ChunkRenderData::foliage), and FoliageRenderer draws the
+// ones near the eye as instances of two crossed quads.
+enum FoliageKind {
+    FOLIAGE_GRASS,
+    FOLIAGE_RED_FLOWER,
+    FOLIAGE_YELLOW_FLOWER,
+    FOLIAGE_BLUE_FLOWER,
+    FOLIAGE_KIND_COUNT
+};
+
+// The plants of a chunk snapshot, one entry each: the air voxel's index in
+// the low 12 bits, its kind in the next 4 and its light (see sunLight())
+// in the 8 above. Chunks without grass or air skip the scan.
+void findFoliage(const Chunk& chunk, const ChunkVoxels& voxels, std::vector<uint32_t>& foliage);
+
+// Draws the plants of the chunks within 'radius' of the eye with one
+// instanced draw: every plant's eye-relative base, kind, light, turn and
+// height written into the frame's stream buffer as per-instance attributes,
+// the quads' corners made by the vertex shader from gl_VertexID. The cover
+// thins out past fullDensity of the radius, down to none at the radius: a
+// plant is kept while a hash of its block is below the density there, and
+// shrinks as the density comes down to it instead of popping out. Blades
+// and petals are cut out of the quads in the fragment shader, their edges
+// resolved by alpha to coverage (an alpha test on single-sampled targets),
+// so the pass writes depth like any opaque geometry and needs no sorting.
+struct FoliageRenderer {
+    float radius = 48.0f;           // Blocks from the eye; nothing is drawn beyond
+    float fullDensity = 0.35f;      // Share of the radius drawn at full density
+    int lastInstances = 0;          // Plants drawn by the last draw()
+
+    // 'cameraBinding' is the uniform buffer binding of the Camera block
+    void init(unsigned int cameraBinding);
+    void destroy();
+
+    // Draw the plants of 'renderer''s chunks inside 'frustum' (world space)
+    // around 'eye' into a target of 'samples' samples per pixel, lit by
+    // 'sunDirection' (towards the sun). Returns the draw calls (0 when
+    // nothing is near or the stream region is full).
+    int draw(const ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye, const glm::vec3& sunDirection,
+        StreamBuffer& stream, int samples);
+
+private:
+    // Per-instance attributes as uploaded
+    struct GpuInstance {
+        glm::vec3 base;         // Centre of the plant's foot, relative to the eye
+        uint8_t data[4];        // Kind, light, turn (of half a circle), height (of the full one)
+    };
+
+    ShaderProgram program;
+    unsigned int VAO = 0;
+    std::vector<int> near;      // draw() scratch: chunks with plants in range
+};
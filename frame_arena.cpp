@@ -0,0 +1,77 @@
+#include "frame_arena.h"
+
+#include <cstdlib>
+
+// Default sizes; both grow to their observed peak
+const size_t FRAME_ARENA_BYTES = 1024 * 1024;
+const size_t THREAD_ARENA_BYTES = 256 * 1024;
+
+FrameArena::~FrameArena()
+{
+    reset();
+    free(base);
+}
+
+void FrameArena::init(size_t bytes)
+{
+    free(base);
+    base = (uint8_t*)malloc(bytes);
+    size = bytes;
+    offset = 0;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes <= size) {
+        offset = start + bytes;
+        if (offset + overflowBytes > peakBytes)
+            peakBytes = offset + overflowBytes;
+        return base + start;
+    }
+
+    // Out of space: serve from a separate block until the next reset
+    void* block = malloc(bytes + alignment);
+    overflow.push_back(block);
+    overflowBytes += bytes + alignment;
+    if (offset + overflowBytes > peakBytes)
+        peakBytes = offset + overflowBytes;
+    return (void*)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void FrameArena::reset()
+{
+    if (!overflow.empty()) {
+        for (void* block : overflow)
+            free(block);
+        overflow.clear();
+        overflowBytes = 0;
+
+        // Grow so the same load fits in the main block next time
+        init(peakBytes + peakBytes / 4);
+    }
+    offset = 0;
+}
+
+void FrameArena::rewind(size_t position)
+{
+    // Overflow blocks are only returned by reset()
+    if (position < offset)
+        offset = position;
+}
+
+FrameArena& frameArena()
+{
+    static FrameArena arena;
+    if (!arena.capacity())
+        arena.init(FRAME_ARENA_BYTES);
+    return arena;
+}
+
+FrameArena& threadArena()
+{
+    static thread_local FrameArena arena;
+    if (!arena.capacity())
+        arena.init(THREAD_ARENA_BYTES);
+    return arena;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Linear (bump) allocator for transient data. Allocation is a pointer bump
+// and everything is released at once by reset(). Running out of space falls
+// back to overflow blocks; the next reset() grows the main block to the peak
+// so steady-state frames never reach malloc.
+struct FrameArena {
+    FrameArena() = default;
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    ~FrameArena();
+
+    void init(size_t bytes);
+
+    void* allocate(size_t size, size_t alignment = 16);
+
+    // Uninitialised array of 'count' trivially destructible elements
+    template <typename T>
+    T* allocArray(size_t count) { return (T*)allocate(count * sizeof(T), alignof(T)); }
+
+    // Release everything allocated since the last reset
+    void reset();
+
+    // Position to rewind to, for scratch space nested inside a frame
+    size_t mark() const { return offset; }
+    void rewind(size_t position);
+
+    size_t used() const { return offset + overflowBytes; }
+    size_t capacity() const { return size; }
+    size_t peak() const { return peakBytes; }
+
+private:
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    size_t overflowBytes = 0;           // Held in overflow blocks this frame
+    size_t peakBytes = 0;
+    std::vector<void*> overflow;        // Freed by reset()
+};
+
+// Rewinds an arena to where it was on construction
+struct ArenaScope {
+    explicit ArenaScope(FrameArena& arena) : arena(arena), position(arena.mark()) {}
+    ~ArenaScope() { arena.rewind(position); }
+
+    FrameArena& arena;
+    size_t position;
+};
+
+// Arena reset once per iteration of the render loop (main thread only)
+FrameArena& frameArena();
+// Arena of the calling thread for job scratch. The job system rewinds it
+// after every job; workers reset it between jobs and the render loop resets
+// the main thread's once per frame.
+FrameArena& threadArena();
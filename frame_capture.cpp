@@ -0,0 +1,279 @@
+#include "frame_capture.h"
+
+#include "gl_extensions.h"
+#include "gl_state.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+const char* FrameCapture::SCREENSHOT_DIR = "screenshots";
+
+void FrameCapture::init()
+{
+    for (Readback& slot : ring)
+        glGenBuffers(1, &slot.buffer);
+}
+
+void FrameCapture::destroy()
+{
+    // Oldest first, so video frames stay in order
+    for (int i = 0; i < RING_SIZE; i++) {
+        Readback& slot = ring[(next + i) % RING_SIZE];
+        if (slot.fence)
+            finish(slot);
+    }
+    stopVideo();
+    if (jobs)
+        jobs->wait(writes);
+    for (Readback& slot : ring) {
+        glState().deleteBuffers(1, &slot.buffer);
+        slot.buffer = 0;
+    }
+}
+
+void FrameCapture::readback(unsigned int framebuffer, int width, int height, bool screenshot, bool video)
+{
+    if (width <= 0 || height <= 0)
+        return;
+    // The GPU is a whole ring behind; waiting beats dropping a screenshot
+    Readback& slot = ring[next];
+    if (slot.fence)
+        finish(slot);
+
+    glState().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.width != width || slot.height != height)
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, nullptr, GL_STREAM_READ);
+    glState().bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.screenshot = screenshot;
+    slot.video = video;
+    next = (next + 1) % RING_SIZE;
+}
+
+void FrameCapture::collect()
+{
+    // Oldest first, stopping at the first the GPU hasn't reached
+    for (int i = 0; i < RING_SIZE; i++) {
+        Readback& slot = ring[(next + i) % RING_SIZE];
+        if (!slot.fence)
+            continue;
+        GLenum status = glClientWaitSync((GLsync)slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        finish(slot);
+    }
+}
+
+void FrameCapture::finish(Readback& slot)
+{
+    glClientWaitSync((GLsync)slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync((GLsync)slot.fence);
+    slot.fence = nullptr;
+
+    bool video = slot.video && videoFile;
+    if (video && videoWidth == 0) {
+        videoWidth = slot.width;
+        videoHeight = slot.height;
+    }
+    if (video && (slot.width != videoWidth || slot.height != videoHeight)) {
+        droppedFrames++;
+        video = false;
+    }
+    if (!video && !slot.screenshot)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if ((int)queue.size() >= MAX_QUEUED_FRAMES && !slot.screenshot) {
+            droppedFrames++;
+            return;
+        }
+    }
+
+    // Copied out so the buffer is free for the next readback at once
+    CapturedFrame frame;
+    frame.pixels.resize((size_t)slot.width * slot.height * 4);
+    frame.width = slot.width;
+    frame.height = slot.height;
+    frame.screenshot = slot.screenshot;
+    frame.video = video;
+    glState().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)frame.pixels.size(), GL_MAP_READ_BIT);
+    if (pixels) {
+        memcpy(frame.pixels.data(), pixels, frame.pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!pixels)
+        return;
+
+    if (frame.screenshot)
+        screenshots++;
+    if (frame.video)
+        videoFrames++;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back(std::move(frame));
+    }
+    if (jobs)
+        jobs->schedule([this] { write(); }, &writes);
+    else
+        write();
+}
+
+void FrameCapture::write()
+{
+    // Whichever job gets here writes the oldest frame, so video frames keep their order
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+    CapturedFrame frame;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        frame = std::move(queue.front());
+        queue.pop_front();
+    }
+
+    if (frame.video) {
+        // Upright, without alpha
+        std::vector<uint8_t> row((size_t)frame.width * 3);
+        for (int y = frame.height - 1; y >= 0; y--) {
+            const uint8_t* source = &frame.pixels[(size_t)y * frame.width * 4];
+            for (int x = 0; x < frame.width; x++)
+                memcpy(&row[x * 3], &source[x * 4], 3);
+            fwrite(row.data(), 1, row.size(), videoFile);
+        }
+    }
+    if (frame.screenshot) {
+#ifdef _MSC_VER
+        _mkdir(SCREENSHOT_DIR);
+#else
+        mkdir(SCREENSHOT_DIR, 0755);
+#endif
+        // The first number without a file yet
+        std::string path;
+        FILE* existing;
+        do {
+            path = std::string(SCREENSHOT_DIR) + "/screenshot_" + std::to_string(nextScreenshot++) + ".qoi";
+            existing = fopen(path.c_str(), "rb");
+            if (existing)
+                fclose(existing);
+        } while (existing);
+
+        std::vector<uint8_t> image = encodeQoi(frame.pixels.data(), frame.width, frame.height);
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file && fwrite(image.data(), 1, image.size(), file) == image.size())
+            std::cout << "Screenshot: " << path << std::endl;
+        else
+            std::cout << "Screenshot: can't write " << path << std::endl;
+        if (file)
+            fclose(file);
+    }
+}
+
+bool FrameCapture::startVideo(const char* path)
+{
+    stopVideo();
+    videoFile = fopen(path, "wb");
+    if (!videoFile) {
+        std::cout << "Capture: can't write " << path << std::endl;
+        return false;
+    }
+    videoPath = path;
+    videoWidth = 0;
+    videoHeight = 0;
+    videoFrames = 0;
+    droppedFrames = 0;
+    std::cout << "Capture: started, " << path << std::endl;
+    return true;
+}
+
+void FrameCapture::stopVideo()
+{
+    if (!videoFile)
+        return;
+    // Frames still in the ring are left out; the queued ones are written first
+    if (jobs)
+        jobs->wait(writes);
+    fclose(videoFile);
+    videoFile = nullptr;
+    std::cout << "Capture: " << videoFrames << " frames of " << videoWidth << "x" << videoHeight << " (" << droppedFrames
+              << " dropped) in " << videoPath << ", raw rgb24: ffmpeg -f rawvideo -pixel_format rgb24 -video_size "
+              << videoWidth << "x" << videoHeight << " -i " << videoPath << " capture.mp4" << std::endl;
+}
+
+// QOI ("Quite OK Image"): runs, a 64-entry index of recent colours, and
+// small differences to the previous pixel, byte-aligned
+std::vector<uint8_t> encodeQoi(const uint8_t* rgba, int width, int height)
+{
+    std::vector<uint8_t> out;
+    out.reserve((size_t)width * height * 2 + 22);
+    const uint8_t header[14] = { 'q', 'o', 'i', 'f',
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        3, 0 };     // RGB, sRGB
+    out.insert(out.end(), header, header + sizeof(header));
+
+    uint8_t index[64][3] = {};
+    bool indexed[64] = {};      // The decoder's entries start transparent, so never match them
+    uint8_t previous[3] = { 0, 0, 0 };
+    int run = 0;
+    for (int y = height - 1; y >= 0; y--) {
+        for (int x = 0; x < width; x++) {
+            const uint8_t* pixel = &rgba[((size_t)y * width + x) * 4];
+            if (memcmp(pixel, previous, 3) == 0) {
+                if (++run == 62) {
+                    out.push_back((uint8_t)(0xC0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out.push_back((uint8_t)(0xC0 | (run - 1)));
+                run = 0;
+            }
+
+            // Alpha is always 255 in the hash
+            int hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + 255 * 11) % 64;
+            if (indexed[hash] && memcmp(index[hash], pixel, 3) == 0) {
+                out.push_back((uint8_t)hash);
+            }
+            else {
+                memcpy(index[hash], pixel, 3);
+                indexed[hash] = true;
+                int dr = (int8_t)(pixel[0] - previous[0]);
+                int dg = (int8_t)(pixel[1] - previous[1]);
+                int db = (int8_t)(pixel[2] - previous[2]);
+                int drg = dr - dg;
+                int dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.push_back((uint8_t)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    out.push_back((uint8_t)(0x80 | (dg + 32)));
+                    out.push_back((uint8_t)((drg + 8) << 4 | (dbg + 8)));
+                }
+                else {
+                    out.push_back(0xFE);
+                    out.insert(out.end(), pixel, pixel + 3);
+                }
+            }
+            memcpy(previous, pixel, 3);
+        }
+    }
+    if (run > 0)
+        out.push_back((uint8_t)(0xC0 | (run - 1)));
+    const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out.insert(out.end(), end, end + sizeof(end));
+    return out;
+}
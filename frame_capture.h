@@ -0,0 +1,79 @@
+#pragma once
+
+#include "job_system.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Screenshots and continuous capture without stalling the frame. Each
+// captured frame is read with glReadPixels into the next of a ring of pixel
+// pack buffers, which returns at once, and fenced. A later frame maps the
+// buffer once its fence has signalled, copies the pixels out and hands them
+// to a job: screenshots are encoded as QOI files in SCREENSHOT_DIR, video
+// frames are appended to one raw RGB file, in order. Render thread only,
+// except the jobs.
+struct FrameCapture {
+    static const int RING_SIZE = 3;             // Pack buffers; frames in flight before a readback is waited on
+    static const int MAX_QUEUED_FRAMES = 8;     // Copied out but not yet written; more are dropped
+    static const char* SCREENSHOT_DIR;
+
+    JobSystem* jobs = nullptr;
+
+    void init();
+    // Writes what is queued and closes the video
+    void destroy();
+
+    // Read the frame drawn into 'framebuffer' (0 = the back buffer), as a
+    // screenshot and/or a video frame. Call after it is drawn, before the swap.
+    void readback(unsigned int framebuffer, int width, int height, bool screenshot, bool video);
+    // Hand the readbacks the GPU has finished to the jobs. Every frame.
+    void collect();
+
+    // Raw RGB24 frames, top row first, all of the first frame's size
+    bool startVideo(const char* path);
+    void stopVideo();
+    bool videoOpen() const { return videoFile != nullptr; }
+
+    int screenshots = 0;        // Written or queued
+    int videoFrames = 0;
+    int droppedFrames = 0;      // Writes falling behind, or a video frame of another size
+
+private:
+    struct Readback {
+        unsigned int buffer = 0;
+        void* fence = nullptr;      // GLsync; null while the slot is free
+        int width = 0;
+        int height = 0;
+        bool screenshot = false;
+        bool video = false;
+    };
+    struct CapturedFrame {
+        std::vector<uint8_t> pixels;    // RGBA, bottom row first
+        int width;
+        int height;
+        bool screenshot;
+        bool video;
+    };
+
+    void finish(Readback& slot);
+    void write();
+
+    Readback ring[RING_SIZE];
+    int next = 0;               // Slot of the next readback; the oldest pending one after it
+    int nextScreenshot = 0;     // Number in the next screenshot's file name
+
+    JobCounter writes;
+    std::mutex queueMutex;
+    std::deque<CapturedFrame> queue;
+    std::mutex writeMutex;      // Held by the job writing, so frames go out in order
+    FILE* videoFile = nullptr;
+    const char* videoPath = nullptr;
+    int videoWidth = 0;
+    int videoHeight = 0;
+};
+
+// QOI image of 'rgba' (bottom row first), flipped upright, alpha dropped
+std::vector<uint8_t> encodeQoi(const uint8_t* rgba, int width, int height);
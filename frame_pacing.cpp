@@ -0,0 +1,102 @@
+#include "frame_pacing.h"
+#include "profiler.h"
+#include "render_device.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+const char* PRESENT_MODE_NAMES[PRESENT_MODE_COUNT] = { "uncapped", "vsync", "adaptive vsync", "frame limiter" };
+
+// Sleep requested per nap; the spin covers what naps can't
+const int NAP_MS = 1;
+// Weight of each nap in the duration estimate
+const double NAP_SMOOTHING = 0.05;
+
+PresentMode applyPresentMode(PresentMode mode)
+{
+    if (mode == PRESENT_ADAPTIVE_VSYNC && !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+        !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+        mode = PRESENT_VSYNC;
+    // A negative interval asks for late swaps to tear
+    glfwSwapInterval(mode == PRESENT_VSYNC ? 1 : mode == PRESENT_ADAPTIVE_VSYNC ? -1 : 0);
+    return mode;
+}
+
+void FrameLimiter::wait()
+{
+#ifdef _MSC_VER
+    // The default scheduler tick is 15.6 ms; naps are only useful at 1 ms
+    static bool fineTimer = timeBeginPeriod(1) == TIMERR_NOERROR;
+    (void)fineTimer;
+#endif
+    int64_t period = (int64_t)(1e9 / std::max(fps, 1.0));
+    int64_t now = profilerNow();
+    deadline = deadline == 0 ? now : deadline + period;
+    if (deadline < now)
+        deadline = now;
+
+    while ((double)(deadline - now) > napMean + std::sqrt(napVariance)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(NAP_MS));
+        int64_t woke = profilerNow();
+        double delta = (double)(woke - now) - napMean;
+        napMean += delta * NAP_SMOOTHING;
+        napVariance = (1.0 - NAP_SMOOTHING) * (napVariance + NAP_SMOOTHING * delta * delta);
+        now = woke;
+    }
+    while (profilerNow() < deadline) {
+    }
+}
+
+void SwapFences::afterSwap()
+{
+    int limit = std::min(maxQueued, MAX_QUEUED);
+    if (limit <= 0) {
+        destroy();
+        return;
+    }
+    fences[count++] = renderDevice().insertFence();
+    while (count > limit) {
+        renderDevice().finishFence(fences[0]);
+        renderDevice().destroyFence(fences[0]);
+        std::copy(fences + 1, fences + count, fences);
+        fences[--count] = nullptr;
+    }
+}
+
+void SwapFences::destroy()
+{
+    for (int i = 0; i < count; i++)
+        renderDevice().destroyFence(fences[i]);
+    std::fill(fences, fences + MAX_QUEUED + 1, nullptr);
+    count = 0;
+}
+
+void LookLatch::publish(float yaw, float pitch)
+{
+    uint32_t words[2];
+    memcpy(&words[0], &yaw, sizeof(float));
+    memcpy(&words[1], &pitch, sizeof(float));
+    look.store((uint64_t)words[0] | (uint64_t)words[1] << 32, std::memory_order_release);
+}
+
+void LookLatch::read(float& yaw, float& pitch) const
+{
+    uint64_t bits = look.load(std::memory_order_acquire);
+    uint32_t words[2] = { (uint32_t)bits, (uint32_t)(bits >> 32) };
+    memcpy(&yaw, &words[0], sizeof(float));
+    memcpy(&pitch, &words[1], sizeof(float));
+}
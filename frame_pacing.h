@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// How finished frames reach the screen
+enum PresentMode {
+    PRESENT_UNCAPPED,       // Swap immediately; as many frames as the GPU manages
+    PRESENT_VSYNC,          // Wait for vertical blank
+    PRESENT_ADAPTIVE_VSYNC, // Wait for vertical blank unless the frame is late, then tear (swap_control_tear)
+    PRESENT_LIMITED,        // Swap immediately, frames started at a fixed rate by FrameLimiter
+    PRESENT_MODE_COUNT
+};
+extern const char* PRESENT_MODE_NAMES[PRESENT_MODE_COUNT];
+
+// Set the swap interval for 'mode' on the current context. Adaptive vsync
+// falls back to plain vsync where WGL/GLX_EXT_swap_control_tear is missing.
+// Returns the mode in effect.
+PresentMode applyPresentMode(PresentMode mode);
+
+// Starts frames at a fixed rate: sleeps while the remaining time leaves room
+// for another nap, then spins to the deadline. How long a nap actually
+// takes is tracked as it goes (mean plus one standard deviation of recent
+// naps, exponentially weighted), so the
+// spin stays short where sleeps are precise and grows where the scheduler
+// is coarse. A frame that overran starts at once and the schedule restarts
+// from it, instead of catching up with a burst of short frames.
+struct FrameLimiter {
+    double fps = 60.0;
+
+    // Return at the start of the next frame
+    void wait();
+
+private:
+    int64_t deadline = 0;       // profilerNow() time of the next frame start, 0 = none yet
+    // Nap durations seen, in nanoseconds
+    double napMean = 2e6;
+    double napVariance = 0.0;
+};
+
+// Caps the frames the driver may queue ahead of the GPU, which would
+// otherwise be a few frames of input latency while the GPU is the
+// bottleneck. Each swap is followed by a fence, and the render thread waits
+// on the fence of the swap 'maxQueued' frames before.
+struct SwapFences {
+    static const int MAX_QUEUED = 3;
+    int maxQueued = 1;          // 0 = up to the driver
+
+    // Call after every swap, with the context current
+    void afterSwap();
+    void destroy();
+
+private:
+    void* fences[MAX_QUEUED + 1] = {};  // GLsync of recent swaps, oldest first
+    int count = 0;
+};
+
+// Late latching: the newest look direction (yaw and pitch in degrees),
+// published by the main thread as input arrives and read by the render
+// thread just before the frame's camera is uploaded, so the view takes in
+// mouse motion polled while the frame was being prepared. Both angles share
+// one atomic word, so a read never mixes two updates.
+struct LookLatch {
+    void publish(float yaw, float pitch);
+    void read(float& yaw, float& pitch) const;
+
+private:
+    std::atomic<uint64_t> look{ 0 };
+};
@@ -0,0 +1,34 @@
+#include "frame_packet.h"
+
+void FramePipeline::submit()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    pending = &packets[writeIndex];
+    reading = true;
+    condition.notify_all();
+    condition.wait(lock, [this] { return !reading || stopping; });
+    writeIndex ^= 1;
+}
+
+FramePacket* FramePipeline::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return pending != nullptr || stopping; });
+    FramePacket* packet = pending;
+    pending = nullptr;
+    return stopping ? nullptr : packet;
+}
+
+void FramePipeline::release()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    reading = false;
+    condition.notify_all();
+}
+
+void FramePipeline::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    condition.notify_all();
+}
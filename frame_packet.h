@@ -0,0 +1,171 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_mesh.h"
+#include "chunk_overlay.h"
+#include "console.h"
+#include "entity_systems.h"
+#include "frame_pacing.h"
+#include "frame_stats.h"
+#include "frustum.h"
+#include "gpu_particles.h"
+#include "lod_terrain.h"
+#include "memory_tracking.h"
+#include "voxel_raycast.h"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Figures for the stats overlay beyond the per-frame counters, refreshed
+// ten times a second by the main thread
+struct StatsOverlay {
+    FrameTimeSummary times;         // Over the frame history
+    size_t chunksInUse = 0;
+    size_t chunksReserved = 0;
+    // Pooled megabytes in use, then reserved
+    float voxelMB[2] = {};
+    float stagingMB[2] = {};
+    float heapMB[2] = {};
+    // Per memory tag: live and peak megabytes, and the most allocations
+    // made in one frame since the last refresh
+    float tagMB[MEMORY_TAG_COUNT][2] = {};
+    uint64_t tagFrameAllocations[MEMORY_TAG_COUNT] = {};
+};
+
+// Everything the render thread needs for one frame, built by the main thread
+struct FramePacket {
+    // Camera; view and projection are camera-relative (eye at the origin)
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::dvec3 eye = glm::dvec3(0.0);
+    Frustum frustum;                // World space
+    // Stereo (2): the views side by side, each eye's camera-relative view
+    // with the projection above (half the target's aspect); the frustum
+    // then holds both
+    int views = 1;
+    glm::mat4 eyeViews[2] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+    // Late latching: the look (degrees) the view was built from, which the
+    // render thread may turn towards the newest one (see LookLatch)
+    bool lateLatch = false;
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+
+    // Chunk set changes since the previous packet
+    std::vector<Chunk*> loadedChunks;
+    std::vector<glm::ivec3> unloadedChunks;
+    // Streamed area: columns within renderDistance of streamCenter
+    glm::ivec2 streamCenter = glm::ivec2(0);
+    int renderDistance = 0;
+
+    // Block under the crosshair
+    bool picked = false;
+    RayHit pick;
+
+    // Entity boxes, at this frame's interpolated positions
+    std::vector<EntityInstance> entities;
+    // Particle bursts started since the previous packet
+    std::vector<ParticleEmitter> particleEmitters;
+    Weather weather = WEATHER_CLEAR;
+    float frameSeconds = 0.0f;      // Since the previous packet, to advance the particles
+
+    double fps = 0.0;               // For the HUD
+    bool statsOverlay = true;       // HUD stats lines shown
+    bool minimap = true;            // HUD minimap shown
+    StatsOverlay stats;
+
+    // Render settings
+    MeshMode meshMode = MESH_GREEDY;
+    bool instancing = false;
+    bool remeshAll = false;
+    bool gpuCulling = true;
+    bool occlusionCulling = true;
+    bool entityOcclusion = true;    // Read the Hi-Z pyramid back for culling entities on the CPU
+    bool visibilityCulling = true;
+    bool horizonCulling = true;
+    bool depthPrePass = false;
+    bool occlusionQueries = false;
+    bool shadows = true;
+    bool fog = true;                // Distance fog and chunk fade-in
+    bool pointLights = true;        // Lamps as clustered point lights
+    bool occupancyVolume = true;    // Blocks around the eye in a 3D texture (particle collision)
+    bool clouds = true;             // Cloud layer blended over the sky
+    float foliageRadius = 0.0f;     // Ground cover drawn to this many blocks from the eye, 0 = none
+    bool weightedOit = false;       // Translucent blocks blended order-independently instead of sorted
+    bool dynamicResolution = false; // Scene resolution follows the GPU frame budget
+    bool temporalUpscale = true;    // A scaled scene is reconstructed over frames rather than stretched
+    bool fxaa = false;              // Post-process anti-aliasing when the scene is shown
+    PresentMode presentMode = PRESENT_UNCAPPED;
+    int maxQueuedFrames = 0;        // Swaps the GPU may lag behind, 0 = up to the driver
+    float frameBudgetMs = 15.0f;    // GPU frame time dynamic resolution holds to
+    size_t meshUploadBytes = 0;     // Chunk mesh vertex data uploaded per frame at most
+    size_t lodUploadBytes = 0;      // ... and LOD tile data
+    int meshSubmitsPerFrame = 0;    // Chunk snapshots handed to the mesher per frame at most
+    glm::vec3 sunDirection = glm::vec3(0.0f, 1.0f, 0.0f);  // Towards the sun
+    bool wireframe = false;
+    bool overdraw = false;          // Chunk surfaces counted per pixel instead of shaded
+    ChunkOverlayMode chunkOverlay = CHUNK_OVERLAY_OFF;  // What chunks are tinted by
+    bool profilerView = false;      // Timeline of the previous frame's zones (and pipeline statistics)
+    int lodDistance = 0;            // LOD horizon in chunk columns, 0 = off
+    FarFieldMode farField = FAR_FIELD_LOD;  // How the horizon is drawn
+    bool warmingUp = false;         // Window not shown yet; the first frame after is marked in the start-up timeline
+    const std::vector<glm::ivec3>* resumeChunks = nullptr;  // While warming up into a resumed session, the view it left (main thread's)
+    bool paused = false;            // Window minimised: chunk and mesh updates only, nothing drawn
+    ConsoleText console;            // Only filled in while open
+    bool screenshot = false;        // Read this frame back into a screenshot
+    bool captureVideo = false;      // ... and every frame into the capture file while set
+
+    // Written back by the render thread once the frame is submitted
+    int quads = 0;
+    int drawCalls = 0;
+    int stateCalls = 0;         // GL state changes issued
+    int filteredStateCalls = 0; // ... and dropped as redundant
+    int hudGlyphs = 0;          // HUD glyph quads rewritten
+    int chunkCount = 0;         // Chunks the renderer tracks
+    int reusedMeshes = 0;       // Of those, drawing another chunk's mesh
+    int sharedMeshes = 0;       // Meshes drawn by more than one chunk
+    int visibleChunks = -1;     // Left by CPU culling; -1 when culled on the GPU
+    int horizonCulled = 0;      // Dropped by CPU culling under the terrain horizon
+    size_t uploadedBytes = 0;   // Mesh vertex data uploaded
+    float uploadThreadMs = -1.0f;   // Upload thread's time on its last batch; -1 without one
+    int uploadedMeshes = 0;     // ... and the meshes it made up
+    int pendingMeshes = 0;      // Chunks still to be meshed or uploaded
+    int resumePending = -1;     // Of resumeChunks, not on the GPU yet; -1 without them
+    int pendingFarField = 0;    // Ray-marched regions or impostor faces still to build
+    bool programsReady = false; // Chunk programs linked
+};
+
+// Double-buffered hand-off of frame packets to the render thread. The main
+// thread fills one packet while the render thread submits the other. After
+// taking a packet the render thread first applies the parts that read state
+// the main thread also writes (world voxels, the chunk set), then calls
+// release(); submit() returns only after that point, so the main thread
+// never modifies that state while it is being read.
+struct FramePipeline {
+    // Main thread: the packet to fill next. Free once the previous submit()
+    // returned; its stats are those of the frame submitted two packets ago.
+    FramePacket& back() { return packets[writeIndex]; }
+    // Main thread: hand the back packet over and wait for its release()
+    void submit();
+
+    // Render thread: wait for the next packet; nullptr once stopped
+    FramePacket* acquire();
+    // Render thread: done with the shared state of the acquired packet
+    void release();
+
+    // Wake the render thread so its acquire() returns nullptr
+    void stop();
+
+private:
+    FramePacket packets[2];
+    int writeIndex = 0;
+    FramePacket* pending = nullptr; // Submitted, not yet acquired
+    bool reading = false;           // Render thread hasn't released the submitted packet
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
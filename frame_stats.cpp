@@ -0,0 +1,64 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr double FrameStats::HISTOGRAM_BUCKET_MS;
+
+void FrameStats::addFrame(double seconds, const FrameCounters& counters)
+{
+    frameMs[next] = (float)(seconds * 1000.0);
+    next = (next + 1) % HISTORY;
+    if (filled < HISTORY)
+        filled++;
+    latest = counters;
+}
+
+void FrameStats::clear()
+{
+    next = 0;
+    filled = 0;
+    latest = FrameCounters();
+}
+
+FrameTimeSummary summarizeFrameTimes(float* frameMs, int count)
+{
+    FrameTimeSummary result;
+    result.frames = count;
+    if (count <= 0)
+        return result;
+
+    std::sort(frameMs, frameMs + count);
+    double total = 0.0;
+    for (int i = 0; i < count; i++)
+        total += frameMs[i];
+
+    // Nearest rank: the smallest time at least p of the frames don't exceed
+    auto percentile = [&](double p) {
+        int rank = (int)std::ceil(p * count);
+        return (double)frameMs[std::max(rank, 1) - 1];
+    };
+    result.meanMs = total / count;
+    result.fps = result.meanMs > 0.0 ? 1000.0 / result.meanMs : 0.0;
+    result.p50Ms = percentile(0.50);
+    result.p95Ms = percentile(0.95);
+    result.p99Ms = percentile(0.99);
+    result.maxMs = frameMs[count - 1];
+    return result;
+}
+
+FrameTimeSummary FrameStats::summary() const
+{
+    float sorted[HISTORY];
+    std::copy(frameMs, frameMs + filled, sorted);
+    return summarizeFrameTimes(sorted, filled);
+}
+
+void FrameStats::histogram(int counts[HISTOGRAM_BUCKETS]) const
+{
+    std::fill(counts, counts + HISTOGRAM_BUCKETS, 0);
+    for (int i = 0; i < filled; i++) {
+        int bucket = (int)(frameMs[i] / HISTOGRAM_BUCKET_MS);
+        counts[std::min(std::max(bucket, 0), HISTOGRAM_BUCKETS - 1)]++;
+    }
+}
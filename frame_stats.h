@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+
+// Per-frame work counters, as reported by the render thread
+struct FrameCounters {
+    int drawCalls = 0;
+    int triangles = 0;
+    int loadedChunks = 0;
+    int visibleChunks = -1;     // After culling; -1 when the GPU decides (GPU culling, occlusion queries)
+    size_t uploadedBytes = 0;   // Chunk mesh vertex data sent this frame
+    int meshesUploaded = 0;     // Chunk meshes that went into the heap this frame
+};
+
+// Frame time distribution over the recorded history
+struct FrameTimeSummary {
+    int frames = 0;         // Frames the figures cover
+    double fps = 0.0;       // From the mean frame time
+    double meanMs = 0.0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+};
+
+// Summary of 'count' frame times in milliseconds; sorts them in place
+FrameTimeSummary summarizeFrameTimes(float* frameMs, int count);
+
+// Rolling statistics over the last HISTORY frames. Averages hide hitches,
+// so frame times are kept individually and summarised as percentiles, and
+// binned into a histogram of HISTOGRAM_BUCKET_MS wide buckets.
+struct FrameStats {
+    static const int HISTORY = 1024;
+    static const int HISTOGRAM_BUCKETS = 34;            // The last one counts everything longer
+    static constexpr double HISTOGRAM_BUCKET_MS = 1.0;
+
+    void addFrame(double seconds, const FrameCounters& counters);
+    void clear();
+
+    // Percentiles are by nearest rank over the history (sorted on each call)
+    FrameTimeSummary summary() const;
+    // Frames of the history per bucket
+    void histogram(int counts[HISTOGRAM_BUCKETS]) const;
+    // Counters of the latest frame
+    const FrameCounters& counters() const { return latest; }
+    int frames() const { return filled; }
+
+private:
+    float frameMs[HISTORY] = {};
+    int next = 0;       // Ring position of the next frame
+    int filled = 0;
+    FrameCounters latest;
+};
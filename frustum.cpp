@@ -0,0 +1,164 @@
+#include "frustum.h"
+#include "simd_math.h"
+
+void Frustum::update(const glm::mat4& viewProjection)
+{
+    // Rows of the matrix (glm is column-major: m[column][row])
+    glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+    planes[0] = row3 + row0; // left
+    planes[1] = row3 - row0; // right
+    planes[2] = row3 + row1; // bottom
+    planes[3] = row3 - row1; // top
+    planes[4] = row3 + row2; // near
+    planes[5] = row3 - row2; // far
+
+    for (int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool Frustum::intersectsAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+    for (int i = 0; i < 6; i++) {
+        const glm::vec4& p = planes[i];
+
+        // p-vertex: the box corner furthest along the plane normal
+        glm::vec3 positive(
+            p.x >= 0.0f ? boxMax.x : boxMin.x,
+            p.y >= 0.0f ? boxMax.y : boxMin.y,
+            p.z >= 0.0f ? boxMax.z : boxMin.z);
+
+        if (glm::dot(glm::vec3(p), positive) + p.w < 0.0f)
+            return false; // Entirely behind this plane
+    }
+    return true;
+}
+
+void AABBList::clear()
+{
+    minX.clear(); minY.clear(); minZ.clear();
+    maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void AABBList::add(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    minX.push_back(boxMin.x); minY.push_back(boxMin.y); minZ.push_back(boxMin.z);
+    maxX.push_back(boxMax.x); maxY.push_back(boxMax.y); maxZ.push_back(boxMax.z);
+}
+
+void AABBList::removeSwap(int i)
+{
+    std::vector<float>* lists[6] = { &minX, &minY, &minZ, &maxX, &maxY, &maxZ };
+    for (std::vector<float>* list : lists) {
+        (*list)[i] = list->back();
+        list->pop_back();
+    }
+}
+
+int cullAABBs(const Frustum& frustum, const AABBList& boxes, int* visible)
+{
+    return cullAABBRange(frustum, boxes, 0, boxes.size(), visible);
+}
+
+int cullAABBRange(const Frustum& frustum, const AABBList& boxes, int begin, int end, int* visible)
+{
+    const int count = end;
+
+    // The p-vertex choice depends only on the plane, so pick the source arrays up front
+    const float* px[6];
+    const float* py[6];
+    const float* pz[6];
+    for (int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        px[p] = plane.x >= 0.0f ? boxes.maxX.data() : boxes.minX.data();
+        py[p] = plane.y >= 0.0f ? boxes.maxY.data() : boxes.minY.data();
+        pz[p] = plane.z >= 0.0f ? boxes.maxZ.data() : boxes.minZ.data();
+    }
+
+    int visibleCount = 0;
+    int i = begin;
+
+#if defined(SIMD_AVX)
+    for (; i + 8 <= count; i += 8) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            __m256 d = _mm256_set1_ps(plane.w);
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(px[p] + i)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(py[p] + i)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(pz[p] + i)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        // Branch-free compaction: always write, advance only when visible
+        int mask = _mm256_movemask_ps(inside);
+        for (int k = 0; k < 8; k++) {
+            visible[visibleCount] = i + k;
+            visibleCount += (mask >> k) & 1;
+        }
+    }
+#elif defined(SIMD_SSE)
+    for (; i + 4 <= count; i += 4) {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            __m128 d = _mm_set1_ps(plane.w);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(px[p] + i)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(py[p] + i)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(pz[p] + i)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+
+        // Branch-free compaction: always write, advance only when visible
+        int mask = _mm_movemask_ps(inside);
+        visible[visibleCount] = i;     visibleCount += mask & 1;
+        visible[visibleCount] = i + 1; visibleCount += (mask >> 1) & 1;
+        visible[visibleCount] = i + 2; visibleCount += (mask >> 2) & 1;
+        visible[visibleCount] = i + 3; visibleCount += (mask >> 3) & 1;
+    }
+#endif
+
+    // Scalar tail (and fallback on targets without SSE)
+    for (; i < count; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            inside = plane.x * px[p][i] + plane.y * py[p][i] + plane.z * pz[p][i] + plane.w >= 0.0f;
+        }
+        if (inside)
+            visible[visibleCount++] = i;
+    }
+
+    return visibleCount;
+}
+
+bool isChunkInViewFrustum(const glm::vec3& chunkPos, const glm::mat4& view, const glm::mat4& projection, float chunkSize) {
+    // Define the 8 corners of the chunk
+    glm::vec3 corners[8];
+    corners[0] = chunkPos;
+    corners[1] = chunkPos + glm::vec3(chunkSize, 0, 0);
+    corners[2] = chunkPos + glm::vec3(0, chunkSize, 0);
+    corners[3] = chunkPos + glm::vec3(0, 0, chunkSize);
+    corners[4] = chunkPos + glm::vec3(chunkSize, chunkSize, 0);
+    corners[5] = chunkPos + glm::vec3(chunkSize, 0, chunkSize);
+    corners[6] = chunkPos + glm::vec3(0, chunkSize, chunkSize);
+    corners[7] = chunkPos + glm::vec3(chunkSize, chunkSize, chunkSize);
+
+    // Check if any of the chunk's corners are inside the view frustum
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 clipSpacePos = projection * view * glm::vec4(corners[i], 1.0f);
+
+        // Perform the frustum check for each corner
+        if (clipSpacePos.x > -clipSpacePos.w && clipSpacePos.x < clipSpacePos.w &&
+            clipSpacePos.y > -clipSpacePos.w && clipSpacePos.y < clipSpacePos.w &&
+            clipSpacePos.z > -clipSpacePos.w && clipSpacePos.z < clipSpacePos.w) {
+            return true; // If any corner is inside the frustum, the chunk is visible
+        }
+    }
+
+    // If no corner is visible, the chunk is not in the view frustum
+    return false;
+}
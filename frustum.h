@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// View frustum as 6 planes (ax + by + cz + d >= 0 inside), extracted once per frame
+struct Frustum {
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    // Extract normalised planes from a combined projection * view matrix
+    void update(const glm::mat4& viewProjection);
+
+    // Conservative AABB test: false only if the box is fully outside one plane
+    bool intersectsAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+};
+
+// Original corner-in-clip-space test, kept for comparison with Frustum.
+// Misses boxes that straddle the frustum with no corner inside.
+bool isChunkInViewFrustum(const glm::vec3& chunkPos, const glm::mat4& view, const glm::mat4& projection, float chunkSize);
+
+// Chunk bounding boxes in structure-of-arrays form for batched culling
+struct AABBList {
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    void clear();
+    void add(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    // Remove box i by moving the last box into its slot
+    void removeSwap(int i);
+    int size() const { return (int)minX.size(); }
+};
+
+// Test every box against the frustum, 8 (AVX) or 4 (SSE) at a time, and
+// write the indices of intersecting boxes to 'visible'. Returns the count.
+// 'visible' must have room for boxes.size() entries.
+int cullAABBs(const Frustum& frustum, const AABBList& boxes, int* visible);
+// Same for boxes [begin, end) only; 'visible' needs room for end - begin entries
+int cullAABBRange(const Frustum& frustum, const AABBList& boxes, int begin, int end, int* visible);
@@ -0,0 +1,135 @@
+#include "fxaa_pass.h"
+#include "gl_state.h"
+
+static const char* fxaaVertexSource = R"(
+#version 330 core
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char* fxaaFragmentSource = R"(
+#version 330 core
+uniform sampler2D scene;
+uniform vec2 texelSize;     // Of the scene
+uniform vec2 outputSize;
+out vec4 FragColor;
+
+const float EDGE_THRESHOLD = 0.125;     // Least contrast (relative to the brightest) treated as an edge
+const float EDGE_THRESHOLD_MIN = 0.0312;    // ... and absolute, so dark areas are left alone
+const float REDUCE_MUL = 1.0 / 8.0;
+const float REDUCE_MIN = 1.0 / 128.0;
+const float SPAN_MAX = 8.0;             // Longest blend along an edge, in scene texels
+
+float luma(vec3 color)
+{
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / outputSize;
+    vec3 rgbM = texture(scene, uv).rgb;
+    float lumaM = luma(rgbM);
+    float lumaNW = luma(texture(scene, uv + vec2(-1.0, -1.0) * texelSize).rgb);
+    float lumaNE = luma(texture(scene, uv + vec2(1.0, -1.0) * texelSize).rgb);
+    float lumaSW = luma(texture(scene, uv + vec2(-1.0, 1.0) * texelSize).rgb);
+    float lumaSE = luma(texture(scene, uv + vec2(1.0, 1.0) * texelSize).rgb);
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+    if (lumaMax - lumaMin < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD)) {
+        FragColor = vec4(rgbM, 1.0);
+        return;
+    }
+
+    // Along the edge: perpendicular to the luma gradient of the diagonals,
+    // stretched so its shorter component is one texel
+    vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * REDUCE_MUL, REDUCE_MIN);
+    float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+    dir = clamp(dir * rcpDirMin, vec2(-SPAN_MAX), vec2(SPAN_MAX)) * texelSize;
+
+    // Two taps close in, then two more further out unless they cross
+    // another edge (their luma leaves the local range)
+    vec3 rgbA = 0.5 * (texture(scene, uv + dir * (1.0 / 3.0 - 0.5)).rgb + texture(scene, uv + dir * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 rgbB = rgbA * 0.5 + 0.25 * (texture(scene, uv - dir * 0.5).rgb + texture(scene, uv + dir * 0.5).rgb);
+    float lumaB = luma(rgbB);
+    FragColor = vec4(lumaB < lumaMin || lumaB > lumaMax ? rgbA : rgbB, 1.0);
+}
+)";
+
+void FxaaPass::init()
+{
+    program.create(fxaaVertexSource, fxaaFragmentSource);
+    glGenVertexArrays(1, &emptyVAO);
+    glGenSamplers(1, &linearSampler);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void FxaaPass::destroy()
+{
+    if (emptyVAO == 0)
+        return;
+    program.destroy();
+    glDeleteSamplers(1, &linearSampler);
+    glState().deleteVertexArrays(1, &emptyVAO);
+    glState().deleteFramebuffers(1, &copyFramebuffer);
+    glState().deleteTextures(1, &copyTexture);
+    linearSampler = emptyVAO = copyFramebuffer = copyTexture = 0;
+    copyWidth = copyHeight = 0;
+}
+
+void FxaaPass::apply(unsigned int colorTexture, int width, int height,
+    unsigned int target, int targetWidth, int targetHeight, int unit)
+{
+    glState().bindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(0, 0, targetWidth, targetHeight);
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().disable(GL_DEPTH_TEST);
+
+    program.use();
+    glUniform1i(program.uniform("scene"), unit);
+    glUniform2f(program.uniform("texelSize"), 1.0f / width, 1.0f / height);
+    glUniform2f(program.uniform("outputSize"), (float)targetWidth, (float)targetHeight);
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    glState().bindTexture(GL_TEXTURE_2D, colorTexture);
+    glBindSampler(unit, linearSampler);
+    glState().bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindSampler(unit, 0);
+    glState().activeTexture(GL_TEXTURE0);
+
+    glState().enable(GL_DEPTH_TEST);
+    glState().polygonMode(polygonMode);
+}
+
+void FxaaPass::applyFramebuffer(unsigned int source, int width, int height,
+    unsigned int target, int targetWidth, int targetHeight, int unit)
+{
+    if (width != copyWidth || height != copyHeight || copyTexture == 0) {
+        glState().deleteFramebuffers(1, &copyFramebuffer);
+        glState().deleteTextures(1, &copyTexture);
+        copyWidth = width;
+        copyHeight = height;
+        glGenTextures(1, &copyTexture);
+        glState().bindTexture(GL_TEXTURE_2D, copyTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glState().bindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &copyFramebuffer);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, copyFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, copyTexture, 0);
+    }
+
+    glState().bindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFramebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    apply(copyTexture, width, height, target, targetWidth, targetHeight, unit);
+}
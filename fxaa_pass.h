@@ -0,0 +1,42 @@
+#pragma once
+
+#include "shader.h"
+
+#include <cstddef>
+
+// Post-process anti-aliasing (FXAA, after Lottes' "FXAA 3.11" console
+// variant): one fullscreen pass over the finished scene that finds edges
+// from the luma of each pixel's diagonal neighbours and blends along them
+// with a few bilinear taps. It costs a fixed few texture reads per output
+// pixel whatever the geometry, where MSAA multiplies the scene's depth and
+// colour work and memory by its sample count.
+//
+// The scene is read from a texture: the Hi-Z target's own, or a copy of
+// any framebuffer (the window's included) blitted into the pass's texture
+// first. When the scene is scaled the pass also stretches it to the output.
+struct FxaaPass {
+    void init();
+    void destroy();
+
+    // Filter 'colorTexture' ('width' x 'height') into 'target' over its
+    // 'targetWidth' x 'targetHeight', sampling through texture 'unit', and
+    // leave 'target' bound
+    void apply(unsigned int colorTexture, int width, int height,
+        unsigned int target, int targetWidth, int targetHeight, int unit);
+    // Same for the colour of 'source', copied into the pass's texture first;
+    // 'source' may be 'target'
+    void applyFramebuffer(unsigned int source, int width, int height,
+        unsigned int target, int targetWidth, int targetHeight, int unit);
+
+    // Bytes of the copy texture (0 until a framebuffer was filtered)
+    size_t textureBytes() const { return (size_t)copyWidth * copyHeight * 4; }
+
+private:
+    ShaderProgram program;
+    unsigned int emptyVAO = 0;      // Fullscreen triangle from gl_VertexID
+    unsigned int linearSampler = 0; // The filter's taps fall between texels
+    unsigned int copyFramebuffer = 0;
+    unsigned int copyTexture = 0;   // RGBA8 copy of a framebuffer's colour
+    int copyWidth = 0;
+    int copyHeight = 0;
+};
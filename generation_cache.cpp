@@ -0,0 +1,77 @@
+#include "generation_cache.h"
+#include "lz4.h"
+#include "region_file.h"
+#include "world.h"
+
+bool GenerationCache::fetch(uint32_t seed, const glm::ivec3& coord, PalettedBlocks& out)
+{
+    uint64_t key = generatedChunkKey(seed, coord);
+    std::vector<uint8_t> compressed;
+    uint32_t rawSize;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(key);
+        if (found == entries.end() || found->second.seed != seed || found->second.coord != coord) {
+            misses++;
+            return false;
+        }
+        lru.splice(lru.begin(), lru, found->second.recent);
+        compressed = found->second.compressed;
+        rawSize = found->second.rawSize;
+    }
+    // Decompressed outside the lock
+    std::vector<uint8_t> raw(rawSize);
+    if (!lz4Decompress(compressed.data(), compressed.size(), raw.data(), raw.size()) ||
+        !decodeChunkPayload(raw.data(), raw.size(), out)) {
+        misses++;
+        return false;
+    }
+    hits++;
+    return true;
+}
+
+void GenerationCache::store(uint32_t seed, const glm::ivec3& coord, const PalettedBlocks& blocks)
+{
+    std::vector<uint8_t> raw;
+    encodeChunkPayload(blocks, raw);
+    std::vector<uint8_t> compressed(lz4CompressBound(raw.size()));
+    compressed.resize(lz4Compress(raw.data(), raw.size(), compressed.data()));
+    compressed.shrink_to_fit();
+
+    uint64_t key = generatedChunkKey(seed, coord);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        used -= found->second.compressed.size();
+        lru.erase(found->second.recent);
+        entries.erase(found);
+    }
+    lru.push_front(key);
+    Entry& entry = entries[key];
+    entry.seed = seed;
+    entry.coord = coord;
+    entry.rawSize = (uint32_t)raw.size();
+    entry.compressed = std::move(compressed);
+    entry.recent = lru.begin();
+    used += entry.compressed.size();
+    while (used > budgetBytes && !lru.empty()) {
+        auto oldest = entries.find(lru.back());
+        used -= oldest->second.compressed.size();
+        entries.erase(oldest);
+        lru.pop_back();
+    }
+}
+
+void GenerationCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+    used = 0;
+}
+
+size_t GenerationCache::bytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Generated chunks addressed by generatedChunkKey(): what the generator
+// made for a (seed, generator version, coordinate), kept as LZ4-compressed
+// payloads (see encodeChunkPayload()) up to budgetBytes, the least recently
+// used dropped first. Since the same key always holds the same blocks, a
+// chunk that was never edited needn't be saved: coming back, it is taken
+// from here or generated again. Only chunks that took per-voxel work are
+// worth storing; uniform ones are generated in O(1).
+//
+// Safe to use from several threads: generator workers fetch and store
+// while the main thread loads.
+struct GenerationCache {
+    // Blocks generated for 'coord' from 'seed', into 'out'; false if not cached
+    bool fetch(uint32_t seed, const glm::ivec3& coord, PalettedBlocks& out);
+    void store(uint32_t seed, const glm::ivec3& coord, const PalettedBlocks& blocks);
+    void clear();
+
+    // Compressed bytes held
+    size_t bytes();
+    size_t budgetBytes = 64 * 1024 * 1024;
+
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+
+private:
+    struct Entry {
+        uint32_t seed;                  // The key's fields, against hash collisions
+        glm::ivec3 coord;
+        std::vector<uint8_t> compressed;
+        uint32_t rawSize;
+        std::list<uint64_t>::iterator recent;   // Position in 'lru'
+    };
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::list<uint64_t> lru;            // Keys, most recently used first
+    size_t used = 0;
+};
@@ -0,0 +1,92 @@
+#include "gl_debug.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "profiler.h"
+
+#include <iostream>
+
+static const char* sourceName(GLenum source)
+{
+    switch (source) {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+    case GL_DEBUG_SOURCE_APPLICATION: return "application";
+    default: return "other";
+    }
+}
+
+static const char* typeName(GLenum type)
+{
+    switch (type) {
+    case GL_DEBUG_TYPE_ERROR: return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behaviour";
+    case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+    default: return "other";
+    }
+}
+
+static void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei,
+    const GLchar* message, const void* userParam)
+{
+    ((GLDebugOutput*)userParam)->receive(source, type, id, severity, message);
+}
+
+bool GLDebugOutput::start()
+{
+    if (!glFeatures.debugOutput)
+        return false;
+    glState().enable(GL_DEBUG_OUTPUT);
+    glState().enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    // Notifications are mostly chatter (buffer placement and the like),
+    // except for performance ones
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PERFORMANCE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+    glDebugMessageCallback(debugCallback, this);
+    installed = true;
+    return true;
+}
+
+void GLDebugOutput::stop()
+{
+    if (!installed)
+        return;
+    glDebugMessageCallback(nullptr, nullptr);
+    glState().disable(GL_DEBUG_OUTPUT);
+    installed = false;
+}
+
+void GLDebugOutput::receive(unsigned int source, unsigned int type, unsigned int id, unsigned int severity, const char* message)
+{
+    // Zone names must be literals
+    const char* zoneName;
+    if (type == GL_DEBUG_TYPE_ERROR) {
+        errors++;
+        zoneName = "GL error";
+    }
+    else if (type == GL_DEBUG_TYPE_PERFORMANCE) {
+        performanceWarnings++;
+        zoneName = "GL performance warning";
+    }
+    else {
+        otherMessages++;
+        zoneName = "GL message";
+    }
+    int64_t now = profilerNow();
+    profilerRecordTrack("GL debug", ProfileZone{ zoneName, now, now, 0 });
+
+    int count;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        count = ++seen[(uint64_t)source << 32 | id];
+    }
+    if (count > PRINTS_PER_MESSAGE)
+        return;
+    const char* level = severity == GL_DEBUG_SEVERITY_HIGH ? "high" : severity == GL_DEBUG_SEVERITY_MEDIUM ? "medium" :
+        severity == GL_DEBUG_SEVERITY_LOW ? "low" : "notification";
+    std::cout << "GL " << typeName(type) << " (" << sourceName(source) << ", " << level << ", id " << id << "): " << message
+              << (count == PRINTS_PER_MESSAGE ? " [repeats are only counted]" : "") << std::endl;
+}
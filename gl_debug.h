@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// Driver messages of a debug context (GL 4.3 / KHR_debug) without polling
+// glGetError: errors, undefined behaviour and performance warnings (buffer
+// stalls, shader recompiles, redundant state) are logged, repeats of a
+// message counted rather than printed, and each is recorded as an instant
+// on the profiler's "GL debug" track, so traces show which zone it came
+// from. Callbacks are synchronous: they run on the thread making the call.
+//
+// Nothing is enabled unless the context was created with
+// GLFW_OPENGL_DEBUG_CONTEXT; without one start() does nothing, no callback
+// is installed and the driver does no extra work.
+struct GLDebugOutput {
+    static const int PRINTS_PER_MESSAGE = 3;    // Then only counted
+
+    // Install the callback on the current context (after loadGLExtensions()).
+    // False without debug output.
+    bool start();
+    void stop();
+    bool active() const { return installed; }
+
+    std::atomic<uint64_t> errors{ 0 };
+    std::atomic<uint64_t> performanceWarnings{ 0 };
+    std::atomic<uint64_t> otherMessages{ 0 };   // Everything else not filtered out
+
+    // Called by the driver
+    void receive(unsigned int source, unsigned int type, unsigned int id, unsigned int severity, const char* message);
+
+private:
+    bool installed = false;
+    std::mutex mutex;   // Guards seen
+    std::unordered_map<uint64_t, int> seen;    // Source and id -> times received
+};
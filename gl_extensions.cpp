@@ -0,0 +1,140 @@
+#include "gl_extensions.h"
+
+#include <GLFW/glfw3.h>
+
+#include <cstring>
+
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect = nullptr;
+PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC glMultiDrawElementsIndirectCount = nullptr;
+PFNGLDISPATCHCOMPUTEPROC glDispatchCompute = nullptr;
+PFNGLMEMORYBARRIERPROC glMemoryBarrier = nullptr;
+PFNGLBUFFERSTORAGEPROC glBufferStorage = nullptr;
+PFNGLBINDIMAGETEXTUREPROC glBindImageTexture = nullptr;
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR = nullptr;
+PFNGLDEBUGMESSAGECALLBACKPROC glDebugMessageCallback = nullptr;
+PFNGLDEBUGMESSAGECONTROLPROC glDebugMessageControl = nullptr;
+
+GLFeatures glFeatures;
+
+static bool hasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return true;
+    return false;
+}
+
+static bool versionAtLeast(int major, int minor)
+{
+    return glFeatures.major > major || (glFeatures.major == major && glFeatures.minor >= minor);
+}
+
+void loadGLExtensions()
+{
+    glGetIntegerv(GL_MAJOR_VERSION, &glFeatures.major);
+    glGetIntegerv(GL_MINOR_VERSION, &glFeatures.minor);
+
+    // Indirect draws read baseInstance, so base-instance support is needed as well
+    if (versionAtLeast(4, 3) || (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_base_instance")))
+        glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect");
+    glFeatures.multiDrawIndirect = glMultiDrawElementsIndirect != nullptr;
+
+    if (versionAtLeast(4, 3) || (hasExtension("GL_ARB_compute_shader") && hasExtension("GL_ARB_shader_storage_buffer_object"))) {
+        glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)glfwGetProcAddress("glDispatchCompute");
+        glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)glfwGetProcAddress("glMemoryBarrier");
+    }
+    glFeatures.computeShaders = glDispatchCompute != nullptr && glMemoryBarrier != nullptr;
+
+    // The ARB entry point has the same signature as the core one
+    if (versionAtLeast(4, 6))
+        glMultiDrawElementsIndirectCount = (PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC)glfwGetProcAddress("glMultiDrawElementsIndirectCount");
+    else if (hasExtension("GL_ARB_indirect_parameters"))
+        glMultiDrawElementsIndirectCount = (PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC)glfwGetProcAddress("glMultiDrawElementsIndirectCountARB");
+    glFeatures.indirectCount = glMultiDrawElementsIndirectCount != nullptr;
+
+    if (versionAtLeast(4, 4) || hasExtension("GL_ARB_buffer_storage"))
+        glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    glFeatures.bufferStorage = glBufferStorage != nullptr;
+
+    if (versionAtLeast(4, 2) || hasExtension("GL_ARB_shader_image_load_store"))
+        glBindImageTexture = (PFNGLBINDIMAGETEXTUREPROC)glfwGetProcAddress("glBindImageTexture");
+    glFeatures.imageLoadStore = glBindImageTexture != nullptr;
+
+    // Drivers may expose the entry points but no format they can reload
+    if (versionAtLeast(4, 1) || hasExtension("GL_ARB_get_program_binary")) {
+        glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+        glProgramBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+        glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+    }
+    GLint binaryFormats = 0;
+    if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    glFeatures.programBinary = binaryFormats > 0;
+
+    // Same entry point and completion query under both names
+    if (hasExtension("GL_KHR_parallel_shader_compile"))
+        glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (hasExtension("GL_ARB_parallel_shader_compile"))
+        glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    glFeatures.parallelShaderCompile = glMaxShaderCompilerThreadsKHR != nullptr;
+    if (glFeatures.parallelShaderCompile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu); // As many threads as the driver likes
+
+    // The extensions share the core enums
+    if (versionAtLeast(4, 6) || hasExtension("GL_ARB_texture_filter_anisotropic") || hasExtension("GL_EXT_texture_filter_anisotropic"))
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &glFeatures.maxAnisotropy);
+
+    // Sampling only: uploads use the core glCompressedTexImage3D
+    glFeatures.textureS3TC = hasExtension("GL_EXT_texture_compression_s3tc");
+    glFeatures.textureBPTC = versionAtLeast(4, 2) || hasExtension("GL_ARB_texture_compression_bptc");
+
+    // Only a debug context reports messages; the core profile's KHR_debug
+    // entry points have no suffix
+    GLint contextFlags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &contextFlags);
+    if ((contextFlags & GL_CONTEXT_FLAG_DEBUG_BIT) && (versionAtLeast(4, 3) || hasExtension("GL_KHR_debug"))) {
+        glDebugMessageCallback = (PFNGLDEBUGMESSAGECALLBACKPROC)glfwGetProcAddress("glDebugMessageCallback");
+        glDebugMessageControl = (PFNGLDEBUGMESSAGECONTROLPROC)glfwGetProcAddress("glDebugMessageControl");
+    }
+    glFeatures.debugOutput = glDebugMessageCallback != nullptr && glDebugMessageControl != nullptr;
+
+    // Storage blocks are only required in compute shaders; some drivers
+    // offer none to vertex shaders
+    GLint vertexStorageBlocks = 0;
+    if (versionAtLeast(4, 3))
+        glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexStorageBlocks);
+    glFeatures.vertexPulling = vertexStorageBlocks > 0;
+
+    glFeatures.pipelineStatistics = versionAtLeast(4, 6) || hasExtension("GL_ARB_pipeline_statistics_query");
+    glFeatures.memoryInfoNVX = hasExtension("GL_NVX_gpu_memory_info");
+    glFeatures.memoryInfoATI = hasExtension("GL_ATI_meminfo");
+    glFeatures.bindlessTextures = hasExtension("GL_ARB_bindless_texture");
+}
+
+bool queryGpuMemory(GpuMemoryInfo& info)
+{
+    info = GpuMemoryInfo();
+    if (glFeatures.memoryInfoNVX) {
+        GLint total = 0, available = 0, evictions = 0;
+        glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &total);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTION_COUNT_NVX, &evictions);
+        info.totalMB = total / 1024;
+        info.availableMB = available / 1024;
+        info.evictions = evictions;
+        return true;
+    }
+    if (glFeatures.memoryInfoATI) {
+        // Free in the pool, largest free block, then the same for auxiliary memory
+        GLint freeKB[4] = {};
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, freeKB);
+        info.availableMB = freeKB[0] / 1024;
+        return true;
+    }
+    return false;
+}
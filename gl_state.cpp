@@ -0,0 +1,230 @@
+#include "gl_state.h"
+
+// Slot of a buffer binding target in the cache, -1 if it isn't cached
+static int bufferSlot(GLenum target)
+{
+    switch (target) {
+    case GL_ARRAY_BUFFER: return 0;
+    case GL_ELEMENT_ARRAY_BUFFER: return 1;
+    case GL_UNIFORM_BUFFER: return 2;
+    case GL_COPY_READ_BUFFER: return 3;
+    case GL_COPY_WRITE_BUFFER: return 4;
+    case GL_DRAW_INDIRECT_BUFFER: return 5;
+    case GL_SHADER_STORAGE_BUFFER: return 6;
+    case GL_PARAMETER_BUFFER: return 7;
+    case GL_PIXEL_UNPACK_BUFFER: return 8;
+    case GL_PIXEL_PACK_BUFFER: return 9;
+    default: return -1;
+    }
+}
+
+// Slot of a glEnable capability in the cache, -1 if it isn't cached
+static int capabilitySlot(GLenum capability)
+{
+    switch (capability) {
+    case GL_DEPTH_TEST: return 0;
+    case GL_BLEND: return 1;
+    case GL_CULL_FACE: return 2;
+    case GL_SCISSOR_TEST: return 3;
+    default: return -1;
+    }
+}
+
+bool GLStateCache::change(GLuint& current, GLuint value)
+{
+    if (current == value) {
+        filteredCalls++;
+        return false;
+    }
+    current = value;
+    issuedCalls++;
+    return true;
+}
+
+void GLStateCache::useProgram(GLuint id)
+{
+    if (change(program, id))
+        glUseProgram(id);
+}
+
+void GLStateCache::bindVertexArray(GLuint vao)
+{
+    if (change(vertexArray, vao)) {
+        glBindVertexArray(vao);
+        buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    int slot = bufferSlot(target);
+    if (slot < 0) {
+        issuedCalls++;
+        glBindBuffer(target, buffer);
+    }
+    else if (change(buffers[slot], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    int slot = bufferSlot(target);
+    if (slot >= 0)
+        buffers[slot] = buffer;
+    issuedCalls++;
+    glBindBufferBase(target, index, buffer);
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    int slot = bufferSlot(target);
+    if (slot >= 0)
+        buffers[slot] = buffer;
+    issuedCalls++;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLStateCache::activeTexture(GLenum unit)
+{
+    if (change(activeUnit, unit - GL_TEXTURE0))
+        glActiveTexture(unit);
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture)
+{
+    if (target == GL_TEXTURE_2D && activeUnit < (GLuint)TEXTURE_UNITS) {
+        if (change(textures2D[activeUnit], texture))
+            glBindTexture(target, texture);
+        return;
+    }
+    issuedCalls++;
+    glBindTexture(target, texture);
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    if (target == GL_READ_FRAMEBUFFER) {
+        if (change(readFramebuffer, framebuffer))
+            glBindFramebuffer(target, framebuffer);
+    }
+    else if (target == GL_DRAW_FRAMEBUFFER) {
+        if (change(drawFramebuffer, framebuffer))
+            glBindFramebuffer(target, framebuffer);
+    }
+    else if (readFramebuffer == framebuffer && drawFramebuffer == framebuffer) {
+        filteredCalls++;
+    }
+    else {
+        readFramebuffer = drawFramebuffer = framebuffer;
+        issuedCalls++;
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+void GLStateCache::polygonMode(GLenum mode)
+{
+    if (change(polygon, mode))
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLStateCache::setCapability(GLenum capability, bool enabled)
+{
+    int slot = capabilitySlot(capability);
+    if (slot >= 0 && !change(capabilities[slot], enabled ? GL_TRUE : GL_FALSE))
+        return;
+    if (slot < 0)
+        issuedCalls++;
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+    if (change(depthFunction, func))
+        glDepthFunc(func);
+}
+
+void GLStateCache::depthMask(GLboolean enabled)
+{
+    if (change(depthWrites, enabled))
+        glDepthMask(enabled);
+}
+
+void GLStateCache::colorMask(GLboolean enabled)
+{
+    if (change(colorWrites, enabled))
+        glColorMask(enabled, enabled, enabled, enabled);
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* ids)
+{
+    for (GLsizei i = 0; i < count; i++)
+        for (GLuint& bound : buffers)
+            if (bound == ids[i])
+                bound = 0;
+    glDeleteBuffers(count, ids);
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* ids)
+{
+    for (GLsizei i = 0; i < count; i++)
+        if (vertexArray == ids[i]) {
+            vertexArray = 0;
+            buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+    glDeleteVertexArrays(count, ids);
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* ids)
+{
+    for (GLsizei i = 0; i < count; i++)
+        for (GLuint& bound : textures2D)
+            if (bound == ids[i])
+                bound = 0;
+    glDeleteTextures(count, ids);
+}
+
+void GLStateCache::deleteFramebuffers(GLsizei count, const GLuint* ids)
+{
+    for (GLsizei i = 0; i < count; i++) {
+        if (readFramebuffer == ids[i])
+            readFramebuffer = 0;
+        if (drawFramebuffer == ids[i])
+            drawFramebuffer = 0;
+    }
+    glDeleteFramebuffers(count, ids);
+}
+
+void GLStateCache::deleteProgram(GLuint id)
+{
+    // A current program stays in use until another one is made current,
+    // but its name may be handed out again
+    if (program == id)
+        program = UNKNOWN;
+    glDeleteProgram(id);
+}
+
+void GLStateCache::invalidate()
+{
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    for (GLuint& bound : buffers)
+        bound = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (GLuint& bound : textures2D)
+        bound = UNKNOWN;
+    readFramebuffer = drawFramebuffer = UNKNOWN;
+    polygon = UNKNOWN;
+    for (GLuint& state : capabilities)
+        state = UNKNOWN;
+    depthFunction = depthWrites = colorWrites = UNKNOWN;
+}
+
+GLStateCache& glState()
+{
+    static GLStateCache cache;
+    return cache;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "gl_extensions.h"
+
+#include <cstdint>
+
+// Shadow copy of the GL state the renderer changes most: program, VAO,
+// buffer, texture and framebuffer bindings, polygon mode and depth/colour
+// state. Calls that would set a value already current are dropped and
+// counted. Everything that changes this state must go through the cache
+// (or call invalidate() afterwards); the GL context is only used by one
+// thread at a time, so one cache is enough.
+struct GLStateCache {
+    void useProgram(GLuint program);
+    // Also forgets the element buffer binding, which belongs to the VAO
+    void bindVertexArray(GLuint vao);
+    void bindBuffer(GLenum target, GLuint buffer);
+    // Indexed bindings always reach GL; they also set the generic binding
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, GLuint texture);
+    // GL_FRAMEBUFFER sets both the read and draw bindings
+    void bindFramebuffer(GLenum target, GLuint framebuffer);
+
+    // Front and back faces together
+    void polygonMode(GLenum mode);
+    GLenum currentPolygonMode() const { return polygon; }
+    void enable(GLenum capability) { setCapability(capability, true); }
+    void disable(GLenum capability) { setCapability(capability, false); }
+    void depthFunc(GLenum func);
+    void depthMask(GLboolean enabled);
+    // All four channels together
+    void colorMask(GLboolean enabled);
+
+    // GL unbinds objects as they are deleted, so their names must leave the cache
+    void deleteBuffers(GLsizei count, const GLuint* buffers);
+    void deleteVertexArrays(GLsizei count, const GLuint* vaos);
+    void deleteTextures(GLsizei count, const GLuint* textures);
+    void deleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+    void deleteProgram(GLuint program);
+
+    // Treat all state as unknown, after GL was changed behind the cache's back
+    void invalidate();
+
+    // Calls passed to GL and calls dropped since the last resetCounters()
+    uint32_t issuedCalls = 0;
+    uint32_t filteredCalls = 0;
+    void resetCounters() { issuedCalls = 0; filteredCalls = 0; }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    static const int BUFFER_TARGETS = 10;
+    static const int TEXTURE_UNITS = 16;
+    static const int CAPABILITIES = 4;
+
+    // Compare and store; returns true when the call has to be issued
+    bool change(GLuint& current, GLuint value);
+    void setCapability(GLenum capability, bool enabled);
+
+    // Initial values are the GL defaults of a new context
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+    GLuint buffers[BUFFER_TARGETS] = {};
+    GLuint activeUnit = 0;
+    GLuint textures2D[TEXTURE_UNITS] = {};
+    GLuint readFramebuffer = 0;
+    GLuint drawFramebuffer = 0;
+    GLuint polygon = GL_FILL;
+    GLuint capabilities[CAPABILITIES] = {};     // GL_FALSE / GL_TRUE / UNKNOWN per capability
+    GLuint depthFunction = GL_LESS;
+    GLuint depthWrites = GL_TRUE;
+    GLuint colorWrites = GL_TRUE;
+};
+
+// Cache for the shared GL context
+GLStateCache& glState();
@@ -0,0 +1,299 @@
+#include "glyph_atlas.h"
+#include "gl_state.h"
+#include "memory_tracking.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_MODULE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Atlas width; rows of glyphs are packed onto shelves and the height grows to fit
+const int ATLAS_WIDTH = 512;
+const int GLYPH_PADDING = 1; // Keeps filtered samples from bleeding into neighbours
+const unsigned char FALLBACK_CHAR = '?';
+
+// Finished atlases are cached here, relative to the working directory
+static const char* ATLAS_CACHE_DIR = "font_cache";
+static const uint32_t ATLAS_CACHE_MAGIC = 0x4C544147; // "GATL"
+static const uint32_t ATLAS_CACHE_VERSION = 1;
+
+// Printable characters: ASCII and the Latin-1 supplement (code point = byte)
+static bool isPrintable(int c)
+{
+    return (c >= 0x20 && c < 0x7F) || c >= 0xA0;
+}
+
+// FNV-1a over a block of bytes
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string atlasCachePath(uint64_t key)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%016llx.atlas", ATLAS_CACHE_DIR, (unsigned long long)key);
+    return path;
+}
+
+bool GlyphAtlas::init(const char* path, int glyphPixelHeight, GlyphMode glyphMode)
+{
+    MemoryTagScope memoryTag(MEMORY_TEXT);
+    // The font's contents are part of the key, so an updated font file
+    // never picks up a stale atlas
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        std::cout << "ERROR::FREETYPE: Failed to load font " << path << std::endl;
+        return false;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    char buffer[1 << 16];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash = hashBytes(hash, buffer, read);
+    fclose(file);
+    const int32_t settings[4] = { glyphPixelHeight, (int32_t)glyphMode, SDF_SPREAD, ATLAS_WIDTH };
+    cacheKey = hashBytes(hash, settings, sizeof(settings));
+
+    fontPath = path;
+    pixelHeight = glyphPixelHeight;
+    mode = glyphMode;
+    width = ATLAS_WIDTH;
+    if (!loadCache()) {
+        memset(state, ENTRY_UNKNOWN, sizeof(state));
+        pixels.clear();
+        height = 0;
+        penX = GLYPH_PADDING;
+        shelfY = GLYPH_PADDING;
+        shelfHeight = 0;
+    }
+    dirtyTop = 0;
+    dirtyBottom = height;
+    textureHeight = 0;
+    return true;
+}
+
+void GlyphAtlas::destroy()
+{
+    if (cacheDirty && !faceFailed)
+        storeCache();
+    cacheDirty = false;
+    if (face)
+        FT_Done_Face(face);
+    if (library)
+        FT_Done_FreeType(library);
+    face = nullptr;
+    library = nullptr;
+    if (texture != 0)
+        glState().deleteTextures(1, &texture);
+    texture = 0;
+    textureHeight = 0;
+}
+
+const Glyph& GlyphAtlas::lookupMissing(int c)
+{
+    static const Glyph EMPTY;
+    if (state[c] == ENTRY_UNKNOWN) {
+        MemoryTagScope memoryTag(MEMORY_TEXT);
+        rasterise(c);
+    }
+    if (state[c] == ENTRY_READY)
+        return glyphs[c];
+    if (c == FALLBACK_CHAR)
+        return EMPTY; // Not even the fallback exists
+    return glyph((char)FALLBACK_CHAR);
+}
+
+bool GlyphAtlas::hasGlyph(char c)
+{
+    unsigned char index = (unsigned char)c;
+    if (state[index] == ENTRY_UNKNOWN)
+        rasterise(index);
+    return state[index] == ENTRY_READY;
+}
+
+bool GlyphAtlas::openFace()
+{
+    if (face)
+        return true;
+    if (faceFailed)
+        return false;
+    faceFailed = true;
+    if (FT_Init_FreeType(&library)) {
+        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+        library = nullptr;
+        return false;
+    }
+    if (FT_New_Face(library, fontPath.c_str(), 0, &face)) {
+        std::cout << "ERROR::FREETYPE: Failed to load font " << fontPath << std::endl;
+        face = nullptr;
+        return false;
+    }
+    if (mode == GLYPH_SDF) {
+        FT_Int spread = SDF_SPREAD;
+        FT_Property_Set(library, "sdf", "spread", &spread);
+        FT_Property_Set(library, "bsdf", "spread", &spread);
+    }
+    FT_Set_Pixel_Sizes(face, 0, pixelHeight);
+    lineHeight = (int)(face->size->metrics.height >> 6);
+    faceFailed = false;
+    return true;
+}
+
+void GlyphAtlas::reserveRows(int rows)
+{
+    if (rows <= height)
+        return;
+    int grown = std::max(height, 64);
+    while (grown < rows)
+        grown *= 2;
+    height = grown;
+    pixels.resize((size_t)width * height, 0);
+}
+
+void GlyphAtlas::rasterise(int c)
+{
+    state[c] = ENTRY_MISSING;
+    if (!isPrintable(c) || !openFace())
+        return;
+    cacheDirty = true;
+    if (FT_Get_Char_Index(face, (FT_ULong)c) == 0)
+        return;
+    bool rendered;
+    if (mode == GLYPH_BITMAP) {
+        rendered = FT_Load_Char(face, (FT_ULong)c, FT_LOAD_RENDER) == 0;
+    }
+    else {
+        // Unhinted outlines: hinting snaps to the rasterised size's pixel
+        // grid, which the distance field is meant to be independent of
+        rendered = FT_Load_Char(face, (FT_ULong)c, FT_LOAD_NO_HINTING) == 0 &&
+            FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF) == 0;
+    }
+    if (!rendered)
+        return;
+
+    const FT_Bitmap& bitmap = face->glyph->bitmap;
+    Glyph& g = glyphs[c];
+    g.size = glm::ivec2((int)bitmap.width, (int)bitmap.rows);
+    g.bearing = glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+    g.advance = (int)(face->glyph->advance.x >> 6); // 26.6 fixed point
+
+    // Shelf packing: glyphs left to right, a new row when one doesn't fit
+    if (penX + g.size.x + GLYPH_PADDING > width) {
+        penX = GLYPH_PADDING;
+        shelfY += shelfHeight + GLYPH_PADDING;
+        shelfHeight = 0;
+    }
+    if (g.size.y > shelfHeight)
+        shelfHeight = g.size.y;
+    reserveRows(shelfY + shelfHeight + GLYPH_PADDING);
+    for (int row = 0; row < g.size.y; row++)
+        memcpy(&pixels[(size_t)(shelfY + row) * width + penX], bitmap.buffer + row * bitmap.pitch, (size_t)g.size.x);
+    g.uv = glm::vec4((float)penX, (float)shelfY, (float)(penX + g.size.x), (float)(shelfY + g.size.y));
+    penX += g.size.x + GLYPH_PADDING;
+
+    dirtyTop = std::min(dirtyTop, shelfY);
+    dirtyBottom = std::max(dirtyBottom, shelfY + g.size.y);
+    state[c] = ENTRY_READY;
+    rasterisedGlyphs++;
+}
+
+void GlyphAtlas::upload()
+{
+    if (height == 0 || (textureHeight == height && dirtyTop >= dirtyBottom))
+        return;
+    glState().activeTexture(GL_TEXTURE0 + textureUnit);
+    if (texture == 0) {
+        glGenTextures(1, &texture);
+        glState().bindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glState().bindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows are tightly packed bytes
+    if (textureHeight != height) {
+        // Grown (or new): reallocate with everything
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        textureHeight = height;
+    }
+    else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirtyTop, width, dirtyBottom - dirtyTop,
+            GL_RED, GL_UNSIGNED_BYTE, &pixels[(size_t)dirtyTop * width]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glState().activeTexture(GL_TEXTURE0);
+    dirtyTop = height;
+    dirtyBottom = 0;
+}
+
+// Cache file: header, entry states, glyph metrics, then the texels
+bool GlyphAtlas::loadCache()
+{
+    FILE* file = fopen(atlasCachePath(cacheKey).c_str(), "rb");
+    if (!file)
+        return false;
+
+    uint32_t magic = 0, version = 0;
+    uint64_t key = 0;
+    int32_t header[5]; // lineHeight, height, penX, shelfY, shelfHeight
+    bool valid = fread(&magic, sizeof(magic), 1, file) == 1 && magic == ATLAS_CACHE_MAGIC &&
+        fread(&version, sizeof(version), 1, file) == 1 && version == ATLAS_CACHE_VERSION &&
+        fread(&key, sizeof(key), 1, file) == 1 && key == cacheKey &&
+        fread(header, sizeof(header), 1, file) == 1 &&
+        header[1] >= 0 && header[1] <= 16384;
+    if (valid) {
+        pixels.assign((size_t)width * header[1], 0);
+        valid = fread(state, sizeof(state), 1, file) == 1 &&
+            fread(glyphs, sizeof(glyphs), 1, file) == 1 &&
+            fread(pixels.data(), 1, pixels.size(), file) == pixels.size();
+    }
+    fclose(file);
+    if (!valid) {
+        pixels.clear();
+        return false;
+    }
+    lineHeight = header[0];
+    height = header[1];
+    penX = header[2];
+    shelfY = header[3];
+    shelfHeight = header[4];
+    return true;
+}
+
+void GlyphAtlas::storeCache() const
+{
+#ifdef _MSC_VER
+    _mkdir(ATLAS_CACHE_DIR);
+#else
+    mkdir(ATLAS_CACHE_DIR, 0755);
+#endif
+    FILE* file = fopen(atlasCachePath(cacheKey).c_str(), "wb");
+    if (!file)
+        return;
+    const int32_t header[5] = { lineHeight, height, penX, shelfY, shelfHeight };
+    fwrite(&ATLAS_CACHE_MAGIC, sizeof(ATLAS_CACHE_MAGIC), 1, file);
+    fwrite(&ATLAS_CACHE_VERSION, sizeof(ATLAS_CACHE_VERSION), 1, file);
+    fwrite(&cacheKey, sizeof(cacheKey), 1, file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(state, sizeof(state), 1, file);
+    fwrite(glyphs, sizeof(glyphs), 1, file);
+    fwrite(pixels.data(), 1, pixels.size(), file);
+    fclose(file);
+}
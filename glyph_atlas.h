@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+// Metrics and atlas position of one rasterised glyph
+struct Glyph {
+    glm::ivec2 size = glm::ivec2(0);    // Bitmap size in pixels
+    glm::ivec2 bearing = glm::ivec2(0); // Offset from the pen position to the bitmap's top-left, y up
+    int advance = 0;                    // Pen advance in pixels
+    glm::vec4 uv = glm::vec4(0.0f);     // Rect in texels: left, top, right, bottom
+};
+
+// What the atlas texels hold
+enum GlyphMode {
+    GLYPH_BITMAP,   // Coverage; sharp only near the rasterised size
+    GLYPH_SDF       // Signed distance to the outline, 0.5 on the edge; sharp at any scale
+};
+
+// The printable Latin-1 characters of a font in one single-channel texture,
+// so any amount of text draws with a single texture bind. Lookup is a flat
+// 256-entry table indexed by the byte value.
+//
+// Glyphs are rasterised by FreeType the first time they are looked up, and
+// the atlas is saved to a cache file keyed by the font's contents, size and
+// mode. A later run starts from that file and only opens FreeType when it
+// meets a character the cache hasn't seen.
+struct GlyphAtlas {
+    static const int TABLE_SIZE = 256;
+    static const int SDF_SPREAD = 4;    // Pixels of distance on each side of the edge
+
+    unsigned int texture = 0;           // Created by the first upload()
+    int textureUnit = 0;                // Unit upload() leaves the texture bound to, for good
+    int width = 0;
+    int height = 0;                     // Grows while glyphs are added; rects are in texels so they stay valid
+    int pixelHeight = 0;                // Size the glyphs were rasterised at
+    int lineHeight = 0;                 // Baseline to baseline in pixels, once the cache or font is loaded
+    GlyphMode mode = GLYPH_BITMAP;
+    int rasterisedGlyphs = 0;           // Glyphs FreeType rendered this run
+
+    // Prepare the font at 'pixelHeight', loading the cached atlas when there
+    // is one. False if the font file can't be read. SDF glyphs carry
+    // SDF_SPREAD pixels of border, included in their size and bearing, so
+    // they lay out exactly like bitmap glyphs.
+    bool init(const char* fontPath, int pixelHeight, GlyphMode mode = GLYPH_BITMAP);
+    // Saves the cache if glyphs were added, then releases the texture and FreeType
+    void destroy();
+
+    // Glyph for a character, rasterised now if it hasn't been seen. Bytes the
+    // font has no glyph for (and control characters) show the fallback '?'.
+    const Glyph& glyph(char c)
+    {
+        unsigned char index = (unsigned char)c;
+        return state[index] == ENTRY_READY ? glyphs[index] : lookupMissing(index);
+    }
+    // Whether the font provides the character itself
+    bool hasGlyph(char c);
+    // Send glyphs added since the last call to the texture (needs the GL
+    // context), bound to 'textureUnit'
+    void upload();
+
+private:
+    enum EntryState : uint8_t {
+        ENTRY_UNKNOWN,  // Not rasterised yet
+        ENTRY_READY,
+        ENTRY_MISSING   // The font has no glyph for it
+    };
+
+    // Slow path of glyph(): rasterise unknown entries, resolve missing ones
+    const Glyph& lookupMissing(int c);
+    // Rasterise and pack one character, setting its state
+    void rasterise(int c);
+    // Open FreeType and the face on first need; false if the font won't load
+    bool openFace();
+    // Grow the CPU copy so 'rows' fit, in power-of-two steps
+    void reserveRows(int rows);
+    bool loadCache();
+    void storeCache() const;
+
+    Glyph glyphs[TABLE_SIZE];
+    uint8_t state[TABLE_SIZE] = {};
+
+    std::string fontPath;
+    uint64_t cacheKey = 0;
+    bool cacheDirty = false;            // Entries changed since the cache was loaded
+    FT_LibraryRec_* library = nullptr;
+    FT_FaceRec_* face = nullptr;
+    bool faceFailed = false;
+
+    // Shelf packing state and the CPU copy of the texture
+    std::vector<uint8_t> pixels;
+    int penX = 0;
+    int shelfY = 0;
+    int shelfHeight = 0;
+    int textureHeight = 0;              // Height the texture was last allocated with
+    int dirtyTop = 0;                   // Rows to upload
+    int dirtyBottom = 0;
+};
@@ -0,0 +1,351 @@
+#include "gpu_culling.h"
+#include "chunk_renderer.h"
+#include "frame_arena.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "shader.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstring>
+
+// Layout of one chunk record in the std430 record buffer
+struct ChunkRecord {
+    float boundsMin[4];
+    int32_t baseVertex;
+    uint32_t page;
+    uint32_t pageBase;      // First command slot of the page
+    float fadeStart;        // ChunkRenderData::fadeStart
+};
+static_assert(sizeof(ChunkRecord) == 32, "records must match the std430 layout");
+
+// One meshlet (ChunkMesh::Meshlet) of a chunk record; its command slot is
+// its index in the meshlet buffer
+struct MeshletRecord {
+    uint32_t chunk;         // Chunk record
+    uint32_t range;         // First quad, quads in bits 16-23, face in bits 24-26
+    uint32_t bounds;        // ChunkMesh::Meshlet::bounds
+};
+static_assert(sizeof(MeshletRecord) == 12, "records must match the std430 layout");
+
+static const char* cullShaderSource = R"(
+#version 430 core
+layout (local_size_x = 64) in;
+
+struct ChunkRecord {
+    vec4 boundsMin;
+    int baseVertex;
+    uint page;
+    uint pageBase;
+    float fadeStart;
+};
+struct MeshletRecord {
+    uint chunk;
+    uint range;
+    uint bounds;
+};
+
+layout (std430, binding = 0) readonly buffer Records { ChunkRecord records[]; };
+layout (std430, binding = 1) writeonly buffer Commands { uint commands[]; };
+layout (std430, binding = 2) buffer Counts { uint drawCounts[]; };
+layout (std430, binding = 3) writeonly buffer Offsets { float offsets[]; };
+layout (std430, binding = 5) readonly buffer Meshlets { MeshletRecord meshlets[]; };
+
+uniform vec4 planes[6];
+uniform uint meshletCount;
+uniform bool compact; // Append visible commands instead of zeroing culled ones
+uniform uint views;         // Instances per command, one per view (chunkViewCount())
+uniform ivec3 eyeBlock;     // Camera position split into whole blocks and a fraction,
+uniform vec3 eyeFraction;   // so origins are offset exactly in integers first
+uniform float clock;        // ChunkRenderer::clock and fadeSeconds, for the fade-in
+uniform float fadeSeconds;  // written with each origin (as ChunkRenderer::fadeOf())
+
+uniform bool occlusion;
+uniform mat4 reprojection;  // Camera-relative position -> clip space of the Hi-Z frame
+layout (binding = 0) uniform sampler2D hiz; // Farthest depth per texel, one level per halving
+
+// True if the box lies entirely behind the depth recorded in the pyramid
+bool occluded(vec3 lo, vec3 hi)
+{
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearest = 1.0;
+    for (int c = 0; c < 8; c++) {
+        vec3 corner = mix(lo, hi, vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+        vec4 clip = reprojection * vec4(corner, 1.0);
+        if (clip.w <= 0.0)
+            return false; // Reaches behind the eye; can't bound it on screen
+        vec3 ndc = clip.xyz / clip.w;
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    uvMin = clamp(uvMin, 0.0, 1.0);
+    uvMax = clamp(uvMax, 0.0, 1.0);
+
+    // Pick the level where the rectangle spans at most 2x2 texels. Texels of
+    // level n cover pixels p >> n, so map through pixel coordinates.
+    ivec2 size0 = textureSize(hiz, 0);
+    ivec2 p0 = ivec2(uvMin * vec2(size0));
+    ivec2 p1 = min(ivec2(uvMax * vec2(size0)), size0 - 1);
+    int span = max(p1.x - p0.x, p1.y - p0.y) + 1;
+    int level = min(int(ceil(log2(float(span)))), textureQueryLevels(hiz) - 1);
+
+    ivec2 last = textureSize(hiz, level) - 1;
+    ivec2 t0 = min(p0 >> level, last);
+    ivec2 t1 = min(p1 >> level, last);
+    float farthest = max(max(texelFetch(hiz, t0, level).r, texelFetch(hiz, ivec2(t1.x, t0.y), level).r),
+                         max(texelFetch(hiz, ivec2(t0.x, t1.y), level).r, texelFetch(hiz, t1, level).r));
+    return nearest > farthest;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= meshletCount)
+        return;
+
+    // The meshlet's box, world-space and relative to the eye
+    MeshletRecord m = meshlets[i];
+    ChunkRecord r = records[m.chunk];
+    vec3 lo = vec3((uvec3(m.bounds) >> uvec3(0u, 5u, 10u)) & 31u);
+    vec3 hi = vec3((uvec3(m.bounds) >> uvec3(15u, 20u, 25u)) & 31u);
+    vec3 boundsMin = r.boundsMin.xyz + lo;
+    vec3 boundsMax = r.boundsMin.xyz + hi;
+    vec3 origin = vec3(ivec3(r.boundsMin.xyz) - eyeBlock) - eyeFraction;
+    vec3 boxMin = origin + lo;
+    vec3 boxMax = origin + hi;
+
+    // p-vertex test against every plane
+    bool inside = true;
+    for (int p = 0; p < 6; p++) {
+        vec3 pv = mix(boundsMin, boundsMax, greaterThanEqual(planes[p].xyz, vec3(0.0)));
+        if (dot(planes[p].xyz, pv) + planes[p].w < 0.0)
+            inside = false;
+    }
+
+    // Every quad of the meshlet faces one direction: away from the eye
+    // unless the eye is past the nearest of their planes (as chunkFacingMask())
+    // With several views each has its own eye, so none is left out
+    uint face = (m.range >> 24) & 7u;
+    if (face < 6u && views == 1u) {
+        int axis = int(face >> 1);
+        inside = inside && ((face & 1u) != 0u ? boxMin[axis] < 0.0 : boxMax[axis] > 0.0);
+    }
+    if (inside && occlusion)
+        inside = !occluded(boxMin, boxMax);
+
+    uint slot = i;
+    if (compact) {
+        if (!inside)
+            return;
+        slot = r.pageBase + atomicAdd(drawCounts[r.page], 1u);
+    }
+
+    // DrawElementsIndirectCommand; the base instance selects the chunk
+    // origin. Culled meshlets get zero instances when not compacting.
+    uint first = m.range & 0xFFFFu;
+    uint quads = (m.range >> 16) & 0xFFu;
+    commands[slot * 5u + 0u] = quads * 6u;
+    commands[slot * 5u + 1u] = inside ? views : 0u;
+    commands[slot * 5u + 2u] = 0u;
+    commands[slot * 5u + 3u] = uint(r.baseVertex) + first * 4u;
+    commands[slot * 5u + 4u] = slot;
+
+    float fade = fadeSeconds <= 0.0 || r.fadeStart < 0.0 ? 1.0 : min((clock - r.fadeStart) / fadeSeconds, 1.0);
+    offsets[slot * 4u + 0u] = origin.x;
+    offsets[slot * 4u + 1u] = origin.y;
+    offsets[slot * 4u + 2u] = origin.z;
+    offsets[slot * 4u + 3u] = fade;
+}
+)";
+
+bool GpuCuller::init()
+{
+    if (!glFeatures.computeShaders || !glFeatures.multiDrawIndirect)
+        return false;
+
+    program.createCompute(cullShaderSource);
+
+    glGenBuffers(1, &recordBuffer);
+    glGenBuffers(1, &meshletBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &countBuffer);
+    glGenBuffers(1, &offsetBuffer);
+    return true;
+}
+
+void GpuCuller::destroy()
+{
+    if (program.id == 0)
+        return;
+    program.destroy();
+    glState().deleteBuffers(1, &recordBuffer);
+    glState().deleteBuffers(1, &meshletBuffer);
+    glState().deleteBuffers(1, &commandBuffer);
+    glState().deleteBuffers(1, &countBuffer);
+    glState().deleteBuffers(1, &offsetBuffer);
+    recordBuffer = meshletBuffer = commandBuffer = countBuffer = offsetBuffer = 0;
+}
+
+void GpuCuller::setOcclusion(const HiZBuffer* hiz, const glm::mat4& matrix)
+{
+    occluders = hiz;
+    reprojection = matrix;
+}
+
+void GpuCuller::updateRecords(const ChunkRenderer& renderer)
+{
+    const GpuHeap& heap = chunkMeshHeap();
+    int pages = heap.pageCount();
+
+    // Group the meshes and their meshlets by heap page (counting sort), so
+    // each page's commands are contiguous
+    std::vector<int> chunkStart(pages + 1, 0);
+    pageStart.assign(pages + 1, 0);
+    for (const ChunkRenderData& data : renderer.chunks) {
+        if (data.mesh.vertexCount == 0)
+            continue;
+        chunkStart[data.mesh.page() + 1]++;
+        pageStart[data.mesh.page() + 1] += (int)data.mesh.meshlets.size();
+    }
+    for (int p = 0; p < pages; p++) {
+        chunkStart[p + 1] += chunkStart[p];
+        pageStart[p + 1] += pageStart[p];
+    }
+
+    recordCount = pages > 0 ? chunkStart[pages] : 0;
+    meshletCount = pages > 0 ? pageStart[pages] : 0;
+    candidateQuads = 0;
+
+    ChunkRecord* records = frameArena().allocArray<ChunkRecord>(recordCount);
+    MeshletRecord* meshlets = frameArena().allocArray<MeshletRecord>(meshletCount);
+    int* chunkCursor = frameArena().allocArray<int>(pages);
+    int* meshletCursor = frameArena().allocArray<int>(pages);
+    for (int p = 0; p < pages; p++) {
+        chunkCursor[p] = chunkStart[p];
+        meshletCursor[p] = pageStart[p];
+    }
+
+    for (const ChunkRenderData& data : renderer.chunks) {
+        if (data.mesh.vertexCount == 0)
+            continue;
+
+        int page = data.mesh.page();
+        int index = chunkCursor[page]++;
+        ChunkRecord& r = records[index];
+        memcpy(r.boundsMin, glm::value_ptr(glm::vec4(data.chunk->origin(), 0.0f)), sizeof(r.boundsMin));
+        r.baseVertex = (int32_t)data.mesh.baseVertex();
+        r.page = page;
+        r.pageBase = pageStart[page];
+        r.fadeStart = data.fadeStart;
+        for (const ChunkMesh::Meshlet& m : data.mesh.meshlets) {
+            MeshletRecord& out = meshlets[meshletCursor[page]++];
+            out.chunk = (uint32_t)index;
+            out.range = m.first | (uint32_t)m.quads << 16 | (uint32_t)m.face << 24;
+            out.bounds = m.bounds;
+        }
+        candidateQuads += data.mesh.quadCount;
+    }
+
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, recordBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, recordCount * sizeof(ChunkRecord), records, GL_DYNAMIC_DRAW);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, meshletBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, meshletCount * sizeof(MeshletRecord), meshlets, GL_DYNAMIC_DRAW);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, meshletCount * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (pages > 0 ? pages : 1) * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, offsetBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, meshletCount * 4 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+
+    rendererVersion = renderer.drawDataVersion;
+    heapVersion = heap.changeCount();
+}
+
+int GpuCuller::cullAndDraw(const ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye, const ShaderProgram& drawProgram, int& quads)
+{
+    cull(renderer, frustum, eye);
+    return draw(drawProgram, quads);
+}
+
+void GpuCuller::cull(const ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye)
+{
+    if (renderer.drawDataVersion != rendererVersion || chunkMeshHeap().changeCount() != heapVersion)
+        updateRecords(renderer);
+    if (meshletCount == 0)
+        return;
+
+    int pages = (int)pageStart.size() - 1;
+    bool compact = glFeatures.indirectCount;
+
+    // Compute pass: one invocation per meshlet
+    if (compact) {
+        uint32_t* zeros = frameArena().allocArray<uint32_t>(pages);
+        memset(zeros, 0, pages * sizeof(uint32_t));
+        glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pages * sizeof(uint32_t), zeros);
+    }
+
+    program.use();
+    glUniform4fv(program.uniform("planes"), 6, glm::value_ptr(frustum.planes[0]));
+    glUniform1ui(program.uniform("meshletCount"), (GLuint)meshletCount);
+    glUniform1i(program.uniform("compact"), compact ? 1 : 0);
+    glUniform1ui(program.uniform("views"), (GLuint)chunkViewCount());
+    glm::dvec3 eyeBlock = glm::floor(eye);
+    glUniform3i(program.uniform("eyeBlock"), (GLint)eyeBlock.x, (GLint)eyeBlock.y, (GLint)eyeBlock.z);
+    glUniform3fv(program.uniform("eyeFraction"), 1, glm::value_ptr(glm::vec3(eye - eyeBlock)));
+    glUniform1f(program.uniform("clock"), (float)renderer.clock);
+    glUniform1f(program.uniform("fadeSeconds"), renderer.fadeSeconds);
+    glUniform1i(program.uniform("occlusion"), occluders ? 1 : 0);
+    if (occluders) {
+        glUniformMatrix4fv(program.uniform("reprojection"), 1, GL_FALSE, glm::value_ptr(reprojection));
+        glState().activeTexture(GL_TEXTURE0);
+        glState().bindTexture(GL_TEXTURE_2D, occluders->pyramid);
+    }
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, recordBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, offsetBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, meshletBuffer);
+    glDispatchCompute((meshletCount + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+int GpuCuller::draw(const ShaderProgram& drawProgram, int& quads)
+{
+    if (meshletCount == 0)
+        return 0;
+
+    int pages = (int)pageStart.size() - 1;
+    bool compact = glFeatures.indirectCount;
+
+    // One multi-draw per heap page over that page's command slots
+    drawProgram.use();
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    if (compact)
+        glState().bindBuffer(GL_PARAMETER_BUFFER, countBuffer);
+
+    int draws = 0;
+    for (int p = 0; p < pages; p++) {
+        int count = pageStart[p + 1] - pageStart[p];
+        if (count == 0)
+            continue;
+
+        chunkMeshHeap().bind(p);
+        bindChunkDrawOffsets(offsetBuffer, 0, 4);
+        const void* commands = (const void*)(pageStart[p] * sizeof(DrawElementsIndirectCommand));
+        if (compact)
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_SHORT, commands, p * sizeof(uint32_t), count, 0);
+        else
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, commands, count, 0);
+        draws++;
+    }
+
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    if (compact)
+        glState().bindBuffer(GL_PARAMETER_BUFFER, 0);
+
+    quads += candidateQuads;
+    return draws;
+}
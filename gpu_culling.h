@@ -0,0 +1,63 @@
+#pragma once
+
+#include "frustum.h"
+#include "hiz_buffer.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <vector>
+
+struct ChunkRenderer;
+
+// GPU-driven chunk culling: a compute pass tests every chunk's AABB against
+// the frustum and writes the indirect draw commands for the survivors, so the
+// CPU never walks the visible set. Needs compute shaders and multi-draw
+// indirect; with indirect-count support the command list is compacted and
+// its length read from the GPU, otherwise culled commands get zero instances.
+// The unit tested is the meshlet (ChunkMesh::Meshlet): up to
+// CHUNK_MESHLET_QUADS quads of one face direction with their own bounds,
+// each checked against the frustum, the direction to the eye and,
+// optionally, a Hi-Z pyramid, and drawn by its own command when it passes.
+// That leaves out the hidden parts of chunks that are partly visible,
+// which a test of the whole chunk can't.
+struct GpuCuller {
+    // Returns false when the context lacks the required features
+    bool init();
+    void destroy();
+
+    // Cull and draw every chunk mesh of 'renderer', with chunk origins made
+    // relative to 'eye'. 'drawProgram' is re-bound after the compute pass.
+    // Adds the quads of all candidate meshes to 'quads' (the visible subset is
+    // only known on the GPU) and returns the number of draw calls.
+    int cullAndDraw(const ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye, const ShaderProgram& drawProgram, int& quads);
+    // The two halves of cullAndDraw, so the commands of one compute pass can
+    // be drawn more than once (e.g. a depth pre-pass and the main pass)
+    void cull(const ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye);
+    int draw(const ShaderProgram& drawProgram, int& quads);
+
+    // Occlusion-test the following cullAndDraw calls against 'hiz' (nullptr
+    // to disable). 'reprojection' maps camera-relative positions of the
+    // current frame to clip space of the frame the pyramid was built from.
+    void setOcclusion(const HiZBuffer* hiz, const glm::mat4& reprojection);
+
+private:
+    // Rebuild the chunk records after the chunk set or mesh allocations changed
+    void updateRecords(const ChunkRenderer& renderer);
+
+    ShaderProgram program;
+    unsigned int recordBuffer = 0;  // ChunkRecord per mesh, grouped by heap page
+    unsigned int meshletBuffer = 0; // MeshletRecord per meshlet, in the same order
+    unsigned int commandBuffer = 0; // A DrawElementsIndirectCommand slot per meshlet
+    unsigned int countBuffer = 0;   // Draw count per heap page (compacted mode)
+    unsigned int offsetBuffer = 0;  // Chunk origin and fade-in per command slot
+
+    const HiZBuffer* occluders = nullptr;
+    glm::mat4 reprojection = glm::mat4(1.0f);
+
+    int recordCount = 0;
+    int meshletCount = 0;
+    int candidateQuads = 0;
+    std::vector<int> pageStart;     // First meshlet of each page, plus the total
+    uint32_t rendererVersion = UINT32_MAX;
+    uint32_t heapVersion = UINT32_MAX;
+};
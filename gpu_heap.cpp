@@ -0,0 +1,272 @@
+#include "gpu_heap.h"
+#include "gl_state.h"
+#include "gpu_upload_thread.h"
+#include "render_device.h"
+#include "stream_buffer.h"
+
+#include <glad/glad.h>
+
+#include <iterator>
+
+// Allocation sizes are rounded up to this many elements to limit tiny holes
+const uint32_t GPU_HEAP_GRANULARITY = 96;
+
+static uint32_t roundUp(uint32_t count)
+{
+    return (count + GPU_HEAP_GRANULARITY - 1) / GPU_HEAP_GRANULARITY * GPU_HEAP_GRANULARITY;
+}
+
+void GpuHeap::init(uint32_t size, uint32_t elementsPerPage, void (*setup)(), int binding)
+{
+    elementSize = size;
+    pageElements = elementsPerPage;
+    setupAttributes = setup;
+    storageBinding = binding;
+    if (pulling()) {
+        glGenVertexArrays(1, &sharedVAO);
+        glState().bindVertexArray(sharedVAO);
+        setupAttributes();
+        glState().bindVertexArray(0);
+    }
+}
+
+void GpuHeap::destroy()
+{
+    finishUploads();
+    for (Page& p : pages) {
+        if (!pulling())
+            glState().deleteVertexArrays(1, &p.VAO);
+        glState().deleteBuffers(1, &p.buffer);
+    }
+    if (sharedVAO != 0)
+        glState().deleteVertexArrays(1, &sharedVAO);
+    sharedVAO = 0;
+    pages.clear();
+    records.clear();
+    freeHandles.clear();
+    usedElements = 0;
+    changes++;
+}
+
+int GpuHeap::addPage(uint32_t minElements)
+{
+    Page p;
+    p.capacity = minElements > pageElements ? roundUp(minElements) : pageElements;
+    p.holes[0] = p.capacity;
+
+    glGenBuffers(1, &p.buffer);
+    if (pulling()) {
+        p.VAO = sharedVAO;
+        glState().bindBuffer(GL_ARRAY_BUFFER, p.buffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)p.capacity * elementSize, nullptr, GL_DYNAMIC_DRAW);
+    }
+    else {
+        glGenVertexArrays(1, &p.VAO);
+        glState().bindVertexArray(p.VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, p.buffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)p.capacity * elementSize, nullptr, GL_DYNAMIC_DRAW);
+        setupAttributes();
+        glState().bindVertexArray(0);
+    }
+
+    pages.push_back(p);
+    return (int)pages.size() - 1;
+}
+
+// First-fit search for 'count' elements starting before 'below'
+bool GpuHeap::takeHole(Page& p, uint32_t count, uint32_t& first, uint32_t below)
+{
+    for (auto it = p.holes.begin(); it != p.holes.end() && it->first < below; ++it) {
+        if (it->second < count)
+            continue;
+
+        first = it->first;
+        uint32_t remaining = it->second - count;
+        p.holes.erase(it);
+        if (remaining > 0)
+            p.holes[first + count] = remaining;
+        return true;
+    }
+    return false;
+}
+
+void GpuHeap::freeRange(Page& p, uint32_t first, uint32_t count)
+{
+    auto next = p.holes.lower_bound(first);
+
+    // Merge with the following hole
+    if (next != p.holes.end() && first + count == next->first) {
+        count += next->second;
+        next = p.holes.erase(next);
+    }
+    // Merge with the preceding hole
+    if (next != p.holes.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == first) {
+            prev->second += count;
+            return;
+        }
+    }
+    p.holes[first] = count;
+}
+
+int GpuHeap::allocate(uint32_t count)
+{
+    count = roundUp(count > 0 ? count : 1);
+
+    int pageIndex = -1;
+    uint32_t first = 0;
+    for (int i = 0; i < (int)pages.size() && pageIndex < 0; i++)
+        if (takeHole(pages[i], count, first, UINT32_MAX))
+            pageIndex = i;
+    if (pageIndex < 0) {
+        pageIndex = addPage(count);
+        takeHole(pages[pageIndex], count, first, UINT32_MAX);
+    }
+
+    int handle;
+    if (!freeHandles.empty()) {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+    }
+    else {
+        handle = (int)records.size();
+        records.push_back(Record());
+    }
+    records[handle] = { pageIndex, first, count, 1 };
+    pages[pageIndex].used[first] = handle;
+    usedElements += count;
+    changes++;
+    return handle;
+}
+
+void GpuHeap::retain(int handle)
+{
+    if (handle >= 0 && records[handle].page >= 0)
+        records[handle].owners++;
+}
+
+void GpuHeap::release(int handle)
+{
+    if (handle < 0 || records[handle].page < 0)
+        return;
+
+    Record& r = records[handle];
+    if (--r.owners > 0)
+        return;
+    Page& p = pages[r.page];
+    p.used.erase(r.first);
+    freeRange(p, r.first, r.capacity);
+    usedElements -= r.capacity;
+
+    r.page = -1;
+    freeHandles.push_back(handle);
+    changes++;
+}
+
+int GpuHeap::reserve(int handle, uint32_t count)
+{
+    if (handle < 0 || records[handle].capacity < count || records[handle].owners > 1) {
+        release(handle);
+        handle = allocate(count);
+    }
+    return handle;
+}
+
+int GpuHeap::upload(int handle, const void* data, uint32_t count)
+{
+    handle = reserve(handle, count);
+    if (count == 0)
+        return handle;
+
+    const Record& r = records[handle];
+    size_t bytes = (size_t)count * elementSize;
+    if (uploader && uploader->active()) {
+        uploader->write(pages[r.page].buffer, (size_t)r.first * elementSize, data, bytes);
+        return handle;
+    }
+    size_t offset = staging ? staging->write(data, bytes, elementSize) : StreamBuffer::STREAM_FULL;
+    if (offset != StreamBuffer::STREAM_FULL) {
+        glState().bindBuffer(GL_COPY_READ_BUFFER, staging->buffer);
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, pages[r.page].buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)offset,
+            (GLintptr)r.first * elementSize, (GLsizeiptr)bytes);
+        return handle;
+    }
+    glState().bindBuffer(GL_ARRAY_BUFFER, pages[r.page].buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)r.first * elementSize, (GLsizeiptr)bytes, data);
+    return handle;
+}
+
+void GpuHeap::copyFrom(int handle, uint32_t offset, unsigned int source, size_t sourceOffset, uint32_t count)
+{
+    if (count == 0)
+        return;
+    finishUploads();
+    const Record& r = records[handle];
+    glState().bindBuffer(GL_COPY_READ_BUFFER, source);
+    glState().bindBuffer(GL_COPY_WRITE_BUFFER, pages[r.page].buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)sourceOffset,
+        (GLintptr)(r.first + offset) * elementSize, (GLsizeiptr)count * elementSize);
+}
+
+void GpuHeap::finishUploads() const
+{
+    if (uploader && uploader->pending())
+        uploader->finish();
+}
+
+void GpuHeap::bind(int page) const
+{
+    finishUploads();
+    glState().bindVertexArray(pages[page].VAO);
+    if (pulling())
+        glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, (GLuint)storageBinding, pages[page].buffer);
+}
+
+void GpuHeap::record(CommandList& list, int page) const
+{
+    finishUploads();
+    list.bindVertexArray(pages[page].VAO);
+    if (pulling())
+        list.bindStorageBuffer((unsigned int)storageBinding, pages[page].buffer);
+}
+
+int GpuHeap::defragment(int maxMoves)
+{
+    finishUploads();
+    int moves = 0;
+    for (Page& p : pages) {
+        while (moves < maxMoves && !p.used.empty()) {
+            // Highest allocation of the page, moved into the lowest hole below it
+            auto top = std::prev(p.used.end());
+            int handle = top->second;
+            Record& r = records[handle];
+
+            uint32_t first;
+            if (!takeHole(p, r.capacity, first, r.first))
+                break; // Already compact enough
+
+            glState().bindBuffer(GL_COPY_READ_BUFFER, p.buffer);
+            glState().bindBuffer(GL_COPY_WRITE_BUFFER, p.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                (GLintptr)r.first * elementSize, (GLintptr)first * elementSize, (GLsizeiptr)r.capacity * elementSize);
+
+            p.used.erase(top);
+            freeRange(p, r.first, r.capacity);
+            r.first = first;
+            p.used[first] = handle;
+            moves++;
+            changes++;
+        }
+    }
+    return moves;
+}
+
+size_t GpuHeap::bytesReserved() const
+{
+    size_t total = 0;
+    for (const Page& p : pages)
+        total += (size_t)p.capacity * elementSize;
+    return total;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+struct CommandList;
+struct GpuUploadThread;
+struct StreamBuffer;
+
+// Sub-allocates ranges of fixed-size elements from a few large GL buffers.
+// Each page is one buffer with its own VAO, so everything in a page draws
+// after a single bind. Allocations are addressed by handle, which lets
+// defragment() move them without their owners noticing.
+//
+// With a staging ring, uploads are written into it and copied into the page
+// on the GPU (glCopyBufferSubData), ordered after the draws still reading
+// the old contents, so the driver neither stalls nor shadows the page. The
+// ring's per-frame fences keep its regions from being overwritten early.
+//
+// With an active upload thread, uploads are queued to it instead. Anything
+// that reads or moves the pages (binding one, copyFrom(), defragment())
+// first finishes the queued uploads, so the render thread overlaps them
+// with whatever it does in between.
+struct GpuHeap {
+    StreamBuffer* staging = nullptr;    // Optional; uploads that don't fit go direct with glBufferSubData
+    GpuUploadThread* uploader = nullptr;    // Optional; used instead of 'staging' while active
+
+    // 'setupAttributes' is called with a page's VAO and buffer bound to
+    // declare the vertex format. With a 'storageBinding' (vertex pulling:
+    // shaders read the elements from a storage buffer by gl_VertexID) the
+    // pages share one VAO, set up once with no page bound, and bind() puts
+    // the page's buffer at that GL_SHADER_STORAGE_BUFFER binding.
+    void init(uint32_t elementSize, uint32_t pageElements, void (*setupAttributes)(), int storageBinding = -1);
+    void destroy();
+
+    // Reserve room for 'count' elements; returns a handle
+    int allocate(uint32_t count);
+    // Allocations can be shared: retain() adds an owner, release() drops
+    // one and frees the range once none is left
+    void retain(int handle);
+    void release(int handle);
+    int owners(int handle) const { return handle >= 0 && records[handle].page >= 0 ? records[handle].owners : 0; }
+    // Copy 'count' elements into an allocation, reallocating if it is too
+    // small or shared (the other owners keep the old contents). Returns the
+    // (possibly new) handle.
+    int upload(int handle, const void* data, uint32_t count);
+    // Make an allocation hold at least 'count' elements, reallocating (its
+    // contents lost) if it is too small or shared. Returns the (possibly new) handle.
+    int reserve(int handle, uint32_t count);
+    // Copy 'count' elements from byte 'sourceOffset' of the GL buffer
+    // 'source' to element 'offset' of an allocation, on the GPU, for data
+    // that was written there by shaders
+    void copyFrom(int handle, uint32_t offset, unsigned int source, size_t sourceOffset, uint32_t count);
+
+    // Page and first element of an allocation, for draw calls
+    int page(int handle) const { return records[handle].page; }
+    uint32_t first(int handle) const { return records[handle].first; }
+    // Bind a page's VAO, or the shared one and the page's storage binding
+    void bind(int page) const;
+    // Same, recorded into 'list'
+    void record(CommandList& list, int page) const;
+    bool pulling() const { return storageBinding >= 0; }
+
+    // Move up to 'maxMoves' allocations from the top of their page into the
+    // lowest hole that fits, compacting the heap over time
+    int defragment(int maxMoves);
+
+    // Occupancy
+    size_t bytesInUse() const { return (size_t)usedElements * elementSize; }
+    size_t bytesReserved() const;
+    int pageCount() const { return (int)pages.size(); }
+    // Bumped whenever an allocation is created, released or moved
+    uint32_t changeCount() const { return changes; }
+
+private:
+    struct Page {
+        unsigned int VAO;
+        unsigned int buffer;
+        uint32_t capacity;                  // In elements
+        std::map<uint32_t, uint32_t> holes; // First element -> length, coalesced
+        std::map<uint32_t, int> used;       // First element -> handle
+    };
+
+    struct Record {
+        int page;       // -1 when the handle is free
+        uint32_t first;
+        uint32_t capacity;
+        int owners;
+    };
+
+    int addPage(uint32_t minElements);
+    // Make the uploader's writes visible before the pages are used
+    void finishUploads() const;
+    bool takeHole(Page& p, uint32_t count, uint32_t& first, uint32_t below);
+    void freeRange(Page& p, uint32_t first, uint32_t count);
+
+    uint32_t elementSize = 0;
+    uint32_t pageElements = 0;
+    void (*setupAttributes)() = nullptr;
+    int storageBinding = -1;
+    unsigned int sharedVAO = 0;     // Of every page when pulling
+    std::vector<Page> pages;
+    std::vector<Record> records;
+    std::vector<int> freeHandles;
+    uint64_t usedElements = 0;
+    uint32_t changes = 0;
+};
@@ -0,0 +1,284 @@
+#include "gpu_mesher.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+
+// Most faces of one direction in a chunk: every other voxel of each column
+const int MAX_FACE_QUADS = CHUNK_VOLUME / 2;
+// Quad vertices per slot, six directions of MAX_FACE_QUADS
+const size_t SLOT_QUAD_BYTES = (size_t)6 * MAX_FACE_QUADS * 4 * sizeof(ChunkVertex);
+
+static_assert(CHUNK_SIZE == 16 && MAX_FACE_QUADS == 2048, "the meshing shader assumes 16^3 chunks");
+static_assert(offsetof(ChunkVoxels, border) == 4096 && offsetof(ChunkVoxels, light) == 5632 &&
+    offsetof(ChunkVoxels, borderLight) == 9728 && sizeof(ChunkVoxels) == 11264, "the meshing shader reads snapshots by byte offset");
+static_assert(BLOCK_TYPE_COUNT <= 32, "opaque block types are passed as a 32-bit mask");
+
+static const char* meshShaderSource = R"(
+#version 430 core
+layout (local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout (std430, binding = 0) readonly buffer Voxels { uint voxels[]; };
+layout (std430, binding = 1) buffer Counts { uint faceCounts[]; };
+layout (std430, binding = 2) writeonly buffer Quads { uint quadVertices[]; };
+
+uniform uint slot;
+uniform uint opaqueMask;    // Bit per opaque block type
+
+// ChunkVoxels byte offsets
+const uint SLOT_BYTES = 11264u;
+const uint BORDER = 4096u;
+const uint LIGHT = 5632u;
+const uint BORDER_LIGHT = 9728u;
+const uint MAX_FACE_QUADS = 2048u;
+
+// CornerLight samples: count << 12 | sun << 6 | block light when open
+const uint SOLID = 1u << 15;
+const uint OPEN_MASK = SOLID - 1u;
+
+const ivec3 FACE_NORMALS[6] = ivec3[6](
+    ivec3(-1, 0, 0), ivec3(1, 0, 0), ivec3(0, -1, 0), ivec3(0, 1, 0), ivec3(0, 0, -1), ivec3(0, 0, 1));
+const ivec3 FACE_CORNERS[24] = ivec3[24](
+    ivec3(0, 0, 0), ivec3(0, 0, 1), ivec3(0, 1, 1), ivec3(0, 1, 0),
+    ivec3(1, 0, 1), ivec3(1, 0, 0), ivec3(1, 1, 0), ivec3(1, 1, 1),
+    ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(1, 0, 1), ivec3(0, 0, 1),
+    ivec3(0, 1, 1), ivec3(1, 1, 1), ivec3(1, 1, 0), ivec3(0, 1, 0),
+    ivec3(1, 0, 0), ivec3(0, 0, 0), ivec3(0, 1, 0), ivec3(1, 1, 0),
+    ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 1, 1), ivec3(0, 1, 1));
+
+uint byteAt(uint offset)
+{
+    uint i = slot * SLOT_BYTES + offset;
+    return (voxels[i >> 2] >> ((i & 3u) * 8u)) & 255u;
+}
+
+bool opaque(uint block)
+{
+    return ((opaqueMask >> block) & 1u) != 0u;
+}
+
+// Block and light at 'p', inside the chunk or one voxel out along a single
+// axis (the neighbour borders). False further out.
+bool voxelAt(ivec3 p, out uint block, out uint light)
+{
+    bvec3 low = lessThan(p, ivec3(0));
+    bvec3 high = greaterThanEqual(p, ivec3(16));
+    bvec3 outside = bvec3(low.x || high.x, low.y || high.y, low.z || high.z);
+    int count = int(outside.x) + int(outside.y) + int(outside.z);
+    block = 0u;
+    light = 0u;
+    if (count > 1)
+        return false;
+    if (count == 0) {
+        uint i = uint(p.x << 8 | p.y << 4 | p.z);
+        block = byteAt(i);
+        light = byteAt(LIGHT + i);
+        return true;
+    }
+    uint i;
+    if (outside.x)
+        i = (high.x ? 256u : 0u) + uint(p.y * 16 + p.z);
+    else if (outside.y)
+        i = (high.y ? 768u : 512u) + uint(p.x * 16 + p.z);
+    else
+        i = (high.z ? 1280u : 1024u) + uint(p.x * 16 + p.y);
+    block = byteAt(BORDER + i);
+    light = byteAt(BORDER_LIGHT + i);
+    return true;
+}
+
+uint sampleAt(ivec3 p)
+{
+    uint block, light;
+    if (!voxelAt(p, block, light))
+        return 0u;
+    return opaque(block) ? SOLID : (1u << 12 | (light >> 4) << 6 | (light & 15u));
+}
+
+uint average(uint sum, uint count)
+{
+    return min((sum + count / 2u) / count, 15u);
+}
+
+void main()
+{
+    ivec3 pos = ivec3(gl_GlobalInvocationID);
+    uint block, light;
+    voxelAt(pos, block, light);
+    if (!opaque(block))
+        return;
+
+    for (int face = 0; face < 6; face++) {
+        ivec3 facing = pos + FACE_NORMALS[face];
+        uint neighbour, neighbourLight;
+        voxelAt(facing, neighbour, neighbourLight);
+        if (opaque(neighbour))
+            continue;
+
+        // Smooth light and AO of the four corners, as CornerLight::face()
+        int d = face / 2;
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+        uint facingSample = sampleAt(facing);
+        uint lights[4];
+        uint ao[4];
+        for (int i = 0; i < 4; i++) {
+            ivec3 corner = FACE_CORNERS[face * 4 + i];
+            ivec3 stepU = ivec3(0);
+            ivec3 stepV = ivec3(0);
+            stepU[u] = corner[u] > 0 ? 1 : -1;
+            stepV[v] = corner[v] > 0 ? 1 : -1;
+            uint sides = sampleAt(facing + stepU) + sampleAt(facing + stepV);
+            uint diagonal = sampleAt(facing + stepU + stepV);
+            uint openSides = sides & OPEN_MASK;
+            uint sum = facingSample + openSides + (openSides != 0u ? diagonal & OPEN_MASK : 0u);
+            uint count = sum >> 12;
+            lights[i] = average((sum >> 6) & 63u, count) << 4 | average(sum & 63u, count);
+            uint solidSides = sides >> 15;
+            ao[i] = solidSides == 2u ? 0u : 3u - solidSides - (diagonal >> 15);
+        }
+
+        uint quad = atomicAdd(faceCounts[slot * 6u + uint(face)], 1u);
+        if (quad >= MAX_FACE_QUADS)
+            continue; // Can't happen in a 16^3 chunk
+        uint base = ((slot * 6u + uint(face)) * MAX_FACE_QUADS + quad) * 4u;
+        // Split along the darker diagonal, as emitQuad()
+        int first = ao[0] + ao[2] > ao[1] + ao[3] ? 1 : 0;
+        for (int k = 0; k < 4; k++) {
+            int i = (first + k) & 3;
+            uvec3 p = uvec3(pos + FACE_CORNERS[face * 4 + i]);
+            quadVertices[base + uint(k)] = p.x | p.y << 5 | p.z << 10 | uint(face) << 15 |
+                ao[i] << 18 | block << 20 | lights[i] << 24;
+        }
+    }
+}
+)";
+
+bool GpuMesher::init()
+{
+    if (!glFeatures.computeShaders)
+        return false;
+
+    program.createCompute(meshShaderSource);
+
+    glGenBuffers(1, &voxelBuffer);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, voxelBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)SLOTS * sizeof(ChunkVoxels), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &countBuffer);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)SLOTS * 6 * sizeof(uint32_t), nullptr, GL_DYNAMIC_READ);
+    glGenBuffers(1, &quadBuffer);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, quadBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(SLOTS * SLOT_QUAD_BYTES), nullptr, GL_DYNAMIC_COPY);
+
+    uint32_t mask = 0;
+    for (int id = 0; id < BLOCK_TYPE_COUNT; id++)
+        if (isOpaque((BlockId)id))
+            mask |= 1u << id;
+    program.use();
+    glUniform1ui(program.uniform("opaqueMask"), mask);
+
+    for (Slot& s : slots)
+        s = Slot();
+    freeCount = SLOTS;
+    return true;
+}
+
+void GpuMesher::destroy()
+{
+    if (program.id == 0)
+        return;
+    for (Slot& s : slots)
+        renderDevice().destroyFence(s.fence);
+    program.destroy();
+    glState().deleteBuffers(1, &voxelBuffer);
+    glState().deleteBuffers(1, &countBuffer);
+    glState().deleteBuffers(1, &quadBuffer);
+    voxelBuffer = countBuffer = quadBuffer = 0;
+    freeCount = 0;
+}
+
+bool GpuMesher::accepts(const Chunk& chunk)
+{
+    // Unused palette entries only make this conservative
+    for (BlockId id : chunk.blocks.palette)
+        if (isTranslucent(id))
+            return false;
+    return true;
+}
+
+void GpuMesher::submit(const glm::ivec3& coord, uint32_t version, const ChunkVoxels& voxels)
+{
+    int index = 0;
+    while (slots[index].state != SLOT_FREE)
+        index++;
+    Slot& s = slots[index];
+
+    // The slot's last pass has finished (its fence signalled), so these
+    // writes don't wait on the GPU
+    static const uint32_t zeros[6] = {};
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, voxelBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)index * sizeof(ChunkVoxels), sizeof(ChunkVoxels), &voxels);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)index * sizeof(zeros), sizeof(zeros), zeros);
+
+    program.use();
+    glUniform1ui(program.uniform("slot"), (GLuint)index);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, voxelBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, countBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, quadBuffer);
+    glDispatchCompute(CHUNK_SIZE / 4, CHUNK_SIZE / 4, CHUNK_SIZE / 4);
+    // The counts are read back and the quads copied by buffer commands
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    s.fence = renderDevice().insertFence();
+
+    s.state = SLOT_RUNNING;
+    s.sequence = nextSequence++;
+    s.result.coord = coord;
+    s.result.version = version;
+    s.result.faceVisibility = computeFaceVisibility(voxels);
+    s.result.slot = index;
+    freeCount--;
+}
+
+bool GpuMesher::poll(GpuMeshResult& out)
+{
+    // Passes finish in submission order, so only the oldest running one is checked
+    Slot* oldest = nullptr;
+    for (Slot& s : slots)
+        if (s.state == SLOT_RUNNING && (!oldest || s.sequence - oldest->sequence > UINT32_MAX / 2))
+            oldest = &s;
+    if (!oldest)
+        return false;
+    // The first check flushes, so the fence is sure to signal eventually
+    if (!renderDevice().waitFence(oldest->fence, 0))
+        return false;
+    renderDevice().destroyFence(oldest->fence);
+
+    uint32_t counts[6];
+    glState().bindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)oldest->result.slot * sizeof(counts), sizeof(counts), counts);
+    for (int face = 0; face < 6; face++)
+        oldest->result.faceQuads[face] = (int)std::min<uint32_t>(counts[face], MAX_FACE_QUADS);
+    oldest->state = SLOT_DONE;
+    out = oldest->result;
+    return true;
+}
+
+void GpuMesher::take(const GpuMeshResult& result, ChunkMesh* mesh)
+{
+    Slot& s = slots[result.slot];
+    if (mesh) {
+        size_t offsets[6];
+        for (int face = 0; face < 6; face++)
+            offsets[face] = (size_t)result.slot * SLOT_QUAD_BYTES + (size_t)face * MAX_FACE_QUADS * 4 * sizeof(ChunkVertex);
+        mesh->copyFaces(quadBuffer, offsets, result.faceQuads);
+    }
+    // The copies are ordered before the next pass that overwrites the slot
+    s.state = SLOT_FREE;
+    freeCount++;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_mesh.h"
+#include "chunk_visibility.h"
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Chunk meshing in a compute shader, the alternative to ChunkMesher's CPU
+// workers chosen at startup (--mesher gpu). A chunk's snapshot is uploaded
+// into a slot of a storage buffer and meshed with one invocation per voxel:
+// each visible face takes a place in its direction's list with an atomic
+// counter and writes its four packed vertices, smooth light and AO
+// computed as CornerLight does, so the result matches meshChunk() with
+// MESH_CULLED quad for quad (in another order within each direction). Once
+// the pass's fence has signalled, the six counts are read back and the
+// quads copied into the vertex heap on the GPU, grouped by face; the
+// vertices never cross the bus.
+//
+// Only the culled mesh is built, whatever the mesh mode. Chunks with
+// translucent blocks are left to the CPU mesher, as their quads are kept on
+// the CPU for back-to-front re-sorts, and so are meshes stored as face
+// records.
+struct GpuMeshResult {
+    glm::ivec3 coord;
+    uint32_t version;
+    FaceVisibility faceVisibility;  // Computed on the CPU at submission
+    int slot;                       // Taken until take()
+    int faceQuads[6];
+};
+
+struct GpuMesher {
+    static const int SLOTS = 16;    // Chunks in flight
+
+    // Returns false when the context lacks compute shaders
+    bool init();
+    void destroy();
+
+    // Chunks it can mesh: no translucent block in the palette
+    static bool accepts(const Chunk& chunk);
+    bool hasFreeSlot() const { return freeCount > 0; }
+    int inFlight() const { return SLOTS - freeCount; }
+
+    // Upload a snapshot and dispatch its pass (needs a free slot)
+    void submit(const glm::ivec3& coord, uint32_t version, const ChunkVoxels& voxels);
+    // Take the next finished pass, if any, without waiting
+    bool poll(GpuMeshResult& out);
+    // Copy a finished mesh into 'mesh' (nullptr drops it) and free its slot
+    void take(const GpuMeshResult& result, ChunkMesh* mesh);
+
+private:
+    enum SlotState { SLOT_FREE, SLOT_RUNNING, SLOT_DONE };
+    struct Slot {
+        SlotState state = SLOT_FREE;
+        void* fence = nullptr;          // GLsync of the pass
+        uint32_t sequence = 0;          // Submission order, so results come back oldest first
+        GpuMeshResult result;
+    };
+
+    ShaderProgram program;
+    unsigned int voxelBuffer = 0;   // One ChunkVoxels per slot
+    unsigned int countBuffer = 0;   // Six face counters per slot
+    unsigned int quadBuffer = 0;    // Room for the most quads of each direction, per slot
+    Slot slots[SLOTS];
+    int freeCount = 0;
+    uint32_t nextSequence = 0;
+};
@@ -0,0 +1,402 @@
+#include "gpu_particles.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// The origin moves to the eye once it is this far away
+const double ORIGIN_REBASE_DISTANCE = 64.0;
+// Weather around the eye
+const float WEATHER_RADIUS = 24.0f;     // Half the side of the square it falls over
+const float WEATHER_HEIGHT = 20.0f;     // Above the eye
+const float RAIN_RATE = 4000.0f;        // Particles per second
+const float RAIN_SPEED = 18.0f;
+const float SNOW_RATE = 1200.0f;
+const float SNOW_SPEED = 2.0f;
+// Bytes of one particle: vec4 position and life, vec4 velocity and kind
+const int PARTICLE_BYTES = 32;
+const char* const FEEDBACK_VARYINGS[2] = { "outPosLife", "outVelKind" };
+
+// std140 layout of an emitter
+struct GpuEmitter {
+    glm::vec4 positionSpread;   // Relative to the particle origin
+    glm::vec4 velocityJitter;
+    glm::vec4 settings;         // Lifetime, kind, block
+    glm::ivec4 range;           // End of its spawn indices, hash seed
+};
+
+// Shared by the compute and the transform feedback update: spawn a slot in
+// this frame's range from its emitter, or advance a live particle. Kind
+// and block share the last velocity component (kind * 16 + block).
+static const char* particleUpdateSource = R"(
+const int MAX_EMITTERS = 32;
+const int PARTICLE_DEBRIS = 0;
+const int PARTICLE_RAIN = 1;
+const int PARTICLE_SNOW = 2;
+
+struct Emitter {
+    vec4 positionSpread;
+    vec4 velocityJitter;
+    vec4 settings;
+    ivec4 range;
+};
+layout (std140) uniform Emitters {
+    Emitter emitters[MAX_EMITTERS];
+};
+uniform int emitterCount;
+uniform int spawnStart;     // First slot spawned this frame
+uniform int spawnCount;
+uniform int capacity;
+uniform float dt;
+uniform vec3 originShift;   // Old origin minus new
+
+float hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return float(x >> 8) * (1.0 / 16777216.0);
+}
+vec3 hash3(uint seed)
+{
+    return vec3(hash(seed), hash(seed + 1u), hash(seed + 2u)) * 2.0 - 1.0;
+}
+
+void updateParticle(int slot, inout vec4 posLife, inout vec4 velKind)
+{
+    int spawnIndex = (slot - spawnStart + capacity) % capacity;
+    if (spawnIndex < spawnCount) {
+        int e = 0;
+        while (e < emitterCount - 1 && spawnIndex >= emitters[e].range.x)
+            e++;
+        Emitter emitter = emitters[e];
+        uint seed = uint(spawnIndex) * 2654435761u + uint(emitter.range.y);
+        int kind = int(emitter.settings.y);
+        vec3 offset = hash3(seed) * emitter.positionSpread.w;
+        if (kind != PARTICLE_DEBRIS)
+            offset.y = 0.0; // Weather starts on a sheet above the eye
+        float life = emitter.settings.x * (0.75 + 0.25 * hash(seed + 3u));
+        vec3 velocity = emitter.velocityJitter.xyz + hash3(seed + 4u) * emitter.velocityJitter.w;
+        posLife = vec4(emitter.positionSpread.xyz + offset, life);
+        velKind = vec4(velocity, float(kind * 16) + emitter.settings.z);
+        return;
+    }
+    if (posLife.w <= 0.0)
+        return;
+
+    int kind = int(velKind.w) / 16;
+    vec3 velocity = velKind.xyz;
+    if (kind == PARTICLE_DEBRIS)
+        velocity.y -= 20.0 * dt;
+    vec3 previous = posLife.xyz + originShift;
+    vec3 position = previous + velocity * dt;
+    if (kind == PARTICLE_SNOW)
+        position.xz += vec2(sin(posLife.w * 1.7 + float(slot)), cos(posLife.w * 1.3 + float(slot))) * 0.5 * dt;
+    float life = posLife.w - dt;
+    // Debris comes to rest on solid blocks; rain and snow end there
+    if ((occupancyFlags(position) & OCCUPANCY_SOLID) != 0u) {
+        position = previous;
+        velocity = vec3(0.0);
+        if (kind != PARTICLE_DEBRIS)
+            life = 0.0;
+    }
+    posLife = vec4(position, life);
+    velKind.xyz = velocity;
+}
+)";
+
+static const char* computeHeader = R"(
+#version 430 core
+layout (local_size_x = 64) in;
+
+struct Particle {
+    vec4 posLife;
+    vec4 velKind;
+};
+layout (std430, binding = 0) buffer Particles {
+    Particle particles[];
+};
+)";
+
+static const char* computeMain = R"(
+void main()
+{
+    int slot = int(gl_GlobalInvocationID.x);
+    if (slot >= capacity)
+        return;
+    Particle p = particles[slot];
+    updateParticle(slot, p.posLife, p.velKind);
+    particles[slot] = p;
+}
+)";
+
+static const char* feedbackHeader = R"(
+#version 330 core
+layout (location = 0) in vec4 aPosLife;
+layout (location = 1) in vec4 aVelKind;
+out vec4 outPosLife;
+out vec4 outVelKind;
+)";
+
+static const char* feedbackMain = R"(
+void main()
+{
+    vec4 posLife = aPosLife;
+    vec4 velKind = aVelKind;
+    updateParticle(gl_VertexID, posLife, velKind);
+    outPosLife = posLife;
+    outVelKind = velKind;
+}
+)";
+
+static const char* particleVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec4 aPosLife;
+layout (location = 1) in vec4 aVelKind;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+};
+layout (std140) uniform Palette {
+    vec4 blockColors[16];
+};
+uniform vec3 eyeOffset;         // Eye relative to the particle origin
+uniform float viewportHeight;
+
+out vec4 color;
+flat out int kind;
+
+void main()
+{
+    if (aPosLife.w <= 0.0) {
+        // Dead: outside the clip volume
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        gl_PointSize = 1.0;
+        color = vec4(0.0);
+        kind = 0;
+        return;
+    }
+    kind = int(aVelKind.w) / 16;
+    int block = int(aVelKind.w) - kind * 16;
+    gl_Position = viewProj * vec4(aPosLife.xyz - eyeOffset, 1.0);
+    // World size in blocks to pixels at this depth
+    float size = kind == 0 ? 0.12 : (kind == 1 ? 0.4 : 0.08);
+    gl_PointSize = clamp(size * projection[1][1] * 0.5 * viewportHeight / gl_Position.w, 1.0, 64.0);
+    if (kind == 0)
+        color = vec4(blockColors[block].rgb * 0.8, 1.0);
+    else if (kind == 1)
+        color = vec4(0.6, 0.7, 0.9, 0.5);
+    else
+        color = vec4(1.0, 1.0, 1.0, 0.9);
+    // Fade out over the last quarter second
+    color.a *= clamp(aPosLife.w * 4.0, 0.0, 1.0);
+}
+)";
+
+static const char* particleFragmentShaderSource = R"(
+#version 330 core
+in vec4 color;
+flat in int kind;
+out vec4 FragColor;
+
+void main()
+{
+    // Debris square, rain a thin vertical streak, snow round
+    vec2 p = gl_PointCoord - 0.5;
+    if (kind == 1 && abs(p.x) > 0.06)
+        discard;
+    if (kind == 2 && dot(p, p) > 0.25)
+        discard;
+    FragColor = color;
+}
+)";
+
+// Particle state as vertex attributes 0 and 1
+static void setParticleAttributes()
+{
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, PARTICLE_BYTES, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, PARTICLE_BYTES, (void*)16);
+    glEnableVertexAttribArray(1);
+}
+
+void GpuParticles::init(int particleCapacity, unsigned int cameraBinding, unsigned int paletteBinding)
+{
+    capacity = particleCapacity;
+    compute = glFeatures.computeShaders;
+    std::string updateSource = std::string(compute ? computeHeader : feedbackHeader) + occupancyVolumeSource() + particleUpdateSource +
+        (compute ? computeMain : feedbackMain);
+    if (compute)
+        updateProgram.createCompute(updateSource.c_str());
+    else
+        updateProgram.createFeedback(updateSource.c_str(), FEEDBACK_VARYINGS, 2);
+    updateProgram.bindBlock("Emitters", PARTICLE_EMITTER_BINDING);
+    drawProgram.create(particleVertexShaderSource, particleFragmentShaderSource);
+    drawProgram.bindBlock("Camera", cameraBinding);
+    drawProgram.bindBlock("Palette", paletteBinding);
+
+    // Everything starts dead (zero life)
+    int bufferCount = compute ? 1 : 2;
+    std::vector<unsigned char> zeros((size_t)capacity * PARTICLE_BYTES, 0);
+    glGenBuffers(bufferCount, buffers);
+    glGenVertexArrays(bufferCount, drawVAOs);
+    for (int i = 0; i < bufferCount; i++) {
+        glState().bindVertexArray(drawVAOs[i]);
+        glState().bindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, zeros.size(), zeros.data(), GL_DYNAMIC_COPY);
+        setParticleAttributes();
+    }
+    glState().bindVertexArray(0);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &emitterUBO);
+    glState().bindBuffer(GL_UNIFORM_BUFFER, emitterUBO);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_EMITTERS * sizeof(GpuEmitter), nullptr, GL_STREAM_DRAW);
+    glState().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    current = 0;
+    head = 0;
+    activeSeconds = 0.0f;
+}
+
+void GpuParticles::destroy()
+{
+    if (emitterUBO == 0)
+        return;
+    glState().deleteBuffers(2, buffers);
+    glState().deleteVertexArrays(2, drawVAOs);
+    glState().deleteBuffers(1, &emitterUBO);
+    buffers[0] = buffers[1] = 0;
+    drawVAOs[0] = drawVAOs[1] = 0;
+    emitterUBO = 0;
+    updateProgram.destroy();
+    drawProgram.destroy();
+}
+
+ParticleEmitter GpuParticles::weatherEmitter(Weather weather, const glm::dvec3& eye, float dt)
+{
+    ParticleEmitter emitter;
+    emitter.position = eye + glm::dvec3(0.0, WEATHER_HEIGHT, 0.0);
+    emitter.spread = WEATHER_RADIUS;
+    if (weather == WEATHER_CLEAR) {
+        spawnFraction = 0.0f;
+        return emitter;
+    }
+    float rate = weather == WEATHER_RAIN ? RAIN_RATE : SNOW_RATE;
+    float speed = weather == WEATHER_RAIN ? RAIN_SPEED : SNOW_SPEED;
+    emitter.kind = weather == WEATHER_RAIN ? PARTICLE_RAIN : PARTICLE_SNOW;
+    emitter.velocity = glm::vec3(0.0f, -speed, 0.0f);
+    emitter.speedJitter = speed * 0.1f;
+    // Long enough to fall past the eye and as far again
+    emitter.lifetime = 2.0f * WEATHER_HEIGHT / speed;
+    float owed = spawnFraction + rate * dt;
+    emitter.count = (int)owed;
+    spawnFraction = owed - emitter.count;
+    return emitter;
+}
+
+void GpuParticles::update(const std::vector<ParticleEmitter>& emitters, float dt, const glm::dvec3& eye)
+{
+    // Keep the origin near the eye; live particles move with it
+    glm::vec3 shift(0.0f);
+    if (!hasOrigin || glm::length(eye - origin) > ORIGIN_REBASE_DISTANCE) {
+        glm::dvec3 rebased = glm::floor(eye);
+        if (hasOrigin)
+            shift = glm::vec3(origin - rebased);
+        origin = rebased;
+        hasOrigin = true;
+    }
+
+    // Room for this frame's bursts, in the order given
+    GpuEmitter gpu[MAX_EMITTERS];
+    int used = 0;
+    int spawnCount = 0;
+    for (const ParticleEmitter& e : emitters) {
+        if (used == MAX_EMITTERS || e.count <= 0 || spawnCount + e.count > capacity)
+            continue;
+        spawnCount += e.count;
+        activeSeconds = std::max(activeSeconds, e.lifetime);
+        GpuEmitter& g = gpu[used++];
+        g.positionSpread = glm::vec4(glm::vec3(e.position - origin), e.spread);
+        g.velocityJitter = glm::vec4(e.velocity, e.speedJitter);
+        g.settings = glm::vec4(e.lifetime, (float)e.kind, (float)e.block, 0.0f);
+        g.range = glm::ivec4(spawnCount, (int)(seed++ * 0x9E3779B1u), 0, 0);
+    }
+    if (spawnCount == 0 && activeSeconds <= 0.0f)
+        return; // Nothing alive and nothing new: skip the pass
+
+    if (used > 0) {
+        glState().bindBuffer(GL_UNIFORM_BUFFER, emitterUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, used * sizeof(GpuEmitter), gpu);
+        glState().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glState().bindBufferBase(GL_UNIFORM_BUFFER, PARTICLE_EMITTER_BINDING, emitterUBO);
+
+    updateProgram.use();
+    glUniform1i(updateProgram.uniform("emitterCount"), used);
+    glUniform1i(updateProgram.uniform("spawnStart"), head);
+    glUniform1i(updateProgram.uniform("spawnCount"), spawnCount);
+    glUniform1i(updateProgram.uniform("capacity"), capacity);
+    glUniform1f(updateProgram.uniform("dt"), dt);
+    glUniform3fv(updateProgram.uniform("originShift"), 1, glm::value_ptr(shift));
+    if (occupancy) {
+        occupancy->bindProgram(updateProgram);
+        occupancy->setUniforms(updateProgram, origin, true);
+    }
+    else {
+        glUniform4f(updateProgram.uniform("occupancyOrigin"), 0.0f, 0.0f, 0.0f, 0.0f);
+    }
+
+    if (compute) {
+        glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+        glDispatchCompute((capacity + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+    else {
+        // Stream the current state through the vertex shader into the other buffer
+        glState().enable(GL_RASTERIZER_DISCARD);
+        glState().bindVertexArray(drawVAOs[current]);
+        glState().bindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1 - current]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, capacity);
+        glEndTransformFeedback();
+        glState().bindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glState().bindVertexArray(0);
+        glState().disable(GL_RASTERIZER_DISCARD);
+        current = 1 - current;
+    }
+    head = (head + spawnCount) % capacity;
+    activeSeconds -= dt;
+}
+
+int GpuParticles::draw(const glm::dvec3& eye, int viewportHeight)
+{
+    if (!hasOrigin || activeSeconds <= 0.0f)
+        return 0;
+    drawProgram.use();
+    glm::vec3 eyeOffset = glm::vec3(eye - origin);
+    glUniform3fv(drawProgram.uniform("eyeOffset"), 1, glm::value_ptr(eyeOffset));
+    glUniform1f(drawProgram.uniform("viewportHeight"), (float)viewportHeight);
+
+    // Blended over the scene, depth tested but not written
+    glState().enable(GL_PROGRAM_POINT_SIZE);
+    glState().enable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState().depthMask(GL_FALSE);
+    glState().bindVertexArray(drawVAOs[current]);
+    glDrawArrays(GL_POINTS, 0, capacity);
+    glState().bindVertexArray(0);
+    glState().depthMask(GL_TRUE);
+    glState().disable(GL_BLEND);
+    glState().disable(GL_PROGRAM_POINT_SIZE);
+    return 1;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "chunk.h"
+#include "occupancy_volume.h"
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Uniform buffer binding of the emitter block
+const unsigned int PARTICLE_EMITTER_BINDING = 3;
+
+enum ParticleKind {
+    PARTICLE_DEBRIS,    // Chips of a broken block, thrown out and falling
+    PARTICLE_RAIN,      // Falling straight, drawn as streaks
+    PARTICLE_SNOW,      // Drifting down slowly
+    PARTICLE_KIND_COUNT
+};
+
+// A burst of particles to spawn this frame. The GPU derives every
+// particle's start from the emitter and the particle's slot.
+struct ParticleEmitter {
+    glm::dvec3 position;        // World space
+    float spread = 0.5f;        // Particles start within this many blocks of it (on x and z only for weather)
+    glm::vec3 velocity = glm::vec3(0.0f);   // Blocks per second
+    float speedJitter = 0.0f;   // Random velocity added, up to this much on each axis
+    float lifetime = 1.0f;      // Seconds
+    int count = 0;
+    ParticleKind kind = PARTICLE_DEBRIS;
+    BlockId block = BLOCK_STONE; // Colour of debris
+};
+
+// Weather drawn with particles around the eye
+enum Weather {
+    WEATHER_CLEAR,
+    WEATHER_RAIN,
+    WEATHER_SNOW,
+    WEATHER_COUNT
+};
+
+// Particles simulated entirely on the GPU. Their state lives in buffers
+// the CPU never reads or writes: each frame the CPU only fills a small
+// uniform buffer of emitters, and one pass over every slot of a fixed-size
+// ring both spawns (slots from the ring head on, each taking its start
+// from the emitter it falls in and a hash of the slot) and advances the
+// rest. New particles overwrite the oldest once the ring is full.
+//
+// With compute shaders (GL 4.3) the pass updates one storage buffer in
+// place; on GL 3.3 a vertex shader streams it between two buffers with
+// transform feedback, rasterisation off. Either way the result is drawn
+// straight from the buffer as point sprites.
+//
+// Positions are kept relative to an origin near the eye, moved (and the
+// particles shifted with it) when the eye wanders off, so they keep their
+// precision anywhere in the world.
+struct GpuParticles {
+    static const int MAX_EMITTERS = 32;
+
+    // 'capacity' particles; Camera and Palette blocks at the given bindings
+    void init(int capacity, unsigned int cameraBinding, unsigned int paletteBinding);
+    void destroy();
+
+    // Spawn the bursts of 'emitters' (at most MAX_EMITTERS, more are
+    // dropped) and advance every particle by 'dt' seconds
+    void update(const std::vector<ParticleEmitter>& emitters, float dt, const glm::dvec3& eye);
+    // Draw the live particles from 'eye', blended over the scene;
+    // 'viewportHeight' sizes the sprites. Returns the draw calls.
+    int draw(const glm::dvec3& eye, int viewportHeight);
+
+    // Emitter of one frame's weather around 'eye', for 'dt' seconds
+    ParticleEmitter weatherEmitter(Weather weather, const glm::dvec3& eye, float dt);
+
+    // Optional (not owned); particles collide with its solid blocks
+    const OccupancyVolume* occupancy = nullptr;
+    bool compute = false;   // Updated by compute shader, else transform feedback
+    int capacity = 0;
+
+private:
+    ShaderProgram updateProgram;
+    ShaderProgram drawProgram;
+    unsigned int buffers[2] = {};       // Particle state; only [0] with compute
+    unsigned int drawVAOs[2] = {};      // Reading buffers[i] as vertex attributes
+    unsigned int emitterUBO = 0;
+    int current = 0;                    // Buffer holding the latest state
+    int head = 0;                       // Next slot to spawn into
+    glm::dvec3 origin = glm::dvec3(0.0);
+    bool hasOrigin = false;
+    float spawnFraction = 0.0f;         // Weather particles owed from earlier frames
+    float activeSeconds = 0.0f;         // Until the last particle spawned dies; idle at 0
+    unsigned int seed = 0;              // Varies the emitters' hashes from frame to frame
+};
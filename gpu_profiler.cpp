@@ -0,0 +1,136 @@
+#include "gpu_profiler.h"
+#include "gl_extensions.h"
+#include "profiler.h"
+
+// Query targets in PipelineStatistic order
+static const GLenum STATISTIC_TARGETS[GpuProfiler::STAT_COUNT] = {
+    GL_VERTEX_SHADER_INVOCATIONS,
+    GL_CLIPPING_INPUT_PRIMITIVES,
+    GL_CLIPPING_OUTPUT_PRIMITIVES,
+    GL_FRAGMENT_SHADER_INVOCATIONS,
+};
+
+void GpuProfiler::init()
+{
+    for (FrameQueries& frame : frames) {
+        glGenQueries(MAX_PASSES * 2, frame.queries);
+        if (glFeatures.pipelineStatistics)
+            glGenQueries(MAX_PASSES * STAT_COUNT, frame.statisticQueries);
+        frame.count = 0;
+    }
+    current = 0;
+    openCount = 0;
+    counting = false;
+}
+
+void GpuProfiler::destroy()
+{
+    for (FrameQueries& frame : frames) {
+        if (frame.queries[0] != 0)
+            glDeleteQueries(MAX_PASSES * 2, frame.queries);
+        if (frame.statisticQueries[0] != 0)
+            glDeleteQueries(MAX_PASSES * STAT_COUNT, frame.statisticQueries);
+        for (unsigned int& query : frame.queries)
+            query = 0;
+        for (unsigned int& query : frame.statisticQueries)
+            query = 0;
+        frame.count = 0;
+    }
+    results.clear();
+}
+
+void GpuProfiler::beginFrame()
+{
+    // Re-align the clocks each frame so drift between them stays small
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    gpuToCpu = profilerNow() - (int64_t)gpuNow;
+
+    FrameQueries& frame = frames[current];
+    if (frame.count > 0) {
+        // The last timestamp written is the last to finish
+        GLuint available = 0;
+        glGetQueryObjectuiv(frame.queries[frame.count * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+            collect(frame);
+        // Otherwise the GPU is even further behind; the set is reused and lost
+    }
+    frame.count = 0;
+    openCount = 0;
+    counting = statistics && frame.statisticQueries[0] != 0;
+}
+
+void GpuProfiler::beginPass(const char* name)
+{
+    FrameQueries& frame = frames[current];
+    int pass = frame.count < MAX_PASSES ? frame.count++ : -1;
+    if (openCount < MAX_PASSES)
+        open[openCount] = pass;
+    openCount++;
+    if (pass < 0)
+        return;
+    frame.names[pass] = name;
+    frame.depths[pass] = openCount - 1;
+    frame.counted[pass] = counting && openCount == 1;
+    glQueryCounter(frame.queries[pass * 2], GL_TIMESTAMP);
+    if (frame.counted[pass]) {
+        for (int stat = 0; stat < STAT_COUNT; stat++)
+            glBeginQuery(STATISTIC_TARGETS[stat], frame.statisticQueries[pass * STAT_COUNT + stat]);
+    }
+}
+
+void GpuProfiler::endPass()
+{
+    if (openCount == 0)
+        return;
+    openCount--;
+    int pass = openCount < MAX_PASSES ? open[openCount] : -1;
+    if (pass < 0)
+        return;
+    FrameQueries& frame = frames[current];
+    if (frame.counted[pass]) {
+        for (int stat = 0; stat < STAT_COUNT; stat++)
+            glEndQuery(STATISTIC_TARGETS[stat]);
+    }
+    glQueryCounter(frame.queries[pass * 2 + 1], GL_TIMESTAMP);
+}
+
+void GpuProfiler::endFrame()
+{
+    // Close anything left open so every begun pass has its end timestamp
+    while (openCount > 0)
+        endPass();
+    current = (current + 1) % FRAME_LATENCY;
+}
+
+void GpuProfiler::collect(FrameQueries& frame)
+{
+    results.clear();
+    GLuint64 first = 0, last = 0;
+    for (int pass = 0; pass < frame.count; pass++) {
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[pass * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(frame.queries[pass * 2 + 1], GL_QUERY_RESULT, &end);
+        if (end < start)
+            end = start;
+        if (pass == 0 || start < first)
+            first = start;
+        if (end > last)
+            last = end;
+        PassTime time = { frame.names[pass], frame.depths[pass], (end - start) / 1e6, false, {} };
+        if (frame.counted[pass]) {
+            // Ended before the pass's last timestamp, so normally done too;
+            // left out rather than waited for if not
+            const unsigned int* queries = &frame.statisticQueries[pass * STAT_COUNT];
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[STAT_COUNT - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            time.counted = available != 0;
+            for (int stat = 0; stat < STAT_COUNT && time.counted; stat++)
+                glGetQueryObjectui64v(queries[stat], GL_QUERY_RESULT, &time.statistics[stat]);
+        }
+        results.push_back(time);
+        profilerRecordTrack("GPU", ProfileZone{ frame.names[pass],
+            (int64_t)start + gpuToCpu, (int64_t)end + gpuToCpu, frame.depths[pass] });
+    }
+    frameMs = (last - first) / 1e6;
+}
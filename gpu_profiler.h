@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// GPU time per render pass from GL_TIMESTAMP queries. Each frame writes its
+// own query set and a set is only read FRAME_LATENCY frames later, once the
+// GPU is done with it, so reading back never stalls the render thread.
+// Finished passes are also recorded on the profiler's "GPU" track, shifted
+// onto the CPU clock, so they line up with CPU zones in exported traces.
+//
+// With 'statistics' set (and glFeatures.pipelineStatistics) top-level passes
+// also count shader invocations and clipped primitives. Queries of one kind
+// can't nest, so passes inside another are covered by their parent's counts.
+struct GpuProfiler {
+    static const int FRAME_LATENCY = 4;     // Query sets in flight
+    static const int MAX_PASSES = 16;       // Per frame; further passes aren't timed
+
+    enum PipelineStatistic {
+        STAT_VERTEX_INVOCATIONS,
+        STAT_CLIPPING_INPUT,        // Primitives reaching the clipper...
+        STAT_CLIPPING_OUTPUT,       // ... and leaving it (culled ones dropped, split ones counted per piece)
+        STAT_FRAGMENT_INVOCATIONS,
+        STAT_COUNT
+    };
+
+    struct PassTime {
+        const char* name;
+        int depth;      // Nesting level
+        double ms;
+        bool counted;   // 'statistics' were recorded
+        uint64_t statistics[STAT_COUNT];
+    };
+
+    void init();
+    void destroy();
+
+    // Start a frame, reading back the oldest query set if it's finished
+    void beginFrame();
+    // Timestamps around a pass; passes may nest
+    void beginPass(const char* name);
+    void endPass();
+    void endFrame();
+
+    // Passes of the most recent frame read back, in begin order
+    const std::vector<PassTime>& passes() const { return results; }
+    double frameMs = 0.0;   // First pass start to last pass end of that frame
+    bool statistics = false;    // Count pipeline statistics from the next frame on
+
+private:
+    struct FrameQueries {
+        unsigned int queries[MAX_PASSES * 2] = {}; // Begin and end timestamp per pass
+        unsigned int statisticQueries[MAX_PASSES * STAT_COUNT] = {};
+        const char* names[MAX_PASSES] = {};
+        int depths[MAX_PASSES] = {};
+        bool counted[MAX_PASSES] = {};
+        int count = 0;
+    };
+
+    // Copy a finished set into 'results' and the profiler
+    void collect(FrameQueries& frame);
+
+    FrameQueries frames[FRAME_LATENCY];
+    int current = 0;
+    int open[MAX_PASSES] = {};  // Stack of begun passes, -1 for untimed ones
+    int openCount = 0;
+    int64_t gpuToCpu = 0;       // Added to GL timestamps to get profilerNow() time
+    bool counting = false;      // 'statistics' as of beginFrame()
+    std::vector<PassTime> results;
+};
+
+// Times the GPU work issued during its lifetime as a pass
+struct GpuPassScope {
+    GpuPassScope(GpuProfiler& profiler, const char* name) : profiler(profiler) { profiler.beginPass(name); }
+    ~GpuPassScope() { profiler.endPass(); }
+    GpuPassScope(const GpuPassScope&) = delete;
+    GpuPassScope& operator=(const GpuPassScope&) = delete;
+
+    GpuProfiler& profiler;
+};
@@ -0,0 +1,126 @@
+#include "gpu_upload_thread.h"
+#include "profiler.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstring>
+
+bool GpuUploadThread::start(GLFWwindow* window)
+{
+    stop();
+    if (!window)
+        return false;
+    context = window;
+    quit = false;
+    submitted = false;
+    running = true;
+    thread = std::thread([this] { run(); });
+    return true;
+}
+
+void GpuUploadThread::stop()
+{
+    if (!running)
+        return;
+    finish();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+    running = false;
+    context = nullptr;
+}
+
+void GpuUploadThread::write(unsigned int buffer, size_t offset, const void* data, size_t bytes)
+{
+    Batch& batch = batches[filling];
+    size_t source = batch.data.size();
+    batch.data.resize(source + bytes);
+    memcpy(batch.data.data() + source, data, bytes);
+    batch.writes.push_back({ buffer, offset, bytes, source });
+}
+
+void GpuUploadThread::kick()
+{
+    if (batches[filling].writes.empty())
+        return;
+    if (inFlight)
+        finish();
+    Batch& batch = batches[filling];
+    batch.ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // The thread's context waits on the fence, which only works once the
+    // GPU has it
+    glFlush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        working = filling;
+        submitted = true;
+    }
+    wake.notify_one();
+    inFlight = true;
+    filling ^= 1;
+}
+
+void GpuUploadThread::finish()
+{
+    if (!inFlight) {
+        if (batches[filling].writes.empty())
+            return;
+        kick();
+    }
+    PROFILE_ZONE("Wait for uploads");
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return !submitted; });
+    }
+    Batch& batch = batches[working];
+    glWaitSync((GLsync)batch.done, 0, GL_TIMEOUT_IGNORED);
+    // Deleting is deferred by GL until nothing waits on them
+    glDeleteSync((GLsync)batch.done);
+    glDeleteSync((GLsync)batch.ready);
+    batch.done = nullptr;
+    batch.ready = nullptr;
+    batchBytes = batch.data.size();
+    batchMs = batch.ms;
+    batch.data.clear();
+    batch.writes.clear();
+    inFlight = false;
+}
+
+void GpuUploadThread::run()
+{
+    glfwMakeContextCurrent(context);
+    profilerSetThreadName("Uploads");
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return submitted || quit; });
+        if (!submitted)
+            break;
+        // The render thread fills the other batch meanwhile and leaves this
+        // one alone until finish() sees 'submitted' cleared
+        Batch& batch = batches[working];
+        lock.unlock();
+
+        PROFILE_ZONE("Upload batch");
+        auto begin = std::chrono::steady_clock::now();
+        glWaitSync((GLsync)batch.ready, 0, GL_TIMEOUT_IGNORED);
+        for (const Write& w : batch.writes) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, w.buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)w.offset, (GLsizeiptr)w.bytes, batch.data.data() + w.source);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        batch.done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        batch.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        lock.lock();
+        submitted = false;
+        finished.notify_one();
+    }
+    lock.unlock();
+    glfwMakeContextCurrent(NULL);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// Buffer uploads on a thread of their own, in a second GL context sharing
+// objects with the render thread's. The render thread only copies the data
+// into a batch (write()); the thread makes the glBufferSubData calls, so
+// the driver's copies and validation no longer take submission time. The
+// alternative is GpuHeap's staging ring: on integrated GPUs, whose mapped
+// memory the GPU reads directly, that costs the render thread about as
+// little, which is why it stays the default there.
+//
+// Both directions are ordered by fences. kick() fences the render context,
+// and the thread's context waits on that fence before writing, so buffers
+// the render thread has just created or resized are complete. finish()
+// waits for the thread's fence after its writes, as a GPU-side wait in the
+// render context, so later draws see the new contents. One batch is in
+// flight at a time; the render thread fills the next one meanwhile.
+//
+// The thread's context has its own bindings and doesn't go through
+// glState(), whose cache follows the render context only.
+struct GpuUploadThread {
+    // Run on 'context', a hidden window sharing the render context's
+    // objects (windows are created on the main thread, as GLFW wants). False
+    // without one; the thread then stays inactive.
+    bool start(GLFWwindow* context);
+    // Finish what is queued and end the thread. Render context current.
+    void stop();
+    bool active() const { return running; }
+
+    // The rest is render thread only.
+    // Queue a copy of 'bytes' of 'data' into 'buffer' at 'offset'
+    void write(unsigned int buffer, size_t offset, const void* data, size_t bytes);
+    // Hand the queued writes to the thread
+    void kick();
+    // Make every write so far visible to the render context's next
+    // commands, kicking the queued ones first. Waits for the thread.
+    void finish();
+    // Writes queued or handed over and not finished
+    bool pending() const { return !batches[filling].writes.empty() || inFlight; }
+
+    // Of the last finished batch: bytes written and the thread's time
+    size_t batchBytes = 0;
+    double batchMs = 0.0;
+
+private:
+    struct Write {
+        unsigned int buffer;
+        size_t offset;
+        size_t bytes;
+        size_t source;      // Offset in the batch's data
+    };
+    struct Batch {
+        std::vector<uint8_t> data;  // Kept from batch to batch
+        std::vector<Write> writes;
+        void* ready = nullptr;      // Render context fence the thread waits on
+        void* done = nullptr;       // Thread fence after its writes
+        double ms = 0.0;
+    };
+
+    void run();
+
+    GLFWwindow* context = nullptr;
+    std::thread thread;
+    bool running = false;
+
+    std::mutex mutex;
+    std::condition_variable wake;       // A batch was handed over, or stop()
+    std::condition_variable finished;   // The thread is done with its batch
+    bool submitted = false;             // The thread has batches[working] to write
+    bool quit = false;
+
+    Batch batches[2];
+    int filling = 0;                    // Batch write() appends to
+    int working = 0;                    // Batch last handed to the thread
+    bool inFlight = false;              // batches[working] kicked and not finished
+};
@@ -0,0 +1,99 @@
+#include "hardware_tier.h"
+
+#include "cvars.h"
+#include "gl_extensions.h"
+#include "thread_priority.h"
+
+#include <algorithm>
+
+const char* GPU_VENDOR_NAMES[GPU_VENDOR_COUNT] = { "other", "NVIDIA", "AMD", "Intel" };
+const char* QUALITY_TIER_NAMES[QUALITY_TIER_COUNT] = { "auto", "low", "medium", "high", "ultra" };
+
+// Mesa reports itself as the vendor, so the renderer string is searched too
+static bool mentions(const std::string& text, const char* word)
+{
+    return text.find(word) != std::string::npos;
+}
+
+HardwareProfile probeHardware()
+{
+    HardwareProfile hardware;
+    const char* vendor = (const char*)glGetString(GL_VENDOR);
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    hardware.renderer = renderer ? renderer : "";
+    std::string names = std::string(vendor ? vendor : "") + " " + hardware.renderer;
+    if (mentions(names, "NVIDIA"))
+        hardware.vendor = GPU_VENDOR_NVIDIA;
+    else if (mentions(names, "AMD") || mentions(names, "ATI") || mentions(names, "Radeon"))
+        hardware.vendor = GPU_VENDOR_AMD;
+    else if (mentions(names, "Intel"))
+        hardware.vendor = GPU_VENDOR_INTEL;
+
+    // APUs name no model, just the graphics of the processor
+    hardware.integrated = (hardware.vendor == GPU_VENDOR_INTEL && !mentions(hardware.renderer, "Arc")) ||
+        (hardware.vendor == GPU_VENDOR_AMD && (mentions(hardware.renderer, "Radeon(TM) Graphics") ||
+            mentions(hardware.renderer, "Radeon Graphics") || mentions(hardware.renderer, "Radeon Vega")));
+
+    GpuMemoryInfo memory;
+    if (queryGpuMemory(memory))
+        hardware.vramMB = memory.totalMB >= 0 ? memory.totalMB : memory.availableMB;
+    hardware.cores = hardwareThreadCount();
+    return hardware;
+}
+
+QualityTier chooseQualityTier(const HardwareProfile& hardware)
+{
+    if (!glFeatures.multiDrawIndirect || !glFeatures.computeShaders || hardware.integrated)
+        return QUALITY_LOW;
+
+    QualityTier tier = QUALITY_MEDIUM;  // Discrete, size unknown
+    if (hardware.vramMB >= 0) {
+        tier = hardware.vramMB < 2048 ? QUALITY_LOW :
+            hardware.vramMB < 4096 ? QUALITY_MEDIUM :
+            hardware.vramMB < 10240 ? QUALITY_HIGH : QUALITY_ULTRA;
+    }
+    if (hardware.cores < 4)
+        tier = std::min(tier, QUALITY_MEDIUM);
+    else if (hardware.cores < 8)
+        tier = std::min(tier, QUALITY_HIGH);
+    return tier;
+}
+
+struct TierSetting {
+    const char* name;
+    const char* value;
+};
+
+// Departures from the built-in defaults, which are the high tier
+static const TierSetting LOW_SETTINGS[] = {
+    { "render_distance", "4" }, { "lod_distance", "32" }, { "shadows", "off" }, { "point_lights", "off" },
+    { "temporal_upscale", "off" }, { "chunk_loads_per_tick", "16" }, { "mesh_upload_kb", "256" },
+    { "lod_upload_kb", "128" }, { "voxel_mb", "128" }, { "mesh_mb", "32" }, { "gpu_mb", "128" },
+    { "gen_cache_mb", "16" },
+};
+static const TierSetting MEDIUM_SETTINGS[] = {
+    { "render_distance", "5" }, { "lod_distance", "64" }, { "mesh_upload_kb", "512" },
+    { "lod_upload_kb", "256" }, { "voxel_mb", "192" }, { "gpu_mb", "192" }, { "gen_cache_mb", "32" },
+};
+static const TierSetting ULTRA_SETTINGS[] = {
+    { "render_distance", "10" }, { "lod_distance", "256" }, { "fxaa", "on" }, { "chunk_loads_per_tick", "64" },
+    { "mesh_upload_kb", "2048" }, { "lod_upload_kb", "1024" }, { "voxel_mb", "512" }, { "mesh_mb", "128" },
+    { "gpu_mb", "768" }, { "gen_cache_mb", "128" },
+};
+
+template <size_t N>
+static void applySettings(const TierSetting (&settings)[N], CVarRegistry& cvars)
+{
+    for (const TierSetting& setting : settings)
+        cvars.setDefault(setting.name, setting.value);
+}
+
+void applyQualityTier(QualityTier tier, CVarRegistry& cvars)
+{
+    switch (tier) {
+    case QUALITY_LOW: applySettings(LOW_SETTINGS, cvars); break;
+    case QUALITY_MEDIUM: applySettings(MEDIUM_SETTINGS, cvars); break;
+    case QUALITY_ULTRA: applySettings(ULTRA_SETTINGS, cvars); break;
+    default: break;
+    }
+}
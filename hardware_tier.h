@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+
+struct CVarRegistry;
+
+enum GpuVendor {
+    GPU_VENDOR_OTHER,
+    GPU_VENDOR_NVIDIA,
+    GPU_VENDOR_AMD,
+    GPU_VENDOR_INTEL,
+    GPU_VENDOR_COUNT
+};
+extern const char* GPU_VENDOR_NAMES[GPU_VENDOR_COUNT];
+
+// What the machine offers, from the context (glFeatures must be loaded)
+// and the OS
+struct HardwareProfile {
+    std::string renderer;       // GL_RENDERER
+    GpuVendor vendor = GPU_VENDOR_OTHER;
+    bool integrated = false;    // Shares system memory (Intel other than Arc, AMD APUs)
+    int vramMB = -1;            // Dedicated video memory, or free memory at start-up with
+                                // ATI_meminfo only; -1 when the driver doesn't say
+    int cores = 1;              // Logical processors
+};
+HardwareProfile probeHardware();
+
+// Performance tiers, each a set of cvar defaults. QUALITY_AUTO picks one
+// from the hardware.
+enum QualityTier {
+    QUALITY_AUTO,
+    QUALITY_LOW,        // Integrated GPUs and GL 3.3-only drivers
+    QUALITY_MEDIUM,
+    QUALITY_HIGH,       // The built-in defaults
+    QUALITY_ULTRA,
+    QUALITY_TIER_COUNT
+};
+extern const char* QUALITY_TIER_NAMES[QUALITY_TIER_COUNT];
+
+// Without the GL 4.3 draw path a machine is low whatever its memory;
+// otherwise video memory decides, capped by the core count, which bounds
+// how fast chunks stream in
+QualityTier chooseQualityTier(const HardwareProfile& hardware);
+
+// Set the tier's defaults through CVarRegistry::setDefault(), so whatever
+// the config file or the command line set is kept. Start-up only.
+void applyQualityTier(QualityTier tier, CVarRegistry& cvars);
@@ -0,0 +1,172 @@
+#include "hiz_buffer.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+
+#include <algorithm>
+
+static const char* copyShaderSource = R"(
+#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform sampler2D sceneDepth;
+layout (r32f, binding = 0) writeonly uniform image2D dst;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(p, imageSize(dst))))
+        return;
+    imageStore(dst, p, vec4(texelFetch(sceneDepth, p, 0).r));
+}
+)";
+
+static const char* reduceShaderSource = R"(
+#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) readonly uniform image2D src;
+layout (r32f, binding = 1) writeonly uniform image2D dst;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(dst);
+    if (any(greaterThanEqual(p, dstSize)))
+        return;
+
+    // 2x2 footprint; the last row / column also takes the odd texel of the
+    // source so nothing is dropped on non-power-of-two levels
+    ivec2 srcSize = imageSize(src);
+    ivec2 extent = ivec2(2) + ivec2(equal(p, dstSize - 1)) * (srcSize & 1);
+    float farthest = 0.0;
+    for (int y = 0; y < extent.y; y++)
+        for (int x = 0; x < extent.x; x++)
+            farthest = max(farthest, imageLoad(src, min(p * 2 + ivec2(x, y), srcSize - 1)).r);
+    imageStore(dst, p, vec4(farthest));
+}
+)";
+
+static int levelSize(int size, int level)
+{
+    return std::max(1, size >> level);
+}
+
+bool HiZBuffer::init(int w, int h)
+{
+    if (!glFeatures.computeShaders || !glFeatures.imageLoadStore)
+        return false;
+
+    copyProgram.createCompute(copyShaderSource);
+    reduceProgram.createCompute(reduceShaderSource);
+    width = w;
+    height = h;
+    createTargets();
+    return true;
+}
+
+void HiZBuffer::destroy()
+{
+    if (copyProgram.id == 0)
+        return;
+    destroyTargets();
+    copyProgram.destroy();
+    reduceProgram.destroy();
+}
+
+bool HiZBuffer::resize(int w, int h)
+{
+    if (w == width && h == height)
+        return false;
+    width = w;
+    height = h;
+    destroyTargets();
+    createTargets();
+    return true;
+}
+
+void HiZBuffer::createTargets()
+{
+    // A minimised window reports a zero-sized framebuffer
+    int w = std::max(width, 1);
+    int h = std::max(height, 1);
+
+    glGenTextures(1, &colorTexture);
+    glState().bindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &depthTexture);
+    glState().bindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, w, h, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &framebuffer);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Full mip chain down to 1x1
+    levels = 1;
+    while ((w >> levels) > 0 || (h >> levels) > 0)
+        levels++;
+
+    glGenTextures(1, &pyramid);
+    glState().bindTexture(GL_TEXTURE_2D, pyramid);
+    for (int level = 0; level < levels; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelSize(w, level), levelSize(h, level), 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+}
+
+void HiZBuffer::destroyTargets()
+{
+    glState().deleteFramebuffers(1, &framebuffer);
+    glState().deleteTextures(1, &colorTexture);
+    glState().deleteTextures(1, &depthTexture);
+    glState().deleteTextures(1, &pyramid);
+    framebuffer = colorTexture = depthTexture = pyramid = 0;
+    levels = 0;
+}
+
+void HiZBuffer::bindScene() const
+{
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void HiZBuffer::build() const
+{
+    int w = std::max(width, 1);
+    int h = std::max(height, 1);
+
+    copyProgram.use();
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindTexture(GL_TEXTURE_2D, depthTexture);
+    glBindImageTexture(0, pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+
+    reduceProgram.use();
+    for (int level = 1; level < levels; level++) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glBindImageTexture(0, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((levelSize(w, level) + 7) / 8, (levelSize(h, level) + 7) / 8, 1);
+    }
+
+    // Next frame's culling pass samples the pyramid
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+}
+
+void HiZBuffer::present(unsigned int target, int targetWidth, int targetHeight) const
+{
+    glState().bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT,
+        width == targetWidth && height == targetHeight ? GL_NEAREST : GL_LINEAR);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "shader.h"
+
+// Offscreen scene target plus a hierarchical depth (Hi-Z) pyramid built from
+// its depth buffer. Each texel of level n holds the farthest depth of the
+// texels it covers in level n - 1, so one fetch at the right level bounds
+// the depth behind any screen rectangle. GpuCuller tests chunk bounds against
+// the previous frame's pyramid to skip chunks hidden behind nearer terrain.
+// Needs compute shaders and image load/store.
+struct HiZBuffer {
+    unsigned int framebuffer = 0;   // Scene colour + depth, blitted to the window by present()
+    unsigned int colorTexture = 0;
+    unsigned int depthTexture = 0;
+    unsigned int pyramid = 0;       // R32F, one mip level per reduction
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+
+    // Returns false when the context lacks the required features
+    bool init(int width, int height);
+    void destroy();
+    // Recreate the targets for a new framebuffer size (no-op if unchanged).
+    // Returns true when they were recreated, invalidating the pyramid.
+    bool resize(int width, int height);
+
+    // Render the scene into the offscreen target
+    void bindScene() const;
+    // Reduce the scene depth into the pyramid (call after the opaque pass)
+    void build() const;
+    // Copy the scene colour to 'target', stretched over its 'targetWidth' x
+    // 'targetHeight' with bilinear filtering when the scene is scaled, and
+    // leave it bound
+    void present(unsigned int target, int targetWidth, int targetHeight) const;
+
+private:
+    void createTargets();
+    void destroyTargets();
+
+    ShaderProgram copyProgram;      // Scene depth -> level 0
+    ShaderProgram reduceProgram;    // Level n - 1 -> level n
+};
@@ -0,0 +1,160 @@
+#include "hiz_readback.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "hiz_buffer.h"
+#include "profiler.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+
+// Texels across a footprint worth reading; larger boxes are near the eye
+// and rarely hidden, so they are taken as visible
+const int HIZ_MAX_FOOTPRINT = 8;
+
+bool HiZSnapshot::occluded(const glm::dvec3& boxMin, const glm::dvec3& boxMax) const
+{
+    if (depth.empty())
+        return false;
+    glm::vec3 lo = glm::vec3(boxMin - eye);
+    glm::vec3 hi = glm::vec3(boxMax - eye);
+    glm::vec2 uvMin(1.0f), uvMax(0.0f);
+    float nearest = 1.0f;
+    for (int c = 0; c < 8; c++) {
+        glm::vec3 corner = glm::mix(lo, hi, glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+        glm::vec4 clip = viewProj * glm::vec4(corner, 1.0f);
+        if (clip.w <= 0.0f)
+            return false;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        uvMin = glm::min(uvMin, glm::vec2(ndc) * 0.5f + 0.5f);
+        uvMax = glm::max(uvMax, glm::vec2(ndc) * 0.5f + 0.5f);
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+    if (uvMax.x < 0.0f || uvMax.y < 0.0f || uvMin.x > 1.0f || uvMin.y > 1.0f)
+        return false;   // Off screen: not the pyramid's to judge
+    uvMin = glm::clamp(uvMin, 0.0f, 1.0f);
+    uvMax = glm::clamp(uvMax, 0.0f, 1.0f);
+
+    // Through pixel coordinates, as texels of level n cover pixels p >> n
+    glm::ivec2 size0(sceneWidth, sceneHeight);
+    glm::ivec2 last(width - 1, height - 1);
+    glm::ivec2 t0 = glm::min(glm::ivec2(uvMin * glm::vec2(size0)) >> level, last);
+    glm::ivec2 t1 = glm::min(glm::min(glm::ivec2(uvMax * glm::vec2(size0)), size0 - 1) >> level, last);
+    if (t1.x - t0.x >= HIZ_MAX_FOOTPRINT || t1.y - t0.y >= HIZ_MAX_FOOTPRINT)
+        return false;
+    for (int y = t0.y; y <= t1.y; y++)
+        for (int x = t0.x; x <= t1.x; x++)
+            if (depth[(size_t)y * width + x] >= nearest)
+                return false;
+    return true;
+}
+
+void HiZReadback::init()
+{
+    for (Readback& slot : ring) {
+        slot = Readback();
+        glGenBuffers(1, &slot.buffer);
+    }
+    next = 0;
+}
+
+void HiZReadback::destroy()
+{
+    clear();
+    for (Readback& slot : ring) {
+        if (slot.buffer)
+            glState().deleteBuffers(1, &slot.buffer);
+        slot.buffer = 0;
+    }
+}
+
+void HiZReadback::capture(const HiZBuffer& hiz, const glm::mat4& viewProj, const glm::dvec3& eye)
+{
+    if (hiz.levels == 0 || hiz.width <= 0 || hiz.height <= 0)
+        return;
+    // A slot still in flight is dropped rather than waited on: a newer
+    // pyramid replaces it anyway
+    Readback& slot = ring[next];
+    if (slot.fence) {
+        glDeleteSync((GLsync)slot.fence);
+        slot.fence = nullptr;
+    }
+
+    HiZSnapshot& s = slot.snapshot;
+    s.sceneWidth = hiz.width;
+    s.sceneHeight = hiz.height;
+    s.level = 0;
+    while (s.level < hiz.levels - 1 && std::max(1, hiz.width >> s.level) > MAX_WIDTH)
+        s.level++;
+    s.width = std::max(1, hiz.width >> s.level);
+    s.height = std::max(1, hiz.height >> s.level);
+    s.viewProj = viewProj;
+    s.eye = eye;
+
+    size_t bytes = (size_t)s.width * s.height * sizeof(float);
+    glState().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.bytes < bytes) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)bytes, nullptr, GL_STREAM_READ);
+        slot.bytes = bytes;
+    }
+    // The pyramid was written as images; make that visible to the copy
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindTexture(GL_TEXTURE_2D, hiz.pyramid);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, s.level, GL_RED, GL_FLOAT, nullptr);
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+    glState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next = (next + 1) % RING_SIZE;
+}
+
+void HiZReadback::collect()
+{
+    // Oldest first, so the newest finished one is published last
+    for (int i = 0; i < RING_SIZE; i++) {
+        Readback& slot = ring[(next + i) % RING_SIZE];
+        if (!slot.fence)
+            continue;
+        GLenum status = glClientWaitSync((GLsync)slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync((GLsync)slot.fence);
+        slot.fence = nullptr;
+
+        PROFILE_ZONE("Hi-Z readback");
+        std::shared_ptr<HiZSnapshot> snapshot = std::make_shared<HiZSnapshot>(slot.snapshot);
+        snapshot->depth.resize((size_t)snapshot->width * snapshot->height);
+        glState().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        const void* texels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+            (GLsizeiptr)(snapshot->depth.size() * sizeof(float)), GL_MAP_READ_BIT);
+        if (texels) {
+            memcpy(snapshot->depth.data(), texels, snapshot->depth.size() * sizeof(float));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!texels)
+            continue;
+        std::lock_guard<std::mutex> lock(mutex);
+        published = snapshot;
+    }
+}
+
+void HiZReadback::clear()
+{
+    for (Readback& slot : ring) {
+        if (slot.fence)
+            glDeleteSync((GLsync)slot.fence);
+        slot.fence = nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    published.reset();
+}
+
+std::shared_ptr<const HiZSnapshot> HiZReadback::latest() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return published;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct HiZBuffer;
+
+// One coarse level of a Hi-Z pyramid on the CPU, with the view it was
+// rendered from
+struct HiZSnapshot {
+    int sceneWidth = 0, sceneHeight = 0;    // Level 0, in pixels
+    int level = 0;                          // Of the pyramid 'depth' is
+    int width = 0, height = 0;
+    std::vector<float> depth;               // Farthest window depth per texel, rows bottom first
+    glm::mat4 viewProj = glm::mat4(1.0f);   // Camera-relative, as the frame was drawn
+    glm::dvec3 eye = glm::dvec3(0.0);
+
+    // True when the box is certainly behind what that frame drew: its
+    // nearest point is farther than the farthest depth over its footprint.
+    // The test the culling pass makes for meshlets, at this one level; a
+    // box reaching behind the eye or over too many texels is never hidden.
+    bool occluded(const glm::dvec3& boxMin, const glm::dvec3& boxMax) const;
+};
+
+// The Hi-Z pyramid read back for the CPU to cull with, so what is hidden
+// behind terrain (entities in caves, debris bursts behind a hill) costs
+// neither the CPU nor the GPU anything. After the pyramid is built the
+// first level of at most MAX_WIDTH texels across is read into the next of a
+// ring of pixel pack buffers and fenced, like FrameCapture's readbacks; a
+// later frame copies it out once the fence has signalled. The newest copy
+// is published for any thread to test against: it is a few frames old,
+// which only ever errs towards showing things (a box uncovered since pops
+// in that many frames late).
+struct HiZReadback {
+    static const int RING_SIZE = 3;
+    static const int MAX_WIDTH = 128;
+
+    void init();
+    void destroy();
+
+    // Read the pyramid just built with 'viewProj' (camera-relative) at 'eye'.
+    // Render thread, after HiZBuffer::build().
+    void capture(const HiZBuffer& hiz, const glm::mat4& viewProj, const glm::dvec3& eye);
+    // Publish the readbacks the GPU has finished. Every frame.
+    void collect();
+    // Drop what was published and in flight, for frames without a pyramid
+    void clear();
+
+    // The newest snapshot, or null. Any thread.
+    std::shared_ptr<const HiZSnapshot> latest() const;
+
+private:
+    struct Readback {
+        unsigned int buffer = 0;
+        void* fence = nullptr;      // GLsync
+        size_t bytes = 0;           // Allocated
+        HiZSnapshot snapshot;       // All but the depth, until it arrives
+    };
+
+    Readback ring[RING_SIZE];
+    int next = 0;
+    mutable std::mutex mutex;
+    std::shared_ptr<const HiZSnapshot> published;
+};
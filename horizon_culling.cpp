@@ -0,0 +1,151 @@
+#include "horizon_culling.h"
+#include "chunk_renderer.h"
+#include "profiler.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const float TWO_PI = 6.28318530718f;
+
+static uint64_t columnKey(const glm::ivec2& column)
+{
+    return packChunkCoord(glm::ivec3(column.x, 0, column.y));
+}
+
+// Bin holding azimuth 'angle' (radians, any turn)
+static int binOf(float angle)
+{
+    int bin = (int)std::floor(angle * (HorizonCuller::BINS / TWO_PI));
+    return ((bin % HorizonCuller::BINS) + HorizonCuller::BINS) % HorizonCuller::BINS;
+}
+
+// Bins from 'first' to 'last' round the circle (both included)
+template <typename Visit>
+static void forEachBin(int first, int last, Visit visit)
+{
+    for (int bin = first; ; bin = (bin + 1) % HorizonCuller::BINS) {
+        visit(bin);
+        if (bin == last)
+            break;
+    }
+}
+
+void HorizonCuller::clear()
+{
+    hidden.clear();
+    hiddenChunks = 0;
+}
+
+void HorizonCuller::build(const World& world, const ChunkRenderer& renderer, const glm::dvec3& eye)
+{
+    PROFILE_ZONE("Horizon culling");
+    hidden.clear();
+    glm::ivec3 eyeBlock = glm::ivec3(glm::floor(eye));
+    if (eyeBlock.y <= world.skyHeight(eyeBlock.x, eyeBlock.z))
+        return;
+
+    // Every column with a chunk, but the camera's own
+    columns.clear();
+    for (const ChunkRenderData& data : renderer.chunks) {
+        glm::ivec2 coord(data.chunk->coord.x, data.chunk->coord.z);
+        if (!hidden.insert(columnKey(coord), 0))
+            continue;
+        glm::vec2 lo = glm::vec2(glm::dvec2(coord) * (double)CHUNK_SIZE - glm::dvec2(eye.x, eye.z));
+        glm::vec2 hi = lo + glm::vec2((float)CHUNK_SIZE);
+        glm::vec2 outside = glm::max(glm::max(lo, -hi), glm::vec2(0.0f));
+        if (outside == glm::vec2(0.0f))
+            continue;
+
+        Column column;
+        column.coord = coord;
+        column.nearest = glm::length(outside);
+        column.farthest = glm::length(glm::max(glm::abs(lo), glm::abs(hi)));
+        // Corner azimuths about the centre's, which the square spans less than half a turn around
+        glm::vec2 centre = (lo + hi) * 0.5f;
+        float middle = std::atan2(centre.y, centre.x);
+        column.firstAngle = middle;
+        column.lastAngle = middle;
+        for (int corner = 0; corner < 4; corner++) {
+            glm::vec2 p((corner & 1) ? hi.x : lo.x, (corner & 2) ? hi.y : lo.y);
+            float offset = std::atan2(p.y, p.x) - middle;
+            if (offset > TWO_PI / 2)
+                offset -= TWO_PI;
+            else if (offset < -TWO_PI / 2)
+                offset += TWO_PI;
+            column.firstAngle = std::min(column.firstAngle, middle + offset);
+            column.lastAngle = std::max(column.lastAngle, middle + offset);
+        }
+        column.ground = world.groundHeight(coord);
+        columns.push_back(column);
+    }
+    std::sort(columns.begin(), columns.end(), [](const Column& a, const Column& b) { return a.nearest < b.nearest; });
+
+    std::fill(horizon, horizon + BINS, -std::numeric_limits<float>::infinity());
+    pending.clear();
+    auto later = [](const Occluder& a, const Occluder& b) { return a.farthest > b.farthest; };
+    float eyeHeight = (float)eye.y;
+    for (const Column& column : columns) {
+        // Ground wholly nearer than this column is in the horizon
+        while (!pending.empty() && pending.front().farthest <= column.nearest) {
+            const Occluder& occluder = pending.front();
+            forEachBin(occluder.firstBin, occluder.lastBin, [&](int bin) {
+                horizon[bin] = std::max(horizon[bin], occluder.slope);
+            });
+            std::pop_heap(pending.begin(), pending.end(), later);
+            pending.pop_back();
+        }
+
+        // The lowest horizon over the bins the column touches hides the
+        // chunks whose top edge stays under it everywhere
+        float lowest = std::numeric_limits<float>::infinity();
+        forEachBin(binOf(column.firstAngle), binOf(column.lastAngle), [&](int bin) {
+            lowest = std::min(lowest, horizon[bin]);
+        });
+        uint16_t sections = 0;
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+            float rise = (float)((y + 1) * CHUNK_SIZE) - eyeHeight;
+            float steepest = rise / (rise > 0.0f ? column.nearest : column.farthest);
+            if (steepest >= lowest)
+                break;
+            sections |= (uint16_t)(1u << y);
+        }
+        hidden[columnKey(column.coord)] = sections;
+
+        // Its ground stops every ray under the shallowest elevation it is
+        // seen at, in the bins it fills entirely
+        float binsPerRadian = BINS / TWO_PI;
+        int firstBin = (int)std::ceil(column.firstAngle * binsPerRadian);
+        int lastBin = (int)std::floor(column.lastAngle * binsPerRadian) - 1;
+        if (column.ground < 0 || lastBin < firstBin)
+            continue;
+        float rise = (float)(column.ground + 1) - eyeHeight;
+        Occluder occluder;
+        occluder.farthest = column.farthest;
+        occluder.firstBin = ((firstBin % BINS) + BINS) % BINS;
+        occluder.lastBin = ((lastBin % BINS) + BINS) % BINS;
+        occluder.slope = rise / (rise > 0.0f ? column.farthest : column.nearest);
+        pending.push_back(occluder);
+        std::push_heap(pending.begin(), pending.end(), later);
+    }
+}
+
+int HorizonCuller::filter(ChunkRenderer& renderer)
+{
+    hiddenChunks = 0;
+    if (hidden.size() == 0)
+        return renderer.visibleCount;
+    int kept = 0;
+    for (int v = 0; v < renderer.visibleCount; v++) {
+        int index = renderer.visible[v];
+        const glm::ivec3& coord = renderer.chunks[index].chunk->coord;
+        const uint16_t* sections = hidden.find(columnKey(glm::ivec2(coord.x, coord.z)));
+        if (sections && coord.y >= 0 && coord.y < WORLD_HEIGHT_CHUNKS && (*sections & (1u << coord.y)))
+            hiddenChunks++;
+        else
+            renderer.visible[kept++] = index;
+    }
+    renderer.visibleCount = kept;
+    return kept;
+}
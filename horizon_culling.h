@@ -0,0 +1,60 @@
+#pragma once
+
+#include "chunk_hash_map.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct ChunkRenderer;
+struct World;
+
+// Terrain horizon occlusion on the CPU, for the frustum and cave culling
+// paths (GL 3.3 included). The loaded chunk columns are visited outwards
+// from the camera; each raises an occlusion horizon by its ground height
+// (World::groundHeight()): per azimuth bin, the steepest elevation below
+// which every ray meets the ground. A chunk whose box stays under the
+// horizon across all the bins it spans is hidden. Ground only counts once
+// every column nearer is tested, so nothing is hidden by terrain behind it.
+//
+// The terrain is taken as a height field: generated caves stay CAVE_ROOF
+// blocks under the surface, so a ray under the ground stays there, and
+// trees, which stand over open air, don't count as ground. With the eye
+// under its own column's sky height (in a cave, under a tree) nothing is
+// hidden.
+struct HorizonCuller {
+    static const int BINS = 512;    // Azimuth resolution
+
+    // Build the horizon around 'eye' over the renderer's chunk columns and
+    // note which chunks it hides. While the world may be read.
+    void build(const World& world, const ChunkRenderer& renderer, const glm::dvec3& eye);
+    // Hide nothing until the next build()
+    void clear();
+    // Drop the hidden chunks from renderer.visible, keeping the order.
+    // Returns the new visible count.
+    int filter(ChunkRenderer& renderer);
+
+    int hiddenChunks = 0;           // Dropped by the last filter()
+
+private:
+    struct Column {
+        glm::ivec2 coord;
+        float nearest;              // Horizontal distance from the eye to the column's square
+        float farthest;
+        float firstAngle;           // Azimuth span of the square, radians; first <= last
+        float lastAngle;
+        int ground;                 // World::groundHeight()
+    };
+    struct Occluder {
+        float farthest;             // Applied once every column tested is at least this far
+        int firstBin;               // Bins the column covers entirely
+        int lastBin;
+        float slope;                // Elevation (tangent) below which the bins' rays meet it
+    };
+
+    std::vector<Column> columns;
+    std::vector<Occluder> pending;  // Min-heap on 'farthest'
+    float horizon[BINS];            // Elevation tangent per bin
+    ChunkHashMap<uint16_t> hidden;  // Hidden sections (bit per chunk height) by packed (x, 0, z)
+};
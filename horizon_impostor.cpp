@@ -0,0 +1,212 @@
+#include "horizon_impostor.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Direction and up vector of each face in the cube map's own convention
+// (image rows run down the face), which keeps the views proper rotations
+static const glm::vec3 FACE_DIRECTIONS[HORIZON_FACES] = {
+    { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+    { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+};
+static const glm::vec3 FACE_UPS[HORIZON_FACES] = {
+    { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+    { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+};
+const float CAPTURE_NEAR_PLANE = 2.0f;
+
+static const char* backdropVertexSource = R"(
+#version 330 core
+out vec2 ndc;
+
+void main()
+{
+    // On the far plane, so only pixels nothing has been drawn over pass
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    ndc = corner * 2.0 - 1.0;
+    gl_Position = vec4(ndc, 1.0, 1.0);
+}
+)";
+
+static const char* backdropFragmentSource = R"(
+#version 330 core
+in vec2 ndc;
+out vec4 FragColor;
+
+uniform samplerCube horizon;
+uniform mat4 inverseViewProj;   // Camera-relative
+uniform vec3 eyeOffset;         // Eye from the capture point
+uniform float nearestDistance;  // Radius of the sphere the cube is projected on
+
+void main()
+{
+    vec4 farPoint = inverseViewProj * vec4(ndc, 1.0, 1.0);
+    vec3 rd = normalize(farPoint.xyz / farPoint.w);
+
+    // Look the cube up where the ray leaves the sphere; the eye is always
+    // inside it
+    float b = dot(eyeOffset, rd);
+    float c = dot(eyeOffset, eyeOffset) - nearestDistance * nearestDistance;
+    float t = -b + sqrt(max(b * b - c, 0.0));
+    vec4 color = texture(horizon, eyeOffset + rd * t);
+    if (color.a < 0.5)
+        discard;
+    FragColor = vec4(color.rgb, 1.0);
+}
+)";
+
+bool HorizonImpostor::init()
+{
+    glGenTextures(1, &cubeTexture);
+    glState().bindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    for (int face = 0; face < HORIZON_FACES; face++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, faceSize, faceSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Filter across face edges instead of clamping at each
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, faceSize, faceSize);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, cubeTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    // Nothing captured shows through until its face is drawn
+    for (int face = 0; face < HORIZON_FACES; face++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeTexture, 0);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete) {
+        destroy();
+        return false;
+    }
+
+    program.create(backdropVertexSource, backdropFragmentSource);
+    glGenVertexArrays(1, &emptyVAO);
+    invalidate();
+    captured = false;
+    placed = false;
+    return true;
+}
+
+void HorizonImpostor::destroy()
+{
+    if (cubeTexture == 0)
+        return;
+    if (emptyVAO != 0) {
+        program.destroy();
+        glState().deleteVertexArrays(1, &emptyVAO);
+    }
+    glState().deleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glState().deleteTextures(1, &cubeTexture);
+    cubeTexture = depthBuffer = framebuffer = emptyVAO = 0;
+}
+
+void HorizonImpostor::follow(const glm::dvec3& eye)
+{
+    if (placed && glm::length(eye - capture) < recaptureDistance)
+        return;
+    capture = eye;
+    placed = true;
+    invalidate();
+}
+
+void HorizonImpostor::invalidate()
+{
+    for (bool& s : stale)
+        s = true;
+}
+
+int HorizonImpostor::nextFace(const glm::vec3& forward) const
+{
+    int best = -1;
+    float bestFacing = 0.0f;
+    for (int face = 0; face < HORIZON_FACES; face++) {
+        float facing = glm::dot(FACE_DIRECTIONS[face], forward);
+        if (stale[face] && (best < 0 || facing > bestFacing)) {
+            best = face;
+            bestFacing = facing;
+        }
+    }
+    return best;
+}
+
+int HorizonImpostor::staleFaces() const
+{
+    int count = 0;
+    for (bool s : stale)
+        count += s ? 1 : 0;
+    return count;
+}
+
+glm::mat4 HorizonImpostor::faceView(int face) const
+{
+    return glm::lookAt(glm::vec3(0.0f), FACE_DIRECTIONS[face], FACE_UPS[face]);
+}
+
+glm::mat4 HorizonImpostor::faceProjection(float farPlane) const
+{
+    return glm::perspective(glm::radians(90.0f), 1.0f, CAPTURE_NEAR_PLANE, farPlane);
+}
+
+void HorizonImpostor::beginFace(int face)
+{
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeTexture, 0);
+    glViewport(0, 0, faceSize, faceSize);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void HorizonImpostor::endFace(int face)
+{
+    stale[face] = false;
+    captured = true;
+}
+
+int HorizonImpostor::draw(const glm::mat4& viewProj, const glm::dvec3& eye, float nearestDistance, int textureUnit)
+{
+    if (!captured)
+        return 0;
+
+    // Keep the eye inside the projection sphere even just before a recapture
+    glm::vec3 eyeOffset(eye - capture);
+    float radius = std::max(nearestDistance, glm::length(eyeOffset) + 1.0f);
+
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().depthFunc(GL_LEQUAL);
+    glState().depthMask(GL_FALSE);
+    program.use();
+    glm::mat4 inverse = glm::inverse(viewProj);
+    glUniformMatrix4fv(program.uniform("inverseViewProj"), 1, GL_FALSE, &inverse[0][0]);
+    glUniform3f(program.uniform("eyeOffset"), eyeOffset.x, eyeOffset.y, eyeOffset.z);
+    glUniform1f(program.uniform("nearestDistance"), radius);
+    glUniform1i(program.uniform("horizon"), textureUnit);
+    glState().activeTexture(GL_TEXTURE0 + textureUnit);
+    glState().bindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState().depthFunc(GL_LESS);
+    glState().depthMask(GL_TRUE);
+    glState().polygonMode(polygonMode);
+    return 1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+const int HORIZON_FACES = 6;    // Cube map faces, +X, -X, +Y, -Y, +Z, -Z
+
+// The horizon as a backdrop: the LOD tiles are drawn into a cube map around
+// a capture point, a few faces a frame, and the cube is drawn behind the
+// streamed chunks instead of the tiles themselves. The far field then costs
+// a fullscreen pass per frame, plus a face's worth of tiles while the
+// faces are being redrawn.
+//
+// The faces go stale when the eye has moved recaptureDistance from the
+// capture point (which then moves to the eye) or the tiles have changed
+// (invalidate()); stale faces keep their old image until their turn, the
+// ones the camera faces first. The cube is sampled through a sphere of the
+// nearest captured distance around the capture point, so what is nearest
+// barely slides as the eye wanders from it.
+struct HorizonImpostor {
+    int faceSize = 512;             // Texels per face edge
+    int facesPerFrame = 1;          // Recaptured per frame at most
+    double recaptureDistance = 16.0;    // Blocks the eye may move from the capture point
+
+    // Returns false when the capture framebuffer is incomplete
+    bool init();
+    void destroy();
+
+    // Move the capture point to 'eye' and mark every face stale once the eye
+    // is too far from it
+    void follow(const glm::dvec3& eye);
+    // Every face stale, e.g. as the tiles behind them changed
+    void invalidate();
+    // The stale face nearest 'forward', -1 when none is
+    int nextFace(const glm::vec3& forward) const;
+
+    // Camera of a face, relative to the capture point, out to 'farPlane'
+    glm::mat4 faceView(int face) const;
+    glm::mat4 faceProjection(float farPlane) const;
+    const glm::dvec3& capturePoint() const { return capture; }
+    // Bind 'face' as the target, cleared to transparent, for its tiles to be
+    // drawn into; the caller binds its own target again after endFace()
+    void beginFace(int face);
+    void endFace(int face);
+
+    // Draw the cube behind everything drawn so far in the bound target,
+    // where 'viewProj' is the camera-relative one the scene was drawn with
+    // and 'nearestDistance' how far from the capture point the captured
+    // tiles begin. Returns the draw calls (one, or none before any capture).
+    int draw(const glm::mat4& viewProj, const glm::dvec3& eye, float nearestDistance, int textureUnit);
+
+    int staleFaces() const;
+    // GPU memory of the cube and its depth buffer
+    size_t textureBytes() const { return (size_t)faceSize * faceSize * (HORIZON_FACES * 4 + 4); }
+
+private:
+    ShaderProgram program;
+    unsigned int cubeTexture = 0;   // RGBA8, alpha 0 where nothing was drawn
+    unsigned int depthBuffer = 0;   // Shared by every face's capture
+    unsigned int framebuffer = 0;
+    unsigned int emptyVAO = 0;      // Fullscreen triangle from gl_VertexID
+    glm::dvec3 capture = glm::dvec3(0.0);
+    bool stale[HORIZON_FACES] = {};
+    bool captured = false;          // Some face has been drawn since init()
+    bool placed = false;            // The capture point has been set
+};
@@ -0,0 +1,91 @@
+#include "input_map.h"
+
+#include <GLFW/glfw3.h>
+
+void InputMap::setDefaults()
+{
+    const InputBinding defaults[ACTION_COUNT] = {
+        { GLFW_KEY_W, false },              // ACTION_MOVE_FORWARD
+        { GLFW_KEY_S, false },              // ACTION_MOVE_BACK
+        { GLFW_KEY_A, false },              // ACTION_MOVE_LEFT
+        { GLFW_KEY_D, false },              // ACTION_MOVE_RIGHT
+        { GLFW_KEY_SPACE, false },          // ACTION_MOVE_UP
+        { GLFW_KEY_LEFT_CONTROL, false },   // ACTION_MOVE_DOWN
+        { GLFW_KEY_LEFT_SHIFT, false },     // ACTION_SPRINT
+        { GLFW_MOUSE_BUTTON_LEFT, true },   // ACTION_BREAK_BLOCK
+        { GLFW_MOUSE_BUTTON_RIGHT, true },  // ACTION_PLACE_BLOCK
+        { GLFW_KEY_B, false },              // ACTION_CYCLE_PLACE_BLOCK
+        { GLFW_KEY_ESCAPE, false },         // ACTION_SHOW_CURSOR
+        { GLFW_KEY_F, false },              // ACTION_WIREFRAME
+        { GLFW_KEY_ENTER, false },          // ACTION_TOGGLE_FULLSCREEN
+        { GLFW_KEY_G, false },              // ACTION_CYCLE_MESHER
+        { GLFW_KEY_M, false },              // ACTION_TOGGLE_INSTANCING
+        { GLFW_KEY_C, false },              // ACTION_TOGGLE_GPU_CULLING
+        { GLFW_KEY_O, false },              // ACTION_TOGGLE_OCCLUSION
+        { GLFW_KEY_V, false },              // ACTION_TOGGLE_VISIBILITY
+        { GLFW_KEY_Q, false },              // ACTION_TOGGLE_QUERIES
+        { GLFW_KEY_P, false },              // ACTION_TOGGLE_PREPASS
+        { GLFW_KEY_L, false },              // ACTION_TOGGLE_LOD
+        { GLFW_KEY_H, false },              // ACTION_TOGGLE_SHADOWS
+        { GLFW_KEY_R, false },              // ACTION_TOGGLE_DYNAMIC_RESOLUTION
+        { GLFW_KEY_EQUAL, false },          // ACTION_DISTANCE_UP
+        { GLFW_KEY_MINUS, false },          // ACTION_DISTANCE_DOWN
+        { GLFW_KEY_N, false },              // ACTION_CYCLE_PLAYER_MODE
+        { GLFW_KEY_F3, false },             // ACTION_TOGGLE_PROFILER
+        { GLFW_KEY_F4, false },             // ACTION_EXPORT_TRACE
+        { GLFW_KEY_F5, false },             // ACTION_CYCLE_PRESENT_MODE
+        { GLFW_KEY_T, false },              // ACTION_TOGGLE_WEIGHTED_OIT
+        { GLFW_KEY_K, false },              // ACTION_CYCLE_WEATHER
+        { GLFW_KEY_U, false },              // ACTION_TOGGLE_TEMPORAL_UPSCALE
+        { GLFW_KEY_X, false },              // ACTION_TOGGLE_FXAA
+        { GLFW_KEY_F2, false },             // ACTION_TOGGLE_STATS
+        { GLFW_KEY_F6, false },             // ACTION_TOGGLE_OVERDRAW
+        { GLFW_KEY_F7, false },             // ACTION_CYCLE_CHUNK_OVERLAY
+        { GLFW_KEY_F12, false },            // ACTION_SCREENSHOT
+        { GLFW_KEY_F9, false },             // ACTION_TOGGLE_CAPTURE
+        { GLFW_KEY_F8, false },             // ACTION_TOGGLE_MINIMAP
+    };
+    for (int i = 0; i < ACTION_COUNT; i++)
+        bind((InputAction)i, defaults[i]);
+}
+
+void InputMap::bind(InputAction action, InputBinding binding)
+{
+    bindings[action] = binding;
+    down[action] = false;
+    presses[action] = 0;
+}
+
+void InputMap::onKey(int key, int action)
+{
+    onInput({ key, false }, action);
+}
+
+void InputMap::onMouseButton(int button, int action)
+{
+    onInput({ button, true }, action);
+}
+
+void InputMap::onInput(InputBinding input, int action)
+{
+    if (action == GLFW_REPEAT)
+        return;
+
+    // One input may drive several actions
+    for (int i = 0; i < ACTION_COUNT; i++) {
+        if (bindings[i].code < 0 || bindings[i].code != input.code || bindings[i].mouse != input.mouse)
+            continue;
+        bool pressed = action == GLFW_PRESS;
+        if (pressed && !down[i])
+            presses[i]++;
+        down[i] = pressed;
+    }
+}
+
+bool InputMap::takePress(InputAction action)
+{
+    if (presses[action] == 0)
+        return false;
+    presses[action]--;
+    return true;
+}
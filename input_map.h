@@ -0,0 +1,77 @@
+#pragma once
+
+// Everything the keyboard and mouse can trigger
+enum InputAction {
+    ACTION_MOVE_FORWARD,
+    ACTION_MOVE_BACK,
+    ACTION_MOVE_LEFT,
+    ACTION_MOVE_RIGHT,
+    ACTION_MOVE_UP,
+    ACTION_MOVE_DOWN,
+    ACTION_SPRINT,
+    ACTION_BREAK_BLOCK,
+    ACTION_PLACE_BLOCK,
+    ACTION_CYCLE_PLACE_BLOCK,
+    ACTION_SHOW_CURSOR,         // Held
+    ACTION_WIREFRAME,           // Held
+    ACTION_TOGGLE_FULLSCREEN,
+    ACTION_CYCLE_MESHER,
+    ACTION_TOGGLE_INSTANCING,
+    ACTION_TOGGLE_GPU_CULLING,
+    ACTION_TOGGLE_OCCLUSION,
+    ACTION_TOGGLE_VISIBILITY,
+    ACTION_TOGGLE_QUERIES,
+    ACTION_TOGGLE_PREPASS,
+    ACTION_TOGGLE_LOD,
+    ACTION_TOGGLE_SHADOWS,
+    ACTION_TOGGLE_DYNAMIC_RESOLUTION,
+    ACTION_DISTANCE_UP,
+    ACTION_DISTANCE_DOWN,
+    ACTION_CYCLE_PLAYER_MODE,
+    ACTION_TOGGLE_PROFILER,
+    ACTION_EXPORT_TRACE,
+    ACTION_CYCLE_PRESENT_MODE,
+    ACTION_TOGGLE_WEIGHTED_OIT,
+    ACTION_CYCLE_WEATHER,
+    ACTION_TOGGLE_TEMPORAL_UPSCALE,
+    ACTION_TOGGLE_FXAA,
+    ACTION_TOGGLE_STATS,
+    ACTION_TOGGLE_OVERDRAW,
+    ACTION_CYCLE_CHUNK_OVERLAY,
+    ACTION_SCREENSHOT,
+    ACTION_TOGGLE_CAPTURE,
+    ACTION_TOGGLE_MINIMAP,
+    ACTION_COUNT
+};
+
+// A GLFW key, or a GLFW mouse button
+struct InputBinding {
+    int code = -1;  // -1 = unbound
+    bool mouse = false;
+};
+
+// Rebindable action map fed by the GLFW key and mouse button callbacks.
+// Actions are held while their input is down; presses are counted on the
+// down transition only (key repeats are ignored) and kept until taken, so
+// an action handled on the simulation tick isn't lost on a frame without one.
+struct InputMap {
+    InputMap() { setDefaults(); }
+
+    void setDefaults();
+    void bind(InputAction action, InputBinding binding);
+
+    // From the GLFW callbacks (GLFW_PRESS / GLFW_RELEASE / GLFW_REPEAT)
+    void onKey(int key, int action);
+    void onMouseButton(int button, int action);
+
+    bool held(InputAction action) const { return down[action]; }
+    // True once per press since the last call for this action
+    bool takePress(InputAction action);
+
+private:
+    void onInput(InputBinding input, int action);
+
+    InputBinding bindings[ACTION_COUNT];
+    bool down[ACTION_COUNT] = {};
+    int presses[ACTION_COUNT] = {};
+};
@@ -0,0 +1,207 @@
+#include "input_recording.h"
+
+#include <cstring>
+
+const uint32_t INPUT_LOG_MAGIC = 0x52495856; // "VXIR"
+const uint32_t INPUT_LOG_VERSION = 1;
+
+// Frames between flushes of a recording
+const int INPUT_LOG_FLUSH_FRAMES = 60;
+
+struct InputLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    InputSessionStart start;
+};
+
+// Payload bytes after each event type's tag
+static size_t payloadSize(uint8_t type)
+{
+    switch (type) {
+    case INPUT_FRAME: return sizeof(float);
+    case INPUT_KEY: return sizeof(int16_t) + 1;
+    case INPUT_MOUSE_BUTTON: return 2;
+    case INPUT_CURSOR: return 2 * sizeof(float);
+    case INPUT_SCROLL: return sizeof(float);
+    case INPUT_CHAR: return sizeof(uint32_t);
+    default: return 0;
+    }
+}
+
+bool InputRecorder::open(const char* path, const InputSessionStart& start)
+{
+    close();
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    InputLogHeader header = { INPUT_LOG_MAGIC, INPUT_LOG_VERSION, start };
+    failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    frames = 0;
+    return !failed;
+}
+
+bool InputRecorder::close()
+{
+    if (!file)
+        return true;
+    bool ok = !failed && fclose(file) == 0;
+    file = nullptr;
+    return ok;
+}
+
+void InputRecorder::put(const void* data, size_t size)
+{
+    if (fwrite(data, size, 1, file) != 1)
+        failed = true;
+}
+
+void InputRecorder::key(int key, int action)
+{
+    if (!file)
+        return;
+    uint8_t tag = INPUT_KEY;
+    int16_t code = (int16_t)key;
+    uint8_t state = (uint8_t)action;
+    put(&tag, 1);
+    put(&code, sizeof(code));
+    put(&state, 1);
+}
+
+void InputRecorder::mouseButton(int button, int action)
+{
+    if (!file)
+        return;
+    uint8_t bytes[3] = { INPUT_MOUSE_BUTTON, (uint8_t)button, (uint8_t)action };
+    put(bytes, sizeof(bytes));
+}
+
+void InputRecorder::cursor(float x, float y)
+{
+    if (!file)
+        return;
+    uint8_t tag = INPUT_CURSOR;
+    float position[2] = { x, y };
+    put(&tag, 1);
+    put(position, sizeof(position));
+}
+
+void InputRecorder::scroll(float yOffset)
+{
+    if (!file)
+        return;
+    uint8_t tag = INPUT_SCROLL;
+    put(&tag, 1);
+    put(&yOffset, sizeof(yOffset));
+}
+
+void InputRecorder::frame(float seconds)
+{
+    if (!file)
+        return;
+    uint8_t tag = INPUT_FRAME;
+    put(&tag, 1);
+    put(&seconds, sizeof(seconds));
+    if (++frames % INPUT_LOG_FLUSH_FRAMES == 0)
+        fflush(file);
+}
+
+void InputRecorder::character(unsigned int codepoint)
+{
+    if (!file)
+        return;
+    uint8_t tag = INPUT_CHAR;
+    uint32_t code = codepoint;
+    put(&tag, 1);
+    put(&code, sizeof(code));
+}
+
+bool InputReplay::load(const char* path, std::string& error)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+    InputLogHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == INPUT_LOG_MAGIC && header.version == INPUT_LOG_VERSION;
+    if (valid) {
+        log.clear();
+        uint8_t buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            log.insert(log.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    if (!valid) {
+        error = std::string(path) + " isn't an input recording";
+        return false;
+    }
+    start = header.start;
+
+    // Count the whole frames; a recording cut short mid-frame ends before it
+    frames = 0;
+    end = 0;
+    size_t at = 0;
+    while (at < log.size()) {
+        uint8_t type = log[at];
+        size_t size = payloadSize(type);
+        if (size == 0) {
+            error = std::string(path) + " has an unknown event";
+            return false;
+        }
+        at += 1 + size;
+        if (at > log.size())
+            break;
+        if (type == INPUT_FRAME) {
+            frames++;
+            end = at;
+        }
+    }
+    cursor = 0;
+    frame = 0;
+    return true;
+}
+
+bool InputReplay::nextFrame(std::vector<InputEvent>& events, float& seconds)
+{
+    events.clear();
+    while (cursor < end) {
+        InputEvent event = {};
+        event.type = (InputEventType)log[cursor];
+        const uint8_t* payload = &log[cursor + 1];
+        cursor += 1 + payloadSize(event.type);
+        switch (event.type) {
+        case INPUT_FRAME:
+            memcpy(&seconds, payload, sizeof(float));
+            frame++;
+            return true;
+        case INPUT_KEY: {
+            int16_t code;
+            memcpy(&code, payload, sizeof(code));
+            event.code = code;
+            event.action = payload[sizeof(code)];
+            break;
+        }
+        case INPUT_MOUSE_BUTTON:
+            event.code = payload[0];
+            event.action = payload[1];
+            break;
+        case INPUT_CURSOR:
+            memcpy(&event.x, payload, sizeof(float));
+            memcpy(&event.y, payload + sizeof(float), sizeof(float));
+            break;
+        case INPUT_SCROLL:
+            memcpy(&event.y, payload, sizeof(float));
+            break;
+        case INPUT_CHAR: {
+            uint32_t code;
+            memcpy(&code, payload, sizeof(code));
+            event.code = (int)code;
+            break;
+        }
+        }
+        events.push_back(event);
+    }
+    return false;
+}
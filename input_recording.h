@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// What a session starts from, so a replay starts from the same place: the
+// world, the player, the mouse look and the simulation's phase. Written
+// as-is at the top of a recording.
+struct InputSessionStart {
+    uint32_t seed;
+    int32_t renderDistance;
+    int32_t playerMode;
+    int32_t placeIndex;
+    double position[3];     // PlayerController::position
+    float velocity[3];
+    uint8_t onGround;
+    uint8_t firstMouse;
+    uint8_t padding[2];
+    float yaw, pitch, fov;
+    float lastX, lastY;     // Cursor position mouse_callback measures from
+    double accumulator;     // FixedTimestep::accumulator
+};
+
+enum InputEventType : uint8_t {
+    INPUT_FRAME,            // Ends a frame's events; 'x' is its seconds
+    INPUT_KEY,              // 'code' is the GLFW key
+    INPUT_MOUSE_BUTTON,     // 'code' is the GLFW button
+    INPUT_CURSOR,           // Cursor at ('x', 'y')
+    INPUT_SCROLL,           // Vertical offset 'y'
+    INPUT_CHAR,             // Typed character 'code' (console text)
+};
+
+// One callback's worth of input, with the arguments the callback acts on
+struct InputEvent {
+    InputEventType type;
+    int code;       // Key, button or character
+    int action;     // GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+    float x, y;
+};
+
+// Session recording (--record <file>): the GLFW input callbacks in the
+// order they fired, and the elapsed time of each frame they fired before,
+// in a compact binary log (3 to 9 bytes an event). The main loop marks each
+// frame before processInput() reads the callbacks' effects, so a replay
+// that hands the same events to the same callbacks and the same frame
+// times to the FixedTimestep runs the same simulation ticks on the same
+// input. Written through stdio buffering and flushed every second or so,
+// so a session that crashes keeps all but its last moments.
+struct InputRecorder {
+    InputRecorder() = default;
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+    ~InputRecorder() { close(); }
+
+    bool open(const char* path, const InputSessionStart& start);
+    // True on success or if nothing was open
+    bool close();
+    bool recording() const { return file != nullptr; }
+
+    // From the GLFW callbacks; ignored while not recording
+    void key(int key, int action);
+    void mouseButton(int button, int action);
+    void cursor(float x, float y);
+    void scroll(float yOffset);
+    void character(unsigned int codepoint);
+    // Ends the frame that took 'seconds'
+    void frame(float seconds);
+
+    int frames = 0;
+
+private:
+    void put(const void* data, size_t size);
+
+    FILE* file = nullptr;
+    bool failed = false;
+};
+
+// A recording read back (--replay <file>). The whole log is loaded up
+// front; one that was cut short ends at its last whole frame.
+struct InputReplay {
+    InputSessionStart start = {};
+
+    // False with a message in 'error' if the file is missing or malformed
+    bool load(const char* path, std::string& error);
+
+    // The next frame's events into 'events' (cleared first) and its elapsed
+    // time into 'seconds'; false once every frame has been replayed
+    bool nextFrame(std::vector<InputEvent>& events, float& seconds);
+
+    int frameCount() const { return frames; }
+    int framesReplayed() const { return frame; }
+
+private:
+    std::vector<uint8_t> log;   // The events after the header
+    size_t cursor = 0;
+    size_t end = 0;             // Just past the last whole frame
+    int frames = 0;
+    int frame = 0;
+};
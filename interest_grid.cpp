@@ -0,0 +1,38 @@
+#include "interest_grid.h"
+
+void InterestGrid::subscribe(uint32_t subscriber, const glm::ivec2& cell)
+{
+    std::vector<Subscription>& subscriptions = cells[interestCellKey(cell)];
+    for (Subscription& subscription : subscriptions) {
+        if (subscription.subscriber == subscriber) {
+            subscription.count++;
+            return;
+        }
+    }
+    subscriptions.push_back(Subscription{ subscriber, 1 });
+}
+
+void InterestGrid::unsubscribe(uint32_t subscriber, const glm::ivec2& cell)
+{
+    uint64_t key = interestCellKey(cell);
+    std::vector<Subscription>* subscriptions = cells.find(key);
+    if (!subscriptions)
+        return;
+    for (size_t i = 0; i < subscriptions->size(); i++) {
+        Subscription& subscription = (*subscriptions)[i];
+        if (subscription.subscriber != subscriber)
+            continue;
+        if (--subscription.count == 0) {
+            subscription = subscriptions->back();
+            subscriptions->pop_back();
+            if (subscriptions->empty())
+                cells.erase(key);
+        }
+        return;
+    }
+}
+
+const std::vector<InterestGrid::Subscription>* InterestGrid::subscribers(const glm::ivec2& cell) const
+{
+    return cells.find(interestCellKey(cell));
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_hash_map.h"
+#include "world.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Side of an interest cell in chunk columns (as a shift); cells span the
+// world's height
+const int INTEREST_CELL_SHIFT = 1;
+const int INTEREST_CELL_CHUNKS = 1 << INTEREST_CELL_SHIFT;
+const int INTEREST_CELL_SIZE = INTEREST_CELL_CHUNKS * CHUNK_SIZE;
+
+// Cell of a chunk, block or position (the shifts round negative ones down)
+inline glm::ivec2 interestCellOfChunk(const glm::ivec3& coord)
+{
+    return glm::ivec2(coord.x >> INTEREST_CELL_SHIFT, coord.z >> INTEREST_CELL_SHIFT);
+}
+inline glm::ivec2 interestCellOf(const glm::ivec3& block)
+{
+    return interestCellOfChunk(chunkCoordOf(block));
+}
+inline glm::ivec2 interestCellOf(const glm::dvec3& position)
+{
+    return glm::ivec2((int)std::floor(position.x / INTEREST_CELL_SIZE), (int)std::floor(position.z / INTEREST_CELL_SIZE));
+}
+inline uint64_t interestCellKey(const glm::ivec2& cell)
+{
+    return packChunkCoord(glm::ivec3(cell.x, 0, cell.y));
+}
+
+// Who wants the updates of each cell of the world. A subscriber (a small
+// integer the owner assigns, such as a client's slot) is counted into a
+// cell once per thing it has there, chunks held for instance, and is among
+// the cell's subscribers while any is left, so updates of a cell reach
+// exactly the subscribers that care without looking at anyone else.
+struct InterestGrid {
+    struct Subscription {
+        uint32_t subscriber;
+        int count;
+    };
+
+    void subscribe(uint32_t subscriber, const glm::ivec2& cell);
+    // Undo one subscribe(); nothing if there is none
+    void unsubscribe(uint32_t subscriber, const glm::ivec2& cell);
+    // Subscribers of a cell, nullptr if it has none
+    const std::vector<Subscription>* subscribers(const glm::ivec2& cell) const;
+    void clear() { cells.clear(); }
+
+    // Cells with subscribers
+    size_t cellCount() const { return cells.size(); }
+
+private:
+    ChunkHashMap<std::vector<Subscription>> cells;  // By interestCellKey(); no entry without subscribers
+};
+
+// One tick's updates grouped by cell: add() them in any order, then sort()
+// once; each cell's items are then one run, in the order they were added,
+// handed out per cell. Lets a tick's updates be gathered once and fanned
+// out a cell at a time, instead of every receiver looking at every update.
+template <typename T>
+struct CellBuckets {
+    struct Entry {
+        uint64_t key;       // interestCellKey() of the cell
+        glm::ivec2 cell;
+        T item;
+    };
+
+    void clear()
+    {
+        items.clear();
+        runs.clear();
+    }
+    void add(const glm::ivec2& cell, const T& item) { items.push_back(Entry{ interestCellKey(cell), cell, item }); }
+    void sort()
+    {
+        std::stable_sort(items.begin(), items.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+        for (size_t i = 0; i < items.size(); i++) {
+            if (i == 0 || items[i].key != items[i - 1].key)
+                runs[items[i].key] = (uint32_t)i;
+        }
+    }
+
+    // The run of 'cell' after sort(): 'count' entries from the returned one,
+    // nullptr when the cell has none
+    const Entry* find(const glm::ivec2& cell, size_t& count) const
+    {
+        const uint32_t* first = runs.find(interestCellKey(cell));
+        if (!first)
+            return nullptr;
+        size_t end = *first;
+        while (end < items.size() && items[end].key == items[*first].key)
+            end++;
+        count = end - *first;
+        return &items[*first];
+    }
+    // fn(cell, entries, count) for each cell with items, after sort()
+    template <typename Fn>
+    void forEachCell(Fn fn) const
+    {
+        for (size_t begin = 0, end; begin < items.size(); begin = end) {
+            for (end = begin + 1; end < items.size() && items[end].key == items[begin].key; end++) {
+            }
+            fn(items[begin].cell, &items[begin], end - begin);
+        }
+    }
+
+    bool empty() const { return items.empty(); }
+    size_t size() const { return items.size(); }
+
+private:
+    std::vector<Entry> items;
+    ChunkHashMap<uint32_t> runs;    // First entry of each cell
+};
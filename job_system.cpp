@@ -0,0 +1,208 @@
+#include "job_system.h"
+#include "frame_arena.h"
+#include "memory_tracking.h"
+#include "profiler.h"
+
+#include <cstdio>
+
+struct Job {
+    std::function<void()> fn;
+    JobCounter* counter;
+};
+
+// Queue owned by the current thread: a worker index, or -1 elsewhere
+static thread_local int currentQueue = -1;
+
+void JobSystem::start(int threadCount, int reservedThreads, ThreadPriority priority, bool pinWorkers)
+{
+    if (threadCount <= 0) {
+        threadCount = hardwareThreadCount() - reservedThreads;
+        if (threadCount < 1)
+            threadCount = 1;
+    }
+    workerPriority = priority;
+    firstWorkerCore = pinWorkers ? reservedThreads : -1;
+
+    for (int i = 0; i <= threadCount; i++)
+        queues.emplace_back(new WorkQueue());
+
+    running = true;
+    for (int i = 0; i < threadCount; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    sleepCondition.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+
+    for (std::unique_ptr<WorkQueue>& queue : queues)
+        for (Job* job : queue->jobs)
+            delete job;
+    queues.clear();
+    queuedJobs = 0;
+}
+
+void JobSystem::schedule(std::function<void()> fn, JobCounter* counter, JobCounter* dependency)
+{
+    Job* job = new Job{ std::move(fn), counter };
+    if (counter)
+        counter->count.fetch_add(1, std::memory_order_relaxed);
+
+    if (dependency) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->isDone()) {
+            dependency->waiting.push_back(job);
+            return;
+        }
+    }
+    enqueue(job);
+}
+
+void JobSystem::enqueue(Job* job)
+{
+    int index = currentQueue >= 0 ? currentQueue : (int)queues.size() - 1;
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->jobs.push_back(job);
+    }
+    queuedJobs.fetch_add(1, std::memory_order_release);
+
+    // Taking the lock orders this wake-up after a worker's check of queuedJobs
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    sleepCondition.notify_one();
+}
+
+bool JobSystem::runOne(int queueIndex)
+{
+    Job* job = nullptr;
+
+    // Newest job of our own queue first
+    if (queueIndex >= 0) {
+        WorkQueue& own = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+        }
+    }
+
+    // Otherwise steal the oldest job from any other queue
+    int queueCount = (int)queues.size();
+    for (int i = 1; i <= queueCount && !job; i++) {
+        int victim = (queueIndex + i + queueCount) % queueCount;
+        WorkQueue& other = *queues[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.jobs.empty()) {
+            job = other.jobs.front();
+            other.jobs.pop_front();
+        }
+    }
+
+    if (!job)
+        return false;
+
+    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    {
+        // Job scratch from threadArena() ends with the job
+        ArenaScope scratch(threadArena());
+        job->fn();
+    }
+    finish(job);
+    return true;
+}
+
+void JobSystem::finish(Job* job)
+{
+    JobCounter* counter = job->counter;
+    delete job;
+    if (counter)
+        endWork(*counter);
+}
+
+void JobSystem::beginWork(JobCounter& counter)
+{
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobSystem::endWork(JobCounter& counter)
+{
+    // Decrement under the lock so wait() can't return (and the counter go
+    // away) while this thread still touches it
+    std::vector<Job*> released;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        if (counter.count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        // Last job of the batch: release everything that depended on it
+        released.swap(counter.waiting);
+    }
+    for (Job* waitingJob : released)
+        enqueue(waitingJob);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    while (!counter.isDone()) {
+        if (!runOne(currentQueue))
+            std::this_thread::yield();
+    }
+
+    // Wait for the finishing thread to release the counter
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::parallelFor(int count, int grain, const std::function<void(int, int)>& fn)
+{
+    if (count <= 0)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    // Small loops aren't worth the scheduling overhead
+    if (count <= grain || workers.empty()) {
+        fn(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (int begin = grain; begin < count; begin += grain) {
+        int end = begin + grain < count ? begin + grain : count;
+        schedule([&fn, begin, end] { fn(begin, end); }, &counter);
+    }
+
+    // The caller takes the first range itself, then helps with the rest
+    fn(0, grain);
+    wait(counter);
+}
+
+void JobSystem::workerLoop(int index)
+{
+    currentQueue = index;
+    char name[32];
+    snprintf(name, sizeof(name), "Worker %d", index);
+    profilerSetThreadName(name);
+    setThreadMemoryTag(MEMORY_JOBS);
+    if (workerPriority != THREAD_NORMAL_PRIORITY)
+        setCurrentThreadPriority(workerPriority);
+    if (firstWorkerCore >= 0)
+        pinCurrentThread(firstWorkerCore + index);
+    for (;;) {
+        if (runOne(index)) {
+            threadArena().reset();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this] { return !running || queuedJobs.load(std::memory_order_acquire) > 0; });
+        if (!running)
+            return;
+    }
+}
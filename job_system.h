@@ -0,0 +1,81 @@
+#pragma once
+
+#include "thread_priority.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+
+// Counts unfinished jobs. Jobs can be made to wait for a counter to reach
+// zero, which is how dependencies between job batches are expressed.
+struct JobCounter {
+    std::atomic<int> count{ 0 };
+
+    bool isDone() const { return count.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend struct JobSystem;
+    std::mutex mutex;
+    std::vector<Job*> waiting;  // Released when count reaches zero
+};
+
+// Work-stealing scheduler: every worker owns a deque, takes its newest job
+// first and steals the oldest job of another queue when its own is empty.
+// Threads that are not workers push into a shared queue that workers steal from.
+struct JobSystem {
+    // Start 'threadCount' workers (0 = one per logical processor left after
+    // 'reservedThreads', the caller's own busy threads; at least one).
+    // Workers run at 'priority'; with 'pinWorkers' each keeps to a processor
+    // of its own, past the first 'reservedThreads'.
+    void start(int threadCount = 0, int reservedThreads = 1, ThreadPriority priority = THREAD_NORMAL_PRIORITY, bool pinWorkers = false);
+    // Wait for running jobs to return and stop the workers. Queued jobs are dropped.
+    void stop();
+
+    // Run 'fn' on a worker. 'counter' (optional) is incremented now and
+    // decremented once fn returns. With a 'dependency', fn is held back until
+    // that counter reaches zero.
+    void schedule(std::function<void()> fn, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+    // Block until 'counter' reaches zero, running queued jobs on this thread meanwhile
+    void wait(JobCounter& counter);
+
+    // Call fn(begin, end) over [0, count) in ranges of 'grain' across the
+    // workers and the calling thread, returning once every range is done
+    void parallelFor(int count, int grain, const std::function<void(int, int)>& fn);
+
+    // Count work that isn't a scheduled job (such as an AsyncChain hopping
+    // between threads) against 'counter': beginWork() before it starts,
+    // endWork() once it is over, which releases the jobs waiting on it
+    void beginWork(JobCounter& counter);
+    void endWork(JobCounter& counter);
+
+    int workerCount() const { return (int)workers.size(); }
+
+    ~JobSystem() { stop(); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Job*> jobs;
+    };
+
+    void enqueue(Job* job);
+    bool runOne(int queueIndex);
+    void finish(Job* job);
+    void workerLoop(int index);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues; // One per worker, then the shared queue
+    std::atomic<int> queuedJobs{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    bool running = false;
+    ThreadPriority workerPriority = THREAD_NORMAL_PRIORITY;
+    int firstWorkerCore = -1;       // Processor of worker 0 when pinned, -1 = not pinned
+};
@@ -0,0 +1,412 @@
+#include "kernel_benchmarks.h"
+#include "chunk.h"
+#include "chunk_hash_map.h"
+#include "chunk_mesh.h"
+#include "frustum.h"
+#include "lod_terrain.h"
+#include "lz4.h"
+#include "palette_kernels.h"
+#include "region_file.h"
+#include "simd_math.h"
+#include "sparse_voxel_octree.h"
+#include "terrain_noise.h"
+#include "world.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+// Each kernel runs for at least this long
+const double MIN_KERNEL_MS = 250.0;
+
+// Results the compiler must not optimise away are passed through here
+static volatile long long benchmarkSink;
+static void consume(long long value)
+{
+    benchmarkSink = benchmarkSink + value;
+}
+
+// Repeat 'kernel' (which processes 'chunksPerCall' chunks) until MIN_KERNEL_MS passes
+static KernelResult timeKernel(const char* kernelName, const char* fixture, long long chunksPerCall, int voxelsPerChunk,
+    const std::function<void()>& kernel)
+{
+    kernel(); // Warm caches and pools
+
+    KernelResult result;
+    result.kernel = kernelName;
+    result.fixture = fixture;
+    result.voxelsPerChunk = voxelsPerChunk;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        kernel();
+        result.chunks += chunksPerCall;
+        result.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    } while (result.totalMs < MIN_KERNEL_MS);
+    return result;
+}
+
+// Standard chunk contents, with air borders and full sunlight as an unlit
+// Chunk::decode() leaves them
+struct ChunkFixture {
+    const char* name;
+    std::unique_ptr<ChunkVoxels> voxels;
+};
+
+static std::vector<ChunkFixture> makeFixtures()
+{
+    std::vector<ChunkFixture> fixtures;
+    auto add = [&](const char* name) -> BlockId* {
+        fixtures.push_back(ChunkFixture{ name, std::unique_ptr<ChunkVoxels>(new ChunkVoxels()) });
+        ChunkVoxels& voxels = *fixtures.back().voxels;
+        memset(voxels.border, BLOCK_AIR, sizeof(voxels.border));
+        memset(voxels.light, FULL_SUNLIGHT, sizeof(voxels.light));
+        memset(voxels.borderLight, FULL_SUNLIGHT, sizeof(voxels.borderLight));
+        return voxels.blocks;
+    };
+
+    memset(add("empty"), BLOCK_AIR, CHUNK_VOLUME);
+    memset(add("full"), BLOCK_STONE, CHUNK_VOLUME);
+
+    BlockId* hollow = add("hollow");
+    for (int x = 0; x < CHUNK_SIZE; x++)
+        for (int y = 0; y < CHUNK_SIZE; y++)
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                bool shell = x == 0 || x == CHUNK_SIZE - 1 || y == 0 || y == CHUNK_SIZE - 1 || z == 0 || z == CHUNK_SIZE - 1;
+                hollow[chunkIndex(x, y, z)] = shell ? BLOCK_STONE : BLOCK_AIR;
+            }
+
+    // Fixed-seed LCG so every run (and every machine) sees the same voxels
+    BlockId* random = add("random");
+    uint32_t state = 12345u;
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t r = state >> 24;
+        random[i] = r < 128 ? BLOCK_AIR : (BlockId)(BLOCK_STONE + r % 3);
+    }
+
+    // Rolling surface: stone, three blocks of dirt, grass on top
+    BlockId* terrain = add("terrain");
+    for (int x = 0; x < CHUNK_SIZE; x++)
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            int height = 8 + (int)std::lround(3.0 * std::sin(x * 0.4) + 2.0 * std::cos(z * 0.5));
+            for (int y = 0; y < CHUNK_SIZE; y++) {
+                BlockId id = BLOCK_AIR;
+                if (y < height - 3) id = BLOCK_STONE;
+                else if (y < height) id = BLOCK_DIRT;
+                else if (y == height) id = BLOCK_GRASS;
+                terrain[chunkIndex(x, y, z)] = id;
+            }
+        }
+    return fixtures;
+}
+
+std::vector<KernelResult> runKernelBenchmarks()
+{
+    std::vector<KernelResult> results;
+
+    // Generation of one column of chunks, from bedrock to the sky, as the
+    // generator does it: the height fields of the column and the ones
+    // around it (for trees across the border) once, then each chunk
+    const int GENERATED_CHUNKS = WORLD_HEIGHT_CHUNKS;
+    const uint32_t SEED = 1337;
+    std::unique_ptr<Chunk> chunk(new Chunk());
+    TerrainNeighbourhood terrain;
+    results.push_back(timeKernel("generate", "column", GENERATED_CHUNKS, CHUNK_VOLUME, [&] {
+        buildTerrainNeighbourhood(glm::ivec2(3, -7), SEED, terrain);
+        for (int y = 0; y < GENERATED_CHUNKS; y++)
+            generateChunk(*chunk, glm::ivec3(3, y, -7), terrain, SEED);
+    }));
+    // The same with the height fields evaluated again for every chunk
+    results.push_back(timeKernel("generate_uncached", "column", GENERATED_CHUNKS, CHUNK_VOLUME, [&] {
+        for (int y = 0; y < GENERATED_CHUNKS; y++)
+            generateChunk(*chunk, glm::ivec3(3, y, -7), SEED);
+    }));
+
+    // The terrain height field of one chunk's columns, vectorised and scalar.
+    // A "voxel" here is one column sample.
+    NoiseSettings noise;
+    noise.seed = SEED;
+    float heights[CHUNK_SIZE];
+    auto noiseKernel = [&](void (*row)(const NoiseSettings&, float, float, float, int, float*)) {
+        return [&, row] {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                row(noise, x / 128.0f, 0.0f, 1.0f / 128.0f, CHUNK_SIZE, heights);
+                consume((long long)heights[x]);
+            }
+        };
+    };
+    results.push_back(timeKernel("noise_simd", "column", 1, CHUNK_SIZE * CHUNK_SIZE, noiseKernel(fractalNoiseRow)));
+    results.push_back(timeKernel("noise_scalar", "column", 1, CHUNK_SIZE * CHUNK_SIZE, noiseKernel(fractalNoiseRowScalar)));
+
+    // Octree of a 128-block cube of terrain from its height field, and rays
+    // through it, aimed down at the surface. A "chunk" of a ray is one ray.
+    const int OCTREE_DEPTH = 7;
+    const int OCTREE_CHUNKS = (1 << OCTREE_DEPTH) / CHUNK_SIZE;
+    SparseVoxelOctree octree;
+    results.push_back(timeKernel("svo_build", "terrain", OCTREE_CHUNKS * OCTREE_CHUNKS * OCTREE_CHUNKS, CHUNK_VOLUME, [&] {
+        octree.buildTerrain(glm::ivec3(0), OCTREE_DEPTH, SEED);
+        consume((long long)octree.nodes.size());
+    }));
+    const int OCTREE_RAYS = 256;
+    results.push_back(timeKernel("svo_raycast", "terrain", OCTREE_RAYS, 0, [&] {
+        RayHit hit;
+        for (int i = 0; i < OCTREE_RAYS; i++) {
+            glm::dvec3 origin(8.5 + (i % 16) * 7.0, 120.0, 8.5 + (i / 16) * 7.0);
+            glm::vec3 direction(std::cos(i * 0.7f), -1.5f, std::sin(i * 0.7f));
+            if (octree.raycast(origin, direction, 200.0f, hit))
+                consume(hit.block.y);
+        }
+    }));
+
+    // LOD tiles of each level, cells then greedy mesh. A "chunk" is one
+    // tile, which covers 8^level chunks.
+    std::unique_ptr<ChunkVoxels> lodVoxels(new ChunkVoxels());
+    ChunkVertexBuffer lodVertices;
+    const char* lodNames[LOD_LEVELS] = { "lod_tile_2x", "lod_tile_4x", "lod_tile_8x" };
+    for (int level = 1; level <= LOD_LEVELS; level++) {
+        results.push_back(timeKernel(lodNames[level - 1], "terrain", 1, CHUNK_VOLUME, [&] {
+            buildLodVoxels(level, glm::ivec3(-3, 0, 5), SEED, *lodVoxels);
+            lodVertices.clear();
+            consume(meshChunkGreedy(*lodVoxels, lodVertices));
+        }));
+    }
+
+    // Chunk lookups by coordinate over a streamed area (25 x 16 x 25
+    // chunks), probing every slot of a box one chunk larger so a share of
+    // them miss: the open-addressing map and an unordered_map beside it.
+    // A "chunk" is one lookup.
+    ChunkHashMap<int> coordIndex;
+    std::unordered_map<uint64_t, int> coordIndexNodes;
+    for (int x = -12; x <= 12; x++)
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++)
+            for (int z = -12; z <= 12; z++) {
+                coordIndex[packChunkCoord(glm::ivec3(x, y, z))] = x + y + z;
+                coordIndexNodes[packChunkCoord(glm::ivec3(x, y, z))] = x + y + z;
+            }
+    const int LOOKUPS = 27 * (WORLD_HEIGHT_CHUNKS + 2) * 27;
+    results.push_back(timeKernel("lookup_hash", "grid", LOOKUPS, 0, [&] {
+        long long sum = 0;
+        for (int x = -13; x <= 13; x++)
+            for (int y = -1; y <= WORLD_HEIGHT_CHUNKS; y++)
+                for (int z = -13; z <= 13; z++)
+                    if (const int* found = coordIndex.find(packChunkCoord(glm::ivec3(x, y, z))))
+                        sum += *found;
+        consume(sum);
+    }));
+    results.push_back(timeKernel("lookup_unordered", "grid", LOOKUPS, 0, [&] {
+        long long sum = 0;
+        for (int x = -13; x <= 13; x++)
+            for (int y = -1; y <= WORLD_HEIGHT_CHUNKS; y++)
+                for (int z = -13; z <= 13; z++) {
+                    auto it = coordIndexNodes.find(packChunkCoord(glm::ivec3(x, y, z)));
+                    if (it != coordIndexNodes.end())
+                        sum += it->second;
+                }
+        consume(sum);
+    }));
+
+    // Voxel kernels over each fixture
+    std::vector<ChunkFixture> fixtures = makeFixtures();
+    ChunkVertexBuffer vertices;
+    PalettedBlocks paletted;
+    PalettedBlocks loaded;
+    PalettedBlocks remapped;
+    std::vector<uint64_t> packedWords(CHUNK_VOLUME * 8 / 64);
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> compressed(lz4CompressBound(2 + 256 + CHUNK_VOLUME));
+    size_t compressedSize = 0;
+    std::unique_ptr<ChunkVoxels> decoded(new ChunkVoxels());
+    const char* meshNames[MESH_MODE_COUNT] = { "mesh_culled", "mesh_binary", "mesh_greedy" };
+    for (const ChunkFixture& fixture : fixtures) {
+        const ChunkVoxels& voxels = *fixture.voxels;
+        for (int mode = 0; mode < MESH_MODE_COUNT; mode++) {
+            results.push_back(timeKernel(meshNames[mode], fixture.name, 1, CHUNK_VOLUME, [&] {
+                vertices.clear();
+                consume(meshChunk(voxels, (MeshMode)mode, vertices));
+            }));
+        }
+        results.push_back(timeKernel("palette_encode", fixture.name, 1, CHUNK_VOLUME, [&] {
+            paletted.encode(voxels.blocks);
+            consume(paletted.bitsPerIndex);
+        }));
+        paletted.encode(voxels.blocks);
+        results.push_back(timeKernel("palette_decode", fixture.name, 1, CHUNK_VOLUME, [&] {
+            paletted.decode(decoded->blocks);
+            consume(decoded->blocks[CHUNK_VOLUME - 1]);
+        }));
+        // The same two steps through the scalar kernels (a uniform chunk has no indices)
+        if (!paletted.isUniform()) {
+            int bits = paletted.bitsPerIndex;
+            const uint8_t* palette = paletted.palette.data();
+            int paletteSize = (int)paletted.palette.size();
+            results.push_back(timeKernel("palette_encode_scalar", fixture.name, 1, CHUNK_VOLUME, [&] {
+                uint8_t found[256];
+                consume(collectPaletteScalar(voxels.blocks, CHUNK_VOLUME, found));
+                findPaletteIndicesScalar(voxels.blocks, CHUNK_VOLUME, palette, paletteSize, decoded->light);
+                packPaletteIndicesScalar(decoded->light, bits, packedWords.data());
+                consume((long long)packedWords[0]);
+            }));
+            results.push_back(timeKernel("palette_decode_scalar", fixture.name, 1, CHUNK_VOLUME, [&] {
+                unpackPaletteIndicesScalar(paletted.words.data(), bits, decoded->blocks);
+                lookupBytesScalar(decoded->blocks, CHUNK_VOLUME, palette, decoded->blocks);
+                consume(decoded->blocks[CHUNK_VOLUME - 1]);
+            }));
+            // Two stale entries set() left behind, dropped and the indices remapped
+            results.push_back(timeKernel("palette_remap", fixture.name, 1, CHUNK_VOLUME, [&] {
+                remapped = paletted;
+                remapped.set(0, BLOCK_WATER);
+                remapped.set(0, BLOCK_LEAVES);
+                remapped.set(0, voxels.blocks[0]);
+                remapped.compact();
+                consume((long long)remapped.palette.size());
+            }));
+        }
+        // A region record: the payload of the paletted chunk, LZ4 on top
+        results.push_back(timeKernel("chunk_compress", fixture.name, 1, CHUNK_VOLUME, [&] {
+            encodeChunkPayload(paletted, payload);
+            compressedSize = lz4Compress(payload.data(), payload.size(), compressed.data());
+            consume((long long)compressedSize);
+        }));
+        results.push_back(timeKernel("chunk_decompress", fixture.name, 1, CHUNK_VOLUME, [&] {
+            uint8_t raw[2 + 256 + CHUNK_VOLUME];
+            if (lz4Decompress(compressed.data(), compressedSize, raw, payload.size()))
+                consume(decodeChunkPayload(raw, payload.size(), loaded));
+        }));
+    }
+
+    // Neighbourhood queries (the 3x3x3 box around each interior voxel, as AO
+    // and light spreading read it) over the terrain voxels in the linear
+    // layout and in Morton order, plus converting between them
+    const ChunkVoxels& terrainVoxels = *fixtures.back().voxels;
+    std::unique_ptr<ChunkVoxels> morton(new ChunkVoxels());
+    linearToMorton(terrainVoxels.blocks, morton->blocks);
+    auto neighbourhoodKernel = [&](const BlockId* blocks, int (*index)(int, int, int)) {
+        return [&, blocks, index] {
+            long long solid = 0;
+            for (int x = 1; x < CHUNK_SIZE - 1; x++)
+                for (int y = 1; y < CHUNK_SIZE - 1; y++)
+                    for (int z = 1; z < CHUNK_SIZE - 1; z++)
+                        for (int dx = -1; dx <= 1; dx++)
+                            for (int dy = -1; dy <= 1; dy++)
+                                for (int dz = -1; dz <= 1; dz++)
+                                    solid += blocks[index(x + dx, y + dy, z + dz)] != BLOCK_AIR;
+            consume(solid);
+        };
+    };
+    results.push_back(timeKernel("neighbours_linear", "terrain", 1, CHUNK_VOLUME, neighbourhoodKernel(terrainVoxels.blocks, chunkIndex)));
+    results.push_back(timeKernel("neighbours_morton", "terrain", 1, CHUNK_VOLUME, neighbourhoodKernel(morton->blocks, chunkMortonIndex)));
+    results.push_back(timeKernel("morton_convert", "terrain", 1, CHUNK_VOLUME, [&] {
+        linearToMorton(terrainVoxels.blocks, morton->blocks);
+        mortonToLinear(morton->blocks, decoded->blocks);
+        consume(decoded->blocks[CHUNK_VOLUME / 2]);
+    }));
+
+    // Filling a 48-block box, off the chunk grid so it has whole and partial
+    // sections, alternately with stone and air: the bulk edit and the same
+    // through setBlock(). A "chunk" is CHUNK_VOLUME blocks of the box.
+    World editWorld;
+    editWorld.seed = SEED;
+    for (int x = 0; x < 5; x++)
+        for (int y = 0; y < 5; y++)
+            for (int z = 0; z < 5; z++)
+                editWorld.loadChunk(glm::ivec3(x, y, z));
+    const glm::ivec3 FILL_MIN(8), FILL_MAX(56);
+    const int FILL_CHUNKS = 48 * 48 * 48 / CHUNK_VOLUME;
+    int fills = 0;
+    results.push_back(timeKernel("edit_fill_bulk", "world", FILL_CHUNKS, CHUNK_VOLUME, [&] {
+        consume(editWorld.fillBox(FILL_MIN, FILL_MAX, fills++ % 2 ? BLOCK_AIR : BLOCK_STONE, false));
+    }));
+    results.push_back(timeKernel("edit_fill_setblock", "world", FILL_CHUNKS, CHUNK_VOLUME, [&] {
+        BlockId id = fills++ % 2 ? BLOCK_AIR : BLOCK_STONE;
+        for (int x = FILL_MIN.x; x < FILL_MAX.x; x++)
+            for (int y = FILL_MIN.y; y < FILL_MAX.y; y++)
+                for (int z = FILL_MIN.z; z < FILL_MAX.z; z++)
+                    editWorld.setBlock(glm::ivec3(x, y, z), id, false);
+        consume(editWorld.getBlock(FILL_MIN));
+    }));
+
+    // Frustum tests of a 32 x 16 x 32 grid of chunk bounds, about a third in view
+    AABBList boxes;
+    for (int x = -16; x < 16; x++)
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++)
+            for (int z = -16; z < 16; z++) {
+                glm::vec3 boxMin = glm::vec3(x, y, z) * (float)CHUNK_SIZE;
+                boxes.add(boxMin, boxMin + glm::vec3((float)CHUNK_SIZE));
+            }
+    Frustum frustum;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 64.0f, 0.0f), glm::vec3(1.0f, 60.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frustum.update(projection * view);
+    std::vector<int> visible(boxes.size());
+    results.push_back(timeKernel("cull_corners", "grid", boxes.size(), 0, [&] {
+        int count = 0;
+        for (int i = 0; i < boxes.size(); i++)
+            count += isChunkInViewFrustum(glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]), view, projection, (float)CHUNK_SIZE);
+        consume(count);
+    }));
+    results.push_back(timeKernel("cull_planes", "grid", boxes.size(), 0, [&] {
+        int count = 0;
+        for (int i = 0; i < boxes.size(); i++)
+            count += frustum.intersectsAABB(glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]),
+                glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]));
+        consume(count);
+    }));
+    results.push_back(timeKernel("cull_aabbs", "grid", boxes.size(), 0, [&] {
+        consume(cullAABBs(frustum, boxes, visible.data()));
+    }));
+
+    // The grid's box corners into clip space, by glm one at a time and batched
+    glm::mat4 viewProjection = projection * view;
+    std::vector<float> clip[4];
+    for (std::vector<float>& column : clip)
+        column.resize(boxes.size());
+    results.push_back(timeKernel("transform_glm", "grid", boxes.size(), 0, [&] {
+        for (int i = 0; i < boxes.size(); i++) {
+            glm::vec4 p = viewProjection * glm::vec4(boxes.minX[i], boxes.minY[i], boxes.minZ[i], 1.0f);
+            clip[0][i] = p.x;
+            clip[1][i] = p.y;
+            clip[2][i] = p.z;
+            clip[3][i] = p.w;
+        }
+        consume((long long)clip[3][boxes.size() - 1]);
+    }));
+    results.push_back(timeKernel("transform_batch", "grid", boxes.size(), 0, [&] {
+        transformPoints(viewProjection, boxes.minX.data(), boxes.minY.data(), boxes.minZ.data(), boxes.size(),
+            clip[0].data(), clip[1].data(), clip[2].data(), clip[3].data());
+        consume((long long)clip[3][boxes.size() - 1]);
+    }));
+
+    return results;
+}
+
+bool reportKernelBenchmarks(const std::vector<KernelResult>& results, const char* jsonPath)
+{
+    printf("%-18s %-8s %12s %12s %14s\n", "kernel", "fixture", "ns/chunk", "ns/voxel", "chunks/s");
+    for (const KernelResult& r : results) {
+        char perVoxel[32] = "-";
+        if (r.voxelsPerChunk > 0)
+            snprintf(perVoxel, sizeof(perVoxel), "%.3f", r.nsPerVoxel());
+        printf("%-18s %-8s %12.1f %12s %14.0f\n", r.kernel.c_str(), r.fixture.c_str(), r.nsPerChunk(), perVoxel, r.chunksPerSecond());
+    }
+    if (!jsonPath)
+        return true;
+
+    FILE* file = fopen(jsonPath, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\n  \"kernels\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const KernelResult& r = results[i];
+        fprintf(file, "    { \"kernel\": \"%s\", \"fixture\": \"%s\", \"chunks\": %lld, \"total_ms\": %.3f, "
+            "\"ns_per_chunk\": %.3f, \"ns_per_voxel\": %.4f, \"chunks_per_second\": %.1f }%s\n",
+            r.kernel.c_str(), r.fixture.c_str(), r.chunks, r.totalMs, r.nsPerChunk(), r.nsPerVoxel(), r.chunksPerSecond(),
+            i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Timing of one CPU kernel on one fixture
+struct KernelResult {
+    std::string kernel;
+    std::string fixture;        // Chunk contents it ran on, or the test scene
+    long long chunks = 0;       // Chunks (or chunk bounds) processed over all iterations
+    int voxelsPerChunk = 0;     // 0 for kernels that don't touch voxels
+    double totalMs = 0.0;
+
+    double nsPerChunk() const { return chunks > 0 ? totalMs * 1e6 / chunks : 0.0; }
+    double nsPerVoxel() const { return voxelsPerChunk > 0 ? nsPerChunk() / voxelsPerChunk : 0.0; }
+    double chunksPerSecond() const { return totalMs > 0.0 ? chunks / (totalMs / 1000.0) : 0.0; }
+};
+
+// CPU-only timings of the chunk pipeline kernels, so a new mesher or
+// storage scheme comes with numbers. Each voxel kernel (the three meshers,
+// palette encode and decode with the SIMD kernels and the scalar ones, and
+// a palette remap dropping unused entries) runs over the standard fixtures:
+//   empty   all air
+//   full    all stone
+//   hollow  a one-block stone shell, the original hollow-cube world
+//   random  a fixed-seed mix of air and the three materials
+//   terrain a layered height field (stone, dirt, grass under air)
+// plus chunk generation, the terrain noise (SIMD and scalar rows), building
+// and raycasting a terrain octree, LOD tiles of each level, chunk lookups
+// by coordinate (the open-addressing map against std::unordered_map),
+// neighbourhood reads in the linear and Morton voxel layouts, a box fill
+// through the bulk edit API against setBlock() per block, and the
+// frustum tests (isChunkInViewFrustum, the per-box plane test and the
+// batched cullAABBs) and point transforms (glm per point and the batched
+// transformPoints) over a grid of chunk bounds. Needs no window or GL
+// context. Each kernel repeats until it has run for a while so short
+// kernels still get stable numbers.
+std::vector<KernelResult> runKernelBenchmarks();
+// Print a table of results and, with a path, write them as JSON. Returns
+// false if the file can't be written.
+bool reportKernelBenchmarks(const std::vector<KernelResult>& results, const char* jsonPath);
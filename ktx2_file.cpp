@@ -0,0 +1,95 @@
+#include "ktx2_file.h"
+#include "gl_extensions.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+// Identifier, header and section index, before the level index
+const size_t KTX2_HEADER_SIZE = 80;
+const size_t KTX2_LEVEL_ENTRY_SIZE = 24;
+
+// VkFormat values of the accepted formats
+struct Ktx2Format {
+    uint32_t vkFormat;
+    unsigned int glFormat;
+    int blockBytes;     // Per 4x4 texel block
+    bool srgb;
+    const char* name;
+};
+
+// 'srgb' formats map to the UNORM enum: block colours are used as stored,
+// like the RGBA8 path, which doesn't decode sRGB either
+static const Ktx2Format KTX2_FORMATS[] = {
+    { 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,  8,  false, "BC1" },
+    { 132, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,  8,  true,  "BC1" },
+    { 133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8,  false, "BC1" },
+    { 134, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8,  true,  "BC1" },
+    { 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16, false, "BC3" },
+    { 138, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16, true,  "BC3" },
+    { 145, GL_COMPRESSED_RGBA_BPTC_UNORM,    16, false, "BC7" },
+    { 146, GL_COMPRESSED_RGBA_BPTC_UNORM,    16, true,  "BC7" },
+};
+
+static uint32_t readU32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t readU64(const uint8_t* p)
+{
+    return (uint64_t)readU32(p) | (uint64_t)readU32(p + 4) << 32;
+}
+
+bool parseKtx2(const uint8_t* data, size_t size, Ktx2Texture& out)
+{
+    if (size < KTX2_HEADER_SIZE || std::memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+        return false;
+    uint32_t vkFormat = readU32(data + 12);
+    uint32_t width = readU32(data + 20);
+    uint32_t height = readU32(data + 24);
+    uint32_t depth = readU32(data + 28);
+    uint32_t layers = readU32(data + 32);
+    uint32_t faces = readU32(data + 36);
+    uint32_t levelCount = readU32(data + 40);
+    uint32_t supercompression = readU32(data + 44);
+
+    const Ktx2Format* format = nullptr;
+    for (const Ktx2Format& f : KTX2_FORMATS) {
+        if (f.vkFormat == vkFormat)
+            format = &f;
+    }
+    // 0 levels asks the loader to generate mips, which compressed formats can't
+    if (!format || supercompression != 0 || depth != 0 || faces != 1 || levelCount == 0 ||
+        levelCount > (uint32_t)KTX2_MAX_LEVELS || width == 0 || height == 0 ||
+        width > 1u << (KTX2_MAX_LEVELS - 1) || height > 1u << (KTX2_MAX_LEVELS - 1) || layers > 65536)
+        return false;
+    uint32_t fullChain = 1;
+    while (std::max(width, height) >> fullChain)
+        fullChain++;
+    if (levelCount > fullChain || KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_ENTRY_SIZE > size)
+        return false;
+
+    out.glFormat = format->glFormat;
+    out.formatName = format->name;
+    out.srgb = format->srgb;
+    out.width = (int)width;
+    out.height = (int)height;
+    out.layers = std::max(1, (int)layers);
+    out.levelCount = (int)levelCount;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        const uint8_t* entry = data + KTX2_HEADER_SIZE + level * KTX2_LEVEL_ENTRY_SIZE;
+        uint64_t offset = readU64(entry);
+        uint64_t length = readU64(entry + 8);
+
+        Ktx2Level& l = out.levels[level];
+        l.width = std::max(1, out.width >> level);
+        l.height = std::max(1, out.height >> level);
+        uint64_t expected = (uint64_t)((l.width + 3) / 4) * ((l.height + 3) / 4) * format->blockBytes * out.layers;
+        if (length != expected || offset > size || length > size - offset)
+            return false;
+        l.data = data + offset;
+        l.size = (size_t)length;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Mip levels a KTX2 texture may have at most (a 32768^2 base level)
+const int KTX2_MAX_LEVELS = 16;
+
+// One mip level: every array layer, back to back, in the layout
+// glCompressedTexImage3D takes
+struct Ktx2Level {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// A block-compressed 2D (array) texture inside a KTX2 file. The levels
+// point into the file's bytes, so uploads read them in place.
+struct Ktx2Texture {
+    unsigned int glFormat = 0;  // GL_COMPRESSED_* internal format
+    const char* formatName = "";
+    bool srgb = false;          // Tagged sRGB in the file
+    int width = 0;
+    int height = 0;
+    int layers = 0;             // 1 for a plain 2D texture
+    int levelCount = 0;
+    Ktx2Level levels[KTX2_MAX_LEVELS];  // levels[0] is the base level
+};
+
+// Parse the KTX2 file in 'data'. Only BC1, BC3 and BC7 2D textures and
+// texture arrays are accepted, without supercompression (Basis Universal
+// and Zstandard files need a transcoder first). Returns false, with 'out'
+// unspecified, when the file is malformed, truncated or another kind of
+// texture.
+bool parseKtx2(const uint8_t* data, size_t size, Ktx2Texture& out);
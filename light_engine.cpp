@@ -0,0 +1,659 @@
+#include "light_engine.h"
+#include "frame_arena.h"
+#include "light_kernels.h"
+#include "palette_kernels.h"
+#include "profiler.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// A job's region: the 3x3 chunk columns around its centre column, the full
+// height of the world, flattened [x][y][z] like chunk voxels
+const int REGION_COLUMNS = 9;
+const int REGION_WIDTH = 3 * CHUNK_SIZE;
+const int REGION_HEIGHT = WORLD_HEIGHT_CHUNKS * CHUNK_SIZE;
+const int REGION_VOLUME = REGION_WIDTH * REGION_HEIGHT * REGION_WIDTH;
+const int STRIDE_X = REGION_HEIGHT * REGION_WIDTH;
+const int STRIDE_Y = REGION_WIDTH;
+
+// Initial sunlight is swept rather than queued when the voxels seeding the
+// queue are at least this share (1 in n) of those the sweep would cover
+const int SWEEP_FRONTIER_SHARE = 8;
+
+static inline int regionIndex(int x, int y, int z)
+{
+    return (x * REGION_HEIGHT + y) * REGION_WIDTH + z;
+}
+
+// Index of the region column at (dx, dz) from the centre, each -1..1
+static inline int regionColumn(int dx, int dz)
+{
+    return (dx + 1) * 3 + (dz + 1);
+}
+
+static inline uint64_t columnKey(const glm::ivec2& column)
+{
+    return packChunkCoord(glm::ivec3(column.x, 0, column.y));
+}
+
+struct LightEngine::Job {
+    glm::ivec2 column;
+    bool initial = false;       // Light the centre column from scratch, else relight 'edits'
+    std::vector<glm::ivec3> edits;  // Changed blocks (world positions)
+    // Per region chunk, [regionColumn()][y]
+    Chunk* chunks[REGION_COLUMNS][WORLD_HEIGHT_CHUNKS];     // Live chunk when snapshotted, nullptr if missing; only compared
+    bool lit[REGION_COLUMNS][WORLD_HEIGHT_CHUNKS];          // Was CHUNK_LIT: its light is used, and may be updated
+    PalettedBlocks blocks[REGION_COLUMNS][WORLD_HEIGHT_CHUNKS];
+    ChunkLight light[REGION_COLUMNS][WORLD_HEIGHT_CHUNKS];  // Snapshot, replaced by the result
+    bool changed[REGION_COLUMNS][WORLD_HEIGHT_CHUNKS];      // Result differs from the snapshot
+    int16_t sky[REGION_WIDTH][REGION_WIDTH];                // [x][z] World::skyHeight(), raised over missing chunks
+};
+
+// Nibble of 'light' selected by 'shift' (4 for sunlight, 0 for block light)
+static inline int level(uint8_t light, int shift)
+{
+    return (light >> shift) & 15;
+}
+static inline void setLevel(uint8_t& light, int shift, int value)
+{
+    light = (uint8_t)((light & ~(15 << shift)) | (value << shift));
+}
+
+// Neighbour of voxel 'i' at (x, y, z) across 'face', or -1 outside the region
+static inline int neighbourIndex(int i, int x, int y, int z, int face)
+{
+    switch (face) {
+    case 0: return x > 0 ? i - STRIDE_X : -1;
+    case 1: return x < REGION_WIDTH - 1 ? i + STRIDE_X : -1;
+    case 2: return y > 0 ? i - STRIDE_Y : -1;
+    case 3: return y < REGION_HEIGHT - 1 ? i + STRIDE_Y : -1;
+    case 4: return z > 0 ? i - 1 : -1;
+    default: return z < REGION_WIDTH - 1 ? i + 1 : -1;
+    }
+}
+
+static inline void regionPosition(int i, int& x, int& y, int& z)
+{
+    x = i / STRIDE_X;
+    y = (i / STRIDE_Y) % REGION_HEIGHT;
+    z = i % REGION_WIDTH;
+}
+
+// Breadth-first add flood from the queued voxels: each spreads its level
+// minus one into open neighbours that are darker. Full sunlight keeps its
+// level going down.
+static void floodAdd(const BlockId* blocks, uint8_t* light, std::vector<int>& queue, int shift)
+{
+    bool sun = shift == 4;
+    for (size_t head = 0; head < queue.size(); head++) {
+        int i = queue[head];
+        int current = level(light[i], shift);
+        int x, y, z;
+        regionPosition(i, x, y, z);
+        for (int face = 0; face < 6; face++) {
+            int n = neighbourIndex(i, x, y, z, face);
+            if (n < 0 || isOpaque(blocks[n]))
+                continue;
+            int next = sun && face == 2 && current == MAX_LIGHT ? MAX_LIGHT : current - 1;
+            if (level(light[n], shift) >= next)
+                continue;
+            setLevel(light[n], shift, next);
+            queue.push_back(n);
+        }
+    }
+    queue.clear();
+}
+
+// Breadth-first removal flood from voxels whose light was cleared, each
+// queued with the level it had. Neighbours dimmer than that (or full
+// sunlight right below full sunlight) got their light from it and are
+// cleared in turn; the others are lit some other way and are queued in
+// 'refill' to spread back into the cleared area.
+static void floodRemove(const BlockId* blocks, uint8_t* light, std::vector<std::pair<int, int>>& queue,
+    std::vector<int>& refill, int shift)
+{
+    bool sun = shift == 4;
+    for (size_t head = 0; head < queue.size(); head++) {
+        int i = queue[head].first;
+        int removed = queue[head].second;
+        int x, y, z;
+        regionPosition(i, x, y, z);
+        for (int face = 0; face < 6; face++) {
+            int n = neighbourIndex(i, x, y, z, face);
+            if (n < 0)
+                continue;
+            int neighbour = level(light[n], shift);
+            if (neighbour == 0)
+                continue;
+            bool emitter = !sun && blockEmission(blocks[n]) > 0;
+            bool fed = neighbour < removed || (sun && face == 2 && removed == MAX_LIGHT && neighbour == MAX_LIGHT);
+            if (fed && !emitter) {
+                setLevel(light[n], shift, 0);
+                queue.push_back(std::make_pair(n, neighbour));
+            }
+            else {
+                refill.push_back(n);
+            }
+        }
+    }
+    queue.clear();
+}
+
+// Spread the sunlight of a region lit down to its sky heights with slab
+// sweeps (sweepLight()) instead of the queue, over rows begin <= y < end:
+// those the sky can reach, from MAX_LIGHT - 1 below the lowest sky height
+// up to the highest, above which every column is at full sunlight
+static void sweepSunlight(const BlockId* blocks, uint8_t* light, int begin, int end)
+{
+    PROFILE_ZONE("Sweep sunlight");
+    uint8_t openTable[BLOCK_TYPE_COUNT];
+    for (int id = 0; id < BLOCK_TYPE_COUNT; id++)
+        openTable[id] = isOpaque((BlockId)id) ? 0 : 0xFF;
+    // Rows begin - 1 and end are sources the sweep only reads; the rest of
+    // the scratch is never touched
+    int first = std::max(0, begin - 1);
+    int last = std::min(REGION_HEIGHT - 1, end);
+    ArenaScope scratch(threadArena());
+    uint8_t* open = scratch.arena.allocArray<uint8_t>(REGION_VOLUME);
+    uint8_t* level = scratch.arena.allocArray<uint8_t>(REGION_VOLUME);
+    for (int x = 0; x < REGION_WIDTH; x++) {
+        int rows = regionIndex(x, begin, 0);
+        lookupBytes(&blocks[rows], (end - begin) * REGION_WIDTH, openTable, BLOCK_TYPE_COUNT, &open[rows]);
+        for (int i = regionIndex(x, first, 0); i < regionIndex(x, last + 1, 0); i++)
+            level[i] = (uint8_t)(light[i] >> 4);
+    }
+    sweepLight(level, open, REGION_WIDTH, REGION_HEIGHT, REGION_WIDTH, begin, end);
+    for (int x = 0; x < REGION_WIDTH; x++) {
+        for (int i = regionIndex(x, begin, 0); i < regionIndex(x, end, 0); i++)
+            light[i] = (uint8_t)(level[i] << 4);
+    }
+}
+
+// Light a region from nothing: sunlight down every column from the sky
+// to the column's sky height (the highest opaque block), spread sideways,
+// and block light from every emitter. From 'openHeight' up the region is
+// all air (the sections above the highest occupied one): full sunlight
+// with nowhere to spread, set a whole slab at a time. The sideways spread
+// takes the queue when few voxels start it, as under open terrain, and
+// slab sweeps when many do, as over caves open to the sky: the queue's
+// cost follows the voxels it visits, a sweep's the rows it covers.
+static void lightRegion(const BlockId* blocks, uint8_t* light, const int16_t (*sky)[REGION_WIDTH], int openHeight)
+{
+    std::vector<int> queue;
+    for (int x = 0; x < REGION_WIDTH; x++)
+        memset(&light[regionIndex(x, openHeight, 0)], FULL_SUNLIGHT, (REGION_HEIGHT - openHeight) * REGION_WIDTH);
+    int lowestSky = openHeight, highestSky = -1;
+    for (int x = 0; x < REGION_WIDTH; x++) {
+        for (int z = 0; z < REGION_WIDTH; z++) {
+            for (int y = openHeight - 1; y > sky[x][z]; y--)
+                light[regionIndex(x, y, z)] = FULL_SUNLIGHT;
+            lowestSky = std::min(lowestSky, (int)sky[x][z]);
+            highestSky = std::max(highestSky, (int)sky[x][z]);
+        }
+    }
+
+    // Only sunlit voxels beside an open voxel the sky doesn't reach have
+    // anywhere to spread: none above the sky heights of the columns around
+    for (int x = 0; x < REGION_WIDTH; x++) {
+        for (int z = 0; z < REGION_WIDTH; z++) {
+            int reach = -1;
+            if (x > 0)
+                reach = std::max(reach, (int)sky[x - 1][z]);
+            if (x < REGION_WIDTH - 1)
+                reach = std::max(reach, (int)sky[x + 1][z]);
+            if (z > 0)
+                reach = std::max(reach, (int)sky[x][z - 1]);
+            if (z < REGION_WIDTH - 1)
+                reach = std::max(reach, (int)sky[x][z + 1]);
+            for (int y = std::min(reach, openHeight - 1); y > sky[x][z]; y--) {
+                int i = regionIndex(x, y, z);
+                for (int face = 0; face < 6; face++) {
+                    if (face == 2 || face == 3)
+                        continue;
+                    int n = neighbourIndex(i, x, y, z, face);
+                    if (n >= 0 && !isOpaque(blocks[n]) && light[n] != FULL_SUNLIGHT) {
+                        queue.push_back(i);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    int sweepBegin = std::max(0, lowestSky + 2 - MAX_LIGHT);
+    int sweepEnd = std::min(openHeight, highestSky + 1);
+    if (!queue.empty() && (int)queue.size() * SWEEP_FRONTIER_SHARE >= (sweepEnd - sweepBegin) * REGION_WIDTH * REGION_WIDTH) {
+        sweepSunlight(blocks, light, sweepBegin, sweepEnd);
+        queue.clear();
+    }
+    else {
+        floodAdd(blocks, light, queue, 4);
+    }
+
+    for (int x = 0; x < REGION_WIDTH; x++) {
+        for (int i = regionIndex(x, 0, 0); i < regionIndex(x, openHeight, 0); i++) {
+            int emission = blockEmission(blocks[i]);
+            if (emission > 0) {
+                setLevel(light[i], 0, emission);
+                queue.push_back(i);
+            }
+        }
+    }
+    floodAdd(blocks, light, queue, 0);
+}
+
+// Update a lit region for block edits within it: clear what each edited
+// voxel used to pass on or give off, then refill from what still lights it
+static void relightEdits(const BlockId* blocks, uint8_t* light, const std::vector<int>& edited)
+{
+    std::vector<std::pair<int, int>> removeSun, removeBlock;
+    std::vector<int> addSun, addBlock;
+    for (int i : edited) {
+        int sun = sunLight(light[i]);
+        int block = blockLight(light[i]);
+        if (block > 0) {
+            setLevel(light[i], 0, 0);
+            removeBlock.push_back(std::make_pair(i, block));
+        }
+        if (sun > 0 && isOpaque(blocks[i])) {
+            setLevel(light[i], 4, 0);
+            removeSun.push_back(std::make_pair(i, sun));
+        }
+    }
+    floodRemove(blocks, light, removeSun, addSun, 4);
+    floodRemove(blocks, light, removeBlock, addBlock, 0);
+
+    for (int i : edited) {
+        int emission = blockEmission(blocks[i]);
+        if (emission > 0) {
+            setLevel(light[i], 0, emission);
+            addBlock.push_back(i);
+        }
+        if (isOpaque(blocks[i]))
+            continue;
+
+        // Opened up: the light around flows in
+        int x, y, z;
+        regionPosition(i, x, y, z);
+        for (int face = 0; face < 6; face++) {
+            int n = neighbourIndex(i, x, y, z, face);
+            if (n >= 0 && light[n] != 0) {
+                addSun.push_back(n);
+                addBlock.push_back(n);
+            }
+        }
+    }
+    floodAdd(blocks, light, addSun, 4);
+    floodAdd(blocks, light, addBlock, 0);
+}
+
+void LightEngine::run(Job& job)
+{
+    PROFILE_ZONE("Light region");
+    std::vector<BlockId> blocks(REGION_VOLUME);
+    std::vector<uint8_t> light(REGION_VOLUME, 0);
+    BlockId flatBlocks[CHUNK_VOLUME];
+    uint8_t flatLight[CHUNK_VOLUME];
+
+    // Expand the snapshot. Missing chunks are solid and dark; chunks that
+    // aren't lit yet are dark until their own column is lit. Air sections
+    // are already in place, so unless their light is needed they are
+    // skipped, and only the sections up to the highest occupied one are lit
+    // voxel by voxel.
+    int openSections = 0;
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            int c = regionColumn(dx, dz);
+            for (int cy = 0; cy < WORLD_HEIGHT_CHUNKS; cy++) {
+                bool useLight = !job.initial && job.lit[c][cy];
+                bool empty = job.chunks[c][cy] && job.blocks[c][cy].isUniform() && job.blocks[c][cy].palette[0] == BLOCK_AIR;
+                if (!empty)
+                    openSections = std::max(openSections, cy + 1);
+                if (empty && !useLight)
+                    continue;
+                if (job.chunks[c][cy])
+                    job.blocks[c][cy].decode(flatBlocks);
+                else
+                    memset(flatBlocks, BLOCK_STONE, sizeof(flatBlocks));
+                if (useLight)
+                    job.light[c][cy].decode(flatLight);
+
+                for (int x = 0; x < CHUNK_SIZE; x++) {
+                    for (int y = 0; y < CHUNK_SIZE; y++) {
+                        int i = regionIndex((dx + 1) * CHUNK_SIZE + x, cy * CHUNK_SIZE + y, (dz + 1) * CHUNK_SIZE);
+                        memcpy(&blocks[i], &flatBlocks[chunkIndex(x, y, 0)], CHUNK_SIZE);
+                        if (useLight)
+                            memcpy(&light[i], &flatLight[chunkIndex(x, y, 0)], CHUNK_SIZE);
+                    }
+                }
+            }
+        }
+    }
+
+    if (job.initial) {
+        lightRegion(blocks.data(), light.data(), job.sky, openSections * CHUNK_SIZE);
+    }
+    else {
+        glm::ivec3 origin((job.column.x - 1) * CHUNK_SIZE, 0, (job.column.y - 1) * CHUNK_SIZE);
+        std::vector<int> edited;
+        for (const glm::ivec3& block : job.edits) {
+            glm::ivec3 p = block - origin;
+            if (p.x >= 0 && p.x < REGION_WIDTH && p.y >= 0 && p.y < REGION_HEIGHT && p.z >= 0 && p.z < REGION_WIDTH)
+                edited.push_back(regionIndex(p.x, p.y, p.z));
+        }
+        relightEdits(blocks.data(), light.data(), edited);
+    }
+
+    // Gather the results: the centre column of a new column in full, and
+    // whatever changed in lit chunks. Light a new column sends into its
+    // neighbours only adds to theirs.
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            int c = regionColumn(dx, dz);
+            bool centre = dx == 0 && dz == 0;
+            for (int cy = 0; cy < WORLD_HEIGHT_CHUNKS; cy++) {
+                job.changed[c][cy] = false;
+                if (!job.chunks[c][cy] || !(job.lit[c][cy] || (job.initial && centre)))
+                    continue;
+
+                for (int x = 0; x < CHUNK_SIZE; x++) {
+                    for (int y = 0; y < CHUNK_SIZE; y++) {
+                        int i = regionIndex((dx + 1) * CHUNK_SIZE + x, cy * CHUNK_SIZE + y, (dz + 1) * CHUNK_SIZE);
+                        memcpy(&flatLight[chunkIndex(x, y, 0)], &light[i], CHUNK_SIZE);
+                    }
+                }
+                if (job.initial && !centre) {
+                    for (int i = 0; i < CHUNK_VOLUME; i++) {
+                        uint8_t before = job.light[c][cy].get(i);
+                        flatLight[i] = packLight(std::max(sunLight(before), sunLight(flatLight[i])),
+                            std::max(blockLight(before), blockLight(flatLight[i])));
+                    }
+                }
+
+                ChunkLight result;
+                result.encode(flatLight);
+                job.changed[c][cy] = result != job.light[c][cy];
+                job.light[c][cy] = std::move(result);
+            }
+        }
+    }
+}
+
+void LightEngine::start(JobSystem& jobs)
+{
+    jobSystem = &jobs;
+}
+
+void LightEngine::stop()
+{
+    if (!jobSystem)
+        return;
+
+    jobSystem->wait(activeJobs);
+    jobSystem = nullptr;
+
+    results.drain(finished);
+    for (Job* job : finished)
+        delete job;
+    finished.clear();
+    running = 0;
+    readyChunks.clear();
+    columnQueue.clear();
+    queuedColumns.clear();
+    edits.clear();
+    lockedColumns.clear();
+}
+
+void LightEngine::chunkReady(const glm::ivec3& coord)
+{
+    glm::ivec2 column(coord.x, coord.z);
+    uint64_t key = columnKey(column);
+    if (++readyChunks[key] == WORLD_HEIGHT_CHUNKS && queuedColumns.insert(key, true))
+        columnQueue.push_back(column);
+}
+
+void LightEngine::chunkUnloaded(const glm::ivec3& coord)
+{
+    uint64_t key = columnKey(glm::ivec2(coord.x, coord.z));
+    int* count = readyChunks.find(key);
+    if (count && --*count <= 0)
+        readyChunks.erase(key);
+}
+
+void LightEngine::blockChanged(const glm::ivec3& block)
+{
+    edits.push_back(block);
+}
+
+bool LightEngine::regionLocked(const glm::ivec2& column) const
+{
+    for (int dx = -1; dx <= 1; dx++)
+        for (int dz = -1; dz <= 1; dz++)
+            if (lockedColumns.contains(columnKey(column + glm::ivec2(dx, dz))))
+                return true;
+    return false;
+}
+
+void LightEngine::lockRegion(const glm::ivec2& column, int delta)
+{
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            uint64_t key = columnKey(column + glm::ivec2(dx, dz));
+            int& count = lockedColumns[key];
+            count += delta;
+            if (count <= 0)
+                lockedColumns.erase(key);
+        }
+    }
+}
+
+LightEngine::Job* LightEngine::snapshot(World& world, const glm::ivec2& column)
+{
+    Job* job = new Job();
+    job->column = column;
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            int c = regionColumn(dx, dz);
+            for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+                Chunk* chunk = world.getChunk(glm::ivec3(column.x + dx, y, column.y + dz));
+                job->chunks[c][y] = chunk;
+                job->lit[c][y] = chunk && chunk->state == CHUNK_LIT;
+                if (!chunk)
+                    continue;
+                job->blocks[c][y] = chunk->blocks;
+                job->light[c][y] = chunk->light;
+            }
+
+            // Missing chunks light as solid: the sky stops at the highest
+            int missingTop = -1;
+            for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+                if (!job->chunks[c][y])
+                    missingTop = y * CHUNK_SIZE + CHUNK_SIZE - 1;
+            }
+            glm::ivec2 origin = (column + glm::ivec2(dx, dz)) * CHUNK_SIZE;
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                for (int z = 0; z < CHUNK_SIZE; z++) {
+                    int height = std::max(world.skyHeight(origin.x + x, origin.y + z), missingTop);
+                    job->sky[(dx + 1) * CHUNK_SIZE + x][(dz + 1) * CHUNK_SIZE + z] = (int16_t)height;
+                }
+            }
+        }
+    }
+    lockRegion(column, 1);
+    return job;
+}
+
+void LightEngine::schedule(Job* job)
+{
+    running++;
+    jobSystem->schedule([this, job] {
+        run(*job);
+        results.push(job);
+    }, &activeJobs);
+}
+
+bool LightEngine::startColumn(World& world, const glm::ivec2& column)
+{
+    // Dropped if a chunk left meanwhile; it is queued again once they are all back
+    for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+        const Chunk* chunk = world.getChunk(glm::ivec3(column.x, y, column.y));
+        if (!chunk || (chunk->state != CHUNK_READY && chunk->state != CHUNK_LIT))
+            return false;
+    }
+    if (baked(world, column)) {
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+            Chunk* chunk = world.getChunk(glm::ivec3(column.x, y, column.y));
+            chunk->state = CHUNK_LIT;
+            chunk->dirty = true; // Held back from meshing until now
+        }
+        return true;
+    }
+    Job* job = snapshot(world, column);
+    job->initial = true;
+    schedule(job);
+    return true;
+}
+
+bool LightEngine::baked(World& world, const glm::ivec2& column)
+{
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            bool centre = dx == 0 && dz == 0;
+            for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+                const Chunk* chunk = world.getChunk(glm::ivec3(column.x + dx, y, column.y + dz));
+                if (centre ? !chunk->bakedLight : chunk && chunk->state == CHUNK_LIT && !chunk->bakedLight)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Mark a chunk whose light went from 'before' to its current light for
+// re-meshing, and each neighbour whose mesh samples a layer that changed
+static void markRelit(World& world, Chunk& chunk, const ChunkLight& before, bool edited)
+{
+    chunk.dirty = true;
+    chunk.edited = chunk.edited || edited;
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        Chunk* neighbour = world.getChunk(chunk.coord + glm::ivec3(n[0], n[1], n[2]));
+        if (!neighbour || neighbour->dirty)
+            continue;
+
+        int d = face / 2;
+        int a = d == 0 ? 1 : 0;
+        int b = d == 2 ? 1 : 2;
+        int pos[3];
+        pos[d] = (face & 1) ? CHUNK_SIZE - 1 : 0;
+        bool layerChanged = false;
+        for (pos[a] = 0; pos[a] < CHUNK_SIZE && !layerChanged; pos[a]++) {
+            for (pos[b] = 0; pos[b] < CHUNK_SIZE; pos[b]++) {
+                int i = chunkIndex(pos[0], pos[1], pos[2]);
+                if (before.get(i) != chunk.light.get(i)) {
+                    layerChanged = true;
+                    break;
+                }
+            }
+        }
+        if (layerChanged) {
+            neighbour->dirty = true;
+            neighbour->edited = neighbour->edited || edited;
+        }
+    }
+}
+
+void LightEngine::apply(World& world, Job& job)
+{
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            int c = regionColumn(dx, dz);
+            bool centre = dx == 0 && dz == 0;
+            for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+                Chunk* chunk = job.chunks[c][y];
+                if (!chunk || world.getChunk(glm::ivec3(job.column.x + dx, y, job.column.y + dz)) != chunk)
+                    continue; // Missing, or unloaded since
+
+                bool newlyLit = job.initial && centre;
+                if (newlyLit ? chunk->state != CHUNK_READY && chunk->state != CHUNK_LIT :
+                    !job.lit[c][y] || chunk->state != CHUNK_LIT)
+                    continue;
+                if (newlyLit)
+                    chunk->state = CHUNK_LIT;
+                if (!job.changed[c][y]) {
+                    if (newlyLit)
+                        chunk->dirty = true; // Held back from meshing until now
+                    continue;
+                }
+
+                ChunkLight before = std::move(chunk->light);
+                chunk->light = std::move(job.light[c][y]);
+                markRelit(world, *chunk, before, !job.initial);
+                // Light saved with the blocks is stale now
+                if (chunk->bakedLight && !job.initial) {
+                    chunk->bakedLight = false;
+                    chunk->unsaved = true;
+                }
+            }
+        }
+    }
+}
+
+void LightEngine::update(World& world, const glm::ivec3& cameraChunk)
+{
+    world.flushBlockEvents();
+    if (!jobSystem)
+        return;
+    PROFILE_ZONE("Lighting");
+
+    results.drain(finished);
+    while (!finished.empty()) {
+        Job* job = finished.front();
+        finished.pop_front();
+        apply(world, *job);
+        lockRegion(job->column, -1);
+        running--;
+        delete job;
+    }
+
+    int limit = maxJobs > 0 ? maxJobs : std::max(1, jobSystem->workerCount() / 2);
+
+    // Edits first, so the player sees them soon: one job takes every queued
+    // edit of its column, the rest keep their order
+    for (size_t e = 0; e < edits.size() && running < limit; ) {
+        glm::ivec2 column(floorDivChunk(edits[e].x), floorDivChunk(edits[e].z));
+        if (regionLocked(column)) {
+            e++;
+            continue;
+        }
+        Job* job = snapshot(world, column);
+        size_t kept = e;
+        for (size_t k = e; k < edits.size(); k++) {
+            if (floorDivChunk(edits[k].x) == column.x && floorDivChunk(edits[k].z) == column.y)
+                job->edits.push_back(edits[k]);
+            else
+                edits[kept++] = edits[k];
+        }
+        edits.resize(kept);
+        schedule(job);
+    }
+
+    // Then new columns, nearest first (taken from the back)
+    if (running >= limit || columnQueue.empty())
+        return;
+    glm::ivec2 camera(cameraChunk.x, cameraChunk.z);
+    std::sort(columnQueue.begin(), columnQueue.end(), [&](const glm::ivec2& a, const glm::ivec2& b) {
+        glm::ivec2 da = a - camera;
+        glm::ivec2 db = b - camera;
+        return da.x * da.x + da.y * da.y > db.x * db.x + db.y * db.y;
+    });
+    for (size_t q = columnQueue.size(); q-- > 0 && running < limit; ) {
+        glm::ivec2 column = columnQueue[q];
+        if (regionLocked(column))
+            continue;
+        columnQueue.erase(columnQueue.begin() + q);
+        queuedColumns.erase(columnKey(column));
+        startColumn(world, column);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_hash_map.h"
+#include "job_system.h"
+#include "mpsc_queue.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct World;
+
+// Sunlight and block light of the loaded chunks, flood-filled on job system
+// workers. Light travels through air and loses a level per block, except
+// full sunlight falling straight down; emitters (blockEmission()) are
+// sources of block light. Both kinds are stored per voxel in Chunk::light
+// and baked into mesh vertices.
+//
+// Light never reaches further than MAX_LIGHT blocks, so a column of chunks
+// only depends on the voxels of the 3x3 columns around it. Every job works
+// on such a region: the main thread snapshots its blocks and light, a
+// worker computes, and the main thread writes back the chunks that changed
+// (marking them for re-meshing). Regions of running jobs are locked, so
+// jobs never overlap.
+//
+//  - A column whose chunks are all CHUNK_READY is lit from scratch, then
+//    moved to CHUNK_LIT. Where much of its sunlight spreads sideways, as
+//    into caves open to the sky, that takes vectorised sweeps over whole
+//    rows (light_kernels.h) instead of the queue. Light it sends into lit
+//    neighbour columns is merged into theirs (a new column can only
+//    brighten them: missing chunks count as solid).
+//  - A column whose chunks all came with baked light (Chunk::bakedLight)
+//    is already lit: it moves to CHUNK_LIT without a job, unless a lit
+//    neighbour column wasn't baked with it and so still needs its light.
+//    An edit's relight drops the baked light of the chunks it changes,
+//    saving them again without it.
+//  - Block edits are incremental: a removal flood clears the light that
+//    came through or from the edited voxel, and an add flood refills it
+//    from the lit voxels bordering the cleared area and any new emitter.
+struct LightEngine {
+    // Run lighting jobs on 'jobs'
+    void start(JobSystem& jobs);
+    // Wait for running jobs and drop their results and everything queued
+    void stop();
+
+    // World hooks (main thread): a chunk became CHUNK_READY, a ready or lit
+    // chunk was unloaded, a block changed (World::flushBlockEvents())
+    void chunkReady(const glm::ivec3& coord);
+    void chunkUnloaded(const glm::ivec3& coord);
+    void blockChanged(const glm::ivec3& block);
+
+    // Apply finished jobs to the world, then start new ones: edits first,
+    // then columns nearest 'cameraChunk'. Main thread, while it may change
+    // the world.
+    void update(World& world, const glm::ivec3& cameraChunk);
+
+    // Columns and edits waiting to be lit, plus running jobs
+    int pendingCount() const { return (int)(columnQueue.size() + edits.size()) + running; }
+
+    // Most jobs running at once; 0 = half the workers (at least one)
+    int maxJobs = 0;
+
+    ~LightEngine() { stop(); }
+
+private:
+    struct Job;
+
+    // Job body (worker): light the job's region
+    static void run(Job& job);
+    // Lock the region around 'column' and snapshot it into a new job
+    Job* snapshot(World& world, const glm::ivec2& column);
+    void schedule(Job* job);
+    // Write a finished job's light into the chunks still loaded
+    void apply(World& world, Job& job);
+    bool regionLocked(const glm::ivec2& column) const;
+    void lockRegion(const glm::ivec2& column, int delta);
+    // Start an initial lighting job for the column if it is still complete
+    // (or take its baked light)
+    bool startColumn(World& world, const glm::ivec2& column);
+    // True if the column's chunks have their light baked, and so do the lit
+    // chunks around it
+    static bool baked(World& world, const glm::ivec2& column);
+
+    JobSystem* jobSystem = nullptr;
+    JobCounter activeJobs;
+    int running = 0;
+
+    ChunkHashMap<int> readyChunks;      // Per column (y = 0): chunks ready or lit
+    std::vector<glm::ivec2> columnQueue;// Complete columns waiting for initial light
+    ChunkHashMap<bool> queuedColumns;   // Members of columnQueue
+    std::vector<glm::ivec3> edits;      // Blocks changed and not yet relit, in order
+    ChunkHashMap<int> lockedColumns;    // Running jobs' regions, by column
+
+    MPSCQueue<Job*> results;            // Pushed by workers, drained by update()
+    std::deque<Job*> finished;
+};
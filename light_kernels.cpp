@@ -0,0 +1,221 @@
+#include "light_kernels.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIGHT_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define LIGHT_NEON 1
+#endif
+
+// Registers in the longest row the SIMD scan handles (64 voxels); longer
+// rows take the scalar one
+const int MAX_ROW_VECTORS = 4;
+
+// level[i] = max(level[i], from[i] - 1) where open[i], for 'count' bytes.
+// True if any level rose.
+static bool spreadRowsScalar(uint8_t* level, const uint8_t* from, const uint8_t* open, int count)
+{
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+        int next = from[i] > 0 ? from[i] - 1 : 0;
+        if (open[i] && next > level[i]) {
+            level[i] = (uint8_t)next;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Spread along one row of 'count' voxels, towards higher z and back
+static bool spreadAlongScalar(uint8_t* row, const uint8_t* open, int count)
+{
+    bool changed = false;
+    for (int z = 1; z < count; z++) {
+        int next = row[z - 1] > 0 ? row[z - 1] - 1 : 0;
+        if (open[z] && next > row[z]) {
+            row[z] = (uint8_t)next;
+            changed = true;
+        }
+    }
+    for (int z = count - 2; z >= 0; z--) {
+        int next = row[z + 1] > 0 ? row[z + 1] - 1 : 0;
+        if (open[z] && next > row[z]) {
+            row[z] = (uint8_t)next;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+#if defined(LIGHT_SSE2)
+typedef __m128i LightVector;
+
+static inline LightVector loadVector(const uint8_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void storeVector(uint8_t* p, LightVector v) { _mm_storeu_si128((__m128i*)p, v); }
+static inline LightVector zeroVector() { return _mm_setzero_si128(); }
+static inline LightVector maxVector(LightVector a, LightVector b) { return _mm_max_epu8(a, b); }
+static inline LightVector andVector(LightVector a, LightVector b) { return _mm_and_si128(a, b); }
+static inline LightVector subtractVector(LightVector a, int s) { return _mm_subs_epu8(a, _mm_set1_epi8((char)s)); }
+static inline bool equalVectors(LightVector a, LightVector b) { return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF; }
+// Bytes of the row moved S places towards higher z: 'cur' shifted, with the
+// top of 'lower' (the register before it) coming in
+template <int S>
+static inline LightVector shiftUp(LightVector cur, LightVector lower) { return _mm_or_si128(_mm_slli_si128(cur, S), _mm_srli_si128(lower, 16 - S)); }
+// ... and towards lower z, with the bottom of 'upper' coming in
+template <int S>
+static inline LightVector shiftDown(LightVector cur, LightVector upper) { return _mm_or_si128(_mm_srli_si128(cur, S), _mm_slli_si128(upper, 16 - S)); }
+#elif defined(LIGHT_NEON)
+typedef uint8x16_t LightVector;
+
+static inline LightVector loadVector(const uint8_t* p) { return vld1q_u8(p); }
+static inline void storeVector(uint8_t* p, LightVector v) { vst1q_u8(p, v); }
+static inline LightVector zeroVector() { return vdupq_n_u8(0); }
+static inline LightVector maxVector(LightVector a, LightVector b) { return vmaxq_u8(a, b); }
+static inline LightVector andVector(LightVector a, LightVector b) { return vandq_u8(a, b); }
+static inline LightVector subtractVector(LightVector a, int s) { return vqsubq_u8(a, vdupq_n_u8((uint8_t)s)); }
+static inline bool equalVectors(LightVector a, LightVector b) { return vminvq_u8(vceqq_u8(a, b)) == 0xFF; }
+template <int S>
+static inline LightVector shiftUp(LightVector cur, LightVector lower) { return vextq_u8(lower, cur, 16 - S); }
+template <int S>
+static inline LightVector shiftDown(LightVector cur, LightVector upper) { return vextq_u8(cur, upper, S); }
+#endif
+
+#if defined(LIGHT_SSE2) || defined(LIGHT_NEON)
+static bool spreadRowsSimd(uint8_t* level, const uint8_t* from, const uint8_t* open, int count)
+{
+    bool changed = false;
+    for (int i = 0; i < count; i += 16) {
+        LightVector current = loadVector(level + i);
+        LightVector next = maxVector(current, andVector(subtractVector(loadVector(from + i), 1), loadVector(open + i)));
+        if (!equalVectors(next, current)) {
+            storeVector(level + i, next);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// One doubling step of the scan towards higher z: levels S voxels back,
+// less S, where the S voxels up to here are open; then 'open' becomes
+// "the 2S voxels up to here are open"
+template <int S>
+static inline void scanUp(LightVector* row, LightVector* open, int vectors)
+{
+    for (int k = vectors - 1; k >= 0; k--) {
+        LightVector lowerLevel = k > 0 ? row[k - 1] : zeroVector();
+        LightVector lowerOpen = k > 0 ? open[k - 1] : zeroVector();
+        row[k] = maxVector(row[k], andVector(subtractVector(shiftUp<S>(row[k], lowerLevel), S), open[k]));
+        open[k] = andVector(open[k], shiftUp<S>(open[k], lowerOpen));
+    }
+}
+
+template <int S>
+static inline void scanDown(LightVector* row, LightVector* open, int vectors)
+{
+    for (int k = 0; k < vectors; k++) {
+        LightVector upperLevel = k + 1 < vectors ? row[k + 1] : zeroVector();
+        LightVector upperOpen = k + 1 < vectors ? open[k + 1] : zeroVector();
+        row[k] = maxVector(row[k], andVector(subtractVector(shiftDown<S>(row[k], upperLevel), S), open[k]));
+        open[k] = andVector(open[k], shiftDown<S>(open[k], upperOpen));
+    }
+}
+
+static bool spreadAlongSimd(uint8_t* level, const uint8_t* openBytes, int count)
+{
+    int vectors = count / 16;
+    LightVector before[MAX_ROW_VECTORS], row[MAX_ROW_VECTORS], open[MAX_ROW_VECTORS];
+    for (int k = 0; k < vectors; k++) {
+        before[k] = row[k] = loadVector(level + k * 16);
+        open[k] = loadVector(openBytes + k * 16);
+    }
+    // Registers are walked against the shift, so each step reads the
+    // neighbour register as it was before the step
+    scanUp<1>(row, open, vectors);
+    scanUp<2>(row, open, vectors);
+    scanUp<4>(row, open, vectors);
+    scanUp<8>(row, open, vectors);
+    for (int k = 0; k < vectors; k++)
+        open[k] = loadVector(openBytes + k * 16);
+    scanDown<1>(row, open, vectors);
+    scanDown<2>(row, open, vectors);
+    scanDown<4>(row, open, vectors);
+    scanDown<8>(row, open, vectors);
+
+    bool changed = false;
+    for (int k = 0; k < vectors; k++) {
+        if (!equalVectors(row[k], before[k])) {
+            storeVector(level + k * 16, row[k]);
+            changed = true;
+        }
+    }
+    return changed;
+}
+#endif
+
+// Passes until nothing changes, with the row kernels as template arguments
+// so they inline into the loops. Each row remembers whether it rose in the
+// last pass or this one; spreading from one row into another that have
+// both stayed put since the last pass did it gives nothing new, and is
+// skipped, so later passes only visit where light is still moving.
+template <bool (*spreadRows)(uint8_t*, const uint8_t*, const uint8_t*, int), bool (*spreadAlong)(uint8_t*, const uint8_t*, int)>
+static int sweep(uint8_t* level, const uint8_t* open, int sizeX, int sizeY, int sizeZ, int yBegin, int yEnd)
+{
+    if (yBegin >= yEnd)
+        return 0;
+    const int strideX = sizeY * sizeZ;
+    // Rose in the last pass, rose in this one; the sources outside the
+    // swept rows never do
+    std::vector<uint8_t> last(sizeX * sizeY, 1), now(sizeX * sizeY, 0);
+    auto moved = [&](int x, int y) { return (last[x * sizeY + y] | now[x * sizeY + y]) != 0; };
+    auto spread = [&](int x, int y, int fromX, int fromY) {
+        if (!moved(x, y) && !moved(fromX, fromY))
+            return;
+        if (spreadRows(level + x * strideX + y * sizeZ, level + fromX * strideX + fromY * sizeZ, open + x * strideX + y * sizeZ, sizeZ))
+            now[x * sizeY + y] = 1;
+    };
+
+    int passes = 0;
+    for (bool changed = true; changed; ) {
+        passes++;
+        for (int x = 1; x < sizeX; x++) {
+            for (int y = yBegin; y < yEnd; y++)
+                spread(x, y, x - 1, y);
+        }
+        for (int x = sizeX - 2; x >= 0; x--) {
+            for (int y = yBegin; y < yEnd; y++)
+                spread(x, y, x + 1, y);
+        }
+        for (int x = 0; x < sizeX; x++) {
+            for (int y = yBegin > 0 ? yBegin : 1; y < yEnd; y++)
+                spread(x, y, x, y - 1);
+            for (int y = (yEnd < sizeY ? yEnd : sizeY - 1) - 1; y >= yBegin; y--)
+                spread(x, y, x, y + 1);
+            for (int y = yBegin; y < yEnd; y++) {
+                if (moved(x, y) && spreadAlong(level + x * strideX + y * sizeZ, open + x * strideX + y * sizeZ, sizeZ))
+                    now[x * sizeY + y] = 1;
+            }
+        }
+        changed = std::find(now.begin(), now.end(), 1) != now.end();
+        last.swap(now);
+        std::fill(now.begin(), now.end(), 0);
+    }
+    return passes;
+}
+
+int sweepLightScalar(uint8_t* level, const uint8_t* open, int sizeX, int sizeY, int sizeZ, int yBegin, int yEnd)
+{
+    return sweep<spreadRowsScalar, spreadAlongScalar>(level, open, sizeX, sizeY, sizeZ, yBegin, yEnd);
+}
+
+int sweepLight(uint8_t* level, const uint8_t* open, int sizeX, int sizeY, int sizeZ, int yBegin, int yEnd)
+{
+#if defined(LIGHT_SSE2) || defined(LIGHT_NEON)
+    if (sizeZ % 16 == 0 && sizeZ <= MAX_ROW_VECTORS * 16)
+        return sweep<spreadRowsSimd, spreadAlongSimd>(level, open, sizeX, sizeY, sizeZ, yBegin, yEnd);
+#endif
+    return sweepLightScalar(level, open, sizeX, sizeY, sizeZ, yBegin, yEnd);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Bulk light propagation for initial lighting: instead of a voxel at a time
+// from a queue, light levels spread through whole rows at once with byte
+// max and saturating subtract, 16 voxels per instruction (SSE2, NEON).
+//
+// A box of levels, one byte per voxel (0..MAX_LIGHT), is laid out
+// [x][y][z] with z fastest, like a light job's region. 'open' has 0xFF for
+// each voxel light passes through and 0 for the others. Every open voxel
+// ends up at least one below the brightest of its six neighbours, which is
+// what a breadth-first flood from the same levels gives. Voxels that are not
+// open keep their level, so emitters in solid blocks still shine out of them.
+//
+// A sweep pass runs across the box along x (both ways), along y, and then
+// along each row in z. Along z a row is scanned in doubling steps of 1, 2,
+// 4 and 8 voxels, which reaches the 15 a level can travel. Passes repeat
+// until one changes nothing; light turning a corner needs another pass,
+// so terrain usually settles in a few.
+//
+// The scalar loops are the reference. Every path gives the same bytes.
+
+// Sweep rows yBegin <= y < yEnd of a sizeX x sizeY x sizeZ box ('sizeZ' a
+// multiple of 16) until nothing changes. The rows just outside, if any,
+// are read as fixed sources. Returns the passes taken, the last of which
+// changed nothing.
+int sweepLight(uint8_t* level, const uint8_t* open, int sizeX, int sizeY, int sizeZ, int yBegin, int yEnd);
+int sweepLightScalar(uint8_t* level, const uint8_t* open, int sizeX, int sizeY, int sizeZ, int yBegin, int yEnd);
@@ -0,0 +1,364 @@
+#include "lod_terrain.h"
+#include "frame_arena.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "sparse_voxel_octree.h"
+#include "terrain_column.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+const char* FAR_FIELD_NAMES[FAR_FIELD_MODE_COUNT] = { "lod", "raymarch", "impostor" };
+
+// Level in the top 4 bits, then x (24), y (12) and z (24)
+static uint64_t packTileKey(int level, const glm::ivec3& coord)
+{
+    const uint64_t mask24 = (1u << 24) - 1;
+    const uint64_t mask12 = (1u << 12) - 1;
+    return ((uint64_t)level << 60) | ((uint64_t)(coord.x & mask24) << 36) |
+        ((uint64_t)(coord.y & mask12) << 24) | (uint64_t)(coord.z & mask24);
+}
+
+static int floorDiv(int v, int d)
+{
+    return (v >= 0 ? v : v - (d - 1)) / d;
+}
+
+void buildLodVoxels(int level, const glm::ivec3& tile, uint32_t seed, ChunkVoxels& out)
+{
+    int cell = 1 << level;
+    glm::ivec3 origin = tile * (CHUNK_SIZE * cell);
+
+    // Nothing finer than a cell is kept, so the octree stays small
+    SparseVoxelOctree octree;
+    octree.buildTerrain(origin, 4 + level, seed, level);
+    for (int x = 0; x < CHUNK_SIZE; x++)
+        for (int y = 0; y < CHUNK_SIZE; y++)
+            for (int z = 0; z < CHUNK_SIZE; z++)
+                out.blocks[chunkIndex(x, y, z)] = octree.sample(origin + glm::ivec3(x, y, z) * cell, level);
+    memset(out.border, BLOCK_AIR, sizeof(out.border));
+    // Seen from afar, everything is in daylight
+    memset(out.light, FULL_SUNLIGHT, sizeof(out.light));
+    memset(out.borderLight, FULL_SUNLIGHT, sizeof(out.borderLight));
+}
+
+void LodTerrain::start(JobSystem& jobs)
+{
+    jobSystem = &jobs;
+}
+
+void LodTerrain::stop()
+{
+    if (!jobSystem)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        requests.clear();
+    }
+    jobSystem->wait(activeJobs);
+    jobSystem = nullptr;
+
+    results.drain(finished);
+    for (Result* result : finished)
+        delete result;
+    finished.clear();
+}
+
+int LodTerrain::tileDistance(int level, const glm::ivec2& tile) const
+{
+    // Chebyshev distance from the centre column to the tile's nearest column
+    int span = 1 << level;
+    glm::ivec2 lo = tile * span - center;
+    glm::ivec2 hi = lo + glm::ivec2(span - 1);
+    int dx = std::max(std::max(lo.x, -hi.x), 0);
+    int dz = std::max(std::max(lo.y, -hi.y), 0);
+    return std::max(dx, dz);
+}
+
+void LodTerrain::selectTiles(int level, const glm::ivec2& tile, std::vector<Request>& wanted) const
+{
+    int distance = tileDistance(level, tile);
+    if (distance > outer)
+        return;
+    if (level > 1 && distance < (inner << (level - 1))) {
+        for (int i = 0; i < 4; i++)
+            selectTiles(level - 1, tile * 2 + glm::ivec2(i & 1, i >> 1), wanted);
+        return;
+    }
+
+    // Nothing to draw if even the farthest column of the tile is streamed
+    int span = 1 << level;
+    glm::ivec2 lo = tile * span - center;
+    glm::ivec2 hi = lo + glm::ivec2(span - 1);
+    int fx = std::max(std::abs(lo.x), std::abs(hi.x));
+    int fz = std::max(std::abs(lo.y), std::abs(hi.y));
+    if (fx * fx + fz * fz <= inner * inner)
+        return;
+
+    // Stacked from the bottom of the world up to the highest surface
+    int layers = TERRAIN_MAX_SURFACE / (CHUNK_SIZE << level) + 1;
+    for (int y = 0; y < layers; y++) {
+        glm::ivec3 coord(tile.x, y, tile.y);
+        wanted.push_back({ packTileKey(level, coord), level, coord, distance });
+    }
+}
+
+void LodTerrain::update(const glm::ivec2& centerColumn, int innerRadius, int outerRadius)
+{
+    if (centerColumn == center && innerRadius == inner && outerRadius == outer)
+        return;
+    PROFILE_ZONE("Select LOD tiles");
+    center = centerColumn;
+    inner = innerRadius;
+    outer = outerRadius;
+
+    // Walk down from the coarsest tiles covering the horizon
+    std::vector<Request> wanted;
+    int topSpan = 1 << LOD_LEVELS;
+    for (int tx = floorDiv(center.x - outer, topSpan); tx <= floorDiv(center.x + outer, topSpan); tx++)
+        for (int tz = floorDiv(center.y - outer, topSpan); tz <= floorDiv(center.y + outer, topSpan); tz++)
+            selectTiles(LOD_LEVELS, glm::ivec2(tx, tz), wanted);
+
+    for (auto& entry : tiles)
+        entry.second.wanted = false;
+    std::vector<Request> added;
+    for (const Request& request : wanted) {
+        auto it = tiles.find(request.key);
+        if (it != tiles.end()) {
+            it->second.wanted = true;
+            continue;
+        }
+        Tile& tile = tiles[request.key];
+        tile.level = request.level;
+        tile.coord = request.coord;
+        added.push_back(request);
+    }
+
+    // Unbuilt tiles that left the set have nothing to show and go now;
+    // built ones are drawn until their replacements are ready
+    missingTiles = 0;
+    retiring = false;
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        Tile& tile = it->second;
+        if (!tile.wanted && !tile.built) {
+            it = tiles.erase(it);
+            continue;
+        }
+        retiring = retiring || !tile.wanted;
+        if (!tile.built)
+            missingTiles++;
+        ++it;
+    }
+
+    {
+        // Keep the queued tiles that are still wanted, at their new distance
+        std::lock_guard<std::mutex> lock(requestMutex);
+        size_t kept = 0;
+        for (Request& request : requests) {
+            if (tiles.find(request.key) == tiles.end())
+                continue;
+            request.distance = tileDistance(request.level, glm::ivec2(request.coord.x, request.coord.z));
+            requests[kept++] = request;
+        }
+        requests.resize(kept);
+        requests.insert(requests.end(), added.begin(), added.end());
+        std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+            return a.distance > b.distance;
+        });
+    }
+
+    // One job per new tile; each builds whatever is nearest when it runs
+    if (jobSystem) {
+        for (size_t i = 0; i < added.size(); i++)
+            jobSystem->schedule([this] { buildNext(); }, &activeJobs);
+    }
+    if (retiring && missingTiles == 0)
+        retireTiles();
+}
+
+int LodTerrain::uploadMeshes(size_t budgetBytes)
+{
+    results.drain(finished);
+
+    size_t sent = 0;
+    int uploaded = 0;
+    while (!finished.empty() && sent < budgetBytes) {
+        Result* result = finished.front();
+        finished.pop_front();
+
+        // Tiles dropped meanwhile, or built twice after being re-wanted, are ignored
+        auto it = tiles.find(result->key);
+        if (it != tiles.end() && !it->second.built) {
+            it->second.mesh.upload(result->vertices, result->quadCount);
+            it->second.built = true;
+            missingTiles--;
+            sent += result->vertices.size() * sizeof(ChunkVertex);
+            uploaded++;
+        }
+        delete result;
+    }
+
+    if (retiring && missingTiles == 0)
+        retireTiles();
+    return uploaded;
+}
+
+void LodTerrain::retireTiles()
+{
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        if (it->second.wanted) {
+            ++it;
+            continue;
+        }
+        it->second.mesh.destroy();
+        it = tiles.erase(it);
+    }
+    retiring = false;
+}
+
+int LodTerrain::draw(StreamBuffer& stream, const Frustum& frustum, const glm::dvec3& eye, bool indirect, int& quads)
+{
+    GpuHeap& heap = chunkMeshHeap();
+    int pages = heap.pageCount();
+    if (tiles.empty() || pages == 0)
+        return 0;
+
+    // Tile origin relative to the eye, and the cell size that scales its vertices
+    auto tileOffset = [&](const Tile& tile) {
+        int span = CHUNK_SIZE << tile.level;
+        glm::vec3 origin(glm::dvec3(tile.coord * span) - eye);
+        return glm::vec4(origin, (float)(1 << tile.level));
+    };
+    // Directions of the tile's mesh that can face the eye
+    auto facingMask = [&](const Tile& tile) {
+        glm::vec3 origin(tileOffset(tile));
+        return chunkFacingMask(origin, origin + glm::vec3((float)(CHUNK_SIZE << tile.level)));
+    };
+
+    // Built tiles in view, with their command count per heap page: one per
+    // range of facing directions
+    const Tile** visibleTiles = frameArena().allocArray<const Tile*>(tiles.size());
+    ChunkMeshRanges* ranges = frameArena().allocArray<ChunkMeshRanges>(tiles.size());
+    int* pageStart = frameArena().allocArray<int>(pages + 1);
+    memset(pageStart, 0, (pages + 1) * sizeof(int));
+    int visibleCount = 0;
+    for (const auto& entry : tiles) {
+        const Tile& tile = entry.second;
+        if (tile.mesh.vertexCount == 0)
+            continue;
+        int span = CHUNK_SIZE << tile.level;
+        glm::vec3 boxMin = glm::vec3(tile.coord * span);
+        if (!frustum.intersectsAABB(boxMin, boxMin + glm::vec3((float)span)))
+            continue;
+        int v = visibleCount++;
+        visibleTiles[v] = &tile;
+        tile.mesh.facingRanges(facingMask(tile), ranges[v]);
+        pageStart[tile.mesh.page() + 1] += ranges[v].count;
+    }
+    if (visibleCount == 0)
+        return 0;
+
+    if (!indirect) {
+        int boundPage = -1;
+        for (int v = 0; v < visibleCount; v++) {
+            const Tile& tile = *visibleTiles[v];
+            int page = tile.mesh.page();
+            if (page != boundPage) {
+                heap.bind(page);
+                boundPage = page;
+            }
+            glm::vec4 offset = tileOffset(tile);
+            glVertexAttrib4f(1, offset.x, offset.y, offset.z, offset.w);
+            quads += tile.mesh.draw(facingMask(tile));
+        }
+        return visibleCount;
+    }
+
+    // One command per range, bucketed by page; its base instance selects the offset
+    int* cursor = frameArena().allocArray<int>(pages);
+    for (int p = 0; p < pages; p++) {
+        pageStart[p + 1] += pageStart[p];
+        cursor[p] = pageStart[p];
+    }
+    int total = pageStart[pages];
+    if (total == 0)
+        return 0;
+    DrawElementsIndirectCommand* commands = frameArena().allocArray<DrawElementsIndirectCommand>(total);
+    glm::vec4* offsets = frameArena().allocArray<glm::vec4>(total);
+    for (int v = 0; v < visibleCount; v++) {
+        const Tile& tile = *visibleTiles[v];
+        for (int r = 0; r < ranges[v].count; r++) {
+            int slot = cursor[tile.mesh.page()]++;
+            commands[slot].count = ranges[v].quads[r] * 6;
+            commands[slot].instanceCount = 1;
+            commands[slot].firstIndex = 0;
+            commands[slot].baseVertex = (GLint)(tile.mesh.baseVertex() + ranges[v].first[r] * 4);
+            commands[slot].baseInstance = slot;
+            offsets[slot] = tileOffset(tile);
+            quads += ranges[v].quads[r];
+        }
+    }
+
+    size_t commandOffset = stream.write(commands, total * sizeof(DrawElementsIndirectCommand), 4);
+    size_t originOffset = stream.write(offsets, total * sizeof(glm::vec4), 4);
+    if (commandOffset == StreamBuffer::STREAM_FULL || originOffset == StreamBuffer::STREAM_FULL)
+        return 0;
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer);
+
+    int draws = 0;
+    for (int p = 0; p < pages; p++) {
+        int count = pageStart[p + 1] - pageStart[p];
+        if (count == 0)
+            continue;
+        heap.bind(p);
+        bindChunkDrawOffsets(stream.buffer, originOffset, 4);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+            (void*)(commandOffset + pageStart[p] * sizeof(DrawElementsIndirectCommand)), count, 0);
+        draws++;
+    }
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return draws;
+}
+
+void LodTerrain::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        requests.clear();
+    }
+    for (auto& entry : tiles)
+        entry.second.mesh.destroy();
+    tiles.clear();
+    inner = -1;
+    outer = -1;
+    missingTiles = 0;
+    retiring = false;
+}
+
+void LodTerrain::buildNext()
+{
+    PROFILE_ZONE("Build LOD tile");
+    Request request;
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        if (requests.empty())
+            return; // Dropped by update() or stop()
+
+        request = requests.back();
+        requests.pop_back();
+    }
+
+    std::unique_ptr<ChunkVoxels> voxels(new ChunkVoxels());
+    buildLodVoxels(request.level, request.coord, seed, *voxels);
+
+    Result* result = new Result();
+    result->key = request.key;
+    result->quadCount = meshChunk(*voxels, meshMode, result->vertices);
+    results.push(result);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_mesh.h"
+#include "frustum.h"
+#include "job_system.h"
+#include "mpsc_queue.h"
+#include "stream_buffer.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Coarsest level of detail: tiles of 8x8x8 chunks, one cell per 8^3 blocks
+const int LOD_LEVELS = 3;
+
+// How the horizon beyond the streamed chunks is drawn
+enum FarFieldMode {
+    FAR_FIELD_LOD,          // LodTerrain tiles, every frame
+    FAR_FIELD_RAYMARCH,     // RaymarchTerrain's coarse grid, ray marched per pixel
+    FAR_FIELD_IMPOSTOR,     // LOD tiles captured into HorizonImpostor's cube map a few faces at a time
+    FAR_FIELD_MODE_COUNT
+};
+extern const char* FAR_FIELD_NAMES[FAR_FIELD_MODE_COUNT];   // As --far-field and benchmark scripts spell them
+
+// Cells of a level-'level' tile: CHUNK_SIZE^3 of (2^level)^3 blocks each,
+// every one holding the representative block of its cube (the level cut of
+// a SparseVoxelOctree built for the tile). The border is air, so the mesher
+// closes the tile's sides with walls down to its bottom: these are the
+// skirts that hide cracks where a tile meets one of another level.
+void buildLodVoxels(int level, const glm::ivec3& tile, uint32_t seed, ChunkVoxels& out);
+
+// Terrain beyond the streamed chunks, drawn as LOD tiles. A tile of level L
+// (1..LOD_LEVELS) covers 2^L chunks along each axis and is meshed like one
+// chunk, so a tile costs about what a chunk does whatever its level. Tiles
+// are picked like a quadtree around the streaming centre: a tile splits
+// into the four of the next finer level while it is within
+// innerRadius * 2^(L-1) columns, so level 1 starts at the render distance
+// and each further level at twice the distance of the one before. Level 1
+// tiles overlap the streamed circle of chunks; the LOD shader discards
+// their fragments over columns that are streamed.
+//
+// Tiles are built on job system workers (octree, cells, mesh) and uploaded
+// on the GL thread. When the wanted set changes, tiles that left it are kept
+// and drawn until every new tile is built, so a level change never opens a
+// hole in the horizon.
+struct LodTerrain {
+    uint32_t seed = 0;
+    MeshMode meshMode = MESH_GREEDY;
+
+    // Build tiles on 'jobs'
+    void start(JobSystem& jobs);
+    // Drop queued tiles and wait for running builds
+    void stop();
+
+    // Choose the tiles for chunks streamed within 'innerRadius' columns of
+    // 'centerColumn' and a horizon of 'outerRadius' columns, queueing the
+    // missing ones nearest first. Cheap when neither changed.
+    void update(const glm::ivec2& centerColumn, int innerRadius, int outerRadius);
+    // Upload finished tiles until 'budgetBytes' of vertex data has been sent
+    // (the last one may overshoot). Returns the number uploaded.
+    int uploadMeshes(size_t budgetBytes);
+    // Draw the built tiles inside 'frustum', the LOD program bound. With
+    // 'indirect' (initChunkMeshes(true)) one glMultiDrawElementsIndirect per
+    // heap page, commands and offsets written into 'stream'; otherwise one
+    // draw per tile. Adds the quads drawn to 'quads' and returns the draws.
+    int draw(StreamBuffer& stream, const Frustum& frustum, const glm::dvec3& eye, bool indirect, int& quads);
+
+    // Wanted tiles not built yet (any thread)
+    int pendingCount() const { return missingTiles.load(std::memory_order_relaxed); }
+    int tileCount() const { return (int)tiles.size(); }
+
+    // Release every tile's GPU data
+    void destroy();
+
+    ~LodTerrain() { stop(); }
+
+private:
+    struct Tile {
+        int level;
+        glm::ivec3 coord;   // In tiles of its level
+        ChunkMesh mesh;
+        bool built = false;
+        bool wanted = true;
+    };
+    struct Request {
+        uint64_t key;
+        int level;
+        glm::ivec3 coord;
+        int distance;       // Columns from the streaming centre; nearest are built first
+    };
+    struct Result {
+        uint64_t key;
+        ChunkVertexBuffer vertices;
+        int quadCount;
+    };
+
+    // Append the tiles wanted under 'tile' of 'level' (x, z) to 'wanted'
+    void selectTiles(int level, const glm::ivec2& tile, std::vector<Request>& wanted) const;
+    int tileDistance(int level, const glm::ivec2& tile) const;
+    // Free the tiles that left the wanted set once nothing is missing
+    void retireTiles();
+    // Job body: build the nearest queued tile
+    void buildNext();
+
+    JobSystem* jobSystem = nullptr;
+    JobCounter activeJobs;
+    std::mutex requestMutex;            // Guards requests
+    std::vector<Request> requests;      // Farthest first, built from the back
+
+    MPSCQueue<Result*> results;         // Pushed by workers, drained on the GL thread
+    std::deque<Result*> finished;
+
+    std::unordered_map<uint64_t, Tile> tiles;
+    glm::ivec2 center = glm::ivec2(0);
+    int inner = -1;
+    int outer = -1;
+    std::atomic<int> missingTiles{ 0 };
+    bool retiring = false;              // Some tiles have left the wanted set
+};
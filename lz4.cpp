@@ -0,0 +1,148 @@
+#include "lz4.h"
+
+#include <algorithm>
+#include <cstring>
+
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;     // The block ends with at least this many literals
+const size_t MATCH_FIND_LIMIT = 12; // ... and no match starts in its last 12 bytes
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 12;
+
+static uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hashSequence(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Length bytes following a token nibble of 15
+static uint8_t* writeLength(uint8_t* out, size_t length)
+{
+    for (length -= 15; length >= 255; length -= 255)
+        *out++ = 255;
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+static uint8_t* writeSequence(uint8_t* out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+    uint8_t* token = out++;
+    *token = (uint8_t)(std::min<size_t>(literalCount, 15) << 4);
+    if (literalCount >= 15)
+        out = writeLength(out, literalCount);
+    memcpy(out, literals, literalCount);
+    out += literalCount;
+    if (matchLength == 0)
+        return out; // Last sequence: literals only
+
+    *out++ = (uint8_t)(offset & 0xFF);
+    *out++ = (uint8_t)(offset >> 8);
+    size_t extra = matchLength - MIN_MATCH;
+    *token |= (uint8_t)std::min<size_t>(extra, 15);
+    if (extra >= 15)
+        out = writeLength(out, extra);
+    return out;
+}
+
+size_t lz4Compress(const uint8_t* src, size_t srcSize, uint8_t* dst)
+{
+    uint8_t* out = dst;
+    size_t anchor = 0;
+
+    if (srcSize > MATCH_FIND_LIMIT) {
+        // Last position each hashed 4-byte sequence was seen at
+        uint32_t table[1 << HASH_BITS];
+        memset(table, 0, sizeof(table));
+
+        size_t findLimit = srcSize - MATCH_FIND_LIMIT;
+        size_t matchLimit = srcSize - LAST_LITERALS;
+        size_t p = 1;
+        while (p < findLimit) {
+            uint32_t sequence = read32(src + p);
+            uint32_t h = hashSequence(sequence);
+            size_t candidate = table[h];
+            table[h] = (uint32_t)p;
+            if (p - candidate > MAX_OFFSET || read32(src + candidate) != sequence) {
+                p++;
+                continue;
+            }
+
+            size_t length = MIN_MATCH;
+            while (p + length < matchLimit && src[candidate + length] == src[p + length])
+                length++;
+            out = writeSequence(out, src + anchor, p - anchor, p - candidate, length);
+            p += length;
+            anchor = p;
+        }
+    }
+
+    out = writeSequence(out, src + anchor, srcSize - anchor, 0, 0);
+    return (size_t)(out - dst);
+}
+
+// Add the length bytes following a token nibble of 15; false past the end
+static bool readLength(const uint8_t*& in, const uint8_t* inEnd, size_t& length)
+{
+    uint8_t b;
+    do {
+        if (in >= inEnd)
+            return false;
+        b = *in++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+    const uint8_t* in = src;
+    const uint8_t* inEnd = src + srcSize;
+    uint8_t* out = dst;
+    uint8_t* outEnd = dst + dstSize;
+
+    while (in < inEnd) {
+        uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(in, inEnd, literals))
+            return false;
+        if ((size_t)(inEnd - in) < literals || (size_t)(outEnd - out) < literals)
+            return false;
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+        if (in == inEnd)
+            break; // The last sequence has no match
+
+        if (inEnd - in < 2)
+            return false;
+        size_t offset = in[0] | ((size_t)in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > (size_t)(out - dst))
+            return false;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(in, inEnd, length))
+            return false;
+        length += MIN_MATCH;
+        if ((size_t)(outEnd - out) < length)
+            return false;
+
+        // A match closer than its length overlaps the bytes it produces
+        // (runs): those are copied byte by byte
+        const uint8_t* match = out - offset;
+        if (offset >= length) {
+            memcpy(out, match, length);
+        }
+        else {
+            for (size_t i = 0; i < length; i++)
+                out[i] = match[i];
+        }
+        out += length;
+    }
+    return out == outEnd;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LZ4 block format, compatible with the reference encoder and decoder:
+// sequences of literals plus a match (2-byte offset back into the output,
+// length of at least 4). The compressor is greedy with one hash probe per
+// position, which is what chunk payloads need: they are small, and most of
+// their redundancy is long runs that any match finder catches.
+
+// Largest possible compressed size of 'size' input bytes
+inline size_t lz4CompressBound(size_t size) { return size + size / 255 + 16; }
+
+// Compress 'src' into 'dst', which must hold lz4CompressBound(srcSize)
+// bytes. Returns the compressed size.
+size_t lz4Compress(const uint8_t* src, size_t srcSize, uint8_t* dst);
+
+// Decompress into exactly 'dstSize' bytes. False if the input is malformed,
+// reaches outside either buffer, or doesn't produce dstSize bytes.
+bool lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
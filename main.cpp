@@ -2,23 +2,169 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
-
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <map>
 #include <string>
-
-// Window dimensions
+#include <thread>
+#include <vector>
+
+#include "async_chain.h"
+#include "block_instancing.h"
+#include "benchmark.h"
+#include "benchmark_compare.h"
+#include "block_outline.h"
+#include "block_textures.h"
+#include "chunk.h"
+#include "chunk_client.h"
+#include "chunk_generator.h"
+#include "chunk_mesh.h"
+#include "chunk_mesher.h"
+#include "chunk_overlay.h"
+#include "chunk_renderer.h"
+#include "cloud_layer.h"
+#include "clustered_lights.h"
+#include "console.h"
+#include "cvars.h"
+#include "dynamic_resolution.h"
+#include "entity_broadphase.h"
+#include "entity_renderer.h"
+#include "entity_store.h"
+#include "entity_systems.h"
+#include "fixed_timestep.h"
+#include "frame_capture.h"
+#include "frame_packet.h"
+#include "frame_pacing.h"
+#include "frame_stats.h"
+#include "frame_arena.h"
+#include "foliage_renderer.h"
+#include "frustum.h"
+#include "fxaa_pass.h"
+#include "generation_cache.h"
+#include "gl_debug.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "gpu_particles.h"
+#include "occupancy_volume.h"
+#include "glyph_atlas.h"
+#include "gpu_culling.h"
+#include "gpu_mesher.h"
+#include "gpu_profiler.h"
+#include "gpu_upload_thread.h"
+#include "hardware_tier.h"
+#include "horizon_culling.h"
+#include "horizon_impostor.h"
+#include "input_map.h"
+#include "input_recording.h"
+#include "hiz_buffer.h"
+#include "hiz_readback.h"
+#include "job_system.h"
+#include "kernel_benchmarks.h"
+#include "light_engine.h"
+#include "lod_terrain.h"
+#include "mesh_cache.h"
+#include "minimap.h"
+#include "metrics_exporter.h"
+#include "navigation_graph.h"
+#include "net_protocol.h"
+#include "occlusion_queries.h"
+#include "offscreen_target.h"
+#include "player_controller.h"
+#include "procedural_sky.h"
+#include "profiler.h"
+#include "profiler_view.h"
+#include "raymarch_terrain.h"
+#include "region_file.h"
+#include "schematic_file.h"
+#include "session_resume.h"
+#include "render_device.h"
+#include "render_queue.h"
+#include "shader.h"
+#include "shadow_cascades.h"
+#include "startup_timeline.h"
+#include "stream_buffer.h"
+#include "temporal_upscaler.h"
+#include "text_batch.h"
+#include "thread_priority.h"
+#include "voxel_raycast.h"
+#include "weighted_oit.h"
+#include "world.h"
+#include "world_simulation.h"
+
+// Initial window dimensions; the framebuffer size is read every frame
 const unsigned int WIDTH = 800;
 const unsigned int HEIGHT = 600;
+// Window placement before going fullscreen, restored when leaving it
+int windowedX = 100, windowedY = 100;
+int windowedWidth = WIDTH, windowedHeight = HEIGHT;
+
+// Uniform buffer binding points
+const unsigned int PALETTE_BINDING = 0;
+const unsigned int CAMERA_BINDING = 1;
+const unsigned int SHADOW_BINDING = 2;
+// Entries of the palette block (blockColors[] in the shaders): every material a vertex can name
+const int PALETTE_SIZE = 16;
+static_assert(BLOCK_TYPE_COUNT <= PALETTE_SIZE, "the palette holds every block type");
+
+// Features the chunk shading programs are specialised by, one variant per
+// combination (ProgramPermutations), and the define each is compiled with
+enum ChunkShaderFeature {
+    CHUNK_FEATURE_FOG = 1 << 0,
+    CHUNK_FEATURE_SHADOWS = 1 << 1,
+    CHUNK_FEATURE_POINT_LIGHTS = 1 << 2,
+};
+const int CHUNK_FEATURE_COUNT = 3;
+const char* const CHUNK_FEATURE_DEFINES[CHUNK_FEATURE_COUNT] = { "CHUNK_FOG", "CHUNK_SHADOWS", "CHUNK_POINT_LIGHTS" };
+
+// Texture units of the shadow cascades and block textures, bound for good (unit 0
+// is left to passes that bind textures while they run)
+const int SHADOW_TEXTURE_UNIT = 1;
+const int BLOCK_TEXTURE_UNIT = 2;
+// First of the two units the OIT composite samples through, bound only while it runs
+const int OIT_TEXTURE_UNIT = 3;
+// Coarse grid of the ray-marched far field
+const int FAR_FIELD_TEXTURE_UNIT = 5;
+// First of the three texture buffers of the clustered point lights, bound for good
+const int LIGHT_TEXTURE_UNIT = 6;
+// First of the units the passes that show the scene (temporal upscaler, FXAA) sample
+// through, bound only while they run
+const int PRESENT_TEXTURE_UNIT = 9;
+// The HUD font's atlas, bound for good so text draws without a texture bind
+const int GLYPH_TEXTURE_UNIT = 12;
+// Block flags around the camera (occupancy volume), bound for good
+const int OCCUPANCY_TEXTURE_UNIT = 13;
+// Minimap tiles, sampled by the HUD's image quads, bound for good
+const int MINIMAP_TEXTURE_UNIT = 14;
+// The cloud layer's textures, bound only while it and the sky draw
+const int CLOUD_TEXTURE_UNIT = 15;
+// Particle ring size, and the debris burst of a broken block
+const int PARTICLE_CAPACITY = 65536;
+const int DEBRIS_PARTICLES = 24;
+
+// Per-frame camera block, laid out to match the std140 Camera block in the shaders.
+// The matrices are camera-relative: the eye sits at the origin and chunk
+// offsets are given relative to it, so large world coordinates never reach
+// the GPU as floats.
+struct CameraUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProj;
+    glm::vec4 cameraPos;    // World-space eye position, w unused
+    glm::vec4 fog;          // Colour, and the distance from the eye where it is complete (0 = no fog)
+    // Stereo chunk passes (views.x 2): each eye's viewProj, the instance's
+    // low bit picking the eye and its half of the target
+    glm::mat4 eyeViewProj[2] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+    glm::vec4 views = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+};
 
 // Camera settings
-glm::vec3 cameraPos = glm::vec3(0.0f, 16.0f, 48.0f);
+glm::vec3 cameraPos = glm::vec3(0.0f, 64.0f, 48.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, -0.2f, -1.0f);
 glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
 
@@ -33,43 +179,579 @@ float fov = 45.0f;
 
 bool firstMouse = true;
 
+// Keyboard and mouse bindings, updated by the GLFW callbacks
+InputMap input;
+
+// Simulation runs at a fixed rate, rendering at whatever rate the GPU allows
+const double SIMULATION_RATE = 60.0;    // Ticks per second
+PlayerController player;
+PlayerInput playerInput;                // Sampled by processInput each frame
+
+// Chunk meshing
+MeshMode meshMode = MESH_GREEDY;
+bool useInstancing = false; // Draw instanced cubes instead of chunk meshes
+bool remeshAll = false; // Set when the mesh builder or renderer changes
+bool useGpuCulling = true;  // Cull and build draw commands in a compute pass when supported
+bool useOcclusionCulling = true;    // Also test chunks against last frame's Hi-Z pyramid (GPU culling only)
+bool useEntityOcclusion = true;     // Leave out entities and debris hidden in a Hi-Z readback (occlusion culling only)
+bool useVisibilityCulling = true;   // Walk the chunk face connectivity graph (CPU culling only)
+bool useHorizonCulling = true;      // Drop chunks under the terrain's occlusion horizon (CPU culling only)
+bool useDepthPrePass = false;       // Depth-only pass first, then shade with GL_EQUAL depth
+bool useOcclusionQueries = false;   // Per-chunk draws under hardware occlusion queries (default without GPU culling)
+bool useShadows = true;             // H key: sun shadows from cascaded shadow maps
+bool useDynamicResolution = true;   // R key: scale the scene's resolution to hold the GPU frame budget
+bool useTemporalUpscale = true;     // U key: reconstruct a scaled scene from jittered frames (with a Hi-Z target)
+bool useFxaa = false;               // X key / --fxaa: post-process anti-aliasing when the scene is shown
+bool useWeightedOit = false;        // T key / --oit: weighted blended OIT for translucent blocks instead of sorting
+bool useVertexPulling = true;       // --no-pulling: chunk vertices through attribute 0 even on GL 4.3
+bool useFaceRecords = false;        // --mesh-format faces: one record per quad instead of four vertices (pulling only)
+bool useGpuMesher = false;          // --mesher gpu: mesh opaque-only chunks in a compute shader (culled meshes)
+int uploadThreadMode = -1;          // --upload-thread on|off|auto: mesh uploads from a shared context's thread (-1: discrete GPUs)
+float stereoSeparation = 0.0f;      // --stereo <blocks>: two views side by side, this far apart, chunks drawn once for both (0 = one view)
+Weather weather = WEATHER_CLEAR;    // K key / --weather: rain or snow particles around the eye
+bool useOccupancyVolume = true;     // Mirror nearby blocks into a 3D texture; particles collide with it
+bool useClouds = true;              // Drifting cloud layer over the sky, at a quarter of the scene's resolution
+bool useFoliage = true;             // Grass tufts and flowers over grass blocks near the eye
+float foliageRadius = 48.0f;        // Blocks from the eye that ground cover is drawn to, thinning out towards it
+bool wireframe = false;             // Held F key
+bool showOverdraw = false;          // F6: chunk overdraw heatmap in place of the shaded scene
+ChunkOverlayMode chunkOverlayMode = CHUNK_OVERLAY_OFF;  // F7: tint chunks by build time, vertices or cull outcome
+bool showStats = true;              // F2: frame stats overlay in the HUD
+bool showMinimap = true;            // F8: top-down map of the terrain around the camera in the HUD
+bool statsInTitle = false;          // --title-stats: also write them to the window title (slow on Windows)
+bool showProfiler = false;          // F3: timeline of the last frame's profiler zones, GPU pass times and statistics
+const char* TRACE_PATH = "trace.json";  // F4 writes the recorded zones here for chrome://tracing
+bool screenshotRequested = false;   // F12: the next frame shown, saved as a QOI file
+bool capturingVideo = false;        // F9 / --capture <file>: every frame shown into a raw video file
+const char* capturePath = "capture.rgb";
+
+// Job system workers (--workers <n>, 0 = one per logical processor besides
+// the main and render threads; --worker-priority low|normal|high;
+// --pin-workers). The render thread asks for a raised priority and the
+// chunk I/O thread runs low, so background work doesn't preempt a frame.
+int workerThreads = 0;
+ThreadPriority workerPriority = THREAD_NORMAL_PRIORITY;
+bool pinWorkers = false;
+
+// World streaming
+int renderDistance = 6;                 // Radius in chunk columns around the camera
+int chunkLoadsPerTick = 32;             // Generated chunks picked up per simulation tick at most
+int meshUploadKB = 1024;                // Async mesh vertex data uploaded per frame
+int meshSubmitsPerFrame = 256;          // Chunk snapshots handed to the mesher per frame
+const int MESH_HEAP_MOVES_PER_FRAME = 4;    // Mesh ranges compacted within the vertex heap per frame
+
+// Sun and its shadows. The cascades reach the render distance, within limits.
+glm::vec3 sunDirection = glm::normalize(glm::vec3(0.4f, 0.85f, 0.35f));    // Towards the sun
+const int SHADOW_MAP_RESOLUTION = 1024;     // Texels along each cascade
+const float MIN_SHADOW_DISTANCE = 64.0f;    // Blocks
+const float MAX_SHADOW_DISTANCE = 256.0f;
+
+// Dynamic resolution: the scene is rendered at MIN_RESOLUTION_SCALE to 100%
+// of each framebuffer side so the GPU frame time stays within the budget
+// (--frame-ms), and scaled up before the HUD is drawn at full resolution.
+// Benchmarks always render at full resolution.
+float frameBudgetMs = 15.0f;
+const float MIN_RESOLUTION_SCALE = 0.5f;
+
+// Frame pacing (--present uncapped|vsync|adaptive|limit, --fps <n>,
+// --queued-frames <n>; F5 cycles the present mode). The limiter waits
+// before input is sampled, and at most maxQueuedFrames swaps may be queued
+// for the GPU, both for lower input latency. Benchmarks are uncapped with
+// the driver's queue.
+PresentMode presentMode = PRESENT_VSYNC;
+double frameLimitFps = 60.0;
+int maxQueuedFrames = 1;
+
+// Background throttling: while the window is unfocused frames are capped at
+// backgroundFps (--background-fps <n>, 0 = uncapped); while it is minimised
+// nothing is drawn and the loop runs at MINIMISED_FPS, which keeps chunk
+// streaming, meshing and autosaves going. Never during warm-up or benchmarks.
+double backgroundFps = 15.0;
+const double MINIMISED_FPS = 5.0;
+
+// Late latching (off with --no-late-latch or in benchmarks): the render
+// thread turns each frame's view to the newest mouse look just before its
+// camera block is written, by up to the margin the culling frustum is
+// widened by. Mouse motion is raw (unaccelerated) where supported.
+bool useLateLatch = true;
+const float LATE_LATCH_MARGIN_DEGREES = 4.0f;
+LookLatch lookLatch;
+
+// Most anisotropic filtering for block textures (1 = off), within what the driver allows
+const float MATERIAL_ANISOTROPY = 8.0f;
+// Pre-compressed block textures (KTX2, BC1/BC3/BC7, a layer per block type); generated when missing
+const char* BLOCK_TEXTURE_PATH = "textures/blocks.ktx2";
+
+// Distant terrain: LOD tiles from the render distance out to the horizon
+bool useLod = true;                     // L key
+int lodDistance = 128;                  // Horizon radius in chunk columns
+FarFieldMode farField = FAR_FIELD_LOD;  // --far-field: LOD tiles, ray marched through a coarse grid, or captured into a cube map
+int lodUploadKB = 512;                  // LOD tile data uploaded per frame
+const float DEFAULT_FAR_PLANE = 500.0f;    // Far plane without LOD
+
+// Hiding the edge of the streamed world: fog thickening towards the render
+// distance (the LOD horizon when it is on), and newly uploaded chunks
+// dithered in instead of popping
+bool useFog = true;                     // --no-fog: neither
+bool usePointLights = true;             // --no-point-lights: lamps light only through the flood-filled block light
+const float CHUNK_FADE_SECONDS = 0.6f;
+
+// Scripted-camera benchmark (--benchmark <file>): input is ignored and the
+// camera follows the script's path, one simulation tick per frame
+bool benchmarkMode = false;
+BenchmarkScript benchmarkScript;
+const double BENCHMARK_MAX_WARMUP_SECONDS = 30.0;
+// --runs <n>: fly the path n times, settling at its start before each, so
+// reports carry the spread between runs; --compare <baseline> <candidate>
+// checks two reports for regressions beyond --threshold <percent>
+int benchmarkRuns = 1;
+const double DEFAULT_COMPARE_THRESHOLD_PERCENT = 5.0;
+// Session recording (--record <file>): the input callbacks and frame times
+// from the moment the window is shown, with where the session started.
+// Replay (--replay <file>) starts from there once its own warm-up has
+// settled and feeds the recording to the callbacks and the simulation in
+// place of live input, then writes the profiler trace and exits; the world
+// is generated from the recorded seed unless --world is given. Replay with
+// the flags the session was recorded with.
+InputRecorder inputRecorder;
+InputReplay inputReplay;
+bool replayMode = false;
+// --headless: the window stays hidden and frames go to an offscreen target
+// of a fixed size, so results don't depend on the desktop or the display
+bool headless = false;
+const int BENCHMARK_WIDTH = 1920;
+const int BENCHMARK_HEIGHT = 1080;
+// The Benchmark project builds this file with HEADLESS_BENCHMARK: it runs
+// the default path headless unless told otherwise
+const char* DEFAULT_BENCHMARK_PATH = "benchmarks/flythrough.txt";
+
+// Driver debug messages (--gl-debug, always on in debug builds): a debug
+// context reports errors and performance warnings to GLDebugOutput, which
+// logs them and marks them in the profiler. Release builds ask for a plain
+// context, which reports nothing.
+#ifdef _DEBUG
+bool glDebug = true;
+#else
+bool glDebug = false;
+#endif
+GLDebugOutput glDebugOutput;
+
+// Start-up: the window is shown (and a benchmark starts its path) once the
+// initial view has streamed in, been lit, meshed and uploaded, and the
+// chunk programs have linked: WARMUP_SETTLE_FRAMES frames in a row without
+// any of that work left, or after warmupSeconds (--warmup <s>, 0 = show at
+// once). The phases are timed from the top of main() and printed once the
+// first frame is shown.
+const int WARMUP_SETTLE_FRAMES = 60;
+double warmupSeconds = 10.0;
+StartupTimeline startupTimeline;
+// A start that resumes the world's last session (session_resume.h, off
+// with --no-resume) puts the camera back, has the chunks that were in view
+// loaded first and shows the window once those are on the GPU; the count
+// the warm-up reads lags two packets, so a couple of frames settle it.
+const int RESUME_SETTLE_FRAMES = 2;
+bool resumeSession = true;
+
+// Saved chunks (--world <directory>). Benchmarks generate everything
+// unless a directory is given, so their runs stay comparable.
+const char* DEFAULT_WORLD_DIR = "world";
+// Changed chunks are also saved every this many seconds (--autosave <s>, 0 = off),
+// snapshotted on the main thread and written by the generator's I/O thread
+double autosaveSeconds = 60.0;
+
+// Memory budgets (--voxel-mb, --mesh-mb, --gpu-mb, --gen-cache-mb; 0 = no
+// limit, or no cache), sized so a 4 GB machine with an integrated GPU never
+// runs out however far one flies: loaded voxels (the streaming radius
+// shrinks while over), snapshots and meshes waiting for upload (meshing
+// waits), chunk meshes in the vertex heap (meshes out of view are dropped,
+// least recently seen first) and compressed generated chunks kept for
+// coming back to them (least recently used dropped)
+size_t voxelBudgetMB = 256;
+size_t meshBudgetMB = 64;
+size_t gpuMeshBudgetMB = 256;
+size_t generationCacheMB = 64;
+// Loaded chunks whose voxels nothing read for --cold-after seconds (0 =
+// never) are kept LZ4-compressed until something does, this many more a
+// tick at most
+double coldChunkSeconds = 30.0;
+const int COLD_CHUNKS_PER_TICK = 16;
+// Schematics (console "export" and "import") stream this many blocks' worth
+// of cells a tick
+const int SCHEMATIC_BLOCKS_PER_TICK = 16 * CHUNK_VOLUME;
+
+// Multiplayer: --connect <host[:port]> plays on a dedicated server (the
+// Server project) instead of a local world
+const char* connectAddress = nullptr;
+ChunkClient chunkClient;
+
+// Metrics for remote monitoring (--metrics-file <path>, --metrics-statsd
+// <host[:port]>, every --metrics-interval <s>): frame times, memory per
+// subsystem, streaming queues and GL errors, published by the main thread
+// and written out by the exporter's own thread
+MetricsExporter metricsExporter;
+
+// Runtime configuration: the knobs above registered by name as cvars
+// (registerCVars), read from the config file (--config <file>, or
+// DEFAULT_CONFIG_PATH when it exists), then overridden by the flags and by
+// --set <name> <value> in command-line order. The console (grave accent)
+// changes live ones in game and saves them all back with "save".
+CVarRegistry cvars;
+Console console;
+const char* DEFAULT_CONFIG_PATH = "settings.cfg";
+// Quality tier (--quality auto|low|medium|high|ultra): cvar defaults picked
+// once the context is up, from the GL features, video memory and cores;
+// whatever the config file or the flags set stays. Not in benchmarks,
+// which keep the built-in defaults so runs compare across machines, or in
+// replays, which run with what was recorded.
+QualityTier qualityTier = QUALITY_AUTO;
+
+// Block editing
+const float PICK_DISTANCE = 8.0f;       // Reach of the crosshair in blocks
+// Placed with the right mouse button, cycled through PLACEABLE_BLOCKS
+const BlockId PLACEABLE_BLOCKS[] = { BLOCK_DIRT, BLOCK_STONE, BLOCK_GRASS, BLOCK_LAMP, BLOCK_WATER, BLOCK_GLASS };
+const char* PLACEABLE_NAMES[] = { "dirt", "stone", "grass", "lamp", "water", "glass" };
+const int PLACEABLE_COUNT = 6;
+int placeIndex = 0;
+
 // Function prototypes
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
+void processBlockEdits(World& world, EntityStore& entities, std::vector<ParticleEmitter>& particles, const RayHit* pick,
+    const PlayerController& player);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void char_callback(GLFWwindow* window, unsigned int codepoint);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-unsigned int compileShader(unsigned int type, const char* source);
-double statsTracker(GLFWwindow* window, int* totalBlocks);
-void RenderText(unsigned int shader, std::string text, float x, float y, float scale, glm::vec3 color);
-bool isChunkInViewFrustum(const glm::vec3& chunkPos, const glm::mat4& view, const glm::mat4& projection, float chunkSize);
-
-// Struct for character glyphs
-struct Character {
-    GLuint     TextureID;  // ID handle of the glyph texture
-    glm::ivec2 Size;       // Size of glyph
-    glm::ivec2 Bearing;    // Offset from baseline to left/top of glyph
-    GLuint     Advance;    // Offset to advance to next glyph
-};
-
-// Map to store characters
-std::map<GLchar, Character> Characters;
-
-// VAO and VBO for text rendering
-GLuint textVAO, textVBO;
+double statsTracker(GLFWwindow* window, FramePacket& frame);
+FrameCounters packetCounters(const FramePacket& frame);
+glm::vec3 lookDirection(float yaw, float pitch);
+InputSessionStart captureSession(uint32_t seed, const FixedTimestep& simulation);
+void restoreSession(const InputSessionStart& start, FixedTimestep& simulation);
+void replayInputEvent(GLFWwindow* window, const InputEvent& event);
+void registerCVars();
+// Frame times and counters of recent frames, fed by statsTracker()
+FrameStats frameStats;
+// Allocations per memory tag and frame, also fed by statsTracker()
+MemoryFrameCounter memoryFrames;
+void RenderText(const char* text, float x, float y, float scale, glm::vec3 color);
+int cullChunks(ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye, bool visibilityCulling);
+
+// Every glyph of the HUD font in one texture. As a distance field one
+// small atlas stays sharp at every text size.
+GlyphAtlas glyphAtlas;
+const char* FONT_PATH = "C:/Windows/Fonts/arial.ttf";
+const int FONT_PIXEL_HEIGHT = 32;
+const GlyphMode FONT_MODE = GLYPH_SDF;
+
+// Every RenderText call of a frame, drawn at once
+TextBatch textBatch;
+ProfilerView profilerView;
+GpuProfiler gpuProfiler;    // GPU milliseconds per pass, shown in the HUD
+
+// Per-frame streamed data (draw commands)
+StreamBuffer frameStream;
+const size_t FRAME_STREAM_BYTES = 8 * 1024 * 1024; // Per frame in flight
+// Mesh uploads on a context of their own, instead of the staging ring
+GpuUploadThread uploadThread;
+
+int main(int argc, char** argv)
+{
+    startupTimeline.start();
+    const char* benchmarkPath = nullptr;
+    bool microBenchmarks = false;
+    const char* microReportPath = nullptr;
+    const char* compareBaseline = nullptr;
+    const char* compareCandidate = nullptr;
+    double compareThreshold = DEFAULT_COMPARE_THRESHOLD_PERCENT;
+    const char* worldDir = nullptr;
+    const char* recordPath = nullptr;
+
+    // The config file first, so the flags override it
+    registerCVars();
+    const char* configPath = nullptr;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0)
+            configPath = argv[i + 1];
+    }
+    if (configPath) {
+        if (!cvars.loadFile(configPath)) {
+            std::cout << "Config: can't open " << configPath << std::endl;
+            return 1;
+        }
+    }
+    else {
+        configPath = DEFAULT_CONFIG_PATH;
+        cvars.loadFile(configPath);
+    }
 
-// VAOs, VBOs, and EBO for cubes
-unsigned int stoneVAO, stoneVBO;
-unsigned int dirtVAO, dirtVBO;
-unsigned int grassVAO, grassVBO;
-unsigned int EBO;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmarkPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--world") == 0 && i + 1 < argc) {
+            worldDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--autosave") == 0 && i + 1 < argc) {
+            autosaveSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmupSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-resume") == 0) {
+            resumeSession = false;
+        }
+        else if (strcmp(argv[i], "--gl-debug") == 0) {
+            glDebug = true;
+        }
+        else if (strcmp(argv[i], "--no-pulling") == 0) {
+            useVertexPulling = false;
+        }
+        else if (strcmp(argv[i], "--no-fog") == 0) {
+            useFog = false;
+        }
+        else if (strcmp(argv[i], "--no-point-lights") == 0) {
+            usePointLights = false;
+        }
+        else if (strcmp(argv[i], "--title-stats") == 0) {
+            statsInTitle = true;
+        }
+        else if (strcmp(argv[i], "--fxaa") == 0) {
+            useFxaa = true;
+        }
+        else if (strcmp(argv[i], "--mesh-format") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "faces") == 0)
+                useFaceRecords = true;
+            else if (strcmp(name, "vertices") == 0)
+                useFaceRecords = false;
+            else
+                std::cout << "Unknown mesh format '" << name << "', keeping vertices" << std::endl;
+        }
+        else if (strcmp(argv[i], "--mesher") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "gpu") == 0)
+                useGpuMesher = true;
+            else if (strcmp(name, "cpu") == 0)
+                useGpuMesher = false;
+            else
+                std::cout << "Unknown mesher '" << name << "', keeping cpu" << std::endl;
+        }
+        else if (strcmp(argv[i], "--upload-thread") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            uploadThreadMode = strcmp(mode, "on") == 0 ? 1 : strcmp(mode, "off") == 0 ? 0 : -1;
+        }
+        else if (strcmp(argv[i], "--far-field") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            int mode = 0;
+            while (mode < FAR_FIELD_MODE_COUNT && strcmp(name, FAR_FIELD_NAMES[mode]) != 0)
+                mode++;
+            if (mode < FAR_FIELD_MODE_COUNT)
+                farField = (FarFieldMode)mode;
+            else
+                std::cout << "Unknown far field '" << name << "', keeping " << FAR_FIELD_NAMES[farField] << std::endl;
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workerThreads = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--worker-priority") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            int priority = 0;
+            while (priority <= THREAD_HIGH_PRIORITY && strcmp(name, THREAD_PRIORITY_NAMES[priority]) != 0)
+                priority++;
+            if (priority <= THREAD_HIGH_PRIORITY)
+                workerPriority = (ThreadPriority)priority;
+            else
+                std::cout << "Unknown worker priority '" << name << "', keeping " << THREAD_PRIORITY_NAMES[workerPriority] << std::endl;
+        }
+        else if (strcmp(argv[i], "--pin-workers") == 0) {
+            pinWorkers = true;
+        }
+        else if (strcmp(argv[i], "--voxel-mb") == 0 && i + 1 < argc) {
+            voxelBudgetMB = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cold-after") == 0 && i + 1 < argc) {
+            coldChunkSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--mesh-mb") == 0 && i + 1 < argc) {
+            meshBudgetMB = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--gpu-mb") == 0 && i + 1 < argc) {
+            gpuMeshBudgetMB = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--gen-cache-mb") == 0 && i + 1 < argc) {
+            generationCacheMB = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frame-ms") == 0 && i + 1 < argc) {
+            frameBudgetMs = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            presentMode = strcmp(mode, "uncapped") == 0 ? PRESENT_UNCAPPED :
+                strcmp(mode, "adaptive") == 0 ? PRESENT_ADAPTIVE_VSYNC :
+                strcmp(mode, "limit") == 0 ? PRESENT_LIMITED : PRESENT_VSYNC;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            frameLimitFps = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--background-fps") == 0 && i + 1 < argc) {
+            backgroundFps = std::max(0.0, atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--no-late-latch") == 0) {
+            useLateLatch = false;
+        }
+        else if (strcmp(argv[i], "--queued-frames") == 0 && i + 1 < argc) {
+            maxQueuedFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--oit") == 0) {
+            useWeightedOit = true;
+        }
+        else if (strcmp(argv[i], "--stereo") == 0 && i + 1 < argc) {
+            stereoSeparation = std::max(0.0f, (float)atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--weather") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            weather = strcmp(name, "rain") == 0 ? WEATHER_RAIN : (strcmp(name, "snow") == 0 ? WEATHER_SNOW : WEATHER_CLEAR);
+        }
+        else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connectAddress = argv[++i];
+        }
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            benchmarkRuns = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            compareBaseline = argv[++i];
+            compareCandidate = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            compareThreshold = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            std::string error;
+            if (!inputReplay.load(argv[++i], error)) {
+                std::cout << "Replay: " << error << std::endl;
+                return 1;
+            }
+            replayMode = true;
+        }
+        else if (strcmp(argv[i], "--metrics-file") == 0 && i + 1 < argc) {
+            metricsExporter.filePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--metrics-statsd") == 0 && i + 1 < argc) {
+            metricsExporter.statsdAddress = argv[++i];
+        }
+        else if (strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            metricsExporter.intervalSeconds = std::max(1.0, atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capturePath = argv[++i];
+            capturingVideo = true;
+        }
+        else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            std::string error;
+            if (!cvars.set("quality", argv[++i], error))
+                std::cout << "--quality: " << error << std::endl;
+        }
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            i++;    // Already loaded
+        }
+        else if (strcmp(argv[i], "--set") == 0 && i + 2 < argc) {
+            std::string error;
+            if (!cvars.set(argv[i + 1], argv[i + 2], error))
+                std::cout << "--set: " << error << std::endl;
+            i += 2;
+        }
+        else if (strcmp(argv[i], "--micro") == 0) {
+            microBenchmarks = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                microReportPath = argv[++i];
+        }
+        else {
+            std::cout << "Usage: " << argv[0] << " [--benchmark <path file>] [--headless] [--world <directory>] [--autosave <seconds>] [--warmup <seconds>] [--no-resume] [--gl-debug] [--no-pulling] [--no-fog] [--no-point-lights] [--fxaa] [--title-stats] [--mesh-format vertices|faces] [--mesher cpu|gpu] [--upload-thread on|off|auto] [--far-field lod|raymarch|impostor] [--workers <n>] [--worker-priority low|normal|high] [--pin-workers] [--voxel-mb <n>] [--mesh-mb <n>] [--gpu-mb <n>] [--gen-cache-mb <n>] [--cold-after <seconds>] [--frame-ms <ms>] [--present uncapped|vsync|adaptive|limit] [--fps <n>] [--queued-frames <n>] [--background-fps <n>] [--no-late-latch] [--oit] [--stereo <separation>] [--weather clear|rain|snow] [--connect <host[:port]>] [--runs <n>] [--compare <baseline.json> <candidate.json>] [--threshold <percent>] [--record <file>] [--replay <file>] [--metrics-file <path>] [--metrics-statsd <host[:port]>] [--metrics-interval <seconds>] [--config <file>] [--set <cvar> <value>] [--quality auto|low|medium|high|ultra] [--capture <file>] [--micro [report.json]]" << std::endl;
+            return 1;
+        }
+    }
+#ifdef HEADLESS_BENCHMARK
+    if (!benchmarkPath && !microBenchmarks)
+        benchmarkPath = DEFAULT_BENCHMARK_PATH;
+    headless = true;
+#endif
+
+    // Two benchmark reports against each other; exits 1 on a regression
+    if (compareBaseline)
+        return compareBenchmarkReports(compareBaseline, compareCandidate, compareThreshold);
+
+    // CPU kernels only; no window or context
+    if (microBenchmarks) {
+        std::vector<KernelResult> results = runKernelBenchmarks();
+        if (!reportKernelBenchmarks(results, microReportPath)) {
+            std::cout << "Benchmark: can't write " << microReportPath << std::endl;
+            return 2;
+        }
+        return 0;
+    }
+    if (connectAddress) {
+        std::string host = connectAddress;
+        int port = NET_DEFAULT_PORT;
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos) {
+            port = atoi(host.c_str() + colon + 1);
+            host.resize(colon);
+        }
+        if (!netStartup() || !chunkClient.connect(host.c_str(), port)) {
+            std::cout << "Client: can't connect to " << connectAddress << std::endl;
+            return 1;
+        }
+        std::cout << "Client: connected to " << connectAddress << std::endl;
+        chunkClient.player = &player;
+    }
+    if (headless && !benchmarkPath) {
+        std::cout << "--headless needs --benchmark <path file>" << std::endl;
+        return 1;
+    }
+    if (benchmarkPath) {
+        std::string error;
+        if (!benchmarkScript.load(benchmarkPath, error)) {
+            std::cout << "Benchmark: " << error << std::endl;
+            return 1;
+        }
+        benchmarkMode = true;
+        renderDistance = benchmarkScript.renderDistance;
+        useLod = benchmarkScript.lodDistance > 0;
+        if (useLod)
+            lodDistance = benchmarkScript.lodDistance;
+        farField = benchmarkScript.farField;
+    }
+    if (replayMode) {
+        if (benchmarkMode || connectAddress || recordPath) {
+            std::cout << "--replay can't be combined with --benchmark, --connect or --record" << std::endl;
+            return 1;
+        }
+        // The world it was recorded in
+        benchmarkScript.seed = inputReplay.start.seed;
+        renderDistance = inputReplay.start.renderDistance;
+    }
+    if (metricsExporter.filePath || metricsExporter.statsdAddress) {
+        std::string error;
+        if (!metricsExporter.start(error)) {
+            std::cout << "Metrics: " << error << std::endl;
+            return 1;
+        }
+    }
 
-int main()
-{
-    // Initialize GLFW
+    // Initialize GLFW; the window stays hidden until the warm-up is done
     glfwInit();
+    startupTimeline.mark("glfwInit");
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, glDebug ? GLFW_TRUE : GLFW_FALSE);
 
     // Create window
     GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "3D Cubes with Camera", NULL, NULL);
@@ -80,15 +762,20 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(0); // Disable VSync
-
-    // Set callbacks
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    // Capture mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    startupTimeline.mark("window");
+    // The render thread sets the swap interval for the present mode
+
+    // Set callbacks and capture the mouse; a benchmark or a replay takes no input
+    if (!benchmarkMode && !replayMode) {
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCharCallback(window, char_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        if (glfwRawMouseMotionSupported())
+            glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+    }
 
     // Load OpenGL function pointers using GLAD
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -97,31 +784,300 @@ int main()
         return -1;
     }
 
+    // Optional GL 4.x features; the renderer falls back to per-chunk draws without them
+    loadGLExtensions();
+    if (glDebug)
+        std::cout << "GL debug output: " << (glDebugOutput.start() ? "on" : "unavailable") << std::endl;
+    startupTimeline.mark("GL loader");
+    const std::string rendererName = (const char*)glGetString(GL_RENDERER);  // For benchmark reports
+    std::cout << "OpenGL " << glFeatures.major << "." << glFeatures.minor << ", chunk draws: "
+        << (glFeatures.multiDrawIndirect ? "multi-draw indirect" : "per chunk")
+        << (glFeatures.computeShaders && glFeatures.multiDrawIndirect ? ", compute culling available" : "")
+        << (glFeatures.vertexPulling && useVertexPulling ? useFaceRecords ? ", vertex pulling from face records" : ", vertex pulling" : "")
+        << std::endl;
+
+    // Quality tier for this machine; everything below reads the cvars it sets
+    HardwareProfile hardware = probeHardware();
+    std::cout << "Hardware: " << GPU_VENDOR_NAMES[hardware.vendor] << (hardware.integrated ? " integrated" : "")
+        << ", " << (hardware.vramMB >= 0 ? std::to_string(hardware.vramMB) + " MB video memory" : "video memory unknown")
+        << ", " << hardware.cores << " threads; indirect draws " << (glFeatures.multiDrawIndirect ? "yes" : "no")
+        << ", compute " << (glFeatures.computeShaders ? "yes" : "no")
+        << ", bindless " << (glFeatures.bindlessTextures ? "yes" : "no")
+        << ", persistent mapping " << (glFeatures.bufferStorage ? "yes" : "no")
+        << ", parallel compile " << (glFeatures.parallelShaderCompile ? "yes" : "no") << std::endl;
+    if (!benchmarkMode && !replayMode) {
+        QualityTier tier = qualityTier == QUALITY_AUTO ? chooseQualityTier(hardware) : qualityTier;
+        applyQualityTier(tier, cvars);
+        std::cout << "Quality: " << QUALITY_TIER_NAMES[tier] << (qualityTier == QUALITY_AUTO ? " (auto)" : "") << std::endl;
+    }
+
+    // Mesh uploads where they cross the bus are worth taking off the render
+    // thread: a hidden window shares its objects, for the upload thread's
+    // context. The staging ring remains the fallback.
+    bool wantUploadThread = uploadThreadMode < 0 ? !hardware.integrated && hardware.vendor != GPU_VENDOR_OTHER : uploadThreadMode > 0;
+    GLFWwindow* uploadWindow = wantUploadThread ? glfwCreateWindow(1, 1, "Uploads", NULL, window) : NULL;
+    uploadThread.start(uploadWindow);
+    std::cout << "Mesh uploads: " << (uploadThread.active() ? "upload thread" : wantUploadThread ? "staging ring (no shared context)" : "staging ring") << std::endl;
+
+    // Ring buffer for streamed per-frame data, persistently mapped when supported
+    frameStream.init(FRAME_STREAM_BYTES);
+    std::cout << "Frame stream: " << (frameStream.persistent ? "persistent mapping" : "unsynchronised map range") << std::endl;
+
     // Enable depth test
-    glEnable(GL_DEPTH_TEST);
+    glState().enable(GL_DEPTH_TEST);
 
     // Build and compile our shader program
     // ------------------------------------
+    // Vertex shaders of chunk meshes start with their vertex input: attribute
+    // 0, or the heap page read by gl_VertexID on GL 4.3 (vertex pulling, off
+    // with --no-pulling), which leaves one VAO for every page. Face records
+    // are read the same way, so they need pulling too.
+    bool vertexPulling = useVertexPulling && glFeatures.vertexPulling;
+    if (useFaceRecords && !vertexPulling) {
+        std::cout << "Face record meshes need vertex pulling, using vertices" << std::endl;
+        useFaceRecords = false;
+    }
+    const std::string chunkVertexInput = chunkVertexInputSource(vertexPulling, useFaceRecords);
+
     // Vertex shader for cubes
-    const char* vertexShaderSource = R"(
+    const std::string vertexShaderSource = chunkVertexInput + R"(
+    layout (location = 1) in vec4 aChunkOffset; // Origin of the chunk being drawn, relative to the camera; how far it has faded in
+
+    out vec3 texCoord;          // Block texture coordinates (tiling per block) and layer
+    out float occlusion;        // Baked ambient occlusion
+    out float skyLight;         // Brightness of the flood-filled sunlight
+    out vec3 blockLight;        // ... and of block light, tinted
+    out float sunFacing;        // Cosine between the face normal and the sun direction
+    #ifdef CHUNK_SHADOWS
+    out vec3 shadowCoords[4];   // Shadow map coordinates and depth per cascade
+    #endif
+    #ifdef CHUNK_FOG
+    out float viewDistance;     // From the eye, for the fog
+    #endif
+    #ifdef CHUNK_POINT_LIGHTS
+    out vec3 relativePosition;  // Offset from the eye, for point lights
+    out float viewDepth;        // Along the view direction, picking the light cluster
+    #endif
+    flat out vec3 faceNormal;
+    flat out float fade;        // aChunkOffset.w
+    invariant gl_Position;  // Also used by the depth pre-pass and shadow programs
+
+    layout (std140) uniform Camera {
+        mat4 view;
+        mat4 projection;
+        mat4 viewProj;
+        vec4 cameraPos;
+        vec4 fog;
+        mat4 eyeViewProj[2];
+        vec4 views;
+    };
+
+    layout (std140) uniform Shadows {
+        mat4 shadowMatrices[4];
+        vec4 shadowOffsets[4];
+        vec4 sunDirection;
+    };
+
+    const vec3 FACE_NORMALS[6] = vec3[6](vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+        vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0));
+
+    // Baked ambient occlusion: 0 (corner boxed in) .. 3 (open)
+    const float AO_CURVE[4] = float[4](0.45, 0.65, 0.82, 1.0);
+
+    // Brightness of a light level: each level below full is 20% dimmer
+    float lightLevel(uint level)
+    {
+        return pow(0.8, 15.0 - float(level));
+    }
+
+    void main()
+    {
+        uint aPacked = chunkVertex();   // See packChunkVertex()
+        vec3 aPos = vec3(aPacked & 31u, (aPacked >> 5) & 31u, (aPacked >> 10) & 31u);
+        uint material = (aPacked >> 20) & 15u;
+        uint face = (aPacked >> 15) & 7u;
+        vec3 normal = FACE_NORMALS[face];
+
+        // Only the chunk origin varies per draw; the combined matrix is precomputed
+        vec3 position = aPos + aChunkOffset.xyz;
+        if (views.x > 1.0) {
+            // Stereo: even instances into the left half of the target, odd
+            // ones into the right, each clipped at the middle
+            int e = gl_InstanceID & 1;
+            vec4 clip = eyeViewProj[e] * vec4(position, 1.0);
+            clip.x = clip.x * 0.5 + (float(e) - 0.5) * clip.w;
+            gl_Position = clip;
+            gl_ClipDistance[0] = e == 0 ? -clip.x : clip.x;
+        }
+        else {
+            gl_Position = viewProj * vec4(position, 1.0);
+            gl_ClipDistance[0] = 1.0;
+        }
+    #ifdef CHUNK_FOG
+        viewDistance = length(position);
+    #endif
+    #ifdef CHUNK_POINT_LIGHTS
+        relativePosition = position;
+        viewDepth = -(view * vec4(position, 1.0)).z;
+    #endif
+        faceNormal = normal;
+        fade = aChunkOffset.w;
+
+        // The texture repeats once per block across the two axes in the face
+        // plane (v runs up the sides), so greedy quads tile it
+        vec2 planar = face < 2u ? aPos.zy : face < 4u ? aPos.xz : aPos.xy;
+        texCoord = vec3(planar, float(material));
+        occlusion = AO_CURVE[(aPacked >> 18) & 3u];
+
+        // Block light is warmer than daylight
+        skyLight = lightLevel(aPacked >> 28);
+        blockLight = lightLevel((aPacked >> 24) & 15u) * vec3(1.0, 0.85, 0.6);
+        sunFacing = max(dot(normal, sunDirection.xyz), 0.0);
+
+        // Orthographic, so the coordinates interpolate exactly; lookups are
+        // pushed off the surface by about a texel to avoid self-shadowing
+    #ifdef CHUNK_SHADOWS
+        for (int i = 0; i < 4; i++)
+            shadowCoords[i] = (shadowMatrices[i] * vec4(position + normal * shadowOffsets[i].x, 1.0)).xyz;
+    #endif
+    }
+    )";
+
+    // Chunks fading in leave out a growing share of their pixels in an
+    // ordered dither, so what is behind shows through until they are whole.
+    // Shared by every chunk fragment shader, the depth-only one included, so
+    // the pre-pass keeps matching the main pass.
+    const char* chunkFadeSource = R"(
     #version 330 core
-    layout (location = 0) in vec3 aPos; 
-    layout (location = 1) in vec3 aColor;
+    flat in float fade;
 
-    out vec3 ourColor;
+    // 4x4 Bayer matrix thresholds, (0.5..15.5) / 16
+    void fadeDither()
+    {
+        if (fade >= 1.0)
+            return;
+        ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+        int bayer = ((p.x ^ p.y) & 1) * 8 + (p.y & 1) * 4 + ((p.x ^ p.y) & 2) + ((p.y >> 1) & 1);
+        if (fade * 16.0 <= float(bayer) + 0.5)
+            discard;
+    }
+    )";
+
+    // Shading of chunk meshes, shared by the fragment shaders below: the
+    // block texture, lit by sky light split into ambient and direct sun
+    // (which the shadow cascades can block) or block light, whichever is
+    // brighter, and fogged with distance. Lamps near the fragment, from its
+    // light cluster (see ClusteredLights), brighten the block light per
+    // pixel up to twice the flood-filled level, so none shines where the
+    // flood fill found a wall in the way. Shadows, fog and lamps are only
+    // compiled into the variants that use them (CHUNK_SHADOWS, CHUNK_FOG,
+    // CHUNK_POINT_LIGHTS; see chunkPrograms below).
+    const std::string chunkShadingSource = std::string(chunkFadeSource) + clusteredLightsSource() + R"(
+    in vec3 texCoord;
+    in float occlusion;
+    in float skyLight;
+    in vec3 blockLight;
+    in float sunFacing;
+    #ifdef CHUNK_SHADOWS
+    in vec3 shadowCoords[4];
+    #endif
+    #ifdef CHUNK_FOG
+    in float viewDistance;
+    #endif
+    #ifdef CHUNK_POINT_LIGHTS
+    in vec3 relativePosition;
+    in float viewDepth;
+    #endif
+    flat in vec3 faceNormal;
+
+    uniform sampler2DArrayShadow shadowMap;
+    uniform sampler2DArray blockTextures;   // One layer per material
+
+    layout (std140) uniform Camera {
+        mat4 view;
+        mat4 projection;
+        mat4 viewProj;
+        vec4 cameraPos;
+        vec4 fog;               // Colour, and the distance where it is complete (0 = none)
+        mat4 eyeViewProj[2];
+        vec4 views;
+    };
 
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    layout (std140) uniform Shadows {
+        mat4 shadowMatrices[4];
+        vec4 shadowOffsets[4];
+        vec4 sunDirection;      // w = 0 without shadows
+    };
+
+    const float AMBIENT = 0.6;  // Share of sky light that isn't direct sun
+
+    // Sun reaching the fragment, from the first cascade holding it
+    // (filtered 2x2 by the hardware comparison)
+    float sunVisibility()
+    {
+    #ifdef CHUNK_SHADOWS
+        if (sunDirection.w == 0.0 || sunFacing == 0.0)
+            return 1.0;
+        for (int i = 0; i < 4; i++) {
+            vec3 c = shadowCoords[i];
+            if (all(greaterThan(c, vec3(0.0))) && all(lessThan(c, vec3(1.0))))
+                return texture(shadowMap, vec4(c.xy, float(i), c.z));
+        }
+    #endif
+        return 1.0;
+    }
+
+    // Lit and fogged colour, with the texture's alpha; nothing while the
+    // chunk's fade-in leaves the pixel out
+    vec4 shade()
+    {
+        fadeDither();
+        vec4 surface = texture(blockTextures, texCoord);
+        float sun = skyLight * (AMBIENT + (1.0 - AMBIENT) * sunFacing * sunVisibility());
+    #ifdef CHUNK_POINT_LIGHTS
+        vec3 lamps = min(pointLighting(relativePosition, faceNormal, viewDepth), blockLight * 2.0);
+        vec3 lit = surface.rgb * occlusion * max(max(vec3(sun), max(blockLight, lamps)), vec3(0.04));
+    #else
+        vec3 lit = surface.rgb * occlusion * max(max(vec3(sun), blockLight), vec3(0.04));
+    #endif
+    #ifdef CHUNK_FOG
+        // Thickens over the last 40% of the fog distance
+        float haze = fog.w > 0.0 ? smoothstep(0.6 * fog.w, fog.w, viewDistance) : 0.0;
+        return vec4(mix(lit, fog.rgb, haze), surface.a);
+    #else
+        return vec4(lit, surface.a);
+    #endif
+    }
+    )";
+
+    // Fragment shader for chunk meshes, opaque or blended in sorted order
+    const std::string chunkFragmentShaderSource = chunkShadingSource + R"(
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = shade();
+    }
+    )";
+
+    // Fragment shader for translucent meshes under weighted blended OIT (see
+    // WeightedOit): weighted colour and alpha into the accumulation target,
+    // the weight into the second one
+    const std::string oitFragmentShaderSource = chunkShadingSource + R"(
+    layout (location = 0) out vec4 accumulation;
+    layout (location = 1) out float weight;
 
     void main()
     {
-        gl_Position = projection * view * model * vec4(aPos, 1.0);
-        ourColor = aColor;
+        vec4 color = shade();
+        // Nearer surfaces count for more (the paper's equation 10)
+        float w = color.a * clamp(3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);
+        accumulation = vec4(color.rgb * w, color.a);
+        weight = w;
     }
     )";
 
-    // Fragment shader for cubes
+    // Fragment shader for instanced cubes
     const char* fragmentShaderSource = R"(
     #version 330 core
     in vec3 ourColor;
@@ -133,362 +1089,2257 @@ int main()
     } 
     )";
 
-    unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-
-    // Link shaders
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // Check for linking errors
-    int success;
-    char infoLog[512];
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    // Set up vertex data and buffers and configure vertex attributes
-    // --------------------------------------------------------------
-    // Dirt block (brown color)
-    float dirt_vertices[] = {
-        // positions          // colors (brown)
-       -0.5f, -0.5f, -0.5f,   0.6f, 0.3f, 0.0f, //0
-        0.5f, -0.5f, -0.5f,   0.6f, 0.3f, 0.0f, //1
-        0.5f,  0.5f, -0.5f,   0.6f, 0.3f, 0.0f, //2
-       -0.5f,  0.5f, -0.5f,   0.6f, 0.3f, 0.0f, //3
-       -0.5f, -0.5f,  0.5f,   0.6f, 0.3f, 0.0f, //4
-        0.5f, -0.5f,  0.5f,   0.6f, 0.3f, 0.0f, //5
-        0.5f,  0.5f,  0.5f,   0.6f, 0.3f, 0.0f, //6
-       -0.5f,  0.5f,  0.5f,   0.6f, 0.3f, 0.0f  //7
+    // Fragment shader for the depth pre-pass and shadow maps (colour writes
+    // are masked off)
+    const std::string depthFragmentShaderSource = std::string(chunkFadeSource) + R"(
+    void main()
+    {
+        fadeDither();
+    }
+    )";
+
+    // Fragment shader for the overdraw heatmap: every chunk fragment adds a
+    // little red, so stacked surfaces go through orange and yellow to white
+    // (about 6, 16 and 50 layers). Blended additively with depth testing off.
+    const std::string overdrawFragmentShaderSource = std::string(chunkFadeSource) + R"(
+    out vec4 FragColor;
+
+    void main()
+    {
+        fadeDither();
+        FragColor = vec4(0.16, 0.06, 0.02, 1.0);
+    }
+    )";
+
+    // Vertex shader for instanced unit cubes (fallback when meshing is disabled)
+    const char* instancedVertexShaderSource = R"(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;   // Unit-cube corner, four per face in face order
+    layout (location = 2) in vec3 iPos;   // Per-instance chunk-local block position
+    layout (location = 3) in uvec2 iData; // Per-instance material and visible-face mask
+
+    out vec3 ourColor;
+
+    uniform vec3 chunkOffset; // Chunk origin relative to the camera
+    layout (std140) uniform Camera {
+        mat4 view;
+        mat4 projection;
+        mat4 viewProj;
+        vec4 cameraPos;
     };
 
-    // Stone block (gray color)
-    float stone_vertices[] = {
-        // positions          // colors (gray)
-       -0.5f, -0.5f, -0.5f,   0.5f, 0.5f, 0.5f, //0
-        0.5f, -0.5f, -0.5f,   0.5f, 0.5f, 0.5f, //1
-        0.5f,  0.5f, -0.5f,   0.5f, 0.5f, 0.5f, //2
-       -0.5f,  0.5f, -0.5f,   0.5f, 0.5f, 0.5f, //3
-       -0.5f, -0.5f,  0.5f,   0.5f, 0.5f, 0.5f, //4
-        0.5f, -0.5f,  0.5f,   0.5f, 0.5f, 0.5f, //5
-        0.5f,  0.5f,  0.5f,   0.5f, 0.5f, 0.5f, //6
-       -0.5f,  0.5f,  0.5f,   0.5f, 0.5f, 0.5f  //7
+    layout (std140) uniform Palette {
+        vec4 blockColors[16];
     };
 
-    // Grass block (green color)
-    float grass_vertices[] = {
-        // positions          // colors (green)
-       -0.5f, -0.5f, -0.5f,   0.0f, 1.0f, 0.0f, //0
-        0.5f, -0.5f, -0.5f,   0.0f, 1.0f, 0.0f, //1
-        0.5f,  0.5f, -0.5f,   0.0f, 1.0f, 0.0f, //2
-       -0.5f,  0.5f, -0.5f,   0.0f, 1.0f, 0.0f, //3
-       -0.5f, -0.5f,  0.5f,   0.0f, 1.0f, 0.0f, //4
-        0.5f, -0.5f,  0.5f,   0.0f, 1.0f, 0.0f, //5
-        0.5f,  0.5f,  0.5f,   0.0f, 1.0f, 0.0f, //6
-       -0.5f,  0.5f,  0.5f,   0.0f, 1.0f, 0.0f  //7
+    void main()
+    {
+        // Collapse hidden faces outside the clip volume so they are never
+        // rasterised. The face (-X, +X, -Y, +Y, -Z, +Z) comes from the vertex
+        // index rather than an attribute.
+        uint face = uint(gl_VertexID) >> 2;
+        if ((iData.y & (1u << face)) == 0u) {
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        }
+        else {
+            gl_Position = viewProj * vec4(aPos + iPos + chunkOffset, 1.0);
+        }
+        ourColor = blockColors[iData.x].rgb;
+    }
+    )";
+
+    // Vertex shader for LOD tiles: chunk meshes whose cells are 2^level
+    // blocks, the cell size riding in the offset's fourth component
+    const std::string lodVertexShaderSource = chunkVertexInput + R"(
+    layout (location = 1) in vec4 aTileOffset;  // Tile origin relative to the camera, cell size
+
+    out vec3 ourColor;
+    out vec2 horizontalPos; // Relative to the camera
+    out float viewDistance;
+
+    layout (std140) uniform Camera {
+        mat4 view;
+        mat4 projection;
+        mat4 viewProj;
+        vec4 cameraPos;
+        vec4 fog;
     };
 
-    // Indices for EBO
-    unsigned int indices[] = {
-        0, 1, 2, 2, 3, 0,   // back face
-        4, 5, 6, 6, 7, 4,   // front face
-        0, 1, 5, 5, 4, 0,   // bottom face
-        2, 3, 7, 7, 6, 2,   // top face
-        0, 3, 7, 7, 4, 0,   // left face
-        1, 2, 6, 6, 5, 1    // right face
+    layout (std140) uniform Palette {
+        vec4 blockColors[16];
     };
 
-    // Generate EBO
-    glGenBuffers(1, &EBO);
+    void main()
+    {
+        uint aPacked = chunkVertex();
+        vec3 aPos = vec3(aPacked & 31u, (aPacked >> 5) & 31u, (aPacked >> 10) & 31u);
+        uint material = (aPacked >> 20) & 15u;
+
+        vec3 position = aPos * aTileOffset.w + aTileOffset.xyz;
+        gl_Position = viewProj * vec4(position, 1.0);
+        ourColor = blockColors[material].rgb;
+        horizontalPos = position.xz;
+        viewDistance = length(position);
+    }
+    )";
 
-    // Stone block setup
-    glGenVertexArrays(1, &stoneVAO);
-    glGenBuffers(1, &stoneVBO);
+    // Fragment shader for LOD tiles: columns drawn by streamed chunks are
+    // left to them (same circle test as World::updateStreaming). Fogged as
+    // the chunks are.
+    const char* lodFragmentShaderSource = R"(
+    #version 330 core
+    in vec3 ourColor;
+    in vec2 horizontalPos;
+    in float viewDistance;
+    out vec4 FragColor;
 
-    glBindVertexArray(stoneVAO);
+    uniform vec2 streamOrigin;  // Minimum corner of the streaming centre column, relative to the camera
+    uniform float streamRadius; // In columns
 
-    glBindBuffer(GL_ARRAY_BUFFER, stoneVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(stone_vertices), stone_vertices, GL_STATIC_DRAW);
+    layout (std140) uniform Camera {
+        mat4 view;
+        mat4 projection;
+        mat4 viewProj;
+        vec4 cameraPos;
+        vec4 fog;
+    };
 
-    // Bind EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    void main()
+    {
+        vec2 column = floor((horizontalPos - streamOrigin) / 16.0);
+        if (dot(column, column) <= streamRadius * streamRadius)
+            discard;
+        float haze = fog.w > 0.0 ? smoothstep(0.6 * fog.w, fog.w, viewDistance) : 0.0;
+        FragColor = vec4(mix(ourColor, fog.rgb, haze), 1.0);
+    }
+    )";
 
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // Flat-shaded chunk shader, shown until the programs above have linked
+    const std::string fallbackVertexShaderSource = chunkVertexInput + R"(
+    layout (location = 1) in vec3 aChunkOffset;
 
-    // Dirt block setup
-    glGenVertexArrays(1, &dirtVAO);
-    glGenBuffers(1, &dirtVBO);
+    layout (std140) uniform Camera {
+        mat4 view;
+        mat4 projection;
+        mat4 viewProj;
+        vec4 cameraPos;
+    };
 
-    glBindVertexArray(dirtVAO);
+    void main()
+    {
+        uint aPacked = chunkVertex();
+        vec3 aPos = vec3(aPacked & 31u, (aPacked >> 5) & 31u, (aPacked >> 10) & 31u);
+        gl_Position = viewProj * vec4(aPos + aChunkOffset, 1.0);
+    }
+    )";
 
-    glBindBuffer(GL_ARRAY_BUFFER, dirtVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(dirt_vertices), dirt_vertices, GL_STATIC_DRAW);
+    const char* fallbackFragmentShaderSource = R"(
+    #version 330 core
+    out vec4 FragColor;
 
-    // Bind EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    // EBO data is already set, no need to call glBufferData again
+    void main()
+    {
+        FragColor = vec4(0.5, 0.5, 0.5, 1.0);
+    }
+    )";
 
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // The chunk programs build in the background (with parallel shader
+    // compilation) while the rest of start-up runs; the render thread
+    // finishes them once the driver is done. The shading ones come in a
+    // variant per combination of features, built as frames ask for them;
+    // the one with every feature covers for the rest meanwhile.
+    ClusteredLights clusteredLights;
+    auto setupChunkProgram = [&](const ShaderProgram& program) {
+        program.bindBlock("Camera", CAMERA_BINDING);
+        program.bindBlock("Shadows", SHADOW_BINDING);
+        glUniform1i(program.uniform("shadowMap"), SHADOW_TEXTURE_UNIT);
+        glUniform1i(program.uniform("blockTextures"), BLOCK_TEXTURE_UNIT);
+        clusteredLights.bindProgram(program);
+    };
+    ProgramPermutations chunkPrograms;
+    chunkPrograms.init(vertexShaderSource, chunkFragmentShaderSource, CHUNK_FEATURE_DEFINES, CHUNK_FEATURE_COUNT, setupChunkProgram);
+    ProgramPermutations oitPrograms;
+    oitPrograms.init(vertexShaderSource, oitFragmentShaderSource, CHUNK_FEATURE_DEFINES, CHUNK_FEATURE_COUNT, setupChunkProgram);
+    // Depth-only variant for the pre-pass; the shared vertex stage keeps its
+    // depth identical to the main pass (gl_Position is invariant)
+    ShaderProgram depthProgram;
+    depthProgram.createAsync(vertexShaderSource.c_str(), depthFragmentShaderSource.c_str());
+    ShaderProgram overdrawProgram;
+    overdrawProgram.createAsync(vertexShaderSource.c_str(), overdrawFragmentShaderSource.c_str());
+    ShaderProgram instancedProgram;
+    instancedProgram.createAsync(instancedVertexShaderSource, fragmentShaderSource);
+    ShaderProgram lodProgram;
+    lodProgram.createAsync(lodVertexShaderSource.c_str(), lodFragmentShaderSource);
+    int chunkOffsetLoc = -1;
+    ShaderProgram fallbackProgram;
+    fallbackProgram.create(fallbackVertexShaderSource.c_str(), fallbackFragmentShaderSource);
+    fallbackProgram.bindBlock("Camera", CAMERA_BINDING);
+    startupTimeline.mark("shaders");
+
+    // Block textures for chunk meshes, bound to their unit for good
+    BlockTextures blockTextures;
+    blockTextures.init(MATERIAL_ANISOTROPY, BLOCK_TEXTURE_PATH);
+    blockTextures.bind(BLOCK_TEXTURE_UNIT);
+    std::cout << "Block textures: " << blockTextures.format << " " << blockTextures.size << "x" << blockTextures.size
+              << ", " << blockTextures.levels << " mip levels, " << blockTextures.bytes / 1024 << " KiB";
+    if (blockTextures.anisotropy > 0.0f)
+        std::cout << ", " << blockTextures.anisotropy << "x anisotropic filtering";
+    std::cout << std::endl;
+
+    // Flat block colours for instanced cubes and LOD tiles (std140: one vec4 per material)
+    glm::vec4 paletteData[PALETTE_SIZE] = {};
+    for (int i = 0; i < BLOCK_TYPE_COUNT; i++)
+        paletteData[i] = glm::vec4(BLOCK_COLORS[i], 1.0f);
+
+    unsigned int paletteUBO;
+    glGenBuffers(1, &paletteUBO);
+    glState().bindBuffer(GL_UNIFORM_BUFFER, paletteUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(paletteData), paletteData, GL_STATIC_DRAW);
+    glState().bindBufferBase(GL_UNIFORM_BUFFER, PALETTE_BINDING, paletteUBO);
+
+    // Lamps as point lights for the chunk programs, binned into clusters of
+    // the view every frame
+    clusteredLights.init(LIGHT_TEXTURE_UNIT);
+
+    // Camera matrices are written into the frame stream once per frame and
+    // bound as a range at CAMERA_BINDING. Block bindings of the chunk
+    // programs are set once they have linked.
+    auto bindChunkPrograms = [&]() {
+        instancedProgram.bindBlock("Palette", PALETTE_BINDING);
+        lodProgram.bindBlock("Palette", PALETTE_BINDING);
+        depthProgram.bindBlock("Camera", CAMERA_BINDING);
+        overdrawProgram.bindBlock("Camera", CAMERA_BINDING);
+        instancedProgram.bindBlock("Camera", CAMERA_BINDING);
+        lodProgram.bindBlock("Camera", CAMERA_BINDING);
+        depthProgram.bindBlock("Shadows", SHADOW_BINDING);
+        overdrawProgram.bindBlock("Shadows", SHADOW_BINDING);
+        chunkOffsetLoc = instancedProgram.uniform("chunkOffset");
+    };
+    int uniformAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+
+    // Vertex heap and quad indices for chunk meshes, and the unit cube for
+    // instanced blocks (drawn with the same indices)
+    initChunkMeshes(glFeatures.multiDrawIndirect, vertexPulling, useFaceRecords, stereoSeparation > 0.0f ? 2 : 1);
+    chunkMeshHeap().uploader = &uploadThread;
+    initBlockInstancing();
+
+    // Compute-shader culling for the indirect path
+    GpuCuller gpuCuller;
+    bool gpuCullingAvailable = gpuCuller.init();
+
+    // Compute-shader meshing when chosen; the CPU mesher still builds the
+    // chunks it doesn't take (translucent blocks, edits, instancing)
+    GpuMesher gpuMesher;
+    bool gpuMeshing = false;
+    if (useGpuMesher) {
+        if (useFaceRecords)
+            std::cout << "GPU meshing writes vertices, not face records; using the CPU mesher" << std::endl;
+        else if (!(gpuMeshing = gpuMesher.init()))
+            std::cout << "GPU meshing needs compute shaders; using the CPU mesher" << std::endl;
+        else
+            std::cout << "Chunk meshing: compute shader" << std::endl;
+    }
 
-    // Grass block setup
-    glGenVertexArrays(1, &grassVAO);
-    glGenBuffers(1, &grassVBO);
+    // With GPU culling the scene is drawn offscreen so its depth can be reduced
+    // into a Hi-Z pyramid for the next frame's occlusion tests
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    OffscreenTarget offscreen;
+    OffscreenTarget sceneTarget;    // Scaled scene (or one for weighted OIT), when there is no Hi-Z buffer to hold it
+    WeightedOit weightedOitTarget;  // Order-independent translucency targets, sized to the scene on first use
+    weightedOitTarget.init();
+    DynamicResolution dynamicResolution;
+    dynamicResolution.budgetMs = frameBudgetMs;
+    dynamicResolution.minScale = MIN_RESOLUTION_SCALE;
+    dynamicResolution.settleFrames = GpuProfiler::FRAME_LATENCY + 2;
+    // Reconstructs the scaled scene at the window's resolution, from the
+    // Hi-Z buffer's colour and depth textures
+    TemporalUpscaler temporalUpscaler;
+    temporalUpscaler.init();
+    FxaaPass fxaaPass;
+    fxaaPass.init();
+    if (headless) {
+        if (!offscreen.init(BENCHMARK_WIDTH, BENCHMARK_HEIGHT)) {
+            std::cout << "Failed to create the offscreen target" << std::endl;
+            return -1;
+        }
+        framebufferWidth = BENCHMARK_WIDTH;
+        framebufferHeight = BENCHMARK_HEIGHT;
+    }
+    // Sun shadow cascades, sampled by the chunk program from SHADOW_TEXTURE_UNIT
+    ShadowCascades shadowCascades;
+    bool shadowsAvailable = shadowCascades.init(SHADOW_MAP_RESOLUTION);
+    if (shadowsAvailable)
+        shadowCascades.bindTexture(SHADOW_TEXTURE_UNIT);
+    else
+        std::cout << "Shadow maps unavailable" << std::endl;
+
+    HiZBuffer hiz;
+    bool hizAvailable = gpuCullingAvailable && hiz.init(framebufferWidth, framebufferHeight);
+    bool hizValid = false;          // Pyramid holds last frame's depth
+    glm::mat4 hizViewProj;          // Camera-relative view-projection it was rendered with
+    glm::dvec3 hizEye;              // ... and that frame's eye position
+    // Its coarse levels on the CPU, for the main thread to cull entities with
+    HiZReadback hizReadback;
+    if (hizAvailable)
+        hizReadback.init();
+
+    // Highlight of the block under the crosshair
+    BlockOutline blockOutline;
+    blockOutline.init(CAMERA_BINDING);
+    // Per-chunk debug tints (F7)
+    ChunkOverlay chunkOverlay;
+    chunkOverlay.init(CAMERA_BINDING);
+    // Backdrop of every frame, in place of a clear colour
+    ProceduralSky sky;
+    sky.init();
+    CloudLayer clouds;
+    clouds.init();
+    EntityRenderer entityRenderer;
+    entityRenderer.init(CAMERA_BINDING);
+    FoliageRenderer foliageRenderer;
+    foliageRenderer.init(CAMERA_BINDING);
+    GpuParticles particles;
+    particles.init(PARTICLE_CAPACITY, CAMERA_BINDING, PALETTE_BINDING);
+    OccupancyVolume occupancyVolume;
+    occupancyVolume.init(OCCUPANCY_TEXTURE_UNIT);
+    Minimap minimap;
+    minimap.init(MINIMAP_TEXTURE_UNIT);
+    std::vector<ParticleEmitter> particleEmitters;
+
+    // Box queries + conditional rendering, the occlusion culler for GL 3.3
+    OcclusionQueries occlusionQueries;
+    occlusionQueries.init(CAMERA_BINDING);
+    useOcclusionQueries = !gpuCullingAvailable;
+    startupTimeline.mark("buffers");
+
+    // World and its render-side mirror; chunks stream in around the camera
+    // One job system runs generation, meshing and culling work; results are
+    // handed back to the render loop
+    JobSystem jobSystem;
+    const int RESERVED_THREADS = 2;     // Main and render
+    jobSystem.start(workerThreads, RESERVED_THREADS, workerPriority, pinWorkers);
+    std::cout << "Job system: " << jobSystem.workerCount() << " workers on " << hardwareThreadCount() << " hardware threads, "
+              << THREAD_PRIORITY_NAMES[workerPriority] << " priority" << (pinWorkers ? ", pinned" : "") << std::endl;
+    // Screenshots and video are encoded and written by the workers
+    FrameCapture frameCapture;
+    frameCapture.jobs = &jobSystem;
+    frameCapture.init();
+    // Saved chunks are read on the generator's I/O thread; it needs the store before start()
+    RegionStore regionStore;
+    // On a server the world is saved there
+    if (!worldDir && !benchmarkMode && !replayMode && !connectAddress)
+        worldDir = DEFAULT_WORLD_DIR;
+    if (worldDir && !regionStore.open(worldDir, benchmarkScript.seed))
+        std::cout << "World: can't use " << worldDir << ", chunks won't be saved" << std::endl;
+    ChunkGenerator chunkGenerator;
+    GenerationCache generationCache;
+    generationCache.budgetBytes = generationCacheMB * 1024 * 1024;
+    LightEngine lightEngine;
+    NavigationGraph navigation;
+    WorldSimulation worldSimulation;
+    EntityStore entities;
+    EntityBroadphase entityBroadphase;
+    std::vector<EntityPair> entityPairs;
+    SchematicExport schematicExport;
+    SchematicImport schematicImport;
+    World world;
+    world.generator = &chunkGenerator;
+    world.lighting = &lightEngine;
+    world.navigation = &navigation;
+    worldSimulation.attach(world, &jobSystem);
+    world.seed = connectAddress ? chunkClient.seed : benchmarkScript.seed;
+    world.voxelBudgetBytes = voxelBudgetMB * 1024 * 1024;
+    world.coldAfterTicks = (uint32_t)(coldChunkSeconds * SIMULATION_RATE);
+    chunkGenerator.seed = world.seed;
+    if (connectAddress)
+        chunkGenerator.remote = &chunkClient;
+    else if (generationCacheMB > 0)
+        chunkGenerator.cache = &generationCache;
+    if (regionStore.isOpen()) {
+        world.storage = &regionStore;
+        chunkGenerator.storage = &regionStore;
+    }
+    // The last session's view, if it was of this world. The player is held
+    // there until it is in, so a walking one doesn't drop through terrain
+    // that hasn't loaded.
+    ResumeState resume;
+    bool resuming = resumeSession && regionStore.isOpen() && !benchmarkMode && !replayMode && !connectAddress &&
+        loadResumeState(resumeStatePath(worldDir), resume) && resume.seed == world.seed && !resume.chunks.empty();
+    if (resuming) {
+        player.mode = (PlayerMode)resume.playerMode;
+        player.position = resume.position;
+        yaw = resume.yaw;
+        pitch = resume.pitch;
+        fov = resume.fov;
+        cameraFront = lookDirection(yaw, pitch);
+        // Only what streaming will keep; the rest would never arrive
+        glm::ivec2 column((int)floor(resume.position.x / CHUNK_SIZE), (int)floor(resume.position.z / CHUNK_SIZE));
+        resume.chunks.erase(std::remove_if(resume.chunks.begin(), resume.chunks.end(), [&](const glm::ivec3& coord) {
+            glm::ivec2 offset = glm::ivec2(coord.x, coord.z) - column;
+            return offset.x * offset.x + offset.y * offset.y > renderDistance * renderDistance;
+        }), resume.chunks.end());
+        chunkGenerator.prefer(resume.chunks);
+        std::cout << "World: resuming the last session's view, " << resume.chunks.size() << " chunks" << std::endl;
+    }
+    bool holdPlayer = resuming;
+    chunkGenerator.start(jobSystem);
+    lightEngine.start(jobSystem);
+    navigation.start(jobSystem);
+    ChunkMesher chunkMesher;
+    chunkMesher.budgetBytes = meshBudgetMB * 1024 * 1024;
+    // Meshes baked beside the region files (WorldBake --mesh) are copied, not built
+    MeshCache meshCache;
+    if (regionStore.isOpen() && !connectAddress) {
+        meshCache.open(worldDir, meshMode);
+        chunkMesher.cache = &meshCache;
+    }
+    chunkMesher.start(jobSystem);
+    ChunkRenderer chunkRenderer;
+    chunkRenderer.jobs = &jobSystem;
+    HorizonCuller horizonCuller;
+    chunkRenderer.meshBudgetBytes = gpuMeshBudgetMB * 1024 * 1024;
+    chunkRenderer.meshSubmitsPerFrame = meshSubmitsPerFrame;
+    if (gpuMeshing)
+        chunkRenderer.gpuMesher = &gpuMesher;
+    LodTerrain lodTerrain;
+    lodTerrain.seed = world.seed;
+    lodTerrain.start(jobSystem);
+    RaymarchTerrain raymarchTerrain;
+    raymarchTerrain.seed = world.seed;
+    raymarchTerrain.init(PALETTE_BINDING, CAMERA_BINDING);
+    // The ray march maps pixels of the whole target, not of half of it
+    if (farField == FAR_FIELD_RAYMARCH && stereoSeparation > 0.0f) {
+        std::cout << "Ray-marched far field is single view, drawing LOD tiles in stereo" << std::endl;
+        farField = FAR_FIELD_LOD;
+    }
+    if (farField == FAR_FIELD_RAYMARCH)
+        std::cout << "Far field: ray marched, " << raymarchTerrain.textureBytes() / 1024 << " KiB grid, horizon up to "
+                  << RaymarchTerrain::maxHorizonColumns() << " columns" << std::endl;
+    HorizonImpostor horizonImpostor;
+    if (farField == FAR_FIELD_IMPOSTOR) {
+        if (horizonImpostor.init()) {
+            std::cout << "Far field: horizon impostor, " << horizonImpostor.faceSize << "x" << horizonImpostor.faceSize << " faces, "
+                      << horizonImpostor.textureBytes() / 1024 << " KiB" << std::endl;
+        }
+        else {
+            std::cout << "Horizon impostor framebuffer incomplete, drawing LOD tiles" << std::endl;
+            farField = FAR_FIELD_LOD;
+        }
+    }
+    startupTimeline.mark("world systems");
+
+    // Rasterise the HUD font; text is skipped if it can't be loaded
+    if (!glyphAtlas.init(FONT_PATH, FONT_PIXEL_HEIGHT, FONT_MODE))
+        std::cout << "Text rendering disabled" << std::endl;
+    glyphAtlas.textureUnit = GLYPH_TEXTURE_UNIT;
+    textBatch.init(&glyphAtlas);
+    textBatch.setImageUnit(MINIMAP_TEXTURE_UNIT);
+    startupTimeline.mark("FreeType");
+    profilerView.init();
+    gpuProfiler.init();
+    profilerSetThreadName("Main");
+
+    // The player starts where the camera was placed, or where the resumed
+    // session left it
+    if (!resuming)
+        player.setEye(glm::dvec3(cameraPos));
+    glm::dvec3 previousEye = player.eye();  // Eye at the previous tick, for interpolation
+    FixedTimestep simulation;
+    simulation.setRate(SIMULATION_RATE);
+
+    // Frames are prepared here and submitted by the render thread, which
+    // owns the GL context; the two overlap through double-buffered packets
+    FramePipeline pipeline;
+
+    // One simulation step: player movement, then world updates budgeted per tick
+    RayHit pick;
+    bool picked = false;
+    auto simulate = [&](float dt) {
+        PROFILE_ZONE("Simulate");
+        // From a server: its chunks arrive in the generator's place, its
+        // deltas are applied here and its snapshots correct the player
+        // before the tick predicts on from there
+        if (chunkClient.connected())
+            chunkClient.update(world);
+        previousEye = player.eye();
+        if (chunkClient.connected())
+            chunkClient.stepPlayer(world, playerInput, dt);
+        else if (!holdPlayer)
+            player.step(world, playerInput, dt);
+
+        // Stream chunks in and out around the player's column. Changes are
+        // collected for the next packet; a chunk loaded and unloaded again
+        // before the render thread saw it is dropped from both lists.
+        FramePacket& packet = pipeline.back();
+        glm::dvec3 feet = player.position;
+        glm::ivec2 column((int)floor(feet.x / CHUNK_SIZE), (int)floor(feet.z / CHUNK_SIZE));
+        size_t firstUnloaded = packet.unloadedChunks.size();
+        PROFILE_ZONE("Streaming");
+        world.updateStreaming(column, renderDistance, chunkLoadsPerTick, packet.loadedChunks, packet.unloadedChunks);
+        packet.streamCenter = column;
+        packet.renderDistance = world.streamingRadius();
+        for (size_t u = firstUnloaded; u < packet.unloadedChunks.size();) {
+            auto match = std::find_if(packet.loadedChunks.begin(), packet.loadedChunks.end(),
+                [&](const Chunk* chunk) { return chunk->coord == packet.unloadedChunks[u]; });
+            if (match == packet.loadedChunks.end()) {
+                u++;
+                continue;
+            }
+            packet.loadedChunks.erase(match);
+            packet.unloadedChunks.erase(packet.unloadedChunks.begin() + u);
+        }
 
-    glBindVertexArray(grassVAO);
+        // Block edits against the latest pick; they land before re-meshing
+        processBlockEdits(world, entities, packet.particleEmitters, picked ? &pick : nullptr, player);
 
-    glBindBuffer(GL_ARRAY_BUFFER, grassVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(grass_vertices), grass_vertices, GL_STATIC_DRAW);
+        // Schematics move a slice of cells a tick, so no tick waits on a whole build
+        if (schematicExport.active()) {
+            if (!schematicExport.step(world, SCHEMATIC_BLOCKS_PER_TICK))
+                console.print("Export: write failed after %d of %d cells", schematicExport.cellsDone, schematicExport.cellCount);
+            else if (!schematicExport.active())
+                console.print("Export: done, %d cells", schematicExport.cellCount);
+        }
+        if (schematicImport.active()) {
+            if (!schematicImport.step(world, SCHEMATIC_BLOCKS_PER_TICK))
+                console.print("Import: damaged file, stopped after %d of %d cells", schematicImport.cellsDone, schematicImport.cellCount);
+            else if (!schematicImport.active())
+                console.print("Import: done, %d blocks changed", schematicImport.changedBlocks);
+        }
 
-    // Bind EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    // EBO data is already set, no need to call glBufferData again
+        // Water flows from the cells around the last steps' changes; the
+        // chunks it reaches re-mesh in the background. Grass spreading and
+        // the like, over a bounded number of sections. Both change the
+        // world, which on a server only its owner does.
+        if (!connectAddress)
+            worldSimulation.tick(world);
+        // The tick's block changes so far reach lighting, water, navigation
+        // and the server's change log as one batch
+        world.flushBlockEvents();
+
+        // Dropped items and other moving objects, then the ones that ended
+        // up inside each other pushed apart
+        updateEntities(entities, world, dt);
+        entityBroadphase.update(entities);
+        entityBroadphase.findPairs(entities, &jobSystem, entityPairs);
+        separateEntities(entities, world, entityPairs);
+
+        // Light new columns and relight around edits; finished jobs mark
+        // the chunks they change for re-meshing
+        lightEngine.update(world, glm::ivec3(glm::floor(feet / (double)CHUNK_SIZE)));
+        navigation.update(world, glm::ivec3(glm::floor(feet / (double)CHUNK_SIZE)));
+        world.compressColdChunks(COLD_CHUNKS_PER_TICK);
+    };
 
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // Render thread
+    // -------------
+    // AsyncChain steps that make GL calls hop here; they run once a frame
+    ThreadHop glThread;
+    glfwMakeContextCurrent(NULL);
+    std::thread renderThread([&] {
+        glfwMakeContextCurrent(window);
+        profilerSetThreadName("Render");
+        setCurrentThreadPriority(THREAD_HIGH_PRIORITY);
+        int viewportWidth = framebufferWidth;
+        int viewportHeight = framebufferHeight;
+        glViewport(0, 0, viewportWidth, viewportHeight);
+        RenderQueue renderQueue;    // Per-chunk draws of the fallback path
+        bool chunkProgramsReady = false;
+        int pendingMeshes = 0;      // Left after this frame's mesh submissions, for the warm-up
+        int resumePending = -1;     // ... and of a resumed session's view
+        // The first frame after the warm-up ends the start-up timeline
+        bool firstFrameShown = false;
+        auto frameShown = [&](const FramePacket& frame) {
+            if (frame.warmingUp || firstFrameShown)
+                return;
+            firstFrameShown = true;
+            startupTimeline.mark("first frame");
+            std::cout << startupTimeline.summary() << std::endl;
+        };
+        int64_t frameStart = profilerNow();     // Render loop iteration boundaries, for the profiler view
+        int64_t previousFrameStart = frameStart;
+        PresentMode requestedPresentMode = PRESENT_MODE_COUNT;  // Applied to the swap interval so far
+        bool requestedCapture = false;  // Video capture started
+        uint32_t jitterIndex = 0;   // Frames drawn with a temporal upscaling jitter
+        SwapFences swapFences;
+
+        for (;;)
+        {
+            FramePacket* packet;
+            {
+                PROFILE_ZONE("Wait for packet");
+                packet = pipeline.acquire();
+            }
+            if (!packet)
+                break;
+            const FramePacket& frame = *packet;
+            previousFrameStart = frameStart;
+            frameStart = profilerNow();
+
+            // Per-frame scratch from last frame is no longer referenced
+            frameArena().reset();
+            threadArena().reset();
+            frameStream.beginFrame();
+            chunkMeshStaging().beginFrame();
+            glState().resetCounters();
+            gpuProfiler.statistics = frame.profilerView;   // Shown beside the pass times
+            gpuProfiler.beginFrame();
+            dynamicResolution.budgetMs = frame.frameBudgetMs;
+            chunkRenderer.meshSubmitsPerFrame = frame.meshSubmitsPerFrame;
+
+            // Meshing and uploads go nearest first
+            glm::ivec3 cameraChunk = glm::ivec3(glm::floor(frame.eye / (double)CHUNK_SIZE));
+            {
+                // Chunk set and mesh updates read the world, which the main thread
+                // leaves alone until release()
+                PROFILE_ZONE("Chunk updates");
+                for (const glm::ivec3& coord : frame.unloadedChunks)
+                    chunkRenderer.removeChunk(coord);
+                for (Chunk* chunk : frame.loadedChunks)
+                    chunkRenderer.addChunk(chunk);
+
+                // Rebuild every chunk when the builder changes and report the difference
+                if (frame.remeshAll) {
+                    for (ChunkRenderData& data : chunkRenderer.chunks)
+                        data.chunk->dirty = true;
+                    chunkRenderer.updateDirty(world, frame.meshMode, frame.instancing, nullptr, cameraChunk, frame.eye); // Synchronous, so the timings are complete
+
+                    if (!frame.instancing) {
+                        int totalQuads = 0;
+                        double totalMs = 0.0;
+                        for (const ChunkRenderData& data : chunkRenderer.chunks) {
+                            totalQuads += data.mesh.quadCount;
+                            totalMs += data.mesh.buildTimeMs;
+                        }
+                        const char* modeNames[MESH_MODE_COUNT] = { "Culled", "Binary", "Greedy" };
+                        std::cout << modeNames[frame.meshMode] << " meshing: "
+                            << totalQuads * 2 << " triangles, " << totalMs << " ms" << std::endl;
+                    }
+                }
 
-    // Unbind VAO
-    glBindVertexArray(0);
+                // Drop meshes out of view while over the heap budget; ones back in view are re-meshed
+                if (!frame.instancing)
+                    chunkRenderer.enforceMeshBudget(frame.frustum, cameraChunk);
+
+                // Re-mesh only chunks whose voxels have changed, on the mesher threads
+                chunkRenderer.updateDirty(world, frame.meshMode, frame.instancing, &chunkMesher, cameraChunk, frame.eye);
+                pendingMeshes = chunkRenderer.pendingCount();
+                resumePending = frame.resumeChunks ? (int)frame.resumeChunks->size() - chunkRenderer.residentCount(*frame.resumeChunks) : -1;
+
+                // The horizon reads the world's heights, so it is built here
+                if (frame.horizonCulling)
+                    horizonCuller.build(world, chunkRenderer, frame.eye);
+                else
+                    horizonCuller.clear();
+
+                // The occupancy volume reads the voxels of the chunks that changed
+                if (frame.occupancyVolume)
+                    occupancyVolume.update(world, chunkRenderer, frame.eye);
+                else
+                    occupancyVolume.clear();
+
+                // Minimap tiles of the columns that changed, from their voxels
+                if (frame.minimap)
+                    minimap.update(world, chunkRenderer, frame.eye);
+            }
 
-    // Initialize FreeType for text rendering (code omitted for brevity)
-    // ...
+            // Distant tiles follow the streamed area; none are kept while LOD is off
+            if (frame.lodDistance > 0 && frame.farField != FAR_FIELD_RAYMARCH)
+                lodTerrain.update(frame.streamCenter, frame.renderDistance, frame.lodDistance);
+            else if (lodTerrain.tileCount() > 0)
+                lodTerrain.destroy();
+            pipeline.release();
+
+            // From here on only render-side state is touched. Run the GL
+            // steps hopped here, then upload what the mesher finished within
+            // this frame's budget. The heap is compacted first: moving an
+            // allocation waits for its uploads, and this frame's are left to
+            // the upload thread until the first draw from the heap.
+            glThread.runPending();
+            chunkRenderer.clock += frame.frameSeconds;
+            chunkRenderer.fadeSeconds = frame.fog ? CHUNK_FADE_SECONDS : 0.0f;
+            chunkMeshHeap().defragment(MESH_HEAP_MOVES_PER_FRAME);
+            int uploadedMeshes = chunkRenderer.uploadMeshes(chunkMesher, frame.meshUploadBytes, cameraChunk);
+            if (lodTerrain.uploadMeshes(frame.lodUploadBytes) > 0)
+                horizonImpostor.invalidate();
+            uploadThread.kick();
+            if (frame.lodDistance > 0 && frame.farField == FAR_FIELD_RAYMARCH)
+                raymarchTerrain.update(glm::ivec2(floorDivChunk((int)std::floor(frame.eye.x)), floorDivChunk((int)std::floor(frame.eye.z))));
+
+            // Minimised: the chunks and meshes above keep up, but nothing is
+            // drawn or swapped
+            if (frame.paused) {
+                frameStream.endFrame();
+                chunkMeshStaging().endFrame();
+                packet->quads = 0;
+                packet->drawCalls = 0;
+                packet->chunkCount = (int)chunkRenderer.chunks.size();
+                packet->uploadedBytes = chunkRenderer.uploadedBytes;
+                packet->uploadThreadMs = uploadThread.active() ? (float)uploadThread.batchMs : -1.0f;
+                packet->uploadedMeshes = uploadedMeshes;
+                packet->pendingMeshes = pendingMeshes;
+                packet->resumePending = resumePending;
+                packet->programsReady = chunkProgramsReady;
+                gpuProfiler.endFrame();
+                glFlush();
+                continue;
+            }
 
-    // Render loop
-    // -----------
-    int total_rendered_blocks = 0;
+            // Render
+            // ------
+            viewportWidth = frame.framebufferWidth;
+            viewportHeight = frame.framebufferHeight;
+
+            // Scene resolution for the newest GPU frame time read back
+            if (frame.dynamicResolution)
+                dynamicResolution.update(gpuProfiler.frameMs);
+            else
+                dynamicResolution.reset();
+            int sceneWidth = dynamicResolution.scaled(viewportWidth);
+            int sceneHeight = dynamicResolution.scaled(viewportHeight);
+
+            // Sun shadows, before the scene target is bound: the near cascade
+            // every frame, cached ones once their casters or box changed
+            bool shadows = shadowsAvailable && frame.shadows && chunkProgramsReady && !frame.instancing;
+            if (shadows) {
+                for (const glm::ivec3& coord : chunkRenderer.changedMeshes) {
+                    glm::vec3 boxMin = glm::vec3(coord) * (float)CHUNK_SIZE;
+                    shadowCascades.invalidate(boxMin, boxMin + glm::vec3((float)CHUNK_SIZE));
+                }
+                float distance = glm::clamp(frame.renderDistance * (float)CHUNK_SIZE, MIN_SHADOW_DISTANCE, MAX_SHADOW_DISTANCE);
+                shadowCascades.plan(frame.eye, frame.sunDirection, distance);
+            }
+            else {
+                // Nothing is kept up to date meanwhile; start over when shadows return
+                shadowCascades.invalidateAll();
+            }
+            chunkRenderer.changedMeshes.clear();
+
+            // Lookup matrices for this frame's eye, also bound while casters are drawn
+            ShadowUniforms shadowUniforms = shadowCascades.uniforms(frame.eye, shadows);
+            size_t shadowOffset = frameStream.write(&shadowUniforms, sizeof(shadowUniforms), (size_t)uniformAlignment);
+            if (shadowOffset != StreamBuffer::STREAM_FULL)
+                glState().bindBufferRange(GL_UNIFORM_BUFFER, SHADOW_BINDING, frameStream.buffer, (GLintptr)shadowOffset, sizeof(shadowUniforms));
+
+            int shadowDraws = 0;
+            if (shadows) {
+                PROFILE_ZONE("Shadows");
+                GpuPassScope gpuShadows(gpuProfiler, "Shadows");
+                depthProgram.use();
+                int* casters = frameArena().allocArray<int>(chunkRenderer.chunks.size());
+                int shadowQuads = 0;
+                for (int c = 0; c < SHADOW_CASCADES; c++) {
+                    ShadowCascade& cascade = shadowCascades.cascades[c];
+                    if (!cascade.render)
+                        continue;
+
+                    // Casters are drawn like the scene, seen from the sun and
+                    // relative to the cascade's anchor
+                    CameraUniforms light;
+                    light.view = glm::mat4(1.0f);
+                    light.projection = glm::mat4(1.0f);
+                    light.viewProj = cascade.viewProj;
+                    light.cameraPos = glm::vec4(glm::vec3(cascade.anchor), 1.0f);
+                    light.fog = glm::vec4(0.0f);
+                    size_t lightOffset = frameStream.write(&light, sizeof(light), (size_t)uniformAlignment);
+                    if (lightOffset == StreamBuffer::STREAM_FULL) {
+                        cascade.dirty = true;
+                        continue;
+                    }
+                    glState().bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, frameStream.buffer, (GLintptr)lightOffset, sizeof(light));
 
-    while (!glfwWindowShouldClose(window))
-    {
-        // Per-frame time logic
-        // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+                    shadowCascades.beginCascade(c);
+                    int casterCount = cullAABBs(cascade.casters, chunkRenderer.bounds, casters);
+                    shadowDraws += glFeatures.multiDrawIndirect ?
+                        chunkRenderer.drawIndirect(casters, casterCount, frameStream, cascade.anchor, shadowQuads, false) :
+                        chunkRenderer.drawEach(casters, casterCount, cascade.anchor, shadowQuads, false);
+                }
+                shadowCascades.endCascades();
+            }
 
-        // Input
-        // -----
-        processInput(window);
+            // Fog for every camera of the frame, the colour of the sky's
+            // horizon, complete a chunk short of the render distance or at
+            // the LOD horizon
+            SkyColors skyPalette = skyColors(frame.sunDirection);
+            glm::vec4 fog(skyPalette.horizon, 0.0f);
+            if (frame.fog)
+                fog.w = (float)((frame.lodDistance > 0 ? frame.lodDistance : std::max(frame.renderDistance - 1, 1)) * CHUNK_SIZE);
+
+            // Stale faces of the horizon impostor, the LOD tiles drawn into
+            // them from its capture point. The streamed circle is left out
+            // short of the render distance, by as far as the eye may move
+            // before the next capture, so no gap opens at its edge meanwhile.
+            if (frame.lodDistance > 0 && frame.farField == FAR_FIELD_IMPOSTOR && chunkProgramsReady) {
+                horizonImpostor.follow(frame.eye);
+                glm::vec3 forward(-frame.view[0][2], -frame.view[1][2], -frame.view[2][2]);
+                int face = horizonImpostor.nextFace(forward);
+                if (face >= 0) {
+                    PROFILE_ZONE("Capture horizon");
+                    GpuPassScope gpuCapture(gpuProfiler, "Horizon capture");
+                    const glm::dvec3& capturePoint = horizonImpostor.capturePoint();
+                    float captureFar = std::max(DEFAULT_FAR_PLANE, frame.lodDistance * CHUNK_SIZE * 1.5f);
+                    int margin = (int)std::ceil(horizonImpostor.recaptureDistance / CHUNK_SIZE);
+                    glm::vec2 captureStreamOrigin(glm::dvec2(frame.streamCenter) * (double)CHUNK_SIZE - glm::dvec2(capturePoint.x, capturePoint.z));
+                    glState().polygonMode(GL_FILL);
+                    lodProgram.use();
+                    glUniform2f(lodProgram.uniform("streamOrigin"), captureStreamOrigin.x, captureStreamOrigin.y);
+                    glUniform1f(lodProgram.uniform("streamRadius"), (float)std::max(frame.renderDistance - margin, 0));
+                    for (int i = 0; i < horizonImpostor.facesPerFrame && face >= 0; i++) {
+                        CameraUniforms capture;
+                        capture.view = horizonImpostor.faceView(face);
+                        capture.projection = horizonImpostor.faceProjection(captureFar);
+                        capture.viewProj = capture.projection * capture.view;
+                        capture.cameraPos = glm::vec4(glm::vec3(capturePoint), 1.0f);
+                        capture.fog = fog;
+                        size_t captureOffset = frameStream.write(&capture, sizeof(capture), (size_t)uniformAlignment);
+                        if (captureOffset == StreamBuffer::STREAM_FULL)
+                            break;
+                        glState().bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, frameStream.buffer, (GLintptr)captureOffset, sizeof(capture));
+
+                        // Culled like the main view, in capture-relative space
+                        Frustum captureFrustum;
+                        captureFrustum.update(capture.viewProj * glm::translate(glm::mat4(1.0f), -glm::vec3(capturePoint)));
+                        horizonImpostor.beginFace(face);
+                        int captureQuads = 0;
+                        lodTerrain.draw(frameStream, captureFrustum, capturePoint, glFeatures.multiDrawIndirect, captureQuads);
+                        horizonImpostor.endFace(face);
+                        face = horizonImpostor.nextFace(forward);
+                    }
+                }
+            }
 
-        // Render
-        // ------
-        glClearColor(0.53f, 0.81f, 0.92f, 1.0f); // Light sky blue background
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // The clouds the sky will show, before the scene's target is bound
+            bool drawClouds = frame.clouds && !frame.overdraw && sceneWidth > 0 && sceneHeight > 0;
+            if (drawClouds) {
+                PROFILE_ZONE("Clouds");
+                GpuPassScope gpuClouds(gpuProfiler, "Clouds");
+                clouds.update(frame.projection * frame.view, frame.eye, skyPalette, frame.frameSeconds,
+                    sceneWidth, sceneHeight, CLOUD_TEXTURE_UNIT);
+            }
+            else
+                clouds.invalidate();
+
+            glState().polygonMode(frame.wireframe ? GL_LINE : GL_FILL);  // Filtered unless toggled
+
+            // The scene goes to the Hi-Z buffer's target, the headless one or
+            // the scaled one, else straight to the window. Weighted OIT needs
+            // the scene's depth attached to its own targets, so it also takes
+            // the scaled target at full resolution.
+            bool weightedOit = frame.weightedOit && chunkProgramsReady && !frame.instancing && sceneWidth > 0 && sceneHeight > 0;
+            unsigned int sceneFramebuffer = 0;
+            unsigned int sceneDepthTexture = 0;
+            unsigned int sceneDepthBuffer = 0;
+            if (hizAvailable) {
+                // Targets follow the scene size; a minimised window keeps the old ones
+                if (sceneWidth > 0 && sceneHeight > 0 && hiz.resize(sceneWidth, sceneHeight))
+                    hizValid = false;
+                hiz.bindScene();
+                sceneFramebuffer = hiz.framebuffer;
+                sceneDepthTexture = hiz.depthTexture;
+            }
+            else if (headless) {
+                offscreen.bind();
+                sceneFramebuffer = offscreen.framebuffer;
+                sceneDepthBuffer = offscreen.depthBuffer;
+            }
+            else if (sceneWidth != viewportWidth || sceneHeight != viewportHeight || weightedOit) {
+                if (sceneTarget.resize(sceneWidth, sceneHeight)) {
+                    sceneTarget.bind();
+                    sceneFramebuffer = sceneTarget.framebuffer;
+                    sceneDepthBuffer = sceneTarget.depthBuffer;
+                }
+                else {
+                    sceneWidth = viewportWidth;
+                    sceneHeight = viewportHeight;
+                }
+            }
+            else if (sceneTarget.framebuffer != 0) {
+                // Back at full resolution, drawn straight to the window
+                sceneTarget.destroy();
+            }
+            bool scaledScene = sceneWidth != viewportWidth || sceneHeight != viewportHeight;
+            bool presentSceneTarget = !hizAvailable && !headless && sceneFramebuffer != 0;
+            // Below the window's resolution the Hi-Z target's scene is drawn
+            // jittered and reconstructed; at full resolution it is shown as is
+            bool temporalUpscale = frame.temporalUpscale && hizAvailable && scaledScene && sceneWidth > 0 && sceneHeight > 0;
+            glm::vec2 jitter(0.0f);
+            if (temporalUpscale)
+                jitter = TemporalUpscaler::jitter(jitterIndex++, sceneWidth, sceneHeight);
+            else
+                temporalUpscaler.invalidate();
+            weightedOit = weightedOit && sceneFramebuffer != 0;
+            glViewport(0, 0, sceneWidth, sceneHeight);
+            // Colour needs no clear: the sky fills whatever the scene leaves
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+            // Finish the chunk programs once the driver has built them all;
+            // meshes are drawn flat (and instanced cubes not at all) until then
+            if (!chunkProgramsReady) {
+                bool linked = chunkPrograms.poll();
+                linked = oitPrograms.poll() && linked;
+                linked = depthProgram.poll() && linked;
+                linked = overdrawProgram.poll() && linked;
+                linked = instancedProgram.poll() && linked;
+                linked = lodProgram.poll() && linked;
+                if (linked) {
+                    bindChunkPrograms();
+                    chunkProgramsReady = true;
+                }
+            }
 
-        // Activate shader
-        glUseProgram(shaderProgram);
+            // The overdraw heatmap is built up from black by the chunk
+            // passes alone; nothing else is drawn over it
+            bool overdraw = frame.overdraw && chunkProgramsReady && !frame.instancing;
+            if (overdraw) {
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
 
-        // Camera/view transformation
-        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        // Projection
-        glm::mat4 projection = glm::perspective(glm::radians(fov), (float)WIDTH / (float)HEIGHT, 0.1f, 500.0f);
-
-        // Retrieve the matrix uniform locations
-        unsigned int modelLoc = glGetUniformLocation(shaderProgram, "model");
-        unsigned int viewLoc = glGetUniformLocation(shaderProgram, "view");
-        unsigned int projLoc = glGetUniformLocation(shaderProgram, "projection");
-
-        // Pass the matrices to the shader
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-        // Define the number of chunks for each material
-        int stoneChunks = 13;
-        int dirtChunks = 2;
-        int grassChunks = 1;
-        int totalChunks = stoneChunks + dirtChunks + grassChunks;
-        const int chunkSize = 16;
-
-        total_rendered_blocks = 0;
-
-        // Render loop for chunks
-        for (int chunkY = 0; chunkY < totalChunks; chunkY++) {
-
-            // Initialize the chunk data (make it hollow)
-            int chunk[chunkSize][chunkSize][chunkSize];
-
-            for (int x = 0; x < chunkSize; x++) {
-                for (int y = 0; y < chunkSize; y++) {
-                    for (int z = 0; z < chunkSize; z++) {
-                        // Set outer blocks to 1 (solid), inner blocks to 0 (air)
-                        if (x == 0 || x == chunkSize - 1 ||
-                            y == 0 || y == chunkSize - 1 ||
-                            z == 0 || z == chunkSize - 1) {
-                            chunk[x][y][z] = 1; // Solid block
-                        }
-                        else {
-                            chunk[x][y][z] = 0; // Air
-                        }
-                    }
+            // Late latching: turn the view to the newest mouse look, as far as
+            // the culling frustum allows. The packet is this thread's until
+            // the next acquire(), so it is updated in place.
+            if (frame.lateLatch) {
+                float latestYaw, latestPitch;
+                lookLatch.read(latestYaw, latestPitch);
+                float turnYaw = glm::clamp(latestYaw - frame.yaw, -LATE_LATCH_MARGIN_DEGREES, LATE_LATCH_MARGIN_DEGREES);
+                float turnPitch = glm::clamp(latestPitch - frame.pitch, -LATE_LATCH_MARGIN_DEGREES, LATE_LATCH_MARGIN_DEGREES);
+                if (turnYaw != 0.0f || turnPitch != 0.0f) {
+                    glm::mat4 latched = glm::lookAt(glm::vec3(0.0f), lookDirection(frame.yaw + turnYaw, frame.pitch + turnPitch), glm::vec3(0.0f, 1.0f, 0.0f));
+                    glm::mat4 turn = latched * glm::inverse(frame.view);
+                    packet->view = latched;
+                    for (int e = 0; e < frame.views; e++)
+                        packet->eyeViews[e] = turn * frame.eyeViews[e];
                 }
             }
 
-            // Bind the appropriate VAO
-            if (chunkY < stoneChunks) {
-                glBindVertexArray(stoneVAO);
+            // Point lights of the lamps around the eye for this view, at the
+            // scene's resolution; an empty grid leaves the programs reading none
+            // Then the chunk programs for what this frame shades with
+            const ShaderProgram* chunkProgram = &fallbackProgram;
+            const ShaderProgram* oitProgram = &fallbackProgram;
+            if (chunkProgramsReady && !frame.instancing) {
+                bool pointLights = frame.pointLights && clusteredLights.update(chunkRenderer, frame.eye, frame.view, frame.projection) > 0;
+                uint32_t features = (fog.w > 0.0f ? CHUNK_FEATURE_FOG : 0) | (shadows ? CHUNK_FEATURE_SHADOWS : 0)
+                    | (pointLights ? CHUNK_FEATURE_POINT_LIGHTS : 0);
+                chunkProgram = &chunkPrograms.select(features);
+                oitProgram = &oitPrograms.select(features);
+                clusteredLights.setUniforms(*chunkProgram, sceneWidth, sceneHeight, pointLights);
+                clusteredLights.setUniforms(*oitProgram, sceneWidth, sceneHeight, pointLights);
             }
-            else if (chunkY < stoneChunks + dirtChunks) {
-                glBindVertexArray(dirtVAO);
+
+            // Activate shader for the current chunk renderer
+            const ShaderProgram& program = !chunkProgramsReady ? fallbackProgram :
+                frame.instancing ? instancedProgram : *chunkProgram;
+            program.use();
+
+            // Upload the camera block once for every program this frame
+            const glm::dvec3& eye = frame.eye;
+            CameraUniforms camera;
+            camera.view = frame.view;
+            camera.projection = TemporalUpscaler::jittered(frame.projection, jitter);
+            camera.viewProj = camera.projection * frame.view;
+            camera.cameraPos = glm::vec4(glm::vec3(eye), 1.0f);
+            camera.fog = fog;
+            camera.views.x = (float)frame.views;
+            for (int e = 0; e < frame.views; e++)
+                camera.eyeViewProj[e] = camera.projection * frame.eyeViews[e];
+            size_t cameraOffset = frameStream.write(&camera, sizeof(camera), (size_t)uniformAlignment);
+            if (cameraOffset != StreamBuffer::STREAM_FULL)
+                glState().bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, frameStream.buffer, (GLintptr)cameraOffset, sizeof(camera));
+
+            int quads = 0;
+            int draws = 0;
+
+            // Chunk passes in stereo draw each chunk once per eye (see the
+            // chunk vertex shader), clipped to its half of the target; the
+            // culled draws are built for that count
+            bool stereoChunks = frame.views == 2 && chunkProgramsReady;
+            auto stereoChunkPasses = [&](bool begin) {
+                if (!stereoChunks)
+                    return;
+                setChunkViewCount(begin ? 2 : 1);
+                if (begin)
+                    glState().enable(GL_CLIP_DISTANCE0);
+                else
+                    glState().disable(GL_CLIP_DISTANCE0);
+            };
+            stereoChunkPasses(true);
+
+            // Cull once for this frame
+            bool queryCulling = frame.occlusionQueries && !frame.instancing;
+            bool gpuCulling = gpuCullingAvailable && frame.gpuCulling && !frame.instancing && !queryCulling;
+            int visibleCount = 0;
+            if (gpuCulling) {
+                // Visibility and draw commands are produced on the GPU. The pyramid
+                // is from last frame, so shift its matrix to this frame's eye.
+                bool occlusion = hizValid && frame.occlusionCulling;
+                glm::mat4 reprojection = hizViewProj * glm::translate(glm::mat4(1.0f), glm::vec3(eye - hizEye));
+                gpuCuller.setOcclusion(occlusion ? &hiz : nullptr, reprojection);
+                PROFILE_ZONE("Cull");
+                GpuPassScope gpuCull(gpuProfiler, "Cull");
+                gpuCuller.cull(chunkRenderer, frame.frustum, eye);
             }
             else {
-                glBindVertexArray(grassVAO);
+                // Frustum / cave culling on the CPU
+                PROFILE_ZONE("Cull");
+                visibleCount = cullChunks(chunkRenderer, frame.frustum, eye, frame.visibilityCulling);
+                visibleCount = horizonCuller.filter(chunkRenderer);
             }
 
-            // Frustum culling
-            if (!isChunkInViewFrustum(glm::vec3(0.0f, chunkY * chunkSize, 0.0f), view, projection, chunkSize)) {
-                continue; // Skip rendering if chunk is not in view
+            // Draw the culled chunks with 'pass'; returns the draw calls
+            auto drawChunks = [&](const ShaderProgram& pass, int& passQuads) {
+                const char* passName = &pass == &depthProgram ? "Depth pre-pass" : "Draw chunks";
+                PROFILE_ZONE(passName);
+                GpuPassScope gpuPass(gpuProfiler, passName);
+                if (gpuCulling)
+                    return gpuCuller.draw(pass, passQuads);
+                if (queryCulling) // Occlusion decided per chunk on the GPU
+                    return occlusionQueries.draw(chunkRenderer, chunkRenderer.visible, visibleCount, eye, pass, passQuads);
+
+                pass.use();
+                if (!frame.instancing && glFeatures.multiDrawIndirect) {
+                    // Whole opaque pass in one indirect call per heap page
+                    return chunkRenderer.drawIndirect(frameStream, eye, passQuads);
+                }
+
+                // Queue one draw per chunk keyed by its vertex array (heap page
+                // or instance VAO) and distance, so binds happen once per bucket
+                // and each bucket is drawn front to back
+                RenderPass passId = &pass == &depthProgram ? PASS_DEPTH : PASS_OPAQUE;
+                renderQueue.clear();
+                for (int v = 0; v < visibleCount; v++) {
+                    int index = chunkRenderer.visible[v];
+                    const ChunkRenderData& data = chunkRenderer.chunks[index];
+                    int material = frame.instancing ? (int)data.instances.VAO : data.mesh.page();
+                    if (material < 0)
+                        continue;
+                    glm::vec3 center = data.chunk->relativeOrigin(eye) + glm::vec3(CHUNK_SIZE * 0.5f);
+                    renderQueue.push(renderSortKey(passId, pass.id, (uint32_t)material, glm::dot(center, center)), (uint32_t)index);
+                }
+                renderQueue.sort();
+
+                if (!frame.instancing) {
+                    // Meshes share heap pages, so the VAO only changes between
+                    // pages; directions facing away from the eye are skipped.
+                    // Long queues are recorded across the workers.
+                    int* order = frameArena().allocArray<int>(renderQueue.size());
+                    for (int q = 0; q < renderQueue.size(); q++)
+                        order[q] = (int)renderQueue.item(q);
+                    chunkRenderer.drawEach(order, renderQueue.size(), eye, passQuads);
+                    return renderQueue.size();
+                }
+
+                // One offset upload and one draw call per chunk
+                for (int q = 0; q < renderQueue.size(); q++) {
+                    const ChunkRenderData& data = chunkRenderer.chunks[renderQueue.item(q)];
+                    glUniform3fv(chunkOffsetLoc, 1, glm::value_ptr(data.chunk->relativeOrigin(eye)));
+                    data.instances.draw();
+                    passQuads += data.instances.faceCount;
+                }
+                return renderQueue.size();
+            };
+
+            if (!chunkProgramsReady && frame.instancing) {
+                // Nothing to draw instanced cubes with yet
+            }
+            else if (overdraw) {
+                // Every surface counts, however far behind the nearest
+                PipelineState additive;
+                additive.program = &overdrawProgram;
+                additive.depthTest = false;
+                additive.depthWrite = false;
+                additive.blend = true;
+                glBlendFunc(GL_ONE, GL_ONE);
+                renderDevice().bindPipeline(additive);
+                draws = drawChunks(overdrawProgram, quads);
+                renderDevice().bindPipeline(PipelineState());
             }
+            else if (frame.depthPrePass && chunkProgramsReady && !frame.instancing && !queryCulling) {
+                // Lay down depth only, then shade just the nearest surface of each pixel
+                PipelineState depthOnly;
+                depthOnly.program = &depthProgram;
+                depthOnly.colorWrite = false;
+                PipelineState shadeEqual;
+                shadeEqual.program = chunkProgram;
+                shadeEqual.depthFunc = GL_EQUAL;
+                shadeEqual.depthWrite = false;
+
+                int prePassQuads = 0;
+                renderDevice().bindPipeline(depthOnly);
+                draws = drawChunks(depthProgram, prePassQuads);
+                renderDevice().bindPipeline(shadeEqual);
+                draws += drawChunks(*chunkProgram, quads);
+                renderDevice().bindPipeline(PipelineState());
+            }
+            else {
+                draws = drawChunks(program, quads);
+            }
+            stereoChunkPasses(false);
 
-            // Render blocks within this chunk
-            for (int x = 0; x < chunkSize; x++) {
-                for (int y = 0; y < chunkSize; y++) {
-                    for (int z = 0; z < chunkSize; z++) {
-                        if (chunk[x][y][z] == 0) continue; // Skip air blocks
+            draws += shadowDraws;
 
-                        glm::vec3 blockPos(x * 1.0f, (chunkY * chunkSize + y) * 1.0f, z * 1.0f);
-                        glm::mat4 model = glm::translate(glm::mat4(1.0f), blockPos);
-                        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            // The passes after draw one eye at a time in stereo: into its half
+            // of the target, with a camera block of its own. 'pass' gets the
+            // eye's viewProj.
+            auto forEachView = [&](auto&& pass) {
+                if (frame.views == 1) {
+                    pass(camera.viewProj);
+                    return;
+                }
+                int halfWidth = sceneWidth / 2;
+                for (int e = 0; e < 2; e++) {
+                    CameraUniforms eyeCamera = camera;
+                    eyeCamera.view = frame.eyeViews[e];
+                    eyeCamera.viewProj = camera.eyeViewProj[e];
+                    eyeCamera.views.x = 1.0f;
+                    size_t eyeOffset = frameStream.write(&eyeCamera, sizeof(eyeCamera), (size_t)uniformAlignment);
+                    if (eyeOffset == StreamBuffer::STREAM_FULL)
+                        continue;
+                    glState().bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, frameStream.buffer, (GLintptr)eyeOffset, sizeof(eyeCamera));
+                    glViewport(e * halfWidth, 0, halfWidth, sceneHeight);
+                    pass(eyeCamera.viewProj);
+                }
+                glViewport(0, 0, sceneWidth, sceneHeight);
+                if (cameraOffset != StreamBuffer::STREAM_FULL)
+                    glState().bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, frameStream.buffer, (GLintptr)cameraOffset, sizeof(camera));
+            };
+
+            // LOD tiles last, mostly behind the chunks' depth; or the horizon
+            // ray marched, where nothing nearer has been drawn
+            if (overdraw) {
+                // Only chunks in the heatmap
+            }
+            else if (frame.lodDistance > 0 && frame.farField == FAR_FIELD_RAYMARCH) {
+                PROFILE_ZONE("Draw far field");
+                GpuPassScope gpuFar(gpuProfiler, "Ray-marched far field");
+                draws += raymarchTerrain.draw(camera.viewProj, eye, frame.streamCenter, frame.renderDistance, frame.lodDistance,
+                    frame.sunDirection, sceneWidth, sceneHeight, FAR_FIELD_TEXTURE_UNIT);
+            }
+            else if (frame.lodDistance > 0 && frame.farField == FAR_FIELD_LOD && chunkProgramsReady) {
+                PROFILE_ZONE("Draw LOD");
+                GpuPassScope gpuLod(gpuProfiler, "LOD terrain");
+                lodProgram.use();
+                glm::vec2 streamOrigin(glm::dvec2(frame.streamCenter) * (double)CHUNK_SIZE - glm::dvec2(eye.x, eye.z));
+                glUniform2f(lodProgram.uniform("streamOrigin"), streamOrigin.x, streamOrigin.y);
+                glUniform1f(lodProgram.uniform("streamRadius"), (float)frame.renderDistance);
+                forEachView([&](const glm::mat4&) {
+                    draws += lodTerrain.draw(frameStream, frame.frustum, eye, glFeatures.multiDrawIndirect, quads);
+                });
+            }
 
-                        // Check and render only the visible faces
+            if (!frame.entities.empty() && !overdraw) {
+                PROFILE_ZONE("Draw entities");
+                GpuPassScope gpuEntities(gpuProfiler, "Entities");
+                forEachView([&](const glm::mat4&) {
+                    draws += entityRenderer.draw(frame.entities, eye, frame.sunDirection, frameStream);
+                });
+            }
+            // Ground cover near the eye; the scene targets are single-sampled
+            if (frame.foliageRadius > 0.0f && !overdraw) {
+                GpuPassScope gpuFoliage(gpuProfiler, "Foliage");
+                foliageRenderer.radius = frame.foliageRadius;
+                forEachView([&](const glm::mat4&) {
+                    draws += foliageRenderer.draw(chunkRenderer, frame.frustum, eye, frame.sunDirection, frameStream, 1);
+                });
+            }
 
-                        // Check -X face
-                        if (x == 0 || chunk[x - 1][y][z] == 0) {
-                            // Render left face
-                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(24 * sizeof(GLuint)));
-                        }
+            // The sky once everything opaque is in, over the pixels left at
+            // the far plane; then the impostor's horizon in front of it
+            if (!overdraw) {
+                PROFILE_ZONE("Draw sky");
+                GpuPassScope gpuSky(gpuProfiler, "Sky");
+                forEachView([&](const glm::mat4& viewProj) {
+                    draws += sky.draw(viewProj, frame.sunDirection, skyPalette, drawClouds ? clouds.texture() : 0, CLOUD_TEXTURE_UNIT);
+                });
+            }
+            if (frame.lodDistance > 0 && frame.farField == FAR_FIELD_IMPOSTOR && !overdraw) {
+                PROFILE_ZONE("Draw horizon");
+                GpuPassScope gpuHorizon(gpuProfiler, "Horizon impostor");
+                forEachView([&](const glm::mat4& viewProj) {
+                    draws += horizonImpostor.draw(viewProj, eye, (float)(frame.renderDistance * CHUNK_SIZE), FAR_FIELD_TEXTURE_UNIT);
+                });
+            }
 
-                        // Check +X face
-                        if (x == chunkSize - 1 || chunk[x + 1][y][z] == 0) {
-                            // Render right face
-                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(30 * sizeof(GLuint)));
-                        }
+            // Water and glass over everything opaque, farthest chunk first and
+            // each chunk's faces back to front. Depth is tested but not
+            // written, so translucent faces behind one another all blend.
+            // With weighted OIT order doesn't matter: the meshes go out one
+            // indirect call per heap page, into the OIT targets, and are
+            // resolved over the scene after.
+            if (weightedOit && !overdraw && !weightedOitTarget.resize(sceneWidth, sceneHeight, sceneDepthTexture, sceneDepthBuffer))
+                weightedOit = false;
+            if (overdraw) {
+                // Translucent faces are added to the heatmap like the rest
+                PROFILE_ZONE("Draw translucent");
+                chunkRenderer.updateTranslucent(&chunkMesher, frame.frustum, eye);
+                if (chunkRenderer.translucentCount > 0) {
+                    GpuPassScope gpuTranslucent(gpuProfiler, "Translucent");
+                    overdrawProgram.use();
+                    glState().enable(GL_BLEND);
+                    glBlendFunc(GL_ONE, GL_ONE);
+                    glState().disable(GL_DEPTH_TEST);
+                    glState().depthMask(GL_FALSE);
+                    stereoChunkPasses(true);
+                    draws += chunkRenderer.drawTranslucent(frameStream, eye, glFeatures.multiDrawIndirect, quads);
+                    stereoChunkPasses(false);
+                    glState().depthMask(GL_TRUE);
+                    glState().enable(GL_DEPTH_TEST);
+                    glState().disable(GL_BLEND);
+                }
+            }
+            else if (weightedOit) {
+                PROFILE_ZONE("Draw translucent");
+                chunkRenderer.updateTranslucent(&chunkMesher, frame.frustum, eye, false);
+                if (chunkRenderer.translucentCount > 0) {
+                    GpuPassScope gpuTranslucent(gpuProfiler, "Translucent (OIT)");
+                    weightedOitTarget.begin();
+                    oitProgram->use();
+                    stereoChunkPasses(true);
+                    draws += chunkRenderer.drawTranslucent(frameStream, eye, glFeatures.multiDrawIndirect, quads);
+                    stereoChunkPasses(false);
+                    weightedOitTarget.composite(sceneFramebuffer, OIT_TEXTURE_UNIT);
+                    draws++;
+                }
+            }
+            else if (chunkProgramsReady && !frame.instancing) {
+                PROFILE_ZONE("Draw translucent");
+                chunkRenderer.updateTranslucent(&chunkMesher, frame.frustum, eye);
+                if (chunkRenderer.translucentCount > 0) {
+                    GpuPassScope gpuTranslucent(gpuProfiler, "Translucent");
+                    chunkProgram->use();
+                    glState().enable(GL_BLEND);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    glState().depthMask(GL_FALSE);
+                    stereoChunkPasses(true);
+                    draws += chunkRenderer.drawTranslucent(frameStream, eye, glFeatures.multiDrawIndirect, quads);
+                    stereoChunkPasses(false);
+                    glState().depthMask(GL_TRUE);
+                    glState().disable(GL_BLEND);
+                }
+            }
 
-                        // Check -Y face
-                        if (y == 0 || chunk[x][y - 1][z] == 0) {
-                            // Render bottom face
-                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(12 * sizeof(GLuint)));
-                        }
+            // Debris and weather, simulated and drawn without leaving the GPU
+            if (!overdraw) {
+                PROFILE_ZONE("Particles");
+                GpuPassScope gpuParticles(gpuProfiler, "Particles");
+                particleEmitters = frame.particleEmitters;
+                particleEmitters.push_back(particles.weatherEmitter(frame.weather, eye, frame.frameSeconds));
+                particles.occupancy = frame.occupancyVolume ? &occupancyVolume : nullptr;
+                particles.update(particleEmitters, frame.frameSeconds, eye);
+                forEachView([&](const glm::mat4&) {
+                    draws += particles.draw(eye, sceneHeight);
+                });
+            }
 
-                        // Check +Y face
-                        if (y == chunkSize - 1 || chunk[x][y + 1][z] == 0) {
-                            // Render top face
-                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(18 * sizeof(GLuint)));
-                        }
+            if (frame.picked && !overdraw) {
+                GpuPassScope gpuOutline(gpuProfiler, "Outline");
+                forEachView([&](const glm::mat4&) {
+                    draws += blockOutline.draw(&frame.pick.block, 1, eye, frameStream);
+                });
+            }
 
-                        // Check -Z face
-                        if (z == 0 || chunk[x][y][z - 1] == 0) {
-                            // Render back face
-                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(0 * sizeof(GLuint)));
-                        }
+            // Chunks tinted by their build cost or cull outcome. Which of
+            // those in view were drawn is only known here when occlusion was
+            // decided on the CPU.
+            ChunkOverlayMode overlayMode = frame.instancing || overdraw ? CHUNK_OVERLAY_OFF : frame.chunkOverlay;
+            chunkOverlay.update(overlayMode, chunkRenderer, frame.frustum,
+                gpuCulling || queryCulling ? nullptr : chunkRenderer.visible, visibleCount);
+            if (chunkOverlay.categoryCount > 0) {
+                GpuPassScope gpuOverlay(gpuProfiler, "Chunk overlay");
+                forEachView([&](const glm::mat4&) {
+                    draws += chunkOverlay.draw(eye, frameStream);
+                });
+            }
 
-                        // Check +Z face
-                        if (z == chunkSize - 1 || chunk[x][y][z + 1] == 0) {
-                            // Render front face
-                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(6 * sizeof(GLuint)));
+            // Reduce this frame's depth for next frame's occlusion tests, then
+            // show it: reconstructed, anti-aliased (the temporal upscaler
+            // already is) or copied as it is
+            bool fxaa = frame.fxaa && !temporalUpscale && sceneWidth > 0 && sceneHeight > 0;
+            if (hizAvailable) {
+                GpuPassScope gpuHiz(gpuProfiler, "Hi-Z");
+                hizValid = gpuCulling && frame.occlusionCulling;
+                if (hizValid) {
+                    hiz.build();
+                    hizViewProj = camera.viewProj;
+                    hizEye = eye;
+                    if (frame.entityOcclusion)
+                        hizReadback.capture(hiz, hizViewProj, hizEye);
+                }
+                if (hizValid && frame.entityOcclusion)
+                    hizReadback.collect();
+                else
+                    hizReadback.clear();
+                if (temporalUpscale) {
+                    GpuPassScope gpuUpscale(gpuProfiler, "Temporal upscale");
+                    temporalUpscaler.resolve(hiz.colorTexture, hiz.depthTexture, frame.projection * frame.view, jitter, eye,
+                        offscreen.framebuffer, viewportWidth, viewportHeight, PRESENT_TEXTURE_UNIT);
+                }
+                else if (fxaa) {
+                    GpuPassScope gpuFxaa(gpuProfiler, "FXAA");
+                    fxaaPass.apply(hiz.colorTexture, sceneWidth, sceneHeight, offscreen.framebuffer, viewportWidth, viewportHeight, PRESENT_TEXTURE_UNIT);
+                }
+                else {
+                    hiz.present(offscreen.framebuffer, viewportWidth, viewportHeight);
+                }
+            }
+            else if (fxaa) {
+                // From the scaled target, the headless one or the window
+                // itself, through a copy
+                GpuPassScope gpuFxaa(gpuProfiler, "FXAA");
+                fxaaPass.applyFramebuffer(sceneFramebuffer, sceneWidth, sceneHeight, headless ? offscreen.framebuffer : 0,
+                    viewportWidth, viewportHeight, PRESENT_TEXTURE_UNIT);
+            }
+            else if (presentSceneTarget) {
+                sceneTarget.present(0, viewportWidth, viewportHeight);
+            }
+            // The HUD is drawn at full resolution
+            if (scaledScene)
+                glViewport(0, 0, viewportWidth, viewportHeight);
+
+            {
+                PROFILE_ZONE("HUD");
+                GpuPassScope gpuHud(gpuProfiler, "HUD");
+                // On-screen stats from the last frame rendered from this packet's
+                // slot. The labels never change, so only the numbers are rewritten;
+                // they are formatted on the stack into slots that keep their
+                // storage, so the HUD allocates nothing per frame.
+                textBatch.begin();
+                // Sized for 1080p and grown with taller framebuffers
+                const glm::vec3 HUD_COLOR(1.0f);
+                const float HUD_TEXT_HEIGHT = 19.2f;   // Pixels at 1080p
+                float hudUnit = std::max(1.0f, frame.framebufferHeight / 1080.0f);
+                float hudScale = glyphAtlas.pixelHeight > 0 ? HUD_TEXT_HEIGHT * hudUnit / glyphAtlas.pixelHeight : 0.0f;
+                int hudLines = 0;
+                auto hudLine = [&](const char* label, const char* value) {
+                    float y = frame.framebufferHeight - 28.0f * hudUnit * ++hudLines;
+                    RenderText(label, 10.0f * hudUnit, y, hudScale, HUD_COLOR);
+                    RenderText(value, 110.0f * hudUnit, y, hudScale, HUD_COLOR);
+                };
+                char hudText[64];
+                if (frame.statsOverlay) {
+                    const char* hudLabels[4] = { "FPS", "Quads", "Draws", "Glyphs" };
+                    int hudValues[4] = { (int)(frame.fps + 0.5), frame.quads, frame.drawCalls, frame.hudGlyphs };
+                    for (int line = 0; line < 4; line++) {
+                        snprintf(hudText, sizeof(hudText), "%d", hudValues[line]);
+                        hudLine(hudLabels[line], hudText);
+                    }
+
+                    // Frame times over the history, the chunks drawn and
+                    // what went into it (visible of loaded, -1 when culled
+                    // on the GPU), and pool occupancy
+                    const StatsOverlay& stats = frame.stats;
+                    snprintf(hudText, sizeof(hudText), "%.1f / %.1f / %.1f / %.1f ms p50/95/99/max",
+                        stats.times.p50Ms, stats.times.p95Ms, stats.times.p99Ms, stats.times.maxMs);
+                    hudLine("Frame", hudText);
+                    if (frame.horizonCulled > 0)
+                        snprintf(hudText, sizeof(hudText), "%d / %d, %d under the horizon", frame.visibleChunks, frame.chunkCount, frame.horizonCulled);
+                    else
+                        snprintf(hudText, sizeof(hudText), "%d / %d", frame.visibleChunks, frame.chunkCount);
+                    hudLine("Visible", hudText);
+                    snprintf(hudText, sizeof(hudText), "%d chunks, %d meshes", frame.reusedMeshes, frame.sharedMeshes);
+                    hudLine("Reused", hudText);
+                    if (frame.uploadThreadMs >= 0.0f)
+                        snprintf(hudText, sizeof(hudText), "%.0f KB, thread %.2f ms", frame.uploadedBytes / 1024.0, frame.uploadThreadMs);
+                    else
+                        snprintf(hudText, sizeof(hudText), "%.0f KB", frame.uploadedBytes / 1024.0);
+                    hudLine("Upload", hudText);
+                    snprintf(hudText, sizeof(hudText), "%d / %d dropped", frame.stateCalls, frame.filteredStateCalls);
+                    hudLine("State", hudText);
+                    snprintf(hudText, sizeof(hudText), "%zu / %zu", stats.chunksInUse, stats.chunksReserved);
+                    hudLine("Chunks", hudText);
+                    snprintf(hudText, sizeof(hudText), "%.1f / %.1f MB", stats.voxelMB[0], stats.voxelMB[1]);
+                    hudLine("Voxels", hudText);
+                    snprintf(hudText, sizeof(hudText), "%.1f / %.1f MB", stats.stagingMB[0], stats.stagingMB[1]);
+                    hudLine("Staging", hudText);
+                    snprintf(hudText, sizeof(hudText), "%.1f / %.1f MB", stats.heapMB[0], stats.heapMB[1]);
+                    hudLine("Heap", hudText);
+                    GpuMemoryInfo gpuMemory;
+                    if (queryGpuMemory(gpuMemory)) {
+                        if (gpuMemory.totalMB >= 0)
+                            snprintf(hudText, sizeof(hudText), "%d / %d MB free, %d evictions",
+                                gpuMemory.availableMB, gpuMemory.totalMB, gpuMemory.evictions);
+                        else
+                            snprintf(hudText, sizeof(hudText), "%d MB free", gpuMemory.availableMB);
+                        hudLine("VRAM", hudText);
+                    }
+
+                    // GPU time of the newest frame read back (a few frames old)
+                    if (scaledScene)
+                        snprintf(hudText, sizeof(hudText), "%.2f ms at %d%%", gpuProfiler.frameMs, (int)(dynamicResolution.scale * 100.0f + 0.5f));
+                    else
+                        snprintf(hudText, sizeof(hudText), "%.2f ms", gpuProfiler.frameMs);
+                    hudLine("GPU", hudText);
+                }
+                // ... broken down per pass while the profiler is shown, with
+                // the pipeline statistics of top-level passes in thousands:
+                // vertex and fragment shader runs, and primitives into and
+                // out of the clipper
+                if (frame.profilerView) {
+                    for (const GpuProfiler::PassTime& pass : gpuProfiler.passes()) {
+                        float y = frame.framebufferHeight - 28.0f * hudUnit * ++hudLines;
+                        RenderText(pass.name, (20.0f + 10.0f * pass.depth) * hudUnit, y, hudScale, HUD_COLOR);
+                        textBatch.addf(160.0f * hudUnit, y, hudScale, HUD_COLOR, "%.2f ms", pass.ms);
+                        if (pass.counted) {
+                            const uint64_t* stats = pass.statistics;
+                            textBatch.addf(240.0f * hudUnit, y, hudScale, HUD_COLOR, "VS %.1fk  FS %.1fk  clip %.1fk > %.1fk",
+                                stats[GpuProfiler::STAT_VERTEX_INVOCATIONS] / 1e3, stats[GpuProfiler::STAT_FRAGMENT_INVOCATIONS] / 1e3,
+                                stats[GpuProfiler::STAT_CLIPPING_INPUT] / 1e3, stats[GpuProfiler::STAT_CLIPPING_OUTPUT] / 1e3);
                         }
+                    }
+                }
 
-                        total_rendered_blocks++;
+                // ... and memory per subsystem: live and peak, and the most
+                // allocations in a frame lately. Without the operator new
+                // hooks only the pools are counted.
+                if (frame.profilerView) {
+                    hudLine("Memory", memoryHooksInstalled() ? "all allocations" : "pools only");
+                    const StatsOverlay& stats = frame.stats;
+                    for (int t = 0; t < MEMORY_TAG_COUNT; t++) {
+                        float y = frame.framebufferHeight - 28.0f * hudUnit * ++hudLines;
+                        RenderText(MEMORY_TAG_NAMES[t], 20.0f * hudUnit, y, hudScale, HUD_COLOR);
+                        textBatch.addf(160.0f * hudUnit, y, hudScale, HUD_COLOR, "%.1f MB, peak %.1f MB, %llu allocs/frame",
+                            stats.tagMB[t][0], stats.tagMB[t][1], (unsigned long long)stats.tagFrameAllocations[t]);
                     }
                 }
+
+                // Totals of the chunk overlay's categories, in their tints
+                if (chunkOverlay.categoryCount > 0) {
+                    hudLine("Overlay", CHUNK_OVERLAY_MODE_NAMES[chunkOverlay.mode]);
+                    int decimals = chunkOverlay.mode == CHUNK_OVERLAY_BUILD_TIME ? 1 : 0;
+                    for (int c = 0; c < chunkOverlay.categoryCount; c++) {
+                        const ChunkOverlay::Category& category = chunkOverlay.categories[c];
+                        float y = frame.framebufferHeight - 28.0f * hudUnit * ++hudLines;
+                        RenderText(category.name, 20.0f * hudUnit, y, hudScale, category.color);
+                        textBatch.addf(160.0f * hudUnit, y, hudScale, category.color, "%d chunks, %.*f %s",
+                            category.chunks, decimals, category.total, chunkOverlay.unit);
+                    }
+                }
+
+                // Map of the terrain around the camera, north up, top right;
+                // only the quad's texture coordinates change as it moves
+                if (frame.minimap) {
+                    const float MINIMAP_PIXELS = 256.0f;   // At 1080p
+                    float size = MINIMAP_PIXELS * hudUnit;
+                    float left = frame.framebufferWidth - size - 10.0f * hudUnit;
+                    float bottom = frame.framebufferHeight - size - 10.0f * hudUnit;
+                    textBatch.addImage(left, bottom, size, size, minimap.view(frame.eye), glm::vec3(1.0f));
+                    const Glyph& marker = glyphAtlas.glyph('+');
+                    textBatch.add("+", left + size * 0.5f - (marker.bearing.x + marker.size.x * 0.5f) * hudScale,
+                        bottom + size * 0.5f - (marker.bearing.y - marker.size.y * 0.5f) * hudScale, hudScale, HUD_COLOR);
+                }
+
+                // Console output above its prompt, bottom left
+                if (frame.console.open) {
+                    const ConsoleText& text = frame.console;
+                    for (int line = 0; line < text.lineCount; line++)
+                        RenderText(text.lines[line], 10.0f * hudUnit, (10.0f + 28.0f * (text.lineCount - line)) * hudUnit, hudScale, HUD_COLOR);
+                    textBatch.addf(10.0f * hudUnit, 10.0f * hudUnit, hudScale, HUD_COLOR, "> %s_", text.input);
+                }
+
+                // Timeline of the previous render loop iteration, below the stats
+                if (frame.profilerView) {
+                    float panelTop = frame.framebufferHeight - 28.0f * hudUnit * (hudLines + 0.5f);
+                    draws += profilerView.draw(previousFrameStart, frameStart, 10.0f * hudUnit, panelTop,
+                        frame.framebufferWidth - 20.0f * hudUnit, hudUnit, textBatch, hudScale * 0.55f,
+                        frame.framebufferWidth, frame.framebufferHeight);
+                }
+                draws += textBatch.flush(frame.framebufferWidth, frame.framebufferHeight);
+            }
+
+            // Everything streamed this frame has been submitted
+            frameStream.endFrame();
+            chunkMeshStaging().endFrame();
+            packet->quads = quads;
+            packet->drawCalls = draws;
+            packet->hudGlyphs = textBatch.rewrittenGlyphs;
+            packet->stateCalls = glState().issuedCalls;
+            packet->filteredStateCalls = glState().filteredCalls;
+            packet->chunkCount = (int)chunkRenderer.chunks.size();
+            packet->reusedMeshes = chunkRenderer.reusedMeshes;
+            packet->sharedMeshes = (int)chunkRenderer.sharedMeshCount();
+            packet->visibleChunks = gpuCulling || queryCulling ? -1 : visibleCount;
+            packet->horizonCulled = gpuCulling ? 0 : horizonCuller.hiddenChunks;
+            packet->uploadedBytes = chunkRenderer.uploadedBytes;
+            packet->uploadThreadMs = uploadThread.active() ? (float)uploadThread.batchMs : -1.0f;
+            packet->uploadedMeshes = uploadedMeshes;
+            packet->pendingMeshes = pendingMeshes;
+            packet->resumePending = resumePending;
+            packet->pendingFarField = frame.farField == FAR_FIELD_RAYMARCH ? raymarchTerrain.pendingRegions() :
+                frame.farField == FAR_FIELD_IMPOSTOR && frame.lodDistance > 0 ? horizonImpostor.staleFaces() : 0;
+            packet->programsReady = chunkProgramsReady;
+
+            // Captured frames are read back into pixel buffers and copied
+            // out a few frames later, once the GPU has got there
+            if (frame.captureVideo != requestedCapture) {
+                requestedCapture = frame.captureVideo;
+                if (requestedCapture)
+                    frameCapture.startVideo(capturePath);
+                else
+                    frameCapture.stopVideo();
+            }
+            if (frame.screenshot || frameCapture.videoOpen()) {
+                PROFILE_ZONE("Capture");
+                frameCapture.readback(headless ? offscreen.framebuffer : 0, frame.framebufferWidth, frame.framebufferHeight,
+                    frame.screenshot, frameCapture.videoOpen());
+            }
+            frameCapture.collect();
+
+            gpuProfiler.endFrame();
+            // Headless frames are never shown. The stream buffer's fences keep
+            // the CPU at most FRAMES_IN_FLIGHT frames ahead without a swap; the
+            // flush makes each frame's work start now rather than pile up.
+            if (headless) {
+                glFlush();
+                frameShown(frame);
+                continue;
+            }
+            if (frame.presentMode != requestedPresentMode) {
+                requestedPresentMode = frame.presentMode;
+                PresentMode applied = applyPresentMode(requestedPresentMode);
+                if (applied != requestedPresentMode)
+                    std::cout << "Present mode: " << PRESENT_MODE_NAMES[requestedPresentMode] << " unsupported, using "
+                              << PRESENT_MODE_NAMES[applied] << std::endl;
             }
+            {
+                PROFILE_ZONE("Swap");
+                glfwSwapBuffers(window);
+            }
+            frameShown(frame);
+            PROFILE_ZONE("Frame queue");
+            swapFences.maxQueued = frame.maxQueuedFrames;
+            swapFences.afterSwap();
         }
 
-        // Calculate FPS and render text (code omitted for brevity)
-		//call the statsTracker function to calculate the FPS and update the window title
-        double fps = statsTracker(window, &total_rendered_blocks);
+        swapFences.destroy();
+        glThread.runPending();
+
+        glfwMakeContextCurrent(NULL);
+    });
+
+    // Benchmark progress: the first pose is held until streaming settles,
+    // then frames are recorded along the path; again for each further run
+    BenchmarkRecorder benchmarkRecorder;
+    int exitCode = 0;           // 2 if the results couldn't be written
+    bool benchmarkRunning = false;
+    bool benchmarkSettling = false; // Back at the start between runs
+    int benchmarkFrame = 0;
+    // Replay progress: live until the warm-up is done, then recorded
+    bool replaying = false;
+    std::vector<InputEvent> replayEvents;
+    // Warm-up: frames are rendered to the hidden window until the view is in
+    bool warmingUp = true;
+    int warmupSettled = 0;
+    double warmupStart = glfwGetTime();
+    double warmupLimit = benchmarkMode ? BENCHMARK_MAX_WARMUP_SECONDS : warmupSeconds;
+    double nextAutosave = glfwGetTime() + autosaveSeconds;
+    Frustum lastFrustum;        // Of the latest packet, for the session saved on exit
+    FrameLimiter frameLimiter;
+    // Projection aspect of the last framebuffer with an area (a minimised window has none)
+    float aspect = (float)framebufferWidth / (float)std::max(framebufferHeight, 1);
+    if (benchmarkMode)
+        player.mode = PLAYER_NOCLIP;
+
+    // From here on only live cvars change, through the console
+    cvars.lock();
+    console.cvars = &cvars;
+    console.configPath = configPath;
+    console.commands.push_back({ "export", "export <x0> <y0> <z0> <x1> <y1> <z1> <file> (corner blocks, both included)",
+        [&](const std::vector<std::string>& args) {
+            if (args.size() != 7)
+                return false;
+            glm::ivec3 a(std::atoi(args[0].c_str()), std::atoi(args[1].c_str()), std::atoi(args[2].c_str()));
+            glm::ivec3 b(std::atoi(args[3].c_str()), std::atoi(args[4].c_str()), std::atoi(args[5].c_str()));
+            if (schematicExport.begin(args[6].c_str(), glm::min(a, b), glm::max(a, b) + 1))
+                console.print("Export: %d cells to %s", schematicExport.cellCount, args[6].c_str());
+            else
+                console.print("Export: can't write %s (or the box is too large)", args[6].c_str());
+            return true;
+        } });
+    console.commands.push_back({ "import", "import <file> [<x> <y> <z>] (minimum corner, else at the feet)",
+        [&](const std::vector<std::string>& args) {
+            if (args.size() != 1 && args.size() != 4)
+                return false;
+            // On a server only its owner changes the world
+            if (connectAddress) {
+                console.print("Import: not while connected to a server");
+                return true;
+            }
+            glm::ivec3 at = args.size() == 4 ?
+                glm::ivec3(std::atoi(args[1].c_str()), std::atoi(args[2].c_str()), std::atoi(args[3].c_str())) :
+                glm::ivec3(glm::floor(player.position));
+            if (schematicImport.begin(args[0].c_str(), at))
+                console.print("Import: %dx%dx%d from %s", schematicImport.size.x, schematicImport.size.y, schematicImport.size.z, args[0].c_str());
+            else
+                console.print("Import: can't read %s as a schematic", args[0].c_str());
+            return true;
+        } });
+    console.commands.push_back({ "path", "path <x> <y> <z> (walk from the feet to the block above solid ground)",
+        [&](const std::vector<std::string>& args) {
+            if (args.size() != 3)
+                return false;
+            glm::ivec3 goal(std::atoi(args[0].c_str()), std::atoi(args[1].c_str()), std::atoi(args[2].c_str()));
+            NavPath path;
+            double start = glfwGetTime();
+            if (navigation.findPath(glm::ivec3(glm::floor(player.position)), goal, path))
+                console.print("Path: %d steps, %.2f ms", (int)path.points.size() - 1, (glfwGetTime() - start) * 1000.0);
+            else
+                console.print("Path: none within %d summarised columns", navigation.columnCount());
+            return true;
+        } });
+
+    // Main loop
+    // ---------
+    while (!glfwWindowShouldClose(window))
+    {
+        // Per-frame time logic
+        // --------------------
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
 
-        // Swap buffers and poll IO events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // The packet to fill holds the stats of the last frame rendered from it
+        FramePacket& packet = pipeline.back();
+        //call the statsTracker function to calculate the FPS and update the window title
+        packet.fps = statsTracker(window, packet);
+        packet.loadedChunks.clear();
+        packet.unloadedChunks.clear();
+        packet.entities.clear();
+        packet.particleEmitters.clear();
+        packet.frameSeconds = deltaTime;
+
+        glm::dvec3 renderEye;
+        if (benchmarkMode) {
+            // Scripted camera
+            // ---------------
+            // One tick of 1 / rate seconds per frame whatever the frame took,
+            // so every run visits the same poses
+            if (benchmarkRunning) {
+                const float MB = 1024.0f * 1024.0f;
+                MemorySample memory;
+                memory.voxelMB = voxelStoragePool().bytesInUse() / MB;
+                memory.stagingMB = meshStagingPool().bytesInUse() / MB;
+                memory.heapMB = chunkMeshHeap().bytesInUse() / MB;
+                benchmarkRecorder.addFrame(deltaTime, packetCounters(packet), memory);
+            }
+            CameraKeyframe pose = benchmarkScript.sample(benchmarkFrame / benchmarkScript.rate);
+            player.setEye(pose.position);
+            yaw = pose.yaw;
+            pitch = pose.pitch;
+            cameraFront = lookDirection(yaw, pitch);
+            simulate((float)(1.0 / benchmarkScript.rate));
+            renderEye = player.eye();
+
+            if (benchmarkRunning && ++benchmarkFrame / benchmarkScript.rate > benchmarkScript.duration() &&
+                benchmarkRecorder.runCount() < benchmarkRuns) {
+                // Back to the start for the next run once it has loaded again
+                FrameTimeSummary run = benchmarkRecorder.summarizeRun(benchmarkRecorder.runCount() - 1).times;
+                printf("Benchmark: run %d, %.1f FPS, p50/p95/p99/max %.2f/%.2f/%.2f/%.2f ms\n", benchmarkRecorder.runCount(),
+                    run.fps, run.p50Ms, run.p95Ms, run.p99Ms, run.maxMs);
+                benchmarkRunning = false;
+                benchmarkSettling = true;
+                benchmarkFrame = 0;
+                warmupSettled = 0;
+                warmupStart = currentFrame;
+            }
+            else if (benchmarkRunning && benchmarkFrame / benchmarkScript.rate > benchmarkScript.duration()) {
+                FrameTimeSummary summary = benchmarkRecorder.summary();
+                std::string csvPath = std::string(benchmarkPath) + ".csv";
+                std::string jsonPath = std::string(benchmarkPath) + ".json";
+                bool written = benchmarkRecorder.writeCsv(csvPath.c_str()) &&
+                    benchmarkRecorder.writeJson(jsonPath.c_str(), benchmarkScript, rendererName, startupTimeline);
+                printf("Benchmark: %d frames, %.1f FPS, p50/p95/p99/max %.2f/%.2f/%.2f/%.2f ms%s\n",
+                    summary.frames, summary.fps, summary.p50Ms, summary.p95Ms, summary.p99Ms, summary.maxMs,
+                    written ? "" : " (failed to write results)");
+                if (!written)
+                    exitCode = 2;
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
+            }
+        }
+        else {
+            // Input
+            // -----
+            // A replay hands the callbacks the recorded frame's events and
+            // simulates its recorded time instead of the time that passed
+            double simulatedSeconds = deltaTime;
+            if (replaying) {
+                float recordedSeconds;
+                if (inputReplay.nextFrame(replayEvents, recordedSeconds)) {
+                    for (const InputEvent& event : replayEvents)
+                        replayInputEvent(window, event);
+                    simulatedSeconds = recordedSeconds;
+                }
+                else {
+                    replaying = false;
+                    simulatedSeconds = 0.0;
+                    bool written = profilerExportTrace(TRACE_PATH);
+                    printf("Replay: %d frames replayed%s %s\n", inputReplay.framesReplayed(),
+                        written ? ", profiler trace written to" : ", failed to write", TRACE_PATH);
+                    glfwSetWindowShouldClose(window, GLFW_TRUE);
+                }
+            }
+            else {
+                inputRecorder.frame(deltaTime);
+            }
+            {
+                PROFILE_ZONE("Input");
+                processInput(window);
+            }
 
-		
-    }
+            // Simulation
+            // ----------
+            // Whole ticks for the time elapsed; the camera is interpolated between
+            // the last two tick states so motion stays smooth at any frame rate
+            int ticks = simulation.advance(simulatedSeconds);
+            for (int t = 0; t < ticks; t++)
+                simulate((float)simulation.tickSeconds);
+            renderEye = glm::mix(previousEye, player.eye(), simulation.alpha());
+            // On a server, replays that moved the player fade in
+            if (chunkClient.connected())
+                renderEye += chunkClient.prediction.correction;
+        }
 
-    // De-allocate resources
-    // ---------------------
-    glDeleteVertexArrays(1, &stoneVAO);
-    glDeleteBuffers(1, &stoneVBO);
+        // Until the initial view is in: the render thread's counts are of
+        // the frame submitted two packets ago
+        if (warmingUp || benchmarkSettling) {
+            bool loading = !packet.loadedChunks.empty() || chunkGenerator.pendingCount() > 0 ||
+                lightEngine.pendingCount() > 0 || lodTerrain.pendingCount() > 0 ||
+                packet.pendingMeshes > 0 || packet.pendingFarField > 0 || !packet.programsReady;
+            int settleFrames = WARMUP_SETTLE_FRAMES;
+            // Resuming, the rest streams in behind the first view
+            if (warmingUp && resuming) {
+                loading = packet.resumePending != 0 || !packet.programsReady;
+                settleFrames = RESUME_SETTLE_FRAMES;
+            }
+            warmupSettled = loading ? 0 : warmupSettled + 1;
+            if (warmupSettled >= settleFrames || currentFrame - warmupStart >= warmupLimit) {
+                if (warmingUp) {
+                    warmingUp = false;
+                    if (resuming) {
+                        chunkGenerator.prefer(std::vector<glm::ivec3>());
+                        holdPlayer = false;
+                    }
+                    startupTimeline.mark("first world load");
+                    if (!headless)
+                        glfwShowWindow(window);
+                    if (recordPath) {
+                        if (inputRecorder.open(recordPath, captureSession(world.seed, simulation)))
+                            std::cout << "Recording: input to " << recordPath << std::endl;
+                        else
+                            std::cout << "Recording: can't write " << recordPath << std::endl;
+                    }
+                    if (replayMode) {
+                        restoreSession(inputReplay.start, simulation);
+                        previousEye = player.eye();
+                        replaying = true;
+                        std::cout << "Replay: " << inputReplay.frameCount() << " frames" << std::endl;
+                    }
+                }
+                if (benchmarkMode) {
+                    std::cout << "Benchmark: running " << benchmarkScript.duration() << " s path";
+                    if (benchmarkRuns > 1)
+                        std::cout << ", run " << benchmarkRecorder.runCount() + 1 << " of " << benchmarkRuns;
+                    std::cout << std::endl;
+                    benchmarkSettling = false;
+                    benchmarkRunning = true;
+                    benchmarkRecorder.beginRun();
+                }
+            }
+        }
+        packet.warmingUp = warmingUp;
+        packet.resumeChunks = warmingUp && resuming ? &resume.chunks : nullptr;
+        if (metricsExporter.running()) {
+            metricsExporter.set(METRIC_QUEUE_GENERATION, (double)chunkGenerator.pendingCount());
+            metricsExporter.set(METRIC_QUEUE_LIGHTING, (double)lightEngine.pendingCount());
+            metricsExporter.set(METRIC_QUEUE_MESHING, (double)packet.pendingMeshes);
+            metricsExporter.set(METRIC_QUEUE_LOD, (double)lodTerrain.pendingCount());
+            metricsExporter.set(METRIC_GL_ERRORS, (double)glDebugOutput.errors.load(std::memory_order_relaxed));
+            metricsExporter.set(METRIC_GL_PERFORMANCE_WARNINGS, (double)glDebugOutput.performanceWarnings.load(std::memory_order_relaxed));
+        }
+        bool throttled = !benchmarkMode && !replayMode && !warmingUp;
+        bool minimised = throttled && glfwGetWindowAttrib(window, GLFW_ICONIFIED) == GLFW_TRUE;
+        bool unfocused = throttled && glfwGetWindowAttrib(window, GLFW_FOCUSED) == GLFW_FALSE;
+        packet.paused = minimised;
+        cameraPos = glm::vec3(renderEye);
+
+        // Frame packet
+        // ------------
+        // Camera/view transformation
+        packet.view = glm::lookAt(glm::vec3(0.0f), cameraFront, cameraUp);
+        // Framebuffer size, which the projection follows and the render
+        // thread resizes its targets to
+        if (headless) {
+            packet.framebufferWidth = BENCHMARK_WIDTH;
+            packet.framebufferHeight = BENCHMARK_HEIGHT;
+        }
+        else {
+            glfwGetFramebufferSize(window, &packet.framebufferWidth, &packet.framebufferHeight);
+        }
+        if (packet.framebufferWidth > 0 && packet.framebufferHeight > 0)
+            aspect = (float)packet.framebufferWidth / (float)packet.framebufferHeight;
+        // Projection, reaching the LOD horizon when it is on
+        float farPlane = useLod ? std::max(DEFAULT_FAR_PLANE, lodDistance * CHUNK_SIZE * 1.5f) : DEFAULT_FAR_PLANE;
+        packet.views = stereoSeparation > 0.0f ? 2 : 1;
+        float viewAspect = packet.views == 2 ? aspect * 0.5f : aspect;
+        packet.projection = glm::perspective(glm::radians(fov), viewAspect, 0.1f, farPlane);
+        packet.eye = renderEye;
+        packet.lateLatch = useLateLatch && !benchmarkMode;
+        packet.yaw = yaw;
+        packet.pitch = pitch;
+        lookLatch.publish(yaw, pitch);
+        // World-space frustum planes, extracted once for this frame; wider
+        // on every side by the turn late latching may still add
+        float cullHalfFov = glm::radians(fov) * 0.5f;
+        float cullAspect = viewAspect;
+        if (packet.lateLatch) {
+            float margin = glm::radians(LATE_LATCH_MARGIN_DEGREES);
+            float halfWide = std::min(std::atan(std::tan(cullHalfFov) * viewAspect) + margin, glm::radians(89.0f));
+            cullHalfFov += margin;
+            cullAspect = std::tan(halfWide) / std::tan(cullHalfFov);
+        }
+        if (packet.views == 2) {
+            // Eyes half the separation either side along the camera's right.
+            // Culling uses one frustum around both: the same one moved back
+            // until its sides pass through the eyes.
+            glm::vec3 right = glm::normalize(glm::cross(cameraFront, cameraUp));
+            float halfSeparation = stereoSeparation * 0.5f;
+            for (int e = 0; e < 2; e++)
+                packet.eyeViews[e] = packet.view * glm::translate(glm::mat4(1.0f), right * (e == 0 ? halfSeparation : -halfSeparation));
+            float halfWidth = std::tan(cullHalfFov) * cullAspect;
+            float back = halfSeparation / halfWidth;
+            glm::mat4 unionProjection = glm::perspective(cullHalfFov * 2.0f, cullAspect, 0.1f + back, farPlane + back);
+            glm::vec3 unionEye = cameraPos - glm::normalize(cameraFront) * back;
+            packet.frustum.update(unionProjection * packet.view * glm::translate(glm::mat4(1.0f), -unionEye));
+        }
+        else {
+            glm::mat4 cullProjection = glm::perspective(cullHalfFov * 2.0f, cullAspect, 0.1f, farPlane);
+            packet.frustum.update(cullProjection * packet.view * glm::translate(glm::mat4(1.0f), -cameraPos));
+        }
 
-    glDeleteVertexArrays(1, &dirtVAO);
-    glDeleteBuffers(1, &dirtVBO);
+        lastFrustum = packet.frustum;
 
-    glDeleteVertexArrays(1, &grassVAO);
-    glDeleteBuffers(1, &grassVBO);
+        if (world.storage && autosaveSeconds > 0.0 && currentFrame >= nextAutosave) {
+            PROFILE_ZONE("Autosave");
+            world.saveAll();
+            nextAutosave = currentFrame + autosaveSeconds;
+        }
+
+        // Generate nearby chunks in view first
+        chunkGenerator.setFocus(cameraPos, packet.frustum);
+
+        // Block under the crosshair, outlined by the render thread and edited by the next tick
+        {
+            PROFILE_ZONE("Raycast");
+            picked = raycastBlocks(world, renderEye, cameraFront, PICK_DISTANCE, pick);
+        }
+        packet.picked = picked;
+        packet.pick = pick;
+
+        packet.meshMode = meshMode;
+        packet.instancing = useInstancing;
+        packet.remeshAll = remeshAll;
+        packet.gpuCulling = useGpuCulling;
+        packet.occlusionCulling = useOcclusionCulling;
+        packet.visibilityCulling = useVisibilityCulling;
+        packet.horizonCulling = useHorizonCulling;
+        packet.depthPrePass = useDepthPrePass;
+        packet.occlusionQueries = useOcclusionQueries;
+        packet.shadows = useShadows;
+        packet.fog = useFog;
+        packet.pointLights = usePointLights;
+        packet.weightedOit = useWeightedOit;
+        packet.dynamicResolution = useDynamicResolution && !benchmarkMode;
+        packet.temporalUpscale = useTemporalUpscale;
+        packet.fxaa = useFxaa;
+        packet.presentMode = benchmarkMode ? PRESENT_UNCAPPED : presentMode;
+        packet.maxQueuedFrames = benchmarkMode ? 0 : maxQueuedFrames;
+        packet.frameBudgetMs = frameBudgetMs;
+        packet.meshUploadBytes = (size_t)meshUploadKB * 1024;
+        packet.lodUploadBytes = (size_t)lodUploadKB * 1024;
+        packet.meshSubmitsPerFrame = meshSubmitsPerFrame;
+        packet.console.open = console.text.open;
+        if (console.text.open)
+            packet.console = console.text;
+        packet.sunDirection = sunDirection;
+        // Entities moved on from the last tick by the time the eye was
+        // interpolated past it; a server's between its snapshots
+        if (chunkClient.connected())
+            chunkClient.snapshots.sample(netClockSeconds(), packet.entities);
+        else
+            gatherEntityInstances(entities, benchmarkMode ? 0.0f : (float)(simulation.alpha() * simulation.tickSeconds), packet.entities);
+        // What the last pyramid read back shows hidden is never uploaded or
+        // drawn, and debris burst there never spawned. Grown a little, as
+        // the readback is a few frames behind them.
+        packet.entityOcclusion = useEntityOcclusion;
+        if (std::shared_ptr<const HiZSnapshot> hidden = useEntityOcclusion ? hizReadback.latest() : nullptr) {
+            PROFILE_ZONE("Entity occlusion");
+            const double MARGIN = 0.5;
+            packet.entities.erase(std::remove_if(packet.entities.begin(), packet.entities.end(), [&](const EntityInstance& e) {
+                glm::dvec3 extent = glm::dvec3(e.halfExtents) + MARGIN;
+                return hidden->occluded(e.position - extent, e.position + extent);
+            }), packet.entities.end());
+            packet.particleEmitters.erase(std::remove_if(packet.particleEmitters.begin(), packet.particleEmitters.end(), [&](const ParticleEmitter& emitter) {
+                glm::dvec3 extent = glm::dvec3(emitter.spread + MARGIN);
+                return hidden->occluded(emitter.position - extent, emitter.position + extent);
+            }), packet.particleEmitters.end());
+        }
+        packet.weather = weather;
+        packet.occupancyVolume = useOccupancyVolume;
+        packet.clouds = useClouds;
+        packet.foliageRadius = useFoliage ? foliageRadius : 0.0f;
+        packet.wireframe = wireframe;
+        packet.screenshot = screenshotRequested && !warmingUp;
+        packet.captureVideo = capturingVideo && !warmingUp;
+        if (!warmingUp)
+            screenshotRequested = false;
+        packet.overdraw = showOverdraw;
+        packet.chunkOverlay = chunkOverlayMode;
+        packet.statsOverlay = showStats;
+        packet.minimap = showMinimap;
+        packet.profilerView = showProfiler;
+        packet.lodDistance = useLod ? lodDistance : 0;
+        packet.farField = farField;
+        // Stereo leaves out what assumes one view: query and Hi-Z occlusion,
+        // the jittered history, light clusters along one view direction, the
+        // clouds' view-sized layer and instanced cubes (a draw per chunk
+        // rather than one for both eyes)
+        if (packet.views == 2) {
+            packet.instancing = false;
+            packet.occlusionQueries = false;
+            packet.occlusionCulling = false;
+            packet.temporalUpscale = false;
+            packet.pointLights = false;
+            packet.clouds = false;
+        }
+        remeshAll = false;
+
+        // Hand the frame over; once the render thread has applied its chunk
+        // changes, the chunks it dropped can be freed
+        {
+            PROFILE_ZONE("Wait for render");
+            pipeline.submit();
+        }
+        world.releaseUnloaded();
+
+        // Slow down in the background; otherwise hold the next frame back to
+        // the limiter's rate, so its input is as fresh as possible
+        if (minimised || (unfocused && backgroundFps > 0.0)) {
+            PROFILE_ZONE("Background throttle");
+            frameLimiter.fps = minimised ? MINIMISED_FPS : backgroundFps;
+            frameLimiter.wait();
+        }
+        else if (presentMode == PRESENT_LIMITED && !benchmarkMode) {
+            PROFILE_ZONE("Frame limiter");
+            frameLimiter.fps = frameLimitFps;
+            frameLimiter.wait();
+        }
+
+        // Poll IO events
+        PROFILE_ZONE("Poll events");
+        glfwPollEvents();
+    }
+
+    // Let the render thread finish its frame, then take the context back for cleanup
+    pipeline.stop();
+    renderThread.join();
+    glfwMakeContextCurrent(window);
 
-    glDeleteBuffers(1, &EBO);
+    // The view to come back to, unless the session never got past the warm-up
+    if (regionStore.isOpen() && !benchmarkMode && !replayMode && !connectAddress && !warmingUp) {
+        ResumeState session;
+        session.seed = world.seed;
+        session.playerMode = player.mode;
+        session.position = player.position;
+        session.yaw = yaw;
+        session.pitch = pitch;
+        session.fov = fov;
+        chunkRenderer.residentInView(lastFrustum, session.chunks);
+        if (!saveResumeState(resumeStatePath(worldDir), session))
+            std::cout << "World: can't save the session to " << worldDir << std::endl;
+    }
 
-    glDeleteProgram(shaderProgram);
+    // De-allocate resources
+    // ---------------------
+    world.saveAll();
+    chunkGenerator.stop();  // Writes the saves still queued
+    if (connectAddress) {
+        chunkClient.disconnect();
+        netShutdown();
+    }
+    lightEngine.stop();
+    navigation.stop();
+    chunkMesher.stop();
+    metricsExporter.stop();
+    frameCapture.destroy();
+    lodTerrain.stop();
+    jobSystem.stop();
+    regionStore.close();
+    gpuCuller.destroy();
+    gpuMesher.destroy();
+    shadowCascades.destroy();
+    blockTextures.destroy();
+    hizReadback.destroy();
+    hiz.destroy();
+    offscreen.destroy();
+    sceneTarget.destroy();
+    weightedOitTarget.destroy();
+    temporalUpscaler.destroy();
+    fxaaPass.destroy();
+    occlusionQueries.destroy();
+    blockOutline.destroy();
+    chunkOverlay.destroy();
+    clouds.destroy();
+    sky.destroy();
+    clusteredLights.destroy();
+    foliageRenderer.destroy();
+    entityRenderer.destroy();
+    particles.destroy();
+    occupancyVolume.destroy();
+    minimap.destroy();
+    gpuProfiler.destroy();
+    profilerView.destroy();
+    textBatch.destroy();
+    glyphAtlas.destroy();
+    frameStream.destroy();
+    chunkRenderer.destroy();
+    lodTerrain.destroy();
+    uploadThread.stop();
+    if (uploadWindow)
+        glfwDestroyWindow(uploadWindow);
+    chunkMeshHeap().uploader = nullptr;
+    shutdownChunkMeshes();
+    shutdownBlockInstancing();
+
+    glState().deleteBuffers(1, &paletteUBO);
+    chunkPrograms.destroy();
+    oitPrograms.destroy();
+    depthProgram.destroy();
+    overdrawProgram.destroy();
+    instancedProgram.destroy();
+    lodProgram.destroy();
+    raymarchTerrain.destroy();
+    horizonImpostor.destroy();
+    fallbackProgram.destroy();
+    if (glDebugOutput.active()) {
+        std::cout << "GL debug output: " << glDebugOutput.errors << " errors, " << glDebugOutput.performanceWarnings
+                  << " performance warnings, " << glDebugOutput.otherMessages << " other messages" << std::endl;
+        glDebugOutput.stop();
+    }
 
     // Terminate GLFW
     glfwTerminate();
-    return 0;
+    return exitCode;
 }
 
-// Callback function called when the window is resized
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+// Break (left mouse) or place (right mouse) against the picked block;
+// broken blocks drop an item and a burst of debris
+void processBlockEdits(World& world, EntityStore& entities, std::vector<ParticleEmitter>& particles, const RayHit* pick,
+    const PlayerController& player)
 {
-    // Adjust viewport
-    glViewport(0, 0, width, height);
+    static uint32_t drops = 0;
+    // Presses are taken even without a pick, so they don't fire later
+    bool breakPressed = input.takePress(ACTION_BREAK_BLOCK);
+    bool placePressed = input.takePress(ACTION_PLACE_BLOCK);
+
+    if (pick) {
+        if (breakPressed) {
+            BlockId broken = world.getBlock(pick->block);
+            if (world.setBlock(pick->block, BLOCK_AIR) && broken != BLOCK_AIR) {
+                // A server drops the item itself
+                if (chunkClient.connected())
+                    chunkClient.sendEdit(pick->block, BLOCK_AIR);
+                else
+                    spawnDroppedItem(entities, pick->block, broken, drops++);
+                ParticleEmitter debris;
+                debris.position = glm::dvec3(pick->block) + 0.5;
+                debris.spread = 0.4f;
+                debris.velocity = glm::vec3(0.0f, 2.5f, 0.0f);
+                debris.speedJitter = 2.5f;
+                debris.lifetime = 1.2f;
+                debris.count = DEBRIS_PARTICLES;
+                debris.kind = PARTICLE_DEBRIS;
+                debris.block = broken;
+                particles.push_back(debris);
+            }
+        }
+        else if (placePressed && pick->face >= 0) {
+            // Against the face the crosshair is on
+            const int* n = FACE_NORMALS[pick->face];
+            glm::ivec3 target = pick->block + glm::ivec3(n[0], n[1], n[2]);
+            if ((player.mode == PLAYER_NOCLIP || !player.overlapsBlock(target)) &&
+                world.setBlock(target, PLACEABLE_BLOCKS[placeIndex]) && chunkClient.connected())
+                chunkClient.sendEdit(target, PLACEABLE_BLOCKS[placeIndex]);
+        }
+    }
 }
 
 // Process all input
 void processInput(GLFWwindow* window)
 {
-    float cameraSpeed = 10.0f * deltaTime;
-    //if click esc show mouse cursor and do not focus on window
-
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-	}
-	else {
-		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	}
-
-    //enable wireframe
-	if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	}
-	else {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	}
-
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-        cameraSpeed *= 2;
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        cameraPos += cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        cameraPos -= cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-        cameraPos += cameraSpeed * cameraUp;
-    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-        cameraPos -= cameraSpeed * cameraUp;
-
-
-    if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS) {
-        // Toggle fullscreen
+    //show the mouse cursor while the key is held, only switching on a change
+    static bool cursorShown = false;
+    bool showCursor = input.held(ACTION_SHOW_CURSOR);
+    if (showCursor != cursorShown) {
+        glfwSetInputMode(window, GLFW_CURSOR, showCursor ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+        cursorShown = showCursor;
+    }
+
+    //enable wireframe (applied by the render thread)
+    wireframe = input.held(ACTION_WIREFRAME);
+
+    //cycle the block placed with the right mouse button
+    if (input.takePress(ACTION_CYCLE_PLACE_BLOCK)) {
+        placeIndex = (placeIndex + 1) % PLACEABLE_COUNT;
+        std::cout << "Placing: " << PLACEABLE_NAMES[placeIndex] << std::endl;
+    }
+
+    //cycle between the culled-face, binary and greedy meshers
+    if (input.takePress(ACTION_CYCLE_MESHER)) {
+        meshMode = (MeshMode)((meshMode + 1) % MESH_MODE_COUNT);
+        remeshAll = true;
+    }
+
+    //toggle the instanced-cube renderer (meshing disabled)
+    if (input.takePress(ACTION_TOGGLE_INSTANCING)) {
+        useInstancing = !useInstancing;
+        remeshAll = true;
+    }
+
+    //toggle GPU (compute) and CPU chunk culling
+    if (input.takePress(ACTION_TOGGLE_GPU_CULLING))
+        useGpuCulling = !useGpuCulling;
+
+    //toggle occlusion culling against the Hi-Z pyramid
+    if (input.takePress(ACTION_TOGGLE_OCCLUSION))
+        useOcclusionCulling = !useOcclusionCulling;
+
+    //toggle cave (visibility graph) culling
+    if (input.takePress(ACTION_TOGGLE_VISIBILITY))
+        useVisibilityCulling = !useVisibilityCulling;
+
+    //toggle hardware occlusion queries
+    if (input.takePress(ACTION_TOGGLE_QUERIES))
+        useOcclusionQueries = !useOcclusionQueries;
+
+    //toggle the depth pre-pass
+    if (input.takePress(ACTION_TOGGLE_PREPASS))
+        useDepthPrePass = !useDepthPrePass;
+
+    //toggle the LOD tiles beyond the render distance
+    if (input.takePress(ACTION_TOGGLE_LOD)) {
+        useLod = !useLod;
+        std::cout << "LOD terrain: " << (useLod ? "on" : "off") << std::endl;
+    }
+
+    //toggle sun shadows
+    if (input.takePress(ACTION_TOGGLE_SHADOWS)) {
+        useShadows = !useShadows;
+        std::cout << "Shadows: " << (useShadows ? "on" : "off") << std::endl;
+    }
+
+    //toggle dynamic resolution
+    if (input.takePress(ACTION_TOGGLE_DYNAMIC_RESOLUTION)) {
+        useDynamicResolution = !useDynamicResolution;
+        std::cout << "Dynamic resolution: " << (useDynamicResolution ? "on" : "off") << std::endl;
+    }
+
+    //toggle temporal upscaling of the scaled scene
+    if (input.takePress(ACTION_TOGGLE_TEMPORAL_UPSCALE)) {
+        useTemporalUpscale = !useTemporalUpscale;
+        std::cout << "Upscaling: " << (useTemporalUpscale ? "temporal" : "bilinear") << std::endl;
+    }
+
+    //toggle FXAA
+    if (input.takePress(ACTION_TOGGLE_FXAA)) {
+        useFxaa = !useFxaa;
+        std::cout << "FXAA: " << (useFxaa ? "on" : "off") << std::endl;
+    }
+
+    //toggle order-independent translucency
+    if (input.takePress(ACTION_TOGGLE_WEIGHTED_OIT)) {
+        useWeightedOit = !useWeightedOit;
+        std::cout << "Translucency: " << (useWeightedOit ? "weighted blended OIT" : "sorted") << std::endl;
+    }
+
+    //cycle the weather
+    if (input.takePress(ACTION_CYCLE_WEATHER)) {
+        weather = (Weather)((weather + 1) % WEATHER_COUNT);
+        static const char* WEATHER_NAMES[WEATHER_COUNT] = { "clear", "rain", "snow" };
+        std::cout << "Weather: " << WEATHER_NAMES[weather] << std::endl;
+    }
+
+    //cycle the present mode
+    if (input.takePress(ACTION_CYCLE_PRESENT_MODE)) {
+        presentMode = (PresentMode)((presentMode + 1) % PRESENT_MODE_COUNT);
+        std::cout << "Present mode: " << PRESENT_MODE_NAMES[presentMode];
+        if (presentMode == PRESENT_LIMITED)
+            std::cout << " at " << frameLimitFps << " fps";
+        std::cout << std::endl;
+    }
+
+    //swap the shaded scene for the chunk overdraw heatmap
+    if (input.takePress(ACTION_TOGGLE_OVERDRAW)) {
+        showOverdraw = !showOverdraw;
+        std::cout << "Overdraw heatmap: " << (showOverdraw ? "on" : "off") << std::endl;
+    }
+    if (input.takePress(ACTION_CYCLE_CHUNK_OVERLAY)) {
+        chunkOverlayMode = (ChunkOverlayMode)((chunkOverlayMode + 1) % CHUNK_OVERLAY_MODE_COUNT);
+        std::cout << "Chunk overlay: " << CHUNK_OVERLAY_MODE_NAMES[chunkOverlayMode] << std::endl;
+    }
+
+    //save a screenshot, or start and stop capturing every frame
+    if (input.takePress(ACTION_SCREENSHOT))
+        screenshotRequested = true;
+    if (input.takePress(ACTION_TOGGLE_CAPTURE))
+        capturingVideo = !capturingVideo;
+
+    //show the profiler timeline, or save everything recorded for chrome://tracing
+    if (input.takePress(ACTION_TOGGLE_STATS))
+        showStats = !showStats;
+    if (input.takePress(ACTION_TOGGLE_MINIMAP))
+        showMinimap = !showMinimap;
+    if (input.takePress(ACTION_TOGGLE_PROFILER))
+        showProfiler = !showProfiler;
+    if (input.takePress(ACTION_EXPORT_TRACE)) {
+        if (profilerExportTrace(TRACE_PATH))
+            std::cout << "Profiler trace written to " << TRACE_PATH << std::endl;
+        else
+            std::cout << "Failed to write " << TRACE_PATH << std::endl;
+    }
+
+    //change the render distance
+    int distanceChange = 0;
+    while (input.takePress(ACTION_DISTANCE_UP))
+        distanceChange++;
+    while (input.takePress(ACTION_DISTANCE_DOWN))
+        distanceChange--;
+    if (distanceChange != 0) {
+        renderDistance += distanceChange;
+        if (renderDistance < 1)
+            renderDistance = 1;
+        if (renderDistance > 32)
+            renderDistance = 32;
+        std::cout << "Render distance: " << renderDistance << " chunks" << std::endl;
+    }
+
+    //cycle noclip, flying with collision and walking
+    if (input.takePress(ACTION_CYCLE_PLAYER_MODE)) {
+        player.mode = (PlayerMode)((player.mode + 1) % PLAYER_MODE_COUNT);
+        player.velocity = glm::vec3(0.0f);
+    }
+
+    // Movement intent, applied by the simulation tick
+    playerInput.look = cameraFront;
+    playerInput.sprint = input.held(ACTION_SPRINT);
+    playerInput.forward = (input.held(ACTION_MOVE_FORWARD) ? 1.0f : 0.0f) - (input.held(ACTION_MOVE_BACK) ? 1.0f : 0.0f);
+    playerInput.strafe = (input.held(ACTION_MOVE_RIGHT) ? 1.0f : 0.0f) - (input.held(ACTION_MOVE_LEFT) ? 1.0f : 0.0f);
+    playerInput.vertical = (input.held(ACTION_MOVE_UP) ? 1.0f : 0.0f) - (input.held(ACTION_MOVE_DOWN) ? 1.0f : 0.0f);
+
+    //toggle fullscreen, once per press
+    if (input.takePress(ACTION_TOGGLE_FULLSCREEN)) {
         if (glfwGetWindowMonitor(window) == NULL) {
+            glfwGetWindowPos(window, &windowedX, &windowedY);
+            glfwGetWindowSize(window, &windowedWidth, &windowedHeight);
             // Get the primary monitor
             GLFWmonitor* monitor = glfwGetPrimaryMonitor();
             // Get the video mode of the monitor
@@ -497,17 +3348,40 @@ void processInput(GLFWwindow* window)
             glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
         }
         else {
-            // Leave fullscreen
-            glfwSetWindowMonitor(window, NULL, 100, 100, WIDTH, HEIGHT, 0);
+            // Leave fullscreen, back where the window was
+            glfwSetWindowMonitor(window, NULL, windowedX, windowedY, windowedWidth, windowedHeight, 0);
         }
     }
 }
 
+// Callbacks feeding the action map; processInput acts on it once per frame
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    inputRecorder.key(key, action);
+    if (console.onKey(key, action))
+        return;
+    input.onKey(key, action);
+}
+
+// Typed text, for the console only
+void char_callback(GLFWwindow* window, unsigned int codepoint)
+{
+    inputRecorder.character(codepoint);
+    console.onChar(codepoint);
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    inputRecorder.mouseButton(button, action);
+    input.onMouseButton(button, action);
+}
+
 // Callback function called when the mouse is moved
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 {
     float xpos = static_cast<float>(xposIn);
     float ypos = static_cast<float>(yposIn);
+    inputRecorder.cursor(xpos, ypos);
     if (firstMouse)
     {
         lastX = xpos;
@@ -533,16 +3407,158 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     if (pitch < -89.0f)
         pitch = -89.0f;
 
+    cameraFront = lookDirection(yaw, pitch);
+    lookLatch.publish(yaw, pitch);
+}
+
+// Unit view direction for yaw and pitch in degrees
+glm::vec3 lookDirection(float yaw, float pitch)
+{
     glm::vec3 front;
     front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
     front.y = sin(glm::radians(pitch));
     front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-    cameraFront = glm::normalize(front);
+    return glm::normalize(front);
+}
+
+// Where the session stands, for the start of a recording
+InputSessionStart captureSession(uint32_t seed, const FixedTimestep& simulation)
+{
+    InputSessionStart start = {};
+    start.seed = seed;
+    start.renderDistance = renderDistance;
+    start.playerMode = player.mode;
+    start.placeIndex = placeIndex;
+    for (int axis = 0; axis < 3; axis++) {
+        start.position[axis] = player.position[axis];
+        start.velocity[axis] = player.velocity[axis];
+    }
+    start.onGround = player.onGround;
+    start.firstMouse = firstMouse;
+    start.yaw = yaw;
+    start.pitch = pitch;
+    start.fov = fov;
+    start.lastX = lastX;
+    start.lastY = lastY;
+    start.accumulator = simulation.accumulator;
+    return start;
+}
+
+// Back to where a recording started, before its first frame is replayed
+void restoreSession(const InputSessionStart& start, FixedTimestep& simulation)
+{
+    renderDistance = start.renderDistance;
+    player.mode = (PlayerMode)start.playerMode;
+    placeIndex = start.placeIndex;
+    for (int axis = 0; axis < 3; axis++) {
+        player.position[axis] = start.position[axis];
+        player.velocity[axis] = start.velocity[axis];
+    }
+    player.onGround = start.onGround != 0;
+    firstMouse = start.firstMouse != 0;
+    yaw = start.yaw;
+    pitch = start.pitch;
+    fov = start.fov;
+    lastX = start.lastX;
+    lastY = start.lastY;
+    simulation.accumulator = start.accumulator;
+    cameraFront = lookDirection(yaw, pitch);
+    lookLatch.publish(yaw, pitch);
+}
+
+// A recorded event through the callback that recorded it
+void replayInputEvent(GLFWwindow* window, const InputEvent& event)
+{
+    switch (event.type) {
+    case INPUT_KEY:
+        key_callback(window, event.code, 0, event.action, 0);
+        break;
+    case INPUT_MOUSE_BUTTON:
+        mouse_button_callback(window, event.code, event.action, 0);
+        break;
+    case INPUT_CURSOR:
+        mouse_callback(window, event.x, event.y);
+        break;
+    case INPUT_SCROLL:
+        scroll_callback(window, 0.0, event.y);
+        break;
+    case INPUT_CHAR:
+        char_callback(window, (unsigned int)event.code);
+        break;
+    default:
+        break;
+    }
+}
+
+// Names the config file and the console use for the enum knobs
+const char* MESHER_CVAR_NAMES[MESH_MODE_COUNT] = { "culled", "binary", "greedy" };
+const char* PRESENT_CVAR_NAMES[PRESENT_MODE_COUNT] = { "uncapped", "vsync", "adaptive", "limit" };
+const char* WEATHER_CVAR_NAMES[WEATHER_COUNT] = { "clear", "rain", "snow" };
+
+// Every tunable by name. Live ones are read each frame or tick (the render
+// thread's through the frame packet); the rest size or pick things once at
+// start-up.
+void registerCVars()
+{
+    cvars.addInt("render_distance", &renderDistance, 1, 32, "Chunk columns streamed around the camera");
+    cvars.addBool("lod", &useLod, "LOD terrain beyond the render distance");
+    cvars.addInt("lod_distance", &lodDistance, 1, 1024, "Horizon radius in chunk columns");
+    cvars.addFloat("fov", &fov, 1.0f, 90.0f, "Vertical field of view in degrees");
+    cvars.addEnum("mesher", &meshMode, MESHER_CVAR_NAMES, MESH_MODE_COUNT, "Chunk mesh builder").changed = [] { remeshAll = true; };
+    cvars.addBool("instancing", &useInstancing, "Instanced cubes instead of chunk meshes").changed = [] { remeshAll = true; };
+    cvars.addBool("gpu_culling", &useGpuCulling, "Cull chunks in a compute pass");
+    cvars.addBool("occlusion_culling", &useOcclusionCulling, "Test chunks against the Hi-Z pyramid (GPU culling)");
+    cvars.addBool("entity_occlusion", &useEntityOcclusion, "Cull entities and debris against a Hi-Z readback");
+    cvars.addBool("visibility_culling", &useVisibilityCulling, "Walk the chunk connectivity graph (CPU culling)");
+    cvars.addBool("horizon_culling", &useHorizonCulling, "Drop chunks under the terrain horizon (CPU culling)");
+    cvars.addBool("occlusion_queries", &useOcclusionQueries, "Hardware occlusion queries per chunk");
+    cvars.addBool("depth_prepass", &useDepthPrePass, "Depth-only pass before shading");
+    cvars.addBool("shadows", &useShadows, "Cascaded sun shadows");
+    cvars.addBool("dynamic_resolution", &useDynamicResolution, "Scale the scene to hold frame_ms");
+    cvars.addFloat("frame_ms", &frameBudgetMs, 1.0f, 100.0f, "GPU frame time dynamic resolution holds to");
+    cvars.addBool("temporal_upscale", &useTemporalUpscale, "Reconstruct the scaled scene from jittered frames");
+    cvars.addBool("fxaa", &useFxaa, "Post-process anti-aliasing");
+    cvars.addBool("oit", &useWeightedOit, "Weighted blended translucency instead of sorting");
+    cvars.addBool("fog", &useFog, "Fog and chunk fade-in at the edge of the world");
+    cvars.addBool("point_lights", &usePointLights, "Lamps as clustered point lights");
+    cvars.addEnum("weather", &weather, WEATHER_CVAR_NAMES, WEATHER_COUNT, "Rain or snow particles");
+    cvars.addBool("minimap", &showMinimap, "Top-down map of the terrain around the camera in the HUD");
+    cvars.addBool("clouds", &useClouds, "Drifting cloud layer over the sky");
+    cvars.addBool("foliage", &useFoliage, "Grass tufts and flowers as instanced crossed quads");
+    cvars.addFloat("foliage_radius", &foliageRadius, 8.0f, 128.0f, "Blocks from the eye ground cover is drawn to");
+    cvars.addBool("occupancy_volume", &useOccupancyVolume, "Nearby blocks in a 3D texture; particles collide with them");
+    cvars.addBool("late_latch", &useLateLatch, "Turn the view to the newest mouse look before drawing");
+    cvars.addEnum("present", &presentMode, PRESENT_CVAR_NAMES, PRESENT_MODE_COUNT, "Swap interval or frame limiter");
+    cvars.addDouble("fps", &frameLimitFps, 1.0, 1000.0, "Frame rate of the limit present mode");
+    cvars.addInt("queued_frames", &maxQueuedFrames, 0, 3, "Swaps the GPU may lag behind (0 = driver)");
+    cvars.addDouble("background_fps", &backgroundFps, 0.0, 1000.0, "Frame cap while unfocused (0 = uncapped)");
+    cvars.addInt("chunk_loads_per_tick", &chunkLoadsPerTick, 1, 1024, "Generated chunks picked up per tick");
+    cvars.addInt("mesh_submits_per_frame", &meshSubmitsPerFrame, 0, 4096, "Chunks handed to the mesher per frame (0 = no limit)");
+    cvars.addInt("mesh_upload_kb", &meshUploadKB, 16, 65536, "Chunk mesh data uploaded per frame");
+    cvars.addInt("lod_upload_kb", &lodUploadKB, 16, 65536, "LOD tile data uploaded per frame");
+    cvars.addDouble("autosave", &autosaveSeconds, 0.0, 3600.0, "Seconds between saves of changed chunks (0 = off)");
+
+    cvars.addEnum("quality", &qualityTier, QUALITY_TIER_NAMES, QUALITY_TIER_COUNT, "Tier of defaults for this machine", false);
+    cvars.addInt("workers", &workerThreads, 0, 256, "Job system workers (0 = per logical processor)", false);
+    cvars.addEnum("worker_priority", &workerPriority, THREAD_PRIORITY_NAMES, 3, "Job system worker priority", false);
+    cvars.addBool("pin_workers", &pinWorkers, "Pin each worker to a core", false);
+    cvars.addSize("voxel_mb", &voxelBudgetMB, 0, 65536, "Loaded voxel budget (0 = no limit)", false);
+    cvars.addSize("mesh_mb", &meshBudgetMB, 0, 65536, "Snapshots and meshes waiting for upload (0 = no limit)", false);
+    cvars.addSize("gpu_mb", &gpuMeshBudgetMB, 0, 65536, "Chunk meshes in the vertex heap (0 = no limit)", false);
+    cvars.addSize("gen_cache_mb", &generationCacheMB, 0, 65536, "Compressed generated chunk cache (0 = none)", false);
+    cvars.addDouble("cold_after", &coldChunkSeconds, 0.0, 3600.0, "Seconds before unread chunks are compressed (0 = never)", false);
+    cvars.addEnum("far_field", &farField, FAR_FIELD_NAMES, FAR_FIELD_MODE_COUNT, "Distant terrain technique", false);
+    cvars.addBool("face_records", &useFaceRecords, "One record per quad instead of four vertices", false);
+    cvars.addBool("gpu_mesher", &useGpuMesher, "Mesh opaque-only chunks in a compute shader", false);
+    cvars.addBool("vertex_pulling", &useVertexPulling, "Fetch chunk vertices from a storage buffer on GL 4.3", false);
+    cvars.addFloat("stereo", &stereoSeparation, 0.0f, 10.0f, "Eye separation in blocks (0 = one view)", false);
+    cvars.addDouble("warmup", &warmupSeconds, 0.0, 120.0, "Longest warm-up before the window is shown", false);
 }
 
 // Callback function called when the mouse scroll wheel is used
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    inputRecorder.scroll(static_cast<float>(yoffset));
     if (fov >= 1.0f && fov <= 90.0f)
         fov -= static_cast<float>(yoffset);
     if (fov <= 1.0f)
@@ -551,34 +3567,24 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
         fov = 90.0f;
 }
 
-// Function to compile a shader from source code
-unsigned int compileShader(unsigned int type, const char* source)
-{
-    unsigned int shaderID = glCreateShader(type);
-    glShaderSource(shaderID, 1, &source, NULL);
-    glCompileShader(shaderID);
-
-    // Error handling
-    int success;
-    char infoLog[512];
-    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(shaderID, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    return shaderID;
-}
-
 // Function to calculate FPS and update window title
-double statsTracker(GLFWwindow* window, int* totalBlocks)
+double statsTracker(GLFWwindow* window, FramePacket& frame)
 {
     static double previousSeconds = 0.0;
+    static double previousFrameSeconds = -1.0;
     static int frameCount = 0;
     static double lastFps = 0.0;  // Store the last valid FPS value
+    static StatsOverlay overlay;  // ... and overlay figures
     double currentSeconds = glfwGetTime();
     double elapsedSeconds = currentSeconds - previousSeconds;
 
+    // Every frame's time goes into the history, with the counters the
+    // render thread reported back in this packet
+    if (previousFrameSeconds >= 0.0)
+        frameStats.addFrame(currentSeconds - previousFrameSeconds, packetCounters(frame));
+    previousFrameSeconds = currentSeconds;
+    memoryFrames.endFrame();
+
     frameCount++;
 
     // Update FPS every 0.1 seconds
@@ -586,87 +3592,88 @@ double statsTracker(GLFWwindow* window, int* totalBlocks)
     {
         lastFps = frameCount / elapsedSeconds;  // Calculate FPS
 
-        // Display FPS and block count in window title (optional)
-        char tmp[128];
-        snprintf(tmp, sizeof(tmp), "OpenGL - 3D Cubes with Camera (%.1f FPS) - Blocks: %d", lastFps, *totalBlocks);
-        glfwSetWindowTitle(window, tmp);
+        // Frame time percentiles over the history and pool occupancy:
+        // chunks in use, then pooled voxel / mesh staging / GPU heap
+        // megabytes in use of reserved
+        const float MB = 1024.0f * 1024.0f;
+        overlay.times = frameStats.summary();
+        overlay.chunksInUse = chunkPool().blocksInUse();
+        overlay.chunksReserved = chunkPool().blocksReserved();
+        overlay.voxelMB[0] = voxelStoragePool().bytesInUse() / MB;
+        overlay.voxelMB[1] = voxelStoragePool().bytesReserved() / MB;
+        overlay.stagingMB[0] = meshStagingPool().bytesInUse() / MB;
+        overlay.stagingMB[1] = meshStagingPool().bytesReserved() / MB;
+        overlay.heapMB[0] = chunkMeshHeap().bytesInUse() / MB;
+        overlay.heapMB[1] = chunkMeshHeap().bytesReserved() / MB;
+        for (int t = 0; t < MEMORY_TAG_COUNT; t++) {
+            const MemoryTagStats& tag = memoryFrames.current.tags[t];
+            overlay.tagMB[t][0] = tag.bytes / MB;
+            overlay.tagMB[t][1] = tag.peakBytes / MB;
+            overlay.tagFrameAllocations[t] = memoryFrames.peakFrameAllocations[t];
+        }
+        memoryFrames.resetPeaks();
+        if (metricsExporter.running()) {
+            metricsExporter.set(METRIC_FPS, overlay.times.fps);
+            metricsExporter.set(METRIC_FRAME_P50_MS, overlay.times.p50Ms);
+            metricsExporter.set(METRIC_FRAME_P95_MS, overlay.times.p95Ms);
+            metricsExporter.set(METRIC_FRAME_P99_MS, overlay.times.p99Ms);
+            metricsExporter.set(METRIC_FRAME_MAX_MS, overlay.times.maxMs);
+            for (int t = 0; t < MEMORY_TAG_COUNT; t++)
+                metricsExporter.set((Metric)(METRIC_MEMORY_OTHER_MB + t), overlay.tagMB[t][0]);
+            metricsExporter.set(METRIC_GPU_HEAP_MB, overlay.heapMB[0]);
+        }
+
+        // The same in the window title when asked for, with the counters of
+        // the last frame rendered from this packet: setting the title goes
+        // through the message loop on Windows, and it isn't seen in fullscreen
+        if (statsInTitle) {
+            const FrameTimeSummary& times = overlay.times;
+            char tmp[480];
+            snprintf(tmp, sizeof(tmp), "OpenGL - 3D Cubes with Camera (%.1f FPS) - Frame p50/p95/p99/max: %.1f/%.1f/%.1f/%.1f ms - Quads: %d - Draws: %d - Visible: %d/%d - Upload: %.0f KB - State: %d/%d - Chunks: %zu/%zu - Voxels: %.1f/%.1f MB - Staging: %.1f/%.1f MB - Heap: %.1f/%.1f MB",
+                lastFps, times.p50Ms, times.p95Ms, times.p99Ms, times.maxMs, frame.quads, frame.drawCalls,
+                frame.visibleChunks, frame.chunkCount, frame.uploadedBytes / 1024.0, frame.stateCalls, frame.filteredStateCalls,
+                overlay.chunksInUse, overlay.chunksReserved, overlay.voxelMB[0], overlay.voxelMB[1],
+                overlay.stagingMB[0], overlay.stagingMB[1], overlay.heapMB[0], overlay.heapMB[1]);
+            glfwSetWindowTitle(window, tmp);
+        }
 
         // Reset frame count and time for next FPS calculation
         frameCount = 0;
         previousSeconds = currentSeconds;
     }
+    frame.stats = overlay;
 
     return lastFps;  // Return the last valid FPS value, even if not updated this frame
 }
 
-// Function to render text on the screen
-void RenderText(unsigned int shader, std::string text, float x, float y, float scale, glm::vec3 color)
+// Work counters the render thread wrote back into a packet
+FrameCounters packetCounters(const FramePacket& frame)
 {
-    // Activate corresponding render state	
-    glUseProgram(shader);
-    glUniform3f(glGetUniformLocation(shader, "textColor"), color.x, color.y, color.z);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(textVAO);
-
-    // Iterate through all characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = Characters[*c];
-
-        float xpos = x + ch.Bearing.x * scale;
-        float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-        float w = ch.Size.x * (scale / 2);
-        float h = ch.Size.y * (scale / 2);
-        // Update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }
-        };
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        // Render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        // Advance cursor for next glyph
-        x += (ch.Advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64)
-    }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    FrameCounters counters;
+    counters.drawCalls = frame.drawCalls;
+    counters.triangles = frame.quads * 2;
+    counters.loadedChunks = frame.chunkCount;
+    counters.visibleChunks = frame.visibleChunks;
+    counters.uploadedBytes = frame.uploadedBytes;
+    counters.meshesUploaded = frame.uploadedMeshes;
+    return counters;
 }
 
-bool isChunkInViewFrustum(const glm::vec3& chunkPos, const glm::mat4& view, const glm::mat4& projection, float chunkSize) {
-    // Define the 8 corners of the chunk
-    glm::vec3 corners[8];
-    corners[0] = chunkPos;
-    corners[1] = chunkPos + glm::vec3(chunkSize, 0, 0);
-    corners[2] = chunkPos + glm::vec3(0, chunkSize, 0);
-    corners[3] = chunkPos + glm::vec3(0, 0, chunkSize);
-    corners[4] = chunkPos + glm::vec3(chunkSize, chunkSize, 0);
-    corners[5] = chunkPos + glm::vec3(chunkSize, 0, chunkSize);
-    corners[6] = chunkPos + glm::vec3(0, chunkSize, chunkSize);
-    corners[7] = chunkPos + glm::vec3(chunkSize, chunkSize, chunkSize);
-
-    // Check if any of the chunk's corners are inside the view frustum
-    for (int i = 0; i < 8; i++) {
-        glm::vec4 clipSpacePos = projection * view * glm::vec4(corners[i], 1.0f);
-
-        // Perform the frustum check for each corner
-        if (clipSpacePos.x > -clipSpacePos.w && clipSpacePos.x < clipSpacePos.w &&
-            clipSpacePos.y > -clipSpacePos.w && clipSpacePos.y < clipSpacePos.w &&
-            clipSpacePos.z > -clipSpacePos.w && clipSpacePos.z < clipSpacePos.w) {
-            return true; // If any corner is inside the frustum, the chunk is visible
-        }
-    }
+// Fill the renderer's visible list for the CPU culling paths
+int cullChunks(ChunkRenderer& renderer, const Frustum& frustum, const glm::dvec3& eye, bool visibilityCulling)
+{
+    // Both orders are nearest first; the graph walk is breadth-first already
+    glm::ivec3 cameraChunk = glm::ivec3(glm::floor(eye / (double)CHUNK_SIZE));
+    if (visibilityCulling)
+        return renderer.cullVisibility(frustum, cameraChunk);
+
+    int visibleCount = renderer.cull(frustum);
+    renderer.sortFrontToBack(cameraChunk);
+    return visibleCount;
+}
 
-    // If no corner is visible, the chunk is not in the view frustum
-    return false;
+// Function to render text on the screen; queued in textBatch until its flush()
+void RenderText(const char* text, float x, float y, float scale, glm::vec3 color)
+{
+    textBatch.add(text, x, y, scale, color);
 }
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only mapping of a whole file. Other handles may keep writing to the
+// file; the mapping only covers the size it had when map() was called.
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { unmap(); }
+
+    // False if the file is missing, empty or can't be mapped
+    bool map(const std::string& path);
+    void unmap();
+
+private:
+    // Windows file and file mapping handles (HANDLE)
+    void* file = nullptr;
+    void* mapping = nullptr;
+};
@@ -0,0 +1,158 @@
+#include "memory_tracking.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+const char* MEMORY_TAG_NAMES[MEMORY_TAG_COUNT] = { "Other", "Voxels", "Meshes", "Text", "Jobs", "I/O" };
+
+namespace {
+
+// A cache line per tag, so threads working for different subsystems don't
+// contend on each other's counters
+struct alignas(64) TagCounters {
+    std::atomic<size_t> bytes{ 0 };
+    std::atomic<size_t> peakBytes{ 0 };
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> frees{ 0 };
+};
+
+// Constant-initialised, so allocations made during static initialisation
+// can already be counted
+TagCounters counters[MEMORY_TAG_COUNT];
+thread_local MemoryTag currentTag = MEMORY_OTHER;
+
+} // namespace
+
+void memoryTrackAlloc(MemoryTag tag, size_t bytes)
+{
+    TagCounters& tagCounters = counters[tag];
+    size_t live = tagCounters.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    size_t peak = tagCounters.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !tagCounters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    tagCounters.allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void memoryTrackFree(MemoryTag tag, size_t bytes)
+{
+    counters[tag].bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    counters[tag].frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+MemorySnapshot memorySnapshot()
+{
+    MemorySnapshot snapshot;
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++) {
+        snapshot.tags[t].bytes = counters[t].bytes.load(std::memory_order_relaxed);
+        snapshot.tags[t].peakBytes = counters[t].peakBytes.load(std::memory_order_relaxed);
+        snapshot.tags[t].allocations = counters[t].allocations.load(std::memory_order_relaxed);
+        snapshot.tags[t].frees = counters[t].frees.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+size_t MemorySnapshot::totalBytes() const
+{
+    size_t total = 0;
+    for (const MemoryTagStats& tag : tags)
+        total += tag.bytes;
+    return total;
+}
+
+MemoryTag threadMemoryTag()
+{
+    return currentTag;
+}
+
+void setThreadMemoryTag(MemoryTag tag)
+{
+    currentTag = tag;
+}
+
+void MemoryFrameCounter::endFrame()
+{
+    current = memorySnapshot();
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++) {
+        frameAllocations[t] = current.tags[t].allocations - previousAllocations[t];
+        previousAllocations[t] = current.tags[t].allocations;
+        if (frameAllocations[t] > peakFrameAllocations[t])
+            peakFrameAllocations[t] = frameAllocations[t];
+    }
+}
+
+void MemoryFrameCounter::resetPeaks()
+{
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++)
+        peakFrameAllocations[t] = 0;
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+// Global operator new and delete, counting each block against the tag of
+// the thread that allocated it. The size and tag go in a header in front
+// of the block, as wide as the alignment new guarantees, so the free is
+// attributed to the same tag whichever thread makes it.
+struct alignas(16) AllocationHeader {
+    size_t bytes;
+    MemoryTag tag;
+};
+
+static void* trackedNew(size_t bytes)
+{
+    AllocationHeader* header = (AllocationHeader*)malloc(sizeof(AllocationHeader) + (bytes ? bytes : 1));
+    if (!header)
+        return nullptr;
+    header->bytes = bytes;
+    header->tag = currentTag;
+    memoryTrackAlloc(header->tag, bytes);
+    return header + 1;
+}
+
+static void trackedDelete(void* block)
+{
+    if (!block)
+        return;
+    AllocationHeader* header = (AllocationHeader*)block - 1;
+    memoryTrackFree(header->tag, header->bytes);
+    free(header);
+}
+
+void* operator new(size_t bytes)
+{
+    void* block = trackedNew(bytes);
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t bytes)
+{
+    void* block = trackedNew(bytes);
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept { return trackedNew(bytes); }
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept { return trackedNew(bytes); }
+void operator delete(void* block) noexcept { trackedDelete(block); }
+void operator delete[](void* block) noexcept { trackedDelete(block); }
+void operator delete(void* block, size_t) noexcept { trackedDelete(block); }
+void operator delete[](void* block, size_t) noexcept { trackedDelete(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { trackedDelete(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { trackedDelete(block); }
+
+bool memoryHooksInstalled()
+{
+    return true;
+}
+
+#else
+
+bool memoryHooksInstalled()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Subsystems memory is attributed to
+enum MemoryTag {
+    MEMORY_OTHER,       // Untagged
+    MEMORY_VOXELS,      // Chunks, their voxel storage and snapshots, generation
+    MEMORY_MESHES,      // Mesh building and staging
+    MEMORY_TEXT,        // Glyphs and HUD text
+    MEMORY_JOBS,        // Job system bookkeeping and untagged work on its workers
+    MEMORY_IO,          // Region files and saves, on the I/O thread
+    MEMORY_TAG_COUNT
+};
+extern const char* MEMORY_TAG_NAMES[MEMORY_TAG_COUNT];
+
+// Memory of one tag
+struct MemoryTagStats {
+    size_t bytes = 0;           // Live
+    size_t peakBytes = 0;       // Most live at once since start
+    uint64_t allocations = 0;   // Since start
+    uint64_t frees = 0;
+};
+
+// Every tag's figures at one moment (each read on its own, so totals may
+// be off by allocations in flight)
+struct MemorySnapshot {
+    MemoryTagStats tags[MEMORY_TAG_COUNT];
+
+    size_t totalBytes() const;
+};
+
+// Accounting of allocations per tag, lock-free from any thread. The pools
+// (BlockPool, SizeClassPool) report theirs under the tag they were created
+// with in every build. Builds with TRACK_ALLOCATIONS defined also replace
+// the global operator new and delete, which then attribute every heap
+// allocation to the allocating thread's current tag; without it, memory
+// outside the pools isn't seen.
+void memoryTrackAlloc(MemoryTag tag, size_t bytes);
+void memoryTrackFree(MemoryTag tag, size_t bytes);
+MemorySnapshot memorySnapshot();
+// True in TRACK_ALLOCATIONS builds
+bool memoryHooksInstalled();
+
+// The calling thread's current tag, MEMORY_OTHER until set. Long-lived
+// threads set theirs once at the top; work that belongs to a subsystem
+// wherever it runs uses a MemoryTagScope.
+MemoryTag threadMemoryTag();
+void setThreadMemoryTag(MemoryTag tag);
+
+struct MemoryTagScope {
+    explicit MemoryTagScope(MemoryTag tag) : previous(threadMemoryTag()) { setThreadMemoryTag(tag); }
+    ~MemoryTagScope() { setThreadMemoryTag(previous); }
+    MemoryTagScope(const MemoryTagScope&) = delete;
+    MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+
+private:
+    MemoryTag previous;
+};
+
+// Allocations per frame, from the snapshot the main thread takes once a
+// frame. Counts are of every thread's allocations between two frames.
+struct MemoryFrameCounter {
+    // Close the frame that just ended
+    void endFrame();
+    // Start the per-frame peaks over
+    void resetPeaks();
+
+    MemorySnapshot current;                             // As of the last endFrame()
+    uint64_t frameAllocations[MEMORY_TAG_COUNT] = {};   // During the frame it closed
+    uint64_t peakFrameAllocations[MEMORY_TAG_COUNT] = {}; // Most in one frame since resetPeaks()
+
+private:
+    uint64_t previousAllocations[MEMORY_TAG_COUNT] = {};
+};
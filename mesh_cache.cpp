@@ -0,0 +1,213 @@
+#include "mesh_cache.h"
+#include "region_file.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+const uint32_t MESH_CACHE_MAGIC = 0x434D5856; // "VXMC"
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t format;        // meshFormatHash() of the builder
+    uint32_t entryCount;
+    uint32_t vertexCount;
+};
+struct MeshCacheEntry {
+    uint64_t hash;
+    uint32_t firstVertex;   // Opaque quads' vertices, then the translucent ones
+    uint32_t quadCount;
+    uint32_t translucentQuads;
+    uint16_t faceVisibility;
+    uint16_t reserved;
+};
+static_assert(sizeof(MeshCacheEntry) == 24, "entries are written as they are laid out");
+
+struct MeshCache::Sidecar {
+    MappedFile view;
+    const MeshCacheEntry* entries = nullptr;
+    uint32_t entryCount = 0;
+    const ChunkVertex* vertices = nullptr;
+    uint32_t vertexCount = 0;
+
+    // Map 'path' and check it was built with 'format'
+    bool open(const std::string& path, uint32_t format)
+    {
+        if (!view.map(path) || view.size < sizeof(MeshCacheHeader))
+            return false;
+        MeshCacheHeader header;
+        memcpy(&header, view.data, sizeof(header));
+        if (header.magic != MESH_CACHE_MAGIC || header.format != format)
+            return false;
+        uint64_t size = sizeof(header) + (uint64_t)header.entryCount * sizeof(MeshCacheEntry)
+            + (uint64_t)header.vertexCount * sizeof(ChunkVertex);
+        if (size != view.size)
+            return false;
+        // Every part is 4- or 8-byte sized and the mapping page-aligned
+        entries = (const MeshCacheEntry*)(view.data + sizeof(header));
+        entryCount = header.entryCount;
+        vertices = (const ChunkVertex*)(entries + entryCount);
+        vertexCount = header.vertexCount;
+        return true;
+    }
+};
+
+// Mixes 64-bit words of the snapshot, read unaligned
+uint64_t meshSnapshotHash(const ChunkVoxels& voxels)
+{
+    static_assert(sizeof(ChunkVoxels) % sizeof(uint64_t) == 0, "snapshots hash whole words");
+    const uint8_t* bytes = (const uint8_t*)&voxels;
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < sizeof(ChunkVoxels); i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 29;
+    }
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 33);
+}
+
+uint32_t meshFormatHash(MeshMode mode)
+{
+    // FNV-1a over the fields
+    const uint32_t fields[] = { MESHER_VERSION, (uint32_t)mode, (uint32_t)sizeof(ChunkVertex),
+        (uint32_t)CHUNK_SIZE, (uint32_t)BLOCK_TYPE_COUNT };
+    uint32_t h = 2166136261u;
+    for (uint32_t field : fields) {
+        for (int b = 0; b < 4; b++) {
+            h ^= (field >> (b * 8)) & 0xFF;
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+std::string meshCachePath(const std::string& directory, const glm::ivec3& coord)
+{
+    return directory + "/r." + std::to_string(floorDivRegion(coord.x)) + "." +
+        std::to_string(floorDivRegion(coord.z)) + ".meshes";
+}
+
+bool meshCacheCurrent(const std::string& directory, const glm::ivec3& coord, MeshMode mode)
+{
+    FILE* file = fopen(meshCachePath(directory, coord).c_str(), "rb");
+    if (!file)
+        return false;
+    MeshCacheHeader header;
+    bool current = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == MESH_CACHE_MAGIC && header.format == meshFormatHash(mode);
+    fclose(file);
+    return current;
+}
+
+MeshCache::MeshCache() {}
+
+MeshCache::~MeshCache()
+{
+    close();
+}
+
+bool MeshCache::open(const std::string& directory, MeshMode buildMode)
+{
+    close();
+    root = directory;
+    mode = buildMode;
+    hits = 0;
+    misses = 0;
+    return true;
+}
+
+void MeshCache::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    sidecars.clear();
+    root.clear();
+}
+
+MeshCache::Sidecar* MeshCache::sidecarOf(const glm::ivec3& coord)
+{
+    uint64_t key = packChunkCoord(glm::ivec3(floorDivRegion(coord.x), 0, floorDivRegion(coord.z)));
+    std::lock_guard<std::mutex> lock(mutex);
+    // A null entry remembers a region without a usable sidecar
+    auto found = sidecars.find(key);
+    if (found != sidecars.end())
+        return found->second.get();
+
+    std::unique_ptr<Sidecar> opened(new Sidecar());
+    std::unique_ptr<Sidecar>& sidecar = sidecars[key];
+    sidecar = opened->open(meshCachePath(root, coord), meshFormatHash(mode)) ? std::move(opened) : nullptr;
+    return sidecar.get();
+}
+
+bool MeshCache::find(const glm::ivec3& coord, uint64_t hash, CachedMesh& out)
+{
+    Sidecar* sidecar = isOpen() ? sidecarOf(coord) : nullptr;
+    if (!sidecar) {
+        misses++;
+        return false;
+    }
+    const MeshCacheEntry* end = sidecar->entries + sidecar->entryCount;
+    const MeshCacheEntry* entry = std::lower_bound(sidecar->entries, end, hash,
+        [](const MeshCacheEntry& e, uint64_t h) { return e.hash < h; });
+    uint64_t vertexEnd = entry != end ?
+        (uint64_t)entry->firstVertex + ((uint64_t)entry->quadCount + entry->translucentQuads) * 4 : 0;
+    if (entry == end || entry->hash != hash || vertexEnd > sidecar->vertexCount) {
+        misses++;
+        return false;
+    }
+    out.vertices = sidecar->vertices + entry->firstVertex;
+    out.quadCount = (int)entry->quadCount;
+    out.translucentVertices = out.vertices + entry->quadCount * 4;
+    out.translucentQuads = (int)entry->translucentQuads;
+    out.faceVisibility = entry->faceVisibility;
+    hits++;
+    return true;
+}
+
+void MeshCacheWriter::add(uint64_t hash, const MeshResult& mesh)
+{
+    if (!added.insert(hash).second)
+        return;
+    entries.push_back({ hash, (uint32_t)vertices.size(), (uint32_t)mesh.quadCount, (uint32_t)mesh.translucentQuads,
+        mesh.faceVisibility });
+    vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    vertices.insert(vertices.end(), mesh.translucentVertices.begin(), mesh.translucentVertices.end());
+}
+
+bool MeshCacheWriter::write(const std::string& directory, const glm::ivec3& coord, MeshMode mode)
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.hash < b.hash; });
+    std::vector<MeshCacheEntry> table(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+        table[i] = { entries[i].hash, entries[i].firstVertex, entries[i].quadCount, entries[i].translucentQuads,
+            entries[i].faceVisibility, 0 };
+    MeshCacheHeader header = { MESH_CACHE_MAGIC, meshFormatHash(mode), (uint32_t)table.size(), (uint32_t)vertices.size() };
+
+    // Written aside, then swapped in: a cut-short write leaves no torn sidecar
+    std::string path = meshCachePath(directory, coord);
+    std::string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(table.data(), sizeof(MeshCacheEntry), table.size(), file) == table.size()
+        && fwrite(vertices.data(), sizeof(ChunkVertex), vertices.size(), file) == vertices.size();
+    ok = fclose(file) == 0 && ok;
+    clear();
+    if (!ok) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    remove(path.c_str());
+    return rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+void MeshCacheWriter::clear()
+{
+    entries.clear();
+    vertices.clear();
+    added.clear();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_geometry.h"
+#include "chunk_mesher.h"
+#include "chunk_visibility.h"
+#include "mapped_file.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Hash of everything a mesh is built from: a snapshot's blocks, light and
+// neighbour borders
+uint64_t meshSnapshotHash(const ChunkVoxels& voxels);
+// Stamp of the meshes a builder makes: MESHER_VERSION, the mode and the
+// vertex format
+uint32_t meshFormatHash(MeshMode mode);
+
+// One mesh of a MeshCache, pointing into its mapped sidecar
+struct CachedMesh {
+    const ChunkVertex* vertices;
+    int quadCount;
+    const ChunkVertex* translucentVertices;  // In build order: sort before use
+    int translucentQuads;
+    FaceVisibility faceVisibility;
+};
+
+// Finished chunk meshes saved beside a world's region files, one sidecar
+// per region ("r.<x>.<z>.meshes"), written by the world baker. A mesh is
+// addressed by meshSnapshotHash() of the snapshot it was built from, so a
+// chunk that changed since (or whose neighbours did) simply misses and is
+// meshed as usual; identical snapshots, common underground, share an entry.
+//
+// A sidecar is a header stamped with meshFormatHash(), the entries sorted
+// by hash, then the vertices in ChunkVertex format. It is read through a
+// memory mapping, so a hit is a binary search and a copy of the vertices.
+//
+// Safe to use from several threads: mesher workers look up meshes.
+struct MeshCache {
+    // Use the sidecars in 'directory' built with 'mode'; the others are ignored
+    bool open(const std::string& directory, MeshMode mode);
+    void close();
+    bool isOpen() const { return !root.empty(); }
+
+    // Mesh of the chunk at 'coord' whose snapshot hashes to 'hash'. The
+    // pointers stay valid until close().
+    bool find(const glm::ivec3& coord, uint64_t hash, CachedMesh& out);
+
+    // Builder the sidecars in use were made with
+    MeshMode mode = MESH_GREEDY;
+
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+
+    MeshCache();
+    ~MeshCache();
+
+private:
+    struct Sidecar;
+    // The sidecar of the region holding 'coord', mapped on first use; null
+    // when it is missing or from another builder
+    Sidecar* sidecarOf(const glm::ivec3& coord);
+
+    std::string root;
+    std::mutex mutex;   // Guards sidecars; mapped ones are only read
+    std::unordered_map<uint64_t, std::unique_ptr<Sidecar>> sidecars;
+};
+
+// Collects the meshes of one region and writes its sidecar
+struct MeshCacheWriter {
+    // Add a finished mesh of a snapshot hashing to 'hash' (a hash already
+    // added is kept once). Empty ones count too: buried chunks cost a
+    // meshing pass to find they have no faces.
+    void add(uint64_t hash, const MeshResult& mesh);
+    // Write the sidecar of the region holding 'coord' into 'directory',
+    // replacing any, then clear(). False on I/O errors.
+    bool write(const std::string& directory, const glm::ivec3& coord, MeshMode mode);
+    void clear();
+    int count() const { return (int)entries.size(); }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        uint32_t firstVertex;
+        uint32_t quadCount;
+        uint32_t translucentQuads;
+        FaceVisibility faceVisibility;
+    };
+    std::vector<Entry> entries;
+    std::vector<ChunkVertex> vertices;
+    std::unordered_set<uint64_t> added;
+};
+
+// Path of the sidecar of the region holding 'coord'
+std::string meshCachePath(const std::string& directory, const glm::ivec3& coord);
+// True if that sidecar exists and was built with 'mode'
+bool meshCacheCurrent(const std::string& directory, const glm::ivec3& coord, MeshMode mode);
@@ -0,0 +1,160 @@
+#include "metrics_exporter.h"
+#include "memory_tracking.h"
+#include "profiler.h"
+#include "thread_priority.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+
+const char* METRIC_NAMES[METRIC_COUNT] = {
+    "fps",
+    "frame.p50_ms",
+    "frame.p95_ms",
+    "frame.p99_ms",
+    "frame.max_ms",
+    "memory.other_mb",
+    "memory.voxels_mb",
+    "memory.meshes_mb",
+    "memory.text_mb",
+    "memory.jobs_mb",
+    "memory.io_mb",
+    "memory.gpu_heap_mb",
+    "queue.generation",
+    "queue.lighting",
+    "queue.meshing",
+    "queue.lod",
+    "errors.gl",
+    "warnings.gl_performance",
+};
+
+static_assert(METRIC_MEMORY_IO_MB - METRIC_MEMORY_OTHER_MB + 1 == MEMORY_TAG_COUNT, "a memory metric per MemoryTag");
+
+const int STATSD_DEFAULT_PORT = 8125;
+// Room for every metric in one datagram under a typical MTU
+const size_t SAMPLE_BYTES = 1400;
+
+bool MetricsExporter::start(std::string& error)
+{
+    stop();
+    if (filePath) {
+        file = fopen(filePath, "ab");
+        if (!file) {
+            error = std::string("can't open ") + filePath;
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        fileBytes = (size_t)ftell(file);
+    }
+    if (statsdAddress) {
+        std::string host = statsdAddress;
+        int port = STATSD_DEFAULT_PORT;
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos) {
+            port = atoi(host.c_str() + colon + 1);
+            host.resize(colon);
+        }
+        netStarted = netStartup();
+        if (!netStarted || !statsd.connect(host.c_str(), port)) {
+            error = std::string("can't reach ") + statsdAddress;
+            stop();
+            return false;
+        }
+    }
+
+    stopping = false;
+    thread = std::thread(&MetricsExporter::loop, this);
+    return true;
+}
+
+void MetricsExporter::stop()
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    statsd.close();
+    if (netStarted) {
+        netShutdown();
+        netStarted = false;
+    }
+}
+
+void MetricsExporter::loop()
+{
+    profilerSetThreadName("Metrics");
+    setCurrentThreadPriority(THREAD_LOW_PRIORITY);
+    std::unique_lock<std::mutex> lock(mutex);
+    auto next = std::chrono::steady_clock::now();
+    for (;;) {
+        next += std::chrono::microseconds((long long)(intervalSeconds * 1e6));
+        wake.wait_until(lock, next, [this] { return stopping; });
+        bool last = stopping;
+        lock.unlock();
+        exportSample();
+        lock.lock();
+        if (last)
+            return;
+    }
+}
+
+void MetricsExporter::exportSample()
+{
+    PROFILE_ZONE("Export metrics");
+    double sample[METRIC_COUNT];
+    for (int m = 0; m < METRIC_COUNT; m++)
+        sample[m] = values[m].load(std::memory_order_relaxed);
+
+    char text[SAMPLE_BYTES];
+    if (file) {
+        int length = snprintf(text, sizeof(text), "{\"time\":%lld", (long long)time(nullptr));
+        for (int m = 0; m < METRIC_COUNT && length < (int)sizeof(text); m++)
+            length += snprintf(text + length, sizeof(text) - length, ",\"%s\":%.3f", METRIC_NAMES[m], sample[m]);
+        if (length < (int)sizeof(text) - 1) {
+            length += snprintf(text + length, sizeof(text) - length, "}\n");
+            writeFile(text, (size_t)length);
+        }
+    }
+    if (statsd.isOpen()) {
+        int length = 0;
+        for (int m = 0; m < METRIC_COUNT && length < (int)sizeof(text); m++)
+            length += snprintf(text + length, sizeof(text) - length, "%s.%s:%.3f|g\n", prefix, METRIC_NAMES[m], sample[m]);
+        if (length < (int)sizeof(text))
+            statsd.send(text, (size_t)length - 1);  // Without the last newline
+    }
+}
+
+void MetricsExporter::writeFile(const char* line, size_t length)
+{
+    if (fileBytes > 0 && fileBytes + length > maxFileBytes)
+        rotate();
+    if (!file)
+        return;
+    if (fwrite(line, 1, length, file) == length)
+        fileBytes += length;
+    fflush(file);
+}
+
+// <path> -> <path>.1 -> ... -> <path>.<backups>, the oldest dropped
+void MetricsExporter::rotate()
+{
+    fclose(file);
+    std::string path = filePath;
+    remove((path + "." + std::to_string(backups)).c_str());
+    for (int b = backups - 1; b >= 1; b--)
+        rename((path + "." + std::to_string(b)).c_str(), (path + "." + std::to_string(b + 1)).c_str());
+    if (backups > 0)
+        rename(filePath, (path + ".1").c_str());
+    else
+        remove(filePath);
+    file = fopen(filePath, "wb");
+    fileBytes = 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "net_connection.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Figures the exporter reports
+enum Metric {
+    METRIC_FPS,
+    METRIC_FRAME_P50_MS,
+    METRIC_FRAME_P95_MS,
+    METRIC_FRAME_P99_MS,
+    METRIC_FRAME_MAX_MS,
+    METRIC_MEMORY_OTHER_MB,         // Per MemoryTag, in its order
+    METRIC_MEMORY_VOXELS_MB,
+    METRIC_MEMORY_MESHES_MB,
+    METRIC_MEMORY_TEXT_MB,
+    METRIC_MEMORY_JOBS_MB,
+    METRIC_MEMORY_IO_MB,
+    METRIC_GPU_HEAP_MB,             // Chunk meshes in the vertex heap
+    METRIC_QUEUE_GENERATION,        // Chunks waiting to be generated or loaded
+    METRIC_QUEUE_LIGHTING,
+    METRIC_QUEUE_MESHING,
+    METRIC_QUEUE_LOD,
+    METRIC_GL_ERRORS,               // Since start, from the debug context
+    METRIC_GL_PERFORMANCE_WARNINGS,
+    METRIC_COUNT
+};
+extern const char* METRIC_NAMES[METRIC_COUNT];
+
+// Periodic export of the metrics for remote monitoring (--metrics-file,
+// --metrics-statsd). Any thread publishes a metric's latest value with
+// set(), a relaxed atomic store; a thread of the exporter's own wakes every
+// interval, reads them all and writes one sample to each sink, so a slow
+// disk or network never holds up a frame. Sinks:
+//   file    one JSON object per line, with the Unix time. Past maxFileBytes
+//           the file is rotated to <path>.1 (and .1 to .2 and so on, the
+//           oldest of 'backups' dropped), so a kiosk's disk never fills.
+//   StatsD  every metric as a gauge "<prefix>.<name>:<value>|g", all in one
+//           datagram to the agent.
+struct MetricsExporter {
+    const char* filePath = nullptr;
+    size_t maxFileBytes = 4 * 1024 * 1024;
+    int backups = 3;
+    const char* statsdAddress = nullptr;    // host[:port], port 8125 by default
+    const char* prefix = "voxel";           // Of the StatsD names
+    double intervalSeconds = 10.0;
+
+    // Open the sinks configured above and start the thread. False with a
+    // message in 'error' if a sink can't be opened.
+    bool start(std::string& error);
+    // Write a last sample and stop the thread
+    void stop();
+    bool running() const { return thread.joinable(); }
+
+    // Any thread; never blocks
+    void set(Metric metric, double value) { values[metric].store(value, std::memory_order_relaxed); }
+
+    MetricsExporter() = default;
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+    ~MetricsExporter() { stop(); }
+
+private:
+    void loop();
+    void exportSample();
+    void writeFile(const char* line, size_t length);
+    void rotate();
+
+    std::atomic<double> values[METRIC_COUNT] = {};
+
+    std::thread thread;
+    std::mutex mutex;               // Guards stopping; the thread only waits on it
+    std::condition_variable wake;
+    bool stopping = false;
+
+    FILE* file = nullptr;
+    size_t fileBytes = 0;
+    NetDatagramSocket statsd;
+    bool netStarted = false;
+};
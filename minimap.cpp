@@ -0,0 +1,164 @@
+#include "minimap.h"
+#include "chunk_renderer.h"
+#include "gl_state.h"
+#include "profiler.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+
+static_assert((MINIMAP_TILES & (MINIMAP_TILES - 1)) == 0, "slots are found by masking");
+static_assert(MINIMAP_TILES >= 2 * MINIMAP_RADIUS + 3, "the window must not reach a slot twice");
+
+// Texels of columns with nothing loaded: a dark backdrop
+const uint32_t MINIMAP_EMPTY = 0xA0101010;  // ABGR
+
+void Minimap::init(int textureUnit)
+{
+    unit = textureUnit;
+    glGenTextures(1, &texture);
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    glState().bindTexture(GL_TEXTURE_2D, texture);
+    std::vector<uint32_t> empty((size_t)MINIMAP_SIZE * MINIMAP_SIZE, MINIMAP_EMPTY);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, MINIMAP_SIZE, MINIMAP_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, empty.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glState().activeTexture(GL_TEXTURE0);
+
+    for (auto& row : slots)
+        for (Slot& slot : row)
+            slot = Slot();
+    order.clear();
+    for (int dx = 0; dx < WINDOW; dx++)
+        for (int dz = 0; dz < WINDOW; dz++)
+            order.push_back(glm::ivec2(dx, dz));
+    std::sort(order.begin(), order.end(), [](const glm::ivec2& a, const glm::ivec2& b) {
+        glm::ivec2 da = a - WINDOW / 2, db = b - WINDOW / 2;
+        return da.x * da.x + da.y * da.y < db.x * db.x + db.y * db.y;
+    });
+    pending = 0;
+}
+
+void Minimap::destroy()
+{
+    if (texture == 0)
+        return;
+    glState().deleteTextures(1, &texture);
+    texture = 0;
+}
+
+// Height and block of the highest non-air block of a block column: the
+// heightmap's top opaque block, or what stands on it (water, glass). -1 and
+// air when nothing is loaded there.
+static void surfaceAt(const World& world, WorldCursor& cursor, int x, int z, int& height, BlockId& block)
+{
+    height = world.skyHeight(x, z);
+    block = height >= 0 ? cursor.getBlock(glm::ivec3(x, height, z)) : (BlockId)BLOCK_AIR;
+    uint16_t sections = world.occupiedSections(glm::ivec2(floorDivChunk(x), floorDivChunk(z)));
+    for (int section = WORLD_HEIGHT_CHUNKS - 1; section >= 0 && (section + 1) * CHUNK_SIZE - 1 > height; section--) {
+        if (!(sections & (1u << section)))
+            continue;
+        for (int y = (section + 1) * CHUNK_SIZE - 1; y >= section * CHUNK_SIZE && y > height; y--) {
+            BlockId id = cursor.getBlock(glm::ivec3(x, y, z));
+            if (id != BLOCK_AIR) {
+                height = y;
+                block = id;
+                return;
+            }
+        }
+    }
+}
+
+void Minimap::build(const World& world, const glm::ivec2& column)
+{
+    // Heights one block column further west and north too, for the slopes
+    const int SPAN = CHUNK_SIZE + 1;
+    int heights[SPAN][SPAN];
+    BlockId blocks[SPAN][SPAN];
+    WorldCursor cursor(world);
+    glm::ivec2 first = column * CHUNK_SIZE - 1;
+    for (int z = 0; z < SPAN; z++)
+        for (int x = 0; x < SPAN; x++)
+            surfaceAt(world, cursor, first.x + x, first.y + z, heights[z][x], blocks[z][x]);
+
+    const float WORLD_HEIGHT = (float)(WORLD_HEIGHT_CHUNKS * CHUNK_SIZE);
+    texels.resize(CHUNK_SIZE * CHUNK_SIZE);
+    for (int z = 1; z < SPAN; z++) {
+        for (int x = 1; x < SPAN; x++) {
+            uint32_t& texel = texels[(z - 1) * CHUNK_SIZE + (x - 1)];
+            int height = heights[z][x];
+            if (height < 0) {
+                texel = MINIMAP_EMPTY;
+                continue;
+            }
+            // Lit from the north-west; a neighbour with nothing loaded is level
+            int slope = heights[z - 1][x - 1] >= 0 ? height - heights[z - 1][x - 1] : 0;
+            float shade = 1.0f + 0.1f * (float)glm::clamp(slope, -4, 4);
+            shade *= 0.7f + 0.6f * (float)height / WORLD_HEIGHT;
+            glm::vec3 color = glm::clamp(BLOCK_COLORS[blocks[z][x]] * shade, 0.0f, 1.0f) * 255.0f + 0.5f;
+            texel = 0xFF000000u | (uint32_t)color.b << 16 | (uint32_t)color.g << 8 | (uint32_t)color.r;
+        }
+    }
+
+    glm::ivec2 texel = (column & (MINIMAP_TILES - 1)) * CHUNK_SIZE;
+    glState().bindTexture(GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, texel.x, texel.y, CHUNK_SIZE, CHUNK_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+}
+
+int Minimap::update(const World& world, const ChunkRenderer& renderer, const glm::dvec3& eye)
+{
+    PROFILE_ZONE("Minimap");
+    glm::ivec2 eyeColumn = glm::ivec2(glm::floor(glm::dvec2(eye.x, eye.z) / (double)CHUNK_SIZE));
+    glm::ivec2 window = eyeColumn - WINDOW / 2;
+
+    // What each column holds now: its chunks and their mesh versions, which
+    // change with their voxels. Summed, so the order they come in is moot.
+    for (auto& row : signatures)
+        for (uint64_t& signature : row)
+            signature = 0;
+    for (const ChunkRenderData& data : renderer.chunks) {
+        glm::ivec2 at = glm::ivec2(data.chunk->coord.x, data.chunk->coord.z) - window + 1;
+        if (at.x < 0 || at.x > WINDOW || at.y < 0 || at.y > WINDOW)
+            continue;
+        signatures[at.x][at.y] += ((uint64_t)(uintptr_t)data.chunk ^ data.meshVersion) * 0x9E3779B97F4A7C15ull + 1;
+    }
+
+    int built = 0;
+    pending = 0;
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    for (const glm::ivec2& offset : order) {
+        glm::ivec2 column = window + offset;
+        glm::ivec2 at = offset + 1;
+        // The tile's border slopes read the columns west and north of it
+        uint64_t signature = signatures[at.x][at.y] * 3 + signatures[at.x - 1][at.y] * 5 +
+            signatures[at.x][at.y - 1] * 7 + signatures[at.x - 1][at.y - 1] * 11;
+        glm::ivec2 index = column & (MINIMAP_TILES - 1);
+        Slot& slot = slots[index.x][index.y];
+        if (slot.column == column && slot.signature == signature)
+            continue;
+        if (built == tilesPerFrame) {
+            pending++;
+            continue;
+        }
+        build(world, column);
+        slot.column = column;
+        slot.signature = signature;
+        built++;
+    }
+    glState().activeTexture(GL_TEXTURE0);
+    return built;
+}
+
+glm::vec4 Minimap::view(const glm::dvec3& eye) const
+{
+    // Wrapped in double, so the centre keeps its fraction anywhere in the world
+    double size = MINIMAP_SIZE;
+    float u = (float)((eye.x - std::floor(eye.x / size) * size) / size);
+    float v = (float)((eye.z - std::floor(eye.z / size) * size) / size);
+    float extent = (float)(MINIMAP_RADIUS * CHUNK_SIZE) / (float)MINIMAP_SIZE;
+    return glm::vec4(u - extent, v - extent, u + extent, v + extent);
+}
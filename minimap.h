@@ -0,0 +1,65 @@
+#pragma once
+
+#include "world.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct ChunkRenderer;
+
+// Top-down map of the terrain around the camera for the HUD. Every chunk
+// column is a tile of one RGBA texel per block column: the colour of its
+// highest block, brighter or darker by the slope of the heightmap towards
+// the north-west and by altitude. Tiles are addressed toroidally by column
+// (x and z wrap), like OccupancyVolume's chunks, so with repeat addressing
+// the map around any point is one quad of the texture (view()) that
+// TextBatch::addImage() draws with the rest of the HUD.
+//
+// A tile is rebuilt only when its column changes: a chunk of it (or of the
+// columns west and north, whose heights its border slopes read) is loaded,
+// unloaded or given a new mesh version by the renderer, or another column
+// moves into its slot. A budget of tiles per update(), nearest first; the
+// map costs nothing on the frames nothing changes.
+const int MINIMAP_RADIUS = 12;      // Chunk columns shown either side of the centre
+const int MINIMAP_TILES = 32;       // Tiles across the texture, a power of two above 2 * (MINIMAP_RADIUS + 1)
+const int MINIMAP_SIZE = MINIMAP_TILES * CHUNK_SIZE;
+
+struct Minimap {
+    int tilesPerFrame = 8;      // Tile rebuilds per update(); the rest wait
+
+    // Create the texture, bound to 'unit' for good
+    void init(int unit);
+    void destroy();
+
+    // Follow 'eye' over the renderer's chunks, rebuilding the tiles whose
+    // columns changed. Reads their voxels, so call while the world may be
+    // read. Returns the tiles rebuilt.
+    int update(const World& world, const ChunkRenderer& renderer, const glm::dvec3& eye);
+
+    // Texture coordinates (left, top, right, bottom) of the map centred on
+    // 'eye', MINIMAP_RADIUS columns each way, north (-z) up
+    glm::vec4 view(const glm::dvec3& eye) const;
+
+    // Tiles in the window still to rebuild
+    int pendingTiles() const { return pending; }
+
+private:
+    static const int WINDOW = 2 * MINIMAP_RADIUS + 3;   // Columns across that view() can reach
+    // What one tile of the texture holds
+    struct Slot {
+        glm::ivec2 column = glm::ivec2(INT32_MIN);  // INT32_MIN: nothing yet
+        uint64_t signature = 0;     // Of the chunks it was built from
+    };
+
+    void build(const World& world, const glm::ivec2& column);
+
+    unsigned int texture = 0;
+    int unit = 0;
+    Slot slots[MINIMAP_TILES][MINIMAP_TILES];
+    std::vector<glm::ivec2> order;  // Window offsets, nearest first
+    uint64_t signatures[WINDOW + 1][WINDOW + 1];  // Per column this update, with a row and column to the west and north
+    int pending = 0;
+    std::vector<uint32_t> texels;   // One tile, [z][x]
+};
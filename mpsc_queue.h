@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <utility>
+
+// Lock-free multi-producer, single-consumer queue. Producers push onto an
+// intrusive stack with a CAS loop; the consumer takes the whole stack at
+// once and restores push order.
+template <typename T>
+struct MPSCQueue {
+    MPSCQueue() = default;
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+    ~MPSCQueue()
+    {
+        Node* node = head.exchange(nullptr);
+        while (node) {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    // Any thread
+    void push(T value)
+    {
+        Node* node = new Node{ std::move(value), head.load(std::memory_order_relaxed) };
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Consumer thread only: append everything pushed so far to 'out', oldest first
+    void drain(std::deque<T>& out)
+    {
+        Node* node = head.exchange(nullptr, std::memory_order_acquire);
+
+        // Reverse the stack into push order
+        Node* ordered = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+        while (ordered) {
+            Node* next = ordered->next;
+            out.push_back(std::move(ordered->value));
+            delete ordered;
+            ordered = next;
+        }
+    }
+
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+    std::atomic<Node*> head{ nullptr };
+};
@@ -0,0 +1,613 @@
+#include "navigation_graph.h"
+#include "profiler.h"
+#include "voxel_collision.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+const int COLUMN_HEIGHT = WORLD_HEIGHT_CHUNKS * CHUNK_SIZE;
+const int BLOCK_COLUMNS = CHUNK_SIZE * CHUNK_SIZE;
+static_assert(BLOCK_COLUMNS <= 256, "block columns are numbered in a byte");
+const uint16_t NO_CELL = 0xFFFF;
+
+// Sides of a column its portals cross: -x, +x, -z, +z (side ^ 1 is the
+// opposite one), and drops within it
+static const glm::ivec2 SIDE_OFFSETS[4] = { glm::ivec2(-1, 0), glm::ivec2(1, 0), glm::ivec2(0, -1), glm::ivec2(0, 1) };
+const int SIDE_SAME = 4;
+
+static inline uint64_t columnKey(const glm::ivec2& column)
+{
+    return packChunkCoord(glm::ivec3(column.x, 0, column.y));
+}
+
+// Key of a region in the coarse search
+static inline uint64_t regionKey(const glm::ivec2& column, int region)
+{
+    return packChunkCoord(glm::ivec3(column.x, region, column.y));
+}
+
+// A walkable block: open, with an open block above and a solid one below
+struct NavCell {
+    int16_t y;              // Height of the feet block
+    uint8_t blockColumn;    // x * CHUNK_SIZE + z within the chunk column
+    uint8_t clearance;      // Open blocks from the feet up; 255 for at least that many
+    uint16_t region;
+};
+
+// True if a walker on 'from' can move onto 'to' in the next block column:
+// level, a block up with headroom to jump, or down a drop it can fall
+// past the edge into. Steps of one block are the same both ways.
+static inline bool canStep(const NavCell& from, const NavCell& to)
+{
+    int dy = to.y - from.y;
+    if (dy > 1 || dy < -NAV_MAX_DROP)
+        return false;
+    if (dy == 1)
+        return from.clearance >= 3;
+    return to.clearance >= 2 - dy;
+}
+
+// A step costs its horizontal block plus its climb or fall, never less
+// than the straight distance it covers
+static inline float stepCost(const NavCell& from, const NavCell& to)
+{
+    return 1.0f + (float)std::abs(to.y - from.y);
+}
+
+// A way from one region into another: the step from 'fromCell' onto 'toCell'
+struct NavLink {
+    uint16_t fromRegion;
+    uint16_t toRegion;
+    uint16_t fromCell;
+    uint16_t toCell;        // In the column across 'side'
+    int side;               // Index into SIDE_OFFSETS, SIDE_SAME for a drop
+    float cost;             // From the first region's centre to the second's
+};
+
+struct NavigationGraph::Column {
+    glm::ivec2 coord;
+    std::vector<NavCell> cells;             // By block column, then upwards
+    uint16_t first[BLOCK_COLUMNS + 1];      // First cell of each block column
+    std::vector<uint16_t> centres;          // Per region, the cell nearest its middle
+    std::vector<NavLink> links;             // Grouped by side
+
+    // Position within the column
+    glm::vec3 position(int cell) const
+    {
+        const NavCell& c = cells[cell];
+        return glm::vec3(c.blockColumn / CHUNK_SIZE, c.y, c.blockColumn % CHUNK_SIZE);
+    }
+    glm::ivec3 worldBlock(int cell) const
+    {
+        const NavCell& c = cells[cell];
+        return glm::ivec3(coord.x * CHUNK_SIZE + c.blockColumn / CHUNK_SIZE, c.y, coord.y * CHUNK_SIZE + c.blockColumn % CHUNK_SIZE);
+    }
+
+    // Call fn(next) for each cell of the column a walker on 'cell' can step onto
+    template <typename Fn>
+    void forEachStep(int cell, Fn fn) const
+    {
+        const NavCell& from = cells[cell];
+        for (int side = 0; side < 4; side++) {
+            int x = from.blockColumn / CHUNK_SIZE + SIDE_OFFSETS[side].x;
+            int z = from.blockColumn % CHUNK_SIZE + SIDE_OFFSETS[side].y;
+            if (x < 0 || x >= CHUNK_SIZE || z < 0 || z >= CHUNK_SIZE)
+                continue;
+            int c = x * CHUNK_SIZE + z;
+            for (int next = first[c]; next < first[c + 1]; next++) {
+                if (canStep(from, cells[next]))
+                    fn(next);
+            }
+        }
+    }
+
+    // A* within the region of 'from' to 'to', appending the feet blocks
+    // after 'from' up to 'to' to 'out'
+    bool walk(int from, int to, Search& search, std::vector<glm::ivec3>& out) const;
+};
+
+struct NavigationGraph::Job {
+    glm::ivec2 column;
+    PalettedBlocks blocks[WORLD_HEIGHT_CHUNKS];
+    std::unique_ptr<Column> result;
+};
+
+// One thread's scratch space for queries
+struct NavigationGraph::Search {
+    struct Region {
+        const Column* column = nullptr;     // nullptr until reached
+        uint16_t region = 0;
+        bool closed = false;
+        float cost = 0.0f;                  // From the start
+        uint64_t parent = 0;
+        const NavLink* via = nullptr;       // Portal from the parent
+    };
+    ChunkHashMap<Region> regions;           // By regionKey()
+    std::vector<std::pair<float, uint64_t>> regionOpen;
+    std::vector<std::pair<const Column*, const NavLink*>> legs;
+
+    std::vector<float> costs;               // Per cell of the column walked
+    std::vector<uint16_t> parents;
+    std::vector<uint8_t> closed;
+    std::vector<std::pair<float, int>> cellOpen;
+};
+
+// Open lists are min-heaps on the estimated total
+template <typename T>
+static bool laterFirst(const std::pair<float, T>& a, const std::pair<float, T>& b)
+{
+    return a.first > b.first;
+}
+
+bool NavigationGraph::Column::walk(int from, int to, Search& search, std::vector<glm::ivec3>& out) const
+{
+    if (from == to)
+        return true;
+    size_t count = cells.size();
+    search.costs.assign(count, std::numeric_limits<float>::max());
+    search.parents.assign(count, NO_CELL);
+    search.closed.assign(count, 0);
+    std::vector<std::pair<float, int>>& open = search.cellOpen;
+    open.clear();
+
+    uint16_t region = cells[from].region;
+    glm::vec3 target = position(to);
+    search.costs[from] = 0.0f;
+    open.push_back(std::make_pair(glm::distance(position(from), target), from));
+    while (!open.empty()) {
+        std::pop_heap(open.begin(), open.end(), laterFirst<int>);
+        int cell = open.back().second;
+        open.pop_back();
+        if (search.closed[cell])
+            continue;
+        search.closed[cell] = 1;
+        if (cell == to)
+            break;
+        forEachStep(cell, [&](int next) {
+            if (cells[next].region != region || search.closed[next])
+                return;
+            float cost = search.costs[cell] + stepCost(cells[cell], cells[next]);
+            if (cost >= search.costs[next])
+                return;
+            search.costs[next] = cost;
+            search.parents[next] = (uint16_t)cell;
+            open.push_back(std::make_pair(cost + glm::distance(position(next), target), next));
+            std::push_heap(open.begin(), open.end(), laterFirst<int>);
+        });
+    }
+    if (!search.closed[to])
+        return false;
+
+    size_t begin = out.size();
+    for (int cell = to; cell != from; cell = search.parents[cell])
+        out.push_back(worldBlock(cell));
+    std::reverse(out.begin() + begin, out.end());
+    return true;
+}
+
+// Add a portal, or keep the cheaper of it and the one between the same
+// regions already among links[begin..]
+static void addLink(std::vector<NavLink>& links, size_t begin, const NavLink& link)
+{
+    for (size_t i = begin; i < links.size(); i++) {
+        if (links[i].fromRegion == link.fromRegion && links[i].toRegion == link.toRegion && links[i].side == link.side) {
+            if (link.cost < links[i].cost)
+                links[i] = link;
+            return;
+        }
+    }
+    links.push_back(link);
+}
+
+template <typename Column>
+static NavLink makeLink(const Column& from, int fromCell, const Column& to, int toCell, int side)
+{
+    const NavCell& a = from.cells[fromCell];
+    const NavCell& b = to.cells[toCell];
+    NavLink link;
+    link.fromRegion = a.region;
+    link.toRegion = b.region;
+    link.fromCell = (uint16_t)fromCell;
+    link.toCell = (uint16_t)toCell;
+    link.side = side;
+    link.cost = glm::distance(from.position(from.centres[a.region]), from.position(fromCell)) + stepCost(a, b) +
+        glm::distance(to.position(toCell), to.position(to.centres[b.region]));
+    return link;
+}
+
+void NavigationGraph::build(Job& job)
+{
+    PROFILE_ZONE("Navigation column");
+
+    // What stops movement, [block column][y]
+    std::vector<uint8_t> solid((size_t)BLOCK_COLUMNS * COLUMN_HEIGHT);
+    std::vector<BlockId> flat(CHUNK_VOLUME);
+    for (int cy = 0; cy < WORLD_HEIGHT_CHUNKS; cy++) {
+        const PalettedBlocks& blocks = job.blocks[cy];
+        if (blocks.isUniform()) {
+            uint8_t value = blocksMovement(blocks.palette[0]) ? 1 : 0;
+            for (int c = 0; c < BLOCK_COLUMNS; c++)
+                memset(&solid[(size_t)c * COLUMN_HEIGHT + cy * CHUNK_SIZE], value, CHUNK_SIZE);
+            continue;
+        }
+        blocks.decode(flat.data());
+        for (int x = 0; x < CHUNK_SIZE; x++)
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                uint8_t* out = &solid[(size_t)(x * CHUNK_SIZE + z) * COLUMN_HEIGHT + cy * CHUNK_SIZE];
+                for (int y = 0; y < CHUNK_SIZE; y++)
+                    out[y] = blocksMovement(flat[chunkIndex(x, y, z)]) ? 1 : 0;
+            }
+    }
+
+    // Walkable cells, found from the top down counting the open blocks
+    // above each (the sky above the world is open)
+    std::unique_ptr<Column> column(new Column());
+    column->coord = job.column;
+    std::vector<NavCell>& cells = column->cells;
+    for (int c = 0; c < BLOCK_COLUMNS; c++) {
+        column->first[c] = (uint16_t)cells.size();
+        const uint8_t* blocks = &solid[(size_t)c * COLUMN_HEIGHT];
+        size_t begin = cells.size();
+        int open = 255;
+        for (int y = COLUMN_HEIGHT - 1; y >= 1; y--) {
+            open = blocks[y] ? 0 : std::min(open + 1, 255);
+            if (open >= 2 && blocks[y - 1] && cells.size() < NO_CELL)
+                cells.push_back(NavCell{ (int16_t)y, (uint8_t)c, (uint8_t)open, NO_CELL });
+        }
+        std::reverse(cells.begin() + begin, cells.end());
+    }
+    column->first[BLOCK_COLUMNS] = (uint16_t)cells.size();
+
+    // Regions: cells joined by steps of at most a block up or down
+    std::vector<int> stack;
+    std::vector<int> members;
+    for (int start = 0; start < (int)cells.size(); start++) {
+        if (cells[start].region != NO_CELL)
+            continue;
+        uint16_t region = (uint16_t)column->centres.size();
+        cells[start].region = region;
+        stack.push_back(start);
+        members.clear();
+        glm::vec3 sum(0.0f);
+        while (!stack.empty()) {
+            int cell = stack.back();
+            stack.pop_back();
+            members.push_back(cell);
+            sum += column->position(cell);
+            column->forEachStep(cell, [&](int next) {
+                if (cells[next].region == NO_CELL && std::abs(cells[next].y - cells[cell].y) <= 1) {
+                    cells[next].region = region;
+                    stack.push_back(next);
+                }
+            });
+        }
+        glm::vec3 middle = sum / (float)members.size();
+        int centre = members[0];
+        for (int member : members) {
+            if (glm::distance(column->position(member), middle) < glm::distance(column->position(centre), middle))
+                centre = member;
+        }
+        column->centres.push_back((uint16_t)centre);
+    }
+
+    // Drops from one region into another within the column
+    for (int cell = 0; cell < (int)cells.size(); cell++) {
+        column->forEachStep(cell, [&](int next) {
+            if (cells[next].region != cells[cell].region)
+                addLink(column->links, 0, makeLink(*column, cell, *column, next, SIDE_SAME));
+        });
+    }
+    job.result = std::move(column);
+}
+
+void NavigationGraph::link(Column& from, const Column* to, int side)
+{
+    from.links.erase(std::remove_if(from.links.begin(), from.links.end(),
+        [side](const NavLink& link) { return link.side == side; }), from.links.end());
+    if (!to)
+        return;
+
+    size_t begin = from.links.size();
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        // The block columns facing each other across the side
+        glm::ivec2 a = side < 2 ? glm::ivec2(side == 0 ? 0 : CHUNK_SIZE - 1, i) : glm::ivec2(i, side == 2 ? 0 : CHUNK_SIZE - 1);
+        glm::ivec2 b = (a + SIDE_OFFSETS[side]) & CHUNK_MASK;
+        int fromColumn = a.x * CHUNK_SIZE + a.y;
+        int toColumn = b.x * CHUNK_SIZE + b.y;
+        for (int c = from.first[fromColumn]; c < from.first[fromColumn + 1]; c++) {
+            for (int n = to->first[toColumn]; n < to->first[toColumn + 1]; n++) {
+                if (canStep(from.cells[c], to->cells[n]))
+                    addLink(from.links, begin, makeLink(from, c, *to, n, side));
+            }
+        }
+    }
+}
+
+NavigationGraph::NavigationGraph()
+{
+}
+
+NavigationGraph::~NavigationGraph()
+{
+    stop();
+}
+
+void NavigationGraph::start(JobSystem& jobs)
+{
+    jobSystem = &jobs;
+}
+
+void NavigationGraph::stop()
+{
+    if (jobSystem) {
+        jobSystem->wait(activeJobs);
+        jobSystem = nullptr;
+    }
+
+    results.drain(finished);
+    for (Job* job : finished)
+        delete job;
+    finished.clear();
+    running = 0;
+    columns.clear();
+    readyChunks.clear();
+    columnQueue.clear();
+    queuedColumns.clear();
+    buildingColumns.clear();
+}
+
+void NavigationGraph::chunkReady(const glm::ivec3& coord)
+{
+    glm::ivec2 column(coord.x, coord.z);
+    uint64_t key = columnKey(column);
+    if (++readyChunks[key] == WORLD_HEIGHT_CHUNKS && queuedColumns.insert(key, true))
+        columnQueue.push_back(column);
+}
+
+void NavigationGraph::chunkUnloaded(const glm::ivec3& coord)
+{
+    glm::ivec2 column(coord.x, coord.z);
+    uint64_t key = columnKey(column);
+    int* count = readyChunks.find(key);
+    if (count && --*count <= 0)
+        readyChunks.erase(key);
+    if (columns.contains(key))
+        remove(column);
+}
+
+void NavigationGraph::blockChanged(const glm::ivec3& block)
+{
+    // Columns not summarised yet are read after the edit anyway
+    glm::ivec2 column(floorDivChunk(block.x), floorDivChunk(block.z));
+    uint64_t key = columnKey(column);
+    if ((columns.contains(key) || buildingColumns.contains(key)) && queuedColumns.insert(key, true))
+        columnQueue.push_back(column);
+}
+
+const NavigationGraph::Column* NavigationGraph::columnAt(const glm::ivec2& column) const
+{
+    const std::unique_ptr<Column>* found = columns.find(columnKey(column));
+    return found ? found->get() : nullptr;
+}
+
+void NavigationGraph::remove(const glm::ivec2& column)
+{
+    columns.erase(columnKey(column));
+    for (int side = 0; side < 4; side++) {
+        std::unique_ptr<Column>* neighbour = columns.find(columnKey(column + SIDE_OFFSETS[side]));
+        if (neighbour)
+            link(**neighbour, nullptr, side ^ 1);
+    }
+}
+
+void NavigationGraph::apply(Job& job)
+{
+    uint64_t key = columnKey(job.column);
+    buildingColumns.erase(key);
+    // Dropped if a chunk left meanwhile; it is queued again once they are all back
+    const int* ready = readyChunks.find(key);
+    if (!ready || *ready < WORLD_HEIGHT_CHUNKS)
+        return;
+
+    Column& column = *job.result;
+    for (int side = 0; side < 4; side++) {
+        std::unique_ptr<Column>* neighbour = columns.find(columnKey(job.column + SIDE_OFFSETS[side]));
+        link(column, neighbour ? neighbour->get() : nullptr, side);
+        if (neighbour)
+            link(**neighbour, &column, side ^ 1);
+    }
+    columns[key] = std::move(job.result);
+}
+
+void NavigationGraph::update(World& world, const glm::ivec3& cameraChunk)
+{
+    world.flushBlockEvents();
+    if (!jobSystem)
+        return;
+    PROFILE_ZONE("Navigation");
+
+    results.drain(finished);
+    while (!finished.empty()) {
+        Job* job = finished.front();
+        finished.pop_front();
+        apply(*job);
+        running--;
+        delete job;
+    }
+
+    // Nearest columns first (taken from the back)
+    int limit = maxJobs > 0 ? maxJobs : std::max(1, jobSystem->workerCount() / 4);
+    if (running >= limit || columnQueue.empty())
+        return;
+    glm::ivec2 camera(cameraChunk.x, cameraChunk.z);
+    std::sort(columnQueue.begin(), columnQueue.end(), [&](const glm::ivec2& a, const glm::ivec2& b) {
+        glm::ivec2 da = a - camera;
+        glm::ivec2 db = b - camera;
+        return da.x * da.x + da.y * da.y > db.x * db.x + db.y * db.y;
+    });
+    for (size_t q = columnQueue.size(); q-- > 0 && running < limit; ) {
+        glm::ivec2 column = columnQueue[q];
+        uint64_t key = columnKey(column);
+        // One job per column at a time: an edit during it builds again after
+        if (buildingColumns.contains(key))
+            continue;
+        columnQueue.erase(columnQueue.begin() + q);
+        queuedColumns.erase(key);
+
+        Job* job = new Job();
+        job->column = column;
+        bool complete = true;
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS && complete; y++) {
+            const Chunk* chunk = world.getChunk(glm::ivec3(column.x, y, column.y));
+            complete = chunk && chunk->state != CHUNK_GENERATED && chunk->state != CHUNK_UNLOADING;
+            if (complete)
+                job->blocks[y] = chunk->blocks;
+        }
+        if (!complete) {
+            delete job;
+            continue;
+        }
+        buildingColumns[key] = true;
+        running++;
+        jobSystem->schedule([this, job] {
+            build(*job);
+            results.push(job);
+        }, &activeJobs);
+    }
+}
+
+const NavigationGraph::Column* NavigationGraph::locate(const glm::ivec3& feet, int& cell) const
+{
+    const Column* column = columnAt(glm::ivec2(floorDivChunk(feet.x), floorDivChunk(feet.z)));
+    if (!column)
+        return nullptr;
+    glm::ivec3 local = localBlockOf(feet);
+    int c = local.x * CHUNK_SIZE + local.z;
+    for (int i = column->first[c + 1]; i-- > column->first[c]; ) {
+        int y = column->cells[i].y;
+        if (y <= feet.y) {
+            cell = i;
+            return y >= feet.y - 2 ? column : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+bool NavigationGraph::findPath(const glm::ivec3& start, const glm::ivec3& goal, NavPath& path, Search& search) const
+{
+    path.found = false;
+    path.points.clear();
+    int startCell = 0;
+    int goalCell = 0;
+    const Column* startColumn = locate(start, startCell);
+    const Column* goalColumn = locate(goal, goalCell);
+    if (!startColumn || !goalColumn)
+        return false;
+
+    // Coarse: A* over regions and the portals between them. Positions are
+    // relative to the start column, so floats keep their precision.
+    auto centreOf = [&](const Column& column, int region) {
+        glm::ivec2 offset = (column.coord - startColumn->coord) * CHUNK_SIZE;
+        return column.position(column.centres[region]) + glm::vec3(offset.x, 0.0f, offset.y);
+    };
+    glm::ivec2 goalOffset = (goalColumn->coord - startColumn->coord) * CHUNK_SIZE;
+    glm::vec3 target = goalColumn->position(goalCell) + glm::vec3(goalOffset.x, 0.0f, goalOffset.y);
+    uint64_t startKey = regionKey(startColumn->coord, startColumn->cells[startCell].region);
+    uint64_t goalKey = regionKey(goalColumn->coord, goalColumn->cells[goalCell].region);
+
+    search.regions.clear();
+    search.regionOpen.clear();
+    Search::Region& first = search.regions[startKey];
+    first.column = startColumn;
+    first.region = startColumn->cells[startCell].region;
+    search.regionOpen.push_back(std::make_pair(glm::distance(centreOf(*startColumn, first.region), target), startKey));
+    bool reached = false;
+    for (int expanded = 0; !search.regionOpen.empty() && expanded < maxRegions; ) {
+        std::pop_heap(search.regionOpen.begin(), search.regionOpen.end(), laterFirst<uint64_t>);
+        uint64_t key = search.regionOpen.back().second;
+        search.regionOpen.pop_back();
+        // Copied out: reaching new regions may move the entries
+        Search::Region current = *search.regions.find(key);
+        if (current.closed)
+            continue;
+        search.regions.find(key)->closed = true;
+        if (key == goalKey) {
+            reached = true;
+            break;
+        }
+        expanded++;
+
+        for (const NavLink& link : current.column->links) {
+            if (link.fromRegion != current.region)
+                continue;
+            const Column* next = link.side == SIDE_SAME ? current.column : columnAt(current.column->coord + SIDE_OFFSETS[link.side]);
+            if (!next)
+                continue;
+            uint64_t nextKey = regionKey(next->coord, link.toRegion);
+            float cost = current.cost + link.cost;
+            Search::Region& reachedRegion = search.regions[nextKey];
+            if (reachedRegion.column && (reachedRegion.closed || reachedRegion.cost <= cost))
+                continue;
+            reachedRegion.column = next;
+            reachedRegion.region = link.toRegion;
+            reachedRegion.cost = cost;
+            reachedRegion.parent = key;
+            reachedRegion.via = &link;
+            search.regionOpen.push_back(std::make_pair(cost + glm::distance(centreOf(*next, link.toRegion), target), nextKey));
+            std::push_heap(search.regionOpen.begin(), search.regionOpen.end(), laterFirst<uint64_t>);
+        }
+    }
+    if (!reached)
+        return false;
+
+    // The portals taken, each with the column it leaves
+    search.legs.clear();
+    for (uint64_t key = goalKey; key != startKey; ) {
+        const Search::Region& region = *search.regions.find(key);
+        const Search::Region& parent = *search.regions.find(region.parent);
+        search.legs.push_back(std::make_pair(parent.column, region.via));
+        key = region.parent;
+    }
+    std::reverse(search.legs.begin(), search.legs.end());
+
+    // Fine: A* within each region from portal to portal
+    path.points.push_back(startColumn->worldBlock(startCell));
+    const Column* column = startColumn;
+    int cell = startCell;
+    for (const auto& leg : search.legs) {
+        const NavLink& link = *leg.second;
+        if (!column->walk(cell, link.fromCell, search, path.points))
+            return false;
+        column = link.side == SIDE_SAME ? column : columnAt(column->coord + SIDE_OFFSETS[link.side]);
+        cell = link.toCell;
+        path.points.push_back(column->worldBlock(cell));
+    }
+    if (!column->walk(cell, goalCell, search, path.points))
+        return false;
+    path.found = true;
+    return true;
+}
+
+bool NavigationGraph::findPath(const glm::ivec3& start, const glm::ivec3& goal, NavPath& path) const
+{
+    Search search;
+    return findPath(start, goal, path, search);
+}
+
+void NavigationGraph::findPaths(const PathQuery* queries, int count, NavPath* paths, JobSystem* jobs) const
+{
+    PROFILE_ZONE("Find paths");
+    auto findRange = [&](int begin, int end) {
+        Search search;
+        for (int i = begin; i < end; i++)
+            findPath(queries[i].start, queries[i].goal, paths[i], search);
+    };
+    if (jobs)
+        jobs->parallelFor(count, 16, findRange);
+    else
+        findRange(0, count);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_hash_map.h"
+#include "job_system.h"
+#include "mpsc_queue.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+struct World;
+
+// Deepest drop a path steps down (climbs are one block)
+const int NAV_MAX_DROP = 3;
+
+// A path wanted from one walkable block to another: the blocks the feet
+// are in, standing on solid ground
+struct PathQuery {
+    glm::ivec3 start;
+    glm::ivec3 goal;
+};
+
+struct NavPath {
+    bool found = false;
+    std::vector<glm::ivec3> points;     // Feet blocks from start to goal, one step apart
+};
+
+// Where walkers can go over the loaded terrain, for mobs to find paths
+// through hundreds at a time.
+//
+// Each complete chunk column is summarised on job system workers: its
+// walkable blocks (air with air above and a solid block below), with the
+// open blocks above each, split into regions a walker can cross freely
+// (steps of one block up or down). Regions are linked where one can be
+// left for another: by a drop of up to NAV_MAX_DROP within the column and
+// across each side into the neighbour column, a portal per pair of regions
+// at the crossing that costs least from one region's centre to the other's.
+// An edit that changes what blocks movement re-summarises its column (and
+// relinks its neighbours) in the background; queries use the previous
+// summary meanwhile.
+//
+// A query is hierarchical: A* over regions and portals finds the columns
+// and crossings to take, then A* within each region walks from crossing to
+// crossing, so the fine search never leaves a column and the cost of a
+// long path grows with the columns it crosses, not the blocks.
+struct NavigationGraph {
+    // Summarise columns on 'jobs'
+    void start(JobSystem& jobs);
+    // Wait for running jobs and drop every summary
+    void stop();
+
+    // World hooks (main thread): a chunk became CHUNK_READY, a ready or lit
+    // chunk was unloaded, whether a block stops movement changed
+    // (World::flushBlockEvents())
+    void chunkReady(const glm::ivec3& coord);
+    void chunkUnloaded(const glm::ivec3& coord);
+    void blockChanged(const glm::ivec3& block);
+
+    // Take in finished summaries and start new ones, columns nearest
+    // 'cameraChunk' first. Main thread, while it may change the world.
+    void update(World& world, const glm::ivec3& cameraChunk);
+
+    // Answer 'count' queries into 'paths', spread over 'jobs' if given.
+    // Main thread, between update() calls: the graph must not change
+    // meanwhile.
+    void findPaths(const PathQuery* queries, int count, NavPath* paths, JobSystem* jobs) const;
+    bool findPath(const glm::ivec3& start, const glm::ivec3& goal, NavPath& path) const;
+
+    // Columns waiting for a summary, plus running jobs
+    int pendingCount() const { return (int)columnQueue.size() + running; }
+    // Columns with a summary
+    int columnCount() const { return (int)columns.size(); }
+
+    // Most jobs running at once; 0 = a quarter of the workers (at least one)
+    int maxJobs = 0;
+    // Regions a query looks at before it gives up
+    int maxRegions = 4096;
+
+    // Out of line, where Column is complete
+    NavigationGraph();
+    ~NavigationGraph();
+
+private:
+    struct Column;
+    struct Job;
+    struct Search;
+
+    // Summarise a job's column (worker)
+    static void build(Job& job);
+    // Replace the portals of 'from' on 'side' with those into 'to' (nullptr: none)
+    static void link(Column& from, const Column* to, int side);
+    // Install a finished summary and link it with its neighbours
+    void apply(Job& job);
+    void remove(const glm::ivec2& column);
+    const Column* columnAt(const glm::ivec2& column) const;
+    // Summarised column and walkable cell of a feet block, the highest up
+    // to two blocks below it (nullptr if there is none)
+    const Column* locate(const glm::ivec3& feet, int& cell) const;
+    bool findPath(const glm::ivec3& start, const glm::ivec3& goal, NavPath& path, Search& search) const;
+
+    JobSystem* jobSystem = nullptr;
+    JobCounter activeJobs;
+    int running = 0;
+
+    ChunkHashMap<std::unique_ptr<Column>> columns;
+    ChunkHashMap<int> readyChunks;          // Per column (y = 0): chunks ready or lit
+    std::vector<glm::ivec2> columnQueue;    // Complete or edited columns to summarise
+    ChunkHashMap<bool> queuedColumns;       // Members of columnQueue
+    ChunkHashMap<bool> buildingColumns;     // Columns of running jobs
+
+    MPSCQueue<Job*> results;                // Pushed by workers, drained by update()
+    std::deque<Job*> finished;
+};
@@ -0,0 +1,326 @@
+#include "net_connection.h"
+
+#include <chrono>
+#include <string>
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int SocketLength;
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SOCKET;
+typedef socklen_t SocketLength;
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // Windows has no SIGPIPE to suppress
+#endif
+
+// Largest read per recv() call
+const size_t RECEIVE_CHUNK_BYTES = 64 * 1024;
+// Sent bytes are dropped from the front of the queue once this many pile up
+const size_t COMPACT_BYTES = 64 * 1024;
+
+static bool wouldBlock()
+{
+#ifdef _MSC_VER
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+}
+
+static void closeSocket(uintptr_t socket)
+{
+#ifdef _MSC_VER
+    closesocket((SOCKET)socket);
+#else
+    ::close((SOCKET)socket);
+#endif
+}
+
+static bool setNonBlocking(uintptr_t socket)
+{
+#ifdef _MSC_VER
+    u_long mode = 1;
+    return ioctlsocket((SOCKET)socket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl((SOCKET)socket, F_GETFL, 0);
+    return flags >= 0 && fcntl((SOCKET)socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// Small messages (block deltas) go out at once instead of waiting to be coalesced
+static void setNoDelay(uintptr_t socket)
+{
+    int enabled = 1;
+    setsockopt((SOCKET)socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&enabled, sizeof(enabled));
+}
+
+bool netStartup()
+{
+#ifdef _MSC_VER
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    return true;
+#endif
+}
+
+void netShutdown()
+{
+#ifdef _MSC_VER
+    WSACleanup();
+#endif
+}
+
+double netClockSeconds()
+{
+    typedef std::chrono::steady_clock Clock;
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+bool NetConnection::connect(const char* host, int port)
+{
+    close();
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addresses) != 0)
+        return false;
+
+    for (addrinfo* a = addresses; a && !isOpen(); a = a->ai_next) {
+        SOCKET s = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if ((uintptr_t)s == NO_SOCKET)
+            continue;
+        if (::connect(s, a->ai_addr, (SocketLength)a->ai_addrlen) != 0 || !setNonBlocking((uintptr_t)s)) {
+            closeSocket((uintptr_t)s);
+            continue;
+        }
+        socket = (uintptr_t)s;
+    }
+    freeaddrinfo(addresses);
+    if (isOpen())
+        setNoDelay(socket);
+    return isOpen();
+}
+
+void NetConnection::close()
+{
+    if (!isOpen())
+        return;
+    closeSocket(socket);
+    socket = NO_SOCKET;
+    outgoing.clear();
+    sent = 0;
+}
+
+void NetConnection::send(uint8_t type, const std::vector<uint8_t>& body)
+{
+    std::vector<uint8_t>& out = beginMessage(type, body.size());
+    out.insert(out.end(), body.begin(), body.end());
+    endMessage();
+}
+
+std::vector<uint8_t>& NetConnection::beginMessage(uint8_t type, size_t sizeHint)
+{
+    // Sent bytes go first if that leaves room for the message, rather than
+    // growing the queue past them
+    if (sent > 0 && outgoing.capacity() - outgoing.size() < 5 + sizeHint) {
+        outgoing.erase(outgoing.begin(), outgoing.begin() + sent);
+        sent = 0;
+    }
+    messageStart = outgoing.size();
+    outgoing.reserve(messageStart + 5 + sizeHint);
+    uint8_t header[5] = { 0, 0, 0, 0, type };
+    outgoing.insert(outgoing.end(), header, header + sizeof(header));
+    return outgoing;
+}
+
+void NetConnection::endMessage()
+{
+    if (!isOpen()) {
+        outgoing.clear();
+        return;
+    }
+    uint32_t length = (uint32_t)(outgoing.size() - messageStart - 4);
+    uint8_t* frame = outgoing.data() + messageStart;
+    for (int i = 0; i < 4; i++)
+        frame[i] = (uint8_t)(length >> (i * 8));
+}
+
+bool NetConnection::update()
+{
+    if (!isOpen())
+        return false;
+
+    while (sent < outgoing.size()) {
+        int count = ::send((SOCKET)socket, (const char*)outgoing.data() + sent, (int)(outgoing.size() - sent), MSG_NOSIGNAL);
+        if (count > 0) {
+            sent += count;
+            bytesSent += count;
+            continue;
+        }
+        if (count < 0 && wouldBlock())
+            break; // The socket's buffer is full; the rest goes next update
+        close();
+        return false;
+    }
+    if (sent == outgoing.size()) {
+        outgoing.clear();
+        sent = 0;
+    }
+    else if (sent >= COMPACT_BYTES) {
+        outgoing.erase(outgoing.begin(), outgoing.begin() + sent);
+        sent = 0;
+    }
+
+    // Bodies received since the last update are done with now
+    if (consumed == incoming.size()) {
+        incoming.clear();
+        consumed = 0;
+    }
+    else if (consumed >= COMPACT_BYTES) {
+        incoming.erase(incoming.begin(), incoming.begin() + consumed);
+        consumed = 0;
+    }
+
+    for (;;) {
+        size_t size = incoming.size();
+        incoming.resize(size + RECEIVE_CHUNK_BYTES);
+        int count = recv((SOCKET)socket, (char*)incoming.data() + size, (int)RECEIVE_CHUNK_BYTES, 0);
+        incoming.resize(size + (count > 0 ? count : 0));
+        if (count > 0) {
+            bytesReceived += count;
+            continue;
+        }
+        if (count < 0 && wouldBlock())
+            return true;
+        close(); // Closed by the peer (0) or failed
+        return false;
+    }
+}
+
+bool NetConnection::receive(uint8_t& type, const uint8_t*& body, size_t& size)
+{
+    size_t available = incoming.size() - consumed;
+    if (available < 4)
+        return false;
+    const uint8_t* frame = incoming.data() + consumed;
+    uint32_t length = frame[0] | (frame[1] << 8) | (frame[2] << 16) | ((uint32_t)frame[3] << 24);
+    if (length == 0 || length > NET_MAX_MESSAGE_BYTES) {
+        close();
+        incoming.clear();
+        consumed = 0;
+        return false;
+    }
+    if (available < 4 + (size_t)length)
+        return false;
+
+    type = frame[4];
+    body = frame + 5;
+    size = length - 1;
+    consumed += 4 + length;
+    return true;
+}
+
+bool NetListener::listen(int port)
+{
+    close();
+    SOCKET s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if ((uintptr_t)s == NO_SOCKET)
+        return false;
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short)port);
+    if (bind(s, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(s, SOMAXCONN) != 0 ||
+        !setNonBlocking((uintptr_t)s)) {
+        closeSocket((uintptr_t)s);
+        return false;
+    }
+    socket = (uintptr_t)s;
+    return true;
+}
+
+void NetListener::close()
+{
+    if (socket == NO_SOCKET)
+        return;
+    closeSocket(socket);
+    socket = NO_SOCKET;
+}
+
+bool NetListener::accept(NetConnection& out)
+{
+    if (socket == NO_SOCKET)
+        return false;
+    SOCKET s = ::accept((SOCKET)socket, nullptr, nullptr);
+    if ((uintptr_t)s == NO_SOCKET)
+        return false;
+    if (!setNonBlocking((uintptr_t)s)) {
+        closeSocket((uintptr_t)s);
+        return false;
+    }
+    setNoDelay((uintptr_t)s);
+    out.close();
+    out.socket = (uintptr_t)s;
+    out.incoming.clear();
+    out.consumed = 0;
+    return true;
+}
+
+bool NetDatagramSocket::connect(const char* host, int port)
+{
+    close();
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addresses) != 0)
+        return false;
+
+    // Connecting a UDP socket only fixes its destination
+    for (addrinfo* a = addresses; a && !isOpen(); a = a->ai_next) {
+        SOCKET s = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if ((uintptr_t)s == NO_SOCKET)
+            continue;
+        if (::connect(s, a->ai_addr, (SocketLength)a->ai_addrlen) != 0) {
+            closeSocket((uintptr_t)s);
+            continue;
+        }
+        socket = (uintptr_t)s;
+    }
+    freeaddrinfo(addresses);
+    return isOpen();
+}
+
+void NetDatagramSocket::close()
+{
+    if (!isOpen())
+        return;
+    closeSocket(socket);
+    socket = NO_SOCKET;
+}
+
+bool NetDatagramSocket::send(const void* data, size_t bytes)
+{
+    if (!isOpen())
+        return false;
+    return ::send((SOCKET)socket, (const char*)data, (int)bytes, MSG_NOSIGNAL) == (int)bytes;
+}
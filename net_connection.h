@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Socket library setup, once per process before any connection (WSAStartup
+// on Windows, nothing elsewhere)
+bool netStartup();
+void netShutdown();
+
+// Seconds on a steady clock, for timing network traffic on both ends
+double netClockSeconds();
+
+// Messages are framed as a little-endian u32 length of what follows, a u8
+// type and the body. Longer frames are a protocol error.
+const size_t NET_MAX_MESSAGE_BYTES = 1 << 20;
+
+// Socket handle of a closed connection (INVALID_SOCKET, or -1 on POSIX)
+const uintptr_t NO_SOCKET = ~(uintptr_t)0;
+
+// One non-blocking TCP connection carrying framed messages. send() only
+// queues; update() writes as much as the socket takes and reads whatever
+// has arrived, so neither side ever waits on the network in a tick.
+//
+// Neither direction copies a message body: one is encoded straight into
+// the send queue between beginMessage() and endMessage(), and receive()
+// hands out the body where it lies in the receive buffer. Both buffers
+// keep their memory from message to message, so a connection in steady
+// traffic allocates nothing.
+struct NetConnection {
+    // Blocking connect to 'host' (name or address) on 'port'; the socket is
+    // non-blocking from then on
+    bool connect(const char* host, int port);
+    void close();
+    bool isOpen() const { return socket != NO_SOCKET; }
+
+    // Queue a message
+    void send(uint8_t type, const std::vector<uint8_t>& body);
+    // Start a message in place: append its body to the returned send queue
+    // (with room reserved for 'sizeHint' bytes of it), then endMessage().
+    // Nothing else may be queued meanwhile.
+    std::vector<uint8_t>& beginMessage(uint8_t type, size_t sizeHint = 0);
+    // Frame what was appended since beginMessage(); dropped on a closed
+    // connection
+    void endMessage();
+    // Flush queued messages and read arrived ones. False once the peer
+    // closed the connection or it failed (it is then closed; messages
+    // already read can still be received).
+    bool update();
+    // Next complete message read, false if none: 'size' bytes of body at
+    // 'body', inside the receive buffer and valid until the next update().
+    // A malformed frame closes the connection.
+    bool receive(uint8_t& type, const uint8_t*& body, size_t& size);
+
+    // Queued bytes the socket hasn't taken yet
+    size_t unsentBytes() const { return outgoing.size() - sent; }
+
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+
+    NetConnection() = default;
+    NetConnection(const NetConnection&) = delete;
+    NetConnection& operator=(const NetConnection&) = delete;
+    ~NetConnection() { close(); }
+
+private:
+    friend struct NetListener;
+
+    uintptr_t socket = NO_SOCKET;
+    std::vector<uint8_t> outgoing;
+    size_t sent = 0;        // Bytes of 'outgoing' the socket took
+    size_t messageStart = 0;    // Frame begun by beginMessage()
+    std::vector<uint8_t> incoming;
+    size_t consumed = 0;    // Bytes of 'incoming' already received as messages
+};
+
+// Listening TCP socket, non-blocking
+struct NetListener {
+    // Listen on 'port' on every interface
+    bool listen(int port);
+    void close();
+    // Take one pending connection into 'out', false if none is waiting
+    bool accept(NetConnection& out);
+
+    ~NetListener() { close(); }
+
+private:
+    uintptr_t socket = NO_SOCKET;
+};
+
+// Connected UDP socket for fire-and-forget datagrams (metrics to a StatsD
+// agent). Nothing is acknowledged; a datagram the network drops is lost.
+struct NetDatagramSocket {
+    // Resolve 'host' and address datagrams to it on 'port'
+    bool connect(const char* host, int port);
+    void close();
+    bool isOpen() const { return socket != NO_SOCKET; }
+
+    // False if the datagram couldn't be handed to the network stack
+    bool send(const void* data, size_t bytes);
+
+    NetDatagramSocket() = default;
+    NetDatagramSocket(const NetDatagramSocket&) = delete;
+    NetDatagramSocket& operator=(const NetDatagramSocket&) = delete;
+    ~NetDatagramSocket() { close(); }
+
+private:
+    uintptr_t socket = NO_SOCKET;
+};
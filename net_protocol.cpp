@@ -0,0 +1,324 @@
+#include "net_protocol.h"
+#include "lz4.h"
+#include "region_file.h"
+
+#include <algorithm>
+#include <cmath>
+
+void encodeHello(uint32_t seed, std::vector<uint8_t>& out)
+{
+    NetWriter w(out);
+    w.u32(NET_PROTOCOL_VERSION);
+    w.u32(seed);
+}
+
+bool decodeHello(const uint8_t* body, size_t size, uint32_t& version, uint32_t& seed)
+{
+    NetReader r(body, size);
+    version = r.u32();
+    seed = r.u32();
+    return r.done();
+}
+
+void encodeChunkCoords(const std::vector<glm::ivec3>& coords, std::vector<uint8_t>& out)
+{
+    NetWriter w(out);
+    w.varint((uint32_t)coords.size());
+    for (const glm::ivec3& coord : coords)
+        w.coord(coord);
+}
+
+bool decodeChunkCoords(const uint8_t* body, size_t size, std::vector<glm::ivec3>& out)
+{
+    NetReader r(body, size);
+    uint32_t count = r.varint();
+    // Each coordinate takes 3 bytes at least
+    if (count > size / 3)
+        return false;
+    for (uint32_t i = 0; i < count; i++)
+        out.push_back(r.coord());
+    return r.done();
+}
+
+void encodeChunkData(const Chunk& chunk, uint32_t sequence, std::vector<uint8_t>& scratch, std::vector<uint8_t>& out)
+{
+    encodeChunkPayload(chunk.blocks, scratch);
+    NetWriter w(out);
+    w.coord(chunk.coord);
+    w.varint(sequence);
+    w.varint((uint32_t)scratch.size());
+    size_t start = out.size();
+    out.resize(start + lz4CompressBound(scratch.size()));
+    size_t compressed = lz4Compress(scratch.data(), scratch.size(), out.data() + start);
+    out.resize(start + compressed);
+}
+
+bool decodeChunkData(const uint8_t* body, size_t size, Chunk& chunk, uint32_t& sequence, std::vector<uint8_t>& scratch)
+{
+    NetReader r(body, size);
+    glm::ivec3 coord = r.coord();
+    sequence = r.varint();
+    uint32_t rawSize = r.varint();
+    // The largest payload: 8 bits per index and a full palette
+    if (!r.ok || rawSize > CHUNK_VOLUME + 2 + 256)
+        return false;
+    size_t compressedSize = r.size - r.pos;
+    const uint8_t* compressed = r.bytes(compressedSize);
+    scratch.resize(rawSize);
+    if (!compressed || !lz4Decompress(compressed, compressedSize, scratch.data(), rawSize))
+        return false;
+    if (!decodeChunkPayload(scratch.data(), rawSize, chunk.blocks))
+        return false;
+    chunk.coord = coord;
+    chunk.dirty = true;
+    return true;
+}
+
+void encodeBlockChanges(const std::vector<BlockChange>& changes, std::vector<uint8_t>& out)
+{
+    // Sort by chunk, then block index; stable, so the last change of a
+    // block ends its run
+    struct Keyed {
+        glm::ivec3 chunk;
+        int index;
+        BlockId id;
+    };
+    std::vector<Keyed> keyed;
+    keyed.reserve(changes.size());
+    for (const BlockChange& change : changes) {
+        glm::ivec3 local = localBlockOf(change.block);
+        keyed.push_back({ chunkCoordOf(change.block), chunkIndex(local.x, local.y, local.z), change.id });
+    }
+    std::stable_sort(keyed.begin(), keyed.end(), [](const Keyed& a, const Keyed& b) {
+        if (a.chunk.x != b.chunk.x)
+            return a.chunk.x < b.chunk.x;
+        if (a.chunk.y != b.chunk.y)
+            return a.chunk.y < b.chunk.y;
+        if (a.chunk.z != b.chunk.z)
+            return a.chunk.z < b.chunk.z;
+        return a.index < b.index;
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < keyed.size(); i++) {
+        bool last = i + 1 == keyed.size() || keyed[i + 1].chunk != keyed[i].chunk || keyed[i + 1].index != keyed[i].index;
+        if (last)
+            keyed[kept++] = keyed[i];
+    }
+    keyed.resize(kept);
+
+    NetWriter w(out);
+    uint32_t groups = 0;
+    for (size_t i = 0; i < keyed.size(); i++)
+        groups += i == 0 || keyed[i].chunk != keyed[i - 1].chunk;
+    w.varint(groups);
+    glm::ivec3 previousChunk(0);
+    for (size_t begin = 0; begin < keyed.size(); ) {
+        size_t end = begin + 1;
+        while (end < keyed.size() && keyed[end].chunk == keyed[begin].chunk)
+            end++;
+        w.coord(keyed[begin].chunk - previousChunk);
+        previousChunk = keyed[begin].chunk;
+        w.varint((uint32_t)(end - begin));
+        int previousIndex = 0;
+        for (size_t i = begin; i < end; i++) {
+            w.varint((uint32_t)(keyed[i].index - previousIndex));
+            w.u8(keyed[i].id);
+            previousIndex = keyed[i].index;
+        }
+        begin = end;
+    }
+}
+
+bool decodeBlockChanges(const uint8_t* body, size_t size, std::vector<BlockChange>& out)
+{
+    NetReader r(body, size);
+    uint32_t groups = r.varint();
+    glm::ivec3 chunk(0);
+    for (uint32_t g = 0; g < groups && r.ok; g++) {
+        chunk += r.coord();
+        uint32_t count = r.varint();
+        if (count > CHUNK_VOLUME)
+            return false;
+        int index = 0;
+        for (uint32_t i = 0; i < count && r.ok; i++) {
+            index += (int)r.varint();
+            BlockId id = r.u8();
+            if (index >= CHUNK_VOLUME || id >= BLOCK_TYPE_COUNT)
+                return false;
+            out.push_back({ chunk * CHUNK_SIZE + chunkIndexPosition(index), id });
+        }
+    }
+    return r.done();
+}
+
+void encodePlayerSpawn(const glm::dvec3& position, std::vector<uint8_t>& out)
+{
+    NetWriter w(out);
+    w.f64(position.x);
+    w.f64(position.y);
+    w.f64(position.z);
+}
+
+bool decodePlayerSpawn(const uint8_t* body, size_t size, glm::dvec3& position)
+{
+    NetReader r(body, size);
+    position.x = r.f64();
+    position.y = r.f64();
+    position.z = r.f64();
+    return r.done() && glm::all(glm::lessThan(glm::abs(position), glm::dvec3(1e9)));
+}
+
+static int8_t quantizeAxis(float v)
+{
+    return (int8_t)std::lround(glm::clamp(v, -1.0f, 1.0f) * 127.0f);
+}
+
+PlayerInput quantizePlayerInput(const PlayerInput& input)
+{
+    PlayerInput q = input;
+    q.forward = quantizeAxis(input.forward) / 127.0f;
+    q.strafe = quantizeAxis(input.strafe) / 127.0f;
+    q.vertical = quantizeAxis(input.vertical) / 127.0f;
+    return q;
+}
+
+void encodePlayerInputs(const std::vector<NetPlayerInput>& inputs, std::vector<uint8_t>& out)
+{
+    NetWriter w(out);
+    w.varint((uint32_t)inputs.size());
+    w.varint(inputs.empty() ? 0 : inputs[0].sequence);
+    for (const NetPlayerInput& input : inputs) {
+        w.f32(input.input.look.x);
+        w.f32(input.input.look.y);
+        w.f32(input.input.look.z);
+        w.u8((uint8_t)quantizeAxis(input.input.forward));
+        w.u8((uint8_t)quantizeAxis(input.input.strafe));
+        w.u8((uint8_t)quantizeAxis(input.input.vertical));
+        w.u8((uint8_t)((input.input.sprint ? 1 : 0) | (input.mode << 1)));
+        w.f32(input.dt);
+    }
+}
+
+bool decodePlayerInputs(const uint8_t* body, size_t size, std::vector<NetPlayerInput>& out)
+{
+    NetReader r(body, size);
+    uint32_t count = r.varint();
+    uint32_t sequence = r.varint();
+    // Each input takes 20 bytes
+    if (count > size / 20)
+        return false;
+    for (uint32_t i = 0; i < count && r.ok; i++) {
+        NetPlayerInput input;
+        input.sequence = sequence + i;
+        input.input.look.x = r.f32();
+        input.input.look.y = r.f32();
+        input.input.look.z = r.f32();
+        input.input.forward = (int8_t)r.u8() / 127.0f;
+        input.input.strafe = (int8_t)r.u8() / 127.0f;
+        input.input.vertical = (int8_t)r.u8() / 127.0f;
+        uint8_t flags = r.u8();
+        input.input.sprint = (flags & 1) != 0;
+        input.dt = r.f32();
+        if ((flags >> 1) >= PLAYER_MODE_COUNT || !(input.dt >= 0.0f && input.dt <= 1.0f) ||
+            !glm::all(glm::lessThanEqual(glm::abs(input.input.look), glm::vec3(2.0f))))
+            return false;
+        input.mode = (PlayerMode)(flags >> 1);
+        out.push_back(input);
+    }
+    return r.done();
+}
+
+void encodeSnapshot(const NetSnapshot& snapshot, std::vector<uint8_t>& out)
+{
+    size_t start = out.size();
+    out.resize(start + NET_SNAPSHOT_HEADER_BYTES + snapshot.entities.size() * NET_SNAPSHOT_ENTITY_BYTES);
+    uint8_t* p = out.data() + start;
+    const NetPlayerState& player = snapshot.player;
+    bool hasPlayer = snapshot.hasPlayer;
+    netStore64(p, snapshot.serverTime);
+    netStore32(p + 8, snapshot.inputAck);
+    p[12] = hasPlayer ? (uint8_t)(1 | (player.onGround ? 2 : 0) | (player.mode << 2)) : 0;
+    for (int i = 0; i < 3; i++) {
+        netStore64(p + 13 + i * 8, hasPlayer ? player.position[i] : 0.0);
+        uint32_t bits;
+        float velocity = hasPlayer ? player.velocity[i] : 0.0f;
+        memcpy(&bits, &velocity, 4);
+        netStore32(p + 37 + i * 4, bits);
+    }
+    netStore32(p + 49, (uint32_t)snapshot.entities.size());
+
+    glm::ivec3 origin = hasPlayer ? glm::ivec3(glm::floor(player.position)) : glm::ivec3(0);
+    p += NET_SNAPSHOT_HEADER_BYTES;
+    for (const NetEntity& entity : snapshot.entities) {
+        netStore32(p, entity.id);
+        glm::dvec3 offset = glm::round((entity.position - glm::dvec3(origin)) * 256.0);
+        glm::vec3 half = glm::round(glm::clamp(entity.halfExtents * 256.0f, 0.0f, 65535.0f));
+        for (int i = 0; i < 3; i++) {
+            netStore32(p + 4 + i * 4, (uint32_t)(int32_t)offset[i]);
+            p[16 + i * 2] = (uint8_t)half[i];
+            p[17 + i * 2] = (uint8_t)((uint32_t)half[i] >> 8);
+        }
+        netStore32(p + 22, entity.color);
+        p += NET_SNAPSHOT_ENTITY_BYTES;
+    }
+}
+
+bool NetSnapshotView::open(const uint8_t* body, size_t size)
+{
+    data = nullptr;
+    if (size < NET_SNAPSHOT_HEADER_BYTES)
+        return false;
+    count = netLoad32(body + 49);
+    if (count > (size - NET_SNAPSHOT_HEADER_BYTES) / NET_SNAPSHOT_ENTITY_BYTES ||
+        size != NET_SNAPSHOT_HEADER_BYTES + count * NET_SNAPSHOT_ENTITY_BYTES)
+        return false;
+    data = body;
+    NetPlayerState state = player();
+    if ((data[12] >> 2) >= PLAYER_MODE_COUNT || !glm::all(glm::lessThan(glm::abs(state.position), glm::dvec3(1e9)))) {
+        data = nullptr;
+        return false;
+    }
+    origin = hasPlayer() ? glm::ivec3(glm::floor(state.position)) : glm::ivec3(0);
+    return true;
+}
+
+NetPlayerState NetSnapshotView::player() const
+{
+    NetPlayerState state;
+    for (int i = 0; i < 3; i++) {
+        state.position[i] = netLoad64(data + 13 + i * 8);
+        uint32_t bits = netLoad32(data + 37 + i * 4);
+        memcpy(&state.velocity[i], &bits, 4);
+    }
+    state.onGround = (data[12] & 2) != 0;
+    state.mode = (PlayerMode)(data[12] >> 2);
+    return state;
+}
+
+NetEntity NetSnapshotView::entity(uint32_t i) const
+{
+    const uint8_t* p = data + NET_SNAPSHOT_HEADER_BYTES + i * NET_SNAPSHOT_ENTITY_BYTES;
+    NetEntity entity;
+    entity.id = netLoad32(p);
+    for (int a = 0; a < 3; a++) {
+        entity.position[a] = origin[a] + (int32_t)netLoad32(p + 4 + a * 4) / 256.0;
+        entity.halfExtents[a] = (p[16 + a * 2] | (p[17 + a * 2] << 8)) / 256.0f;
+    }
+    entity.color = netLoad32(p + 22);
+    return entity;
+}
+
+bool decodeSnapshot(const uint8_t* body, size_t size, NetSnapshot& out)
+{
+    NetSnapshotView view;
+    if (!view.open(body, size))
+        return false;
+    out.serverTime = view.serverTime();
+    out.inputAck = view.inputAck();
+    out.hasPlayer = view.hasPlayer();
+    out.player = view.player();
+    out.entities.resize(view.entityCount());
+    for (uint32_t i = 0; i < view.entityCount(); i++)
+        out.entities[i] = view.entity(i);
+    return true;
+}
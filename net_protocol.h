@@ -0,0 +1,284 @@
+#pragma once
+
+#include "chunk.h"
+#include "player_controller.h"
+#include "world.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Chunk streaming between a server that owns the world and its clients,
+// over NetConnection frames, and snapshots of the players and entities
+const uint32_t NET_PROTOCOL_VERSION = 3;
+const int NET_DEFAULT_PORT = 25600;
+
+enum NetMessageType : uint8_t {
+    NET_HELLO = 1,          // Server, first: protocol version, terrain seed
+    NET_CHUNK_REQUEST,      // Client: chunk coordinates, most wanted first
+    NET_CHUNK_RELEASE,      // Client: chunks it no longer wants or holds
+    NET_CHUNK_DATA,         // Server: one requested chunk, palette-encoded and LZ4-compressed
+    NET_BLOCK_DELTAS,       // Server: changes to chunks the client holds since the last batch
+    NET_BLOCK_EDITS,        // Client: the player's edits, for the server to apply
+    NET_PLAYER_SPAWN,       // Client, once: where its player starts
+    NET_PLAYER_INPUT,       // Client: the inputs of its ticks since the last batch
+    NET_SNAPSHOT,           // Server, every tick: the client's player and the entities near it
+};
+
+// One client simulation tick of the player, as sent: stepped the same way
+// on both sides (stepNetPlayer()), so the server agrees with the
+// client's prediction unless the world differs
+struct NetPlayerInput {
+    uint32_t sequence = 0;  // Counts the client's ticks from 0
+    PlayerInput input;
+    PlayerMode mode = PLAYER_NOCLIP;
+    float dt = 0.0f;        // Seconds
+};
+
+// The server's player after the inputs it applied
+struct NetPlayerState {
+    glm::dvec3 position = glm::dvec3(0.0);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    bool onGround = false;
+    PlayerMode mode = PLAYER_NOCLIP;
+};
+
+// An entity box as the server last saw it
+struct NetEntity {
+    uint32_t id;            // Stable while the entity lives
+    glm::dvec3 position;    // Centre, world space
+    glm::vec3 halfExtents;
+    uint32_t color;         // RGBA8
+};
+
+struct NetSnapshot {
+    double serverTime = 0.0;    // Seconds on the server's clock when taken
+    uint32_t inputAck = 0;      // Inputs of the client applied so far
+    bool hasPlayer = false;     // Not before the client's spawn arrived
+    NetPlayerState player;
+    std::vector<NetEntity> entities;    // By ascending id
+};
+
+// Appends little-endian fields and varints to a message body
+struct NetWriter {
+    std::vector<uint8_t>& out;
+
+    explicit NetWriter(std::vector<uint8_t>& body) : out(body) {}
+    void u8(uint8_t v) { out.push_back(v); }
+    void u32(uint32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+            out.push_back((uint8_t)(v >> (i * 8)));
+    }
+    // 7 bits per byte, high bit set on all but the last
+    void varint(uint32_t v)
+    {
+        while (v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+    // Signed, small magnitudes in few bytes
+    void zigzag(int32_t v) { varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31)); }
+    void coord(const glm::ivec3& c)
+    {
+        zigzag(c.x);
+        zigzag(c.y);
+        zigzag(c.z);
+    }
+    void f32(float v)
+    {
+        uint32_t bits;
+        memcpy(&bits, &v, 4);
+        u32(bits);
+    }
+    void f64(double v)
+    {
+        uint64_t bits;
+        memcpy(&bits, &v, 8);
+        u32((uint32_t)bits);
+        u32((uint32_t)(bits >> 32));
+    }
+    void bytes(const uint8_t* data, size_t size) { out.insert(out.end(), data, data + size); }
+};
+
+// Reads what NetWriter wrote. Reading past the end (or a malformed varint)
+// clears 'ok' and returns zeros from then on.
+struct NetReader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+    bool ok = true;
+
+    NetReader(const uint8_t* body, size_t bytes) : data(body), size(bytes) {}
+    uint8_t u8()
+    {
+        if (pos >= size) {
+            ok = false;
+            return 0;
+        }
+        return data[pos++];
+    }
+    uint32_t u32()
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++)
+            v |= (uint32_t)u8() << (i * 8);
+        return v;
+    }
+    uint32_t varint()
+    {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b = u8();
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        ok = false;
+        return 0;
+    }
+    int32_t zigzag()
+    {
+        uint32_t v = varint();
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }
+    glm::ivec3 coord()
+    {
+        glm::ivec3 c;
+        c.x = zigzag();
+        c.y = zigzag();
+        c.z = zigzag();
+        return c;
+    }
+    float f32()
+    {
+        uint32_t bits = u32();
+        float v;
+        memcpy(&v, &bits, 4);
+        return v;
+    }
+    double f64()
+    {
+        uint64_t bits = u32();
+        bits |= (uint64_t)u32() << 32;
+        double v;
+        memcpy(&v, &bits, 8);
+        return v;
+    }
+    // Pointer to the next 'count' bytes, nullptr if fewer are left
+    const uint8_t* bytes(size_t count)
+    {
+        if (!ok || size - pos < count) {
+            ok = false;
+            return nullptr;
+        }
+        pos += count;
+        return data + pos - count;
+    }
+    // Everything read, nothing malformed
+    bool done() const { return ok && pos == size; }
+};
+
+// Little-endian fields at fixed offsets, for layouts read in place
+inline void netStore32(uint8_t* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (i * 8));
+}
+inline uint32_t netLoad32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+inline void netStore64(uint8_t* p, double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    netStore32(p, (uint32_t)bits);
+    netStore32(p + 4, (uint32_t)(bits >> 32));
+}
+inline double netLoad64(const uint8_t* p)
+{
+    uint64_t bits = netLoad32(p) | (uint64_t)netLoad32(p + 4) << 32;
+    double v;
+    memcpy(&v, &bits, 8);
+    return v;
+}
+
+// Messages are encoded by appending to 'out', the connection's send queue
+// (NetConnection::beginMessage()) or any buffer, and decoded from the
+// 'size' bytes at 'body' where they were received
+void encodeHello(uint32_t seed, std::vector<uint8_t>& out);
+bool decodeHello(const uint8_t* body, size_t size, uint32_t& version, uint32_t& seed);
+
+// Chunk coordinates of a request or release
+void encodeChunkCoords(const std::vector<glm::ivec3>& coords, std::vector<uint8_t>& out);
+bool decodeChunkCoords(const uint8_t* body, size_t size, std::vector<glm::ivec3>& out);
+
+// A chunk's blocks for the 'sequence'-th coordinate the client requested
+// (counted over every request message), so a reply to a request the
+// client has since released is recognised and dropped. The uncompressed
+// payload goes through 'scratch' both ways; passing the same one each
+// time keeps its memory.
+void encodeChunkData(const Chunk& chunk, uint32_t sequence, std::vector<uint8_t>& scratch, std::vector<uint8_t>& out);
+// Sets the chunk's coordinate and blocks (marked dirty); false if malformed
+bool decodeChunkData(const uint8_t* body, size_t size, Chunk& chunk, uint32_t& sequence, std::vector<uint8_t>& scratch);
+
+// Block changes, as deltas and edits. The last change of each block wins;
+// they are grouped by chunk, each chunk coordinate relative to the one
+// before and each block as the step from the previous block index in its
+// chunk, so a batch of edits costs a few bytes each.
+void encodeBlockChanges(const std::vector<BlockChange>& changes, std::vector<uint8_t>& out);
+bool decodeBlockChanges(const uint8_t* body, size_t size, std::vector<BlockChange>& out);
+
+// Where the client's player starts
+void encodePlayerSpawn(const glm::dvec3& position, std::vector<uint8_t>& out);
+bool decodePlayerSpawn(const uint8_t* body, size_t size, glm::dvec3& position);
+
+// Consecutive inputs. The movement axes go as signed bytes: 'input' with
+// them rounded the same way, so what the client predicts with is exactly
+// what the server applies.
+PlayerInput quantizePlayerInput(const PlayerInput& input);
+void encodePlayerInputs(const std::vector<NetPlayerInput>& inputs, std::vector<uint8_t>& out);
+bool decodePlayerInputs(const uint8_t* body, size_t size, std::vector<NetPlayerInput>& out);
+
+// Snapshots are the bulk of the traffic, every tick to every client, so
+// they have a flat layout of fixed-size fields that is written and read in
+// place, without varints to step through:
+//   f64 server time, u32 input ack, u8 flags (has player, on ground, mode
+//   << 2), f64 player position x, y, z, f32 velocity x, y, z (zero without
+//   a player), u32 entity count
+//   per entity, NET_SNAPSHOT_ENTITY_BYTES: u32 id, i32 position x, y, z in
+//   1/256 blocks from the block the player is in, u16 half extents x, y, z
+//   in 1/256 blocks, u32 color
+// The player's state goes exactly, to replay inputs from.
+const size_t NET_SNAPSHOT_HEADER_BYTES = 53;
+const size_t NET_SNAPSHOT_ENTITY_BYTES = 26;
+
+// A snapshot's fields where it was received. The header is checked by
+// open(); entities are only unpacked when asked for.
+struct NetSnapshotView {
+    // False if the body is not a whole snapshot or the player's fields are
+    // out of range
+    bool open(const uint8_t* body, size_t size);
+
+    double serverTime() const { return netLoad64(data); }
+    uint32_t inputAck() const { return netLoad32(data + 8); }
+    bool hasPlayer() const { return (data[12] & 1) != 0; }
+    NetPlayerState player() const;
+    uint32_t entityCount() const { return count; }
+    NetEntity entity(uint32_t i) const;
+
+private:
+    const uint8_t* data = nullptr;
+    uint32_t count = 0;
+    glm::ivec3 origin = glm::ivec3(0);
+};
+
+void encodeSnapshot(const NetSnapshot& snapshot, std::vector<uint8_t>& out);
+// Unpacked whole, into 'out' (its entities' memory is reused)
+bool decodeSnapshot(const uint8_t* body, size_t size, NetSnapshot& out);
@@ -0,0 +1,153 @@
+#include "occlusion_queries.h"
+#include "chunk_renderer.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
+// Chunks whose boxes are queried before their meshes are drawn
+const int QUERY_BATCH = 16;
+
+static const char* boxVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos; // Unit-cube corner
+
+uniform vec3 boxOrigin; // Relative to the camera
+uniform float boxSize;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+};
+
+void main()
+{
+    gl_Position = viewProj * vec4(boxOrigin + aPos * boxSize, 1.0);
+}
+)";
+
+static const char* boxFragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(1.0);
+}
+)";
+
+void OcclusionQueries::init(unsigned int cameraBinding)
+{
+    boxProgram.create(boxVertexShaderSource, boxFragmentShaderSource);
+    boxProgram.bindBlock("Camera", cameraBinding);
+
+    const float corners[8 * 3] = {
+        0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0,
+        0, 0, 1,  1, 0, 1,  0, 1, 1,  1, 1, 1
+    };
+    const unsigned char indices[36] = {
+        0, 4, 6,  6, 2, 0,  // -X
+        1, 3, 7,  7, 5, 1,  // +X
+        0, 1, 5,  5, 4, 0,  // -Y
+        2, 6, 7,  7, 3, 2,  // +Y
+        0, 2, 3,  3, 1, 0,  // -Z
+        4, 5, 7,  7, 6, 4   // +Z
+    };
+
+    glGenVertexArrays(1, &boxVAO);
+    glGenBuffers(1, &boxVBO);
+    glGenBuffers(1, &boxEBO);
+    glState().bindVertexArray(boxVAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, boxVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glState().bindVertexArray(0);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    queries.resize(QUERY_BATCH);
+    glGenQueries(QUERY_BATCH, queries.data());
+}
+
+void OcclusionQueries::destroy()
+{
+    if (boxVAO == 0)
+        return;
+    glDeleteQueries((GLsizei)queries.size(), queries.data());
+    queries.clear();
+    glState().deleteVertexArrays(1, &boxVAO);
+    glState().deleteBuffers(1, &boxVBO);
+    glState().deleteBuffers(1, &boxEBO);
+    boxVAO = boxVBO = boxEBO = 0;
+    boxProgram.destroy();
+}
+
+int OcclusionQueries::draw(const ChunkRenderer& renderer, const int* indices, int count, const glm::dvec3& eye,
+    const ShaderProgram& drawProgram, int& quads)
+{
+    // Boxes must be rasterised filled even in wireframe mode
+    GLenum polygonMode = glState().currentPolygonMode();
+
+    // Near-plane margin: a box around the eye would be clipped away
+    const float NEAR_MARGIN = 0.5f;
+
+    bool queried[QUERY_BATCH];
+    int draws = 0;
+    for (int batch = 0; batch < count; batch += QUERY_BATCH) {
+        int batchEnd = std::min(count, batch + QUERY_BATCH);
+
+        // Query pass: depth test only, against the batches drawn so far
+        boxProgram.use();
+        glState().bindVertexArray(boxVAO);
+        glState().colorMask(GL_FALSE);
+        glState().depthMask(GL_FALSE);
+        glState().polygonMode(GL_FILL);
+        glUniform1f(boxProgram.uniform("boxSize"), (float)CHUNK_SIZE);
+        for (int i = batch; i < batchEnd; i++) {
+            const ChunkRenderData& data = renderer.chunks[indices[i]];
+            glm::vec3 origin = data.chunk->relativeOrigin(eye);
+            bool containsEye = glm::all(glm::lessThan(origin, glm::vec3(NEAR_MARGIN))) &&
+                glm::all(glm::greaterThan(origin + glm::vec3((float)CHUNK_SIZE), glm::vec3(-NEAR_MARGIN)));
+            queried[i - batch] = data.mesh.vertexCount > 0 && !containsEye;
+            if (!queried[i - batch])
+                continue;
+
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[i - batch]);
+            glUniform3fv(boxProgram.uniform("boxOrigin"), 1, glm::value_ptr(origin));
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+        }
+        glState().colorMask(GL_TRUE);
+        glState().depthMask(GL_TRUE);
+        glState().polygonMode(polygonMode);
+
+        // Draw pass: the GPU skips meshes whose box was fully hidden
+        drawProgram.use();
+        int boundPage = -1;
+        for (int i = batch; i < batchEnd; i++) {
+            const ChunkRenderData& data = renderer.chunks[indices[i]];
+            int page = data.mesh.page();
+            if (page < 0)
+                continue;
+            if (page != boundPage) {
+                chunkMeshHeap().bind(page);
+                boundPage = page;
+            }
+            glm::vec3 origin = data.chunk->relativeOrigin(eye);
+            glVertexAttrib3fv(1, glm::value_ptr(origin));
+            if (queried[i - batch])
+                glBeginConditionalRender(queries[i - batch], GL_QUERY_WAIT);
+            quads += data.mesh.draw(chunkFacingMask(origin, origin + glm::vec3((float)CHUNK_SIZE)));
+            if (queried[i - batch])
+                glEndConditionalRender();
+            draws++;
+        }
+    }
+    return draws;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct ChunkRenderer;
+
+// Hardware occlusion culling for contexts without compute shaders. Each
+// candidate chunk's bounding box is drawn into an occlusion query with colour
+// and depth writes off, then the chunk mesh is drawn under conditional
+// rendering, so the GPU skips it when no sample of the box passed. Chunks are
+// handled in batches, letting earlier batches occlude later ones, so the
+// candidates should be ordered nearest first.
+struct OcclusionQueries {
+    // 'cameraBinding' is the uniform buffer binding of the Camera block
+    void init(unsigned int cameraBinding);
+    void destroy();
+
+    // Draw the meshes of renderer.chunks[indices[0 .. count)] with chunk
+    // origins relative to 'eye'; 'drawProgram' is re-bound for each batch.
+    // Adds the quads of every candidate to 'quads' (the GPU decides which are
+    // skipped) and returns the number of draw calls issued.
+    int draw(const ChunkRenderer& renderer, const int* indices, int count, const glm::dvec3& eye,
+        const ShaderProgram& drawProgram, int& quads);
+
+private:
+    ShaderProgram boxProgram;
+    unsigned int boxVAO = 0;
+    unsigned int boxVBO = 0;
+    unsigned int boxEBO = 0;
+    std::vector<unsigned int> queries;  // One per chunk of a batch
+};
@@ -0,0 +1,194 @@
+#include "occupancy_volume.h"
+#include "chunk_renderer.h"
+#include "gl_state.h"
+#include "profiler.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Window size and flag values below must match OCCUPANCY_WIDTH, OCCUPANCY_HEIGHT and BlockFlags
+static_assert(OCCUPANCY_WIDTH == 128 && OCCUPANCY_HEIGHT == 256, "update occupancyVolumeSource");
+static_assert(BLOCK_OPAQUE == 1 && BLOCK_TRANSLUCENT == 2 && BLOCK_SOLID == 4 && BLOCK_FLUID == 8,
+    "update occupancyVolumeSource");
+static_assert((OCCUPANCY_COLUMNS & (OCCUPANCY_COLUMNS - 1)) == 0, "slots are found by masking");
+static const char* OCCUPANCY_VOLUME_SOURCE = R"(
+    uniform usampler3D occupancyVolume;     // BlockFlags per block, wrapping in x and z
+    uniform vec4 occupancyOrigin;           // The anchor in texels (x and z wrapped); w = 0 when off
+    uniform vec4 occupancyBounds;           // Window relative to the anchor: min x, min z, max x, max z
+
+    const uint OCCUPANCY_OPAQUE = 1u;
+    const uint OCCUPANCY_TRANSLUCENT = 2u;
+    const uint OCCUPANCY_SOLID = 4u;
+    const uint OCCUPANCY_FLUID = 8u;
+
+    uint occupancyFlags(vec3 position)
+    {
+        if (occupancyOrigin.w == 0.0 || any(lessThan(position.xz, occupancyBounds.xy)) ||
+            any(greaterThanEqual(position.xz, occupancyBounds.zw)))
+            return 0u;
+        ivec3 texel = ivec3(floor(position + occupancyOrigin.xyz));
+        if (texel.y < 0 || texel.y >= 256)
+            return 0u;
+        return texelFetch(occupancyVolume, ivec3(texel.x & 127, texel.y, texel.z & 127), 0).r;
+    }
+)";
+
+const char* occupancyVolumeSource()
+{
+    return OCCUPANCY_VOLUME_SOURCE;
+}
+
+void OccupancyVolume::init(int textureUnit)
+{
+    unit = textureUnit;
+    glGenTextures(1, &texture);
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    glState().bindTexture(GL_TEXTURE_3D, texture);
+    std::vector<uint8_t> zeros(textureBytes(), 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, OCCUPANCY_WIDTH, OCCUPANCY_HEIGHT, OCCUPANCY_WIDTH, 0, GL_RED_INTEGER,
+        GL_UNSIGNED_BYTE, zeros.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glState().activeTexture(GL_TEXTURE0);
+
+    for (auto& plane : slots)
+        for (auto& row : plane)
+            for (Slot& slot : row)
+                slot = Slot();
+    window = glm::ivec2(INT32_MIN);
+    updates = 0;
+    pending = 0;
+}
+
+void OccupancyVolume::destroy()
+{
+    if (texture == 0)
+        return;
+    glState().deleteTextures(1, &texture);
+    texture = 0;
+}
+
+// First texel of a chunk's block of the texture
+static glm::ivec3 texelOf(const glm::ivec3& coord)
+{
+    return glm::ivec3(coord.x & (OCCUPANCY_COLUMNS - 1), coord.y, coord.z & (OCCUPANCY_COLUMNS - 1)) * CHUNK_SIZE;
+}
+
+void OccupancyVolume::write(const World& world, const Chunk& chunk, const glm::ivec3& texel)
+{
+    texels.resize(CHUNK_VOLUME);
+    if (chunk.isUniform()) {
+        std::fill(texels.begin(), texels.end(), BLOCK_PROPERTIES[chunk.uniformBlock()].flags);
+    }
+    else {
+        // Through the world, which thaws a cold chunk first
+        const Chunk* readable = world.getChunk(chunk.coord);
+        blocks.resize(CHUNK_VOLUME);
+        readable->blocks.decode(blocks.data());
+        // Chunk voxels run along z, texels along x
+        for (int x = 0; x < CHUNK_SIZE; x++)
+            for (int y = 0; y < CHUNK_SIZE; y++)
+                for (int z = 0; z < CHUNK_SIZE; z++)
+                    texels[(z * CHUNK_SIZE + y) * CHUNK_SIZE + x] = BLOCK_PROPERTIES[blocks[chunkIndex(x, y, z)]].flags;
+    }
+    glState().bindTexture(GL_TEXTURE_3D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, texel.x, texel.y, texel.z, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, GL_RED_INTEGER,
+        GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void OccupancyVolume::clearSlot(const glm::ivec3& texel)
+{
+    texels.assign(CHUNK_VOLUME, 0);
+    glState().bindTexture(GL_TEXTURE_3D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, texel.x, texel.y, texel.z, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, GL_RED_INTEGER,
+        GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+int OccupancyVolume::update(const World& world, const ChunkRenderer& renderer, const glm::dvec3& eye)
+{
+    PROFILE_ZONE("Occupancy volume");
+    glm::ivec2 eyeColumn = glm::ivec2(glm::floor(glm::dvec2(eye.x, eye.z) / (double)CHUNK_SIZE));
+    window = eyeColumn - OCCUPANCY_COLUMNS / 2;
+    updates++;
+
+    int written = 0;
+    pending = 0;
+    for (const ChunkRenderData& data : renderer.chunks) {
+        const glm::ivec3& coord = data.chunk->coord;
+        if (coord.x < window.x || coord.x >= window.x + OCCUPANCY_COLUMNS || coord.z < window.y ||
+            coord.z >= window.y + OCCUPANCY_COLUMNS || coord.y < 0 || coord.y >= WORLD_HEIGHT_CHUNKS)
+            continue;
+        glm::ivec3 texel = texelOf(coord);
+        Slot& slot = slots[texel.x / CHUNK_SIZE][coord.y][texel.z / CHUNK_SIZE];
+        slot.seen = updates;
+        if (slot.chunk == data.chunk && slot.coord == coord && slot.meshVersion == data.meshVersion)
+            continue;
+        if (written == chunksPerFrame) {
+            pending++;
+            continue;
+        }
+        write(world, *data.chunk, texel);
+        slot.chunk = data.chunk;
+        slot.coord = coord;
+        slot.meshVersion = data.meshVersion;
+        written++;
+    }
+
+    // Slots no chunk in the window claimed: unloaded or out of range
+    for (int x = 0; x < OCCUPANCY_COLUMNS; x++)
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++)
+            for (int z = 0; z < OCCUPANCY_COLUMNS; z++) {
+                Slot& slot = slots[x][y][z];
+                if (slot.chunk && slot.seen != updates) {
+                    clearSlot(glm::ivec3(x, y, z) * CHUNK_SIZE);
+                    slot.chunk = nullptr;
+                }
+            }
+    return written;
+}
+
+void OccupancyVolume::clear()
+{
+    for (int x = 0; x < OCCUPANCY_COLUMNS; x++)
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++)
+            for (int z = 0; z < OCCUPANCY_COLUMNS; z++) {
+                Slot& slot = slots[x][y][z];
+                if (slot.chunk) {
+                    clearSlot(glm::ivec3(x, y, z) * CHUNK_SIZE);
+                    slot.chunk = nullptr;
+                }
+            }
+    window = glm::ivec2(INT32_MIN);
+    pending = 0;
+}
+
+void OccupancyVolume::bindProgram(const ShaderProgram& program) const
+{
+    program.use();
+    glUniform1i(program.uniform("occupancyVolume"), unit);
+}
+
+void OccupancyVolume::setUniforms(const ShaderProgram& program, const glm::dvec3& anchor, bool enabled) const
+{
+    program.use();
+    if (!enabled || window.x == INT32_MIN) {
+        glUniform4f(program.uniform("occupancyOrigin"), 0.0f, 0.0f, 0.0f, 0.0f);
+        return;
+    }
+    // Wrapped in double, so the anchor keeps its fraction anywhere in the world
+    double width = OCCUPANCY_WIDTH;
+    glUniform4f(program.uniform("occupancyOrigin"), (float)(anchor.x - std::floor(anchor.x / width) * width),
+        (float)anchor.y, (float)(anchor.z - std::floor(anchor.z / width) * width), 1.0f);
+    glm::dvec2 low = glm::dvec2(window) * (double)CHUNK_SIZE - glm::dvec2(anchor.x, anchor.z);
+    glm::dvec2 high = low + (double)OCCUPANCY_WIDTH;
+    glUniform4f(program.uniform("occupancyBounds"), (float)low.x, (float)low.y, (float)high.x, (float)high.y);
+}
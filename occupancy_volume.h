@@ -0,0 +1,79 @@
+#pragma once
+
+#include "shader.h"
+#include "world.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ChunkRenderer;
+
+// Block flags of the loaded chunks around the camera in a 3D texture, so
+// shaders can ask what is at a position with one texelFetch (particles
+// collide with it). One R8UI texel per block holds its BlockFlags: opaque,
+// translucent, solid, fluid; 0 is air.
+//
+// The texture spans OCCUPANCY_COLUMNS chunk columns across at full world
+// height, addressed toroidally by block (x and z wrap), so following the
+// camera only rewrites the chunks that came into range. A chunk is written
+// with one glTexSubImage3D when it enters the window and again whenever the
+// renderer rebuilds its mesh (a new meshVersion: its voxels changed), a
+// budget of them per update(); chunks that leave are cleared to air.
+const int OCCUPANCY_COLUMNS = 8;    // Chunk columns across the window, a power of two
+const int OCCUPANCY_WIDTH = OCCUPANCY_COLUMNS * CHUNK_SIZE;
+const int OCCUPANCY_HEIGHT = WORLD_HEIGHT_CHUNKS * CHUNK_SIZE;
+
+struct OccupancyVolume {
+    int chunksPerFrame = 32;    // Chunk writes per update(); the rest wait
+
+    // Create the texture, bound to 'unit' for good
+    void init(int unit);
+    void destroy();
+
+    // Follow 'eye' over the renderer's chunks, writing the changed ones and
+    // clearing those gone. Reads their voxels, so call while the world may
+    // be read. Returns the chunks written.
+    int update(const World& world, const ChunkRenderer& renderer, const glm::dvec3& eye);
+    // Clear everything; the volume reads as air until the next update()
+    void clear();
+
+    // Point the program's sampler at the unit from init()
+    void bindProgram(const ShaderProgram& program) const;
+    // Set the program's uniforms for positions relative to 'anchor' (world
+    // space); everything reads as air when 'enabled' is false
+    void setUniforms(const ShaderProgram& program, const glm::dvec3& anchor, bool enabled) const;
+
+    // Chunks in the window still to write
+    int pendingChunks() const { return pending; }
+    size_t textureBytes() const { return (size_t)OCCUPANCY_WIDTH * OCCUPANCY_HEIGHT * OCCUPANCY_WIDTH; }
+
+private:
+    // What one chunk-sized block of texels holds
+    struct Slot {
+        const Chunk* chunk = nullptr;   // nullptr: air
+        glm::ivec3 coord;
+        uint32_t meshVersion = 0;
+        uint32_t seen = 0;              // Last update() it was in the window
+    };
+
+    void write(const World& world, const Chunk& chunk, const glm::ivec3& texel);
+    void clearSlot(const glm::ivec3& texel);
+
+    unsigned int texture = 0;
+    int unit = 0;
+    glm::ivec2 window = glm::ivec2(INT32_MIN);  // First chunk column of the window; nothing yet at INT32_MIN
+    Slot slots[OCCUPANCY_COLUMNS][WORLD_HEIGHT_CHUNKS][OCCUPANCY_COLUMNS];
+    uint32_t updates = 0;
+    int pending = 0;
+    std::vector<BlockId> blocks;    // One chunk, decoded
+    std::vector<uint8_t> texels;    // One chunk, [z][y][x] as GL reads it
+};
+
+// GLSL for shaders that read the volume: the sampler and uniforms, the
+// OCCUPANCY_* flags and 'uint occupancyFlags(vec3 position)', the flags of
+// the block at 'position' (relative to the anchor of setUniforms()), 0
+// outside the window. No #version line.
+const char* occupancyVolumeSource();
@@ -0,0 +1,58 @@
+#include "offscreen_target.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+
+bool OffscreenTarget::init(int w, int h)
+{
+    width = w;
+    height = h;
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+        destroy();
+    return complete;
+}
+
+void OffscreenTarget::destroy()
+{
+    glState().deleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    framebuffer = colorBuffer = depthBuffer = 0;
+}
+
+bool OffscreenTarget::resize(int w, int h)
+{
+    if (framebuffer != 0 && w == width && h == height)
+        return true;
+    destroy();
+    return init(w, h);
+}
+
+void OffscreenTarget::bind() const
+{
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void OffscreenTarget::present(unsigned int target, int targetWidth, int targetHeight) const
+{
+    glState().bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT,
+        width == targetWidth && height == targetHeight ? GL_NEAREST : GL_LINEAR);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Colour + depth framebuffer standing in for the window's when nothing is
+// shown (headless benchmarks). A hidden window's default framebuffer may be
+// discarded or tested against pixel ownership, so frames are rendered here
+// instead and never displayed. Also holds the scene while it is rendered
+// below the window's resolution, until present() scales it up.
+struct OffscreenTarget {
+    unsigned int framebuffer = 0;
+    unsigned int colorBuffer = 0;   // RGBA8 renderbuffer
+    unsigned int depthBuffer = 0;   // 24-bit depth renderbuffer
+    int width = 0;
+    int height = 0;
+
+    // Returns false if the framebuffer is incomplete
+    bool init(int width, int height);
+    void destroy();
+    // Recreate the buffers for a new size (no-op if unchanged). Returns
+    // false if the framebuffer is incomplete.
+    bool resize(int width, int height);
+
+    void bind() const;
+    // Copy the colour to 'target', stretched over its 'targetWidth' x
+    // 'targetHeight' with bilinear filtering, and leave it bound
+    void present(unsigned int target, int targetWidth, int targetHeight) const;
+};
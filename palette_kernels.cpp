@@ -0,0 +1,411 @@
+#include "palette_kernels.h"
+#include "chunk.h"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PALETTE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define PALETTE_SSSE3 1
+#else
+#include <emmintrin.h>
+#endif
+#define PALETTE_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PALETTE_NEON 1
+#endif
+
+const int PACKED_BYTES[9] = { 0, CHUNK_VOLUME / 8, CHUNK_VOLUME / 4, 0, CHUNK_VOLUME / 2, 0, 0, 0, CHUNK_VOLUME };
+
+void unpackPaletteIndicesScalar(const uint64_t* words, int bits, uint8_t* indices)
+{
+    // Walk each word once; indices never straddle word boundaries
+    const int perWord = 64 / bits;
+    const uint64_t mask = (1ull << bits) - 1;
+    for (int i = 0; i < CHUNK_VOLUME; i += perWord) {
+        uint64_t word = words[i / perWord];
+        for (int k = 0; k < perWord; k++) {
+            indices[i + k] = (uint8_t)(word & mask);
+            word >>= bits;
+        }
+    }
+}
+
+void packPaletteIndicesScalar(const uint8_t* indices, int bits, uint64_t* words)
+{
+    const int perWord = 64 / bits;
+    for (int i = 0; i < CHUNK_VOLUME; i += perWord) {
+        uint64_t word = 0;
+        for (int k = perWord - 1; k >= 0; k--)
+            word = (word << bits) | indices[i + k];
+        words[i / perWord] = word;
+    }
+}
+
+void lookupBytesScalar(const uint8_t* in, int count, const uint8_t* table, uint8_t* out)
+{
+    for (int i = 0; i < count; i++)
+        out[i] = table[in[i]];
+}
+
+void findPaletteIndicesScalar(const uint8_t* values, int count, const uint8_t* palette, int paletteSize, uint8_t* indices)
+{
+    uint8_t lookup[256] = {};
+    for (int j = paletteSize - 1; j >= 0; j--)
+        lookup[palette[j]] = (uint8_t)j;
+    lookupBytesScalar(values, count, lookup, indices);
+}
+
+// Adds the values of values[begin, end) not 'seen' yet
+static int collectRange(const uint8_t* values, int begin, int end, bool* seen, uint8_t* palette, int size)
+{
+    for (int i = begin; i < end; i++) {
+        if (!seen[values[i]]) {
+            seen[values[i]] = true;
+            palette[size++] = values[i];
+        }
+    }
+    return size;
+}
+
+int collectPaletteScalar(const uint8_t* values, int count, uint8_t* palette)
+{
+    bool seen[256] = {};
+    return collectRange(values, 0, count, seen, palette, 0);
+}
+
+#if defined(PALETTE_SSE2)
+// Two nibbles a byte, low first, to a byte each
+static inline void storeNibbles(__m128i packed, uint8_t* out)
+{
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m128i lo = _mm_and_si128(packed, low);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), low);
+    _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(lo, hi));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi8(lo, hi));
+}
+
+// A lane per bit of a vector holding one byte eight times, then a second
+static inline __m128i bitsOfPair(__m128i pair)
+{
+    const __m128i select = _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(pair, select), select);
+    return _mm_and_si128(set, _mm_set1_epi8(1));
+}
+
+void unpackPaletteIndices(const uint64_t* words, int bits, uint8_t* indices)
+{
+    const uint8_t* packed = (const uint8_t*)words;
+    int bytes = PACKED_BYTES[bits];
+    if (bits == 8) {
+        memcpy(indices, packed, CHUNK_VOLUME);
+    }
+    else if (bits == 4) {
+        for (int i = 0; i < bytes; i += 16)
+            storeNibbles(_mm_loadu_si128((const __m128i*)(packed + i)), indices + i * 2);
+    }
+    else if (bits == 2) {
+        // Regroup each byte's four indices as two bytes of nibbles, then as above
+        const __m128i first = _mm_set1_epi8(0x03);
+        const __m128i second = _mm_set1_epi8(0x30);
+        for (int i = 0; i < bytes; i += 16) {
+            __m128i b = _mm_loadu_si128((const __m128i*)(packed + i));
+            __m128i even = _mm_or_si128(_mm_and_si128(b, first), _mm_and_si128(_mm_slli_epi16(b, 2), second));
+            __m128i odd = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(b, 4), first), _mm_and_si128(_mm_srli_epi16(b, 2), second));
+            storeNibbles(_mm_unpacklo_epi8(even, odd), indices + i * 4);
+            storeNibbles(_mm_unpackhi_epi8(even, odd), indices + i * 4 + 32);
+        }
+    }
+    else {
+        // Spread each byte over eight lanes, two bytes a vector, and test a bit in each
+        for (int i = 0; i < bytes; i += 16) {
+            __m128i b = _mm_loadu_si128((const __m128i*)(packed + i));
+            __m128i halves[2] = { _mm_unpacklo_epi8(b, b), _mm_unpackhi_epi8(b, b) };
+            uint8_t* out = indices + i * 8;
+            for (__m128i half : halves) {
+                __m128i quarters[2] = { _mm_unpacklo_epi16(half, half), _mm_unpackhi_epi16(half, half) };
+                for (__m128i quarter : quarters) {
+                    _mm_storeu_si128((__m128i*)out, bitsOfPair(_mm_unpacklo_epi32(quarter, quarter)));
+                    _mm_storeu_si128((__m128i*)(out + 16), bitsOfPair(_mm_unpackhi_epi32(quarter, quarter)));
+                    out += 32;
+                }
+            }
+        }
+    }
+}
+
+void packPaletteIndices(const uint8_t* indices, int bits, uint64_t* words)
+{
+    uint8_t* packed = (uint8_t*)words;
+    int bytes = PACKED_BYTES[bits];
+    const __m128i lowByte = _mm_set1_epi16(0x00FF);
+    if (bits == 8) {
+        memcpy(packed, indices, CHUNK_VOLUME);
+    }
+    else if (bits == 4) {
+        // Each 16-bit lane's high index moves up beside its low one
+        for (int i = 0; i < bytes; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(indices + i * 2));
+            __m128i b = _mm_loadu_si128((const __m128i*)(indices + i * 2 + 16));
+            a = _mm_or_si128(_mm_and_si128(a, lowByte), _mm_slli_epi16(_mm_srli_epi16(a, 8), 4));
+            b = _mm_or_si128(_mm_and_si128(b, lowByte), _mm_slli_epi16(_mm_srli_epi16(b, 8), 4));
+            _mm_storeu_si128((__m128i*)(packed + i), _mm_packus_epi16(a, b));
+        }
+    }
+    else if (bits == 2) {
+        // Pairs into 16-bit lanes, then pairs of those into 32-bit lanes
+        const __m128i lowHalf = _mm_set1_epi32(0xFFFF);
+        for (int i = 0; i < bytes; i += 16) {
+            __m128i lanes[4];
+            for (int k = 0; k < 4; k++) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(indices + i * 4 + k * 16));
+                v = _mm_or_si128(_mm_and_si128(v, lowByte), _mm_slli_epi16(_mm_srli_epi16(v, 8), 2));
+                lanes[k] = _mm_or_si128(_mm_and_si128(v, lowHalf), _mm_slli_epi32(_mm_srli_epi32(v, 16), 4));
+            }
+            __m128i words16 = _mm_packus_epi16(_mm_packs_epi32(lanes[0], lanes[1]), _mm_packs_epi32(lanes[2], lanes[3]));
+            _mm_storeu_si128((__m128i*)(packed + i), words16);
+        }
+    }
+    else {
+        // Bit 0 of each index to the sign bit, then one bit a byte
+        for (int i = 0; i < bytes; i += 2) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(indices + i * 8));
+            uint16_t mask = (uint16_t)_mm_movemask_epi8(_mm_slli_epi16(v, 7));
+            memcpy(packed + i, &mask, sizeof(mask));
+        }
+    }
+}
+
+void lookupBytes(const uint8_t* in, int count, const uint8_t* table, int tableSize, uint8_t* out)
+{
+    if (tableSize > 16) {
+        lookupBytesScalar(in, count, table, out);
+        return;
+    }
+    uint8_t padded[16] = {};
+    memcpy(padded, table, tableSize);
+    int i = 0;
+#if defined(PALETTE_SSSE3)
+    __m128i lanes = _mm_loadu_si128((const __m128i*)padded);
+#if defined(PALETTE_AVX2)
+    __m256i lanes2 = _mm256_broadcastsi128_si256(lanes);
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_shuffle_epi8(lanes2, v));
+    }
+#endif
+    for (; i < count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(lanes, v));
+    }
+#else
+    // No byte shuffle: select each entry where the index matches
+    for (; i < count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i result = _mm_setzero_si128();
+        for (int j = 0; j < tableSize; j++) {
+            __m128i match = _mm_cmpeq_epi8(v, _mm_set1_epi8((char)j));
+            result = _mm_or_si128(result, _mm_and_si128(match, _mm_set1_epi8((char)padded[j])));
+        }
+        _mm_storeu_si128((__m128i*)(out + i), result);
+    }
+#endif
+}
+
+void findPaletteIndices(const uint8_t* values, int count, const uint8_t* palette, int paletteSize, uint8_t* indices)
+{
+    if (paletteSize > 16) {
+        findPaletteIndicesScalar(values, count, palette, paletteSize, indices);
+        return;
+    }
+    // One compare per entry; entries are distinct, so each value matches once
+    int i = 0;
+#if defined(PALETTE_AVX2)
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+        __m256i result = _mm256_setzero_si256();
+        for (int j = 1; j < paletteSize; j++) {
+            __m256i match = _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)palette[j]));
+            result = _mm256_or_si256(result, _mm256_and_si256(match, _mm256_set1_epi8((char)j)));
+        }
+        _mm256_storeu_si256((__m256i*)(indices + i), result);
+    }
+#endif
+    for (; i < count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i result = _mm_setzero_si128();
+        for (int j = 1; j < paletteSize; j++) {
+            __m128i match = _mm_cmpeq_epi8(v, _mm_set1_epi8((char)palette[j]));
+            result = _mm_or_si128(result, _mm_and_si128(match, _mm_set1_epi8((char)j)));
+        }
+        _mm_storeu_si128((__m128i*)(indices + i), result);
+    }
+}
+
+int collectPalette(const uint8_t* values, int count, uint8_t* palette)
+{
+    // While the palette is small, a vector of values already in it costs
+    // one compare per entry; only those with a new value are walked
+    bool seen[256] = {};
+    int size = 0;
+    int i = 0;
+    for (; i < count && size <= 16; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i known = _mm_setzero_si128();
+        for (int j = 0; j < size; j++)
+            known = _mm_or_si128(known, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)palette[j])));
+        if (_mm_movemask_epi8(known) != 0xFFFF)
+            size = collectRange(values, i, i + 16, seen, palette, size);
+    }
+    return collectRange(values, i, count, seen, palette, size);
+}
+#elif defined(PALETTE_NEON)
+void unpackPaletteIndices(const uint64_t* words, int bits, uint8_t* indices)
+{
+    const uint8_t* packed = (const uint8_t*)words;
+    int bytes = PACKED_BYTES[bits];
+    if (bits == 8) {
+        memcpy(indices, packed, CHUNK_VOLUME);
+    }
+    else if (bits == 4) {
+        for (int i = 0; i < bytes; i += 16) {
+            uint8x16_t b = vld1q_u8(packed + i);
+            uint8x16_t lo = vandq_u8(b, vdupq_n_u8(0x0F));
+            uint8x16_t hi = vshrq_n_u8(b, 4);
+            vst1q_u8(indices + i * 2, vzip1q_u8(lo, hi));
+            vst1q_u8(indices + i * 2 + 16, vzip2q_u8(lo, hi));
+        }
+    }
+    else if (bits == 2) {
+        // The four indices of each byte, interleaved back by the store
+        const uint8x16_t mask = vdupq_n_u8(0x03);
+        for (int i = 0; i < bytes; i += 16) {
+            uint8x16_t b = vld1q_u8(packed + i);
+            uint8x16x4_t split;
+            split.val[0] = vandq_u8(b, mask);
+            split.val[1] = vandq_u8(vshrq_n_u8(b, 2), mask);
+            split.val[2] = vandq_u8(vshrq_n_u8(b, 4), mask);
+            split.val[3] = vshrq_n_u8(b, 6);
+            vst4q_u8(indices + i * 4, split);
+        }
+    }
+    else {
+        const uint8_t selectBytes[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+        const uint8x16_t select = vld1q_u8(selectBytes);
+        for (int i = 0; i < bytes; i += 2) {
+            uint8x16_t pair = vcombine_u8(vdup_n_u8(packed[i]), vdup_n_u8(packed[i + 1]));
+            vst1q_u8(indices + i * 8, vandq_u8(vtstq_u8(pair, select), vdupq_n_u8(1)));
+        }
+    }
+}
+
+void packPaletteIndices(const uint8_t* indices, int bits, uint64_t* words)
+{
+    uint8_t* packed = (uint8_t*)words;
+    int bytes = PACKED_BYTES[bits];
+    if (bits == 8) {
+        memcpy(packed, indices, CHUNK_VOLUME);
+    }
+    else if (bits == 4) {
+        for (int i = 0; i < bytes; i += 16) {
+            uint8x16x2_t pairs = vld2q_u8(indices + i * 2);
+            vst1q_u8(packed + i, vorrq_u8(pairs.val[0], vshlq_n_u8(pairs.val[1], 4)));
+        }
+    }
+    else if (bits == 2) {
+        for (int i = 0; i < bytes; i += 16) {
+            uint8x16x4_t quads = vld4q_u8(indices + i * 4);
+            uint8x16_t b = vorrq_u8(quads.val[0], vshlq_n_u8(quads.val[1], 2));
+            b = vorrq_u8(b, vorrq_u8(vshlq_n_u8(quads.val[2], 4), vshlq_n_u8(quads.val[3], 6)));
+            vst1q_u8(packed + i, b);
+        }
+    }
+    else {
+        // Weight each index by its bit, then add up each half
+        const uint8_t weightBytes[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+        const uint8x16_t weights = vld1q_u8(weightBytes);
+        for (int i = 0; i < bytes; i += 2) {
+            uint8x16_t v = vmulq_u8(vld1q_u8(indices + i * 8), weights);
+            packed[i] = vaddv_u8(vget_low_u8(v));
+            packed[i + 1] = vaddv_u8(vget_high_u8(v));
+        }
+    }
+}
+
+void lookupBytes(const uint8_t* in, int count, const uint8_t* table, int tableSize, uint8_t* out)
+{
+    if (tableSize > 16) {
+        lookupBytesScalar(in, count, table, out);
+        return;
+    }
+    uint8_t padded[16] = {};
+    memcpy(padded, table, tableSize);
+    uint8x16_t lanes = vld1q_u8(padded);
+    for (int i = 0; i < count; i += 16)
+        vst1q_u8(out + i, vqtbl1q_u8(lanes, vld1q_u8(in + i)));
+}
+
+void findPaletteIndices(const uint8_t* values, int count, const uint8_t* palette, int paletteSize, uint8_t* indices)
+{
+    if (paletteSize > 16) {
+        findPaletteIndicesScalar(values, count, palette, paletteSize, indices);
+        return;
+    }
+    // One compare per entry; entries are distinct, so each value matches once
+    for (int i = 0; i < count; i += 16) {
+        uint8x16_t v = vld1q_u8(values + i);
+        uint8x16_t result = vdupq_n_u8(0);
+        for (int j = 1; j < paletteSize; j++)
+            result = vorrq_u8(result, vandq_u8(vceqq_u8(v, vdupq_n_u8(palette[j])), vdupq_n_u8((uint8_t)j)));
+        vst1q_u8(indices + i, result);
+    }
+}
+
+int collectPalette(const uint8_t* values, int count, uint8_t* palette)
+{
+    // While the palette is small, a vector of values already in it costs
+    // one compare per entry; only those with a new value are walked
+    bool seen[256] = {};
+    int size = 0;
+    int i = 0;
+    for (; i < count && size <= 16; i += 16) {
+        uint8x16_t v = vld1q_u8(values + i);
+        uint8x16_t known = vdupq_n_u8(0);
+        for (int j = 0; j < size; j++)
+            known = vorrq_u8(known, vceqq_u8(v, vdupq_n_u8(palette[j])));
+        if (vminvq_u8(known) != 0xFF)
+            size = collectRange(values, i, i + 16, seen, palette, size);
+    }
+    return collectRange(values, i, count, seen, palette, size);
+}
+#else
+void unpackPaletteIndices(const uint64_t* words, int bits, uint8_t* indices)
+{
+    unpackPaletteIndicesScalar(words, bits, indices);
+}
+
+int collectPalette(const uint8_t* values, int count, uint8_t* palette)
+{
+    return collectPaletteScalar(values, count, palette);
+}
+
+void packPaletteIndices(const uint8_t* indices, int bits, uint64_t* words)
+{
+    packPaletteIndicesScalar(indices, bits, words);
+}
+
+void lookupBytes(const uint8_t* in, int count, const uint8_t* table, int, uint8_t* out)
+{
+    lookupBytesScalar(in, count, table, out);
+}
+
+void findPaletteIndices(const uint8_t* values, int count, const uint8_t* palette, int paletteSize, uint8_t* indices)
+{
+    findPaletteIndicesScalar(values, count, palette, paletteSize, indices);
+}
+#endif
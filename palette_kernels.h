@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+// Bulk kernels behind PalettedBlocks: bit-packed palette indices to one
+// byte per voxel and back, and byte table lookups, which turn indices into
+// block IDs, block IDs into indices and old indices into new ones.
+//
+// Indices are 1, 2, 4 or 8 bits wide, packed from the low bits of each
+// little-endian 64-bit word, CHUNK_VOLUME of them. Lookups into tables of
+// up to 16 entries (almost every chunk's palette) run 16 or 32 voxels at a
+// time with pshufb (SSSE3, AVX2), tbl (NEON) or one compare per entry
+// (SSE2); packing and unpacking use shifts and byte interleaves (SSE2,
+// NEON). Larger tables and targets without SIMD take the scalar loops,
+// which are also the reference: every path gives the same bytes.
+
+// CHUNK_VOLUME indices of 'bits' each into one byte apiece
+void unpackPaletteIndices(const uint64_t* words, int bits, uint8_t* indices);
+// CHUNK_VOLUME byte indices (each below 1 << bits) into 'words', all of
+// which are overwritten
+void packPaletteIndices(const uint8_t* indices, int bits, uint64_t* words);
+
+// out[i] = table[in[i]] for 'count' bytes (a multiple of 16); every input
+// must be below tableSize. 'out' may be 'in'.
+void lookupBytes(const uint8_t* in, int count, const uint8_t* table, int tableSize, uint8_t* out);
+// Index into 'palette' of each of 'count' values (a multiple of 16), every
+// one of which must be in it; the inverse of lookupBytes() with the palette
+void findPaletteIndices(const uint8_t* values, int count, const uint8_t* palette, int paletteSize, uint8_t* indices);
+
+// Distinct values among 'count' (a multiple of 16) in order of first
+// appearance, into 'palette' (room for 256). Returns how many.
+int collectPalette(const uint8_t* values, int count, uint8_t* palette);
+
+// The same without SIMD, for comparison and as the reference
+void unpackPaletteIndicesScalar(const uint64_t* words, int bits, uint8_t* indices);
+void packPaletteIndicesScalar(const uint8_t* indices, int bits, uint64_t* words);
+void lookupBytesScalar(const uint8_t* in, int count, const uint8_t* table, uint8_t* out);
+void findPaletteIndicesScalar(const uint8_t* values, int count, const uint8_t* palette, int paletteSize, uint8_t* indices);
+int collectPaletteScalar(const uint8_t* values, int count, uint8_t* palette);
@@ -0,0 +1,72 @@
+#include "player_controller.h"
+#include "voxel_collision.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float WALK_SPEED = 4.3f;      // Blocks per second
+const float FLY_SPEED = 10.0f;
+const float SPRINT_FACTOR = 2.0f;
+const float GRAVITY = 28.0f;        // Blocks per second squared
+const float JUMP_SPEED = 8.5f;
+const float MAX_FALL_SPEED = 60.0f;
+
+void PlayerController::step(const World& world, const PlayerInput& input, float dt)
+{
+    float speed = (mode == PLAYER_WALK ? WALK_SPEED : FLY_SPEED) * (input.sprint ? SPRINT_FACTOR : 1.0f);
+
+    glm::vec3 right = glm::normalize(glm::cross(input.look, glm::vec3(0.0f, 1.0f, 0.0f)));
+    if (mode == PLAYER_WALK) {
+        // Walk on the horizontal plane regardless of pitch
+        glm::vec3 flat = glm::vec3(input.look.x, 0.0f, input.look.z);
+        glm::vec3 forward = glm::length(flat) > 0.0f ? glm::normalize(flat) : glm::vec3(0.0f);
+        glm::vec3 wish = forward * input.forward + right * input.strafe;
+        if (glm::length(wish) > 1.0f)
+            wish = glm::normalize(wish);
+        velocity.x = wish.x * speed;
+        velocity.z = wish.z * speed;
+
+        if (onGround && input.vertical > 0.0f)
+            velocity.y = JUMP_SPEED;
+        velocity.y = std::max(velocity.y - GRAVITY * dt, -MAX_FALL_SPEED);
+    }
+    else {
+        velocity = (input.look * input.forward + right * input.strafe + glm::vec3(0.0f, input.vertical, 0.0f)) * speed;
+    }
+
+    glm::dvec3 delta = glm::dvec3(velocity) * (double)dt;
+    if (mode == PLAYER_NOCLIP) {
+        position += delta;
+        onGround = false;
+        return;
+    }
+
+    // Vertical first so walking off an edge and landing resolve cleanly
+    double movedY = moveAxis(world, 1, delta.y);
+    onGround = delta.y < 0.0 && movedY > delta.y;
+    if (movedY != delta.y)
+        velocity.y = 0.0f;
+    if (moveAxis(world, 0, delta.x) != delta.x)
+        velocity.x = 0.0f;
+    if (moveAxis(world, 2, delta.z) != delta.z)
+        velocity.z = 0.0f;
+}
+
+double PlayerController::moveAxis(const World& world, int axis, double delta)
+{
+    glm::dvec3 boxMin = position - glm::dvec3(HALF_WIDTH, 0.0, HALF_WIDTH);
+    glm::dvec3 boxMax = position + glm::dvec3(HALF_WIDTH, HEIGHT, HALF_WIDTH);
+    WorldCursor cursor(world);
+    double allowed = sweepBoxAxis(cursor, boxMin, boxMax, axis, delta);
+    position[axis] += allowed;
+    return allowed;
+}
+
+bool PlayerController::overlapsBlock(const glm::ivec3& block) const
+{
+    glm::dvec3 boxMin = position - glm::dvec3(HALF_WIDTH, 0.0, HALF_WIDTH);
+    glm::dvec3 boxMax = position + glm::dvec3(HALF_WIDTH, HEIGHT, HALF_WIDTH);
+    glm::dvec3 blockMin = glm::dvec3(block);
+    return glm::all(glm::lessThan(boxMin, blockMin + 1.0)) && glm::all(glm::greaterThan(boxMax, blockMin));
+}
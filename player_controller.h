@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+struct World;
+
+// Movement intent sampled once per frame and applied on every simulation tick
+struct PlayerInput {
+    glm::vec3 look = glm::vec3(0.0f, 0.0f, -1.0f);  // Camera front
+    float forward = 0.0f;   // -1 .. 1
+    float strafe = 0.0f;    // -1 .. 1, positive to the right
+    float vertical = 0.0f;  // Jump / fly up (+1) and fly down (-1)
+    bool sprint = false;
+};
+
+enum PlayerMode {
+    PLAYER_NOCLIP,  // Free flight through blocks
+    PLAYER_FLY,     // Free flight that collides with blocks
+    PLAYER_WALK,    // Gravity, jumping and collision
+    PLAYER_MODE_COUNT
+};
+
+// Player body as an axis-aligned box moved through the block grid with
+// swept collision: each tick the motion is applied one axis at a time and
+// clipped at the first solid block layer the box would enter.
+struct PlayerController {
+    static constexpr float HALF_WIDTH = 0.3f;
+    static constexpr float HEIGHT = 1.8f;
+    static constexpr float EYE_HEIGHT = 1.62f;
+
+    glm::dvec3 position = glm::dvec3(0.0);  // Centre of the bottom of the box
+    glm::vec3 velocity = glm::vec3(0.0f);
+    bool onGround = false;
+    PlayerMode mode = PLAYER_NOCLIP;
+
+    // Place the eye at 'eye'
+    void setEye(const glm::dvec3& eye) { position = eye - glm::dvec3(0.0, EYE_HEIGHT, 0.0); }
+    glm::dvec3 eye() const { return position + glm::dvec3(0.0, EYE_HEIGHT, 0.0); }
+
+    // Advance the simulation by 'dt' seconds
+    void step(const World& world, const PlayerInput& input, float dt);
+
+    // True if the body overlaps the block at 'block'
+    bool overlapsBlock(const glm::ivec3& block) const;
+
+private:
+    // Move along 'axis' by up to 'delta', stopping short of solid blocks.
+    // Returns the distance actually moved.
+    double moveAxis(const World& world, int axis, double delta);
+};
@@ -0,0 +1,65 @@
+#include "player_prediction.h"
+#include "world.h"
+
+#include <cmath>
+
+// Inputs kept for replay at most; a server that stopped acknowledging
+// them is long gone by then
+const size_t MAX_PENDING_INPUTS = 600;
+
+void stepNetPlayer(PlayerController& player, const World& world, const NetPlayerInput& input)
+{
+    if (player.mode != input.mode) {
+        player.mode = input.mode;
+        player.velocity = glm::vec3(0.0f);
+    }
+    player.step(world, input.input, input.dt);
+}
+
+NetPlayerInput PlayerPrediction::record(const PlayerInput& input, PlayerMode mode, float dt)
+{
+    NetPlayerInput recorded;
+    recorded.sequence = nextSequence++;
+    recorded.input = quantizePlayerInput(input);
+    recorded.mode = mode;
+    recorded.dt = dt;
+    pending.push_back(recorded);
+    if (pending.size() > MAX_PENDING_INPUTS)
+        pending.pop_front();
+    return recorded;
+}
+
+void PlayerPrediction::reconcile(PlayerController& player, const World& world, const NetPlayerState& state, uint32_t ack)
+{
+    while (!pending.empty() && pending.front().sequence < ack)
+        pending.pop_front();
+
+    glm::dvec3 predicted = player.position;
+    player.position = state.position;
+    player.velocity = state.velocity;
+    player.onGround = state.onGround;
+    player.mode = state.mode;
+    for (const NetPlayerInput& input : pending)
+        stepNetPlayer(player, world, input);
+
+    glm::dvec3 error = predicted - player.position;
+    lastError = glm::length(error);
+    correction += error;
+    if (glm::length(correction) > snapDistance)
+        correction = glm::dvec3(0.0);
+}
+
+void PlayerPrediction::decay(float dt)
+{
+    correction *= std::exp2(-dt / correctionHalfLife);
+    if (glm::dot(correction, correction) < 1e-8)
+        correction = glm::dvec3(0.0);
+}
+
+void PlayerPrediction::reset()
+{
+    pending.clear();
+    nextSequence = 0;
+    correction = glm::dvec3(0.0);
+    lastError = 0.0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "net_protocol.h"
+#include "player_controller.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+struct World;
+
+// Step 'player' by one sent input, as both the client (predicting) and the
+// server (authoritative) do: a mode change stops the player first
+void stepNetPlayer(PlayerController& player, const World& world, const NetPlayerInput& input);
+
+// Client-side prediction of the local player on a server. Every tick's
+// input is applied at once with the same fixed-tick physics the server
+// runs, and kept until a snapshot acknowledges it. A snapshot's state is
+// where the server had the player after the acknowledged inputs; the
+// player restarts from it and the kept inputs are replayed on top, so the
+// prediction is only ever ahead of the server by the unacknowledged ticks.
+//
+// When the replay lands elsewhere than the prediction did (the server saw
+// a block the client hadn't), the player moves there at once but the
+// camera keeps being drawn at 'correction' from it, a vector that fades
+// with correctionHalfLife; jumps beyond snapDistance aren't smoothed.
+struct PlayerPrediction {
+    // The input for the next tick, quantised as the server receives it and
+    // numbered
+    NetPlayerInput record(const PlayerInput& input, PlayerMode mode, float dt);
+    // Restart 'player' from the server's 'state' after its first 'ack'
+    // inputs and replay the rest
+    void reconcile(PlayerController& player, const World& world, const NetPlayerState& state, uint32_t ack);
+    // Fade the correction over 'dt' seconds
+    void decay(float dt);
+    void reset();
+
+    // Added to the drawn eye
+    glm::dvec3 correction = glm::dvec3(0.0);
+    double correctionHalfLife = 0.1;    // Seconds
+    double snapDistance = 4.0;          // Blocks
+
+    // Inputs the server hasn't acknowledged yet
+    size_t pendingCount() const { return pending.size(); }
+    // Distance between the prediction and the replay at the last snapshot
+    double lastError = 0.0;
+
+private:
+    std::deque<NetPlayerInput> pending;
+    uint32_t nextSequence = 0;
+};
@@ -0,0 +1,136 @@
+#include "pool_allocator.h"
+
+#include <cstdlib>
+#include <new>
+
+BlockPool::BlockPool(size_t blockSize, size_t blocksPerSlab, MemoryTag memoryTag)
+    : size(blockSize < sizeof(FreeBlock) ? sizeof(FreeBlock) : (blockSize + 15) & ~(size_t)15),
+      perSlab(blocksPerSlab), tag(memoryTag)
+{
+}
+
+BlockPool::~BlockPool()
+{
+    for (void* slab : slabs)
+        free(slab);
+}
+
+void* BlockPool::allocate()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!freeList) {
+        // Carve a new slab into free blocks
+        uint8_t* slab = (uint8_t*)malloc(size * perSlab);
+        if (!slab)
+            throw std::bad_alloc();
+        slabs.push_back(slab);
+        for (size_t i = perSlab; i-- > 0; ) {
+            FreeBlock* block = (FreeBlock*)(slab + i * size);
+            block->next = freeList;
+            freeList = block;
+        }
+        reserved.fetch_add(perSlab, std::memory_order_relaxed);
+    }
+
+    FreeBlock* block = freeList;
+    freeList = block->next;
+    inUse.fetch_add(1, std::memory_order_relaxed);
+    memoryTrackAlloc(tag, size);
+    return block;
+}
+
+void BlockPool::release(void* block)
+{
+    if (!block)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    FreeBlock* freed = (FreeBlock*)block;
+    freed->next = freeList;
+    freeList = freed;
+    inUse.fetch_sub(1, std::memory_order_relaxed);
+    memoryTrackFree(tag, size);
+}
+
+// Smallest class that fits 'bytes', or -1 when it needs the heap
+static int sizeClass(size_t bytes)
+{
+    int index = 0;
+    size_t classSize = SizeClassPool::MIN_CLASS;
+    while (classSize < bytes) {
+        classSize <<= 1;
+        if (++index == SizeClassPool::CLASS_COUNT)
+            return -1;
+    }
+    return index;
+}
+
+SizeClassPool::SizeClassPool(MemoryTag memoryTag)
+    : tag(memoryTag)
+{
+    // About 64 KB per slab, at least 4 blocks
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        size_t classSize = MIN_CLASS << i;
+        size_t perSlab = 65536 / classSize;
+        classes[i] = new BlockPool(classSize, perSlab < 4 ? 4 : perSlab, tag);
+    }
+}
+
+SizeClassPool::~SizeClassPool()
+{
+    for (int i = 0; i < CLASS_COUNT; i++)
+        delete classes[i];
+}
+
+void* SizeClassPool::allocate(size_t bytes)
+{
+    int index = sizeClass(bytes);
+    if (index < 0) {
+        void* block = malloc(bytes);
+        if (!block)
+            throw std::bad_alloc();
+        memoryTrackAlloc(tag, bytes);
+        return block;
+    }
+    return classes[index]->allocate();
+}
+
+void SizeClassPool::release(void* block, size_t bytes)
+{
+    int index = sizeClass(bytes);
+    if (index < 0) {
+        free(block);
+        memoryTrackFree(tag, bytes);
+    }
+    else
+        classes[index]->release(block);
+}
+
+size_t SizeClassPool::bytesInUse() const
+{
+    size_t total = 0;
+    for (int i = 0; i < CLASS_COUNT; i++)
+        total += classes[i]->blocksInUse() * classes[i]->blockSize();
+    return total;
+}
+
+size_t SizeClassPool::bytesReserved() const
+{
+    size_t total = 0;
+    for (int i = 0; i < CLASS_COUNT; i++)
+        total += classes[i]->blocksReserved() * classes[i]->blockSize();
+    return total;
+}
+
+// Intentionally leaked so buffers freed during static destruction still find their pool
+SizeClassPool& voxelStoragePool()
+{
+    static SizeClassPool* pool = new SizeClassPool(MEMORY_VOXELS);
+    return *pool;
+}
+
+SizeClassPool& meshStagingPool()
+{
+    static SizeClassPool* pool = new SizeClassPool(MEMORY_MESHES);
+    return *pool;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "memory_tracking.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Fixed-size block pool. Blocks are carved from slabs that are never
+// returned to the heap; released blocks are recycled through a free list.
+// Blocks in use count against 'tag' in the memory accounting. Thread-safe.
+struct BlockPool {
+    BlockPool(size_t blockSize, size_t blocksPerSlab, MemoryTag tag = MEMORY_OTHER);
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+    ~BlockPool();
+
+    void* allocate();
+    void release(void* block);
+
+    size_t blockSize() const { return size; }
+    // Occupancy counters
+    size_t blocksInUse() const { return inUse.load(std::memory_order_relaxed); }
+    size_t blocksReserved() const { return reserved.load(std::memory_order_relaxed); }
+
+private:
+    struct FreeBlock { FreeBlock* next; };
+
+    size_t size;
+    size_t perSlab;
+    MemoryTag tag;
+    std::mutex mutex;
+    FreeBlock* freeList = nullptr;
+    std::vector<void*> slabs;
+    std::atomic<size_t> inUse{ 0 };
+    std::atomic<size_t> reserved{ 0 };
+};
+
+// Power-of-two size classes from 64 bytes up to 1 MB, each a BlockPool.
+// Larger requests go straight to the heap. Both count against 'tag'.
+struct SizeClassPool {
+    static const int CLASS_COUNT = 15; // 64 B << 0 .. 64 B << 14
+    static const size_t MIN_CLASS = 64;
+
+    explicit SizeClassPool(MemoryTag tag = MEMORY_OTHER);
+    ~SizeClassPool();
+
+    void* allocate(size_t bytes);
+    void release(void* block, size_t bytes);
+
+    // Bytes handed out and bytes held by the pool (classes only)
+    size_t bytesInUse() const;
+    size_t bytesReserved() const;
+
+private:
+    MemoryTag tag;
+    BlockPool* classes[CLASS_COUNT];
+};
+
+// Pools are created on first use and live for the whole program
+SizeClassPool& voxelStoragePool();  // Packed palette index words
+SizeClassPool& meshStagingPool();   // CPU-side mesh vertices awaiting upload
+
+// Standard allocator drawing from a SizeClassPool, for std::vector storage
+template <typename T, SizeClassPool& (*Pool)()>
+struct PoolAllocator {
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind { typedef PoolAllocator<U, Pool> other; };
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, Pool>&) {}
+
+    T* allocate(size_t count) { return (T*)Pool().allocate(count * sizeof(T)); }
+    void deallocate(T* block, size_t count) { Pool().release(block, count * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U, Pool>&) const { return true; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U, Pool>&) const { return false; }
+};
@@ -0,0 +1,121 @@
+#include "procedural_sky.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+// Day colours; the horizon is the old clear colour
+const glm::vec3 DAY_ZENITH(0.25f, 0.52f, 0.88f);
+const glm::vec3 DAY_HORIZON(0.53f, 0.81f, 0.92f);
+const glm::vec3 NIGHT_ZENITH(0.01f, 0.015f, 0.04f);
+const glm::vec3 NIGHT_HORIZON(0.04f, 0.05f, 0.09f);
+const glm::vec3 SUNSET_HORIZON(0.93f, 0.52f, 0.30f);
+
+static const char* skyVertexSource = R"(
+#version 330 core
+out vec2 ndc;
+
+void main()
+{
+    // On the far plane, so only pixels nothing has been drawn over pass
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    ndc = corner * 2.0 - 1.0;
+    gl_Position = vec4(ndc, 1.0, 1.0);
+}
+)";
+
+static const char* skyFragmentSource = R"(
+#version 330 core
+in vec2 ndc;
+out vec4 FragColor;
+
+uniform mat4 inverseViewProj;   // Camera-relative
+uniform vec3 sunDirection;      // Towards the sun
+uniform vec3 zenithColor;
+uniform vec3 horizonColor;
+uniform vec3 sunColor;
+uniform bool cloudsEnabled;
+uniform sampler2D clouds;       // CloudLayer's, over the same view; premultiplied
+
+void main()
+{
+    vec4 farPoint = inverseViewProj * vec4(ndc, 1.0, 1.0);
+    vec3 rd = normalize(farPoint.xyz / farPoint.w);
+
+    // Horizon to zenith, quickly at first; below the horizon a little darker
+    vec3 sky = rd.y >= 0.0 ? mix(horizonColor, zenithColor, sqrt(rd.y)) :
+        horizonColor * mix(1.0, 0.7, min(-rd.y * 4.0, 1.0));
+
+    // The sun's disc and a glow round it
+    float facing = max(dot(rd, sunDirection), 0.0);
+    sky += sunColor * (smoothstep(0.9995, 0.9998, facing) * 4.0 + pow(facing, 12.0) * 0.3);
+    if (cloudsEnabled) {
+        vec4 cloud = texture(clouds, ndc * 0.5 + 0.5);
+        sky = sky * (1.0 - cloud.a) + cloud.rgb;
+    }
+    FragColor = vec4(sky, 1.0);
+}
+)";
+
+SkyColors skyColors(const glm::vec3& sunDirection)
+{
+    // Full day from 20 degrees up, full night from 6 degrees down; sunset
+    // colours peak as the sun touches the horizon
+    float height = sunDirection.y;
+    float day = glm::smoothstep(-0.1f, 0.35f, height);
+    float sunset = std::max(1.0f - std::abs(height) / 0.25f, 0.0f);
+
+    SkyColors colors;
+    colors.zenith = glm::mix(NIGHT_ZENITH, DAY_ZENITH, day);
+    colors.horizon = glm::mix(glm::mix(NIGHT_HORIZON, DAY_HORIZON, day), SUNSET_HORIZON, sunset * 0.6f);
+    colors.sun = glm::mix(glm::vec3(1.0f, 0.45f, 0.2f), glm::vec3(1.0f, 0.95f, 0.85f), day) * glm::smoothstep(-0.05f, 0.02f, height);
+    return colors;
+}
+
+void ProceduralSky::init()
+{
+    program.create(skyVertexSource, skyFragmentSource);
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+void ProceduralSky::destroy()
+{
+    if (emptyVAO == 0)
+        return;
+    program.destroy();
+    glState().deleteVertexArrays(1, &emptyVAO);
+    emptyVAO = 0;
+}
+
+int ProceduralSky::draw(const glm::mat4& viewProj, const glm::vec3& sunDirection, const SkyColors& colors,
+    unsigned int clouds, int cloudUnit)
+{
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().depthFunc(GL_LEQUAL);
+    glState().depthMask(GL_FALSE);
+    program.use();
+    glm::mat4 inverse = glm::inverse(viewProj);
+    glUniformMatrix4fv(program.uniform("inverseViewProj"), 1, GL_FALSE, &inverse[0][0]);
+    glUniform3f(program.uniform("sunDirection"), sunDirection.x, sunDirection.y, sunDirection.z);
+    glUniform3f(program.uniform("zenithColor"), colors.zenith.r, colors.zenith.g, colors.zenith.b);
+    glUniform3f(program.uniform("horizonColor"), colors.horizon.r, colors.horizon.g, colors.horizon.b);
+    glUniform3f(program.uniform("sunColor"), colors.sun.r, colors.sun.g, colors.sun.b);
+    glUniform1i(program.uniform("cloudsEnabled"), clouds != 0 ? 1 : 0);
+    if (clouds != 0) {
+        glUniform1i(program.uniform("clouds"), cloudUnit);
+        glState().activeTexture(GL_TEXTURE0 + cloudUnit);
+        glState().bindTexture(GL_TEXTURE_2D, clouds);
+    }
+    glState().bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    if (clouds != 0) {
+        glState().bindTexture(GL_TEXTURE_2D, 0);
+        glState().activeTexture(GL_TEXTURE0);
+    }
+    glState().depthFunc(GL_LESS);
+    glState().depthMask(GL_TRUE);
+    glState().polygonMode(polygonMode);
+    return 1;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+// Colours of the sky for a sun direction: a gradient from the horizon up to
+// the zenith, darkening to night as the sun sets and reddening round the
+// horizon near sunset, and the sun's own colour
+struct SkyColors {
+    glm::vec3 zenith;
+    glm::vec3 horizon;  // Also the fog colour, so fogged terrain melts into the sky
+    glm::vec3 sun;
+};
+SkyColors skyColors(const glm::vec3& sunDirection);
+
+// The sky as one fullscreen triangle on the far plane, drawn after the
+// opaque geometry (depth tested, not written), so early depth testing
+// rejects every pixel something was drawn over. Nothing but the program is
+// kept on the GPU: no cube geometry and no textures. Clouds (CloudLayer) are
+// blended over it from their own texture when given one.
+struct ProceduralSky {
+    void init();
+    void destroy();
+
+    // Fill the uncovered pixels of the bound target, 'viewProj' being the
+    // camera-relative one the scene was drawn with and 'sunDirection'
+    // pointing towards the sun, with the 'clouds' texture (0 for none) over
+    // it through texture 'cloudUnit'. Returns the draw calls (one).
+    int draw(const glm::mat4& viewProj, const glm::vec3& sunDirection, const SkyColors& colors,
+        unsigned int clouds = 0, int cloudUnit = 0);
+
+private:
+    ShaderProgram program;
+    unsigned int emptyVAO = 0;      // Fullscreen triangle from gl_VertexID
+};
@@ -0,0 +1,184 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+// Zones kept per thread; older ones are overwritten
+const int ZONE_RING_SIZE = 16384;
+
+namespace {
+
+// Ring buffer of one thread, or of a named track. Only its owner writes to
+// it; the lock is taken per finished zone and is uncontended except while a
+// view or export reads.
+struct ThreadTrace {
+    std::mutex mutex;
+    ProfileZone ring[ZONE_RING_SIZE];
+    uint64_t written = 0;   // Zones ever recorded; the ring holds the last ZONE_RING_SIZE
+    int depth = 0;          // Owner thread only
+    int id = 0;
+    std::string name;
+    bool track = false;     // Fed by profilerRecordTrack(), not tied to a thread
+};
+
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadTrace>> threads; // Kept past thread exit so their zones stay readable
+};
+
+TraceRegistry& registry()
+{
+    static TraceRegistry instance;
+    return instance;
+}
+
+// Add a trace to the registry; the caller holds its mutex
+ThreadTrace* registerTrace(TraceRegistry& reg)
+{
+    reg.threads.emplace_back(new ThreadTrace());
+    ThreadTrace* trace = reg.threads.back().get();
+    trace->id = (int)reg.threads.size() - 1;
+    return trace;
+}
+
+void recordZone(ThreadTrace& trace, const ProfileZone& zone)
+{
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.ring[trace.written % ZONE_RING_SIZE] = zone;
+    trace.written++;
+}
+
+ThreadTrace& threadTrace()
+{
+    static thread_local ThreadTrace* trace = nullptr;
+    if (!trace) {
+        TraceRegistry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        trace = registerTrace(reg);
+        trace->name = "Thread " + std::to_string(trace->id);
+    }
+    return *trace;
+}
+
+const std::chrono::steady_clock::time_point& profilerEpoch()
+{
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return epoch;
+}
+
+// Copy zones out of one ring, oldest first
+void copyZones(ThreadTrace& trace, int64_t from, int64_t to, ProfileThreadZones& out)
+{
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    out.name = trace.name;
+    out.id = trace.id;
+    uint64_t first = trace.written > (uint64_t)ZONE_RING_SIZE ? trace.written - ZONE_RING_SIZE : 0;
+    for (uint64_t i = first; i < trace.written; i++) {
+        const ProfileZone& zone = trace.ring[i % ZONE_RING_SIZE];
+        if (zone.end >= from && zone.start <= to)
+            out.zones.push_back(zone);
+    }
+}
+
+// Zone names are literals from our own code, but keep the JSON valid regardless
+void writeJsonString(FILE* file, const std::string& text)
+{
+    fputc('"', file);
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            fputc('\\', file);
+        if ((unsigned char)c >= 0x20)
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+}
+
+ProfileScope::ProfileScope(const char* zoneName)
+    : name(zoneName)
+{
+    threadTrace().depth++;
+    start = profilerNow();
+}
+
+ProfileScope::~ProfileScope()
+{
+    int64_t end = profilerNow();
+    ThreadTrace& trace = threadTrace();
+    int depth = --trace.depth;
+    recordZone(trace, ProfileZone{ name, start, end, depth });
+}
+
+int64_t profilerNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerEpoch()).count();
+}
+
+void profilerSetThreadName(const char* threadName)
+{
+    ThreadTrace& trace = threadTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.name = threadName;
+}
+
+void profilerRecordTrack(const char* trackName, const ProfileZone& zone)
+{
+    ThreadTrace* trace = nullptr;
+    {
+        TraceRegistry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const std::unique_ptr<ThreadTrace>& candidate : reg.threads) {
+            if (candidate->track && candidate->name == trackName) {
+                trace = candidate.get();
+                break;
+            }
+        }
+        if (!trace) {
+            trace = registerTrace(reg);
+            trace->name = trackName;
+            trace->track = true;
+        }
+    }
+    recordZone(*trace, zone);
+}
+
+void profilerCollect(int64_t from, int64_t to, std::vector<ProfileThreadZones>& threads)
+{
+    TraceRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    threads.resize(reg.threads.size());
+    for (size_t t = 0; t < reg.threads.size(); t++) {
+        threads[t].zones.clear();
+        copyZones(*reg.threads[t], from, to, threads[t]);
+    }
+}
+
+bool profilerExportTrace(const char* path)
+{
+    std::vector<ProfileThreadZones> threads;
+    profilerCollect(INT64_MIN, INT64_MAX, threads);
+
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    // Complete ("X") events in microseconds, plus a name for each thread
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (const ProfileThreadZones& thread : threads) {
+        fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", thread.id);
+        writeJsonString(file, thread.name);
+        fprintf(file, "}}");
+        first = false;
+        for (const ProfileZone& zone : thread.zones) {
+            fprintf(file, ",\n{\"ph\":\"X\",\"name\":");
+            writeJsonString(file, zone.name);
+            fprintf(file, ",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                thread.id, zone.start / 1000.0, (zone.end - zone.start) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One timed region; times are nanoseconds since the profiler started
+struct ProfileZone {
+    const char* name;   // Must outlive the profiler; zones are tagged with literals
+    int64_t start;
+    int64_t end;
+    int depth;          // Nesting level within its thread
+};
+
+// Recorded zones of one thread, ordered by end time
+struct ProfileThreadZones {
+    std::string name;
+    int id;             // Registration order, stable for the thread's life
+    std::vector<ProfileZone> zones;
+};
+
+// Times its own lifetime as a zone of the calling thread. Each thread keeps
+// its most recent zones in a ring buffer of its own, so recording never
+// contends with other threads; use PROFILE_ZONE rather than naming one.
+struct ProfileScope {
+    explicit ProfileScope(const char* name);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    int64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Time the rest of the enclosing block as 'name' (a string literal)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+// Nanoseconds since the profiler started (steady clock)
+int64_t profilerNow();
+// Label the calling thread in views and traces
+void profilerSetThreadName(const char* name);
+// Record a zone measured elsewhere (on the GPU, say) on a named track. Tracks
+// show up in views and traces like threads.
+void profilerRecordTrack(const char* track, const ProfileZone& zone);
+// Copy every thread's zones that overlap [from, to] into 'threads'
+void profilerCollect(int64_t from, int64_t to, std::vector<ProfileThreadZones>& threads);
+// Write everything still held in the ring buffers as a chrome://tracing
+// (Trace Event Format) JSON file. False if the file can't be written.
+bool profilerExportTrace(const char* path);
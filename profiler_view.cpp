@@ -0,0 +1,168 @@
+#include "profiler_view.h"
+#include "gl_state.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const char* barVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;     // Pixels, origin bottom-left
+layout (location = 1) in vec4 aColor;
+
+out vec4 barColor;
+
+uniform vec2 screenSize;
+
+void main()
+{
+    gl_Position = vec4(aPos / screenSize * 2.0 - 1.0, 0.0, 1.0);
+    barColor = aColor;
+}
+)";
+
+static const char* barFragmentShaderSource = R"(
+#version 330 core
+in vec4 barColor;
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = barColor;
+}
+)";
+
+// Layout at unit scale, in pixels
+const float BAR_HEIGHT = 14.0f;
+const float BAR_GAP = 1.0f;
+const float ROW_GAP = 6.0f;
+const float LABEL_WIDTH = 90.0f;    // Thread names, left of the bars
+const float MIN_LABELLED_BAR = 70.0f;
+
+// Bar colours, picked per zone name so a zone keeps its colour across frames
+static const uint8_t ZONE_COLORS[8][4] = {
+    { 230, 124, 115, 255 }, { 247, 178, 103, 255 }, { 244, 226, 130, 255 }, { 140, 207, 126, 255 },
+    { 102, 190, 204, 255 }, { 122, 151, 230, 255 }, { 176, 132, 219, 255 }, { 214, 137, 180, 255 },
+};
+static const uint8_t PANEL_COLOR[4] = { 0, 0, 0, 150 };
+
+static const uint8_t* zoneColor(const char* name)
+{
+    // FNV-1a of the name; the same literal can have several addresses
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    return ZONE_COLORS[hash % 8];
+}
+
+void ProfilerView::init()
+{
+    program.create(barVertexShaderSource, barFragmentShaderSource);
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(BarVertex), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(BarVertex), (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glState().bindVertexArray(0);
+}
+
+void ProfilerView::destroy()
+{
+    program.destroy();
+    glState().deleteVertexArrays(1, &VAO);
+    glState().deleteBuffers(1, &VBO);
+    VAO = VBO = 0;
+    threads.clear();
+    vertices.clear();
+}
+
+void ProfilerView::addRect(float x0, float y0, float x1, float y1, const uint8_t color[4])
+{
+    BarVertex corners[4] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+    for (BarVertex& corner : corners)
+        memcpy(corner.color, color, 4);
+    const int order[6] = { 0, 1, 2, 0, 2, 3 };
+    for (int i : order)
+        vertices.push_back(corners[i]);
+}
+
+int ProfilerView::draw(int64_t from, int64_t to, float x, float top, float width, float unit,
+    TextBatch& text, float textScale, int screenWidth, int screenHeight)
+{
+    if (to <= from)
+        return 0;
+    profilerCollect(from, to, threads);
+
+    float barHeight = BAR_HEIGHT * unit;
+    float barGap = BAR_GAP * unit;
+    float rowGap = ROW_GAP * unit;
+    float barsX = x + LABEL_WIDTH * unit;
+    float barsWidth = width - LABEL_WIDTH * unit;
+    double pixelsPerNs = barsWidth / (double)(to - from);
+    const glm::vec3 LABEL_COLOR(1.0f);
+    const glm::vec3 BAR_LABEL_COLOR(0.0f);
+
+    // Panel first, sized once the rows are known
+    vertices.clear();
+    addRect(0.0f, 0.0f, 0.0f, 0.0f, PANEL_COLOR);
+
+    char heading[64];
+    snprintf(heading, sizeof(heading), "Frame %.2f ms", (to - from) / 1e6);
+    float y = top - barHeight;
+    text.add(heading, x + 4.0f * unit, y + 3.0f * unit, textScale, LABEL_COLOR);
+    y -= rowGap;
+
+    for (const ProfileThreadZones& thread : threads) {
+        if (thread.zones.empty())
+            continue;
+        int maxDepth = 0;
+        for (const ProfileZone& zone : thread.zones)
+            maxDepth = std::max(maxDepth, zone.depth);
+
+        text.add(thread.name, x + 4.0f * unit, y - barHeight + 3.0f * unit, textScale, LABEL_COLOR);
+        for (const ProfileZone& zone : thread.zones) {
+            float x0 = barsX + (float)(std::max(zone.start - from, (int64_t)0) * pixelsPerNs);
+            float x1 = barsX + (float)(std::min(zone.end - from, to - from) * pixelsPerNs);
+            x1 = std::max(x1, x0 + 1.0f);  // Keep very short zones visible
+            float y1 = y - zone.depth * (barHeight + barGap);
+            addRect(x0, y1 - barHeight, x1, y1, zoneColor(zone.name));
+            if (x1 - x0 >= MIN_LABELLED_BAR * unit)
+                text.add(zone.name, x0 + 3.0f * unit, y1 - barHeight + 3.0f * unit, textScale, BAR_LABEL_COLOR);
+        }
+        y -= (maxDepth + 1) * (barHeight + barGap) + rowGap;
+    }
+
+    // Fill in the panel behind everything
+    BarVertex* panel = vertices.data();
+    const float left = x, right = x + width, bottom = y, ceiling = top;
+    panel[0].x = left;  panel[0].y = bottom;
+    panel[1].x = right; panel[1].y = bottom;
+    panel[2].x = right; panel[2].y = ceiling;
+    panel[3].x = left;  panel[3].y = bottom;
+    panel[4].x = right; panel[4].y = ceiling;
+    panel[5].x = left;  panel[5].y = ceiling;
+
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().disable(GL_DEPTH_TEST);
+    glState().enable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    program.use();
+    glUniform2f(program.uniform("screenSize"), (float)screenWidth, (float)screenHeight);
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BarVertex), vertices.data(), GL_STREAM_DRAW);
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+
+    glState().disable(GL_BLEND);
+    glState().enable(GL_DEPTH_TEST);
+    glState().polygonMode(polygonMode);
+    return 1;
+}
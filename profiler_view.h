@@ -0,0 +1,37 @@
+#pragma once
+
+#include "profiler.h"
+#include "shader.h"
+#include "text_batch.h"
+
+#include <cstdint>
+#include <vector>
+
+// On-screen timeline of recorded profiler zones: one row per thread, nested
+// zones stacked below their parents, bar lengths proportional to time
+struct ProfilerView {
+    void init();
+    void destroy();
+
+    // Draw the zones overlapping [from, to] (profilerNow() times) in a panel
+    // whose top-left corner is at pixel (x, top), y up, 'width' pixels wide.
+    // 'unit' scales bar sizes; zone and thread names are queued on 'text' at
+    // 'textScale'. Returns the number of draw calls (0 or 1).
+    int draw(int64_t from, int64_t to, float x, float top, float width, float unit,
+        TextBatch& text, float textScale, int screenWidth, int screenHeight);
+
+private:
+    struct BarVertex {
+        float x, y;
+        uint8_t color[4];
+    };
+
+    // Two triangles covering the rect [x0, x1] x [y0, y1]
+    void addRect(float x0, float y0, float x1, float y1, const uint8_t color[4]);
+
+    ShaderProgram program;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    std::vector<ProfileThreadZones> threads;    // Reused between frames
+    std::vector<BarVertex> vertices;
+};
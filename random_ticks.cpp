@@ -0,0 +1,117 @@
+#include "random_ticks.h"
+#include "job_system.h"
+#include "profiler.h"
+#include "world.h"
+
+// Sunlight grass needs on top to spread onto dirt
+const int GRASS_MIN_SUNLIGHT = 9;
+// Sections per job system range
+const int TICK_GRAIN = 64;
+
+// Well-mixed 64 bits from a counter (splitmix64)
+static inline uint64_t mix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Light at a world block position; full sunlight where no chunk is loaded
+// and above the sky height, without reading the chunk's light
+static uint8_t lightAt(WorldCursor& cursor, const glm::ivec3& block)
+{
+    if (cursor.skyExposed(block))
+        return FULL_SUNLIGHT;
+    glm::ivec3 coord = chunkCoordOf(block);
+    const Chunk* chunk = cursor.chunk(coord);
+    if (!chunk)
+        return FULL_SUNLIGHT;
+    glm::ivec3 local = block - coord * CHUNK_SIZE;
+    return chunk->light.get(chunkIndex(local.x, local.y, local.z));
+}
+
+BlockId randomTickBlock(WorldCursor& cursor, const glm::ivec3& block, BlockId id)
+{
+    switch (id) {
+    case BLOCK_GRASS:
+        // Dies back to dirt under cover
+        return isOpaque(cursor.getBlock(block + glm::ivec3(0, 1, 0))) ? (BlockId)BLOCK_DIRT : id;
+    case BLOCK_DIRT: {
+        // Grows over from grass alongside, a block up or down, when open
+        // to enough sky
+        glm::ivec3 above = block + glm::ivec3(0, 1, 0);
+        BlockId cover = cursor.getBlock(above);
+        if (isOpaque(cover) || isWater(cover) || sunLight(lightAt(cursor, above)) < GRASS_MIN_SUNLIGHT)
+            return id;
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    if ((dx || dz) && cursor.getBlock(block + glm::ivec3(dx, dy, dz)) == BLOCK_GRASS)
+                        return BLOCK_GRASS;
+                }
+            }
+        }
+        return id;
+    }
+    default:
+        return id;
+    }
+}
+
+int RandomTicks::tick(World& world)
+{
+    PROFILE_ZONE("Random ticks");
+    tickCount++;
+
+    // Carry on round the loaded chunks from where the last tick stopped.
+    // Uniform ones are skipped at a glance, but a few times the budget of
+    // them at most, so a mostly empty world still costs a bounded scan.
+    const std::vector<Chunk*>& loaded = world.loadedChunks();
+    sections.clear();
+    size_t scan = std::min(loaded.size(), (size_t)maxSectionsPerTick * 4);
+    for (size_t i = 0; i < scan && (int)sections.size() < maxSectionsPerTick; i++) {
+        if (nextSection >= loaded.size())
+            nextSection = 0;
+        Chunk* chunk = loaded[nextSection++];
+        // Cold chunks sleep: ticking them would keep them thawed
+        if (!chunk->isUniform() && chunk->state == CHUNK_LIT && !chunk->isCold())
+            sections.push_back(chunk);
+    }
+    lastSections = (int)sections.size();
+
+    // Each section writes its own blocksPerSection slots
+    int perSection = blocksPerSection;
+    changes.resize(sections.size() * perSection);
+    auto tickRange = [&](int begin, int end) {
+        WorldCursor cursor(world);
+        for (int s = begin; s < end; s++) {
+            const Chunk& chunk = *sections[s];
+            uint64_t random = mix64(tickCount ^ packChunkCoord(chunk.coord) * 0xD6E8FEB86659FD93ull);
+            for (int k = 0; k < perSection; k++) {
+                // CHUNK_SHIFT bits per axis pick the voxel
+                random = mix64(random);
+                int x = (int)(random & CHUNK_MASK);
+                int y = (int)((random >> CHUNK_SHIFT) & CHUNK_MASK);
+                int z = (int)((random >> (2 * CHUNK_SHIFT)) & CHUNK_MASK);
+                glm::ivec3 block = chunk.coord * CHUNK_SIZE + glm::ivec3(x, y, z);
+                BlockId id = chunk.get(x, y, z);
+                BlockId after = randomTickBlock(cursor, block, id);
+                changes[s * perSection + k] = { block, after != id ? after : (BlockId)BLOCK_TYPE_COUNT };
+            }
+        }
+    };
+    if (jobs)
+        jobs->parallelFor((int)sections.size(), TICK_GRAIN, tickRange);
+    else
+        tickRange(0, (int)sections.size());
+
+    int changed = 0;
+    for (const RandomTickChange& change : changes) {
+        if (change.id == BLOCK_TYPE_COUNT)
+            continue;
+        world.setBlock(change.block, change.id, false);
+        changed++;
+    }
+    return changed;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct JobSystem;
+struct World;
+struct WorldCursor;
+
+// Block picked by a random tick that turns into another
+struct RandomTickChange {
+    glm::ivec3 block;
+    BlockId id;         // BLOCK_TYPE_COUNT when the block stays as it is
+};
+
+// Slow world rules driven by random ticks, as grass spreading over dirt
+// nearby and dying under cover: every tick, blocksPerSection random blocks
+// of each chunk section are offered a rule (randomTickBlock()).
+//
+// Uniform sections (open air, solid stone) are skipped: none of their
+// blocks can change on its own. The rest are visited in turn, at most
+// maxSectionsPerTick a tick, so the cost stays bounded however many chunks
+// are loaded; past that, each section is ticked less often. The sections of
+// a tick are spread over the job system, which only reads the world; the
+// changes are applied afterwards on the main thread as background edits.
+struct RandomTicks {
+    // Random-tick the next sections. Simulation thread, while nothing else
+    // changes the world. Returns the blocks changed.
+    int tick(World& world);
+
+    // Optional workers for the sections (not owned); without them the work
+    // runs on the calling thread
+    JobSystem* jobs = nullptr;
+    int blocksPerSection = 3;
+    int maxSectionsPerTick = 2048;
+
+    // Sections ticked by the last call
+    int lastSections = 0;
+
+private:
+    std::vector<Chunk*> sections;       // This tick's sections
+    std::vector<RandomTickChange> changes;  // blocksPerSection per section
+    size_t nextSection = 0;             // Where the next tick continues in World::loadedChunks()
+    uint64_t tickCount = 0;
+};
+
+// Block 'block' (currently 'id') becomes after a random tick, reading its
+// surroundings through 'cursor'; 'id' when nothing happens
+BlockId randomTickBlock(WorldCursor& cursor, const glm::ivec3& block, BlockId id);
@@ -0,0 +1,355 @@
+#include "raymarch_terrain.h"
+#include "chunk.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "terrain_column.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Cells across the grid, and the chunk columns of a region
+const int GRID_CELLS = RAYMARCH_REGION * RAYMARCH_REGIONS;
+const int REGION_COLUMNS = RAYMARCH_REGION * RAYMARCH_CELL / CHUNK_SIZE;
+// Mip texels that only say "something solid below"
+const uint8_t OCCUPIED = 255;
+
+static_assert(RAYMARCH_HEIGHT == RAYMARCH_REGION && (1 << (RAYMARCH_LEVELS - 1)) == RAYMARCH_REGION,
+    "the coarsest level is one texel per region, full height");
+static_assert(RAYMARCH_HEIGHT * RAYMARCH_CELL > TERRAIN_MAX_SURFACE, "the grid must reach over every surface");
+static_assert((RAYMARCH_REGION * RAYMARCH_CELL) % CHUNK_SIZE == 0, "regions are whole chunk columns");
+
+static int floorDiv(int v, int d)
+{
+    return (v >= 0 ? v : v - (d - 1)) / d;
+}
+
+static int wrap(int v, int n)
+{
+    int m = v % n;
+    return m < 0 ? m + n : m;
+}
+
+static const char* marchVertexSource = R"(
+#version 330 core
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char* marchFragmentSource = R"(
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler3D grid;         // Block type / 255 per cell; OCCUPIED above level 0
+uniform mat4 viewProj;          // Camera-relative
+uniform mat4 inverseViewProj;
+uniform vec2 viewportSize;
+uniform ivec3 eyeCell;          // World cell of the eye
+uniform vec3 eyeFraction;       // Eye position inside it, in cells
+uniform ivec2 windowMin;        // First world cell column of the grid
+uniform vec2 streamOrigin;      // Minimum corner of the streaming centre column, blocks from eyeCell's corner
+uniform float nearRadius;       // Streamed chunk columns, drawn by their meshes
+uniform float horizon;          // In cells, horizontally from the eye
+uniform vec3 sunDirection;
+
+layout (std140) uniform Palette {
+    vec4 blockColors[16];
+};
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 cameraViewProj;
+    vec4 cameraPos;
+    vec4 fog;                   // Colour, and the distance where it is complete (0 = none)
+};
+
+const int CELL = 8;
+const int GRID = 512;
+const int HEIGHT = 16;
+const int LEVELS = 5;
+const int MAX_STEPS = 256;
+
+void main()
+{
+    vec2 ndc = gl_FragCoord.xy / viewportSize * 2.0 - 1.0;
+    vec4 farPoint = inverseViewProj * vec4(ndc, 1.0, 1.0);
+    vec3 rd = normalize(farPoint.xyz / farPoint.w);
+    float horizontal = length(rd.xz);
+    if (horizontal < 1e-3)
+        discard;    // Straight up or down: sky or streamed chunks
+    vec3 ro = eyeFraction;
+    vec3 invDir = 1.0 / mix(rd, vec3(1e-6), lessThan(abs(rd), vec3(1e-6)));
+
+    // From the edge of the streamed chunks to the horizon, within the grid's height
+    float t = max(nearRadius - 1.0, 0.0) * 16.0 / CELL / horizontal;
+    float tEnd = horizon / horizontal;
+    float top = float(HEIGHT - eyeCell.y) - ro.y;
+    if (rd.y > 0.0)
+        tEnd = min(tEnd, top * invDir.y);
+    else if (top < 0.0)
+        t = max(t, top * invDir.y);
+
+    int level = LEVELS - 1;
+    int axis = 1;       // Of the last cell boundary crossed
+    uint material = 0u;
+    for (int i = 0; i < MAX_STEPS && material == 0u; i++) {
+        if (t >= tEnd)
+            discard;
+        vec3 p = ro + rd * t;
+        ivec3 cell = eyeCell + ivec3(floor(p));
+        ivec2 local = cell.xz - windowMin;
+        if (any(lessThan(local, ivec2(0))) || any(greaterThanEqual(local, ivec2(GRID))))
+            discard;
+        ivec3 node = cell >> level;
+
+        float value = 1.0;  // Below the grid is solid
+        if (cell.y >= HEIGHT)
+            value = 0.0;
+        else if (cell.y >= 0) {
+            int mask = (GRID >> level) - 1;
+            value = texelFetch(grid, ivec3(node.x & mask, node.y, node.z & mask), level).r;
+        }
+        if (value > 0.0 && level > 0) {
+            level--;
+            continue;
+        }
+        if (value > 0.0) {
+            // Columns of streamed chunks are left to them
+            vec2 column = floor((p.xz * float(CELL) - streamOrigin) / 16.0);
+            if (dot(column, column) > nearRadius * nearRadius) {
+                material = cell.y < 0 ? 1u : uint(value * 255.0 + 0.5);
+                break;
+            }
+        }
+
+        // Empty: step out of the node, and up a level when that also left
+        // the node's parent. Sides are picked by invDir's sign, which is
+        // never zero, so axis-aligned rays still advance.
+        vec3 lo = vec3((node << level) - eyeCell);
+        vec3 hi = lo + float(1 << level);
+        vec3 exits = (mix(lo, hi, greaterThan(invDir, vec3(0.0))) - ro) * invDir;
+        float tExit = min(min(exits.x, exits.y), exits.z);
+        axis = tExit == exits.x ? 0 : (tExit == exits.y ? 1 : 2);
+        t = max(tExit, t) + 1e-4;
+        if (level < LEVELS - 1 && any(notEqual((eyeCell + ivec3(floor(ro + rd * t))) >> (level + 1), node >> 1)))
+            level++;
+    }
+    if (material == 0u)
+        discard;    // Out of steps
+
+    vec3 normal = vec3(0.0);
+    normal[axis] = rd[axis] > 0.0 ? -1.0 : 1.0;
+    vec3 relative = rd * t * float(CELL);
+    vec4 clip = viewProj * vec4(relative, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    float light = 0.6 + 0.4 * max(dot(normal, sunDirection), 0.0);
+    float haze = fog.w > 0.0 ? smoothstep(0.6 * fog.w, fog.w, t * float(CELL)) : 0.0;
+    FragColor = vec4(mix(blockColors[material].rgb * light, fog.rgb, haze), 1.0);
+}
+)";
+
+void RaymarchTerrain::init(unsigned int paletteBinding, unsigned int cameraBinding)
+{
+    program.create(marchVertexSource, marchFragmentSource);
+    program.bindBlock("Palette", paletteBinding);
+    program.bindBlock("Camera", cameraBinding);
+    glGenVertexArrays(1, &emptyVAO);
+
+    // Every level starts out air
+    glGenTextures(1, &texture);
+    glState().bindTexture(GL_TEXTURE_3D, texture);
+    std::vector<uint8_t> zeros((size_t)GRID_CELLS * RAYMARCH_HEIGHT * GRID_CELLS, 0);
+    bytes = 0;
+    for (int level = 0; level < RAYMARCH_LEVELS; level++) {
+        int side = GRID_CELLS >> level;
+        int height = RAYMARCH_HEIGHT >> level;
+        glTexImage3D(GL_TEXTURE_3D, level, GL_R8, side, height, side, 0, GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+        bytes += (size_t)side * height * side;
+    }
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, RAYMARCH_LEVELS - 1);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    for (auto& row : slots)
+        for (Slot& s : row)
+            s = Slot{ glm::ivec2(INT32_MIN), false };
+    window = glm::ivec2(INT32_MIN);
+    pending = 0;
+}
+
+void RaymarchTerrain::destroy()
+{
+    if (texture == 0)
+        return;
+    program.destroy();
+    glState().deleteVertexArrays(1, &emptyVAO);
+    glDeleteTextures(1, &texture);
+    texture = 0;
+    emptyVAO = 0;
+}
+
+int RaymarchTerrain::maxHorizonColumns()
+{
+    // The eye is somewhere in the middle region of the window
+    return (RAYMARCH_REGIONS / 2 - 1) * REGION_COLUMNS;
+}
+
+// Upload one region's levels, RAYMARCH_REGION >> level texels a side each,
+// one after another in 'levels'
+static void uploadRegion(int slotX, int slotZ, const uint8_t* levels)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < RAYMARCH_LEVELS; level++) {
+        int side = RAYMARCH_REGION >> level;
+        glTexSubImage3D(GL_TEXTURE_3D, level, slotX * side, 0, slotZ * side, side, side, side, GL_RED, GL_UNSIGNED_BYTE, levels);
+        levels += side * side * side;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// Texels of every level of one region
+static size_t regionTexels()
+{
+    size_t total = 0;
+    for (int level = 0; level < RAYMARCH_LEVELS; level++) {
+        size_t side = RAYMARCH_REGION >> level;
+        total += side * side * side;
+    }
+    return total;
+}
+
+void RaymarchTerrain::buildRegion(const glm::ivec2& region, int slotX, int slotZ)
+{
+    const int N = RAYMARCH_REGION;
+    scratch.assign(regionTexels(), 0);
+    uint8_t* cells = scratch.data();    // [z][y][x], x fastest as GL reads it
+
+    // One surface sample at the middle of each cell column
+    glm::ivec2 origin = region * (N * RAYMARCH_CELL) + glm::ivec2(RAYMARCH_CELL / 2);
+    for (int x = 0; x < N; x++) {
+        int16_t surface[N];
+        TerrainBiome biome[N];
+        sampleTerrainSurface(glm::ivec2(origin.x + x * RAYMARCH_CELL, origin.y), RAYMARCH_CELL, N, seed, surface, biome);
+        for (int z = 0; z < N; z++) {
+            // Cells at least half under the surface are solid, the top one its surface block
+            int topCell = (int)std::floor((surface[z] + 1 - RAYMARCH_CELL / 2) / (float)RAYMARCH_CELL);
+            for (int y = 0; y <= std::min(topCell, RAYMARCH_HEIGHT - 1); y++) {
+                BlockId block = y < topCell || biome[z] == BIOME_ROCKY ? BLOCK_STONE : BLOCK_GRASS;
+                cells[(z * N + y) * N + x] = block;
+            }
+        }
+    }
+
+    // Each coarser level marks where anything below it is solid
+    uint8_t* finer = cells;
+    for (int level = 1; level < RAYMARCH_LEVELS; level++) {
+        int fine = N >> (level - 1);
+        int side = N >> level;
+        uint8_t* coarse = finer + fine * fine * fine;
+        for (int z = 0; z < side; z++)
+            for (int y = 0; y < side; y++)
+                for (int x = 0; x < side; x++) {
+                    bool any = false;
+                    for (int c = 0; c < 8; c++)
+                        any |= finer[((z * 2 + (c >> 2)) * fine + y * 2 + ((c >> 1) & 1)) * fine + x * 2 + (c & 1)] != 0;
+                    coarse[(z * side + y) * side + x] = any ? OCCUPIED : 0;
+                }
+        finer = coarse;
+    }
+
+    glState().bindTexture(GL_TEXTURE_3D, texture);
+    uploadRegion(slotX, slotZ, cells);
+}
+
+void RaymarchTerrain::clearSlot(int slotX, int slotZ)
+{
+    scratch.assign(regionTexels(), 0);
+    glState().bindTexture(GL_TEXTURE_3D, texture);
+    uploadRegion(slotX, slotZ, scratch.data());
+}
+
+void RaymarchTerrain::update(const glm::ivec2& eyeColumn)
+{
+    PROFILE_ZONE("Ray march grid");
+    glm::ivec2 eyeRegion(floorDiv(eyeColumn.x, REGION_COLUMNS), floorDiv(eyeColumn.y, REGION_COLUMNS));
+    window = eyeRegion - glm::ivec2(RAYMARCH_REGIONS / 2);
+
+    // Slots whose region left the window are cleared at once, so nothing
+    // shows in the wrong place; the new regions are built nearest first
+    struct Missing {
+        int slotX, slotZ;
+        int distance;
+    };
+    std::vector<Missing> missing;
+    for (int rx = 0; rx < RAYMARCH_REGIONS; rx++) {
+        for (int rz = 0; rz < RAYMARCH_REGIONS; rz++) {
+            glm::ivec2 region = window + glm::ivec2(rx, rz);
+            int slotX = wrap(region.x, RAYMARCH_REGIONS);
+            int slotZ = wrap(region.y, RAYMARCH_REGIONS);
+            Slot& s = slots[slotX][slotZ];
+            if (s.region == region && s.built)
+                continue;
+            if (s.region != region && s.built)
+                clearSlot(slotX, slotZ);
+            s.region = region;
+            s.built = false;
+            glm::ivec2 d = glm::abs(region - eyeRegion);
+            missing.push_back(Missing{ slotX, slotZ, std::max(d.x, d.y) });
+        }
+    }
+    int build = std::min((int)missing.size(), regionsPerFrame);
+    std::partial_sort(missing.begin(), missing.begin() + build, missing.end(),
+        [](const Missing& a, const Missing& b) { return a.distance < b.distance; });
+    for (int i = 0; i < build; i++) {
+        Slot& s = slots[missing[i].slotX][missing[i].slotZ];
+        buildRegion(s.region, missing[i].slotX, missing[i].slotZ);
+        s.built = true;
+    }
+    pending = (int)missing.size() - build;
+}
+
+int RaymarchTerrain::draw(const glm::mat4& viewProj, const glm::dvec3& eye, const glm::ivec2& streamCenter, int nearColumns,
+    int horizonColumns, const glm::vec3& sunDirection, int width, int height, int textureUnit)
+{
+    if (window.x == INT32_MIN)
+        return 0;
+
+    // The eye split into a whole cell and the rest, so large coordinates
+    // stay exact
+    glm::dvec3 eyeInCells = eye / (double)RAYMARCH_CELL;
+    glm::ivec3 eyeCell(glm::floor(eyeInCells));
+    glm::vec3 eyeFraction(eyeInCells - glm::dvec3(eyeCell));
+    glm::ivec2 cellCorner(eyeCell.x * RAYMARCH_CELL, eyeCell.z * RAYMARCH_CELL);
+    glm::vec2 streamOrigin(streamCenter * CHUNK_SIZE - cellCorner);
+    int horizon = std::min(horizonColumns, maxHorizonColumns());
+
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    program.use();
+    glUniformMatrix4fv(program.uniform("viewProj"), 1, GL_FALSE, &viewProj[0][0]);
+    glm::mat4 inverse = glm::inverse(viewProj);
+    glUniformMatrix4fv(program.uniform("inverseViewProj"), 1, GL_FALSE, &inverse[0][0]);
+    glUniform2f(program.uniform("viewportSize"), (float)width, (float)height);
+    glUniform3i(program.uniform("eyeCell"), eyeCell.x, eyeCell.y, eyeCell.z);
+    glUniform3f(program.uniform("eyeFraction"), eyeFraction.x, eyeFraction.y, eyeFraction.z);
+    glUniform2i(program.uniform("windowMin"), window.x * RAYMARCH_REGION, window.y * RAYMARCH_REGION);
+    glUniform2f(program.uniform("streamOrigin"), streamOrigin.x, streamOrigin.y);
+    glUniform1f(program.uniform("nearRadius"), (float)nearColumns);
+    glUniform1f(program.uniform("horizon"), (float)(horizon * CHUNK_SIZE / RAYMARCH_CELL));
+    glUniform3f(program.uniform("sunDirection"), sunDirection.x, sunDirection.y, sunDirection.z);
+    glUniform1i(program.uniform("grid"), textureUnit);
+    glState().activeTexture(GL_TEXTURE0 + textureUnit);
+    glState().bindTexture(GL_TEXTURE_3D, texture);
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState().polygonMode(polygonMode);
+    return 1;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Far-field terrain ray marched through a coarse voxel grid instead of
+// drawn as LOD meshes: one fullscreen pass after the opaque chunks, depth
+// tested against them and writing the depth of what it hits, so the near
+// field still covers it. Memory follows the grid, not the triangles.
+//
+// The grid is a 3D texture of RAYMARCH_CELL-block cells (the block type of
+// each, air or the surface's) around the camera, addressed toroidally so a
+// recentre only rebuilds the regions that came into range. Its mip levels
+// hold whether anything below is solid, which lets rays skip empty space
+// a level at a time. Regions are built on the render thread straight from
+// the terrain's height noise (sampleTerrainSurface()), a handful a frame;
+// caves, trees and player edits are too small to show at this distance.
+//
+// Rays start where they leave the streamed chunks and stop at the horizon,
+// which the grid's extent caps at maxHorizonColumns().
+const int RAYMARCH_CELL = 8;            // Blocks per cell edge
+const int RAYMARCH_REGION = 16;         // Cells per region edge, the unit of rebuilding (and of the coarsest mip)
+const int RAYMARCH_REGIONS = 32;        // Regions across the grid
+const int RAYMARCH_HEIGHT = 16;         // Cells up, from y = 0 (above the highest surface)
+const int RAYMARCH_LEVELS = 5;          // Mip levels: down to a cell per region
+
+struct RaymarchTerrain {
+    uint32_t seed = 0;
+    int regionsPerFrame = 24;   // Rebuilt per update(), nearest first
+
+    // Build the program (reading block colours from the Palette block at
+    // 'paletteBinding' and the fog from the Camera block at 'cameraBinding')
+    // and the empty grid
+    void init(unsigned int paletteBinding, unsigned int cameraBinding);
+    void destroy();
+
+    // Follow the camera: rebuild (or clear) regions no longer matching the
+    // grid window around 'eyeColumn', chunk column of the eye
+    void update(const glm::ivec2& eyeColumn);
+    // March every pixel of the bound scene target ('width' x 'height') not
+    // already covered, from the 'nearColumns' streamed around
+    // 'streamCenter' out to 'horizonColumns' around the eye, sampling the
+    // grid through 'textureUnit'. 'viewProj' is the camera-relative one the
+    // scene was drawn with. Returns the draw calls (one).
+    int draw(const glm::mat4& viewProj, const glm::dvec3& eye, const glm::ivec2& streamCenter, int nearColumns,
+        int horizonColumns, const glm::vec3& sunDirection, int width, int height, int textureUnit);
+
+    // Horizon radius the grid around the camera always covers
+    static int maxHorizonColumns();
+    // Regions of the window still to build
+    int pendingRegions() const { return pending; }
+    // GPU memory of the grid, every level
+    size_t textureBytes() const { return bytes; }
+
+private:
+    // Fill the slot with a region's cells and levels, or with air
+    void buildRegion(const glm::ivec2& region, int slotX, int slotZ);
+    void clearSlot(int slotX, int slotZ);
+
+    ShaderProgram program;
+    unsigned int texture = 0;
+    unsigned int emptyVAO = 0;      // Fullscreen triangle from gl_VertexID
+    glm::ivec2 window = glm::ivec2(INT32_MIN);  // First region of the grid, in world regions
+    // World region each toroidal slot is assigned, [x][z], and whether its texels hold it yet
+    struct Slot {
+        glm::ivec2 region;
+        bool built = false;
+    };
+    Slot slots[RAYMARCH_REGIONS][RAYMARCH_REGIONS];
+    std::vector<uint8_t> scratch;   // One region's levels
+    int pending = 0;
+    size_t bytes = 0;
+};
@@ -0,0 +1,571 @@
+#include "region_file.h"
+#include "lz4.h"
+#include "mapped_file.h"
+#include "profiler.h"
+#include "world.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <direct.h>
+#include <sys/stat.h>
+#else
+#include <sys/stat.h>
+#endif
+
+const uint32_t REGION_MAGIC = 0x47525856; // "VXRG"
+// Layout of the file. Version 1 files are read as they are; their header
+// is bumped at the first save, as records are then tagged with a format.
+const uint32_t REGION_VERSION = 2;
+const uint32_t REGION_UNTAGGED_VERSION = 1;
+// Format of a record's payload, in the top byte of RecordHeader::slot. A
+// record without one (written before formats were tagged) is format 1.
+const uint32_t CHUNK_FORMAT_UNTAGGED = 1;
+const uint32_t CHUNK_FORMAT = 2;        // Written by save()
+const int FORMAT_SHIFT = 24;
+const int REGION_SLOTS = REGION_SIZE * REGION_SIZE * WORLD_HEIGHT_CHUNKS;
+// Offsets are 32-bit; a region never gets near this (a full one of
+// unique, incompressible chunks is ~70 MB)
+const uint64_t MAX_REGION_BYTES = 0x7FFFFFFF;
+// Dead bytes a region may hold before it is considered for compaction
+const uint64_t COMPACT_MIN_DEAD_BYTES = 1024 * 1024;
+// Largest payload: 8-bit indices and a full palette, then light per voxel
+const size_t MAX_PAYLOAD_SIZE = 2 + 256 + CHUNK_VOLUME + 1 + CHUNK_VOLUME;
+// Set in RegionEntry::size when the record's payload carries light
+const uint32_t ENTRY_BAKED_LIGHT = 0x80000000u;
+
+struct RegionHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seed;
+    uint32_t reserved;
+};
+// Where a slot's record is; offset 0 means never saved
+struct RegionEntry {
+    uint32_t offset;
+    uint32_t size;      // Compressed bytes after the record header; top bit ENTRY_BAKED_LIGHT
+};
+// Precedes each record's compressed payload
+struct RecordHeader {
+    uint32_t slot;          // Chunk format << FORMAT_SHIFT | slot
+    uint32_t rawSize;
+};
+static_assert(REGION_SLOTS <= (1 << FORMAT_SHIFT), "slots must leave the format byte free");
+
+const uint64_t TABLE_OFFSET = sizeof(RegionHeader);
+const uint64_t DATA_OFFSET = TABLE_OFFSET + REGION_SLOTS * sizeof(RegionEntry);
+
+void encodeChunkPayload(const PalettedBlocks& blocks, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.push_back((uint8_t)blocks.bitsPerIndex);
+    out.push_back((uint8_t)(blocks.palette.size() - 1));
+    out.insert(out.end(), blocks.palette.begin(), blocks.palette.end());
+
+    size_t wordBytes = blocks.words.size() * sizeof(uint64_t);
+    size_t start = out.size();
+    out.resize(start + wordBytes);
+    if (wordBytes)
+        memcpy(out.data() + start, blocks.words.data(), wordBytes);
+}
+
+bool decodeChunkPayload(const uint8_t* data, size_t size, PalettedBlocks& out)
+{
+    if (size < 2)
+        return false;
+    int bits = data[0];
+    size_t paletteSize = (size_t)data[1] + 1;
+    if (bits != 0 && bits != 1 && bits != 2 && bits != 4 && bits != 8)
+        return false;
+    if (paletteSize > ((size_t)1 << bits))
+        return false;
+    size_t wordCount = (size_t)CHUNK_VOLUME * bits / 64;
+    if (size != 2 + paletteSize + wordCount * sizeof(uint64_t))
+        return false;
+
+    const uint8_t* palette = data + 2;
+    for (size_t i = 0; i < paletteSize; i++) {
+        if (palette[i] >= BLOCK_TYPE_COUNT)
+            return false;
+    }
+
+    // Indices past a partly used palette would read garbage; checked where
+    // they lie, so 'out' is only touched by a payload that decodes
+    const uint8_t* words = palette + paletteSize;
+    if (bits != 0 && paletteSize < ((size_t)1 << bits)) {
+        uint64_t mask = (1ull << bits) - 1;
+        for (size_t w = 0; w < wordCount; w++) {
+            uint64_t word;
+            memcpy(&word, words + w * sizeof(uint64_t), sizeof(uint64_t));
+            for (int bit = 0; bit < 64; bit += bits) {
+                if (((word >> bit) & mask) >= paletteSize)
+                    return false;
+            }
+        }
+    }
+
+    // Straight into the storage, keeping its memory
+    out.palette.assign(palette, palette + paletteSize);
+    out.bitsPerIndex = bits;
+    out.words.resize(wordCount);
+    if (wordCount)
+        memcpy(out.words.data(), words, wordCount * sizeof(uint64_t));
+    else
+        out.words.shrink_to_fit();
+    return true;
+}
+
+// Bytes of the block payload at the start of 'data' (0 if it's cut short),
+// so the light that may follow can be told apart
+static size_t blockPayloadSize(const uint8_t* data, size_t size)
+{
+    if (size < 2)
+        return 0;
+    size_t bytes = 2 + ((size_t)data[1] + 1) + (size_t)CHUNK_VOLUME * data[0] / 64 * sizeof(uint64_t);
+    return bytes <= size ? bytes : 0;
+}
+
+// Baked light after the block payload:
+//   u8  0, then u8 level (uniform) or 1, then CHUNK_VOLUME levels
+static void encodeLightPayload(const ChunkLight& light, std::vector<uint8_t>& out)
+{
+    out.push_back(light.isUniform() ? 0 : 1);
+    if (light.isUniform())
+        out.push_back(light.uniform);
+    else
+        out.insert(out.end(), light.levels.begin(), light.levels.end());
+}
+
+static bool decodeLightPayload(const uint8_t* data, size_t size, ChunkLight& out)
+{
+    if (size == 2 && data[0] == 0) {
+        out.levels.clear();
+        out.uniform = data[1];
+        return true;
+    }
+    if (size == 1 + (size_t)CHUNK_VOLUME && data[0] == 1) {
+        out.encode(data + 1);
+        return true;
+    }
+    return false;
+}
+
+// Steps bringing a raw record payload of an older format up to
+// CHUNK_FORMAT, one format at a time: PAYLOAD_UPGRADES[f] turns format f
+// into f + 1 in place, false if the payload doesn't fit it. Null steps
+// changed nothing the payload holds. They run in load(), on whichever
+// thread loads (the generator's workers), so old worlds are upgraded as
+// they stream in, and the result goes back to disk only when the chunk is
+// next saved.
+typedef bool (*PayloadUpgrade)(std::vector<uint8_t>& raw);
+static const PayloadUpgrade PAYLOAD_UPGRADES[CHUNK_FORMAT] = {
+    nullptr,    // No format 0
+    nullptr,    // 1 -> 2: the format moved into the record header
+};
+
+// Bring 'raw' (format 'format') up to CHUNK_FORMAT. 'changed' says whether
+// any step rewrote it.
+static bool upgradePayload(uint32_t format, std::vector<uint8_t>& raw, bool& changed)
+{
+    changed = false;
+    if (format == 0 || format > CHUNK_FORMAT)
+        return false;
+    for (; format < CHUNK_FORMAT; format++) {
+        if (!PAYLOAD_UPGRADES[format])
+            continue;
+        if (!PAYLOAD_UPGRADES[format](raw) || raw.size() > MAX_PAYLOAD_SIZE)
+            return false;
+        changed = true;
+    }
+    return true;
+}
+
+// One open region: FILE* for appends and table updates, a mapping for reads
+struct RegionFile {
+    std::mutex mutex;       // Held by load() and save() around the calls below
+    std::string path;
+    FILE* file = nullptr;
+    MappedFile view;        // Remapped when a record lies past its end
+    std::vector<RegionEntry> table;
+    uint64_t fileSize = 0;
+    uint64_t liveBytes = 0; // Header, table and the records the table points at
+
+    // Open the region at 'path'. A missing file is created when 'create' is
+    // set; one from another seed (or unreadable) is started over.
+    bool open(const std::string& regionPath, uint32_t seed, bool create);
+    void close();
+    // The blocks, and the light when the record has it ('hasLight' says
+    // which), upgraded to CHUNK_FORMAT ('upgraded' when that changed them)
+    bool read(int slot, PalettedBlocks& out, ChunkLight& light, bool& hasLight, bool& upgraded);
+    bool write(int slot, const uint8_t* compressed, size_t size, size_t rawSize, bool hasLight);
+
+    ~RegionFile() { close(); }
+
+private:
+    bool readTable(uint32_t seed);
+    bool reset(uint32_t seed);
+    // Mark the file as holding tagged records, before the first is written
+    bool tagFormats();
+    // Copy the live records to a new file that replaces this one
+    bool compact();
+    uint32_t fileSeed = 0;
+    uint32_t fileVersion = REGION_VERSION;
+};
+
+static uint32_t compressedSize(const RegionEntry& entry)
+{
+    return entry.size & ~ENTRY_BAKED_LIGHT;
+}
+
+static uint64_t recordBytes(const RegionEntry& entry)
+{
+    return sizeof(RecordHeader) + (uint64_t)compressedSize(entry);
+}
+
+bool RegionFile::open(const std::string& regionPath, uint32_t seed, bool create)
+{
+    path = regionPath;
+    fileSeed = seed;
+    file = fopen(path.c_str(), "r+b");
+    if (file && readTable(seed))
+        return true;
+    if (!file && !create)
+        return false;
+    return reset(seed);
+}
+
+bool RegionFile::readTable(uint32_t seed)
+{
+    RegionHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1)
+        return false;
+    if (header.magic != REGION_MAGIC || header.version < REGION_UNTAGGED_VERSION || header.version > REGION_VERSION ||
+        header.seed != seed)
+        return false;
+    fileVersion = header.version;
+
+    table.resize(REGION_SLOTS);
+    if (fread(table.data(), sizeof(RegionEntry), REGION_SLOTS, file) != (size_t)REGION_SLOTS)
+        return false;
+    fseek(file, 0, SEEK_END);
+    fileSize = (uint64_t)ftell(file);
+
+    // Entries past the end are from a save cut short; drop them
+    liveBytes = DATA_OFFSET;
+    for (RegionEntry& entry : table) {
+        if (entry.offset == 0)
+            continue;
+        if (entry.offset < DATA_OFFSET || entry.offset + recordBytes(entry) > fileSize)
+            entry = RegionEntry{ 0, 0 };
+        else
+            liveBytes += recordBytes(entry);
+    }
+    return true;
+}
+
+bool RegionFile::reset(uint32_t seed)
+{
+    if (file)
+        fclose(file);
+    view.unmap();
+    file = fopen(path.c_str(), "w+b");
+    if (!file)
+        return false;
+
+    RegionHeader header = { REGION_MAGIC, REGION_VERSION, seed, 0 };
+    table.assign(REGION_SLOTS, RegionEntry{ 0, 0 });
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+        || fwrite(table.data(), sizeof(RegionEntry), REGION_SLOTS, file) != (size_t)REGION_SLOTS) {
+        close();
+        return false;
+    }
+    fflush(file);
+    fileSize = liveBytes = DATA_OFFSET;
+    fileVersion = REGION_VERSION;
+    return true;
+}
+
+bool RegionFile::tagFormats()
+{
+    RegionHeader header = { REGION_MAGIC, REGION_VERSION, fileSeed, 0 };
+    fseek(file, 0, SEEK_SET);
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        return false;
+    fflush(file);
+    fileVersion = REGION_VERSION;
+    return true;
+}
+
+void RegionFile::close()
+{
+    view.unmap();
+    if (file)
+        fclose(file);
+    file = nullptr;
+}
+
+bool RegionFile::read(int slot, PalettedBlocks& out, ChunkLight& light, bool& hasLight, bool& upgraded)
+{
+    const RegionEntry& entry = table[slot];
+    if (entry.offset == 0)
+        return false;
+
+    uint64_t end = entry.offset + recordBytes(entry);
+    if (end > view.size && (!view.map(path) || end > view.size))
+        return false;
+
+    RecordHeader header;
+    memcpy(&header, view.data + entry.offset, sizeof(header));
+    uint32_t format = header.slot >> FORMAT_SHIFT;
+    if (format == 0)
+        format = CHUNK_FORMAT_UNTAGGED;
+    if ((header.slot & ((1u << FORMAT_SHIFT) - 1)) != (uint32_t)slot || header.rawSize > MAX_PAYLOAD_SIZE)
+        return false;
+
+    uint8_t buffer[MAX_PAYLOAD_SIZE];
+    const uint8_t* raw = buffer;
+    size_t rawSize = header.rawSize;
+    if (!lz4Decompress(view.data + entry.offset + sizeof(header), compressedSize(entry), buffer, rawSize))
+        return false;
+    // Older formats go through the upgrade steps first
+    std::vector<uint8_t> current;
+    upgraded = false;
+    if (format != CHUNK_FORMAT) {
+        current.assign(buffer, buffer + rawSize);
+        if (!upgradePayload(format, current, upgraded))
+            return false;
+        raw = current.data();
+        rawSize = current.size();
+    }
+
+    size_t blockBytes = blockPayloadSize(raw, rawSize);
+    hasLight = blockBytes != 0 && blockBytes < rawSize;
+    if (hasLight && !decodeLightPayload(raw + blockBytes, rawSize - blockBytes, light))
+        return false;
+    return decodeChunkPayload(raw, hasLight ? blockBytes : rawSize, out);
+}
+
+bool RegionFile::write(int slot, const uint8_t* compressed, size_t size, size_t rawSize, bool hasLight)
+{
+    if (!file || (fileVersion != REGION_VERSION && !tagFormats()))
+        return false;
+    uint64_t bytes = sizeof(RecordHeader) + (uint64_t)size;
+    if (fileSize + bytes > MAX_REGION_BYTES && (!compact() || fileSize + bytes > MAX_REGION_BYTES))
+        return false;
+
+    // Record first, then the table entry: a save cut short leaves the old copy in place
+    RecordHeader header = { CHUNK_FORMAT << FORMAT_SHIFT | (uint32_t)slot, (uint32_t)rawSize };
+    RegionEntry entry = { (uint32_t)fileSize, (uint32_t)size | (hasLight ? ENTRY_BAKED_LIGHT : 0) };
+    fseek(file, (long)fileSize, SEEK_SET);
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(compressed, 1, size, file) != size)
+        return false;
+    fflush(file);
+    fseek(file, (long)(TABLE_OFFSET + slot * sizeof(RegionEntry)), SEEK_SET);
+    if (fwrite(&entry, sizeof(entry), 1, file) != 1)
+        return false;
+    fflush(file);
+
+    if (table[slot].offset != 0)
+        liveBytes -= recordBytes(table[slot]);
+    table[slot] = entry;
+    liveBytes += bytes;
+    fileSize += bytes;
+
+    uint64_t dead = fileSize - liveBytes;
+    if (dead > COMPACT_MIN_DEAD_BYTES && dead * 2 > fileSize)
+        compact();
+    return true;
+}
+
+bool RegionFile::compact()
+{
+    PROFILE_ZONE("Compact region");
+    if (!view.map(path) || view.size < fileSize)
+        return false;
+
+    std::string tempPath = path + ".tmp";
+    FILE* out = fopen(tempPath.c_str(), "wb");
+    if (!out)
+        return false;
+
+    // Records are packed in slot order after a table written last. They are
+    // copied as they are; untagged ones still read as the first format.
+    std::vector<RegionEntry> packed(REGION_SLOTS, RegionEntry{ 0, 0 });
+    uint64_t offset = DATA_OFFSET;
+    bool ok = fseek(out, (long)DATA_OFFSET, SEEK_SET) == 0;
+    for (int slot = 0; ok && slot < REGION_SLOTS; slot++) {
+        const RegionEntry& entry = table[slot];
+        if (entry.offset == 0)
+            continue;
+        uint64_t bytes = recordBytes(entry);
+        ok = fwrite(view.data + entry.offset, 1, (size_t)bytes, out) == bytes;
+        packed[slot] = RegionEntry{ (uint32_t)offset, entry.size };
+        offset += bytes;
+    }
+    RegionHeader header = { REGION_MAGIC, REGION_VERSION, fileSeed, 0 };
+    ok = ok && fseek(out, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(packed.data(), sizeof(RegionEntry), REGION_SLOTS, out) == (size_t)REGION_SLOTS;
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    // The mapping and handle must go before the file can be replaced on Windows
+    close();
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str()) != 0)
+        return false;
+    file = fopen(path.c_str(), "r+b");
+    if (!file)
+        return false;
+    table.swap(packed);
+    fileSize = liveBytes = offset;
+    fileVersion = REGION_VERSION;
+    return true;
+}
+
+static void makeDirectory(const std::string& path)
+{
+#ifdef _MSC_VER
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+static bool isDirectory(const std::string& path)
+{
+#ifdef _MSC_VER
+    struct _stat info;
+    return _stat(path.c_str(), &info) == 0 && (info.st_mode & _S_IFDIR);
+#else
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+// Slot of a chunk within its region's table
+static int regionSlot(const glm::ivec3& coord)
+{
+    int x = coord.x - floorDivRegion(coord.x) * REGION_SIZE;
+    int z = coord.z - floorDivRegion(coord.z) * REGION_SIZE;
+    return (x * REGION_SIZE + z) * WORLD_HEIGHT_CHUNKS + coord.y;
+}
+
+RegionStore::RegionStore() {}
+
+RegionStore::~RegionStore()
+{
+    close();
+}
+
+bool RegionStore::open(const std::string& directory, uint32_t worldSeed)
+{
+    close();
+    makeDirectory(directory);
+    if (!isDirectory(directory))
+        return false;
+    root = directory;
+    seed = worldSeed;
+    loads = 0;
+    saves = 0;
+    upgrades = 0;
+    return true;
+}
+
+void RegionStore::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    regions.clear();
+    root.clear();
+}
+
+RegionFile* RegionStore::regionOf(const glm::ivec3& coord, bool create)
+{
+    int regionX = floorDivRegion(coord.x);
+    int regionZ = floorDivRegion(coord.z);
+    uint64_t key = packChunkCoord(glm::ivec3(regionX, 0, regionZ));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // A null entry remembers a region without a file, so loads don't retry fopen
+    auto found = regions.find(key);
+    if (found != regions.end() && (found->second || !create))
+        return found->second.get();
+
+    std::unique_ptr<RegionFile> opened(new RegionFile());
+    std::string path = root + "/r." + std::to_string(regionX) + "." + std::to_string(regionZ) + ".region";
+    std::unique_ptr<RegionFile>& region = regions[key];
+    region = opened->open(path, seed, create) ? std::move(opened) : nullptr;
+    return region.get();
+}
+
+bool RegionStore::load(const glm::ivec3& coord, Chunk& chunk)
+{
+    if (coord.y < 0 || coord.y >= WORLD_HEIGHT_CHUNKS || !isOpen())
+        return false;
+    RegionFile* region = regionOf(coord, false);
+    if (!region)
+        return false;
+
+    PROFILE_ZONE("Load chunk");
+    PalettedBlocks blocks;
+    ChunkLight light;
+    bool hasLight = false;
+    bool upgraded = false;
+    {
+        std::lock_guard<std::mutex> lock(region->mutex);
+        if (!region->read(regionSlot(coord), blocks, light, hasLight, upgraded))
+            return false;
+    }
+    chunk.coord = coord;
+    chunk.blocks = std::move(blocks);
+    if (hasLight)
+        chunk.light = std::move(light);
+    chunk.bakedLight = hasLight;
+    chunk.dirty = true;
+    // Saved again in the current format whenever it is next saved (unloaded or saveAll())
+    if (upgraded) {
+        chunk.unsaved = true;
+        upgrades++;
+    }
+    loads++;
+    return true;
+}
+
+bool RegionStore::save(const Chunk& chunk)
+{
+    if (chunk.coord.y < 0 || chunk.coord.y >= WORLD_HEIGHT_CHUNKS || !isOpen())
+        return false;
+    RegionFile* region = regionOf(chunk.coord, true);
+    if (!region)
+        return false;
+
+    PROFILE_ZONE("Save chunk");
+    std::vector<uint8_t> raw;
+    encodeChunkPayload(chunk.blocks, raw);
+    if (chunk.bakedLight)
+        encodeLightPayload(chunk.light, raw);
+    std::vector<uint8_t> compressed(lz4CompressBound(raw.size()));
+    size_t size = lz4Compress(raw.data(), raw.size(), compressed.data());
+
+    std::lock_guard<std::mutex> lock(region->mutex);
+    if (!region->write(regionSlot(chunk.coord), compressed.data(), size, raw.size(), chunk.bakedLight))
+        return false;
+    saves++;
+    return true;
+}
+
+bool RegionStore::hasBakedLight(const glm::ivec3& coord)
+{
+    if (coord.y < 0 || coord.y >= WORLD_HEIGHT_CHUNKS || !isOpen())
+        return false;
+    RegionFile* region = regionOf(coord, false);
+    if (!region)
+        return false;
+    std::lock_guard<std::mutex> lock(region->mutex);
+    const RegionEntry& entry = region->table[regionSlot(coord)];
+    return entry.offset != 0 && (entry.size & ENTRY_BAKED_LIGHT) != 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Chunk columns along each side of a region
+const int REGION_SIZE = 32;
+
+// Region coordinate of a chunk coordinate
+inline int floorDivRegion(int v)
+{
+    return (v >= 0 ? v : v - (REGION_SIZE - 1)) / REGION_SIZE;
+}
+
+// Serialised PalettedBlocks, before compression:
+//   u8  bitsPerIndex (0 = uniform)
+//   u8  palette entries - 1
+//   ... palette block IDs
+//   ... packed index words (bitsPerIndex * CHUNK_VOLUME / 64 little-endian u64)
+void encodeChunkPayload(const PalettedBlocks& blocks, std::vector<uint8_t>& out);
+// False if 'data' isn't a valid payload ('out' is then left unchanged)
+bool decodeChunkPayload(const uint8_t* data, size_t size, PalettedBlocks& out);
+
+struct RegionFile;
+
+// Saved chunks of a world directory, one file per region of 32x32 chunk
+// columns ("r.<x>.<z>.region"). A file starts with a header and an offset
+// table of every chunk slot in the region, followed by records: the
+// payload above, LZ4-compressed. Chunks saved with baked light (see
+// Chunk::bakedLight) append it to the payload, so columns lit offline load
+// lit. Reads go through a read-only memory
+// mapping of the file, so loading a chunk is a table lookup, a pointer and
+// a decompression.
+//
+// Each record is tagged with the format of its payload. Records of older
+// formats are upgraded as they are loaded, on the loading thread, and
+// written back in the current one when their chunk is next saved, so an
+// old world never goes through a conversion up front. Files of the first
+// layout (untagged records) are read as they are.
+//
+// Saves only append: the record goes to the end of the file and then its
+// table entry is pointed at it, so the previous copy stays valid until the
+// new one is complete. Superseded records are dead space; a region that
+// is more than half dead is compacted (live records copied to a new file
+// that replaces it).
+//
+// Safe to use from several threads: generator workers load while the main
+// thread saves. Files from another seed are ignored and rewritten.
+struct RegionStore {
+    // Use 'directory' (created if missing) for a world generated from 'seed'
+    bool open(const std::string& directory, uint32_t seed);
+    // Flush and close every region file (no load or save may be running)
+    void close();
+    bool isOpen() const { return !root.empty(); }
+
+    // Replace the chunk's blocks with the saved copy at its coordinate, and
+    // its light if that was saved too (setting Chunk::bakedLight). False if
+    // none was saved (or it can't be read); 'chunk' is then untouched.
+    bool load(const glm::ivec3& coord, Chunk& chunk);
+    // Append the chunk to its region, with its light when it is baked.
+    // False for chunks outside the world's height.
+    bool save(const Chunk& chunk);
+    // True if the chunk at 'coord' was saved with baked light (a table
+    // lookup: nothing is read or decompressed)
+    bool hasBakedLight(const glm::ivec3& coord);
+
+    // Chunks read and written since open()
+    std::atomic<int> loads{ 0 };
+    std::atomic<int> saves{ 0 };
+    // Loads whose payload an upgrade step rewrote
+    std::atomic<int> upgrades{ 0 };
+
+    RegionStore();
+    ~RegionStore();
+
+private:
+    // The region holding 'coord', opened (or created) on first use
+    RegionFile* regionOf(const glm::ivec3& coord, bool create);
+
+    std::string root;
+    uint32_t seed = 0;
+    std::mutex mutex;   // Guards regions; each file has a lock of its own
+    std::unordered_map<uint64_t, std::unique_ptr<RegionFile>> regions;
+};
@@ -0,0 +1,127 @@
+#include "render_device.h"
+#include "gl_state.h"
+#include "shader.h"
+
+#include <glad/glad.h>
+
+void CommandList::bindPipeline(const PipelineState& pipeline)
+{
+    commands.push_back({ COMMAND_PIPELINE, 0, 0, 0, &pipeline, glm::vec4(0.0f) });
+}
+
+void CommandList::bindVertexArray(unsigned int vao)
+{
+    commands.push_back({ COMMAND_VERTEX_ARRAY, vao, 0, 0, nullptr, glm::vec4(0.0f) });
+}
+
+void CommandList::bindStorageBuffer(unsigned int binding, unsigned int buffer)
+{
+    commands.push_back({ COMMAND_STORAGE_BUFFER, binding, (int32_t)buffer, 0, nullptr, glm::vec4(0.0f) });
+}
+
+void CommandList::vertexAttribute(unsigned int location, const glm::vec4& value)
+{
+    commands.push_back({ COMMAND_ATTRIBUTE, location, 0, 0, nullptr, value });
+}
+
+void CommandList::drawIndexed(int indexCount, int baseVertex, int instances)
+{
+    commands.push_back({ COMMAND_DRAW_INDEXED, (uint32_t)indexCount, baseVertex, instances, nullptr, glm::vec4(0.0f) });
+}
+
+unsigned int RenderDevice::createBuffer(unsigned int target, size_t bytes, const void* data, unsigned int usage)
+{
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    glState().bindBuffer(target, buffer);
+    glBufferData(target, (GLsizeiptr)bytes, data, usage);
+    return buffer;
+}
+
+void RenderDevice::updateBuffer(unsigned int target, unsigned int buffer, size_t offset, size_t bytes, const void* data)
+{
+    glState().bindBuffer(target, buffer);
+    glBufferSubData(target, (GLintptr)offset, (GLsizeiptr)bytes, data);
+}
+
+void RenderDevice::destroyBuffer(unsigned int& buffer)
+{
+    if (buffer != 0)
+        glState().deleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void RenderDevice::bindPipeline(const PipelineState& pipeline)
+{
+    if (pipeline.program)
+        pipeline.program->use();
+    if (pipeline.depthTest)
+        glState().enable(GL_DEPTH_TEST);
+    else
+        glState().disable(GL_DEPTH_TEST);
+    glState().depthMask(pipeline.depthWrite ? GL_TRUE : GL_FALSE);
+    glState().depthFunc(pipeline.depthFunc);
+    glState().colorMask(pipeline.colorWrite ? GL_TRUE : GL_FALSE);
+    if (pipeline.blend)
+        glState().enable(GL_BLEND);
+    else
+        glState().disable(GL_BLEND);
+}
+
+int RenderDevice::submit(const CommandList& list)
+{
+    int draws = 0;
+    for (const CommandList::Command& c : list.commands) {
+        switch (c.type) {
+        case CommandList::COMMAND_PIPELINE:
+            bindPipeline(*c.pipeline);
+            break;
+        case CommandList::COMMAND_VERTEX_ARRAY:
+            glState().bindVertexArray(c.a);
+            break;
+        case CommandList::COMMAND_STORAGE_BUFFER:
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, c.a, (GLuint)c.b);
+            break;
+        case CommandList::COMMAND_ATTRIBUTE:
+            glVertexAttrib4fv(c.a, &c.value[0]);
+            break;
+        case CommandList::COMMAND_DRAW_INDEXED:
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)c.a, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)c.instances, c.b);
+            draws++;
+            break;
+        }
+    }
+    submittedCommands += (uint32_t)list.commands.size();
+    return draws;
+}
+
+GpuFence RenderDevice::insertFence()
+{
+    return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool RenderDevice::waitFence(GpuFence fence, uint64_t timeoutNanos)
+{
+    if (!fence)
+        return true;
+    return glClientWaitSync((GLsync)fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeoutNanos) != GL_TIMEOUT_EXPIRED;
+}
+
+void RenderDevice::finishFence(GpuFence fence)
+{
+    while (!waitFence(fence, 1000000)) {
+    }
+}
+
+void RenderDevice::destroyFence(GpuFence& fence)
+{
+    if (fence)
+        glDeleteSync((GLsync)fence);
+    fence = nullptr;
+}
+
+RenderDevice& renderDevice()
+{
+    static RenderDevice device;
+    return device;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ShaderProgram;
+
+// Thin layer between the renderer and the graphics API for the parts that
+// differ most between APIs: buffers, pipelines (a program with its fixed
+// depth, colour and blend state), recorded command lists and fences. GL 3.3
+// through glState() is the only backend; the interface is shaped so one
+// with explicit command buffers could sit behind it.
+//
+// A CommandList only stores commands, without touching the API, so lists
+// can be recorded on any thread (by the job system's workers, say) and
+// handed to submit() on the render thread, which replays them in order.
+
+// Opaque GPU fence (a GLsync), null when none was inserted
+typedef void* GpuFence;
+
+struct PipelineState {
+    const ShaderProgram* program = nullptr;
+    bool depthTest = true;
+    bool depthWrite = true;
+    unsigned int depthFunc = 0x0201;    // GL_LESS
+    bool colorWrite = true;
+    bool blend = false;                 // Blend function is left as set
+};
+
+struct CommandList {
+    void clear() { commands.clear(); }
+    int size() const { return (int)commands.size(); }
+
+    // 'pipeline' is read at submit(), so it must outlive the list
+    void bindPipeline(const PipelineState& pipeline);
+    void bindVertexArray(unsigned int vao);
+    void bindStorageBuffer(unsigned int binding, unsigned int buffer);
+    // Constant value of vertex attribute 'location' for the draws after it
+    void vertexAttribute(unsigned int location, const glm::vec4& value);
+    // 'indexCount' 16-bit indices from the start of the bound element
+    // buffer, triangles, offset by 'baseVertex', 'instances' times
+    void drawIndexed(int indexCount, int baseVertex, int instances = 1);
+
+private:
+    friend struct RenderDevice;
+
+    enum CommandType : uint32_t {
+        COMMAND_PIPELINE,
+        COMMAND_VERTEX_ARRAY,
+        COMMAND_STORAGE_BUFFER,
+        COMMAND_ATTRIBUTE,
+        COMMAND_DRAW_INDEXED,
+    };
+    struct Command {
+        CommandType type;
+        uint32_t a;
+        int32_t b;
+        int32_t instances;
+        const PipelineState* pipeline;
+        glm::vec4 value;
+    };
+
+    std::vector<Command> commands;
+};
+
+struct RenderDevice {
+    // Buffer of 'bytes' for 'target' with GL usage 'usage', filled from
+    // 'data' unless null. Returns the buffer name.
+    unsigned int createBuffer(unsigned int target, size_t bytes, const void* data, unsigned int usage);
+    void updateBuffer(unsigned int target, unsigned int buffer, size_t offset, size_t bytes, const void* data);
+    // Delete and zero 'buffer'
+    void destroyBuffer(unsigned int& buffer);
+
+    // Make 'pipeline' the current program and fixed-function state
+    void bindPipeline(const PipelineState& pipeline);
+    // Replay 'list' on the render thread. Returns the draws issued.
+    int submit(const CommandList& list);
+
+    // Fence after the commands issued so far
+    GpuFence insertFence();
+    // Wait up to 'timeoutNanos' for 'fence' (0 polls); the first wait also
+    // flushes, so the fence is sure to signal. True once it has signalled.
+    bool waitFence(GpuFence fence, uint64_t timeoutNanos);
+    // Block until 'fence' signals
+    void finishFence(GpuFence fence);
+    // Delete and null 'fence'
+    void destroyFence(GpuFence& fence);
+
+    // Commands replayed by submit() since the last resetCounters()
+    uint32_t submittedCommands = 0;
+    void resetCounters() { submittedCommands = 0; }
+};
+
+// Device of the shared GL context
+RenderDevice& renderDevice();
@@ -0,0 +1,42 @@
+#include "render_queue.h"
+
+#include <cstring>
+
+uint64_t renderSortKey(RenderPass pass, uint32_t program, uint32_t material, float depth)
+{
+    uint32_t depthBits;
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+    return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(program & 0xFFF) << 48) |
+        ((uint64_t)(material & 0xFFFF) << 32) | depthBits;
+}
+
+void RenderQueue::sort()
+{
+    size_t count = keys.size();
+    if (count < 2)
+        return;
+    scratchKeys.resize(count);
+    scratchItems.resize(count);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (size_t i = 0; i < count; i++)
+            histogram[(keys[i] >> shift) & 0xFF]++;
+        if (histogram[(keys[0] >> shift) & 0xFF] == count)
+            continue; // Every key has the same byte here
+
+        size_t offset = 0;
+        for (size_t& bucket : histogram) {
+            size_t n = bucket;
+            bucket = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t slot = histogram[(keys[i] >> shift) & 0xFF]++;
+            scratchKeys[slot] = keys[i];
+            scratchItems[slot] = items[i];
+        }
+        keys.swap(scratchKeys);
+        items.swap(scratchItems);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Passes in submission order (the top bits of a sort key)
+enum RenderPass {
+    PASS_DEPTH,     // Depth pre-pass
+    PASS_OPAQUE,
+    PASS_OVERLAY,   // Outlines, HUD
+    PASS_COUNT
+};
+
+// 64-bit draw sort key: pass (4 bits), program (12), material / vertex
+// array (16), then view depth (32). Sorting by key groups draws by state
+// and orders each state bucket front to back. 'depth' must be >= 0; the
+// bits of a non-negative float sort like the float itself.
+uint64_t renderSortKey(RenderPass pass, uint32_t program, uint32_t material, float depth);
+
+// Draws collected for one pass group, then radix-sorted by key before
+// submission. Items are caller-defined indices (e.g. into a chunk list).
+struct RenderQueue {
+    void clear() { keys.clear(); items.clear(); }
+    void push(uint64_t key, uint32_t item) { keys.push_back(key); items.push_back(item); }
+
+    // Stable LSD radix sort on the keys, one byte per pass; bytes equal
+    // across every key (an unused pass or program field) are skipped
+    void sort();
+
+    int size() const { return (int)keys.size(); }
+    uint64_t key(int i) const { return keys[i]; }
+    uint32_t item(int i) const { return items[i]; }
+
+private:
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> items;
+    std::vector<uint64_t> scratchKeys; // Ping-pong buffers, kept between frames
+    std::vector<uint32_t> scratchItems;
+};
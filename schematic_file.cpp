@@ -0,0 +1,184 @@
+#include "schematic_file.h"
+#include "lz4.h"
+#include "profiler.h"
+#include "region_file.h"
+#include "world.h"
+
+const uint32_t SCHEMATIC_MAGIC = 0x43535856; // "VXSC"
+const uint32_t SCHEMATIC_VERSION = 1;
+// Largest side a schematic may have, so cell counts fit an int
+const int MAX_SCHEMATIC_SIZE = 4096;
+// Largest cell payload: 8-bit indices and a full palette
+const size_t MAX_CELL_PAYLOAD = 2 + 256 + CHUNK_VOLUME;
+
+struct SchematicHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t size[3];
+};
+// Precedes each cell's compressed payload
+struct CellHeader {
+    uint32_t compressedSize;
+    uint32_t rawSize;
+};
+
+static glm::ivec3 cellCounts(const glm::ivec3& size)
+{
+    return (size + (CHUNK_SIZE - 1)) / CHUNK_SIZE;
+}
+
+// Cell 'index' in file order: z fastest, then y, then x
+static glm::ivec3 cellAt(int index, const glm::ivec3& cells)
+{
+    return glm::ivec3(index / (cells.y * cells.z), index / cells.z % cells.y, index % cells.z);
+}
+
+bool SchematicExport::begin(const char* path, const glm::ivec3& boxMin, const glm::ivec3& boxMax)
+{
+    cancel();
+    glm::ivec3 size = boxMax - boxMin;
+    if (glm::any(glm::lessThanEqual(size, glm::ivec3(0))) || glm::any(glm::greaterThan(size, glm::ivec3(MAX_SCHEMATIC_SIZE))))
+        return false;
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    SchematicHeader header = { SCHEMATIC_MAGIC, SCHEMATIC_VERSION, { size.x, size.y, size.z } };
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        cancel();
+        return false;
+    }
+    origin = boxMin;
+    cells = cellCounts(size);
+    cellCount = cells.x * cells.y * cells.z;
+    cellsDone = 0;
+    return true;
+}
+
+bool SchematicExport::step(const World& world, int maxBlocks)
+{
+    if (!file)
+        return false;
+    PROFILE_ZONE("Schematic export");
+    bool aligned = localBlockOf(origin) == glm::ivec3(0);
+    PalettedBlocks copied;
+    BlockRegion region;
+    std::vector<BlockId> flat;
+    for (int budget = 0; budget < maxBlocks && cellsDone < cellCount; budget += CHUNK_VOLUME) {
+        glm::ivec3 cellMin = origin + cellAt(cellsDone, cells) * CHUNK_SIZE;
+        const PalettedBlocks* blocks = &copied;
+        if (aligned) {
+            // Straight from the chunk's storage; unloaded chunks are air
+            const Chunk* chunk = world.getChunk(chunkCoordOf(cellMin));
+            if (chunk)
+                blocks = &chunk->blocks;
+            else
+                copied.fill(BLOCK_AIR);
+        }
+        else {
+            world.copyRegion(cellMin, cellMin + CHUNK_SIZE, region);
+            flat.resize(CHUNK_VOLUME);
+            for (int x = 0; x < CHUNK_SIZE; x++)
+                for (int y = 0; y < CHUNK_SIZE; y++)
+                    for (int z = 0; z < CHUNK_SIZE; z++)
+                        flat[chunkIndex(x, y, z)] = region.blocks[region.index(x, y, z)];
+            copied.encode(flat.data());
+        }
+
+        encodeChunkPayload(*blocks, raw);
+        compressed.resize(lz4CompressBound(raw.size()));
+        CellHeader cell;
+        cell.compressedSize = (uint32_t)lz4Compress(raw.data(), raw.size(), compressed.data());
+        cell.rawSize = (uint32_t)raw.size();
+        if (fwrite(&cell, sizeof(cell), 1, file) != 1 || fwrite(compressed.data(), 1, cell.compressedSize, file) != cell.compressedSize) {
+            cancel();
+            return false;
+        }
+        cellsDone++;
+    }
+    if (cellsDone == cellCount) {
+        bool closed = fclose(file) == 0;
+        file = nullptr;
+        return closed;
+    }
+    return true;
+}
+
+void SchematicExport::cancel()
+{
+    if (file)
+        fclose(file);
+    file = nullptr;
+}
+
+bool SchematicImport::begin(const char* path, const glm::ivec3& destination)
+{
+    cancel();
+    file = fopen(path, "rb");
+    if (!file)
+        return false;
+    SchematicHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != SCHEMATIC_MAGIC ||
+        header.version != SCHEMATIC_VERSION) {
+        cancel();
+        return false;
+    }
+    size = glm::ivec3(header.size[0], header.size[1], header.size[2]);
+    if (glm::any(glm::lessThanEqual(size, glm::ivec3(0))) || glm::any(glm::greaterThan(size, glm::ivec3(MAX_SCHEMATIC_SIZE)))) {
+        cancel();
+        return false;
+    }
+    at = destination;
+    cells = cellCounts(size);
+    cellCount = cells.x * cells.y * cells.z;
+    cellsDone = 0;
+    changedBlocks = 0;
+    return true;
+}
+
+bool SchematicImport::step(World& world, int maxBlocks)
+{
+    if (!file)
+        return false;
+    PROFILE_ZONE("Schematic import");
+    PalettedBlocks blocks;
+    BlockRegion region;
+    std::vector<BlockId> flat(CHUNK_VOLUME);
+    for (int budget = 0; budget < maxBlocks && cellsDone < cellCount; budget += CHUNK_VOLUME) {
+        CellHeader cell;
+        if (fread(&cell, sizeof(cell), 1, file) != 1 || cell.rawSize > MAX_CELL_PAYLOAD ||
+            cell.compressedSize > lz4CompressBound(cell.rawSize)) {
+            cancel();
+            return false;
+        }
+        compressed.resize(cell.compressedSize);
+        raw.resize(cell.rawSize);
+        if (fread(compressed.data(), 1, cell.compressedSize, file) != cell.compressedSize ||
+            !lz4Decompress(compressed.data(), compressed.size(), raw.data(), raw.size()) ||
+            !decodeChunkPayload(raw.data(), raw.size(), blocks)) {
+            cancel();
+            return false;
+        }
+
+        // The part of the cell inside the box
+        glm::ivec3 cellOffset = cellAt(cellsDone, cells) * CHUNK_SIZE;
+        region.size = glm::min(size - cellOffset, glm::ivec3(CHUNK_SIZE));
+        region.blocks.resize((size_t)region.size.x * region.size.y * region.size.z);
+        blocks.decode(flat.data());
+        for (int x = 0; x < region.size.x; x++)
+            for (int y = 0; y < region.size.y; y++)
+                for (int z = 0; z < region.size.z; z++)
+                    region.blocks[region.index(x, y, z)] = flat[chunkIndex(x, y, z)];
+        changedBlocks += world.pasteRegion(region, at + cellOffset, false);
+        cellsDone++;
+    }
+    if (cellsDone == cellCount)
+        cancel();
+    return true;
+}
+
+void SchematicImport::cancel()
+{
+    if (file)
+        fclose(file);
+    file = nullptr;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct World;
+
+// Schematic files move a box of blocks between worlds. The box is cut into
+// CHUNK_SIZE^3 cells from its minimum corner, each stored like a region
+// record: its blocks as a chunk payload (encodeChunkPayload(), palette and
+// packed indices) compressed with LZ4.
+//   u32 magic "VXSC", u32 version, i32 size x, y, z
+//   per cell (z fastest, then y, then x): u32 compressed bytes, u32 raw
+//   bytes, the compressed payload
+// Cells on the far edges are whole; their blocks past the box are ignored.
+//
+// Both directions stream a slice of cells per step(), so neither a huge
+// build nor its file is ever held whole and no frame waits on it. Between
+// steps the world is free to change; a box edited while it is exported
+// comes out as it was when each cell was written. Main thread only, as
+// the world's edits are.
+
+// Writes the box [boxMin, boxMax) of a world. A box whose minimum corner is
+// on a chunk boundary is written straight from the chunks' palette storage
+// (cells are chunks); others are copied out a cell at a time. Blocks of
+// chunks not loaded are written as air.
+struct SchematicExport {
+    bool begin(const char* path, const glm::ivec3& boxMin, const glm::ivec3& boxMax);
+    // Write cells until 'maxBlocks' blocks' worth is done. The file is
+    // closed after the last, or on a write error (false).
+    bool step(const World& world, int maxBlocks);
+    void cancel();
+
+    bool active() const { return file != nullptr; }
+    int cellsDone = 0;
+    int cellCount = 0;
+
+private:
+    FILE* file = nullptr;
+    glm::ivec3 origin = glm::ivec3(0);
+    glm::ivec3 cells = glm::ivec3(0);
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> compressed;
+};
+
+// Pastes a schematic into a world with its minimum corner at 'at', through
+// World::pasteRegion() a cell at a time (background re-meshing, like other
+// bulk edits). Cells over chunks not loaded are skipped.
+struct SchematicImport {
+    // False if the file can't be opened or isn't a schematic
+    bool begin(const char* path, const glm::ivec3& at);
+    // Paste cells until 'maxBlocks' blocks' worth is done. The file is
+    // closed after the last, or on a damaged record (false).
+    bool step(World& world, int maxBlocks);
+    void cancel();
+
+    bool active() const { return file != nullptr; }
+    glm::ivec3 size = glm::ivec3(0);
+    int cellsDone = 0;
+    int cellCount = 0;
+    int changedBlocks = 0;      // Since begin()
+
+private:
+    FILE* file = nullptr;
+    glm::ivec3 at = glm::ivec3(0);
+    glm::ivec3 cells = glm::ivec3(0);
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> compressed;
+};
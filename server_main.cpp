@@ -0,0 +1,186 @@
+#include "chunk_server.h"
+#include "entity_broadphase.h"
+#include "entity_store.h"
+#include "entity_systems.h"
+#include "fixed_timestep.h"
+#include "generation_cache.h"
+#include "job_system.h"
+#include "net_connection.h"
+#include "net_protocol.h"
+#include "profiler.h"
+#include "region_file.h"
+#include "world.h"
+#include "world_simulation.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Dedicated server: owns the world, simulates it and streams it to the
+// clients started with --connect. Links the world library only, so it runs
+// on machines without a GPU or a display.
+
+const char* DEFAULT_WORLD_DIR = "world";
+// World rules and entities step at the client's rate; the network, the
+// players' inputs and the snapshots tick less often, the clients
+// interpolating between snapshots
+const int SIMULATION_RATE = 60;         // Ticks per second, as on the client
+const int DEFAULT_TICK_RATE = 20;
+const int STATUS_SECONDS = 10;
+// Held chunks no client has asked about for --cold-after seconds are kept
+// LZ4-compressed, this many more a tick at most
+const int COLD_CHUNKS_PER_TICK = 16;
+
+// Set by Ctrl+C: the loop stops and the world is saved
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+int main(int argc, char* argv[])
+{
+    int port = NET_DEFAULT_PORT;
+    const char* worldDir = DEFAULT_WORLD_DIR;
+    uint32_t seed = 0;
+    double autosaveSeconds = 60.0;
+    int threadCount = 0;
+    int tickRate = DEFAULT_TICK_RATE;
+    size_t generationCacheMB = 256;
+    double coldSeconds = 30.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--world") == 0 && i + 1 < argc) {
+            worldDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-save") == 0) {
+            worldDir = nullptr;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--autosave") == 0 && i + 1 < argc) {
+            autosaveSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            tickRate = glm::clamp(atoi(argv[++i]), 1, SIMULATION_RATE);
+        }
+        else if (strcmp(argv[i], "--gen-cache-mb") == 0 && i + 1 < argc) {
+            generationCacheMB = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cold-after") == 0 && i + 1 < argc) {
+            coldSeconds = atof(argv[++i]);
+        }
+        else {
+            std::cout << "Usage: " << argv[0] << " [--port <n>] [--world <directory>] [--no-save] [--seed <n>] [--autosave <seconds>] [--threads <n>] [--tick-rate <hz>] [--gen-cache-mb <n>] [--cold-after <seconds>]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!netStartup()) {
+        std::cout << "Server: no socket library" << std::endl;
+        return 1;
+    }
+    profilerSetThreadName("Main");
+    // Random ticks spread over every core by default
+    JobSystem jobSystem;
+    jobSystem.start(threadCount);
+
+    World world;
+    world.seed = seed;
+    world.coldAfterTicks = (uint32_t)(coldSeconds * SIMULATION_RATE);
+    // Chunks no client holds are unloaded; the untouched ones come back from here
+    GenerationCache generationCache;
+    generationCache.budgetBytes = generationCacheMB * 1024 * 1024;
+    if (generationCacheMB > 0)
+        world.generationCache = &generationCache;
+    RegionStore storage;
+    if (worldDir && storage.open(worldDir, seed))
+        world.storage = &storage;
+    else if (worldDir)
+        std::cout << "Server: can't use " << worldDir << ", chunks won't be saved" << std::endl;
+    WorldSimulation simulation;
+    simulation.attach(world, &jobSystem);
+    EntityStore entities;
+    EntityBroadphase broadphase;
+    std::vector<EntityPair> entityPairs;
+
+    ChunkServer server;
+    server.entities = &entities;
+    if (!server.start(world, port)) {
+        std::cout << "Server: can't listen on port " << port << std::endl;
+        netShutdown();
+        return 1;
+    }
+    std::cout << "Server: listening on port " << port << std::endl;
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration TICK = std::chrono::microseconds(1000000 / tickRate);
+    const Clock::duration AUTOSAVE = std::chrono::microseconds((int64_t)(autosaveSeconds * 1e6));
+    Clock::time_point nextTick = Clock::now();
+    Clock::time_point nextStatus = nextTick + std::chrono::seconds(STATUS_SECONDS);
+    Clock::time_point nextSave = nextTick + AUTOSAVE;
+    uint64_t statusBytes = 0;
+    FixedTimestep steps;
+    steps.setRate(SIMULATION_RATE);
+    Clock::time_point lastTick = nextTick;
+    while (!stopRequested) {
+        // Requests, edits and inputs in; chunks, the changes since the last
+        // tick and snapshots out. The simulation's changes go out with the
+        // next tick.
+        server.tick();
+        world.settleLoaded();
+        Clock::time_point now = Clock::now();
+        int count = steps.advance(std::chrono::duration<double>(now - lastTick).count());
+        lastTick = now;
+        float dt = (float)steps.tickSeconds;
+        for (int i = 0; i < count; i++) {
+            simulation.tick(world);
+            updateEntities(entities, world, dt);
+            broadphase.update(entities);
+            broadphase.findPairs(entities, &jobSystem, entityPairs);
+            separateEntities(entities, world, entityPairs);
+            world.compressColdChunks(COLD_CHUNKS_PER_TICK);
+        }
+
+        if (now >= nextStatus) {
+            double kbPerSecond = (server.bytesSent() - statusBytes) / 1024.0 / STATUS_SECONDS;
+            std::cout << "Server: " << server.clientCount() << " clients, " << world.loadedChunks().size()
+                << " chunks loaded (" << world.coldChunkCount() << " cold), " << entities.count() << " entities, " << simulation.fluids.activeCount() << " water cells active, "
+                << kbPerSecond << " KB/s sent" << std::endl;
+            statusBytes = server.bytesSent();
+            nextStatus = now + std::chrono::seconds(STATUS_SECONDS);
+        }
+        if (world.storage && autosaveSeconds > 0.0 && now >= nextSave) {
+            world.saveAll();
+            nextSave = now + AUTOSAVE;
+        }
+
+        nextTick += TICK;
+        if (nextTick < now)
+            nextTick = now; // Fell behind: don't try to catch up
+        std::this_thread::sleep_until(nextTick);
+    }
+
+    std::cout << "Server: stopping" << std::endl;
+    server.stop();
+    jobSystem.stop();
+    if (world.storage)
+        std::cout << "Server: saved " << world.saveAll() << " chunks" << std::endl;
+    simulation.detach(world);
+    netShutdown();
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "session_resume.h"
+
+#include <cstdio>
+
+const uint32_t RESUME_MAGIC = 0x53525856; // "VXRS"
+const uint32_t RESUME_VERSION = 1;
+// Beyond any view the renderer keeps; a larger count is a damaged file
+const uint32_t RESUME_MAX_CHUNKS = 1 << 20;
+
+struct ResumeHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seed;
+    int32_t playerMode;
+    double position[3];
+    float yaw, pitch, fov;
+    uint32_t chunkCount;    // Then that many x, y, z int32 triples
+};
+
+std::string resumeStatePath(const std::string& directory)
+{
+    return directory + "/session.dat";
+}
+
+bool saveResumeState(const std::string& path, const ResumeState& state)
+{
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+
+    ResumeHeader header = { RESUME_MAGIC, RESUME_VERSION, state.seed, state.playerMode,
+        { state.position.x, state.position.y, state.position.z }, state.yaw, state.pitch, state.fov,
+        (uint32_t)state.chunks.size() };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (const glm::ivec3& coord : state.chunks) {
+        int32_t packed[3] = { coord.x, coord.y, coord.z };
+        ok = ok && fwrite(packed, sizeof(packed), 1, file) == 1;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        remove(temporary.c_str());
+        return false;
+    }
+    // rename() won't replace a file everywhere
+    remove(path.c_str());
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool loadResumeState(const std::string& path, ResumeState& state)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    ResumeHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == RESUME_MAGIC &&
+        header.version == RESUME_VERSION && header.chunkCount <= RESUME_MAX_CHUNKS;
+    if (ok) {
+        state.seed = header.seed;
+        state.playerMode = header.playerMode;
+        state.position = glm::dvec3(header.position[0], header.position[1], header.position[2]);
+        state.yaw = header.yaw;
+        state.pitch = header.pitch;
+        state.fov = header.fov;
+        state.chunks.resize(header.chunkCount);
+        for (glm::ivec3& coord : state.chunks) {
+            int32_t packed[3];
+            if (fread(packed, sizeof(packed), 1, file) != 1) {
+                ok = false;
+                break;
+            }
+            coord = glm::ivec3(packed[0], packed[1], packed[2]);
+        }
+    }
+    fclose(file);
+    if (!ok)
+        state.chunks.clear();
+    return ok;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where the last session left off, kept beside the world's region files
+// ("session.dat") so the next start can pick up the same view: the camera,
+// and the chunks that were in view with their meshes on the GPU when the
+// window closed. Those are loaded before anything else and the window is
+// shown as soon as they are in, instead of once the whole streamed area has
+// settled, so a restart shows the view it left with nothing missing.
+struct ResumeState {
+    uint32_t seed = 0;          // World the chunks belong to
+    int32_t playerMode = 0;
+    glm::dvec3 position = glm::dvec3(0.0);  // PlayerController::position
+    float yaw = 0.0f, pitch = 0.0f, fov = 0.0f;
+    std::vector<glm::ivec3> chunks;
+};
+
+// Session file of the world in 'directory'
+std::string resumeStatePath(const std::string& directory);
+
+// Written to a temporary file first and moved over the old one, so a
+// session cut off mid-write (kiosks are switched off) keeps the last
+bool saveResumeState(const std::string& path, const ResumeState& state);
+// False if the file is missing, isn't a session file or is cut short
+bool loadResumeState(const std::string& path, ResumeState& state);
@@ -0,0 +1,410 @@
+#include "shader.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Start compiling a shader; the status is only read by checkShader()
+static unsigned int submitShader(unsigned int type, const char* source)
+{
+    unsigned int shaderID = glCreateShader(type);
+    glShaderSource(shaderID, 1, &source, NULL);
+    glCompileShader(shaderID);
+    return shaderID;
+}
+
+// Print the info log of a shader that failed to compile
+static void checkShader(unsigned int shaderID)
+{
+    int success;
+    char infoLog[512];
+    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shaderID, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+}
+
+// Function to compile a shader from source code
+unsigned int compileShader(unsigned int type, const char* source)
+{
+    unsigned int shaderID = submitShader(type, source);
+    checkShader(shaderID);
+    return shaderID;
+}
+
+// Linked program binaries are cached here, relative to the working directory
+static const char* PROGRAM_CACHE_DIR = "shader_cache";
+static const uint32_t PROGRAM_CACHE_MAGIC = 0x4E494250; // "PBIN"
+
+// FNV-1a over a string, including its terminator so concatenations differ
+static uint64_t hashString(uint64_t hash, const char* text)
+{
+    do {
+        hash ^= (unsigned char)*text;
+        hash *= 1099511628211ull;
+    } while (*text++);
+    return hash;
+}
+
+// A binary is only valid for the exact sources and driver build that produced it
+static uint64_t programCacheKey(const char* const* sources, int count)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < count; i++)
+        hash = hashString(hash, sources[i]);
+    hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+    hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+    hash = hashString(hash, (const char*)glGetString(GL_VERSION));
+    return hash;
+}
+
+static std::string programCachePath(uint64_t key)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%016llx.bin", PROGRAM_CACHE_DIR, (unsigned long long)key);
+    return path;
+}
+
+// Program from a cached binary, or 0 when there is none or the driver rejects it
+static unsigned int loadCachedProgram(uint64_t key)
+{
+    FILE* file = fopen(programCachePath(key).c_str(), "rb");
+    if (!file)
+        return 0;
+
+    // Header: magic, binary format, binary length
+    uint32_t header[3];
+    std::vector<char> binary;
+    bool valid = fread(header, sizeof(header), 1, file) == 1 && header[0] == PROGRAM_CACHE_MAGIC;
+    if (valid) {
+        binary.resize(header[2]);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!valid)
+        return 0;
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header[1], binary.data(), (GLsizei)binary.size());
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glState().deleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static void storeProgramBinary(unsigned int program, uint64_t key)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+#ifdef _MSC_VER
+    _mkdir(PROGRAM_CACHE_DIR);
+#else
+    mkdir(PROGRAM_CACHE_DIR, 0755);
+#endif
+    FILE* file = fopen(programCachePath(key).c_str(), "wb");
+    if (!file)
+        return;
+    uint32_t header[3] = { PROGRAM_CACHE_MAGIC, format, (uint32_t)length };
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(binary.data(), 1, (size_t)length, file);
+    fclose(file);
+}
+
+// Compile and link one shader per stage, or load the program from the
+// binary cache when the driver supports it and has seen these sources.
+// 'varyings' are captured by transform feedback, interleaved. Nothing
+// waits for the driver here.
+static ProgramBuild startProgram(const unsigned int* types, const char* const* sources, int count,
+    const char* const* varyings = nullptr, int varyingCount = 0)
+{
+    ProgramBuild build;
+    if (glFeatures.programBinary) {
+        build.cacheKey = programCacheKey(sources, count);
+        for (int i = 0; i < varyingCount; i++)
+            build.cacheKey = hashString(build.cacheKey, varyings[i]);
+        build.program = loadCachedProgram(build.cacheKey);
+        if (build.program != 0) {
+            build.cached = true;
+            return build;
+        }
+    }
+
+    build.program = glCreateProgram();
+    for (int i = 0; i < count; i++) {
+        build.shaders.push_back(submitShader(types[i], sources[i]));
+        glAttachShader(build.program, build.shaders.back());
+    }
+    if (varyingCount > 0)
+        glTransformFeedbackVaryings(build.program, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+    if (glFeatures.programBinary)
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(build.program);
+    return build;
+}
+
+// Whether finishProgram() can run without blocking
+static bool programComplete(const ProgramBuild& build)
+{
+    if (build.cached || !glFeatures.parallelShaderCompile)
+        return true;
+    int complete = 0;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete != 0;
+}
+
+// Report errors, release the stage shaders and cache the binary. Blocks
+// until the driver is done when the build isn't complete yet.
+static unsigned int finishProgram(ProgramBuild& build)
+{
+    if (build.cached)
+        return build.program;
+
+    // Check for linking errors
+    int success;
+    char infoLog[512];
+    glGetProgramiv(build.program, GL_LINK_STATUS, &success);
+    if (!success) {
+        for (unsigned int shader : build.shaders)
+            checkShader(shader);
+        glGetProgramInfoLog(build.program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    for (unsigned int shader : build.shaders)
+        glDeleteShader(shader);
+    build.shaders.clear();
+
+    if (success && glFeatures.programBinary)
+        storeProgramBinary(build.program, build.cacheKey);
+    return build.program;
+}
+
+static ProgramBuild startProgram(const char* vertexSource, const char* fragmentSource)
+{
+    const unsigned int types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    const char* sources[2] = { vertexSource, fragmentSource };
+    return startProgram(types, sources, 2);
+}
+
+static ProgramBuild startComputeProgram(const char* computeSource)
+{
+    const unsigned int types[1] = { GL_COMPUTE_SHADER };
+    return startProgram(types, &computeSource, 1);
+}
+
+// Function to compile and link a vertex + fragment shader program
+unsigned int createShaderProgram(const char* vertexSource, const char* fragmentSource)
+{
+    ProgramBuild build = startProgram(vertexSource, fragmentSource);
+    return finishProgram(build);
+}
+
+// Function to compile and link a compute shader program
+unsigned int createComputeProgram(const char* computeSource)
+{
+    ProgramBuild build = startComputeProgram(computeSource);
+    return finishProgram(build);
+}
+
+// Function to compile and link a vertex shader whose outputs are captured
+unsigned int createFeedbackProgram(const char* vertexSource, const char* const* varyings, int varyingCount)
+{
+    const unsigned int types[1] = { GL_VERTEX_SHADER };
+    ProgramBuild build = startProgram(types, &vertexSource, 1, varyings, varyingCount);
+    return finishProgram(build);
+}
+
+void ShaderProgram::create(const char* vertexSource, const char* fragmentSource)
+{
+    id = createShaderProgram(vertexSource, fragmentSource);
+    cacheUniforms();
+}
+
+void ShaderProgram::createCompute(const char* computeSource)
+{
+    id = createComputeProgram(computeSource);
+    cacheUniforms();
+}
+
+void ShaderProgram::createFeedback(const char* vertexSource, const char* const* varyings, int varyingCount)
+{
+    id = createFeedbackProgram(vertexSource, varyings, varyingCount);
+    cacheUniforms();
+}
+
+void ShaderProgram::createAsync(const char* vertexSource, const char* fragmentSource)
+{
+    build = startProgram(vertexSource, fragmentSource);
+    id = build.program;
+    building = true;
+}
+
+bool ShaderProgram::poll()
+{
+    if (!building)
+        return id != 0;
+    if (!programComplete(build))
+        return false;
+    finishProgram(build);
+    cacheUniforms();
+    building = false;
+    return true;
+}
+
+void ShaderProgram::destroy()
+{
+    if (building) {
+        for (unsigned int shader : build.shaders)
+            glDeleteShader(shader);
+        build.shaders.clear();
+        building = false;
+    }
+    if (id != 0)
+        glState().deleteProgram(id);
+    id = 0;
+    locations.clear();
+}
+
+void ShaderProgram::cacheUniforms()
+{
+    locations.clear();
+
+    int count = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    for (int i = 0; i < count; i++) {
+        char name[256];
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(id, (GLuint)i, sizeof(name), &length, &size, &type, name);
+
+        // Arrays report "name[0]"; store them under the bare name as well
+        std::string key(name, length);
+        int location = glGetUniformLocation(id, name);
+        if (location < 0)
+            continue; // Block member
+        locations[key] = location;
+        size_t bracket = key.find('[');
+        if (bracket != std::string::npos)
+            locations[key.substr(0, bracket)] = location;
+    }
+}
+
+int ShaderProgram::uniform(const char* name) const
+{
+    auto it = locations.find(name);
+    return it != locations.end() ? it->second : -1;
+}
+
+void ShaderProgram::bindBlock(const char* name, unsigned int binding) const
+{
+    unsigned int index = glGetUniformBlockIndex(id, name);
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(id, index, binding);
+}
+
+void ShaderProgram::use() const
+{
+    glState().useProgram(id);
+}
+
+std::string specializeShader(const std::string& source, uint32_t features, const char* const* names, int count)
+{
+    std::string defines;
+    for (int i = 0; i < count; i++) {
+        if (features & (1u << i))
+            defines += std::string("#define ") + names[i] + "\n";
+    }
+    if (defines.empty())
+        return source;
+    // Nothing but comments and blank lines may come before #version
+    size_t version = source.find("#version");
+    size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return defines + source;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+void ProgramPermutations::init(const std::string& vertex, const std::string& fragment, const char* const* featureNames, int featureCount,
+    std::function<void(const ShaderProgram&)> onLinked)
+{
+    vertexSource = vertex;
+    fragmentSource = fragment;
+    names = featureNames;
+    count = featureCount;
+    setup = onLinked;
+    programs.assign(1u << count, ShaderProgram());
+    states.assign(1u << count, VARIANT_NONE);
+    prepare(allFeatures());
+}
+
+void ProgramPermutations::prepare(uint32_t features)
+{
+    features &= allFeatures();
+    if (states[features] != VARIANT_NONE)
+        return;
+    programs[features].createAsync(specializeShader(vertexSource, features, names, count).c_str(),
+        specializeShader(fragmentSource, features, names, count).c_str());
+    states[features] = VARIANT_BUILDING;
+}
+
+bool ProgramPermutations::poll()
+{
+    uint32_t all = allFeatures();
+    if (states[all] == VARIANT_BUILDING && programs[all].poll()) {
+        programs[all].use();
+        setup(programs[all]);
+        states[all] = VARIANT_LINKED;
+    }
+    return states[all] == VARIANT_LINKED;
+}
+
+const ShaderProgram& ProgramPermutations::select(uint32_t features)
+{
+    features &= allFeatures();
+    prepare(features);
+    ShaderProgram& program = programs[features];
+    if (states[features] == VARIANT_BUILDING) {
+        // Without parallel compilation poll() finishes the build here
+        if (!program.poll())
+            return programs[allFeatures()];
+        program.use();
+        setup(program);
+        states[features] = VARIANT_LINKED;
+    }
+    return program;
+}
+
+void ProgramPermutations::destroy()
+{
+    for (ShaderProgram& program : programs)
+        program.destroy();
+    programs.clear();
+    states.clear();
+}
+
+int ProgramPermutations::linkedCount() const
+{
+    int linked = 0;
+    for (State state : states)
+        linked += state == VARIANT_LINKED;
+    return linked;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compile one shader stage, printing the info log on failure
+unsigned int compileShader(unsigned int type, const char* source);
+// Compile and link a vertex + fragment shader program. With program binary
+// support, linked binaries are cached under shader_cache/ (keyed by the
+// sources and the driver) and reloaded instead of compiling when valid.
+unsigned int createShaderProgram(const char* vertexSource, const char* fragmentSource);
+// Compile and link a compute shader program (GL 4.3), cached the same way
+unsigned int createComputeProgram(const char* computeSource);
+// Compile and link a vertex-only program whose outputs 'varyings' are
+// captured interleaved by transform feedback, cached the same way
+unsigned int createFeedbackProgram(const char* vertexSource, const char* const* varyings, int varyingCount);
+
+// 'source' with a "#define <name>" line after its #version line for each set
+// bit of 'features', bit i naming names[i]
+std::string specializeShader(const std::string& source, uint32_t features, const char* const* names, int count);
+
+// A program whose compile and link may still be running in the driver
+struct ProgramBuild {
+    unsigned int program = 0;
+    std::vector<unsigned int> shaders;  // Stage shaders, deleted once linked
+    uint64_t cacheKey = 0;              // Binary cache entry to fill
+    bool cached = false;                // Loaded from the binary cache, already linked
+};
+
+// Linked program with its uniform locations resolved once after linking,
+// so per-frame code never calls glGetUniformLocation
+struct ShaderProgram {
+    unsigned int id = 0;
+
+    // Link from sources and cache every active uniform's location
+    void create(const char* vertexSource, const char* fragmentSource);
+    void createCompute(const char* computeSource);
+    void createFeedback(const char* vertexSource, const char* const* varyings, int varyingCount);
+    // Start compiling and linking without waiting for the driver. With
+    // KHR_parallel_shader_compile it builds on driver threads; poll()
+    // reports when the program can be used (and blocks without it).
+    void createAsync(const char* vertexSource, const char* fragmentSource);
+    // True once the program is linked and its uniforms are cached
+    bool poll();
+    void destroy();
+
+    // Cached location of a uniform, -1 if the program doesn't use it
+    int uniform(const char* name) const;
+    // Attach a named uniform block to a binding point (ignored if unused)
+    void bindBlock(const char* name, unsigned int binding) const;
+
+    void use() const;
+
+private:
+    void cacheUniforms();
+
+    std::unordered_map<std::string, int> locations;
+    ProgramBuild build;
+    bool building = false;  // createAsync() hasn't finished yet
+};
+
+// Variants of one vertex + fragment program specialised by feature bits
+// (specializeShader() on both stages), so a feature that is off costs
+// nothing at all instead of a branch on a uniform. The variant with every
+// feature is built first and stands in for any other until that one has
+// linked, which asks each feature's code to keep working whatever its
+// uniforms say. Other variants are built the first time they are asked
+// for, in the background with parallel shader compilation, and go through
+// the binary cache like any program.
+struct ProgramPermutations {
+    // 'names' (one per feature bit) must outlive this; 'setup' runs on each
+    // variant once it has linked, with it in use. Starts the full variant.
+    void init(const std::string& vertexSource, const std::string& fragmentSource, const char* const* names, int count,
+        std::function<void(const ShaderProgram&)> setup);
+    // True once the full variant can be used
+    bool poll();
+    // Variant for 'features' if linked, the full one otherwise; starts
+    // building it if nothing has. Only after poll() returned true.
+    const ShaderProgram& select(uint32_t features);
+    // Start building a variant ahead of select()
+    void prepare(uint32_t features);
+    void destroy();
+
+    uint32_t allFeatures() const { return (1u << count) - 1; }
+    // Variants linked so far
+    int linkedCount() const;
+
+private:
+    enum State : uint8_t { VARIANT_NONE, VARIANT_BUILDING, VARIANT_LINKED };
+
+    std::string vertexSource;
+    std::string fragmentSource;
+    const char* const* names = nullptr;
+    int count = 0;
+    std::function<void(const ShaderProgram&)> setup;
+    std::vector<ShaderProgram> programs;    // By feature bits
+    std::vector<State> states;
+};
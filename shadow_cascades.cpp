@@ -0,0 +1,198 @@
+#include "shadow_cascades.h"
+#include "gl_state.h"
+#include "world.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Radius of each cascade as a fraction of the shadow distance
+const float CASCADE_SPLITS[SHADOW_CASCADES] = { 0.1f, 0.25f, 0.5f, 1.0f };
+// Box slack of the cached cascades, as a fraction of their radius
+const float CACHED_SLACK = 0.25f;
+// Depth bias while rendering casters (glPolygonOffset factor and units)
+const float SHADOW_SLOPE_BIAS = 1.5f;
+const float SHADOW_CONSTANT_BIAS = 2.0f;
+// Lookups move this many texels along the face normal
+const float NORMAL_OFFSET_TEXELS = 1.5f;
+
+bool ShadowCascades::init(int size)
+{
+    resolution = size;
+    glGenTextures(1, &depthTexture);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, SHADOW_CASCADES, 0,
+        GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    // Linear filtering with comparison: 2x2 percentage-closer filtering for free
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    bool complete = true;
+    glGenFramebuffers(SHADOW_CASCADES, framebuffers);
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffers[c]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, c);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+        destroy();
+    return complete;
+}
+
+void ShadowCascades::destroy()
+{
+    glState().deleteFramebuffers(SHADOW_CASCADES, framebuffers);
+    for (int c = 0; c < SHADOW_CASCADES; c++)
+        framebuffers[c] = 0;
+    glState().deleteTextures(1, &depthTexture);
+    depthTexture = 0;
+    invalidateAll();
+}
+
+void ShadowCascades::invalidate(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    for (int c = 1; c < SHADOW_CASCADES; c++) {
+        ShadowCascade& cascade = cascades[c];
+        if (cascade.valid && !cascade.dirty && cascade.casters.intersectsAABB(boxMin, boxMax))
+            cascade.dirty = true;
+    }
+}
+
+void ShadowCascades::invalidateAll()
+{
+    for (ShadowCascade& cascade : cascades) {
+        cascade.valid = false;
+        cascade.dirty = true;
+        cascade.renderedFrame = 0;
+    }
+}
+
+void ShadowCascades::fit(int c, const glm::dvec3& eye)
+{
+    ShadowCascade& cascade = cascades[c];
+    glm::vec3 up = std::fabs(sun.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), -sun, up);
+
+    // Anchor the box at the eye, moved to the nearest texel corner across the
+    // light so consecutive positions rasterise casters identically
+    double texel = 2.0 * cascade.halfSize / resolution;
+    glm::dmat3 rotation = glm::dmat3(glm::mat3(view));
+    glm::dvec3 light = rotation * eye;
+    light.x = std::floor(light.x / texel + 0.5) * texel;
+    light.y = std::floor(light.y / texel + 0.5) * texel;
+    cascade.anchor = glm::transpose(rotation) * light;
+
+    // Receivers are within the box; casters may be anywhere up to the top of the world
+    float h = cascade.halfSize;
+    cascade.viewProj = glm::ortho(-h, h, -h, h, -h, h) * view;
+    float reach = (float)(WORLD_HEIGHT_CHUNKS * CHUNK_SIZE) / std::max(sun.y, 0.25f);
+    glm::mat4 casterProjection = glm::ortho(-h, h, -h, h, -(h + reach), h);
+    cascade.casters.update(casterProjection * view * glm::translate(glm::mat4(1.0f), -glm::vec3(cascade.anchor)));
+}
+
+int ShadowCascades::plan(const glm::dvec3& eye, const glm::vec3& sunDirection, float distance)
+{
+    frame++;
+    // Cached maps stay usable until their turn comes: a little off while
+    // the sun moves, but never missing
+    if (glm::dot(sunDirection, sun) < 0.99999f || distance != lastDistance) {
+        for (ShadowCascade& cascade : cascades)
+            cascade.dirty = true;
+    }
+    sun = sunDirection;
+    lastDistance = distance;
+
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        ShadowCascade& cascade = cascades[c];
+        cascade.render = false;
+        cascade.radius = distance * CASCADE_SPLITS[c];
+        // The eye left the slack: the box no longer holds the whole sphere
+        if (c > 0 && cascade.valid && glm::length(eye - cascade.anchor) > cascade.halfSize - cascade.radius)
+            cascade.dirty = true;
+    }
+
+    // The near cascade is redrawn every frame, fitted tightly; then the
+    // dirty cached cascades that have waited longest, within the budget
+    auto choose = [&](int c) {
+        ShadowCascade& cascade = cascades[c];
+        float texel = 2.0f * cascade.radius / resolution;
+        cascade.halfSize = c == 0 ? cascade.radius + 2.0f * texel : cascade.radius * (1.0f + CACHED_SLACK);
+        fit(c, eye);
+        cascade.render = true;
+        cascade.valid = true;
+        cascade.dirty = false;
+        cascade.renderedFrame = frame;
+    };
+    choose(0);
+    int chosen = 1;
+    for (int budget = cachedRendersPerFrame; budget > 0; budget--) {
+        int oldest = -1;
+        for (int c = 1; c < SHADOW_CASCADES; c++) {
+            if (cascades[c].dirty && (oldest < 0 || cascades[c].renderedFrame < cascades[oldest].renderedFrame))
+                oldest = c;
+        }
+        if (oldest < 0)
+            break;
+        choose(oldest);
+        chosen++;
+    }
+    return chosen;
+}
+
+void ShadowCascades::beginCascade(int c)
+{
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffers[c]);
+    glViewport(0, 0, resolution, resolution);
+    glState().polygonMode(GL_FILL);
+    glState().enable(GL_DEPTH_CLAMP);
+    glState().enable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowCascades::endCascades()
+{
+    glState().disable(GL_DEPTH_CLAMP);
+    glState().disable(GL_POLYGON_OFFSET_FILL);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowUniforms ShadowCascades::uniforms(const glm::dvec3& eye, bool enabled) const
+{
+    // Clip space to texture coordinates and depth
+    const glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+
+    ShadowUniforms u;
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        const ShadowCascade& cascade = cascades[c];
+        if (enabled && cascade.valid) {
+            u.matrices[c] = bias * cascade.viewProj * glm::translate(glm::mat4(1.0f), glm::vec3(eye - cascade.anchor));
+            u.offsets[c] = glm::vec4(NORMAL_OFFSET_TEXELS * 2.0f * cascade.halfSize / resolution, 0.0f, 0.0f, 0.0f);
+        }
+        else {
+            // Every position maps outside the map, so the cascade is skipped
+            u.matrices[c] = glm::mat4(0.0f);
+            u.matrices[c][3] = glm::vec4(-1.0f, -1.0f, -1.0f, 1.0f);
+            u.offsets[c] = glm::vec4(0.0f);
+        }
+    }
+    u.sunDirection = glm::vec4(sun, enabled ? 1.0f : 0.0f);
+    return u;
+}
+
+void ShadowCascades::bindTexture(int unit) const
+{
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+    glState().activeTexture(GL_TEXTURE0);
+}
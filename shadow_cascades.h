@@ -0,0 +1,85 @@
+#pragma once
+
+#include "frustum.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+const int SHADOW_CASCADES = 4;
+
+// std140 "Shadows" block of the chunk vertex shader
+struct ShadowUniforms {
+    glm::mat4 matrices[SHADOW_CASCADES];    // Camera-relative position -> shadow map coordinates and depth
+    glm::vec4 offsets[SHADOW_CASCADES];     // x: lookups move this far along the face normal (blocks)
+    glm::vec4 sunDirection;                 // Towards the sun; w = 1 with shadows, 0 without
+};
+
+// One orthographic depth map along the sun, over a box around the eye
+struct ShadowCascade {
+    glm::dvec3 anchor = glm::dvec3(0.0);    // Box centre; viewProj is relative to it
+    glm::mat4 viewProj = glm::mat4(1.0f);
+    Frustum casters;            // World space: the box, stretched towards the sun
+    float radius = 0.0f;        // Distance from the eye the map must cover
+    float halfSize = 0.0f;      // Box half extent: radius plus the slack the eye may move
+    bool valid = false;         // Rendered with the current sun and radius
+    bool dirty = true;          // Casters inside changed since it was rendered
+    bool render = false;        // Chosen by plan() for this frame
+    uint32_t renderedFrame = 0; // plan() call it was last rendered in
+};
+
+// Sun shadows as cascaded shadow maps: SHADOW_CASCADES layers of one depth
+// texture array, each covering a sphere around the eye, from a tenth of
+// the shadow distance for the first to all of it for the last. The chunk
+// shader samples the first cascade whose box holds the fragment.
+//
+// Only the first cascade follows the camera every frame (snapped to its
+// texel grid, so shadow edges don't shimmer). The others are cached: their
+// box has slack around the sphere, and they are rendered again only when
+// the sun or the shadow distance changes, the eye leaves the slack, or a
+// chunk mesh inside their caster volume changes - and then one per frame,
+// the oldest first. A cached cascade waiting for its turn keeps its old
+// box; fragments outside it use the next cascade out.
+//
+// Casters are drawn with depth clamping, so ones between the sun and the
+// box still land on its near plane, and the depth range only has to span
+// the box.
+struct ShadowCascades {
+    ShadowCascade cascades[SHADOW_CASCADES];
+    int resolution = 0;
+    unsigned int depthTexture = 0;  // GL_TEXTURE_2D_ARRAY, hardware depth comparison on
+    unsigned int framebuffers[SHADOW_CASCADES] = {};
+    int cachedRendersPerFrame = 1;  // Cached cascades rendered again per plan() at most
+
+    // Returns false if the framebuffers are incomplete
+    bool init(int resolution);
+    void destroy();
+
+    // A chunk mesh in this box changed: cached cascades that may see it are dirtied
+    void invalidate(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    // Re-render every cascade before it is used again (shadows were off)
+    void invalidateAll();
+
+    // Choose the cascades to render this frame and move their boxes around
+    // 'eye'. 'sunDirection' points towards the sun; 'distance' is the
+    // radius of the last cascade. Returns the number chosen (render set).
+    int plan(const glm::dvec3& eye, const glm::vec3& sunDirection, float distance);
+    // Bind cascade 'c' as the depth target and clear it; the caller draws
+    // its casters with viewProj, chunk origins relative to its anchor
+    void beginCascade(int c);
+    // Restore the state beginCascade() changed (the caller resets the viewport)
+    void endCascades();
+
+    // Lookup block for 'eye': matrices of the rendered cascades, or 'enabled' false
+    ShadowUniforms uniforms(const glm::dvec3& eye, bool enabled) const;
+    // Bind the depth texture array to texture unit 'unit' (texture unit 0 is left active)
+    void bindTexture(int unit) const;
+
+private:
+    // Place cascade 'c' around 'eye' and rebuild its matrices
+    void fit(int c, const glm::dvec3& eye);
+
+    glm::vec3 sun = glm::vec3(0.0f);
+    float lastDistance = 0.0f;
+    uint32_t frame = 0;
+};
@@ -0,0 +1,89 @@
+#include "simd_math.h"
+
+void transformPoints(const glm::mat4& m, const float* x, const float* y, const float* z, size_t count,
+    float* outX, float* outY, float* outZ, float* outW)
+{
+    float* out[4] = { outX, outY, outZ, outW };
+    int rows = outW ? 4 : 3;
+    size_t i = 0;
+
+#if defined(SIMD_AVX)
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+        // Every row is read before any is written, so the columns may alias
+        __m256 results[4];
+        for (int r = 0; r < rows; r++) {
+            __m256 d = _mm256_set1_ps(m[3][r]);
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(m[0][r]), px));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(m[1][r]), py));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(m[2][r]), pz));
+            results[r] = d;
+        }
+        for (int r = 0; r < rows; r++)
+            _mm256_storeu_ps(out[r] + i, results[r]);
+    }
+#elif defined(SIMD_SSE)
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 results[4];
+        for (int r = 0; r < rows; r++) {
+            __m128 d = _mm_set1_ps(m[3][r]);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(m[0][r]), px));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(m[1][r]), py));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(m[2][r]), pz));
+            results[r] = d;
+        }
+        for (int r = 0; r < rows; r++)
+            _mm_storeu_ps(out[r] + i, results[r]);
+    }
+#endif
+
+    // Same operations in the same order as the lanes
+    for (; i < count; i++) {
+        float px = x[i], py = y[i], pz = z[i];
+        float results[4];
+        for (int r = 0; r < rows; r++)
+            results[r] = ((m[3][r] + m[0][r] * px) + m[1][r] * py) + m[2][r] * pz;
+        for (int r = 0; r < rows; r++)
+            out[r][i] = results[r];
+    }
+}
+
+// One axis: p += v * dt
+static void addScaled(double* p, const float* v, size_t count, float dt)
+{
+    size_t i = 0;
+#if defined(SIMD_AVX)
+    __m256 step = _mm256_set1_ps(dt);
+    for (; i + 8 <= count; i += 8) {
+        __m256 d = _mm256_mul_ps(_mm256_loadu_ps(v + i), step);
+        __m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+        __m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+        _mm256_storeu_pd(p + i, _mm256_add_pd(_mm256_loadu_pd(p + i), low));
+        _mm256_storeu_pd(p + i + 4, _mm256_add_pd(_mm256_loadu_pd(p + i + 4), high));
+    }
+#elif defined(SIMD_SSE)
+    __m128 step = _mm_set1_ps(dt);
+    for (; i + 4 <= count; i += 4) {
+        __m128 d = _mm_mul_ps(_mm_loadu_ps(v + i), step);
+        __m128d low = _mm_cvtps_pd(d);
+        __m128d high = _mm_cvtps_pd(_mm_movehl_ps(d, d));
+        _mm_storeu_pd(p + i, _mm_add_pd(_mm_loadu_pd(p + i), low));
+        _mm_storeu_pd(p + i + 2, _mm_add_pd(_mm_loadu_pd(p + i + 2), high));
+    }
+#endif
+    for (; i < count; i++)
+        p[i] += v[i] * dt;
+}
+
+void integratePositions(double* px, double* py, double* pz, const float* vx, const float* vy, const float* vz,
+    size_t count, float dt)
+{
+    addScaled(px, vx, count, dt);
+    addScaled(py, vy, count, dt);
+    addScaled(pz, vz, count, dt);
+}
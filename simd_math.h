@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// The SIMD layer over the bundled glm. Every project defines
+// GLM_FORCE_INTRINSICS, so glm's aligned types (glm::aligned_vec4,
+// glm::aligned_mat4 from <glm/gtc/type_aligned.hpp>, 16-byte aligned) take
+// its SSE paths for products, inverses and the like. The plain types keep
+// their packed layout, which vertex formats, uniform blocks and the network
+// code rely on, and their scalar code.
+//
+// Loops over many values use the batched routines here instead, on
+// structure-of-arrays columns: 8 lanes at a time with AVX, 4 with SSE2,
+// then a scalar tail, which is also the fallback and gives the same
+// results. Batched AABB-plane tests are cullAABBs() in frustum.h.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE 1
+#endif
+
+// out = m * (x, y, z, 1) for 'count' points. The output columns may be the
+// input ones; 'outW' may be null when the matrix is affine.
+void transformPoints(const glm::mat4& m, const float* x, const float* y, const float* z, size_t count,
+    float* outX, float* outY, float* outZ, float* outW);
+
+// position += velocity * dt for 'count' entities, with the product taken
+// in float as the scalar loop does, then added to the double positions
+void integratePositions(double* px, double* py, double* pz, const float* vx, const float* vy, const float* vz,
+    size_t count, float dt);
@@ -0,0 +1,117 @@
+#include "snapshot_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Per snapshot: how fast the fastest transit creeps up to follow clock
+// drift and route changes, and how fast the jitter peak fades
+const double TRANSIT_DRIFT = 0.002;
+const double JITTER_FADE = 0.98;
+// Smoothing of the interval between snapshots
+const double INTERVAL_SMOOTHING = 0.1;
+// Further from its target than this, playback jumps there instead of
+// slewing (after a stall, or at the start)
+const double PLAYBACK_SNAP_SECONDS = 0.5;
+
+void SnapshotBuffer::push(const NetSnapshot& snapshot, double arrivalSeconds)
+{
+    double transit = arrivalSeconds - snapshot.serverTime;
+    if (snapshots.empty() && !playing) {
+        fastestTransit = transit;
+        jitter = 0.0;
+        interval = 0.0;
+    }
+    else {
+        if (!snapshots.empty() && snapshot.serverTime <= snapshots.back().serverTime)
+            return;
+        if (transit < fastestTransit)
+            fastestTransit = transit;
+        else
+            fastestTransit += (transit - fastestTransit) * TRANSIT_DRIFT;
+        jitter = std::max(transit - fastestTransit, jitter * JITTER_FADE);
+        if (!snapshots.empty()) {
+            double step = snapshot.serverTime - snapshots.back().serverTime;
+            interval = interval == 0.0 ? step : interval + (step - interval) * INTERVAL_SMOOTHING;
+        }
+    }
+    snapshots.push_back(snapshot);
+    if (snapshots.size() > capacity)
+        snapshots.pop_front();
+}
+
+void SnapshotBuffer::clear()
+{
+    snapshots.clear();
+    playing = false;
+}
+
+double SnapshotBuffer::targetDelay() const
+{
+    return interval + jitter + extraDelay;
+}
+
+// a + (b - a) * t, matching entities by id; those missing from 'a' are
+// taken from 'b' as they are
+static void blend(const NetSnapshot& a, const NetSnapshot& b, double t, std::vector<EntityInstance>& out)
+{
+    size_t j = 0;
+    for (const NetEntity& entity : b.entities) {
+        while (j < a.entities.size() && a.entities[j].id < entity.id)
+            j++;
+        EntityInstance instance;
+        instance.position = entity.position;
+        instance.halfExtents = entity.halfExtents;
+        instance.color = entity.color;
+        if (j < a.entities.size() && a.entities[j].id == entity.id)
+            instance.position = a.entities[j].position + (entity.position - a.entities[j].position) * t;
+        out.push_back(instance);
+    }
+}
+
+void SnapshotBuffer::sample(double nowSeconds, std::vector<EntityInstance>& out)
+{
+    if (snapshots.empty())
+        return;
+    double target = nowSeconds - fastestTransit - targetDelay();
+    if (!playing) {
+        playback = target;
+        playing = true;
+    }
+    else {
+        double elapsed = std::max(nowSeconds - lastSample, 0.0);
+        playback += elapsed;
+        double error = target - playback;
+        if (std::abs(error) > PLAYBACK_SNAP_SECONDS)
+            playback = target;
+        else
+            playback += glm::clamp(error, -elapsed * maxClockSlew, elapsed * maxClockSlew);
+    }
+    lastSample = nowSeconds;
+
+    // Only the last snapshot at or before playback is still needed of the older ones
+    while (snapshots.size() > 2 && snapshots[1].serverTime <= playback)
+        snapshots.pop_front();
+
+    const NetSnapshot& newest = snapshots.back();
+    if (playback < snapshots.front().serverTime || snapshots.size() == 1) {
+        blend(snapshots.front(), snapshots.front(), 0.0, out);
+        return;
+    }
+    if (playback >= newest.serverTime) {
+        // Ran dry: along the motion between the last two, for a while
+        starvedSamples++;
+        const NetSnapshot& before = snapshots[snapshots.size() - 2];
+        double span = newest.serverTime - before.serverTime;
+        double ahead = std::min(playback - newest.serverTime, maxExtrapolation);
+        blend(before, newest, 1.0 + ahead / span, out);
+        return;
+    }
+    for (size_t i = 0; i + 1 < snapshots.size(); i++) {
+        const NetSnapshot& a = snapshots[i];
+        const NetSnapshot& b = snapshots[i + 1];
+        if (playback < b.serverTime) {
+            blend(a, b, (playback - a.serverTime) / (b.serverTime - a.serverTime), out);
+            return;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "entity_systems.h"
+#include "net_protocol.h"
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Server snapshots, played back a little in the past on the client so
+// that there is nearly always one on each side of the time drawn: entity
+// boxes are interpolated between the two, whatever the server's tick rate,
+// and the render loop never waits for the network.
+//
+// The playback delay adapts to the link. Each snapshot's transit time
+// (arrival minus server time, clock offset included) is compared with the
+// fastest one seen lately; the worst lateness of recent snapshots, fading
+// slowly, is the jitter to absorb. Playback runs one snapshot interval
+// plus that jitter behind the fastest transit, and slews at most
+// maxClockSlew faster or slower towards where it should be, so a change of
+// delay never makes entities jump. When the buffer still runs dry, entities
+// carry on along their last motion for up to maxExtrapolation seconds and
+// then stop where they were last seen.
+struct SnapshotBuffer {
+    // A snapshot that arrived at 'arrivalSeconds' (netClockSeconds());
+    // older than the newest one buffered, it's dropped
+    void push(const NetSnapshot& snapshot, double arrivalSeconds);
+    void clear();
+
+    // Append the entities as seen at 'nowSeconds' to 'out'
+    void sample(double nowSeconds, std::vector<EntityInstance>& out);
+
+    // Seconds behind the fastest transit playback aims for
+    double targetDelay() const;
+    // Snapshots buffered, server seconds between them and their jitter
+    size_t size() const { return snapshots.size(); }
+    double snapshotInterval() const { return interval; }
+    double snapshotJitter() const { return jitter; }
+    // Samples that ran past the newest snapshot since the start
+    uint64_t starvedSamples = 0;
+
+    double extraDelay = 0.0;        // Seconds added to the adaptive delay
+    double maxExtrapolation = 0.1;  // Seconds
+    double maxClockSlew = 0.1;      // Fraction of real time
+    size_t capacity = 64;
+
+private:
+    std::deque<NetSnapshot> snapshots;
+    double fastestTransit = 0.0;
+    double jitter = 0.0;
+    double interval = 0.0;
+    double playback = 0.0;          // Server time being drawn
+    double lastSample = 0.0;        // nowSeconds of the last sample()
+    bool playing = false;
+};
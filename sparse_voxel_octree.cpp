@@ -0,0 +1,271 @@
+#include "sparse_voxel_octree.h"
+#include "terrain_column.h"
+#include "world.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// Per-cube volume of each block type, for inner node representatives
+struct BlockVolumes {
+    uint64_t volume[BLOCK_TYPE_COUNT] = {};
+
+    void add(const BlockVolumes& other)
+    {
+        for (int i = 0; i < BLOCK_TYPE_COUNT; i++)
+            volume[i] += other.volume[i];
+    }
+
+    BlockId representative() const
+    {
+        uint64_t total = 0;
+        uint64_t solid = 0;
+        int best = BLOCK_AIR;
+        for (int i = 0; i < BLOCK_TYPE_COUNT; i++) {
+            total += volume[i];
+            if (i != BLOCK_AIR) {
+                solid += volume[i];
+                if (best == BLOCK_AIR || volume[i] > volume[best])
+                    best = i;
+            }
+        }
+        return solid * 2 >= total ? (BlockId)best : (BlockId)BLOCK_AIR;
+    }
+};
+
+// Height field of the cube's footprint plus min / max surface pyramids:
+// level L holds one entry per aligned square of 2^L block columns
+struct TerrainFootprint {
+    int size;
+    std::vector<TerrainColumn> columns;     // Chunk columns, [x][z]
+    int columnsPerSide;
+    std::vector<std::vector<int16_t>> minSurface;
+    std::vector<std::vector<int16_t>> maxSurface;
+
+    const TerrainColumn& columnOf(int x, int z) const
+    {
+        return columns[(x / CHUNK_SIZE) * columnsPerSide + z / CHUNK_SIZE];
+    }
+};
+
+struct TerrainBuilder {
+    SparseVoxelOctree& tree;
+    const TerrainFootprint& footprint;
+    int leafLevel;
+
+    // Whether the cube at cube-local 'local' of 2^level blocks holds one block type
+    bool uniformCube(const glm::ivec3& local, int level, BlockId& id) const
+    {
+        int bottom = tree.origin.y + local.y;
+        int cell = (local.x >> level) * (footprint.size >> level) + (local.z >> level);
+        if (uniformTerrainRange(bottom, bottom + (1 << level) - 1,
+                footprint.minSurface[level][cell], footprint.maxSurface[level][cell], id))
+            return true;
+        if (level > 0)
+            return false;
+        const TerrainColumn& column = footprint.columnOf(local.x, local.z);
+        id = column.blockAt(local.x % CHUNK_SIZE, bottom, local.z % CHUNK_SIZE);
+        return true;
+    }
+
+    // Add up the block types of a cube without storing it, for leaves
+    // coarser than a block
+    void measure(const glm::ivec3& local, int level, BlockVolumes& volumes) const
+    {
+        BlockId id;
+        if (uniformCube(local, level, id)) {
+            volumes.volume[id] += (uint64_t)1 << (3 * level);
+            return;
+        }
+        int half = 1 << (level - 1);
+        for (int c = 0; c < 8; c++)
+            measure(local + glm::ivec3((c & 1) ? half : 0, (c & 2) ? half : 0, (c & 4) ? half : 0), level - 1, volumes);
+    }
+
+    // Fill nodes[index] with the cube at cube-local 'local' of 2^level blocks
+    void fill(uint32_t index, const glm::ivec3& local, int level, BlockVolumes& volumes)
+    {
+        int s = 1 << level;
+        BlockId id;
+        if (uniformCube(local, level, id)) {
+            tree.nodes[index] = SparseVoxelOctree::Node{ 0, id };
+            volumes.volume[id] += (uint64_t)s * s * s;
+            return;
+        }
+        if (level == leafLevel) {
+            BlockVolumes leafVolumes;
+            measure(local, level, leafVolumes);
+            volumes.add(leafVolumes);
+            tree.nodes[index] = SparseVoxelOctree::Node{ 0, leafVolumes.representative() };
+            return;
+        }
+
+        uint32_t children = (uint32_t)tree.nodes.size();
+        tree.nodes.resize(children + 8);
+        BlockVolumes childVolumes;
+        int half = s / 2;
+        for (int c = 0; c < 8; c++) {
+            glm::ivec3 offset((c & 1) ? half : 0, (c & 2) ? half : 0, (c & 4) ? half : 0);
+            fill(children + c, local + offset, level - 1, childVolumes);
+        }
+        volumes.add(childVolumes);
+
+        // Eight equal leaves are one leaf; being leaves, they are the last nodes
+        bool collapse = true;
+        for (int c = 0; c < 8 && collapse; c++) {
+            const SparseVoxelOctree::Node& child = tree.nodes[children + c];
+            collapse = child.children == 0 && child.value == tree.nodes[children].value;
+        }
+        if (collapse) {
+            BlockId value = tree.nodes[children].value;
+            tree.nodes.resize(children);
+            tree.nodes[index] = SparseVoxelOctree::Node{ 0, value };
+        }
+        else {
+            tree.nodes[index] = SparseVoxelOctree::Node{ children, childVolumes.representative() };
+        }
+    }
+};
+
+} // namespace
+
+void SparseVoxelOctree::buildTerrain(const glm::ivec3& cubeOrigin, int cubeDepth, uint32_t seed, int leafLevel)
+{
+    // The footprint is built from whole chunk columns
+    origin = cubeOrigin;
+    depth = std::max(cubeDepth, 4);
+    int s = size();
+
+    TerrainFootprint footprint;
+    footprint.size = s;
+    footprint.columnsPerSide = s / CHUNK_SIZE;
+    footprint.columns.resize((size_t)footprint.columnsPerSide * footprint.columnsPerSide);
+    glm::ivec2 firstColumn(floorDivChunk(origin.x), floorDivChunk(origin.z));
+    for (int cx = 0; cx < footprint.columnsPerSide; cx++)
+        for (int cz = 0; cz < footprint.columnsPerSide; cz++)
+            buildTerrainColumn(firstColumn + glm::ivec2(cx, cz), seed, footprint.columns[cx * footprint.columnsPerSide + cz]);
+
+    footprint.minSurface.resize(depth + 1);
+    footprint.maxSurface.resize(depth + 1);
+    footprint.minSurface[0].resize((size_t)s * s);
+    footprint.maxSurface[0].resize((size_t)s * s);
+    for (int x = 0; x < s; x++)
+        for (int z = 0; z < s; z++) {
+            int16_t height = footprint.columnOf(x, z).surface[x % CHUNK_SIZE][z % CHUNK_SIZE];
+            footprint.minSurface[0][x * s + z] = height;
+            footprint.maxSurface[0][x * s + z] = height;
+        }
+    for (int level = 1; level <= depth; level++) {
+        int n = s >> level;
+        int below = n * 2;
+        footprint.minSurface[level].resize((size_t)n * n);
+        footprint.maxSurface[level].resize((size_t)n * n);
+        for (int x = 0; x < n; x++)
+            for (int z = 0; z < n; z++) {
+                int i00 = (x * 2) * below + z * 2;
+                int i10 = i00 + below;
+                const std::vector<int16_t>& lo = footprint.minSurface[level - 1];
+                const std::vector<int16_t>& hi = footprint.maxSurface[level - 1];
+                footprint.minSurface[level][x * n + z] = std::min(std::min(lo[i00], lo[i00 + 1]), std::min(lo[i10], lo[i10 + 1]));
+                footprint.maxSurface[level][x * n + z] = std::max(std::max(hi[i00], hi[i00 + 1]), std::max(hi[i10], hi[i10 + 1]));
+            }
+    }
+
+    nodes.clear();
+    nodes.resize(1);
+    BlockVolumes volumes;
+    TerrainBuilder builder{ *this, footprint, std::min(std::max(leafLevel, 0), depth) };
+    builder.fill(0, glm::ivec3(0), depth, volumes);
+    nodes.shrink_to_fit();
+}
+
+BlockId SparseVoxelOctree::sample(const glm::ivec3& block, int level) const
+{
+    glm::ivec3 p = block - origin;
+    int s = size();
+    if (nodes.empty() || p.x < 0 || p.y < 0 || p.z < 0 || p.x >= s || p.y >= s || p.z >= s)
+        return BLOCK_AIR;
+
+    uint32_t index = 0;
+    for (int l = depth; l > level && nodes[index].children != 0; ) {
+        l--;
+        int child = ((p.x >> l) & 1) | (((p.y >> l) & 1) << 1) | (((p.z >> l) & 1) << 2);
+        index = nodes[index].children + child;
+    }
+    return nodes[index].value;
+}
+
+bool SparseVoxelOctree::raycast(const glm::dvec3& rayOrigin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+    if (nodes.empty() || direction == glm::vec3(0.0f))
+        return false;
+    glm::dvec3 dir = glm::normalize(glm::dvec3(direction));
+    int s = size();
+
+    // Clip to the cube (slab test), remembering the axis of entry
+    const double INF = std::numeric_limits<double>::infinity();
+    double tEnter = 0.0;
+    double tExit = maxDistance;
+    int face = -1;
+    for (int axis = 0; axis < 3; axis++) {
+        double lo = origin[axis];
+        double hi = origin[axis] + s;
+        if (dir[axis] == 0.0) {
+            if (rayOrigin[axis] < lo || rayOrigin[axis] >= hi)
+                return false;
+            continue;
+        }
+        double t0 = (lo - rayOrigin[axis]) / dir[axis];
+        double t1 = (hi - rayOrigin[axis]) / dir[axis];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        if (t0 > tEnter) {
+            tEnter = t0;
+            face = axis * 2 + (dir[axis] > 0.0 ? 0 : 1);
+        }
+        tExit = std::min(tExit, t1);
+    }
+    if (tEnter > tExit)
+        return false;
+
+    // Leaf by leaf: sample just past the current distance, then jump to the leaf's far side
+    const double NUDGE = 1e-4;
+    double t = tEnter;
+    while (t <= tExit) {
+        glm::dvec3 p = t > 0.0 ? rayOrigin + dir * (t + NUDGE) : rayOrigin;
+        glm::ivec3 local = glm::clamp(glm::ivec3(glm::floor(p)) - origin, glm::ivec3(0), glm::ivec3(s - 1));
+
+        uint32_t index = 0;
+        int level = depth;
+        while (nodes[index].children != 0) {
+            level--;
+            int child = ((local.x >> level) & 1) | (((local.y >> level) & 1) << 1) | (((local.z >> level) & 1) << 2);
+            index = nodes[index].children + child;
+        }
+        if (nodes[index].value != BLOCK_AIR) {
+            hit.block = origin + local;
+            hit.face = face;
+            hit.distance = (float)t;
+            hit.id = nodes[index].value;
+            return true;
+        }
+
+        glm::ivec3 leafMin = origin + ((local >> level) << level);
+        double next = INF;
+        int axis = 0;
+        for (int a = 0; a < 3; a++) {
+            if (dir[a] == 0.0)
+                continue;
+            double bound = dir[a] > 0.0 ? leafMin[a] + (1 << level) : leafMin[a];
+            double ta = (bound - rayOrigin[a]) / dir[a];
+            if (ta < next) {
+                next = ta;
+                axis = a;
+            }
+        }
+        t = std::max(next, t + NUDGE);
+        face = axis * 2 + (dir[axis] > 0.0 ? 0 : 1);
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "chunk.h"
+#include "voxel_raycast.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sparse voxel octree over a cube of 2^depth blocks, for terrain too far away
+// to keep as chunks. Any cube holding a single block type is one leaf
+// however large, so the sky and the rock under a region cost a few nodes
+// instead of whole chunks of voxels. Inner nodes keep a representative
+// block of what they cover, so a level of the tree reads as the region
+// downsampled by a power of two (for LOD meshes).
+struct SparseVoxelOctree {
+    struct Node {
+        uint32_t children;  // First of 8 consecutive children, 0 for a leaf
+        BlockId value;      // Leaf: its block. Inner: the most common solid block if
+                            // at least half the volume is solid, otherwise air
+    };
+
+    glm::ivec3 origin = glm::ivec3(0);  // World block position of the minimum corner
+    int depth = 0;
+    std::vector<Node> nodes;            // nodes[0] is the root
+
+    int size() const { return 1 << depth; }
+
+    // Build the terrain of the cube at 'origin' for 'seed', straight from the
+    // height field: cubes entirely above the surface or under the dirt are
+    // decided from column min / max heights without visiting their blocks.
+    // 'origin' x and z must be on chunk boundaries; depth is at least 4.
+    // Leaves are no smaller than 2^leafLevel blocks, a mixed cube of that
+    // size keeping its representative: far terrain needs no finer detail
+    // than it is meshed at, and most of the nodes sit at the surface.
+    void buildTerrain(const glm::ivec3& origin, int depth, uint32_t seed, int leafLevel = 0);
+
+    // Block at a world position (air outside the cube)
+    BlockId get(const glm::ivec3& block) const { return sample(block, 0); }
+    // Value at 'block' of the tree cut at cells of 2^level blocks: the
+    // covering leaf, or the representative of the inner node of that size
+    BlockId sample(const glm::ivec3& block, int level) const;
+
+    // First solid block along a ray, skipping each empty node in one step.
+    // Same conventions as raycastBlocks(); 'face' is -1 only at the start.
+    bool raycast(const glm::dvec3& rayOrigin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+
+    size_t memoryUsage() const { return nodes.capacity() * sizeof(Node); }
+};
@@ -0,0 +1,57 @@
+#include "startup_timeline.h"
+#include "profiler.h"
+
+#include <cctype>
+
+void StartupTimeline::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    origin = last = profilerNow();
+    marks.clear();
+}
+
+void StartupTimeline::mark(const char* name)
+{
+    int64_t now = profilerNow();
+    std::lock_guard<std::mutex> lock(mutex);
+    Phase phase = { name, last, now };
+    marks.push_back(phase);
+    last = now;
+    profilerRecordTrack("Startup", ProfileZone{ name, phase.start, phase.end, 0 });
+}
+
+std::vector<StartupTimeline::Phase> StartupTimeline::phases() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return marks;
+}
+
+double StartupTimeline::totalMs() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (last - origin) / 1e6;
+}
+
+std::string StartupTimeline::summary() const
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "Startup: %.0f ms (", totalMs());
+    std::string text = buffer;
+    std::vector<Phase> list = phases();
+    for (size_t i = 0; i < list.size(); i++) {
+        snprintf(buffer, sizeof(buffer), "%s%s %.1f", i > 0 ? ", " : "", list[i].name, (list[i].end - list[i].start) / 1e6);
+        text += buffer;
+    }
+    return text + ")";
+}
+
+void StartupTimeline::writeJson(FILE* file, const char* indent) const
+{
+    for (const Phase& phase : phases()) {
+        std::string key;
+        for (const char* c = phase.name; *c; c++)
+            key += *c == ' ' ? '_' : (char)tolower((unsigned char)*c);
+        fprintf(file, "%s\"%s_ms\": %.3f,\n", indent, key.c_str(), (phase.end - phase.start) / 1e6);
+    }
+    fprintf(file, "%s\"total_ms\": %.3f\n", indent, totalMs());
+}
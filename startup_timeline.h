@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Wall-clock times of the start-up phases, from start() at the top of
+// main() to the first frame shown. Each mark() ends the phase since the
+// previous one, so the phases add up to the total. Marks may come from any
+// thread (the render thread marks the first frame); they also go on the
+// profiler's "Startup" track, so traces show them.
+struct StartupTimeline {
+    struct Phase {
+        const char* name;   // A literal, as for profiler zones
+        int64_t start;      // profilerNow() times
+        int64_t end;
+    };
+
+    void start();
+    // End the phase 'name' now
+    void mark(const char* name);
+
+    std::vector<Phase> phases() const;
+    double totalMs() const;
+
+    // "Startup: <total> ms (<phase> <ms>, ...)"
+    std::string summary() const;
+    // The phases as members of a JSON object, one per line after 'indent':
+    // "<phase>_ms" (lower case, spaces as underscores), then "total_ms"
+    void writeJson(FILE* file, const char* indent) const;
+
+private:
+    mutable std::mutex mutex;
+    int64_t origin = 0;
+    int64_t last = 0;   // End of the latest phase
+    std::vector<Phase> marks;
+};
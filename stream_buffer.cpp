@@ -0,0 +1,105 @@
+#include "stream_buffer.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <cstring>
+
+// The buffer is bound to GL_COPY_WRITE_BUFFER for mapping so it never
+// disturbs the array, index or uniform bindings in use
+
+void StreamBuffer::init(size_t bytesPerFrame)
+{
+    regionSize = bytesPerFrame;
+    size_t total = regionSize * FRAMES_IN_FLIGHT;
+
+    glGenBuffers(1, &buffer);
+    glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+    persistent = glFeatures.bufferStorage;
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)total, nullptr, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)total, flags);
+    }
+    else {
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)total, nullptr, GL_STREAM_DRAW);
+    }
+    glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    region = 0;
+    head = 0;
+}
+
+void StreamBuffer::destroy()
+{
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        renderDevice().destroyFence(fences[i]);
+    if (buffer != 0) {
+        if (mapped) {
+            glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glState().deleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+}
+
+void StreamBuffer::beginFrame()
+{
+    region = (region + 1) % FRAMES_IN_FLIGHT;
+    head = 0;
+
+    // Normally long signalled; only blocks when the GPU is frames behind
+    if (fences[region]) {
+        renderDevice().finishFence(fences[region]);
+        renderDevice().destroyFence(fences[region]);
+    }
+}
+
+void StreamBuffer::endFrame()
+{
+    fences[region] = renderDevice().insertFence();
+}
+
+void* StreamBuffer::map(size_t bytes, size_t alignment, size_t& offset)
+{
+    size_t start = (head + alignment - 1) / alignment * alignment;
+    if (start + bytes > regionSize)
+        return nullptr;
+
+    head = start + bytes;
+    offset = region * regionSize + start;
+    if (persistent)
+        return mapped + offset;
+
+    // GL 3.3: the fence already guarantees this range is idle
+    glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    rangeMapped = true;
+    return data;
+}
+
+void StreamBuffer::unmap()
+{
+    if (!rangeMapped)
+        return;
+    glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    rangeMapped = false;
+}
+
+size_t StreamBuffer::write(const void* data, size_t bytes, size_t alignment)
+{
+    size_t offset;
+    void* target = map(bytes, alignment, offset);
+    if (!target)
+        return STREAM_FULL;
+    memcpy(target, data, bytes);
+    unmap();
+    return offset;
+}
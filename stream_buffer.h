@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+// Ring buffer for data written by the CPU every frame (draw commands, text
+// vertices, per-frame uniforms). The buffer is split into one region per
+// frame in flight. Each region is fenced when its frame is submitted and
+// waited on before it is reused, so writes never stall on the driver.
+//
+// With buffer storage (GL 4.4) the buffer is persistently and coherently
+// mapped once. On GL 3.3 each write maps its range unsynchronised; the
+// fences provide the synchronisation instead.
+struct StreamBuffer {
+    static const int FRAMES_IN_FLIGHT = 3;
+
+    void init(size_t bytesPerFrame);
+    void destroy();
+
+    // Wait until the next region is free and make it current
+    void beginFrame();
+    // Fence the current region after the frame's commands were issued
+    void endFrame();
+
+    // Reserve 'bytes' in the current region, aligned to 'alignment' (any
+    // value, not only powers of two, so element strides can be used).
+    // 'offset' receives the position in the buffer. Returns a write
+    // pointer, or nullptr when the region is full. Call unmap() before
+    // drawing from the data.
+    void* map(size_t bytes, size_t alignment, size_t& offset);
+    void unmap();
+    // Copy 'bytes' from 'data' into the current region. Returns the buffer
+    // offset, or STREAM_FULL when it doesn't fit.
+    size_t write(const void* data, size_t bytes, size_t alignment);
+    static const size_t STREAM_FULL = (size_t)-1;
+
+    unsigned int buffer = 0;
+    bool persistent = false;
+
+private:
+    size_t regionSize = 0;
+    int region = 0;
+    size_t head = 0;                // Write position within the current region
+    unsigned char* mapped = nullptr; // Persistent mapping of the whole buffer
+    bool rangeMapped = false;       // GL 3.3 path: a range is currently mapped
+    void* fences[FRAMES_IN_FLIGHT] = {};
+};
@@ -0,0 +1,181 @@
+#include "temporal_upscaler.h"
+#include "gl_state.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+static const char* resolveVertexSource = R"(
+#version 330 core
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char* resolveFragmentSource = R"(
+#version 330 core
+uniform sampler2D sceneColor;
+uniform sampler2D sceneDepth;
+uniform sampler2D history;
+uniform mat4 reprojection;  // This frame's unjittered NDC to last frame's clip space
+uniform vec2 jitterUv;      // The scene's jitter in texture coordinates
+uniform vec2 outputSize;
+uniform float blend;        // 1 without history
+out vec4 FragColor;
+
+void main()
+{
+    // Where this output pixel's centre landed in the jittered scene
+    vec2 uv = gl_FragCoord.xy / outputSize;
+    vec2 sceneUv = uv + jitterUv;
+    vec3 current = texture(sceneColor, sceneUv).rgb;
+
+    // Range of the new frame around it, and its nearest depth, so edges
+    // take the motion of the surface in front
+    ivec2 sceneSize = textureSize(sceneColor, 0);
+    ivec2 center = ivec2(sceneUv * vec2(sceneSize));
+    vec3 low = current, high = current;
+    float depth = 1.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++) {
+            ivec2 p = clamp(center + ivec2(x, y), ivec2(0), sceneSize - 1);
+            vec3 c = texelFetch(sceneColor, p, 0).rgb;
+            low = min(low, c);
+            high = max(high, c);
+            depth = min(depth, texelFetch(sceneDepth, p, 0).r);
+        }
+
+    // Camera motion only: back through last frame's projection
+    vec4 previous = reprojection * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec2 previousUv = previous.xy / previous.w * 0.5 + 0.5;
+    if (blend >= 1.0 || previous.w <= 0.0 || any(lessThan(previousUv, vec2(0.0))) || any(greaterThan(previousUv, vec2(1.0)))) {
+        FragColor = vec4(current, 1.0);
+        return;
+    }
+    vec3 past = clamp(texture(history, previousUv).rgb, low, high);
+    FragColor = vec4(mix(past, current, blend), 1.0);
+}
+)";
+
+// Radical inverse of 'index' in 'base', in [0, 1)
+static float halton(uint32_t index, uint32_t base)
+{
+    float result = 0.0f;
+    float fraction = 1.0f / base;
+    for (; index > 0; index /= base, fraction /= base)
+        result += fraction * (index % base);
+    return result;
+}
+
+void TemporalUpscaler::init()
+{
+    program.create(resolveVertexSource, resolveFragmentSource);
+    glGenVertexArrays(1, &emptyVAO);
+    glGenSamplers(1, &linearSampler);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void TemporalUpscaler::destroy()
+{
+    if (emptyVAO == 0)
+        return;
+    destroyHistory();
+    program.destroy();
+    glDeleteSamplers(1, &linearSampler);
+    glState().deleteVertexArrays(1, &emptyVAO);
+    linearSampler = emptyVAO = 0;
+}
+
+void TemporalUpscaler::destroyHistory()
+{
+    glState().deleteFramebuffers(2, framebuffers);
+    glState().deleteTextures(2, history);
+    for (int i = 0; i < 2; i++)
+        framebuffers[i] = history[i] = 0;
+    width = height = 0;
+    historyValid = false;
+}
+
+glm::vec2 TemporalUpscaler::jitter(uint32_t index, int sceneWidth, int sceneHeight)
+{
+    // Halton points start at 1; centred on the pixel, one pixel is 2 / size in NDC
+    uint32_t phase = index % JITTER_PHASES + 1;
+    glm::vec2 offset(halton(phase, 2) - 0.5f, halton(phase, 3) - 0.5f);
+    return offset * 2.0f / glm::vec2((float)glm::max(sceneWidth, 1), (float)glm::max(sceneHeight, 1));
+}
+
+glm::mat4 TemporalUpscaler::jittered(const glm::mat4& projection, const glm::vec2& jitter)
+{
+    // Added to clip x and y in proportion to w, so NDC shifts by the jitter
+    glm::mat4 shifted = projection;
+    shifted[2][0] -= jitter.x;
+    shifted[2][1] -= jitter.y;
+    return shifted;
+}
+
+void TemporalUpscaler::resolve(unsigned int colorTexture, unsigned int depthTexture,
+    const glm::mat4& viewProj, const glm::vec2& jitter, const glm::dvec3& eye,
+    unsigned int target, int targetWidth, int targetHeight, int unit)
+{
+    // History at the output resolution; a new size starts over
+    if (targetWidth != width || targetHeight != height || history[0] == 0) {
+        destroyHistory();
+        width = targetWidth;
+        height = targetHeight;
+        glGenTextures(2, history);
+        glGenFramebuffers(2, framebuffers);
+        for (int i = 0; i < 2; i++) {
+            glState().bindTexture(GL_TEXTURE_2D, history[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, glm::max(width, 1), glm::max(height, 1), 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, history[i], 0);
+        }
+        glState().bindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Last frame's view, moved to this frame's eye like the Hi-Z reprojection
+    glm::mat4 reprojection = previousViewProj * glm::translate(glm::mat4(1.0f), glm::vec3(eye - previousEye)) * glm::inverse(viewProj);
+    int next = current ^ 1;
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffers[next]);
+    glViewport(0, 0, width, height);
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().disable(GL_DEPTH_TEST);
+
+    program.use();
+    glUniform1i(program.uniform("sceneColor"), unit);
+    glUniform1i(program.uniform("sceneDepth"), unit + 1);
+    glUniform1i(program.uniform("history"), unit + 2);
+    glUniformMatrix4fv(program.uniform("reprojection"), 1, GL_FALSE, &reprojection[0][0]);
+    glUniform2f(program.uniform("jitterUv"), jitter.x * 0.5f, jitter.y * 0.5f);
+    glUniform2f(program.uniform("outputSize"), (float)width, (float)height);
+    glUniform1f(program.uniform("blend"), historyValid ? blend : 1.0f);
+    const unsigned int sources[3] = { colorTexture, depthTexture, history[current] };
+    for (int i = 0; i < 3; i++) {
+        glState().activeTexture(GL_TEXTURE0 + unit + i);
+        glState().bindTexture(GL_TEXTURE_2D, sources[i]);
+        glBindSampler(unit + i, i == 1 ? 0 : linearSampler);
+    }
+    glState().bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    for (int i = 0; i < 3; i++)
+        glBindSampler(unit + i, 0);
+    glState().activeTexture(GL_TEXTURE0);
+
+    glState().enable(GL_DEPTH_TEST);
+    glState().polygonMode(polygonMode);
+    current = next;
+    historyValid = true;
+    previousViewProj = viewProj;
+    previousEye = eye;
+
+    glState().bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[current]);
+    glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Temporal upscaling for a scene drawn below the output resolution (see
+// DynamicResolution). Each frame's projection is shifted by a different
+// sub-pixel jitter (a Halton 2,3 sequence of JITTER_PHASES), so successive
+// frames sample different points inside every output pixel; resolve()
+// blends the new frame into a history kept at the output resolution.
+//
+// The world doesn't move, so motion comes from the camera alone: each
+// output pixel's depth is turned back into a position and projected with
+// last frame's matrix to find where it was in the history. The history
+// colour is then clamped to the range of the new frame's 3x3 neighbourhood,
+// which rejects what was disoccluded or belongs to moving entities instead
+// of smearing it. At native resolution it works as temporal anti-aliasing.
+struct TemporalUpscaler {
+    static const int JITTER_PHASES = 8;
+    float blend = 0.1f;         // Share of the new frame in each resolved pixel
+    int width = 0;              // History size, the output resolution
+    int height = 0;
+
+    void init();
+    void destroy();
+    // Start over from the next frame (the jitter or the view jumped)
+    void invalidate() { historyValid = false; }
+
+    // Sub-pixel offset in NDC for frame 'index' of a 'sceneWidth' x
+    // 'sceneHeight' scene, and the projection shifted by it
+    static glm::vec2 jitter(uint32_t index, int sceneWidth, int sceneHeight);
+    static glm::mat4 jittered(const glm::mat4& projection, const glm::vec2& jitter);
+
+    // Blend the scene ('colorTexture' and 'depthTexture' of the scene's
+    // size, drawn with 'jitter' added to the camera-relative, unjittered
+    // 'viewProj' from 'eye') into the history, sized to the 'targetWidth' x
+    // 'targetHeight' output, and copy the result to 'target', leaving it
+    // bound. Samples through texture units 'unit' to 'unit' + 2.
+    void resolve(unsigned int colorTexture, unsigned int depthTexture,
+        const glm::mat4& viewProj, const glm::vec2& jitter, const glm::dvec3& eye,
+        unsigned int target, int targetWidth, int targetHeight, int unit);
+
+private:
+    void destroyHistory();
+
+    ShaderProgram program;
+    unsigned int emptyVAO = 0;      // Fullscreen triangle from gl_VertexID
+    unsigned int linearSampler = 0; // Bilinear, clamped: scene and history reads between texels
+    unsigned int framebuffers[2] = {};
+    unsigned int history[2] = {};   // RGBA16F; 'current' holds the last result
+    int current = 0;
+    bool historyValid = false;
+    glm::mat4 previousViewProj = glm::mat4(1.0f);
+    glm::dvec3 previousEye = glm::dvec3(0.0);
+};
@@ -0,0 +1,231 @@
+#include "terrain_column.h"
+#include "terrain_noise.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Terrain shape: surface height = base + amplitude * noise, in blocks (keep
+// TERRAIN_MAX_SURFACE in step)
+const float TERRAIN_BASE_HEIGHT = 48.0f;
+const float TERRAIN_AMPLITUDE = 40.0f;
+const float TERRAIN_FREQUENCY = 1.0f / 128.0f;  // Lattice cells per block of the first octave
+const int TERRAIN_OCTAVES = 5;
+const int DIRT_DEPTH = 3;                       // Dirt blocks between the grass and the stone
+
+// Biomes vary over larger distances than the terrain
+const float BIOME_FREQUENCY = 1.0f / 512.0f;
+const int BIOME_OCTAVES = 2;
+const uint32_t BIOME_SEED_OFFSET = 0x5bd1e995u;
+const float ROCKY_THRESHOLD = 0.25f;            // Biome noise above this is rocky
+
+// Caves are where the density noise exceeds the threshold
+const float CAVE_FREQUENCY = 1.0f / 32.0f;
+const int CAVE_OCTAVES = 2;
+const uint32_t CAVE_SEED_OFFSET = 0x68e31da4u;
+const float CAVE_THRESHOLD = 0.4f;
+
+BlockId TerrainColumn::blockAt(int x, int y, int z) const
+{
+    int top = surface[x][z];
+    if (y < 0 || y > top)
+        return BLOCK_AIR;
+    if (biome[x][z] == BIOME_ROCKY)
+        return BLOCK_STONE;
+    if (y == top)
+        return BLOCK_GRASS;
+    return y >= top - DIRT_DEPTH ? BLOCK_DIRT : BLOCK_STONE;
+}
+
+bool TerrainColumn::uniformChunk(int chunkY, BlockId& id) const
+{
+    int bottom = chunkY * CHUNK_SIZE;
+    return uniformTerrainRange(bottom, bottom + CHUNK_SIZE - 1, minSurface, maxSurface, id);
+}
+
+bool uniformTerrainRange(int bottom, int top, int minSurface, int maxSurface, BlockId& id)
+{
+    if (top < 0 || bottom > maxSurface) {
+        id = BLOCK_AIR;
+        return true;
+    }
+    if (bottom >= 0 && top < minSurface - DIRT_DEPTH) {
+        id = BLOCK_STONE;
+        return true;
+    }
+    return false;
+}
+
+void buildTerrainColumn(const glm::ivec2& column, uint32_t seed, TerrainColumn& out)
+{
+    NoiseSettings terrain;
+    terrain.seed = seed;
+    terrain.octaves = TERRAIN_OCTAVES;
+    NoiseSettings biomes;
+    biomes.seed = seed + BIOME_SEED_OFFSET;
+    biomes.octaves = BIOME_OCTAVES;
+
+    out.column = column;
+    out.minSurface = INT32_MAX;
+    out.maxSurface = INT32_MIN;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        // One row of block columns along z per vectorised call
+        float heights[CHUNK_SIZE];
+        float biomeValues[CHUNK_SIZE];
+        float blockX = (float)(column.x * CHUNK_SIZE + x);
+        float blockZ = (float)(column.y * CHUNK_SIZE);
+        fractalNoiseRow(terrain, blockX * TERRAIN_FREQUENCY, blockZ * TERRAIN_FREQUENCY, TERRAIN_FREQUENCY, CHUNK_SIZE, heights);
+        fractalNoiseRow(biomes, blockX * BIOME_FREQUENCY, blockZ * BIOME_FREQUENCY, BIOME_FREQUENCY, CHUNK_SIZE, biomeValues);
+
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            int height = (int)std::floor(TERRAIN_BASE_HEIGHT + TERRAIN_AMPLITUDE * heights[z]);
+            out.surface[x][z] = (int16_t)height;
+            out.biome[x][z] = biomeValues[z] > ROCKY_THRESHOLD ? BIOME_ROCKY : BIOME_GRASSLAND;
+            out.minSurface = std::min(out.minSurface, height);
+            out.maxSurface = std::max(out.maxSurface, height);
+        }
+    }
+}
+
+void sampleTerrainSurface(const glm::ivec2& first, int spacing, int count, uint32_t seed, int16_t* surface, TerrainBiome* biome)
+{
+    NoiseSettings terrain;
+    terrain.seed = seed;
+    terrain.octaves = TERRAIN_OCTAVES;
+    NoiseSettings biomes;
+    biomes.seed = seed + BIOME_SEED_OFFSET;
+    biomes.octaves = BIOME_OCTAVES;
+
+    const int ROW = 64;
+    float heights[ROW];
+    float biomeValues[ROW];
+    for (int start = 0; start < count; start += ROW) {
+        int n = std::min(ROW, count - start);
+        float blockX = (float)first.x;
+        float blockZ = (float)(first.y + start * spacing);
+        fractalNoiseRow(terrain, blockX * TERRAIN_FREQUENCY, blockZ * TERRAIN_FREQUENCY, TERRAIN_FREQUENCY * spacing, n, heights);
+        fractalNoiseRow(biomes, blockX * BIOME_FREQUENCY, blockZ * BIOME_FREQUENCY, BIOME_FREQUENCY * spacing, n, biomeValues);
+        for (int i = 0; i < n; i++) {
+            surface[start + i] = (int16_t)std::floor(TERRAIN_BASE_HEIGHT + TERRAIN_AMPLITUDE * heights[i]);
+            biome[start + i] = biomeValues[i] > ROCKY_THRESHOLD ? BIOME_ROCKY : BIOME_GRASSLAND;
+        }
+    }
+}
+
+// Highest block of block column (x, z) caves may carve
+static int caveCeiling(const TerrainColumn& column, int x, int z)
+{
+    return std::min(CAVE_TOP, column.surface[x][z] - CAVE_ROOF);
+}
+
+bool sampleCaves(const TerrainColumn& column, int chunkY, uint32_t seed, CaveDensity& out)
+{
+    int bottom = chunkY * CHUNK_SIZE;
+    int top = bottom + CHUNK_SIZE - 1;
+    if (top < CAVE_BOTTOM || bottom > std::min(CAVE_TOP, column.maxSurface - CAVE_ROOF))
+        return false;
+
+    NoiseSettings caves;
+    caves.seed = seed + CAVE_SEED_OFFSET;
+    caves.octaves = CAVE_OCTAVES;
+    glm::vec3 origin = glm::vec3(column.column.x * CHUNK_SIZE, bottom, column.column.y * CHUNK_SIZE);
+    float highest = -1.0f;
+    for (int x = 0; x < CAVE_GRID; x++) {
+        for (int y = 0; y < CAVE_GRID; y++) {
+            for (int z = 0; z < CAVE_GRID; z++) {
+                glm::vec3 p = (origin + glm::vec3(x, y, z) * (float)CAVE_CELL) * CAVE_FREQUENCY;
+                float density = fractalNoise3(caves, p.x, p.y, p.z);
+                out.corners[x][y][z] = density;
+                highest = std::max(highest, density);
+            }
+        }
+    }
+    return highest > CAVE_THRESHOLD;
+}
+
+void carveCaves(const TerrainColumn& column, int chunkY, const CaveDensity& density, BlockId* voxels)
+{
+    int bottom = chunkY * CHUNK_SIZE;
+    const float step = 1.0f / CAVE_CELL;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        int cx = x / CAVE_CELL;
+        float fx = (x % CAVE_CELL) * step;
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            int cz = z / CAVE_CELL;
+            float fz = (z % CAVE_CELL) * step;
+            int first = std::max(CAVE_BOTTOM, bottom) - bottom;
+            int last = std::min(caveCeiling(column, x, z), bottom + CHUNK_SIZE - 1) - bottom;
+            for (int y = first; y <= last; y++) {
+                int cy = y / CAVE_CELL;
+                float fy = (y % CAVE_CELL) * step;
+                auto corner = [&](int dx, int dy, int dz) { return density.corners[cx + dx][cy + dy][cz + dz]; };
+                float x00 = corner(0, 0, 0) + (corner(1, 0, 0) - corner(0, 0, 0)) * fx;
+                float x01 = corner(0, 0, 1) + (corner(1, 0, 1) - corner(0, 0, 1)) * fx;
+                float x10 = corner(0, 1, 0) + (corner(1, 1, 0) - corner(0, 1, 0)) * fx;
+                float x11 = corner(0, 1, 1) + (corner(1, 1, 1) - corner(0, 1, 1)) * fx;
+                float y0 = x00 + (x10 - x00) * fy;
+                float y1 = x01 + (x11 - x01) * fy;
+                if (y0 + (y1 - y0) * fz > CAVE_THRESHOLD)
+                    voxels[chunkIndex(x, y, z)] = BLOCK_AIR;
+            }
+        }
+    }
+}
+
+void buildTerrainNeighbourhood(const glm::ivec2& column, uint32_t seed, TerrainNeighbourhood& out)
+{
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            std::shared_ptr<TerrainColumn> built = std::make_shared<TerrainColumn>();
+            buildTerrainColumn(column + glm::ivec2(dx, dz), seed, *built);
+            out.columns[dx + 1][dz + 1] = built;
+        }
+    }
+}
+
+static uint64_t packColumn(const glm::ivec2& column)
+{
+    return ((uint64_t)(uint32_t)column.x << 32) | (uint32_t)column.y;
+}
+
+std::shared_ptr<const TerrainColumn> TerrainColumnCache::get(const glm::ivec2& column, uint32_t seed)
+{
+    uint64_t key = packColumn(column);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (seed != cachedSeed) {
+            columns.clear();
+            order.clear();
+            cachedSeed = seed;
+        }
+        auto it = columns.find(key);
+        if (it != columns.end()) {
+            hits++;
+            return it->second;
+        }
+        misses++;
+    }
+
+    // Build outside the lock so other columns aren't held up
+    std::shared_ptr<TerrainColumn> built = std::make_shared<TerrainColumn>();
+    buildTerrainColumn(column, seed, *built);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (seed != cachedSeed)
+        return built;
+    auto inserted = columns.emplace(key, built);
+    if (!inserted.second)
+        return inserted.first->second;
+    order.push_back(key);
+    if (order.size() > CAPACITY) {
+        columns.erase(order.front());
+        order.pop_front();
+    }
+    return built;
+}
+
+void TerrainColumnCache::getNeighbourhood(const glm::ivec2& column, uint32_t seed, TerrainNeighbourhood& out)
+{
+    for (int dx = -1; dx <= 1; dx++)
+        for (int dz = -1; dz <= 1; dz++)
+            out.columns[dx + 1][dz + 1] = get(column + glm::ivec2(dx, dz), seed);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Highest surface height any seed produces (base 48 + amplitude 40, with
+// the height noise below 1)
+const int TERRAIN_MAX_SURFACE = 87;
+
+// Surface biomes, from a second low-frequency noise
+enum TerrainBiome : uint8_t {
+    BIOME_GRASSLAND,    // Grass over a few blocks of dirt
+    BIOME_ROCKY,        // Bare stone
+    BIOME_COUNT
+};
+
+// The 2D part of terrain generation for one chunk column: surface height
+// and biome per block column. Every chunk stacked in the column shares it,
+// so the noise is evaluated once per column instead of once per chunk.
+struct TerrainColumn {
+    glm::ivec2 column;                          // Chunk column (x, z)
+    int16_t surface[CHUNK_SIZE][CHUNK_SIZE];    // [x][z] height of the top solid block
+    TerrainBiome biome[CHUNK_SIZE][CHUNK_SIZE];
+    int minSurface;
+    int maxSurface;
+
+    // Block at world height 'y' of block column (x, z)
+    BlockId blockAt(int x, int y, int z) const;
+
+    // Chunk layer 'chunkY' of the column when it is a single block type
+    // (entirely above the surface or entirely stone); otherwise false
+    bool uniformChunk(int chunkY, BlockId& id) const;
+};
+
+void buildTerrainColumn(const glm::ivec2& column, uint32_t seed, TerrainColumn& out);
+// Surface height and biome of 'count' block columns 'spacing' blocks apart
+// along z from block column 'first', as buildTerrainColumn() gives them:
+// distant terrain sampled coarser than a block, without whole columns
+void sampleTerrainSurface(const glm::ivec2& first, int spacing, int count, uint32_t seed, int16_t* surface, TerrainBiome* biome);
+
+// Caves: air carved out of the ground by 3D noise, between CAVE_BOTTOM and
+// CAVE_TOP and at least CAVE_ROOF blocks under the surface, so the surface
+// and what stands on it stay whole. Chunk layers outside that band skip the
+// noise altogether (the column's surface bounds say which). Inside it the
+// density is sampled at the corners of CAVE_CELL-block cells and
+// interpolated trilinearly between them: 125 samples a chunk rather than
+// 4096. An interpolated value never exceeds its cell's corners, so a chunk
+// whose corners all stay under the threshold has no caves, exactly, and
+// still comes out uniform.
+const int CAVE_BOTTOM = 16;
+const int CAVE_TOP = 63;
+const int CAVE_ROOF = 4;
+const int CAVE_CELL = 4;
+const int CAVE_GRID = CHUNK_SIZE / CAVE_CELL + 1;
+static_assert(CHUNK_SIZE % CAVE_CELL == 0, "cave cells tile a chunk");
+
+// Cave density at the cell corners of one chunk, [x][y][z]
+struct CaveDensity {
+    float corners[CAVE_GRID][CAVE_GRID][CAVE_GRID];
+};
+
+// Sample the caves of chunk layer 'chunkY' of 'column' into 'out'. False if
+// the chunk has none: outside the cave band (without sampling) or with no
+// corner over the threshold.
+bool sampleCaves(const TerrainColumn& column, int chunkY, uint32_t seed, CaveDensity& out);
+// Carve sampled caves out of the chunk's voxels
+void carveCaves(const TerrainColumn& column, int chunkY, const CaveDensity& density, BlockId* voxels);
+
+// A chunk column's TerrainColumn with the 8 around it, [dx + 1][dz + 1]:
+// what generating one of its chunks reads, since structures on the surface
+// reach across chunk borders
+struct TerrainNeighbourhood {
+    std::shared_ptr<const TerrainColumn> columns[3][3];
+
+    const TerrainColumn& centre() const { return *columns[1][1]; }
+};
+
+void buildTerrainNeighbourhood(const glm::ivec2& column, uint32_t seed, TerrainNeighbourhood& out);
+
+// True with the block type if every block column whose surface lies in
+// [minSurface, maxSurface] is one type over heights [bottom, top]: air
+// above the surface (or below the world), stone under the dirt layer
+bool uniformTerrainRange(int bottom, int top, int minSurface, int maxSurface, BlockId& id);
+
+// Recently built columns, shared by the generator's worker threads. Bounded;
+// the oldest columns are dropped first, which streaming has usually
+// unloaded by then anyway.
+struct TerrainColumnCache {
+    static const size_t CAPACITY = 1024;
+
+    // The column for 'seed', built on a miss. Two threads missing on the same
+    // column both build it; the second result is dropped.
+    std::shared_ptr<const TerrainColumn> get(const glm::ivec2& column, uint32_t seed);
+    // The columns around 'column' as well, through get()
+    void getNeighbourhood(const glm::ivec2& column, uint32_t seed, TerrainNeighbourhood& out);
+
+    // Lookups since start, for reports
+    int hits = 0;
+    int misses = 0;
+
+private:
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const TerrainColumn>> columns;
+    std::deque<uint64_t> order;     // Insertion order, for eviction
+    uint32_t cachedSeed = 0;
+};
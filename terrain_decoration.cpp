@@ -0,0 +1,101 @@
+#include "terrain_decoration.h"
+
+#include <algorithm>
+
+// Trees: at most one per TREE_CELL x TREE_CELL block columns, at a spot in
+// the cell picked by hash, standing on grass
+const int TREE_CELL_SHIFT = 2;
+const int TREE_CELL = 1 << TREE_CELL_SHIFT;
+const uint32_t TREE_CHANCE = 40;        // Out of 256 cells
+const int TREE_MIN_TRUNK = 4;
+const int TREE_MAX_TRUNK = TREE_MAX_TOP - 1;
+const uint32_t TREE_SEED_OFFSET = 0x27d4eb2fu;
+static_assert(TREE_CELL + TREE_REACH <= CHUNK_SIZE, "every tree reaching a chunk stands in the columns around it");
+
+static uint32_t cellHash(uint32_t seed, int x, int z)
+{
+    uint64_t h = ((uint64_t)(uint32_t)x << 32 | (uint32_t)z) ^ ((uint64_t)(seed + TREE_SEED_OFFSET) * 0x9E3779B97F4A7C15ull);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)(h ^ (h >> 31));
+}
+
+bool structuresReach(const TerrainNeighbourhood& terrain, int chunkY)
+{
+    int minSurface = INT32_MAX;
+    int maxSurface = INT32_MIN;
+    for (int dx = 0; dx < 3; dx++) {
+        for (int dz = 0; dz < 3; dz++) {
+            minSurface = std::min(minSurface, terrain.columns[dx][dz]->minSurface);
+            maxSurface = std::max(maxSurface, terrain.columns[dx][dz]->maxSurface);
+        }
+    }
+    int bottom = chunkY * CHUNK_SIZE;
+    return bottom <= maxSurface + TREE_MAX_TOP && bottom + CHUNK_SIZE - 1 > minSurface;
+}
+
+// Write 'id' at world block 'p' if it lies in the chunk at 'origin' and
+// holds air (or, for trunks, leaves)
+static void place(BlockId* voxels, const glm::ivec3& origin, const glm::ivec3& p, BlockId id)
+{
+    glm::ivec3 local = p - origin;
+    if (glm::any(glm::lessThan(local, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(local, glm::ivec3(CHUNK_SIZE))))
+        return;
+    BlockId& voxel = voxels[chunkIndex(local.x, local.y, local.z)];
+    if (voxel == BLOCK_AIR || (id == BLOCK_WOOD && voxel == BLOCK_LEAVES))
+        voxel = id;
+}
+
+static void placeTree(BlockId* voxels, const glm::ivec3& origin, const glm::ivec3& base, int trunk)
+{
+    int top = base.y + trunk - 1;
+    // Two wide layers below the top, corners clipped, then two narrow ones
+    for (int y = top - 2; y <= top + 1; y++) {
+        int radius = y < top ? TREE_REACH : 1;
+        for (int dx = -radius; dx <= radius; dx++) {
+            for (int dz = -radius; dz <= radius; dz++) {
+                bool corner = std::abs(dx) == radius && std::abs(dz) == radius;
+                if (corner && (radius == TREE_REACH || y == top + 1))
+                    continue;
+                place(voxels, origin, glm::ivec3(base.x + dx, y, base.z + dz), BLOCK_LEAVES);
+            }
+        }
+    }
+    for (int y = base.y; y <= top; y++)
+        place(voxels, origin, glm::ivec3(base.x, y, base.z), BLOCK_WOOD);
+}
+
+void decorateChunk(const TerrainNeighbourhood& terrain, const glm::ivec3& coord, uint32_t seed, BlockId* voxels)
+{
+    glm::ivec3 origin = coord * CHUNK_SIZE;
+    glm::ivec2 columnOrigin = glm::ivec2(coord.x, coord.z) * CHUNK_SIZE;
+    int firstCell[2], lastCell[2];
+    for (int axis = 0; axis < 2; axis++) {
+        firstCell[axis] = (columnOrigin[axis] - TREE_REACH) >> TREE_CELL_SHIFT;
+        lastCell[axis] = (columnOrigin[axis] + CHUNK_SIZE - 1 + TREE_REACH) >> TREE_CELL_SHIFT;
+    }
+
+    for (int cx = firstCell[0]; cx <= lastCell[0]; cx++) {
+        for (int cz = firstCell[1]; cz <= lastCell[1]; cz++) {
+            uint32_t h = cellHash(seed, cx, cz);
+            if ((h & 0xFF) >= TREE_CHANCE)
+                continue;
+            int x = (cx << TREE_CELL_SHIFT) + (int)((h >> 8) & (TREE_CELL - 1));
+            int z = (cz << TREE_CELL_SHIFT) + (int)((h >> 12) & (TREE_CELL - 1));
+            int trunk = TREE_MIN_TRUNK + (int)((h >> 16) % (TREE_MAX_TRUNK - TREE_MIN_TRUNK + 1));
+
+            // The column the trunk stands in
+            int dx = (x >> CHUNK_SHIFT) - coord.x;
+            int dz = (z >> CHUNK_SHIFT) - coord.z;
+            const TerrainColumn& column = *terrain.columns[dx + 1][dz + 1];
+            int lx = x & CHUNK_MASK;
+            int lz = z & CHUNK_MASK;
+            if (column.biome[lx][lz] != BIOME_GRASSLAND)
+                continue;
+            glm::ivec3 base(x, column.surface[lx][lz] + 1, z);
+            if (base.y + trunk < origin.y || base.y > origin.y + CHUNK_SIZE - 1)
+                continue;
+            placeTree(voxels, origin, base, trunk);
+        }
+    }
+}
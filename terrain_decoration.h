@@ -0,0 +1,26 @@
+#pragma once
+
+#include "chunk.h"
+#include "terrain_column.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Structures generated over the base terrain: trees on grassland. Each is
+// placed by block column from the seed and the surface there, not per
+// chunk, so a tree across a chunk border comes out the same from either
+// side: every chunk writes the parts of all trees that overlap it, found
+// through the TerrainColumns of its own and the surrounding chunk columns.
+// Generating a chunk thus never waits on its neighbours' voxels or writes
+// into them, and a chunk regenerated after unloading gets its trees back.
+const int TREE_REACH = 2;       // Leaves around the trunk, in blocks
+const int TREE_MAX_TOP = 7;     // Highest leaves above the surface
+
+// True if a structure of the neighbourhood may reach the blocks of chunk
+// layer 'chunkY' (of its centre column)
+bool structuresReach(const TerrainNeighbourhood& terrain, int chunkY);
+
+// Write the parts of the structures overlapping chunk 'coord' into its
+// voxels, which hold the base terrain
+void decorateChunk(const TerrainNeighbourhood& terrain, const glm::ivec3& coord, uint32_t seed, BlockId* voxels);
@@ -0,0 +1,297 @@
+#include "terrain_noise.h"
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#if defined(__SSE4_1__) || defined(__AVX__)
+#include <smmintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#define NOISE_SSE 1
+#endif
+
+// Hash constants: odd multipliers with well-mixed bits
+const uint32_t HASH_X = 0x8da6b343u;
+const uint32_t HASH_Z = 0xd8163841u;
+const uint32_t HASH_Y = 0x9e5e6d31u;
+const uint32_t HASH_SEED = 0xcb1ab31fu;
+const uint32_t HASH_MIX1 = 0x2c1b3c6du;
+const uint32_t HASH_MIX2 = 0x297a2d39u;
+const uint32_t OCTAVE_SEED_STEP = 0x9e3779b9u;
+// The top 24 hash bits map exactly onto floats in [-1, 1)
+const float HASH_TO_UNIT = 2.0f / 16777216.0f;
+
+static inline uint32_t mixHash(uint32_t h)
+{
+    h ^= h >> 15;
+    h *= HASH_MIX1;
+    h ^= h >> 12;
+    h *= HASH_MIX2;
+    h ^= h >> 15;
+    return h;
+}
+
+static inline float latticeValue(uint32_t hx, uint32_t hz)
+{
+    return (float)(int32_t)(mixHash(hx ^ hz) >> 8) * HASH_TO_UNIT - 1.0f;
+}
+
+static inline float fade(float t)
+{
+    return t * t * (3.0f - 2.0f * t);
+}
+
+static inline float lerp(float a, float b, float t)
+{
+    return a + (b - a) * t;
+}
+
+// Lattice hashes of the two x cells around a sample, and its weight
+// between them. Rows run along z, so one octave shares these.
+struct OctaveX {
+    uint32_t hx0, hx1;
+    float ux;
+};
+
+static OctaveX octaveX(const NoiseSettings& settings, int octave, float px)
+{
+    uint32_t seedHash = (settings.seed + (uint32_t)octave * OCTAVE_SEED_STEP) * HASH_SEED;
+    float cellX = std::floor(px);
+    uint32_t hx = (uint32_t)(int32_t)cellX * HASH_X;
+    return OctaveX{ hx ^ seedHash, (hx + HASH_X) ^ seedHash, fade(px - cellX) };
+}
+
+static float normalisation(const NoiseSettings& settings)
+{
+    float total = 0.0f;
+    float amplitude = 1.0f;
+    for (int o = 0; o < settings.octaves; o++) {
+        total += amplitude;
+        amplitude *= settings.gain;
+    }
+    return total > 0.0f ? 1.0f / total : 0.0f;
+}
+
+// Scalar samples [begin, end) of a row, added to out[] (which starts at zero)
+static void accumulateScalar(const NoiseSettings& settings, float x, float z0, float zStep, int begin, int end, float* out)
+{
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (int o = 0; o < settings.octaves; o++) {
+        OctaveX ox = octaveX(settings, o, x * frequency);
+
+        for (int i = begin; i < end; i++) {
+            float pz = (z0 + (float)i * zStep) * frequency;
+            float cellZ = std::floor(pz);
+            uint32_t hz0 = (uint32_t)(int32_t)cellZ * HASH_Z;
+            uint32_t hz1 = hz0 + HASH_Z;
+            float uz = fade(pz - cellZ);
+            float a = lerp(latticeValue(ox.hx0, hz0), latticeValue(ox.hx1, hz0), ox.ux);
+            float b = lerp(latticeValue(ox.hx0, hz1), latticeValue(ox.hx1, hz1), ox.ux);
+            out[i] += lerp(a, b, uz) * amplitude;
+        }
+        frequency *= 2.0f;
+        amplitude *= settings.gain;
+    }
+}
+
+#if defined(NOISE_AVX2)
+static inline __m256i mixHash8(__m256i h)
+{
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)HASH_MIX1));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)HASH_MIX2));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    return h;
+}
+
+static inline __m256 latticeValue8(__m256i hx, __m256i hz)
+{
+    __m256i h = _mm256_srli_epi32(mixHash8(_mm256_xor_si256(hx, hz)), 8);
+    return _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(h), _mm256_set1_ps(HASH_TO_UNIT)), _mm256_set1_ps(1.0f));
+}
+
+static inline __m256 fade8(__m256 t)
+{
+    return _mm256_mul_ps(_mm256_mul_ps(t, t), _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), t)));
+}
+
+static inline __m256 lerp8(__m256 a, __m256 b, __m256 t)
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+#elif defined(NOISE_SSE)
+// 32-bit lane multiply; SSE2 only has the 32 x 32 -> 64 bit even-lane form
+static inline __m128i mullo4(__m128i a, __m128i b)
+{
+#if defined(__SSE4_1__) || defined(__AVX__)
+    return _mm_mullo_epi32(a, b);
+#else
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+static inline __m128i mixHash4(__m128i h)
+{
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    h = mullo4(h, _mm_set1_epi32((int)HASH_MIX1));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+    h = mullo4(h, _mm_set1_epi32((int)HASH_MIX2));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    return h;
+}
+
+static inline __m128 latticeValue4(__m128i hx, __m128i hz)
+{
+    __m128i h = _mm_srli_epi32(mixHash4(_mm_xor_si128(hx, hz)), 8);
+    return _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(h), _mm_set1_ps(HASH_TO_UNIT)), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 fade4(__m128 t)
+{
+    return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), t)));
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// floor() for values well inside the int range: truncate, then step down where that rounded up
+static inline __m128i floor4(__m128 v, __m128& cell)
+{
+    __m128i i = _mm_cvttps_epi32(v);
+    __m128i roundedUp = _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), v));
+    i = _mm_add_epi32(i, roundedUp);
+    cell = _mm_cvtepi32_ps(i);
+    return i;
+}
+#endif
+
+void fractalNoiseRow(const NoiseSettings& settings, float x, float z0, float zStep, int count, float* out)
+{
+    for (int i = 0; i < count; i++)
+        out[i] = 0.0f;
+
+    int simdEnd = 0;
+#if defined(NOISE_AVX2)
+    simdEnd = count & ~7;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    for (int o = 0; o < settings.octaves; o++) {
+        // x is fixed along the row: its cell and weight are scalar
+        OctaveX ox = octaveX(settings, o, x * frequency);
+        __m256i hx0v = _mm256_set1_epi32((int)ox.hx0);
+        __m256i hx1v = _mm256_set1_epi32((int)ox.hx1);
+        __m256 ux = _mm256_set1_ps(ox.ux);
+        __m256 amp = _mm256_set1_ps(amplitude);
+
+        for (int i = 0; i < simdEnd; i += 8) {
+            __m256 index = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+            __m256 pz = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(z0), _mm256_mul_ps(index, _mm256_set1_ps(zStep))), _mm256_set1_ps(frequency));
+            __m256 cellZ = _mm256_floor_ps(pz);
+            __m256i hz0 = _mm256_mullo_epi32(_mm256_cvtps_epi32(cellZ), _mm256_set1_epi32((int)HASH_Z));
+            __m256i hz1 = _mm256_add_epi32(hz0, _mm256_set1_epi32((int)HASH_Z));
+            __m256 uz = fade8(_mm256_sub_ps(pz, cellZ));
+            __m256 a = lerp8(latticeValue8(hx0v, hz0), latticeValue8(hx1v, hz0), ux);
+            __m256 b = lerp8(latticeValue8(hx0v, hz1), latticeValue8(hx1v, hz1), ux);
+            __m256 sum = _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(lerp8(a, b, uz), amp));
+            _mm256_storeu_ps(out + i, sum);
+        }
+        frequency *= 2.0f;
+        amplitude *= settings.gain;
+    }
+#elif defined(NOISE_SSE)
+    simdEnd = count & ~3;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    for (int o = 0; o < settings.octaves; o++) {
+        // x is fixed along the row: its cell and weight are scalar
+        OctaveX ox = octaveX(settings, o, x * frequency);
+        __m128i hx0v = _mm_set1_epi32((int)ox.hx0);
+        __m128i hx1v = _mm_set1_epi32((int)ox.hx1);
+        __m128 ux = _mm_set1_ps(ox.ux);
+        __m128 amp = _mm_set1_ps(amplitude);
+
+        for (int i = 0; i < simdEnd; i += 4) {
+            __m128 index = _mm_add_ps(_mm_set1_ps((float)i), lane);
+            __m128 pz = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(z0), _mm_mul_ps(index, _mm_set1_ps(zStep))), _mm_set1_ps(frequency));
+            __m128 cellZ;
+            __m128i iz = floor4(pz, cellZ);
+            __m128i hz0 = mullo4(iz, _mm_set1_epi32((int)HASH_Z));
+            __m128i hz1 = _mm_add_epi32(hz0, _mm_set1_epi32((int)HASH_Z));
+            __m128 uz = fade4(_mm_sub_ps(pz, cellZ));
+            __m128 a = lerp4(latticeValue4(hx0v, hz0), latticeValue4(hx1v, hz0), ux);
+            __m128 b = lerp4(latticeValue4(hx0v, hz1), latticeValue4(hx1v, hz1), ux);
+            __m128 sum = _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(lerp4(a, b, uz), amp));
+            _mm_storeu_ps(out + i, sum);
+        }
+        frequency *= 2.0f;
+        amplitude *= settings.gain;
+    }
+#endif
+
+    // Scalar tail (and fallback on targets without SSE)
+    accumulateScalar(settings, x, z0, zStep, simdEnd, count, out);
+    float scale = normalisation(settings);
+    for (int i = 0; i < count; i++)
+        out[i] *= scale;
+}
+
+void fractalNoiseRowScalar(const NoiseSettings& settings, float x, float z0, float zStep, int count, float* out)
+{
+    for (int i = 0; i < count; i++)
+        out[i] = 0.0f;
+    accumulateScalar(settings, x, z0, zStep, 0, count, out);
+    float scale = normalisation(settings);
+    for (int i = 0; i < count; i++)
+        out[i] *= scale;
+}
+
+float fractalNoise(const NoiseSettings& settings, float x, float z)
+{
+    float value;
+    fractalNoiseRowScalar(settings, x, z, 0.0f, 1, &value);
+    return value;
+}
+
+float fractalNoise3(const NoiseSettings& settings, float x, float y, float z)
+{
+    float total = 0.0f;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (int o = 0; o < settings.octaves; o++) {
+        OctaveX ox = octaveX(settings, o, x * frequency);
+        float py = y * frequency;
+        float pz = z * frequency;
+        float cellY = std::floor(py);
+        float cellZ = std::floor(pz);
+        uint32_t hy0 = (uint32_t)(int32_t)cellY * HASH_Y;
+        uint32_t hz0 = (uint32_t)(int32_t)cellZ * HASH_Z;
+        float uy = fade(py - cellY);
+        float uz = fade(pz - cellZ);
+
+        // The 2D lattice of each y layer, y folded into the z hash
+        float layers[2];
+        for (int dy = 0; dy < 2; dy++) {
+            uint32_t hz = hz0 ^ (hy0 + (uint32_t)dy * HASH_Y);
+            uint32_t hz1 = (hz0 + HASH_Z) ^ (hy0 + (uint32_t)dy * HASH_Y);
+            float a = lerp(latticeValue(ox.hx0, hz), latticeValue(ox.hx1, hz), ox.ux);
+            float b = lerp(latticeValue(ox.hx0, hz1), latticeValue(ox.hx1, hz1), ox.ux);
+            layers[dy] = lerp(a, b, uz);
+        }
+        total += lerp(layers[0], layers[1], uy) * amplitude;
+        frequency *= 2.0f;
+        amplitude *= settings.gain;
+    }
+    return total * normalisation(settings);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Fractal 2D value noise for terrain. Every lattice point gets a value in
+// [-1, 1) from an integer hash of its coordinates and the seed, so there
+// are no permutation tables and any seed is equally cheap. Octaves double
+// the frequency and scale the amplitude by 'gain'; the sum is normalised
+// back to [-1, 1].
+//
+// Rows are evaluated 8 (AVX2) or 4 (SSE2) samples at a time with a scalar
+// tail. Every path does the same float operations in the same order, so a
+// seed gives the same terrain whichever path a build uses.
+struct NoiseSettings {
+    uint32_t seed = 0;
+    int octaves = 5;
+    float gain = 0.5f;
+};
+
+// Samples at (x, z0 + i * zStep) for i in [0, count)
+void fractalNoiseRow(const NoiseSettings& settings, float x, float z0, float zStep, int count, float* out);
+// The same without SIMD, for comparison and as the reference
+void fractalNoiseRowScalar(const NoiseSettings& settings, float x, float z0, float zStep, int count, float* out);
+// One sample
+float fractalNoise(const NoiseSettings& settings, float x, float z);
+
+// Fractal 3D value noise, for cave density. Scalar only: callers sample it
+// on a coarse grid and interpolate, so it is far from the hot loop.
+float fractalNoise3(const NoiseSettings& settings, float x, float y, float z);
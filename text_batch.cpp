@@ -0,0 +1,288 @@
+#include "text_batch.h"
+#include "gl_state.h"
+#include "memory_tracking.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+static const char* textVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;     // Pixels, origin bottom-left
+layout (location = 1) in vec2 aTexCoord; // Texels
+layout (location = 2) in vec4 aColor;
+layout (location = 3) in float aImage;
+
+out vec2 texCoord;
+out vec4 textColor;
+flat out float imageQuad;
+
+uniform vec2 screenSize;
+
+void main()
+{
+    gl_Position = vec4(aPos / screenSize * 2.0 - 1.0, 0.0, 1.0);
+    texCoord = aTexCoord;
+    textColor = aColor;
+    imageQuad = aImage;
+}
+)";
+
+static const char* textFragmentShaderSource = R"(
+#version 330 core
+in vec2 texCoord;
+in vec4 textColor;
+flat in float imageQuad;
+out vec4 FragColor;
+
+uniform sampler2D glyphs; // Coverage, or signed distance, in the red channel
+uniform bool sdf;
+uniform sampler2D image;  // Of addImage() quads
+
+void main()
+{
+    if (imageQuad > 0.5) {
+        FragColor = texture(image, texCoord) * textColor;
+        return;
+    }
+    float value = texture(glyphs, texCoord / vec2(textureSize(glyphs, 0))).r;
+    if (sdf) {
+        // Antialias over about one screen pixel around the edge at any scale
+        float width = max(fwidth(value) * 0.7, 1e-4);
+        value = smoothstep(0.5 - width, 0.5 + width, value);
+    }
+    FragColor = vec4(textColor.rgb, textColor.a * value);
+}
+)";
+
+// Slots reserve glyph quads in steps of this, so small edits stay in place
+const int SLOT_GRANULARITY = 8;
+
+void TextBatch::init(GlyphAtlas* glyphAtlas)
+{
+    MemoryTagScope memoryTag(MEMORY_TEXT);
+    atlas = glyphAtlas;
+    program.create(textVertexShaderSource, textFragmentShaderSource);
+    program.use();
+    glUniform1i(program.uniform("glyphs"), atlas->textureUnit);
+    glUniform1i(program.uniform("sdf"), atlas->mode == GLYPH_SDF);
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), (void*)(4 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, image));
+    glEnableVertexAttribArray(3);
+    glState().bindVertexArray(0);
+}
+
+void TextBatch::destroy()
+{
+    program.destroy();
+    glState().deleteVertexArrays(1, &VAO);
+    glState().deleteBuffers(1, &VBO);
+    VAO = VBO = 0;
+    slots.clear();
+    vertices.clear();
+}
+
+void TextBatch::begin()
+{
+    used = 0;
+    rewrittenGlyphs = 0;
+    dirtyBegin = INT32_MAX;
+    dirtyEnd = 0;
+}
+
+void TextBatch::add(const char* text, int length, float x, float y, float scale, const glm::vec3& color)
+{
+    if (used == (int)slots.size()) {
+        slots.push_back(Slot{ std::string(), x, y, scale, color, 0, 0 });
+        relayout = true;
+    }
+    Slot& slot = slots[used++];
+    bool sameText = (int)slot.text.size() == length && memcmp(slot.text.data(), text, (size_t)length) == 0;
+    if (sameText && !slot.image && slot.x == x && slot.y == y && slot.scale == scale && slot.color == color && slot.capacity >= length)
+        return;
+
+    // Assigned in place: the string only grows
+    if (slot.image) {
+        slot.image = false;
+        relayout = true;
+    }
+    slot.text.assign(text, (size_t)length);
+    slot.x = x;
+    slot.y = y;
+    slot.scale = scale;
+    slot.color = color;
+    if (length > slot.capacity || relayout) {
+        relayout = true;
+        return;
+    }
+    writeSlot(slot);
+    dirtyBegin = std::min(dirtyBegin, slot.first);
+    dirtyEnd = std::max(dirtyEnd, slot.first + slot.capacity);
+}
+
+void TextBatch::add(const char* text, float x, float y, float scale, const glm::vec3& color)
+{
+    add(text, (int)strlen(text), x, y, scale, color);
+}
+
+void TextBatch::addf(float x, float y, float scale, const glm::vec3& color, const char* format, ...)
+{
+    char text[MAX_FORMATTED_CHARS + 1];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0)
+        length = 0;
+    add(text, std::min(length, MAX_FORMATTED_CHARS), x, y, scale, color);
+}
+
+void TextBatch::addImage(float x, float y, float width, float height, const glm::vec4& uv, const glm::vec3& color)
+{
+    if (used == (int)slots.size()) {
+        slots.push_back(Slot{ std::string(), x, y, 1.0f, color, 0, 0 });
+        relayout = true;
+    }
+    Slot& slot = slots[used++];
+    if (slot.image && slot.x == x && slot.y == y && slot.width == width && slot.height == height &&
+        slot.uv == uv && slot.color == color)
+        return;
+
+    if (!slot.image) {
+        slot.image = true;
+        slot.text.clear();
+        relayout = true;
+    }
+    slot.x = x;
+    slot.y = y;
+    slot.width = width;
+    slot.height = height;
+    slot.uv = uv;
+    slot.color = color;
+    if (relayout)
+        return;
+    writeSlot(slot);
+    dirtyBegin = std::min(dirtyBegin, slot.first);
+    dirtyEnd = std::max(dirtyEnd, slot.first + slot.capacity);
+}
+
+void TextBatch::setImageUnit(int unit)
+{
+    program.use();
+    glUniform1i(program.uniform("image"), unit);
+}
+
+void TextBatch::writeSlot(const Slot& slot)
+{
+    uint8_t rgba[4] = {
+        (uint8_t)(glm::clamp(slot.color.r, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (uint8_t)(glm::clamp(slot.color.g, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (uint8_t)(glm::clamp(slot.color.b, 0.0f, 1.0f) * 255.0f + 0.5f),
+        255
+    };
+
+    TextVertex* out = &vertices[(size_t)slot.first * 6];
+    if (slot.image) {
+        float x0 = slot.x, y0 = slot.y, x1 = slot.x + slot.width, y1 = slot.y + slot.height;
+        const glm::vec4& uv = slot.uv;
+        const TextVertex quad[6] = {
+            { x0, y1, uv.x, uv.y }, { x0, y0, uv.x, uv.w }, { x1, y0, uv.z, uv.w },
+            { x0, y1, uv.x, uv.y }, { x1, y0, uv.z, uv.w }, { x1, y1, uv.z, uv.y },
+        };
+        for (int v = 0; v < 6; v++) {
+            out[v] = quad[v];
+            memcpy(out[v].color, rgba, sizeof(rgba));
+            out[v].image[0] = 1;
+        }
+        return;
+    }
+    float cursor = slot.x;
+    for (int i = 0; i < slot.capacity; i++, out += 6) {
+        if (i >= (int)slot.text.size()) {
+            // Padding: zero-area quad, never rasterised
+            for (int v = 0; v < 6; v++)
+                out[v] = TextVertex{ 0.0f, 0.0f, 0.0f, 0.0f, { 0, 0, 0, 0 }, { 0, 0, 0, 0 } };
+            continue;
+        }
+        const Glyph& g = atlas->glyph(slot.text[i]);
+        float x0 = cursor + g.bearing.x * slot.scale;
+        float y1 = slot.y + g.bearing.y * slot.scale;
+        float x1 = x0 + g.size.x * slot.scale;
+        float y0 = y1 - g.size.y * slot.scale;
+        const glm::vec4& uv = g.uv; // left, top, right, bottom
+        const TextVertex quad[6] = {
+            { x0, y1, uv.x, uv.y }, { x0, y0, uv.x, uv.w }, { x1, y0, uv.z, uv.w },
+            { x0, y1, uv.x, uv.y }, { x1, y0, uv.z, uv.w }, { x1, y1, uv.z, uv.y },
+        };
+        for (int v = 0; v < 6; v++) {
+            out[v] = quad[v];
+            memcpy(out[v].color, rgba, sizeof(rgba));
+        }
+        cursor += g.advance * slot.scale;
+    }
+    rewrittenGlyphs += (int)slot.text.size();
+}
+
+int TextBatch::flush(int screenWidth, int screenHeight)
+{
+    if (used < (int)slots.size()) {
+        slots.resize(used);
+        relayout = true;
+    }
+
+    glState().bindVertexArray(VAO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    if (relayout) {
+        // Fresh capacities with headroom, then everything is rewritten
+        int quads = 0;
+        for (Slot& slot : slots) {
+            slot.first = quads;
+            slot.capacity = slot.image ? 1 : ((int)slot.text.size() + SLOT_GRANULARITY - 1) / SLOT_GRANULARITY * SLOT_GRANULARITY;
+            quads += slot.capacity;
+        }
+        vertices.resize((size_t)quads * 6);
+        for (const Slot& slot : slots)
+            writeSlot(slot);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TextVertex), vertices.data(), GL_DYNAMIC_DRAW);
+        relayout = false;
+    }
+    else if (dirtyBegin < dirtyEnd) {
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)dirtyBegin * 6 * sizeof(TextVertex),
+            (GLsizeiptr)(dirtyEnd - dirtyBegin) * 6 * sizeof(TextVertex), &vertices[(size_t)dirtyBegin * 6]);
+    }
+
+    atlas->upload();
+    if (vertices.empty() || atlas->texture == 0)
+        return 0;
+
+    // Blended over the scene, always filled, without depth
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().disable(GL_DEPTH_TEST);
+    glState().enable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    program.use();
+    glUniform2f(program.uniform("screenSize"), (float)screenWidth, (float)screenHeight);
+    // The atlas stays bound to its own unit, so no texture changes here
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+
+    glState().disable(GL_BLEND);
+    glState().enable(GL_DEPTH_TEST);
+    glState().polygonMode(polygonMode);
+    return 1;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "glyph_atlas.h"
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Screen-space text from every add() of a frame, drawn by flush() in one
+// call from a persistent vertex buffer. The n-th add() of a frame reuses
+// the n-th slot of the previous frame, so a string whose text, position
+// and colour haven't changed costs nothing; changed slots are rewritten in
+// place while they fit their capacity, and the layout is rebuilt otherwise.
+// HUD images (addImage()) are slots of one quad in the same draw, sampling
+// a second texture that stays bound to its own unit.
+struct TextBatch {
+    // 'atlas' must outlive the batch
+    void init(GlyphAtlas* atlas);
+    void destroy();
+
+    // Start a frame's text
+    void begin();
+    // Queue 'length' characters of 'text' at pixel position (x, y) of its
+    // baseline, y up. Slots keep their strings' storage, so once the HUD has
+    // settled queuing text allocates nothing.
+    void add(const char* text, int length, float x, float y, float scale, const glm::vec3& color);
+    // ... a null-terminated string
+    void add(const char* text, float x, float y, float scale, const glm::vec3& color);
+    void add(const std::string& text, float x, float y, float scale, const glm::vec3& color)
+    {
+        add(text.c_str(), (int)text.size(), x, y, scale, color);
+    }
+    // ... printf-style 'format', formatted on the stack (cut at
+    // MAX_FORMATTED_CHARS)
+    static const int MAX_FORMATTED_CHARS = 127;
+    void addf(float x, float y, float scale, const glm::vec3& color, const char* format, ...);
+    // Queue a quad covering pixels (x, y) to (x + width, y + height), y up,
+    // of the texture on imageUnit at 'uv' (left, top, right, bottom,
+    // normalised and addressed as the texture's wrap mode says), tinted by
+    // 'color'
+    void addImage(float x, float y, float width, float height, const glm::vec4& uv, const glm::vec3& color);
+    // Texture unit addImage() quads sample; the texture stays bound there
+    void setImageUnit(int unit);
+    // Upload changed slots and newly rasterised glyphs, then draw everything
+    // queued since begin().
+    // Returns the number of draw calls (0 or 1).
+    int flush(int screenWidth, int screenHeight);
+
+    int rewrittenGlyphs = 0;    // Glyph quads written since begin()
+
+private:
+    struct TextVertex {
+        float x, y, u, v;   // Texels of the glyph atlas, or normalised for images
+        uint8_t color[4];
+        uint8_t image[4];   // [0] is 1 in image quads; the rest pad
+    };
+
+    struct Slot {
+        std::string text;
+        float x, y, scale;
+        glm::vec3 color;
+        int first;      // First glyph quad in the buffer
+        int capacity;   // Glyph quads reserved; unused ones are degenerate
+        bool image = false;     // An addImage() quad instead of text
+        float width = 0.0f, height = 0.0f;
+        glm::vec4 uv = glm::vec4(0.0f);
+    };
+
+    // Write a slot's glyph quads (and padding) into the vertex mirror
+    void writeSlot(const Slot& slot);
+
+    GlyphAtlas* atlas = nullptr;
+    ShaderProgram program;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+
+    std::vector<Slot> slots;
+    std::vector<TextVertex> vertices;   // CPU copy of the buffer, six per glyph quad
+    int used = 0;                       // Slots added this frame
+    bool relayout = false;              // Slot set or capacities changed
+    int dirtyBegin = 0;                 // Glyph quad range to upload
+    int dirtyEnd = 0;
+};
@@ -0,0 +1,92 @@
+#include "thread_priority.h"
+
+#include <thread>
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef __APPLE__
+#include <pthread/qos.h>
+#endif
+#endif
+
+const char* THREAD_PRIORITY_NAMES[3] = { "low", "normal", "high" };
+
+int hardwareThreadCount()
+{
+    int count = (int)std::thread::hardware_concurrency();
+#ifdef __linux__
+    // Fewer when the process is restricted to a subset (taskset, containers)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+        count = CPU_COUNT(&set);
+#endif
+    return count > 0 ? count : 1;
+}
+
+bool setCurrentThreadPriority(ThreadPriority priority)
+{
+#ifdef _MSC_VER
+    static const int WINDOWS_PRIORITY[3] = { THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL };
+    bool applied = SetThreadPriority(GetCurrentThread(), WINDOWS_PRIORITY[priority]) != 0;
+#ifdef THREAD_POWER_THROTTLING_CURRENT_VERSION
+    // EcoQoS for background threads, which Windows 11 schedules on
+    // efficiency cores; everything else opts out of it
+    THREAD_POWER_THROTTLING_STATE throttling = {};
+    throttling.Version = THREAD_POWER_THROTTLING_CURRENT_VERSION;
+    throttling.ControlMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+    throttling.StateMask = priority == THREAD_LOW_PRIORITY ? THREAD_POWER_THROTTLING_EXECUTION_SPEED : 0;
+    SetThreadInformation(GetCurrentThread(), ThreadPowerThrottling, &throttling, sizeof(throttling));
+#endif
+    return applied;
+#elif defined(__APPLE__)
+    // Quality of service classes also pick between performance and
+    // efficiency cores
+    static const qos_class_t QOS[3] = { QOS_CLASS_UTILITY, QOS_CLASS_USER_INITIATED, QOS_CLASS_USER_INTERACTIVE };
+    return pthread_set_qos_class_self_np(QOS[priority], 0) == 0;
+#elif defined(__linux__)
+    // Nice values are per thread on Linux; only root may go below 0
+    static const int THREAD_NICE[3] = { 10, 0, -5 };
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), THREAD_NICE[priority]) == 0;
+#else
+    (void)priority;
+    return false;
+#endif
+}
+
+bool pinCurrentThread(int core)
+{
+    core %= hardwareThreadCount();
+#ifdef _MSC_VER
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+    // The core'th processor the process may run on
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return false;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || core-- > 0)
+            continue;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+    return false;
+#else
+    // macOS has no hard affinity
+    (void)core;
+    return false;
+#endif
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Scheduling hints for the calling thread. All of them are best effort:
+// raising a priority usually needs privileges outside Windows, and failures
+// leave the thread as it was.
+enum ThreadPriority {
+    THREAD_LOW_PRIORITY,        // Background work (saves, streaming): below normal, and on
+                                // hybrid CPUs marked efficient so the OS can keep it on E-cores
+    THREAD_NORMAL_PRIORITY,
+    THREAD_HIGH_PRIORITY,       // The frame's critical path (the render thread)
+};
+extern const char* THREAD_PRIORITY_NAMES[3];
+
+// Logical processors the process can run on (at least 1)
+int hardwareThreadCount();
+// Apply 'priority' to the calling thread. Returns false if the OS refused.
+bool setCurrentThreadPriority(ThreadPriority priority);
+// Keep the calling thread on logical processor 'core' (taken modulo
+// hardwareThreadCount()). Returns false where pinning isn't supported.
+bool pinCurrentThread(int core);
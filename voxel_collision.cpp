@@ -0,0 +1,40 @@
+#include "voxel_collision.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+
+double sweepBoxAxis(WorldCursor& cursor, const glm::dvec3& boxMin, const glm::dvec3& boxMax, int axis, double delta)
+{
+    if (delta == 0.0)
+        return 0.0;
+
+    // Block range covered by the box on the two other axes
+    int a = (axis + 1) % 3;
+    int b = (axis + 2) % 3;
+    int aMin = (int)std::floor(boxMin[a] + COLLISION_SKIN), aMax = (int)std::floor(boxMax[a] - COLLISION_SKIN);
+    int bMin = (int)std::floor(boxMin[b] + COLLISION_SKIN), bMax = (int)std::floor(boxMax[b] - COLLISION_SKIN);
+
+    // Layers swept by the leading face, nearest first
+    double lead = delta > 0.0 ? boxMax[axis] : boxMin[axis];
+    int step = delta > 0.0 ? 1 : -1;
+    int first = delta > 0.0 ? (int)std::ceil(lead - COLLISION_SKIN) : (int)std::floor(lead + COLLISION_SKIN) - 1;
+    int last = (int)std::floor(lead + delta);
+    for (int layer = first; step > 0 ? layer <= last : layer >= last; layer += step) {
+        for (int i = aMin; i <= aMax; i++) {
+            for (int j = bMin; j <= bMax; j++) {
+                glm::ivec3 block;
+                block[axis] = layer;
+                block[a] = i;
+                block[b] = j;
+                if (!blocksMovement(cursor.getBlock(block)))
+                    continue;
+
+                // Stop just short of the layer's near face
+                double allowed = delta > 0.0 ? layer - lead - COLLISION_SKIN : layer + 1 - lead + COLLISION_SKIN;
+                return delta > 0.0 ? std::max(0.0, std::min(delta, allowed)) : std::min(0.0, std::max(delta, allowed));
+            }
+        }
+    }
+    return delta;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+struct WorldCursor;
+
+// Gap kept between a box and a surface it stops against
+const double COLLISION_SKIN = 1e-3;
+
+// Blocks a moving box can't enter (water is waded through)
+inline bool blocksMovement(BlockId id) { return (BLOCK_PROPERTIES[id].flags & BLOCK_SOLID) != 0; }
+
+// Swept box against the block grid along one axis: how far of 'delta' the
+// box from 'boxMin' to 'boxMax' can move along 'axis' before its leading
+// face reaches a layer with a solid block in its path, stopping
+// COLLISION_SKIN short of it. Layers the box already overlaps are skipped,
+// so a box spawned inside blocks can move out. Applying the motion one axis
+// at a time with this gives swept AABB collision.
+double sweepBoxAxis(WorldCursor& cursor, const glm::dvec3& boxMin, const glm::dvec3& boxMax, int axis, double delta);
@@ -0,0 +1,112 @@
+#include "voxel_raycast.h"
+#include "job_system.h"
+#include "world.h"
+
+#include <limits>
+
+bool raycastBlocks(const World& world, const glm::dvec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit)
+{
+    if (direction == glm::vec3(0.0f))
+        return false;
+    glm::dvec3 dir = glm::normalize(glm::dvec3(direction));
+
+    // Distance to the first boundary on each axis and between boundaries
+    const double INF = std::numeric_limits<double>::infinity();
+    glm::ivec3 block = glm::ivec3(glm::floor(origin));
+    glm::ivec3 step;
+    glm::dvec3 tMax, tDelta;
+    for (int axis = 0; axis < 3; axis++) {
+        if (dir[axis] > 0.0) {
+            step[axis] = 1;
+            tMax[axis] = (block[axis] + 1 - origin[axis]) / dir[axis];
+            tDelta[axis] = 1.0 / dir[axis];
+        }
+        else if (dir[axis] < 0.0) {
+            step[axis] = -1;
+            tMax[axis] = (origin[axis] - block[axis]) / -dir[axis];
+            tDelta[axis] = -1.0 / dir[axis];
+        }
+        else {
+            step[axis] = 0;
+            tMax[axis] = INF;
+            tDelta[axis] = INF;
+        }
+    }
+
+    const Chunk* chunk = nullptr;
+    glm::ivec3 chunkCoord = chunkCoordOf(block) + glm::ivec3(1); // Forces the first lookup
+    int face = -1;
+    double t = 0.0;
+    for (;;) {
+        glm::ivec3 coord = chunkCoordOf(block);
+        if (world.sectionEmpty(coord)) {
+            // Nothing but air in this chunk (or none loaded): jump straight
+            // to the block where the ray leaves it, without a lookup
+            int exitAxis = 0;
+            double exit = INF;
+            for (int axis = 0; axis < 3; axis++) {
+                if (step[axis] == 0)
+                    continue;
+                double boundary = (double)(step[axis] > 0 ? coord[axis] + 1 : coord[axis]) * CHUNK_SIZE;
+                double crossing = (boundary - origin[axis]) / dir[axis];
+                if (crossing < exit) {
+                    exit = crossing;
+                    exitAxis = axis;
+                }
+            }
+            t = exit;
+            if (t > maxDistance)
+                return false;
+            glm::dvec3 at = origin + dir * t;
+            for (int axis = 0; axis < 3; axis++) {
+                int first = coord[axis] * CHUNK_SIZE;
+                if (axis == exitAxis)
+                    block[axis] = step[axis] > 0 ? first + CHUNK_SIZE : first - 1;
+                else
+                    block[axis] = glm::clamp((int)glm::floor(at[axis]), first, first + CHUNK_SIZE - 1);
+                if (step[axis] > 0)
+                    tMax[axis] = (block[axis] + 1 - origin[axis]) / dir[axis];
+                else if (step[axis] < 0)
+                    tMax[axis] = (origin[axis] - block[axis]) / -dir[axis];
+            }
+            face = exitAxis * 2 + (step[exitAxis] > 0 ? 0 : 1);
+            continue;
+        }
+        if (coord != chunkCoord) {
+            chunk = world.getChunk(coord);
+            chunkCoord = coord;
+        }
+        if (chunk) {
+            glm::ivec3 local = block - coord * CHUNK_SIZE;
+            BlockId id = chunk->get(local.x, local.y, local.z);
+            if (id != BLOCK_AIR) {
+                hit.block = block;
+                hit.face = face;
+                hit.distance = (float)t;
+                hit.id = id;
+                return true;
+            }
+        }
+
+        // Step across the nearest boundary
+        int axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+        t = tMax[axis];
+        if (t > maxDistance)
+            return false;
+        block[axis] += step[axis];
+        tMax[axis] += tDelta[axis];
+        face = axis * 2 + (step[axis] > 0 ? 0 : 1);
+    }
+}
+
+void raycastBatch(const World& world, const VoxelRay* rays, int count, RayHit* hits, bool* found, JobSystem* jobs)
+{
+    auto castRange = [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            found[i] = raycastBlocks(world, rays[i].origin, rays[i].direction, rays[i].maxDistance, hits[i]);
+    };
+    if (jobs)
+        jobs->parallelFor(count, 64, castRange);
+    else
+        castRange(0, count);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <glm/glm.hpp>
+
+struct World;
+struct JobSystem;
+
+// Result of a voxel ray query
+struct RayHit {
+    glm::ivec3 block;   // World block position of the first solid block
+    int face;           // Face of that block the ray entered through (-X, +X, -Y, +Y, -Z, +Z), -1 if it started inside
+    float distance;     // Along the ray to the entry point
+    BlockId id;
+};
+
+// One ray of a batched query
+struct VoxelRay {
+    glm::dvec3 origin;
+    glm::vec3 direction;    // Need not be normalised
+    float maxDistance;
+};
+
+// Walk the block grid from 'origin' along 'direction' with the Amanatides-Woo
+// DDA, visiting exactly the blocks the ray crosses, nearest first, until a
+// solid block or 'maxDistance'. Only loaded chunks are solid; the chunk
+// lookup is repeated only when the ray enters a new chunk, and a chunk
+// World::sectionEmpty() reports is crossed in one step to the block where
+// the ray leaves it. Returns true on a hit and fills 'hit'.
+bool raycastBlocks(const World& world, const glm::dvec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit);
+
+// Run 'count' rays, split across 'jobs' when given. hits[i] is valid where
+// found[i] is set. The world must not change until this returns.
+void raycastBatch(const World& world, const VoxelRay* rays, int count, RayHit* hits, bool* found, JobSystem* jobs);
@@ -0,0 +1,132 @@
+#include "weighted_oit.h"
+#include "gl_state.h"
+
+static const char* compositeVertexSource = R"(
+#version 330 core
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char* compositeFragmentSource = R"(
+#version 330 core
+uniform sampler2D accumulation;
+uniform sampler2D weights;
+out vec4 FragColor;
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumulation, p, 0);
+    float revealage = accum.a;
+    if (revealage >= 1.0)
+        discard;    // Nothing translucent here
+    FragColor = vec4(accum.rgb / max(texelFetch(weights, p, 0).r, 1e-5), 1.0 - revealage);
+}
+)";
+
+void WeightedOit::init()
+{
+    compositeProgram.create(compositeVertexSource, compositeFragmentSource);
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+void WeightedOit::destroy()
+{
+    destroyTargets();
+    compositeProgram.destroy();
+    glState().deleteVertexArrays(1, &emptyVAO);
+    emptyVAO = 0;
+}
+
+void WeightedOit::destroyTargets()
+{
+    glState().deleteFramebuffers(1, &framebuffer);
+    glState().deleteTextures(1, &accumTexture);
+    glState().deleteTextures(1, &weightTexture);
+    framebuffer = accumTexture = weightTexture = 0;
+    attachedDepth = 0;
+}
+
+static unsigned int createTarget(GLenum format, int w, int h)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glState().bindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format == GL_R16F ? GL_RED : GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+bool WeightedOit::resize(int w, int h, unsigned int depthTexture, unsigned int depthRenderbuffer)
+{
+    unsigned int depth = depthTexture ? depthTexture : depthRenderbuffer;
+    if (framebuffer != 0 && w == width && h == height && depth == attachedDepth)
+        return true;
+    destroyTargets();
+    width = w;
+    height = h;
+
+    accumTexture = createTarget(GL_RGBA16F, w, h);
+    weightTexture = createTarget(GL_R16F, w, h);
+    glGenFramebuffers(1, &framebuffer);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+    if (depthTexture)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    else
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete) {
+        destroyTargets();
+        return false;
+    }
+    attachedDepth = depth;
+    return true;
+}
+
+void WeightedOit::begin()
+{
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    const float clearAccum[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float clearWeights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, clearAccum);
+    glClearBufferfv(GL_COLOR, 1, clearWeights);
+
+    glState().enable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    glState().depthMask(GL_FALSE);
+}
+
+void WeightedOit::composite(unsigned int sceneFramebuffer, int unit)
+{
+    glState().bindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    GLenum polygonMode = glState().currentPolygonMode();
+    glState().polygonMode(GL_FILL);
+    glState().disable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    compositeProgram.use();
+    glUniform1i(compositeProgram.uniform("accumulation"), unit);
+    glUniform1i(compositeProgram.uniform("weights"), unit + 1);
+    glState().activeTexture(GL_TEXTURE0 + unit);
+    glState().bindTexture(GL_TEXTURE_2D, accumTexture);
+    glState().activeTexture(GL_TEXTURE0 + unit + 1);
+    glState().bindTexture(GL_TEXTURE_2D, weightTexture);
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glState().disable(GL_BLEND);
+    glState().enable(GL_DEPTH_TEST);
+    glState().depthMask(GL_TRUE);
+    glState().polygonMode(polygonMode);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "shader.h"
+
+// Weighted blended order-independent transparency (McGuire and Bavoil,
+// JCGT 2013). Translucent surfaces are drawn in any order, depth tested
+// against the scene but not written, into two float targets:
+//   accumulation RGBA16F: rgb adds colour * alpha * weight, a multiplies
+//                         by (1 - alpha) (the revealage: how much of the
+//                         scene still shows through)
+//   weights      R16F:    adds alpha * weight
+// One glBlendFuncSeparate (colour ONE, ONE; alpha ZERO, ONE_MINUS_SRC_ALPHA)
+// gives both, so GL 3.3 without per-target blend functions is enough.
+// composite() then blends the weighted average colour over the scene with
+// coverage 1 - revealage. Weights favour nearer surfaces, which is close to
+// the sorted result for a few layers of similar alpha, the common case.
+struct WeightedOit {
+    unsigned int framebuffer = 0;
+    unsigned int accumTexture = 0;
+    unsigned int weightTexture = 0;
+    int width = 0;
+    int height = 0;
+
+    // Build the composite program. Targets are created by resize().
+    void init();
+    void destroy();
+    // Size the targets to the scene and share its depth: 'depthTexture' if
+    // non-zero, else 'depthRenderbuffer'. No-op if nothing changed; returns
+    // false if the framebuffer is incomplete.
+    bool resize(int width, int height, unsigned int depthTexture, unsigned int depthRenderbuffer);
+
+    // Bind and clear the targets and set up blending and depth for the
+    // translucent draws
+    void begin();
+    // Blend the result over 'sceneFramebuffer' (sampling through texture
+    // units 'unit' and 'unit' + 1) and restore blending and depth writes
+    void composite(unsigned int sceneFramebuffer, int unit);
+
+private:
+    void destroyTargets();
+
+    ShaderProgram compositeProgram;
+    unsigned int emptyVAO = 0;  // Fullscreen triangle from gl_VertexID
+    unsigned int attachedDepth = 0;
+};
@@ -0,0 +1,842 @@
+#include "world.h"
+#include "fluid_simulation.h"
+#include "generation_cache.h"
+#include "light_engine.h"
+#include "navigation_graph.h"
+#include "profiler.h"
+#include "region_file.h"
+#include "terrain_decoration.h"
+#include "voxel_collision.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+// Terrain for groundHeight(): opaque, and not wood or leaves
+static bool isGround(BlockId id)
+{
+    return isOpaque(id) && id != BLOCK_WOOD && id != BLOCK_LEAVES;
+}
+
+Chunk* World::getChunk(const glm::ivec3& coord) const
+{
+    const std::unique_ptr<Chunk>* chunk = chunkMap.find(packChunkCoord(coord));
+    if (!chunk)
+        return nullptr;
+    touch(**chunk);
+    return chunk->get();
+}
+
+void World::touch(const Chunk& chunk) const
+{
+    // Relaxed: the clock only moves while nothing reads the world
+    if (chunk.lastRead.load(std::memory_order_relaxed) != coldClock)
+        chunk.lastRead.store(coldClock, std::memory_order_relaxed);
+    if (!chunk.isCold())
+        return;
+    std::lock_guard<std::mutex> lock(thawMutex);
+    // The voxels read the same after the thaw, so a const chunk may be thawed
+    if (chunk.isCold())
+        const_cast<Chunk&>(chunk).thaw();
+}
+
+Chunk* World::loadChunk(const glm::ivec3& coord)
+{
+    Chunk* chunk = getChunk(coord);
+    if (chunk)
+        return chunk;
+
+    std::unique_ptr<Chunk> created(new Chunk());
+    if (!storage || !storage->load(coord, *created)) {
+        if (generationCache && generationCache->fetch(seed, coord, created->blocks)) {
+            created->coord = coord;
+            created->dirty = true;
+        }
+        else {
+            TerrainNeighbourhood terrain;
+            columns.getNeighbourhood(glm::ivec2(coord.x, coord.z), seed, terrain);
+            generateChunk(*created, coord, terrain, seed);
+            // Uniform chunks come out of the generator in O(1); only cache the rest
+            if (generationCache && !created->isUniform())
+                generationCache->store(seed, coord, created->blocks);
+        }
+    }
+
+    chunk = created.get();
+    chunkMap[packChunkCoord(coord)] = std::move(created);
+    chunkList.push_back(chunk);
+    updateSection(*chunk, true);
+    updateSkyHeights(*chunk, nullptr, glm::ivec3(0), glm::ivec3(CHUNK_SIZE), true);
+    waitingChunks.push_back(chunk);
+    return chunk;
+}
+
+void World::unloadChunk(const glm::ivec3& coord)
+{
+    uint64_t key = packChunkCoord(coord);
+    std::unique_ptr<Chunk>* chunk = chunkMap.find(key);
+    if (!chunk)
+        return;
+    if (storage && (*chunk)->unsaved)
+        saveChunk(**chunk);
+    if ((*chunk)->state == CHUNK_GENERATED)
+        waitingChunks.erase(std::find(waitingChunks.begin(), waitingChunks.end(), chunk->get()));
+    else {
+        if (lighting)
+            lighting->chunkUnloaded(coord);
+        if (navigation)
+            navigation->chunkUnloaded(coord);
+    }
+    if (fluids)
+        fluids->chunkUnloaded(**chunk);
+    if (generator)
+        generator->release(coord);
+    (*chunk)->state = CHUNK_UNLOADING;
+    updateSection(**chunk, false);
+    updateSkyHeights(**chunk, nullptr, glm::ivec3(0), glm::ivec3(CHUNK_SIZE), false);
+
+    for (size_t i = 0; i < chunkList.size(); i++) {
+        if (chunkList[i] == chunk->get()) {
+            chunkList[i] = chunkList.back();
+            chunkList.pop_back();
+            break;
+        }
+    }
+    unloadedList.push_back(std::move(*chunk));
+    chunkMap.erase(key);
+}
+
+int World::saveAll()
+{
+    if (!storage)
+        return 0;
+    int saved = 0;
+    for (Chunk* chunk : chunkList) {
+        if (!chunk->unsaved)
+            continue;
+        saveChunk(*chunk);
+        saved++;
+    }
+    return saved;
+}
+
+void World::saveChunk(Chunk& chunk)
+{
+    touch(chunk);
+    // Written on the generator's I/O thread when there is one
+    if (generator)
+        generator->save(chunk);
+    else
+        storage->save(chunk);
+    chunk.unsaved = false;
+}
+
+BlockId World::getBlock(const glm::ivec3& block) const
+{
+    const Chunk* chunk = getChunk(chunkCoordOf(block));
+    if (!chunk)
+        return BLOCK_AIR;
+    glm::ivec3 local = localBlockOf(block);
+    return chunk->get(local.x, local.y, local.z);
+}
+
+bool World::setBlock(const glm::ivec3& block, BlockId id, bool urgent)
+{
+    Chunk* chunk = getChunk(chunkCoordOf(block));
+    if (!chunk)
+        return false;
+
+    glm::ivec3 local = localBlockOf(block);
+    BlockId previous = chunk->get(local.x, local.y, local.z);
+    if (previous == id)
+        return true;
+    chunk->set(local.x, local.y, local.z, id);
+    updateSection(*chunk, true);
+    if (isOpaque(previous) != isOpaque(id) || isGround(previous) != isGround(id))
+        updateSkyHeights(*chunk, nullptr, local, local + 1, true);
+    chunk->edited = chunk->edited || urgent;
+    chunk->unsaved = true;
+    chunk->bakedLight = false; // Saved without light until it is relit on load
+    if (hasBlockListeners())
+        blockEvents.publish(block, previous, id);
+
+    // A border block is also part of the neighbour's snapshot
+    for (int axis = 0; axis < 3; axis++) {
+        int step = local[axis] == 0 ? -1 : (local[axis] == CHUNK_SIZE - 1 ? 1 : 0);
+        if (step == 0)
+            continue;
+        glm::ivec3 coord = chunk->coord;
+        coord[axis] += step;
+        if (Chunk* neighbour = getChunk(coord)) {
+            neighbour->dirty = true;
+            neighbour->edited = neighbour->edited || urgent;
+        }
+    }
+    return true;
+}
+
+void World::flushBlockEvents()
+{
+    blockEvents.drain(blockBatch);
+    if (blockBatch.empty())
+        return;
+    PROFILE_ZONE("Block events");
+    WorldCursor cursor(*this);
+    for (const BlockEvent& event : blockBatch) {
+        BlockId previous = event.previous;
+        BlockId id = event.id;
+        // Light passes translucent blocks as it does air
+        if (lighting && (isOpaque(previous) != isOpaque(id) || blockEmission(previous) != blockEmission(id)))
+            lighting->blockChanged(event.block);
+        if (fluids) {
+            // Only water moves: a change with none on or beside it needs no look
+            bool wet = isWater(previous) || isWater(id);
+            for (int face = 0; face < 6 && !wet; face++) {
+                const int* n = FACE_NORMALS[face];
+                wet = isWater(cursor.getBlock(event.block + glm::ivec3(n[0], n[1], n[2])));
+            }
+            if (wet)
+                fluids->blockChanged(event.block);
+        }
+        if (navigation && blocksMovement(previous) != blocksMovement(id))
+            navigation->blockChanged(event.block);
+        if (changeLog)
+            changeLog->push_back({ event.block, id });
+    }
+}
+
+// Calls visit(coord, localMin, localMax) for each chunk the box [boxMin,
+// boxMax) overlaps, with the part of the box inside it
+template <typename Visit>
+static void forEachSection(const glm::ivec3& boxMin, const glm::ivec3& boxMax, Visit visit)
+{
+    if (glm::any(glm::lessThanEqual(boxMax, boxMin)))
+        return;
+    glm::ivec3 first = chunkCoordOf(boxMin);
+    glm::ivec3 last = chunkCoordOf(boxMax - 1);
+    for (int cx = first.x; cx <= last.x; cx++) {
+        for (int cy = first.y; cy <= last.y; cy++) {
+            for (int cz = first.z; cz <= last.z; cz++) {
+                glm::ivec3 coord(cx, cy, cz);
+                glm::ivec3 origin = coord * CHUNK_SIZE;
+                visit(coord, glm::max(boxMin - origin, glm::ivec3(0)), glm::min(boxMax - origin, glm::ivec3(CHUNK_SIZE)));
+            }
+        }
+    }
+}
+
+static bool wholeChunk(const glm::ivec3& localMin, const glm::ivec3& localMax)
+{
+    return localMin == glm::ivec3(0) && localMax == glm::ivec3(CHUNK_SIZE);
+}
+
+int World::sectionEdited(Chunk& chunk, const glm::ivec3& localMin, const glm::ivec3& localMax,
+    const BlockId* before, const BlockId* after, bool urgent)
+{
+    glm::ivec3 origin = chunk.coord * CHUNK_SIZE;
+    int changed = 0;
+    int borders = 0; // Bit per face (-X, +X, ...) with a changed block on it
+    for (int x = localMin.x; x < localMax.x; x++) {
+        for (int y = localMin.y; y < localMax.y; y++) {
+            for (int z = localMin.z; z < localMax.z; z++) {
+                int i = chunkIndex(x, y, z);
+                BlockId previous = before[i];
+                BlockId id = after[i];
+                if (previous == id)
+                    continue;
+                changed++;
+                glm::ivec3 local(x, y, z);
+                glm::ivec3 block = origin + local;
+                if (hasBlockListeners())
+                    blockEvents.publish(block, previous, id);
+                for (int axis = 0; axis < 3; axis++) {
+                    if (local[axis] == 0)
+                        borders |= 1 << (2 * axis);
+                    else if (local[axis] == CHUNK_SIZE - 1)
+                        borders |= 2 << (2 * axis);
+                }
+            }
+        }
+    }
+    if (changed == 0)
+        return 0;
+
+    chunk.dirty = true;
+    chunk.edited = chunk.edited || urgent;
+    chunk.unsaved = true;
+    chunk.bakedLight = false;
+    for (int face = 0; face < 6; face++) {
+        if (!(borders & (1 << face)))
+            continue;
+        const int* n = FACE_NORMALS[face];
+        if (Chunk* neighbour = getChunk(chunk.coord + glm::ivec3(n[0], n[1], n[2]))) {
+            neighbour->dirty = true;
+            neighbour->edited = neighbour->edited || urgent;
+        }
+    }
+    return changed;
+}
+
+int World::fillBox(const glm::ivec3& boxMin, const glm::ivec3& boxMax, BlockId id, bool urgent)
+{
+    int changed = 0;
+    BlockId before[CHUNK_VOLUME];
+    BlockId after[CHUNK_VOLUME];
+    forEachSection(boxMin, boxMax, [&](const glm::ivec3& coord, const glm::ivec3& localMin, const glm::ivec3& localMax) {
+        Chunk* chunk = getChunk(coord);
+        if (!chunk || (chunk->isUniform() && chunk->uniformBlock() == id))
+            return;
+        chunk->blocks.decode(before);
+        bool whole = wholeChunk(localMin, localMax);
+        if (whole) {
+            memset(after, id, sizeof(after));
+        }
+        else {
+            memcpy(after, before, sizeof(after));
+            for (int x = localMin.x; x < localMax.x; x++)
+                for (int y = localMin.y; y < localMax.y; y++)
+                    memset(&after[chunkIndex(x, y, localMin.z)], id, localMax.z - localMin.z);
+        }
+        int sectionChanged = sectionEdited(*chunk, localMin, localMax, before, after, urgent);
+        if (sectionChanged > 0) {
+            if (whole)
+                chunk->blocks.fill(id);
+            else
+                chunk->blocks.encode(after); // Uniform again if the fill covered the rest
+            updateSection(*chunk, true);
+            updateSkyHeights(*chunk, after, localMin, localMax, true);
+        }
+        changed += sectionChanged;
+    });
+    return changed;
+}
+
+void World::copyRegion(const glm::ivec3& boxMin, const glm::ivec3& boxMax, BlockRegion& out) const
+{
+    out.size = glm::max(boxMax - boxMin, glm::ivec3(0));
+    out.blocks.assign((size_t)out.size.x * out.size.y * out.size.z, BLOCK_AIR);
+    BlockId flat[CHUNK_VOLUME];
+    forEachSection(boxMin, boxMax, [&](const glm::ivec3& coord, const glm::ivec3& localMin, const glm::ivec3& localMax) {
+        const Chunk* chunk = getChunk(coord);
+        if (!chunk)
+            return;
+        chunk->blocks.decode(flat);
+        glm::ivec3 offset = coord * CHUNK_SIZE - boxMin;
+        for (int x = localMin.x; x < localMax.x; x++)
+            for (int y = localMin.y; y < localMax.y; y++)
+                memcpy(&out.blocks[out.index(offset.x + x, offset.y + y, offset.z + localMin.z)],
+                    &flat[chunkIndex(x, y, localMin.z)], localMax.z - localMin.z);
+    });
+}
+
+int World::pasteRegion(const BlockRegion& region, const glm::ivec3& at, bool urgent)
+{
+    int changed = 0;
+    BlockId before[CHUNK_VOLUME];
+    BlockId after[CHUNK_VOLUME];
+    forEachSection(at, at + region.size, [&](const glm::ivec3& coord, const glm::ivec3& localMin, const glm::ivec3& localMax) {
+        Chunk* chunk = getChunk(coord);
+        if (!chunk)
+            return;
+        chunk->blocks.decode(before);
+        memcpy(after, before, sizeof(after));
+        glm::ivec3 offset = coord * CHUNK_SIZE - at;
+        for (int x = localMin.x; x < localMax.x; x++)
+            for (int y = localMin.y; y < localMax.y; y++)
+                memcpy(&after[chunkIndex(x, y, localMin.z)],
+                    &region.blocks[region.index(offset.x + x, offset.y + y, offset.z + localMin.z)], localMax.z - localMin.z);
+        int sectionChanged = sectionEdited(*chunk, localMin, localMax, before, after, urgent);
+        if (sectionChanged > 0) {
+            chunk->blocks.encode(after);
+            updateSection(*chunk, true);
+            updateSkyHeights(*chunk, after, localMin, localMax, true);
+        }
+        changed += sectionChanged;
+    });
+    return changed;
+}
+
+int World::copyBox(const glm::ivec3& boxMin, const glm::ivec3& boxMax, const glm::ivec3& destination, bool urgent)
+{
+    glm::ivec3 shift = destination - boxMin;
+    if ((shift & CHUNK_MASK) != glm::ivec3(0)) {
+        BlockRegion region;
+        copyRegion(boxMin, boxMax, region);
+        return pasteRegion(region, destination, urgent);
+    }
+
+    // Chunk-aligned: each destination section reads the same section of one
+    // source chunk. Walking against the shift (as memmove does) reads every
+    // source chunk before it is overwritten.
+    if (glm::any(glm::lessThanEqual(boxMax, boxMin)))
+        return 0;
+    glm::ivec3 shiftChunks = shift >> CHUNK_SHIFT;
+    glm::ivec3 first = chunkCoordOf(destination);
+    glm::ivec3 last = chunkCoordOf(destination + (boxMax - boxMin) - 1);
+    int changed = 0;
+    BlockId before[CHUNK_VOLUME];
+    BlockId after[CHUNK_VOLUME];
+    BlockId source[CHUNK_VOLUME];
+    glm::ivec3 count = last - first + 1;
+    for (int ix = 0; ix < count.x; ix++) {
+        for (int iy = 0; iy < count.y; iy++) {
+            for (int iz = 0; iz < count.z; iz++) {
+                glm::ivec3 step(ix, iy, iz);
+                glm::ivec3 coord;
+                for (int axis = 0; axis < 3; axis++)
+                    coord[axis] = shiftChunks[axis] > 0 ? last[axis] - step[axis] : first[axis] + step[axis];
+                Chunk* chunk = getChunk(coord);
+                if (!chunk)
+                    continue;
+                glm::ivec3 origin = coord * CHUNK_SIZE;
+                glm::ivec3 localMin = glm::max(destination - origin, glm::ivec3(0));
+                glm::ivec3 localMax = glm::min(destination + (boxMax - boxMin) - origin, glm::ivec3(CHUNK_SIZE));
+                const Chunk* from = getChunk(coord - shiftChunks);
+
+                chunk->blocks.decode(before);
+                if (from)
+                    from->blocks.decode(source);
+                else
+                    memset(source, BLOCK_AIR, sizeof(source));
+                if (wholeChunk(localMin, localMax)) {
+                    memcpy(after, source, sizeof(after));
+                }
+                else {
+                    memcpy(after, before, sizeof(after));
+                    for (int x = localMin.x; x < localMax.x; x++)
+                        for (int y = localMin.y; y < localMax.y; y++)
+                            memcpy(&after[chunkIndex(x, y, localMin.z)], &source[chunkIndex(x, y, localMin.z)],
+                                localMax.z - localMin.z);
+                }
+                int sectionChanged = sectionEdited(*chunk, localMin, localMax, before, after, urgent);
+                if (sectionChanged > 0) {
+                    if (!wholeChunk(localMin, localMax))
+                        chunk->blocks.encode(after);
+                    else if (from)
+                        chunk->blocks = from->blocks; // The source palette as it is
+                    else
+                        chunk->blocks.fill(BLOCK_AIR);
+                    updateSection(*chunk, true);
+                    updateSkyHeights(*chunk, after, localMin, localMax, true);
+                }
+                changed += sectionChanged;
+            }
+        }
+    }
+    return changed;
+}
+
+size_t World::voxelBytes() const
+{
+    size_t bytes = 0;
+    for (const Chunk* chunk : chunkList)
+        bytes += sizeof(Chunk) + chunk->blocks.memoryUsage() + chunk->light.memoryUsage() + chunk->coldVoxels.capacity();
+    return bytes;
+}
+
+int World::compressColdChunks(int maxChunks)
+{
+    coldClock++;
+    if (coldAfterTicks == 0)
+        return 0;
+    int compressed = 0;
+    for (Chunk* chunk : chunkList) {
+        if (compressed >= maxChunks)
+            break;
+        // Not with light or a mesh still to come, nor for nothing
+        if (chunk->isCold() || chunk->state != CHUNK_LIT || chunk->dirty ||
+            (chunk->isUniform() && chunk->light.isUniform()))
+            continue;
+        if (coldClock - chunk->lastRead.load(std::memory_order_relaxed) < coldAfterTicks)
+            continue;
+        if (chunk->freeze())
+            compressed++;
+        else
+            chunk->lastRead.store(coldClock, std::memory_order_relaxed); // Retried after another wait
+    }
+    return compressed;
+}
+
+int World::coldChunkCount() const
+{
+    int count = 0;
+    for (const Chunk* chunk : chunkList)
+        count += chunk->isCold();
+    return count;
+}
+
+int World::budgetRadius(int radius)
+{
+    if (voxelBudgetBytes == 0 || chunkList.empty()) {
+        streamedRadius = radius;
+        return radius;
+    }
+
+    int current = std::min(radius, std::max(streamedRadius, 1));
+    size_t bytes = voxelBytes();
+    if (bytes > voxelBudgetBytes && current > 1) {
+        current--; // The outer ring unloads below, saving changed chunks
+    }
+    else if (current < radius && streamComplete) {
+        // Grow back once the next ring is expected to fit, with some margin,
+        // at the bytes per column loaded now
+        double loadedColumns = (double)chunkList.size() / WORLD_HEIGHT_CHUNKS;
+        double ringColumns = 3.14159265 * (2 * current + 3);
+        double expected = bytes + bytes / loadedColumns * ringColumns;
+        if (expected < voxelBudgetBytes * 0.9)
+            current++;
+    }
+    streamedRadius = current;
+    return current;
+}
+
+void World::updateStreaming(const glm::ivec2& centerColumn, int requestedRadius, int maxLoads,
+    std::vector<Chunk*>& loaded, std::vector<glm::ivec3>& unloaded)
+{
+    int radius = budgetRadius(requestedRadius);
+    streamColumns(centerColumn, radius, maxLoads, loaded, unloaded);
+    settleWaiting(radius);
+}
+
+bool World::neighboursSettled(const glm::ivec3& coord, int radius) const
+{
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        glm::ivec3 neighbour = coord + glm::ivec3(n[0], n[1], n[2]);
+        if (neighbour.y < 0 || neighbour.y >= WORLD_HEIGHT_CHUNKS)
+            continue; // Outside the world
+        int dx = neighbour.x - streamCenter.x;
+        int dz = neighbour.z - streamCenter.y;
+        if (radius >= 0 && dx * dx + dz * dz > radius * radius)
+            continue; // Not streamed from here; it re-meshes this chunk if it comes
+        if (!getChunk(neighbour))
+            return false;
+    }
+    return true;
+}
+
+void World::settleWaiting(int radius)
+{
+    for (size_t i = 0; i < waitingChunks.size(); ) {
+        Chunk* chunk = waitingChunks[i];
+        if (neighboursSettled(chunk->coord, radius)) {
+            chunk->state = lighting ? CHUNK_READY : CHUNK_LIT;
+            if (lighting)
+                lighting->chunkReady(chunk->coord);
+            if (fluids)
+                fluids->chunkReady(*chunk);
+            if (navigation)
+                navigation->chunkReady(chunk->coord);
+            waitingChunks[i] = waitingChunks.back();
+            waitingChunks.pop_back();
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+void World::streamColumns(const glm::ivec2& centerColumn, int radius, int maxLoads,
+    std::vector<Chunk*>& loaded, std::vector<glm::ivec3>& unloaded)
+{
+    // Rebuild the nearest-first column order when the radius changes
+    if (radius != offsetsRadius) {
+        columnOffsets.clear();
+        for (int dx = -radius; dx <= radius; dx++)
+            for (int dz = -radius; dz <= radius; dz++)
+                if (dx * dx + dz * dz <= radius * radius)
+                    columnOffsets.push_back(glm::ivec2(dx, dz));
+
+        std::sort(columnOffsets.begin(), columnOffsets.end(), [](const glm::ivec2& a, const glm::ivec2& b) {
+            return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+        });
+        offsetsRadius = radius;
+        streamComplete = false;
+    }
+
+    // Unload columns that left the range (with one column of hysteresis)
+    if (centerColumn != streamCenter || !streamComplete) {
+        int keep = radius + 1;
+        for (size_t i = 0; i < chunkList.size(); ) {
+            glm::ivec3 coord = chunkList[i]->coord;
+            int dx = coord.x - centerColumn.x;
+            int dz = coord.z - centerColumn.y;
+            if (dx * dx + dz * dz > keep * keep) {
+                unloaded.push_back(coord);
+                unloadChunk(coord); // Swaps the last chunk into slot i
+            }
+            else {
+                i++;
+            }
+        }
+
+        // Forget queued chunks that are no longer wanted
+        if (generator) {
+            std::vector<glm::ivec3> cancelled;
+            generator->cancelOutside(centerColumn, keep, cancelled);
+            for (const glm::ivec3& coord : cancelled)
+                pendingChunks.erase(packChunkCoord(coord));
+        }
+    }
+
+    if (generator)
+        collectGenerated(centerColumn, radius + 1, maxLoads, loaded);
+
+    if (centerColumn != streamCenter) {
+        streamCenter = centerColumn;
+        streamComplete = false;
+    }
+    if (streamComplete)
+        return;
+
+    // Load missing chunks, nearest columns first, within the budget
+    int loads = 0;
+    for (const glm::ivec2& offset : columnOffsets) {
+        for (int y = 0; y < WORLD_HEIGHT_CHUNKS; y++) {
+            glm::ivec3 coord(centerColumn.x + offset.x, y, centerColumn.y + offset.y);
+            if (getChunk(coord))
+                continue;
+
+            if (generator) {
+                // Queue it; the generator orders requests itself
+                if (pendingChunks.insert(packChunkCoord(coord), true))
+                    generator->request(coord);
+                continue;
+            }
+
+            if (loads == maxLoads)
+                return; // Continue next call
+            loaded.push_back(loadChunk(coord));
+            loads++;
+        }
+    }
+    streamComplete = true;
+}
+
+void World::collectGenerated(const glm::ivec2& centerColumn, int keepRadius, int maxResults, std::vector<Chunk*>& loaded)
+{
+    std::vector<Chunk*> finished;
+    generator->collect(finished, maxResults);
+
+    for (Chunk* chunk : finished) {
+        std::unique_ptr<Chunk> owned(chunk);
+        uint64_t key = packChunkCoord(chunk->coord);
+        pendingChunks.erase(key);
+
+        // Drop results that left the range while they were generated
+        int dx = chunk->coord.x - centerColumn.x;
+        int dz = chunk->coord.z - centerColumn.y;
+        if (dx * dx + dz * dz > keepRadius * keepRadius) {
+            generator->release(chunk->coord);
+            continue;
+        }
+        if (chunkMap.contains(key))
+            continue;
+
+        chunkMap[key] = std::move(owned);
+        chunkList.push_back(chunk);
+        updateSection(*chunk, true);
+        updateSkyHeights(*chunk, nullptr, glm::ivec3(0), glm::ivec3(CHUNK_SIZE), true);
+        waitingChunks.push_back(chunk);
+        loaded.push_back(chunk);
+    }
+}
+
+uint16_t World::occupiedSections(const glm::ivec2& column) const
+{
+    const uint16_t* mask = columnSections.find(packChunkCoord(glm::ivec3(column.x, 0, column.y)));
+    return mask ? *mask : 0;
+}
+
+bool World::sectionEmpty(const glm::ivec3& coord) const
+{
+    return coord.y < 0 || coord.y >= WORLD_HEIGHT_CHUNKS ||
+        !(occupiedSections(glm::ivec2(coord.x, coord.z)) & (1u << coord.y));
+}
+
+int World::skyHeight(int x, int z) const
+{
+    glm::ivec3 block(x, 0, z);
+    glm::ivec3 coord = chunkCoordOf(block);
+    const std::unique_ptr<SkyHeights>* heights = skyHeights.find(packChunkCoord(glm::ivec3(coord.x, 0, coord.z)));
+    if (!heights)
+        return -1;
+    glm::ivec3 local = localBlockOf(block);
+    return (*heights)->top[local.x][local.z];
+}
+
+int World::groundHeight(const glm::ivec2& column) const
+{
+    const std::unique_ptr<SkyHeights>* heights = skyHeights.find(packChunkCoord(glm::ivec3(column.x, 0, column.y)));
+    return heights ? (*heights)->lowestGround : -1;
+}
+
+void World::updateSkyHeights(const Chunk& chunk, const BlockId* blocks, const glm::ivec3& localMin,
+    const glm::ivec3& localMax, bool loaded)
+{
+    if (chunk.coord.y < 0 || chunk.coord.y >= WORLD_HEIGHT_CHUNKS)
+        return;
+    uint64_t key = packChunkCoord(glm::ivec3(chunk.coord.x, 0, chunk.coord.z));
+    if (!loaded && occupiedSections(glm::ivec2(chunk.coord.x, chunk.coord.z)) == 0) {
+        skyHeights.erase(key); // Nothing but air left in the column
+        return;
+    }
+    std::unique_ptr<SkyHeights>& heights = skyHeights[key];
+    if (!heights) {
+        heights.reset(new SkyHeights());
+        memset(heights->sectionTop, -1, sizeof(heights->sectionTop));
+        memset(heights->sectionGround, -1, sizeof(heights->sectionGround));
+        memset(heights->top, -1, sizeof(heights->top));
+    }
+
+    int cy = chunk.coord.y;
+    bool uniform = chunk.isUniform() && !blocks;
+    int uniformTop = uniform && isOpaque(chunk.uniformBlock()) ? CHUNK_SIZE - 1 : -1;
+    int uniformGround = uniform && isGround(chunk.uniformBlock()) ? CHUNK_SIZE - 1 : -1;
+    for (int x = localMin.x; x < localMax.x; x++) {
+        for (int z = localMin.z; z < localMax.z; z++) {
+            int sectionTop = -1;
+            int sectionGround = -1;
+            if (loaded && uniform) {
+                sectionTop = uniformTop;
+                sectionGround = uniformGround;
+            }
+            else if (loaded) {
+                for (int y = CHUNK_SIZE - 1; y >= 0 && sectionGround < 0; y--) {
+                    BlockId id = blocks ? blocks[chunkIndex(x, y, z)] : chunk.get(x, y, z);
+                    if (sectionTop < 0 && isOpaque(id))
+                        sectionTop = y;
+                    if (isGround(id))
+                        sectionGround = y;
+                }
+            }
+            heights->sectionTop[cy][x][z] = (int8_t)sectionTop;
+            heights->sectionGround[cy][x][z] = (int8_t)sectionGround;
+
+            // The highest section with an opaque block in this block column
+            int top = -1;
+            for (int y = WORLD_HEIGHT_CHUNKS - 1; y >= 0 && top < 0; y--) {
+                if (heights->sectionTop[y][x][z] >= 0)
+                    top = y * CHUNK_SIZE + heights->sectionTop[y][x][z];
+            }
+            heights->top[x][z] = (int16_t)top;
+        }
+    }
+
+    // The ground of every block column, for the lowest
+    int lowest = std::numeric_limits<int>::max();
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            int ground = -1;
+            for (int y = WORLD_HEIGHT_CHUNKS - 1; y >= 0 && ground < 0; y--) {
+                if (heights->sectionGround[y][x][z] >= 0)
+                    ground = y * CHUNK_SIZE + heights->sectionGround[y][x][z];
+            }
+            lowest = std::min(lowest, ground);
+        }
+    }
+    heights->lowestGround = (int16_t)lowest;
+}
+
+void World::updateSection(const Chunk& chunk, bool loaded)
+{
+    if (chunk.coord.y < 0 || chunk.coord.y >= WORLD_HEIGHT_CHUNKS)
+        return;
+    uint64_t key = packChunkCoord(glm::ivec3(chunk.coord.x, 0, chunk.coord.z));
+    uint16_t bit = (uint16_t)(1u << chunk.coord.y);
+    // Palette and index width stay put in the cold tier: no thaw
+    if (loaded && !(chunk.isUniform() && chunk.uniformBlock() == BLOCK_AIR)) {
+        columnSections[key] |= bit;
+        return;
+    }
+    uint16_t* mask = columnSections.find(key);
+    if (!mask)
+        return;
+    *mask &= (uint16_t)~bit;
+    if (*mask == 0)
+        columnSections.erase(key);
+}
+
+void World::snapshotChunk(const Chunk& chunk, ChunkVoxels& out) const
+{
+    touch(chunk);
+    chunk.decode(out);
+
+    for (int face = 0; face < 6; face++) {
+        const int* n = FACE_NORMALS[face];
+        const Chunk* neighbour = getChunk(chunk.coord + glm::ivec3(n[0], n[1], n[2]));
+        if (!neighbour)
+            continue; // Stays air in full sunlight
+
+        // Copy the neighbour's layer touching this face
+        int d = face / 2;
+        int a = d == 0 ? 1 : 0;
+        int b = d == 2 ? 1 : 2;
+        int pos[3];
+        pos[d] = (face & 1) ? 0 : CHUNK_SIZE - 1;
+        if (neighbour->isUniform()) {
+            memset(out.border[face], neighbour->uniformBlock(), sizeof(out.border[face]));
+        }
+        else {
+            for (pos[a] = 0; pos[a] < CHUNK_SIZE; pos[a]++)
+                for (pos[b] = 0; pos[b] < CHUNK_SIZE; pos[b]++)
+                    out.border[face][pos[a]][pos[b]] = neighbour->get(pos[0], pos[1], pos[2]);
+        }
+        if (neighbour->light.isUniform()) {
+            memset(out.borderLight[face], neighbour->light.uniform, sizeof(out.borderLight[face]));
+        }
+        else {
+            for (pos[a] = 0; pos[a] < CHUNK_SIZE; pos[a]++)
+                for (pos[b] = 0; pos[b] < CHUNK_SIZE; pos[b]++)
+                    out.borderLight[face][pos[a]][pos[b]] = neighbour->light.get(chunkIndex(pos[0], pos[1], pos[2]));
+        }
+    }
+}
+
+uint64_t generatedChunkKey(uint32_t seed, const glm::ivec3& coord)
+{
+    // splitmix64 finaliser over each part in turn
+    auto mix = [](uint64_t h) {
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    };
+    uint64_t h = mix(((uint64_t)GENERATOR_VERSION << 32) | seed);
+    return mix(h ^ packChunkCoord(coord));
+}
+
+void generateChunk(Chunk& chunk, const glm::ivec3& coord, const TerrainNeighbourhood& terrain, uint32_t seed)
+{
+    chunk.coord = coord;
+    chunk.dirty = true;
+
+    // Whole chunks in the sky or deep underground need no per-voxel work,
+    // unless a tree reaches up into them or a cave down
+    const TerrainColumn& column = terrain.centre();
+    CaveDensity caves;
+    bool hasCaves = sampleCaves(column, coord.y, seed, caves);
+    BlockId uniform;
+    if (column.uniformChunk(coord.y, uniform) && !hasCaves && !(uniform == BLOCK_AIR && structuresReach(terrain, coord.y))) {
+        chunk.blocks.fill(uniform);
+        return;
+    }
+
+    BlockId voxels[CHUNK_VOLUME];
+    int baseY = coord.y * CHUNK_SIZE;
+    for (int x = 0; x < CHUNK_SIZE; x++)
+        for (int y = 0; y < CHUNK_SIZE; y++)
+            for (int z = 0; z < CHUNK_SIZE; z++)
+                voxels[chunkIndex(x, y, z)] = column.blockAt(x, baseY + y, z);
+    if (hasCaves)
+        carveCaves(column, coord.y, caves, voxels);
+    decorateChunk(terrain, coord, seed, voxels);
+    chunk.blocks.encode(voxels);
+}
+
+void generateChunk(Chunk& chunk, const glm::ivec3& coord, uint32_t seed)
+{
+    TerrainNeighbourhood terrain;
+    buildTerrainNeighbourhood(glm::ivec2(coord.x, coord.z), seed, terrain);
+    generateChunk(chunk, coord, terrain, seed);
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "block_event_bus.h"
+#include "chunk.h"
+#include "chunk_generator.h"
+#include "chunk_hash_map.h"
+#include "terrain_column.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct FluidSimulation;
+struct GenerationCache;
+struct LightEngine;
+struct NavigationGraph;
+struct RegionStore;
+
+// Height of the generated world in chunks
+const int WORLD_HEIGHT_CHUNKS = 16;
+static_assert(WORLD_HEIGHT_CHUNKS <= 16, "a column's sections must fit World::occupiedSections()");
+
+// One block set through World::setBlock
+struct BlockChange {
+    glm::ivec3 block;       // World block position
+    BlockId id;
+};
+
+// A box of blocks copied out of the world, laid out as chunk voxels are
+// ([x][y][z], runs along z contiguous)
+struct BlockRegion {
+    glm::ivec3 size = glm::ivec3(0);
+    std::vector<BlockId> blocks;
+
+    int index(int x, int y, int z) const { return (x * size.y + y) * size.z + z; }
+};
+
+// Owns the voxel data of every loaded chunk. Chunks are heap-allocated, so
+// pointers handed out stay valid until releaseUnloaded() runs after the
+// chunk is unloaded.
+struct World {
+    // Loaded chunk at a chunk coordinate, or nullptr. A cold chunk is thawed
+    // first (safe from several threads at once).
+    Chunk* getChunk(const glm::ivec3& coord) const;
+    // Loaded chunk at a chunk coordinate, read from storage or generated
+    // first if needed. Only edited chunks are saved: the rest come out of
+    // the generator the same again.
+    Chunk* loadChunk(const glm::ivec3& coord);
+    // Remove a chunk from the world, saving it first if it changed. Its memory
+    // is kept until releaseUnloaded(), so a renderer drawing on another thread
+    // can still reference it.
+    void unloadChunk(const glm::ivec3& coord);
+    // Save every loaded chunk that changed since it was last saved. With a
+    // generator the chunks are snapshotted and written on its I/O thread, so
+    // this only costs the copies. Returns the number of chunks saved.
+    int saveAll();
+    // Free the chunks unloaded since the last call
+    void releaseUnloaded() { unloadedList.clear(); }
+
+    // Block at a world block position (air where no chunk is loaded)
+    BlockId getBlock(const glm::ivec3& block) const;
+    // Change one block. Marks its chunk for re-meshing, plus the neighbour
+    // sharing the face when the block is on a chunk border; any number of
+    // edits within a frame still rebuild each chunk once. 'urgent' edits
+    // (the player's) re-mesh this frame, others on the background mesher
+    // with the rest of the dirty chunks. The change is published on the
+    // block event bus for flushBlockEvents() to hand on.
+    // Returns false if the chunk isn't loaded.
+    bool setBlock(const glm::ivec3& block, BlockId id, bool urgent = true);
+    // Hand the block changes published since the last call, from any
+    // thread, to the hooks (lighting, fluids, navigation, changeLog) as one
+    // batch, one change per block in chunk order: the lighting engine
+    // relights around those
+    // where light passes differently, the fluid simulation looks at those
+    // with water on or beside them next step, the navigation graph
+    // re-summarises the columns of those that stop movement differently
+    // and the change log records them all. Call once a tick on the thread
+    // that owns the world; the hooks' own updates call it first too, so
+    // nothing they read is left on the bus.
+    void flushBlockEvents();
+
+    // Bulk edits of the box [boxMin, boxMax), for tools and generation. They
+    // work a chunk section at a time: one covering its whole chunk is set
+    // directly (a fill collapses it to uniform storage, a chunk-aligned copy
+    // takes the source's palette over), a partial one is decoded, written a
+    // row at a time and encoded again. The blocks that actually changed are
+    // published as setBlock() publishes them, but each touched chunk and border
+    // neighbour is marked once for the whole edit. Unloaded chunks are
+    // skipped. Each returns the number of blocks changed.
+    int fillBox(const glm::ivec3& boxMin, const glm::ivec3& boxMax, BlockId id, bool urgent = true);
+    // Write 'region' with its minimum corner at 'at'
+    int pasteRegion(const BlockRegion& region, const glm::ivec3& at, bool urgent = true);
+    // Copy the box so its minimum corner lands on 'destination'. Overlapping
+    // boxes copy as if through a buffer.
+    int copyBox(const glm::ivec3& boxMin, const glm::ivec3& boxMax, const glm::ivec3& destination, bool urgent = true);
+    // Blocks of the box (air where no chunk is loaded)
+    void copyRegion(const glm::ivec3& boxMin, const glm::ivec3& boxMax, BlockRegion& out) const;
+
+    // Load the chunks of every column within 'radius' of 'centerColumn', nearest
+    // columns first and at most 'maxLoads' chunks per call, and unload columns
+    // beyond radius + 1. New chunks are appended to 'loaded', the coordinates of
+    // unloaded ones to 'unloaded'. With a generator attached, missing chunks are
+    // queued on it and 'maxLoads' limits how many finished ones are picked up.
+    // Over voxelBudgetBytes the radius shrinks a ring per call, evicting the
+    // farthest columns, and grows back when the next ring fits again.
+    // New chunks start CHUNK_GENERATED and become CHUNK_READY once each
+    // neighbour is loaded or outside the streamed circle or the world; the
+    // lighting engine then lights them (CHUNK_LIT, meshable).
+    void updateStreaming(const glm::ivec2& centerColumn, int radius, int maxLoads,
+        std::vector<Chunk*>& loaded, std::vector<glm::ivec3>& unloaded);
+    // Move the chunks loaded with loadChunk() whose neighbours are all
+    // loaded (or outside the world) on to CHUNK_READY, as updateStreaming()
+    // does for its own; for a world streamed to others rather than around
+    // one centre
+    void settleLoaded() { settleWaiting(-1); }
+    // Radius the last updateStreaming() used, after the voxel budget
+    int streamingRadius() const { return streamedRadius; }
+    // Memory held by the loaded chunks' voxels and light (compressed for
+    // cold chunks)
+    size_t voxelBytes() const;
+
+    // Move up to 'maxChunks' chunks whose voxels went unread (by getChunk()
+    // or snapshotChunk()) for coldAfterTicks calls to the LZ4-compressed cold
+    // tier. Only lit chunks with no re-mesh pending qualify. Call once a
+    // tick where nothing else reads the world: the renderer, light results
+    // and workers still thaw the chunks they reach. Returns the number
+    // compressed.
+    int compressColdChunks(int maxChunks);
+    // Cold chunks among the loaded ones
+    int coldChunkCount() const;
+
+    // Sections of a chunk column (bit y for the chunk at height y) that are
+    // loaded and hold anything but air, so loops over a column and rays
+    // through it can pass the empty ones in O(1) without looking them up.
+    // Kept up to date by loads, unloads and edits; a section an edit empties
+    // keeps its bit until it is uniform air again.
+    uint16_t occupiedSections(const glm::ivec2& column) const;
+    // True if every block of the chunk at 'coord' reads as air: not loaded,
+    // above or below the world, or all air
+    bool sectionEmpty(const glm::ivec3& coord) const;
+    // Height of the highest opaque block of the block column (x, z) among
+    // the loaded chunks, -1 when there is none. Sunlight reaches everything
+    // above it at full strength, so those blocks' sky light is known without
+    // the light engine, and a cheap terrain height for anything else. Kept
+    // up to date by loads, unloads and edits.
+    int skyHeight(int x, int z) const;
+    bool skyExposed(const glm::ivec3& block) const { return block.y > skyHeight(block.x, block.z); }
+    // Lowest ground of a chunk column's block columns, the ground being the
+    // highest opaque block that isn't part of a tree (trees stand over
+    // open air): the terrain everywhere in the column reaches at least this
+    // high. -1 if a block column has none.
+    int groundHeight(const glm::ivec2& column) const;
+
+    // Decode a chunk together with the touching layers of its loaded neighbours
+    void snapshotChunk(const Chunk& chunk, ChunkVoxels& out) const;
+
+    // All loaded chunks (unordered)
+    const std::vector<Chunk*>& loadedChunks() const { return chunkList; }
+
+    // Optional background generator used by updateStreaming (not owned)
+    ChunkGenerator* generator = nullptr;
+    // Optional saved chunks, read before generating and written on unload (not
+    // owned). With a generator, give it the same store: loads and saves then
+    // run on its I/O thread.
+    RegionStore* storage = nullptr;
+    // Optional cache of generated chunks (not owned), tried by loadChunk()
+    // before generating and filled after
+    GenerationCache* generationCache = nullptr;
+    // Optional lighting engine (not owned), told about ready and unloaded
+    // chunks and block edits. Without one chunks skip from CHUNK_READY to
+    // CHUNK_LIT and stay in full sunlight.
+    LightEngine* lighting = nullptr;
+    // Optional water flow (not owned), told about ready and unloaded chunks
+    // and block edits
+    FluidSimulation* fluids = nullptr;
+    // Optional walkability summaries (not owned), told about ready and
+    // unloaded chunks and edits that change what stops movement
+    NavigationGraph* navigation = nullptr;
+    // Optional log (not owned) every block change is appended to, for a
+    // server to send on; the owner empties it
+    std::vector<BlockChange>* changeLog = nullptr;
+    // Terrain seed, fixed by benchmark scripts
+    uint32_t seed = 0;
+    // Most voxel memory the loaded chunks may hold; 0 = no limit
+    size_t voxelBudgetBytes = 0;
+    // compressColdChunks() calls a chunk must go unread before it is
+    // compressed; 0 = never
+    uint32_t coldAfterTicks = 0;
+
+private:
+    void saveChunk(Chunk& chunk);
+    // Note a read of 'chunk' and thaw it if cold
+    void touch(const Chunk& chunk) const;
+    // Bulk edit bookkeeping for the section [localMin, localMax) of 'chunk',
+    // whose blocks went from 'before' to 'after' (flat chunk copies):
+    // publish each changed block, then mark the chunk and any neighbour
+    // across a changed border. Returns the number of changed blocks.
+    int sectionEdited(Chunk& chunk, const glm::ivec3& localMin, const glm::ivec3& localMax,
+        const BlockId* before, const BlockId* after, bool urgent);
+    // Set or clear the chunk's bit in occupiedSections() ('loaded' false
+    // when it leaves the world)
+    void updateSection(const Chunk& chunk, bool loaded);
+    // Bring skyHeight() up to date for the block columns [localMin,
+    // localMax) (x and z) of a chunk that was loaded, changed or is leaving
+    // ('blocks' flat, or nullptr to read the chunk; 'loaded' false when it
+    // leaves). Call after updateSection().
+    void updateSkyHeights(const Chunk& chunk, const BlockId* blocks, const glm::ivec3& localMin,
+        const glm::ivec3& localMax, bool loaded);
+    // Streaming radius for this call: 'radius' limited by the voxel budget
+    int budgetRadius(int radius);
+    // updateStreaming() at the budgeted radius
+    void streamColumns(const glm::ivec2& centerColumn, int radius, int maxLoads,
+        std::vector<Chunk*>& loaded, std::vector<glm::ivec3>& unloaded);
+    // True once each neighbour of 'coord' is loaded, outside the world or
+    // outside the circle streamed at 'radius' (no circle below 0)
+    bool neighboursSettled(const glm::ivec3& coord, int radius) const;
+    // Move the waiting chunks whose neighbours are settled to CHUNK_READY
+    // (CHUNK_LIT without a lighting engine)
+    void settleWaiting(int radius);
+    // Adopt finished chunks from the generator that are still within 'keepRadius'
+    void collectGenerated(const glm::ivec2& centerColumn, int keepRadius, int maxResults, std::vector<Chunk*>& loaded);
+
+    ChunkHashMap<std::unique_ptr<Chunk>> chunkMap;
+    ChunkHashMap<uint16_t> columnSections;  // occupiedSections() by packed (x, 0, z); no entry when 0
+    // The highest opaque and ground blocks of each section are kept too,
+    // so a section that empties or leaves needs no voxels read from the
+    // ones below
+    struct SkyHeights {
+        int8_t sectionTop[WORLD_HEIGHT_CHUNKS][CHUNK_SIZE][CHUNK_SIZE];     // [y][x][z] within the section, -1 for none
+        int8_t sectionGround[WORLD_HEIGHT_CHUNKS][CHUNK_SIZE][CHUNK_SIZE];  // Same for ground blocks
+        int16_t top[CHUNK_SIZE][CHUNK_SIZE];    // [x][z] skyHeight()
+        int16_t lowestGround;                   // groundHeight()
+    };
+    ChunkHashMap<std::unique_ptr<SkyHeights>> skyHeights;  // By packed (x, 0, z); no entry without opaque blocks
+    std::vector<Chunk*> chunkList;
+    std::vector<std::unique_ptr<Chunk>> unloadedList; // Awaiting releaseUnloaded()
+    std::vector<Chunk*> waitingChunks;  // CHUNK_GENERATED: neighbours still loading
+    TerrainColumnCache columns;         // Of the chunks loadChunk() generated lately
+
+    // Streaming state
+    std::vector<glm::ivec2> columnOffsets; // Column offsets within the radius, nearest first
+    int offsetsRadius = -1;
+    glm::ivec2 streamCenter = glm::ivec2(0);
+    bool streamComplete = false;    // Every column in range is loaded (or queued)
+    int streamedRadius = 0;         // Radius after the voxel budget
+    ChunkHashMap<bool> pendingChunks;  // Queued on the generator
+
+    // Block changes for the hooks, published only while one is attached
+    bool hasBlockListeners() const { return lighting || fluids || navigation || changeLog; }
+    BlockEventBus blockEvents;
+    std::vector<BlockEvent> blockBatch; // flushBlockEvents() scratch
+
+    // Cold tier
+    uint32_t coldClock = 0;         // compressColdChunks() calls
+    mutable std::mutex thawMutex;   // One thaw at a time
+};
+
+// Chunk containing a world block position, and the block's position within
+// it (the shift rounds negative positions down)
+inline int floorDivChunk(int v)
+{
+    return v >> CHUNK_SHIFT;
+}
+inline glm::ivec3 chunkCoordOf(const glm::ivec3& block)
+{
+    return glm::ivec3(floorDivChunk(block.x), floorDivChunk(block.y), floorDivChunk(block.z));
+}
+inline glm::ivec3 localBlockOf(const glm::ivec3& block)
+{
+    return block & CHUNK_MASK;
+}
+
+// Pack a chunk coordinate into a 64-bit key (21 bits per axis)
+inline uint64_t packChunkCoord(const glm::ivec3& coord)
+{
+    const uint64_t mask = (1u << 21) - 1;
+    return ((uint64_t)(coord.x & mask) << 42) | ((uint64_t)(coord.y & mask) << 21) | (uint64_t)(coord.z & mask);
+}
+
+// Block reads through a one-chunk cache, for loops that touch many blocks
+// of the same chunk (collision sweeps, neighbour scans): the map is only
+// searched when the chunk changes. Valid while the chunk set stays
+// unchanged; one per thread, since World itself keeps no cache.
+struct WorldCursor {
+    explicit WorldCursor(const World& world) : world(world) {}
+
+    const Chunk* chunk(const glm::ivec3& coord)
+    {
+        if (!valid || coord != cachedCoord) {
+            cached = world.getChunk(coord);
+            cachedCoord = coord;
+            valid = true;
+        }
+        return cached;
+    }
+    bool skyExposed(const glm::ivec3& block) const { return world.skyExposed(block); }
+    // Same as World::getBlock()
+    BlockId getBlock(const glm::ivec3& block)
+    {
+        glm::ivec3 coord = chunkCoordOf(block);
+        const Chunk* found = chunk(coord);
+        if (!found)
+            return BLOCK_AIR;
+        glm::ivec3 local = block - coord * CHUNK_SIZE;
+        return found->get(local.x, local.y, local.z);
+    }
+
+private:
+    const World& world;
+    const Chunk* cached = nullptr;
+    glm::ivec3 cachedCoord = glm::ivec3(0);
+    bool valid = false;
+};
+
+// Version of generateChunk()'s output. Bump it with any change to what
+// any seed generates: it's part of the address of a generated chunk, and
+// chunks never edited are regenerated rather than saved.
+const uint32_t GENERATOR_VERSION = 3;
+
+// Hash of (seed, GENERATOR_VERSION, coordinate): names the blocks the
+// generator makes there, for caches of generated chunks
+uint64_t generatedChunkKey(uint32_t seed, const glm::ivec3& coord);
+
+// Procedural generator: a height field of fractal noise over the seed, with
+// stone below a few blocks of dirt and a grass surface, or bare stone in
+// rocky biomes, caves carved out below it (sampleCaves()), then the trees
+// of decorateChunk(). The same seed and coordinate always give the same
+// voxels. 'terrain' holds the chunk's TerrainColumn and those around it,
+// built from 'seed'; chunks above the surface and the trees, or under the
+// dirt and clear of caves, come out uniform without touching single voxels.
+void generateChunk(Chunk& chunk, const glm::ivec3& coord, const TerrainNeighbourhood& terrain, uint32_t seed);
+// Same, building the columns first (callers without a TerrainColumnCache)
+void generateChunk(Chunk& chunk, const glm::ivec3& coord, uint32_t seed);
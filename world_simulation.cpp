@@ -0,0 +1,22 @@
+#include "world_simulation.h"
+#include "world.h"
+
+void WorldSimulation::attach(World& world, JobSystem* jobs)
+{
+    world.fluids = &fluids;
+    fluids.jobs = jobs;
+    randomTicks.jobs = jobs;
+}
+
+void WorldSimulation::detach(World& world)
+{
+    if (world.fluids == &fluids)
+        world.fluids = nullptr;
+}
+
+int WorldSimulation::tick(World& world)
+{
+    int changed = fluids.tick(world);
+    changed += randomTicks.tick(world);
+    return changed;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "fluid_simulation.h"
+#include "random_ticks.h"
+
+struct JobSystem;
+struct World;
+
+// The rules that change the world on their own, stepped once per
+// simulation tick by whoever owns the world: the client playing a local
+// world or the dedicated server, never a client of a server.
+struct WorldSimulation {
+    // Hook the simulation into 'world' (told about ready and unloaded
+    // chunks and edits from then on); fluid tiles and random ticks spread
+    // over 'jobs' if given (not owned)
+    void attach(World& world, JobSystem* jobs);
+    void detach(World& world);
+
+    // One simulation tick: water flow, then random ticks. Returns the
+    // blocks changed.
+    int tick(World& world);
+
+    FluidSimulation fluids;
+    RandomTicks randomTicks;
+};